@@ -16,6 +16,51 @@
 #include "tcg/tcg.h"
 #include "exec/cpu-common.h"
 #include "exec/exec-all.h"
+#include "qmp-commands.h"
+#include "qapi/qmp/qerror.h"
+#include "qemu/error-report.h"
+#include "exec/tb-coverage.h"
+
+unsigned int tb_hot_threshold;
+
+void qmp_tb_stats_start(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+void qmp_tb_stats_stop(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+TbStatsInfo *qmp_query_tb_stats(bool has_count, int64_t count,
+                                bool has_sort, TbStatsSort sort,
+                                Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
+
+void qmp_coverage_start(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+void qmp_coverage_stop(Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+void qmp_coverage_dump(const char *filename, Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+}
+
+void tb_coverage_init(const char *path)
+{
+    error_report("-coverage is only supported with TCG");
+    exit(1);
+}
 
 void tb_flush(CPUState *cpu)
 {
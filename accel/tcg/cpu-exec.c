@@ -29,6 +29,8 @@
 #include "qemu/rcu.h"
 #include "exec/tb-hash.h"
 #include "exec/tb-lookup.h"
+#include "exec/tb-stats.h"
+#include "exec/tb-coverage.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
@@ -154,14 +156,10 @@ static inline tcg_target_ulong cpu_tb_exec(CPUState *cpu, TranslationBlock *itb)
     if (qemu_etrace_mask(ETRACE_F_CPU)) {
         /* FIXME: Create a binary representation.
                   printf is too slow!!  */
-        qemu_etracer.current_unit_id = cpu->cpu_index;
+        etrace_note_set_unit(&qemu_etracer, cpu->cpu_index);
         cpu_dump_state(cpu, (void *) &qemu_etracer,
                        etrace_note_fprintf, 0);
     }
-    if (qemu_etrace_mask(ETRACE_F_EXEC)) {
-        etrace_dump_exec_start(&qemu_etracer, cpu->cpu_index,
-                               itb->pc);
-    }
 
 
 #if defined(DEBUG_DISAS)
@@ -183,6 +181,9 @@ static inline tcg_target_ulong cpu_tb_exec(CPUState *cpu, TranslationBlock *itb)
     last_tb = (TranslationBlock *)(ret & ~TB_EXIT_MASK);
     tb_exit = ret & TB_EXIT_MASK;
     trace_exec_tb_exit(last_tb, tb_exit);
+    if (last_tb && last_tb->tb_stats) {
+        tb_stats_exit(last_tb, tb_exit);
+    }
 
     if (tb_exit > TB_EXIT_IDX1) {
         /* We didn't start executing this TB (eg because the instruction
@@ -388,6 +389,14 @@ static inline void tb_add_jump(TranslationBlock *tb, int n,
     tb_next->jmp_list_first = (uintptr_t)tb | n;
 }
 
+/* True if tb ran out of hot_count and should make way for a superblock.  */
+static inline bool tb_is_hot(TranslationBlock *tb)
+{
+    return tb_hot_threshold && atomic_read(&tb->hot_count) <= 0 &&
+           !(tb_cflags(tb) & (CF_SUPERBLOCK | CF_LAST_IO | CF_NOCACHE |
+                              CF_INVALID));
+}
+
 static inline TranslationBlock *tb_find(CPUState *cpu,
                                         TranslationBlock *last_tb,
                                         int tb_exit, uint32_t cf_mask)
@@ -395,31 +404,60 @@ static inline TranslationBlock *tb_find(CPUState *cpu,
     TranslationBlock *tb;
     target_ulong cs_base, pc;
     uint32_t flags;
+    uint32_t gen_cflags;
     bool acquired_tb_lock = false;
 
+    /* Stepping code is kept apart rather than flushed in and out.  */
+    if (unlikely(cpu->singlestep_enabled)) {
+        cf_mask |= CF_SINGLESTEP;
+    }
+    gen_cflags = cf_mask;
+
     tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, cf_mask);
-    if (tb == NULL) {
+    if (tb == NULL || unlikely(tb_is_hot(tb))) {
         /* mmap_lock is needed by tb_gen_code, and mmap_lock must be
          * taken outside tb_lock. As system emulation is currently
          * single threaded the locks are NOPs.
          */
         mmap_lock();
+
+        /* Replace a hot TB, unless another vCPU already did.  */
+        if (tb) {
+            tb_lock();
+            if (tb_is_hot(tb)) {
+                tb_phys_invalidate(tb, -1);
+                gen_cflags |= CF_SUPERBLOCK;
+            }
+            tb_unlock();
+        }
+
+#ifdef CONFIG_USER_ONLY
+        /* All threads translate with the same tcg_ctx in user mode.  */
         tb_lock();
         acquired_tb_lock = true;
+#endif
 
         /* There's a chance that our desired tb has been translated while
-         * taking the locks so we check again inside the lock.
+         * taking the locks so we check again.  In system emulation the
+         * translation itself runs without tb_lock, and tb_gen_code()
+         * returns the TB another vCPU published meanwhile, if any.
          */
         tb = tb_htable_lookup(cpu, pc, cs_base, flags, cf_mask);
         if (likely(tb == NULL)) {
             /* if no translated code available, then translate it now */
-            tb = tb_gen_code(cpu, pc, cs_base, flags, cf_mask);
+            tb = tb_gen_code(cpu, pc, cs_base, flags, gen_cflags);
         }
 
         mmap_unlock();
         /* We add the TB in the virtual pc hash table for the fast lookup */
         atomic_set(&cpu->tb_jmp_cache[tb_jmp_cache_hash_func(pc)], tb);
     }
+    /* Keeps the TB's code region off the next eviction */
+    tcg_region_touch(tb->tc.ptr);
+    /* Nothing jumps to a TB before it has been returned from here once.  */
+    if (unlikely(tb_cflags(tb) & CF_COVERAGE)) {
+        tb_coverage_mark(cpu, tb);
+    }
 #ifndef CONFIG_USER_ONLY
     /* We don't take care of direct jumps when address mapping changes in
      * system emulation. So it's not safe to make a direct jump to a TB
@@ -528,6 +566,11 @@ static inline bool cpu_handle_exception(CPUState *cpu, int *ret)
 #else
         if (replay_exception()) {
             CPUClass *cc = CPU_GET_CLASS(cpu);
+
+            if (qemu_etrace_mask(ETRACE_F_COUNTERS)) {
+                etrace_count(&qemu_etracer, cpu->cpu_index,
+                             ETRACE_CNT_EXCP, 0);
+            }
             qemu_mutex_lock_iothread();
             cc->do_interrupt(cpu);
             qemu_mutex_unlock_iothread();
@@ -611,7 +654,12 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
         else {
             if (cc->cpu_exec_interrupt(cpu, interrupt_request)) {
                 replay_interrupt();
+                cpu_poll_reset(cpu);
                 *last_tb = NULL;
+                if (qemu_etrace_mask(ETRACE_F_COUNTERS)) {
+                    etrace_count(&qemu_etracer, cpu->cpu_index,
+                                 ETRACE_CNT_IRQ, 0);
+                }
             }
             /* The target hook may have updated the 'cpu->interrupt_request';
              * reload the 'interrupt_request' value */
@@ -630,7 +678,8 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
 
     /* Finally, check if we need to exit to the main loop.  */
     if (unlikely(atomic_read(&cpu->exit_request)
-        || (use_icount && cpu->icount_decr.u16.low + cpu->icount_extra == 0))) {
+        || ((use_icount || use_icount_quantum) &&
+            cpu->icount_decr.u16.low + cpu->icount_extra == 0))) {
         atomic_set(&cpu->exit_request, 0);
         cpu->exception_index = EXCP_INTERRUPT;
         return true;
@@ -649,6 +698,11 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
     ret = cpu_tb_exec(cpu, tb);
     tb = (TranslationBlock *)(ret & ~TB_EXIT_MASK);
     *tb_exit = ret & TB_EXIT_MASK;
+    if (*tb_exit == TB_EXIT_HOT) {
+        /* tb_find() swaps the TB for a superblock; don't chain to it.  */
+        *last_tb = NULL;
+        return;
+    }
     if (*tb_exit != TB_EXIT_REQUESTED) {
         *last_tb = tb;
         return;
@@ -668,10 +722,18 @@ static inline void cpu_loop_exec_tb(CPUState *cpu, TranslationBlock *tb,
     }
 
     /* Instruction counter expired.  */
-    assert(use_icount);
+    assert(use_icount || use_icount_quantum);
 #ifndef CONFIG_USER_ONLY
     /* Ensure global icount has gone forward */
     cpu_update_icount(cpu);
+    if (use_icount_quantum && !cpu->icount_extra) {
+        /* The next TB does not fit in the quantum; stop short of its end
+         * rather than single-stepping up to it.
+         */
+        cpu->icount_decr.u16.low = 0;
+        cpu->icount_budget = 0;
+        return;
+    }
     /* Refill decrementer and continue execution.  */
     insns_left = MIN(0xffff, cpu->icount_budget);
     cpu->icount_decr.u16.low = insns_left;
@@ -735,7 +797,7 @@ int cpu_exec(CPUState *cpu)
         }
 
         if (qemu_etrace_mask(ETRACE_F_EXEC)
-            && qemu_etracer.exec_start_valid) {
+            && etrace_exec_start_valid(&qemu_etracer, cpu->cpu_index)) {
             target_ulong cs_base, pc;
             uint32_t flags;
 
@@ -768,21 +830,13 @@ int cpu_exec(CPUState *cpu)
             cpu_loop_exec_tb(cpu, tb, &last_tb, &tb_exit);
 
             if (qemu_etrace_mask(ETRACE_F_EXEC)) {
-                target_ulong cs_base, pc;
-                uint32_t flags;
-
-                if (tb_exit) {
-                    /* TB early exit, ask for CPU state.  */
-                    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
-                } else {
-                    /* TB didn't exit, assume we ran all of it.  */
-                    pc = tb->pc + tb->size;
-                }
-                etrace_dump_exec_end(&qemu_etracer,
-                                     cpu->cpu_index, pc);
+                /* Don't let time spent outside of TBs count.  */
+                etrace_exec_tb_end(&qemu_etracer, cpu->cpu_index);
+            }
+            if (qemu_etrace_mask(ETRACE_F_COUNTERS)) {
+                etrace_count(&qemu_etracer, cpu->cpu_index, ETRACE_CNT_TB, 0);
+                etrace_counters_poll(&qemu_etracer, cpu);
             }
-
-            qemu_etracer.exec_start_valid = false;
 
             /* Try to align the host and virtual clocks
                if the guest is in advance */
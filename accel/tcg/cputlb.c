@@ -26,6 +26,7 @@
 #include "exec/cpu_ldst.h"
 #include "exec/cputlb.h"
 #include "exec/memory-internal.h"
+#include "exec/mmio-profile.h"
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
 #include "qemu/error-report.h"
@@ -33,6 +34,8 @@
 #include "exec/helper-proto.h"
 #include "qemu/atomic.h"
 #include "qemu/etrace.h"
+#include "qemu/timer.h"
+#include "sysemu/cpus.h"
 
 /* DEBUG defines, enable DEBUG_TLB_LOG to log to the CPU_LOG_MMU target */
 /* #define DEBUG_TLB */
@@ -93,6 +96,178 @@ static void flush_all_helper(CPUState *src, run_on_cpu_func fn,
     }
 }
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* How long the use of a TLB is watched before it may shrink.  */
+#define TLB_WINDOW_NS (100 * SCALE_MS)
+
+static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
+                             size_t max_entries)
+{
+    desc->window_begin_ns = ns;
+    desc->window_max_entries = max_entries;
+}
+
+static void tlb_mmu_alloc(CPUArchState *env, int mmu_idx, size_t n_entries)
+{
+    env->tlb_mask[mmu_idx] = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+    env->tlb_table[mmu_idx] = g_try_new(CPUTLBEntry, n_entries);
+    env->iotlb[mmu_idx] = g_try_new(CPUIOTLBEntry, n_entries);
+}
+
+static void tlb_mmu_free(CPUArchState *env, int mmu_idx)
+{
+    g_free(env->tlb_table[mmu_idx]);
+    g_free(env->iotlb[mmu_idx]);
+    env->tlb_table[mmu_idx] = NULL;
+    env->iotlb[mmu_idx] = NULL;
+}
+
+/* Called at flush time, with the TLB empty as far as we are concerned,
+ * to pick the size of the TLB of mmu_idx for what comes next.
+ *
+ * The TLB doubles as soon as more than 70% of it was in use at a flush,
+ * so a guest that touches many pages quickly gets a TLB that holds them.
+ * It only shrinks once no flush in the last TLB_WINDOW_NS found more than
+ * 30% of it in use; it then goes down to the smallest size that would
+ * have kept that peak under 70%.  Looking at the peak over a window
+ * rather than at the last flush alone keeps a guest that flushes often
+ * (e.g. on every context switch) from shrinking a TLB it still needs.
+ *
+ * Must be called with tlb_lock held.
+ */
+static void tlb_mmu_resize_locked(CPUArchState *env, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+    size_t old_size = tlb_n_entries(env, mmu_idx);
+    size_t new_size = old_size;
+    int64_t now = get_clock_realtime();
+    bool window_expired = now > desc->window_begin_ns + TLB_WINDOW_NS;
+    size_t rate;
+
+    if (desc->n_used_entries > desc->window_max_entries) {
+        desc->window_max_entries = desc->n_used_entries;
+    }
+    rate = desc->window_max_entries * 100 / old_size;
+
+    if (rate > 70) {
+        new_size = MIN(old_size << 1, 1 << CPU_TLB_DYN_MAX_BITS);
+    } else if (rate < 30 && window_expired) {
+        size_t ceil = pow2ceil(desc->window_max_entries);
+
+        if (desc->window_max_entries * 100 / ceil > 70) {
+            ceil <<= 1;
+        }
+        new_size = MAX(ceil, 1 << CPU_TLB_DYN_MIN_BITS);
+    }
+
+    if (new_size == old_size) {
+        if (window_expired) {
+            tlb_window_reset(desc, now, desc->n_used_entries);
+        }
+        return;
+    }
+
+    tlb_mmu_free(env, mmu_idx);
+    tlb_window_reset(desc, now, 0);
+    tlb_mmu_alloc(env, mmu_idx, new_size);
+    /* Growing is only an optimisation, so fall back to smaller tables
+     * rather than failing when the host is short of memory.
+     */
+    while (!env->tlb_table[mmu_idx] || !env->iotlb[mmu_idx]) {
+        if (new_size == 1 << CPU_TLB_DYN_MIN_BITS) {
+            error_report("%s: %s", __func__, strerror(errno));
+            abort();
+        }
+        new_size >>= 1;
+        tlb_mmu_free(env, mmu_idx);
+        tlb_mmu_alloc(env, mmu_idx, new_size);
+    }
+}
+#endif
+
+void tlb_init(CPUState *cpu)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    CPUArchState *env = cpu->env_ptr;
+    int64_t now = get_clock_realtime();
+    int mmu_idx;
+
+    qemu_spin_init(&env->tlb_lock);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+
+        tlb_window_reset(&env->tlb_d[mmu_idx], now, 0);
+        env->tlb_d[mmu_idx].n_used_entries = 0;
+        tlb_mmu_alloc(env, mmu_idx, n_entries);
+        if (!env->tlb_table[mmu_idx] || !env->iotlb[mmu_idx]) {
+            error_report("%s: %s", __func__, strerror(errno));
+            abort();
+        }
+        memset(env->tlb_table[mmu_idx], -1, n_entries * sizeof(CPUTLBEntry));
+    }
+#endif
+}
+
+void tlb_destroy(CPUState *cpu)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
+
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_mmu_free(env, mmu_idx);
+    }
+#endif
+}
+
+static inline void tlb_table_lock(CPUArchState *env)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    qemu_spin_lock(&env->tlb_lock);
+#endif
+}
+
+static inline void tlb_table_unlock(CPUArchState *env)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    qemu_spin_unlock(&env->tlb_lock);
+#endif
+}
+
+static inline void tlb_n_used_entries_inc(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    env->tlb_d[mmu_idx].n_used_entries++;
+#endif
+}
+
+static inline void tlb_n_used_entries_dec(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    env->tlb_d[mmu_idx].n_used_entries--;
+#endif
+}
+
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 &&
+           te->addr_code == -1;
+}
+
+/* Flush the whole TLB of mmu_idx, resizing it first if need be.
+ * Must be called with tlb_lock held.
+ */
+static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx)
+{
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+    tlb_mmu_resize_locked(env, mmu_idx);
+    env->tlb_d[mmu_idx].n_used_entries = 0;
+#endif
+    memset(env->tlb_table[mmu_idx], -1,
+           tlb_n_entries(env, mmu_idx) * sizeof(CPUTLBEntry));
+    memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+}
+
 size_t tlb_flush_count(void)
 {
     CPUState *cpu;
@@ -114,6 +289,7 @@ size_t tlb_flush_count(void)
 static void tlb_flush_nocheck(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
 
     /* The QOM tests will trigger tlb_flushes without setting up TCG
      * so we bug out here in that case.
@@ -124,12 +300,16 @@ static void tlb_flush_nocheck(CPUState *cpu)
 
     assert_cpu_is_self(cpu);
     atomic_set(&env->tlb_flush_count, env->tlb_flush_count + 1);
+    env->tlb_flush_gen++;
     tlb_debug("(count: %zu)\n", tlb_flush_count());
 
     tb_lock();
 
-    memset(env->tlb_table, -1, sizeof(env->tlb_table));
-    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    tlb_table_lock(env);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_flush_one_mmuidx_locked(env, mmu_idx);
+    }
+    tlb_table_unlock(env);
     cpu_tb_jmp_cache_clear(cpu);
 
     env->vtlb_index = 0;
@@ -180,20 +360,22 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
+    env->tlb_flush_gen++;
 
     tb_lock();
 
     tlb_debug("start: mmu_idx:0x%04lx\n", mmu_idx_bitmask);
 
+    tlb_table_lock(env);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
 
         if (test_bit(mmu_idx, &mmu_idx_bitmask)) {
             tlb_debug("%d\n", mmu_idx);
 
-            memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
-            memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+            tlb_flush_one_mmuidx_locked(env, mmu_idx);
         }
     }
+    tlb_table_unlock(env);
 
     cpu_tb_jmp_cache_clear(cpu);
 
@@ -246,7 +428,8 @@ void tlb_flush_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
 
 
 
-static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
+/* Return true if the entry mapped addr and has been flushed.  */
+static inline bool tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
 {
     if (addr == (tlb_entry->addr_read &
                  (TARGET_PAGE_MASK | TLB_INVALID_MASK)) ||
@@ -255,17 +438,19 @@ static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong addr)
         addr == (tlb_entry->addr_code &
                  (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         memset(tlb_entry, -1, sizeof(*tlb_entry));
+        return true;
     }
+    return false;
 }
 
 static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
     target_ulong addr = (target_ulong) data.target_ptr;
-    int i;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
+    env->tlb_flush_gen++;
 
     tlb_debug("page :" TARGET_FMT_lx "\n", addr);
 
@@ -280,9 +465,10 @@ static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
     }
 
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
+        if (tlb_flush_entry(tlb_entry(env, mmu_idx, addr), addr)) {
+            tlb_n_used_entries_dec(env, mmu_idx);
+        }
     }
 
     /* check whether there are entries that need to be flushed in the vtlb */
@@ -320,18 +506,20 @@ static void tlb_flush_page_by_mmuidx_async_work(CPUState *cpu,
     target_ulong addr_and_mmuidx = (target_ulong) data.target_ptr;
     target_ulong addr = addr_and_mmuidx & TARGET_PAGE_MASK;
     unsigned long mmu_idx_bitmap = addr_and_mmuidx & ALL_MMUIDX_BITS;
-    int page = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     int mmu_idx;
     int i;
 
     assert_cpu_is_self(cpu);
+    env->tlb_flush_gen++;
 
-    tlb_debug("page:%d addr:"TARGET_FMT_lx" mmu_idx:0x%lx\n",
-              page, addr, mmu_idx_bitmap);
+    tlb_debug("addr:"TARGET_FMT_lx" mmu_idx:0x%lx\n",
+              addr, mmu_idx_bitmap);
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if (test_bit(mmu_idx, &mmu_idx_bitmap)) {
-            tlb_flush_entry(&env->tlb_table[mmu_idx][page], addr);
+            if (tlb_flush_entry(tlb_entry(env, mmu_idx, addr), addr)) {
+                tlb_n_used_entries_dec(env, mmu_idx);
+            }
 
             /* check whether there are vltb entries that need to be flushed */
             for (i = 0; i < CPU_VTLB_SIZE; i++) {
@@ -526,7 +714,8 @@ static inline void copy_tlb_helper(CPUTLBEntry *d, CPUTLBEntry *s,
 /* This is a cross vCPU call (i.e. another vCPU resetting the flags of
  * the target vCPU). As such care needs to be taken that we don't
  * dangerously race with another vCPU update. The only thing actually
- * updated is the target TLB entry ->addr_write flags.
+ * updated is the target TLB entry ->addr_write flags. tlb_lock keeps
+ * the tables from being reallocated under us.
  */
 void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
 {
@@ -535,10 +724,12 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
     int mmu_idx;
 
     env = cpu->env_ptr;
+    tlb_table_lock(env);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         unsigned int i;
+        unsigned int n = tlb_n_entries(env, mmu_idx);
 
-        for (i = 0; i < CPU_TLB_SIZE; i++) {
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                   start1, length);
         }
@@ -548,6 +739,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                   start1, length);
         }
     }
+    tlb_table_unlock(env);
 }
 
 static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
@@ -562,15 +754,13 @@ static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
     CPUArchState *env = cpu->env_ptr;
-    int i;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
 
     vaddr &= TARGET_PAGE_MASK;
-    i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+        tlb_set_dirty1(tlb_entry(env, mmu_idx, vaddr), vaddr);
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
@@ -620,6 +810,8 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     unsigned int index;
     target_ulong address;
     target_ulong code_address;
+    target_ulong vaddr_page;
+    hwaddr paddr_page;
     uintptr_t addend;
     CPUTLBEntry *te, *tv, tn;
     hwaddr iotlb, xlat, sz;
@@ -631,21 +823,37 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     CPUIOTLBEntry *attr = &env->memattr[attrs.secure];
 
     assert_cpu_is_self(cpu);
-    assert(size >= TARGET_PAGE_SIZE);
-    if (size != TARGET_PAGE_SIZE) {
-        tlb_add_large_page(env, vaddr, size);
+    if (qemu_etrace_mask(ETRACE_F_COUNTERS)) {
+        etrace_count(&qemu_etracer, cpu->cpu_index,
+                     ETRACE_CNT_TLB_MISS, mmu_idx);
     }
+    if (size < TARGET_PAGE_SIZE) {
+        sz = TARGET_PAGE_SIZE;
+    } else {
+        if (size > TARGET_PAGE_SIZE) {
+            tlb_add_large_page(env, vaddr, size);
+        }
+        sz = size;
+    }
+    vaddr_page = vaddr & TARGET_PAGE_MASK;
+    paddr_page = paddr & TARGET_PAGE_MASK;
 
-    sz = size;
-    section = address_space_translate_for_iotlb(cpu, asidx, paddr, &xlat, &sz,
-                                                &prot, &attr->attrs);
+    section = address_space_translate_for_iotlb(cpu, asidx, paddr_page,
+                                                &xlat, &sz, &prot,
+                                                &attr->attrs);
     assert(sz >= TARGET_PAGE_SIZE);
 
     tlb_debug("vaddr=" TARGET_FMT_lx " paddr=0x" TARGET_FMT_plx
               " prot=%x idx=%d sec=%d.%d\n",
               vaddr, paddr, prot, mmu_idx, attr->attrs.secure, attrs.secure);
 
-    address = vaddr;
+    address = vaddr_page;
+    if (size < TARGET_PAGE_SIZE) {
+        /* The protection only holds for part of the page: slow-path every
+         * access so that io_readx/io_writex redo the MMU check.
+         */
+        address |= TLB_RECHECK;
+    }
     if (!memory_region_is_ram(section->mr) && !memory_region_is_romd(section->mr)) {
         /* IO memory case */
         address |= TLB_MMIO;
@@ -656,11 +864,14 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     }
 
     code_address = address;
-    iotlb = memory_region_section_get_iotlb(cpu, section, vaddr, paddr, xlat,
-                                            prot, &address);
+    iotlb = memory_region_section_get_iotlb(cpu, section, vaddr_page,
+                                            paddr_page, xlat, prot, &address);
 
-    index = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    index = tlb_index(env, mmu_idx, vaddr_page);
     te = &env->tlb_table[mmu_idx][index];
+    if (tlb_entry_is_empty(te)) {
+        tlb_n_used_entries_inc(env, mmu_idx);
+    }
     /* do not discard the translation in te, evict it into a victim tlb */
     tv = &env->tlb_v_table[mmu_idx][vidx];
 
@@ -670,11 +881,14 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     env->iotlb_v[mmu_idx][vidx] = env->iotlb[mmu_idx][index];
 
     /* refill the tlb */
-    env->iotlb[mmu_idx][index].addr = iotlb - vaddr;
+    env->iotlb[mmu_idx][index].addr = iotlb - vaddr_page;
     env->iotlb[mmu_idx][index].attrs = attr->attrs;
+    env->iotlb[mmu_idx][index].etrace = qemu_etrace_mask(ETRACE_F_MEM)
+        && etrace_mem_filter(&qemu_etracer, paddr_page,
+                             paddr_page + TARGET_PAGE_SIZE - 1);
 
     /* Now calculate the new entry */
-    tn.addend = addend - vaddr;
+    tn.addend = addend - vaddr_page;
     if (prot & PAGE_READ) {
         tn.addr_read = address;
     } else {
@@ -767,16 +981,55 @@ static inline ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
 }
 
 static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
-                         int mmu_idx,
-                         target_ulong addr, uintptr_t retaddr, int size)
+                         int mmu_idx, target_ulong addr, uintptr_t retaddr,
+                         bool recheck, MMUAccessType access_type, int size)
 {
     CPUState *cpu = ENV_GET_CPU(env);
-    hwaddr physaddr = iotlbentry->addr;
-    MemoryRegion *mr = iotlb_to_region(cpu, physaddr, iotlbentry->attrs);
+    hwaddr physaddr;
+    MemoryRegion *mr;
     uint64_t val;
     bool locked = false;
+    const char *caller;
     MemTxResult r;
 
+    if (recheck) {
+        /* The MMU protection covers less than a page, so repeat the MMU
+         * check for this very address.  The fill longjmps out if the
+         * access should fault.
+         */
+        int index;
+        CPUTLBEntry *tlbe;
+        target_ulong tlb_addr;
+
+        tlb_fill(cpu, addr, access_type, mmu_idx, retaddr);
+
+        index = tlb_index(env, mmu_idx, addr);
+        tlbe = &env->tlb_table[mmu_idx][index];
+        tlb_addr = access_type == MMU_INST_FETCH ? tlbe->addr_code
+                                                 : tlbe->addr_read;
+        if (!(tlb_addr & ~(TARGET_PAGE_MASK | TLB_RECHECK))) {
+            /* RAM access */
+            void *haddr = (void *)((uintptr_t)addr + tlbe->addend);
+
+            switch (size) {
+            case 1:
+                return ldub_p(haddr);
+            case 2:
+                return lduw_p(haddr);
+            case 4:
+                return (uint32_t)ldl_p(haddr);
+            case 8:
+                return ldq_p(haddr);
+            default:
+                g_assert_not_reached();
+            }
+        }
+        /* Fall through for IO, using the refilled iotlb entry.  */
+        iotlbentry = &env->iotlb[mmu_idx][index];
+    }
+
+    physaddr = iotlbentry->addr;
+    mr = iotlb_to_region(cpu, physaddr, iotlbentry->attrs);
     physaddr = (physaddr & TARGET_PAGE_MASK) + addr;
     cpu->mem_io_pc = retaddr;
     if (mr != &io_mem_rom && mr != &io_mem_notdirty && !cpu->can_do_io) {
@@ -793,6 +1046,7 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     /* Xilinx: Make sure we first check if the MemoryRegion is an IOMMU region.
      * This is required to make sure the XMPU works as expected.
      */
+    caller = mmio_profile_caller_push("cpu");
     if (memory_region_get_iommu(mr)) {
         r = address_space_rw(cpu->as, physaddr, iotlbentry->attrs,
                              (void *) &val, size, false);
@@ -800,9 +1054,19 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         r = memory_region_dispatch_read(mr, physaddr,
                                         &val, size, iotlbentry->attrs);
     }
+    mmio_profile_caller_pop(caller);
+
+    if (mr != &io_mem_rom && mr != &io_mem_notdirty) {
+        cpu_poll_mmio_read(cpu, physaddr, val, retaddr);
+    }
+
+    if (qemu_etrace_mask(ETRACE_F_COUNTERS)) {
+        etrace_count_io(&qemu_etracer, cpu->cpu_index, mr);
+    }
 
-    if (qemu_etrace_mask(ETRACE_F_MEM)) {
-        etrace_mem_access(&qemu_etracer, 0, 0,
+    if (qemu_etrace_mask(ETRACE_F_MEM) && iotlbentry->etrace
+        && etrace_mem_sample(&qemu_etracer, cpu->cpu_index)) {
+        etrace_mem_access(&qemu_etracer, cpu->cpu_index, 0,
                           addr, size, MEM_READ, val);
     }
 
@@ -821,14 +1085,54 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
                       int mmu_idx,
                       uint64_t val, target_ulong addr,
-                      uintptr_t retaddr, int size)
+                      uintptr_t retaddr, bool recheck, int size)
 {
     CPUState *cpu = ENV_GET_CPU(env);
-    hwaddr physaddr = iotlbentry->addr;
-    MemoryRegion *mr = iotlb_to_region(cpu, physaddr, iotlbentry->attrs);
+    hwaddr physaddr;
+    MemoryRegion *mr;
     bool locked = false;
+    const char *caller;
     MemTxResult r;
 
+    if (recheck) {
+        /* As in io_readx, the MMU check has to be repeated.  */
+        int index;
+        CPUTLBEntry *tlbe;
+        target_ulong tlb_addr;
+
+        tlb_fill(cpu, addr, MMU_DATA_STORE, mmu_idx, retaddr);
+
+        index = tlb_index(env, mmu_idx, addr);
+        tlbe = &env->tlb_table[mmu_idx][index];
+        tlb_addr = tlbe->addr_write & ~TLB_INVALID_MASK;
+        if (!(tlb_addr & ~(TARGET_PAGE_MASK | TLB_RECHECK))) {
+            /* RAM access */
+            void *haddr = (void *)((uintptr_t)addr + tlbe->addend);
+
+            switch (size) {
+            case 1:
+                stb_p(haddr, val);
+                break;
+            case 2:
+                stw_p(haddr, val);
+                break;
+            case 4:
+                stl_p(haddr, val);
+                break;
+            case 8:
+                stq_p(haddr, val);
+                break;
+            default:
+                g_assert_not_reached();
+            }
+            return;
+        }
+        /* Fall through for IO, including notdirty RAM.  */
+        iotlbentry = &env->iotlb[mmu_idx][index];
+    }
+
+    physaddr = iotlbentry->addr;
+    mr = iotlb_to_region(cpu, physaddr, iotlbentry->attrs);
     physaddr = (physaddr & TARGET_PAGE_MASK) + addr;
     if (mr != &io_mem_rom && mr != &io_mem_notdirty && !cpu->can_do_io) {
         cpu_io_recompile(cpu, retaddr);
@@ -844,6 +1148,8 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     /* Xilinx: Make sure we first check if iommu_ops is avaliable. This is
      * required to make sure the XMPU works as expected.
      */
+    cpu_poll_reset(cpu);
+    caller = mmio_profile_caller_push("cpu");
     if (memory_region_get_iommu(mr)) {
         r = address_space_rw(cpu->as, physaddr, iotlbentry->attrs,
                              (void *) &val, size, true);
@@ -851,9 +1157,15 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
         r = memory_region_dispatch_write(mr, physaddr,
                                          val, size, iotlbentry->attrs);
     }
+    mmio_profile_caller_pop(caller);
 
-    if (qemu_etrace_mask(ETRACE_F_MEM)) {
-        etrace_mem_access(&qemu_etracer, 0, 0,
+    if (qemu_etrace_mask(ETRACE_F_COUNTERS)) {
+        etrace_count_io(&qemu_etracer, cpu->cpu_index, mr);
+    }
+
+    if (qemu_etrace_mask(ETRACE_F_MEM) && iotlbentry->etrace
+        && etrace_mem_sample(&qemu_etracer, cpu->cpu_index)) {
+        etrace_mem_access(&qemu_etracer, cpu->cpu_index, 0,
                           addr, size, MEM_WRITE, val);
     }
 
@@ -881,6 +1193,9 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &env->tlb_table[mmu_idx][index];
 
+            if (tlb_entry_is_empty(tlb)) {
+                tlb_n_used_entries_inc(env, mmu_idx);
+            }
             copy_tlb_helper(&tmptlb, tlb, false);
             copy_tlb_helper(tlb, vtlb, true);
             copy_tlb_helper(vtlb, &tmptlb, true);
@@ -913,14 +1228,24 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
     CPUIOTLBEntry *iotlbentry;
     hwaddr physaddr;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     mmu_idx = cpu_mmu_index(env, true);
+    index = tlb_index(env, mmu_idx, addr);
     if (unlikely(env->tlb_table[mmu_idx][index].addr_code !=
                  (addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK)))) {
         if (!VICTIM_TLB_HIT(addr_read, addr)) {
             tlb_fill(ENV_GET_CPU(env), addr, MMU_INST_FETCH, mmu_idx, 0);
+            /* The fill may have flushed, and so resized, the TLB.  */
+            index = tlb_index(env, mmu_idx, addr);
         }
     }
+    if (unlikely(env->tlb_table[mmu_idx][index].addr_code & TLB_RECHECK)) {
+        /* The MMU protection covers less than a page: check it for the
+         * address the TB starts at.  The rest of the TB is only covered
+         * by the cmmu loads in the translator, which recheck as well.
+         */
+        tlb_fill(cpu, addr, MMU_INST_FETCH, mmu_idx, 0);
+        index = tlb_index(env, mmu_idx, addr);
+    }
     iotlbentry = &env->iotlb[mmu_idx][index];
     pd = iotlbentry->addr & ~TARGET_PAGE_MASK;
     mr = iotlb_to_region(cpu, pd, iotlbentry->attrs);
@@ -969,7 +1294,7 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
 void probe_write(CPUArchState *env, target_ulong addr, int mmu_idx,
                  uintptr_t retaddr)
 {
-    int index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    int index = tlb_index(env, mmu_idx, addr);
     target_ulong tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
 
     if ((addr & TARGET_PAGE_MASK)
@@ -988,7 +1313,7 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
                                NotDirtyInfo *ndi)
 {
     size_t mmu_idx = get_mmuidx(oi);
-    size_t index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    size_t index = tlb_index(env, mmu_idx, addr);
     CPUTLBEntry *tlbe = &env->tlb_table[mmu_idx][index];
     target_ulong tlb_addr = tlbe->addr_write;
     TCGMemOp mop = get_memop(oi);
@@ -1020,12 +1345,14 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
         != (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
         if (!VICTIM_TLB_HIT(addr_write, addr)) {
             tlb_fill(ENV_GET_CPU(env), addr, MMU_DATA_STORE, mmu_idx, retaddr);
+            index = tlb_index(env, mmu_idx, addr);
+            tlbe = &env->tlb_table[mmu_idx][index];
         }
         tlb_addr = tlbe->addr_write & ~TLB_INVALID_MASK;
     }
 
-    /* Notice an IO access  */
-    if (unlikely(tlb_addr & TLB_MMIO)) {
+    /* Notice an IO access or an access that needs an MMU recheck  */
+    if (unlikely(tlb_addr & (TLB_MMIO | TLB_RECHECK))) {
         /* There's really nothing that can be done to
            support this apart from stop-the-world.  */
         goto stop_the_world;
@@ -1056,6 +1383,81 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
     cpu_loop_exit_atomic(ENV_GET_CPU(env), retaddr);
 }
 
+/* Look up the page containing ADDR for an access of ACCESS_TYPE (ELT_OFS
+ * selects the matching comparator), filling the TLB if needed.  Return
+ * the host address if the page is plain RAM with no TLB flags set, or
+ * NULL if the access needs the io/notdirty/watchpoint paths instead.
+ */
+static void *tlb_ram_addr(CPUArchState *env, target_ulong addr,
+                          size_t mmu_idx, size_t elt_ofs,
+                          MMUAccessType access_type, uintptr_t retaddr)
+{
+    size_t index = tlb_index(env, mmu_idx, addr);
+    CPUTLBEntry *entry = &env->tlb_table[mmu_idx][index];
+    target_ulong tlb_addr = *(target_ulong *)((uintptr_t)entry + elt_ofs);
+
+    if ((addr & TARGET_PAGE_MASK)
+        != (tlb_addr & (TARGET_PAGE_MASK | TLB_INVALID_MASK))) {
+        if (!victim_tlb_hit(env, mmu_idx, index, elt_ofs,
+                            addr & TARGET_PAGE_MASK)) {
+            tlb_fill(ENV_GET_CPU(env), addr, access_type, mmu_idx, retaddr);
+            index = tlb_index(env, mmu_idx, addr);
+            entry = &env->tlb_table[mmu_idx][index];
+        }
+        tlb_addr = *(target_ulong *)((uintptr_t)entry + elt_ofs)
+                   & ~TLB_INVALID_MASK;
+    }
+    if (unlikely(tlb_addr & ~TARGET_PAGE_MASK)) {
+        return NULL;
+    }
+    return (void *)((uintptr_t)addr + entry->addend);
+}
+
+/* Fast paths for an access of SIZE bytes at ADDR that crosses into the
+ * next page: look both pages up once and copy the two pieces directly
+ * when both are RAM, rather than splitting the access into recursive
+ * helper calls (loads) or bytewise stores.  Both pages are filled before
+ * any data moves, so a fault on either leaves memory untouched.  Return
+ * false if either page needs the slow path.
+ */
+static bool tlb_read_cross_page(CPUArchState *env, target_ulong addr,
+                                uint8_t *buf, int size, size_t mmu_idx,
+                                size_t elt_ofs, MMUAccessType access_type,
+                                uintptr_t retaddr)
+{
+    target_ulong addr2 = (addr + size - 1) & TARGET_PAGE_MASK;
+    int size1 = addr2 - addr;
+    void *h1, *h2;
+
+    h1 = tlb_ram_addr(env, addr, mmu_idx, elt_ofs, access_type, retaddr);
+    h2 = tlb_ram_addr(env, addr2, mmu_idx, elt_ofs, access_type, retaddr);
+    if (!h1 || !h2) {
+        return false;
+    }
+    memcpy(buf, h1, size1);
+    memcpy(buf + size1, h2, size - size1);
+    return true;
+}
+
+static bool tlb_write_cross_page(CPUArchState *env, target_ulong addr,
+                                 const uint8_t *buf, int size, size_t mmu_idx,
+                                 uintptr_t retaddr)
+{
+    target_ulong addr2 = (addr + size - 1) & TARGET_PAGE_MASK;
+    int size1 = addr2 - addr;
+    size_t elt_ofs = offsetof(CPUTLBEntry, addr_write);
+    void *h1, *h2;
+
+    h1 = tlb_ram_addr(env, addr, mmu_idx, elt_ofs, MMU_DATA_STORE, retaddr);
+    h2 = tlb_ram_addr(env, addr2, mmu_idx, elt_ofs, MMU_DATA_STORE, retaddr);
+    if (!h1 || !h2) {
+        return false;
+    }
+    memcpy(h1, buf, size1);
+    memcpy(h2, buf + size1, size - size1);
+    return true;
+}
+
 #ifdef TARGET_WORDS_BIGENDIAN
 # define TGT_BE(X)  (X)
 # define TGT_LE(X)  BSWAP(X)
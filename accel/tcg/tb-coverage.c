@@ -0,0 +1,207 @@
+/*
+ * Guest code coverage
+ *
+ * Records which bytes of guest physical memory were executed, one bit per
+ * byte in a bitmap per guest page.  A TB is accounted the first time it is
+ * looked up to be run, rather than from the generated code: every TB goes
+ * through tb_find() before anything can jump to it, so the cost is one
+ * address translation per TB and none on the execution path.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "qapi/error.h"
+#include "qemu/bitmap.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "exec/tb-coverage.h"
+#ifndef CONFIG_USER_ONLY
+#include "qmp-commands.h"
+#endif
+
+bool tb_coverage_enabled;
+
+typedef struct CoveragePage {
+    /* Guest physical address of the page, the key in the table */
+    uint64_t addr;
+    /* Executed bytes of the page, TARGET_PAGE_SIZE bits */
+    unsigned long bits[];
+} CoveragePage;
+
+/* Protects the table.  */
+static QemuMutex tb_coverage_lock;
+static GHashTable *tb_coverage;
+static const char *tb_coverage_path;
+
+static void __attribute__((constructor)) tb_coverage_init_table(void)
+{
+    qemu_mutex_init(&tb_coverage_lock);
+    tb_coverage = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                        NULL, g_free);
+}
+
+/* Called with tb_coverage_lock held.  */
+static void tb_coverage_set(hwaddr addr, unsigned int len)
+{
+    uint64_t page = addr & TARGET_PAGE_MASK;
+    CoveragePage *p;
+
+    p = g_hash_table_lookup(tb_coverage, &page);
+    if (!p) {
+        p = g_malloc0(sizeof(*p) +
+                      BITS_TO_LONGS(TARGET_PAGE_SIZE) * sizeof(unsigned long));
+        p->addr = page;
+        g_hash_table_insert(tb_coverage, &p->addr, p);
+    }
+    bitmap_set(p->bits, addr & ~TARGET_PAGE_MASK, len);
+}
+
+static hwaddr tb_coverage_phys(CPUState *cpu, target_ulong addr)
+{
+#ifdef CONFIG_USER_ONLY
+    return addr;
+#else
+    hwaddr page = cpu_get_phys_page_debug(cpu, addr & TARGET_PAGE_MASK);
+
+    return page == -1 ? -1 : page | (addr & ~TARGET_PAGE_MASK);
+#endif
+}
+
+void tb_coverage_mark(CPUState *cpu, TranslationBlock *tb)
+{
+    unsigned int len = MIN(tb->size,
+                           TARGET_PAGE_SIZE - (tb->pc & ~TARGET_PAGE_MASK));
+    hwaddr phys[2];
+
+    atomic_and(&tb->cflags, ~CF_COVERAGE);
+    if (!atomic_read(&tb_coverage_enabled)) {
+        return;
+    }
+
+    phys[0] = tb_coverage_phys(cpu, tb->pc);
+    phys[1] = len < tb->size ? tb_coverage_phys(cpu, tb->pc + len) : -1;
+
+    qemu_mutex_lock(&tb_coverage_lock);
+    if (phys[0] != -1) {
+        tb_coverage_set(phys[0], len);
+    }
+    if (phys[1] != -1) {
+        tb_coverage_set(phys[1], tb->size - len);
+    }
+    qemu_mutex_unlock(&tb_coverage_lock);
+}
+
+static gint tb_coverage_compare(gconstpointer a, gconstpointer b)
+{
+    const CoveragePage *pa = a, *pb = b;
+
+    if (pa->addr == pb->addr) {
+        return 0;
+    }
+    return pa->addr < pb->addr ? -1 : 1;
+}
+
+/* Write the executed ranges as "start end" lines, end excluded.  Ranges
+ * are merged across pages that are contiguous in physical memory.
+ */
+static int tb_coverage_dump(const char *path, Error **errp)
+{
+    unsigned long size = TARGET_PAGE_SIZE;
+    uint64_t start = 0, end = 0;
+    GList *pages, *l;
+    FILE *f;
+    int ret;
+
+    f = fopen(path, "w");
+    if (!f) {
+        error_setg_file_open(errp, errno, path);
+        return -1;
+    }
+
+    fprintf(f, "# executed guest physical code: start end\n");
+    qemu_mutex_lock(&tb_coverage_lock);
+    pages = g_list_sort(g_hash_table_get_values(tb_coverage),
+                        tb_coverage_compare);
+    for (l = pages; l; l = l->next) {
+        CoveragePage *p = l->data;
+        unsigned long bit = find_first_bit(p->bits, size);
+
+        while (bit < size) {
+            unsigned long stop = find_next_zero_bit(p->bits, size, bit);
+
+            if (start == end || end != p->addr + bit) {
+                if (start != end) {
+                    fprintf(f, "0x%" PRIx64 " 0x%" PRIx64 "\n", start, end);
+                }
+                start = p->addr + bit;
+            }
+            end = p->addr + stop;
+            bit = find_next_bit(p->bits, size, stop);
+        }
+    }
+    qemu_mutex_unlock(&tb_coverage_lock);
+    g_list_free(pages);
+
+    if (start != end) {
+        fprintf(f, "0x%" PRIx64 " 0x%" PRIx64 "\n", start, end);
+    }
+    ret = fclose(f);
+    if (ret) {
+        error_setg_errno(errp, errno, "Could not write '%s'", path);
+        return -1;
+    }
+    return 0;
+}
+
+/* TBs are flagged for coverage when they are translated, so starting only
+ * takes effect once the existing code is gone.
+ */
+static void tb_coverage_start(void)
+{
+    qemu_mutex_lock(&tb_coverage_lock);
+    g_hash_table_remove_all(tb_coverage);
+    qemu_mutex_unlock(&tb_coverage_lock);
+    atomic_set(&tb_coverage_enabled, true);
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+static void tb_coverage_atexit(void)
+{
+    Error *err = NULL;
+
+    if (tb_coverage_dump(tb_coverage_path, &err) < 0) {
+        error_report_err(err);
+    }
+}
+
+void tb_coverage_init(const char *path)
+{
+    tb_coverage_path = path;
+    tb_coverage_start();
+    atexit(tb_coverage_atexit);
+}
+
+#ifndef CONFIG_USER_ONLY
+void qmp_coverage_start(Error **errp)
+{
+    tb_coverage_start();
+}
+
+void qmp_coverage_stop(Error **errp)
+{
+    atomic_set(&tb_coverage_enabled, false);
+}
+
+void qmp_coverage_dump(const char *filename, Error **errp)
+{
+    tb_coverage_dump(filename, errp);
+}
+#endif
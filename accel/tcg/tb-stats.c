@@ -0,0 +1,223 @@
+/*
+ * Translation block statistics
+ *
+ * Counts how often each guest code block is translated and executed, what
+ * it costs to translate and how big its host code is, to find the guest
+ * code worth optimizing the front ends for.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "qemu/thread.h"
+#include "exec/tb-hash.h"
+#include "exec/tb-stats.h"
+#ifndef CONFIG_USER_ONLY
+#include "qmp-commands.h"
+#include "qapi/qmp/qerror.h"
+#endif
+
+bool tb_stats_enabled;
+
+/* Translations run in parallel.  Protects the table and the translation
+ * counters.  Entries are never freed, as TBs point to them.
+ */
+static QemuMutex tb_stats_lock;
+static GHashTable *tb_stats;
+
+static guint tb_stats_hash(gconstpointer key)
+{
+    const TBStatistics *s = key;
+
+    return tb_hash_func(s->phys_pc, s->pc, s->flags, 0, 0);
+}
+
+static gboolean tb_stats_equal(gconstpointer a, gconstpointer b)
+{
+    const TBStatistics *sa = a, *sb = b;
+
+    return sa->phys_pc == sb->phys_pc && sa->pc == sb->pc &&
+           sa->cs_base == sb->cs_base && sa->flags == sb->flags;
+}
+
+static void __attribute__((constructor)) tb_stats_init(void)
+{
+    qemu_mutex_init(&tb_stats_lock);
+    tb_stats = g_hash_table_new(tb_stats_hash, tb_stats_equal);
+}
+
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags)
+{
+    TBStatistics key = {
+        .phys_pc = phys_pc,
+        .pc = pc,
+        .cs_base = cs_base,
+        .flags = flags,
+    };
+    TBStatistics *s;
+
+    qemu_mutex_lock(&tb_stats_lock);
+    s = g_hash_table_lookup(tb_stats, &key);
+    if (!s) {
+        s = g_memdup(&key, sizeof(key));
+        g_hash_table_add(tb_stats, s);
+    }
+    qemu_mutex_unlock(&tb_stats_lock);
+    return s;
+}
+
+void tb_stats_translated(TranslationBlock *tb, int64_t ns)
+{
+    TBStatistics *s = tb->tb_stats;
+
+    qemu_mutex_lock(&tb_stats_lock);
+    s->guest_insns = tb->icount;
+    s->host_bytes = tb->tc.size;
+    s->translations++;
+    s->translate_ns += ns;
+    qemu_mutex_unlock(&tb_stats_lock);
+}
+
+#ifndef CONFIG_USER_ONLY
+static void tb_stats_clear(gpointer key, gpointer value, gpointer opaque)
+{
+    TBStatistics *s = key;
+
+    s->guest_insns = 0;
+    s->host_bytes = 0;
+    s->translations = 0;
+    s->translate_ns = 0;
+    s->executions = 0;
+    s->unchained_exits = 0;
+    s->interrupted = 0;
+    s->faults = 0;
+}
+
+/* Instrumentation is decided at translation time, so changing the state
+ * only takes effect once the existing code is gone.
+ */
+static void tb_stats_set_enabled(bool enabled)
+{
+    atomic_set(&tb_stats_enabled, enabled);
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+void qmp_tb_stats_start(Error **errp)
+{
+    qemu_mutex_lock(&tb_stats_lock);
+    g_hash_table_foreach(tb_stats, tb_stats_clear, NULL);
+    qemu_mutex_unlock(&tb_stats_lock);
+    tb_stats_set_enabled(true);
+}
+
+void qmp_tb_stats_stop(Error **errp)
+{
+    tb_stats_set_enabled(false);
+}
+
+static uint64_t tb_stats_key(const TBStatistics *s, TbStatsSort sort)
+{
+    switch (sort) {
+    case TB_STATS_SORT_HOST_COST:
+        return s->executions * s->host_bytes;
+    case TB_STATS_SORT_TRANSLATE_NS:
+        return s->translate_ns;
+    default:
+        return s->executions;
+    }
+}
+
+static gint tb_stats_compare(gconstpointer a, gconstpointer b,
+                             gpointer opaque)
+{
+    TbStatsSort sort = *(TbStatsSort *)opaque;
+    uint64_t ka = tb_stats_key(a, sort), kb = tb_stats_key(b, sort);
+
+    if (ka == kb) {
+        return 0;
+    }
+    return ka > kb ? -1 : 1;
+}
+
+static TbStatsEntry *tb_stats_entry(const TBStatistics *s)
+{
+    TbStatsEntry *e = g_new0(TbStatsEntry, 1);
+
+    e->pc = s->pc;
+    e->phys_pc = s->phys_pc;
+    e->cs_base = s->cs_base;
+    e->flags = s->flags;
+    e->guest_insns = s->guest_insns;
+    e->host_bytes = s->host_bytes;
+    e->translations = s->translations;
+    e->translate_ns = s->translate_ns;
+    e->executions = s->executions;
+    e->unchained_exits = s->unchained_exits;
+    e->interrupted = s->interrupted;
+    e->faults = s->faults;
+    return e;
+}
+
+TbStatsInfo *qmp_query_tb_stats(bool has_count, int64_t count,
+                                bool has_sort, TbStatsSort sort,
+                                Error **errp)
+{
+    TbStatsInfo *info;
+    TbStatsEntryList **tail;
+    GSequence *seq;
+    GSequenceIter *iter;
+    GHashTableIter hiter;
+    gpointer key;
+
+    if (!has_count) {
+        count = 10;
+    } else if (count < 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "count",
+                   "a non-negative number");
+        return NULL;
+    }
+    if (!has_sort) {
+        sort = TB_STATS_SORT_EXECUTIONS;
+    }
+
+    info = g_new0(TbStatsInfo, 1);
+    info->enabled = atomic_read(&tb_stats_enabled);
+    tail = &info->entries;
+
+    /* Snapshot the counters, blocks never used since the last start are
+     * left out.
+     */
+    seq = g_sequence_new(g_free);
+    qemu_mutex_lock(&tb_stats_lock);
+    g_hash_table_iter_init(&hiter, tb_stats);
+    while (g_hash_table_iter_next(&hiter, &key, NULL)) {
+        TBStatistics *s = key;
+
+        if (s->translations || s->executions) {
+            g_sequence_insert_sorted(seq, g_memdup(s, sizeof(*s)),
+                                     tb_stats_compare, &sort);
+        }
+    }
+    qemu_mutex_unlock(&tb_stats_lock);
+
+    for (iter = g_sequence_get_begin_iter(seq);
+         count-- && !g_sequence_iter_is_end(iter);
+         iter = g_sequence_iter_next(iter)) {
+        TbStatsEntryList *e = g_new0(TbStatsEntryList, 1);
+
+        e->value = tb_stats_entry(g_sequence_get(iter));
+        *tail = e;
+        tail = &e->next;
+    }
+    g_sequence_free(seq);
+    return info;
+}
+#endif
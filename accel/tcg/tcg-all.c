@@ -31,6 +31,10 @@
 #include "qom/cpu.h"
 #include "sysemu/cpus.h"
 #include "qemu/main-loop.h"
+#include "qemu/option.h"
+#include "qemu/error-report.h"
+#include "cpu.h"
+#include "exec/exec-all.h"
 
 unsigned long tcg_tb_size;
 
@@ -61,8 +65,28 @@ static void tcg_handle_interrupt(CPUState *cpu, int mask)
 }
 #endif
 
+/* Runs before qemu_tcg_configure(), so pick up what has to be known when
+   code_gen_buffer is allocated here.  */
+static void tcg_configure_hugepages(void)
+{
+    QemuOpts *opts = qemu_opts_find(qemu_find_opts("accel"), NULL);
+    const char *hp = opts ? qemu_opt_get(opts, "tb-hugepages") : NULL;
+
+    if (!hp || strcmp(hp, "thp") == 0) {
+        tb_hugepages = TB_HUGEPAGES_THP;
+    } else if (strcmp(hp, "off") == 0) {
+        tb_hugepages = TB_HUGEPAGES_OFF;
+    } else if (strcmp(hp, "hugetlb") == 0) {
+        tb_hugepages = TB_HUGEPAGES_HUGETLB;
+    } else {
+        error_report("Invalid 'tb-hugepages' option: %s", hp);
+        exit(1);
+    }
+}
+
 static int tcg_init(MachineState *ms)
 {
+    tcg_configure_hugepages();
     tcg_exec_init(tcg_tb_size * 1024 * 1024);
     cpu_interrupt_handler = tcg_handle_interrupt;
     return 0;
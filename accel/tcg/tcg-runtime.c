@@ -30,6 +30,7 @@
 #include "exec/tb-lookup.h"
 #include "disas/disas.h"
 #include "exec/log.h"
+#include "qemu/etrace.h"
 
 /* 32-bit helpers */
 
@@ -166,3 +167,11 @@ void HELPER(exit_atomic)(CPUArchState *env)
 {
     cpu_loop_exit_atomic(ENV_GET_CPU(env), GETPC());
 }
+
+void HELPER(etrace_exec_tb)(CPUArchState *env, void *opaque)
+{
+    TranslationBlock *tb = opaque;
+
+    etrace_exec_tb(&qemu_etracer, ENV_GET_CPU(env)->cpu_index,
+                   tb->pc, tb->pc + tb->size);
+}
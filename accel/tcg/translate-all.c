@@ -52,6 +52,8 @@
 
 #include "exec/cputlb.h"
 #include "exec/tb-hash.h"
+#include "exec/tb-stats.h"
+#include "exec/tb-coverage.h"
 #include "translate-all.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
@@ -158,6 +160,8 @@ TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
+unsigned int tb_hot_threshold;
+int tb_hugepages = TB_HUGEPAGES_THP;
 
 /* translation block context */
 static __thread int have_tb_lock;
@@ -335,15 +339,18 @@ static int cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
     return -1;
 
  found:
-    if (tb->cflags & CF_USE_ICOUNT) {
-        assert(use_icount);
+    if (tb->cflags & (CF_USE_ICOUNT | CF_QUANTUM)) {
+        assert(use_icount || use_icount_quantum);
         /* Reset the cycle counter to the start of the block.  */
         cpu->icount_decr.u16.low += num_insns;
         /* Clear the IO flag.  */
-        cpu->can_do_io = 0;
+        cpu->can_do_io = !(tb->cflags & CF_USE_ICOUNT);
     }
     cpu->icount_decr.u16.low -= i;
     restore_state_to_opc(env, tb, data);
+    if (tb->tb_stats) {
+        tb->tb_stats->faults++;
+    }
 
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->restore_time,
@@ -638,7 +645,9 @@ static inline void *alloc_code_gen_buffer(void)
     if (qemu_mprotect_rwx(buf, size)) {
         abort();
     }
-    qemu_madvise(buf, size, QEMU_MADV_HUGEPAGE);
+    if (tb_hugepages != TB_HUGEPAGES_OFF) {
+        qemu_madvise(buf, size, QEMU_MADV_HUGEPAGE);
+    }
 
     return buf;
 }
@@ -653,6 +662,48 @@ static inline void *alloc_code_gen_buffer(void)
     return buf;
 }
 #else
+/* Size of the huge pages the kernel hands out by default.  */
+static size_t code_gen_hpage_size(void)
+{
+    unsigned long kb = 0;
+#ifdef CONFIG_LINUX
+    gchar *meminfo;
+
+    if (g_file_get_contents("/proc/meminfo", &meminfo, NULL, NULL)) {
+        char *p = strstr(meminfo, "Hugepagesize:");
+
+        if (p) {
+            kb = strtoul(p + strlen("Hugepagesize:"), NULL, 10);
+        }
+        g_free(meminfo);
+    }
+#endif
+    return kb ? kb * 1024 : 2 * 1024 * 1024;
+}
+
+#if defined(MAP_HUGETLB) && !defined(__mips__)
+/* Map the buffer straight from the hugetlbfs pool.  The mapping reserves
+   its pages up front, so running short is reported here rather than as a
+   SIGBUS the first time a region fills up.  */
+static void *alloc_code_gen_buffer_hugetlb(void *start, int prot, int flags)
+{
+    size_t hpage = tcg_ctx->code_gen_page_size;
+    size_t size = ROUND_UP(tcg_ctx->code_gen_buffer_size, hpage);
+    void *buf;
+
+    buf = mmap(start, size, prot, flags | MAP_HUGETLB, -1, 0);
+    if (buf == MAP_FAILED) {
+        warn_report("tb-hugepages=hugetlb: cannot map %zu bytes of huge "
+                    "pages (%s), falling back to transparent huge pages",
+                    size, strerror(errno));
+        return NULL;
+    }
+    tcg_ctx->code_gen_buffer_size = size;
+    tcg_ctx->code_gen_hugetlb = true;
+    return buf;
+}
+#endif
+
 static inline void *alloc_code_gen_buffer(void)
 {
     int prot = PROT_WRITE | PROT_READ | PROT_EXEC;
@@ -689,6 +740,18 @@ static inline void *alloc_code_gen_buffer(void)
 #  endif
 # endif
 
+    if (tb_hugepages != TB_HUGEPAGES_OFF) {
+        tcg_ctx->code_gen_page_size = code_gen_hpage_size();
+    }
+#if defined(MAP_HUGETLB) && !defined(__mips__)
+    if (tb_hugepages == TB_HUGEPAGES_HUGETLB) {
+        buf = alloc_code_gen_buffer_hugetlb((void *)start, prot, flags);
+        if (buf) {
+            return buf;
+        }
+    }
+#endif
+
     buf = mmap((void *)start, size, prot, flags, -1, 0);
     if (buf == MAP_FAILED) {
         return NULL;
@@ -727,7 +790,9 @@ static inline void *alloc_code_gen_buffer(void)
 #endif
 
     /* Request large pages for the buffer.  */
-    qemu_madvise(buf, size, QEMU_MADV_HUGEPAGE);
+    if (tb_hugepages != TB_HUGEPAGES_OFF) {
+        qemu_madvise(buf, size, QEMU_MADV_HUGEPAGE);
+    }
 
     return buf;
 }
@@ -778,6 +843,7 @@ static gint tb_tc_cmp(gconstpointer ap, gconstpointer bp)
 static inline void code_gen_alloc(size_t tb_size)
 {
     tcg_ctx->code_gen_buffer_size = size_code_gen_buffer(tb_size);
+    tcg_ctx->code_gen_page_size = qemu_real_host_page_size;
     tcg_ctx->code_gen_buffer = alloc_code_gen_buffer();
     if (tcg_ctx->code_gen_buffer == NULL) {
         fprintf(stderr, "Could not allocate dynamic translator buffer\n");
@@ -815,13 +881,17 @@ void tcg_exec_init(unsigned long tb_size)
  * Allocate a new translation block. Flush the translation buffer if
  * too many translation blocks or too much generated code.
  *
- * Called with tb_lock held.
+ * Allocates from the region of this thread's tcg_ctx, so it needs no
+ * lock in system emulation. In user-mode emulation, where all threads
+ * share tcg_ctx, called with mmap_lock and tb_lock held.
  */
 static TranslationBlock *tb_alloc(target_ulong pc)
 {
     TranslationBlock *tb;
 
+#ifdef CONFIG_USER_ONLY
     assert_tb_locked();
+#endif
 
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(tb == NULL)) {
@@ -889,17 +959,10 @@ static gboolean tb_host_size_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-/* flush all the translation blocks */
-static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+/* Called with tb_lock held, from a safe-work context.  */
+static void tb_flush__locked(void)
 {
-    tb_lock();
-
-    /* If it is already been done on request of another CPU,
-     * just retry.
-     */
-    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
-        goto done;
-    }
+    CPUState *cpu;
 
     if (DEBUG_TB_FLUSH_GATE) {
         size_t nb_tbs = g_tree_nnodes(tb_ctx.tb_tree);
@@ -925,8 +988,20 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
+}
+
+/* flush all the translation blocks */
+static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    tb_lock();
+
+    /* If it is already been done on request of another CPU,
+     * just retry.
+     */
+    if (tb_ctx.tb_flush_count == tb_flush_count.host_int) {
+        tb_flush__locked();
+    }
 
-done:
     tb_unlock();
 }
 
@@ -939,6 +1014,78 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+struct tb_evict_data {
+    void *start;
+    void *end;
+    GPtrArray *tbs;
+};
+
+static gboolean tb_evict_collect(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    struct tb_evict_data *ed = data;
+
+    /* the tree is sorted by host code address */
+    if ((void *)tb->tc.ptr >= ed->end) {
+        return true;
+    }
+    if ((void *)tb->tc.ptr >= ed->start) {
+        g_ptr_array_add(ed->tbs, tb);
+    }
+    return false;
+}
+
+/*
+ * Drop all TBs whose code is in [@start, @end).  Invalidating them unlinks
+ * the TBs that jump into the range, and takes them off the hash table, the
+ * page lists and the jump caches.
+ */
+static void tb_evict_range(void *start, void *end)
+{
+    struct tb_evict_data ed = {
+        .start = start,
+        .end = end,
+        .tbs = g_ptr_array_new(),
+    };
+    guint i;
+
+    /* the TBs can't be removed while the tree is being walked */
+    g_tree_foreach(tb_ctx.tb_tree, tb_evict_collect, &ed);
+    for (i = 0; i < ed.tbs->len; i++) {
+        TranslationBlock *tb = g_ptr_array_index(ed.tbs, i);
+
+        tb_phys_invalidate(tb, -1);
+        tb_remove(tb);
+    }
+    g_ptr_array_free(ed.tbs, true);
+    tb_ctx.tb_evict_count++;
+}
+
+/*
+ * Make room in a full code buffer by evicting the least recently used
+ * regions, or flush it all if every region is still being translated into.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    tb_lock();
+
+    /* A flush requested meanwhile made all the room there is */
+    if (tb_ctx.tb_flush_count == tb_flush_count.host_int &&
+        !tcg_region_evict(tb_evict_range)) {
+        tb_flush__locked();
+    }
+
+    tb_unlock();
+}
+
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = atomic_mb_read(&tb_ctx.tb_flush_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_evict,
+                          RUN_ON_CPU_HOST_INT(tb_flush_count));
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1253,19 +1400,23 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size;
+    bool acquired_tb_lock = false;
+    int64_t stats_ti = 0;
 #ifdef CONFIG_PROFILER
     TCGProfile *prof = &tcg_ctx->prof;
     int64_t ti;
 #endif
+#ifdef CONFIG_USER_ONLY
     assert_memory_lock();
+#endif
 
     phys_pc = get_page_addr_code(env, pc);
 
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1279,7 +1430,28 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
-    tcg_ctx->tb_cflags = cflags;
+    tb->hot_count = cflags & (CF_SUPERBLOCK | CF_NOCACHE | CF_LAST_IO)
+                    ? 0 : tb_hot_threshold;
+
+    /* Decide once per TB whether etrace cares about it. gen_tb_start
+       instruments the TB accordingly.  */
+    if (qemu_etrace_mask(ETRACE_F_EXEC | ETRACE_F_TRANSLATION)
+        && etrace_exec_filter(&qemu_etracer, pc, pc)) {
+        tb->cflags |= CF_ETRACE;
+    }
+    /* Superblocks replace TBs that already ran and may cover code past
+       branches that are never taken.  */
+    if (atomic_read(&tb_coverage_enabled)
+        && !(cflags & (CF_NOCACHE | CF_SUPERBLOCK))) {
+        tb->cflags |= CF_COVERAGE;
+    }
+    tcg_ctx->tb_cflags = tb->cflags;
+
+    tb->tb_stats = NULL;
+    if (atomic_read(&tb_stats_enabled) && !(cflags & CF_NOCACHE)) {
+        tb->tb_stats = tb_stats_get(phys_pc, pc, cs_base, flags);
+        stats_ti = get_clock();
+    }
 
 #ifdef CONFIG_PROFILER
     /* includes aborted translations because of exceptions */
@@ -1327,6 +1499,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    if (tb->tb_stats) {
+        tb_stats_translated(tb, get_clock() - stats_ti);
+    }
 
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
@@ -1391,15 +1566,40 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     if ((pc & TARGET_PAGE_MASK) != virt_page2) {
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
-    /* As long as consistency of the TB stuff is provided by tb_lock in user
-     * mode and is implicit in single-threaded softmmu emulation, no explicit
-     * memory barrier is required before tb_link_page() makes the TB visible
-     * through the physical hash table and physical page list.
+
+    /* Up to here only this thread's tcg_ctx was used, so vCPUs translate
+     * in parallel. Publishing the TB needs tb_lock, which the callers
+     * replacing a TB already hold. Otherwise another vCPU may have
+     * published the same TB meanwhile: use that one, and give the space
+     * of ours back to the region, as nothing can point to it yet.
+     *
+     * A guest write to the code racing with its translation is not seen,
+     * as the page only becomes write protected when the TB is linked.
+     * Guests synchronize with the vCPU about to run code they modify,
+     * so this is only a concern for code already racing in the guest.
+     */
+    if (!have_tb_lock) {
+        TranslationBlock *existing;
+
+        tb_lock();
+        acquired_tb_lock = true;
+        existing = tb_htable_lookup(cpu, pc, cs_base, flags,
+                                    cflags & CF_HASH_MASK);
+        if (unlikely(existing)) {
+            atomic_set(&tcg_ctx->code_gen_ptr, (void *)tb);
+            tb_unlock();
+            return existing;
+        }
+    }
+
+    /* As long as consistency of the TB stuff is provided by tb_lock, no
+     * explicit memory barrier is required before tb_link_page() makes the
+     * TB visible through the physical hash table and physical page list.
      */
     tb_link_page(tb, phys_pc, phys_page2);
     g_tree_insert(tb_ctx.tb_tree, &tb->tc, tb);
 
-    if (qemu_etrace_mask(ETRACE_F_TRANSLATION)) {
+    if (qemu_etrace_mask(ETRACE_F_TRANSLATION) && (tb->cflags & CF_ETRACE)) {
         CPUState *cpu = ENV_GET_CPU(env);
         hwaddr phys_addr = pc;
 
@@ -1412,6 +1612,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                        tb->tc.ptr, gen_code_size);
     }
 
+    if (acquired_tb_lock) {
+        tb_unlock();
+    }
     return tb;
 }
 
@@ -1859,6 +2062,11 @@ static void print_qht_statistics(FILE *f, fprintf_function cpu_fprintf,
     cpu_fprintf(f, "TB hash avg chain   %0.3f buckets. Histogram: %s\n",
                 qdist_avg(&hst.chain), hgram);
     g_free(hgram);
+
+    if (hst.resize_pending) {
+        cpu_fprintf(f, "TB hash resize      %zu head buckets left to move\n",
+                    hst.resize_pending);
+    }
 }
 
 struct tb_tree_stats {
@@ -1934,6 +2142,7 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
     cpu_fprintf(f, "TB invalidate count %d\n", tb_ctx.tb_phys_invalidate_count);
+    cpu_fprintf(f, "TB region evictions %u\n", tb_ctx.tb_evict_count);
     cpu_fprintf(f, "TLB flush count     %zu\n", tlb_flush_count());
     tcg_dump_info(f, cpu_fprintf);
 
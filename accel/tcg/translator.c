@@ -31,6 +31,18 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+bool translator_follow_branch(DisasContextBase *db, target_ulong dest)
+{
+    uint32_t cflags = tb_cflags(db->tb);
+
+    if (!(cflags & CF_SUPERBLOCK) || (cflags & CF_LAST_IO) ||
+        db->singlestep_enabled || singlestep) {
+        return false;
+    }
+    return dest > db->pc_next &&
+           (dest & TARGET_PAGE_MASK) == (db->pc_first & TARGET_PAGE_MASK);
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb)
 {
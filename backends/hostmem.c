@@ -17,6 +17,8 @@
 #include "qapi-types.h"
 #include "qapi-visit.h"
 #include "qemu/config-file.h"
+#include "qemu/error-report.h"
+#include "qemu/cutils.h"
 #include "qom/object_interfaces.h"
 
 #ifdef CONFIG_NUMA
@@ -187,6 +189,12 @@ static void host_memory_backend_set_dump(Object *obj, bool value, Error **errp)
     }
 }
 
+/* Zero lets the number of vCPUs bound the preallocation threads */
+static int host_memory_backend_prealloc_threads(HostMemoryBackend *backend)
+{
+    return backend->prealloc_threads ? backend->prealloc_threads : smp_cpus;
+}
+
 static bool host_memory_backend_get_prealloc(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -218,7 +226,9 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
         void *ptr = memory_region_get_ram_ptr(&backend->mr);
         uint64_t sz = memory_region_size(&backend->mr);
 
-        os_mem_prealloc(fd, ptr, sz, smp_cpus, &local_err);
+        os_mem_prealloc(fd, ptr, sz,
+                        host_memory_backend_prealloc_threads(backend),
+                        &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -227,6 +237,52 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 }
 
+static void
+host_memory_backend_get_prealloc_threads(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    visit_type_uint32(v, name, &backend->prealloc_threads, errp);
+}
+
+static void
+host_memory_backend_set_prealloc_threads(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+    Error *local_err = NULL;
+    uint32_t value;
+
+    visit_type_uint32(v, name, &value, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    backend->prealloc_threads = value;
+}
+
+static bool host_memory_backend_get_prealloc_async(Object *obj, Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    return backend->prealloc_async;
+}
+
+static void host_memory_backend_set_prealloc_async(Object *obj, bool value,
+                                                   Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(obj);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    backend->prealloc_async = value;
+}
+
 static void host_memory_backend_init(Object *obj)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -262,6 +318,77 @@ bool host_memory_backend_is_mapped(HostMemoryBackend *backend)
     return backend->is_mapped;
 }
 
+bool host_memory_backend_get_host_cpus(HostMemoryBackend *backend,
+                                       unsigned long *host_cpus,
+                                       unsigned long nbits, Error **errp)
+{
+#ifdef CONFIG_LINUX
+    unsigned long node, first, last;
+    bool found = false;
+
+    for (node = find_first_bit(backend->host_nodes, MAX_NODES);
+         node < MAX_NODES;
+         node = find_next_bit(backend->host_nodes, MAX_NODES, node + 1)) {
+        char *path, *list, **ranges;
+        const char *end;
+        int i;
+
+        /* A list of ranges such as "0-3,8-11" */
+        path = g_strdup_printf("/sys/devices/system/node/node%lu/cpulist",
+                               node);
+        if (!g_file_get_contents(path, &list, NULL, NULL)) {
+            error_setg(errp, "Unable to read the CPUs of host node %lu from "
+                       "%s", node, path);
+            g_free(path);
+            return false;
+        }
+        g_free(path);
+
+        ranges = g_strsplit(g_strstrip(list), ",", -1);
+        g_free(list);
+        /* Memory-only nodes have an empty list */
+        for (i = 0; ranges[i] && *ranges[i]; i++) {
+            if (qemu_strtoul(ranges[i], &end, 10, &first) < 0) {
+                break;
+            }
+            last = first;
+            if (*end == '-' && qemu_strtoul(end + 1, &end, 10, &last) < 0) {
+                break;
+            }
+            for (; first <= last && first < nbits; first++) {
+                set_bit(first, host_cpus);
+                found = true;
+            }
+        }
+        if (ranges[i] && *ranges[i]) {
+            error_setg(errp, "Unexpected CPU list '%s' for host node %lu",
+                       ranges[i], node);
+            g_strfreev(ranges);
+            return false;
+        }
+        g_strfreev(ranges);
+    }
+    return found;
+#else
+    error_setg(errp, "Host node CPUs are not known on this host");
+    return false;
+#endif
+}
+
+static void host_memory_backend_prealloc_done(Notifier *notifier, void *data)
+{
+    HostMemoryBackend *backend = container_of(notifier, HostMemoryBackend,
+                                              prealloc_done);
+    Error *local_err = NULL;
+
+    os_mem_prealloc_wait(backend->prealloc_job, &local_err);
+    backend->prealloc_job = NULL;
+    if (local_err) {
+        error_report_err(local_err);
+        exit(1);
+    }
+}
+
 static void
 host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
 {
@@ -330,10 +457,27 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
          * specified NUMA policy in place.
          */
         if (backend->prealloc) {
-            os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            smp_cpus, &local_err);
-            if (local_err) {
-                goto out;
+            int fd = memory_region_get_fd(&backend->mr);
+            int threads = host_memory_backend_prealloc_threads(backend);
+
+            /* The guest cannot run before machine init is done, so
+             * device creation can go on while the pages are touched.
+             */
+            if (backend->prealloc_async && !qdev_hotplug) {
+                backend->prealloc_job = os_mem_prealloc_start(fd, ptr, sz,
+                                                              threads,
+                                                              &local_err);
+                if (local_err) {
+                    goto out;
+                }
+                backend->prealloc_done.notify =
+                    host_memory_backend_prealloc_done;
+                qemu_add_machine_init_done_notifier(&backend->prealloc_done);
+            } else {
+                os_mem_prealloc(fd, ptr, sz, threads, &local_err);
+                if (local_err) {
+                    goto out;
+                }
             }
         }
     }
@@ -386,6 +530,13 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
     object_class_property_add_bool(oc, "prealloc",
         host_memory_backend_get_prealloc,
         host_memory_backend_set_prealloc, &error_abort);
+    object_class_property_add(oc, "prealloc-threads", "int",
+        host_memory_backend_get_prealloc_threads,
+        host_memory_backend_set_prealloc_threads,
+        NULL, NULL, &error_abort);
+    object_class_property_add_bool(oc, "prealloc-async",
+        host_memory_backend_get_prealloc_async,
+        host_memory_backend_set_prealloc_async, &error_abort);
     object_class_property_add(oc, "size", "int",
         host_memory_backend_get_size,
         host_memory_backend_set_size,
@@ -404,6 +555,11 @@ host_memory_backend_class_init(ObjectClass *oc, void *data)
 static void host_memory_backend_finalize(Object *o)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(o);
+
+    if (backend->prealloc_job) {
+        qemu_remove_machine_init_done_notifier(&backend->prealloc_done);
+        os_mem_prealloc_wait(backend->prealloc_job, NULL);
+    }
     g_free(backend->id);
 }
 
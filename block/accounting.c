@@ -27,6 +27,7 @@
 #include "block/accounting.h"
 #include "block/block_int.h"
 #include "qemu/timer.h"
+#include "qemu/host-utils.h"
 #include "sysemu/qtest.h"
 
 static QEMUClockType clock_type = QEMU_CLOCK_REALTIME;
@@ -94,6 +95,22 @@ void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
     cookie->type = type;
 }
 
+static void block_acct_histogram_account(BlockAcctHistogram *hist,
+                                         int64_t latency_ns)
+{
+    uint64_t latency_us = MAX(latency_ns, 0) / SCALE_US;
+    unsigned bin = latency_us ? 64 - clz64(latency_us) : 0;
+
+    hist->bins[MIN(bin, BLOCK_ACCT_HISTOGRAM_BINS - 1)]++;
+}
+
+/* Upper bound of @bin in nanoseconds, the last bin has none */
+uint64_t block_acct_histogram_boundary(unsigned bin)
+{
+    assert(bin < BLOCK_ACCT_HISTOGRAM_BINS - 1);
+    return (1ULL << bin) * SCALE_US;
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
@@ -119,6 +136,8 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
     if (!failed || stats->account_failed) {
         stats->total_time_ns[cookie->type] += latency_ns;
         stats->last_access_time_ns = time_ns;
+        block_acct_histogram_account(
+            &stats->latency_histogram[cookie->type], latency_ns);
 
         QSLIST_FOREACH(s, &stats->intervals, entries) {
             timed_average_account(&s->latency[cookie->type], latency_ns);
@@ -138,6 +157,26 @@ void block_acct_failed(BlockAcctStats *stats, BlockAcctCookie *cookie)
     block_account_one_io(stats, cookie, true);
 }
 
+/* Accounts the time a request spent in the block layer, devices that do
+ * not account their requests themselves get their latency from this too.
+ */
+void block_acct_backend_done(BlockAcctStats *stats, BlockAcctCookie *cookie)
+{
+    int64_t latency_ns = qemu_clock_get_ns(clock_type) -
+                         cookie->start_time_ns;
+
+    if (qtest_enabled()) {
+        latency_ns = qtest_latency_ns;
+    }
+
+    assert(cookie->type < BLOCK_MAX_IOTYPE);
+
+    qemu_mutex_lock(&stats->lock);
+    block_acct_histogram_account(
+        &stats->backend_latency_histogram[cookie->type], latency_ns);
+    qemu_mutex_unlock(&stats->lock);
+}
+
 void block_acct_invalid(BlockAcctStats *stats, enum BlockAcctType type)
 {
     assert(type < BLOCK_MAX_IOTYPE);
@@ -1084,6 +1084,7 @@ int coroutine_fn blk_co_preadv(BlockBackend *blk, int64_t offset,
                                unsigned int bytes, QEMUIOVector *qiov,
                                BdrvRequestFlags flags)
 {
+    BlockAcctCookie acct;
     int ret;
     BlockDriverState *bs = blk_bs(blk);
 
@@ -1102,7 +1103,9 @@ int coroutine_fn blk_co_preadv(BlockBackend *blk, int64_t offset,
                 bytes, false);
     }
 
+    block_acct_start(&blk->stats, &acct, bytes, BLOCK_ACCT_READ);
     ret = bdrv_co_preadv(blk->root, offset, bytes, qiov, flags);
+    block_acct_backend_done(&blk->stats, &acct);
     bdrv_dec_in_flight(bs);
     return ret;
 }
@@ -1111,6 +1114,7 @@ int coroutine_fn blk_co_pwritev(BlockBackend *blk, int64_t offset,
                                 unsigned int bytes, QEMUIOVector *qiov,
                                 BdrvRequestFlags flags)
 {
+    BlockAcctCookie acct;
     int ret;
     BlockDriverState *bs = blk_bs(blk);
 
@@ -1132,7 +1136,9 @@ int coroutine_fn blk_co_pwritev(BlockBackend *blk, int64_t offset,
         flags |= BDRV_REQ_FUA;
     }
 
+    block_acct_start(&blk->stats, &acct, bytes, BLOCK_ACCT_WRITE);
     ret = bdrv_co_pwritev(blk->root, offset, bytes, qiov, flags);
+    block_acct_backend_done(&blk->stats, &acct);
     bdrv_dec_in_flight(bs);
     return ret;
 }
@@ -1499,11 +1505,17 @@ int blk_co_pdiscard(BlockBackend *blk, int64_t offset, int bytes)
 
 int blk_co_flush(BlockBackend *blk)
 {
+    BlockAcctCookie acct;
+    int ret;
+
     if (!blk_is_available(blk)) {
         return -ENOMEDIUM;
     }
 
-    return bdrv_co_flush(blk_bs(blk));
+    block_acct_start(&blk->stats, &acct, 0, BLOCK_ACCT_FLUSH);
+    ret = bdrv_co_flush(blk_bs(blk));
+    block_acct_backend_done(&blk->stats, &acct);
+    return ret;
 }
 
 static void blk_flush_entry(void *opaque)
@@ -389,6 +389,29 @@ static void bdrv_query_info(BlockBackend *blk, BlockInfo **p_info,
     qapi_free_BlockInfo(info);
 }
 
+/* Called with the lock of @stats held */
+static BlockLatencyHistogramInfo *
+bdrv_latency_histogram_info(BlockAcctHistogram *hist)
+{
+    BlockLatencyHistogramInfo *info = g_new0(BlockLatencyHistogramInfo, 1);
+    uint64List **boundaries = &info->boundaries;
+    uint64List **bins = &info->bins;
+    unsigned i;
+
+    for (i = 0; i < BLOCK_ACCT_HISTOGRAM_BINS; i++) {
+        *bins = g_new0(uint64List, 1);
+        (*bins)->value = hist->bins[i];
+        bins = &(*bins)->next;
+
+        if (i < BLOCK_ACCT_HISTOGRAM_BINS - 1) {
+            *boundaries = g_new0(uint64List, 1);
+            (*boundaries)->value = block_acct_histogram_boundary(i);
+            boundaries = &(*boundaries)->next;
+        }
+    }
+    return info;
+}
+
 static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
 {
     BlockAcctStats *stats = blk_get_stats(blk);
@@ -423,6 +446,27 @@ static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
     ds->account_invalid = stats->account_invalid;
     ds->account_failed = stats->account_failed;
 
+    qemu_mutex_lock(&stats->lock);
+    ds->has_rd_latency_histogram = true;
+    ds->rd_latency_histogram = bdrv_latency_histogram_info(
+        &stats->latency_histogram[BLOCK_ACCT_READ]);
+    ds->has_wr_latency_histogram = true;
+    ds->wr_latency_histogram = bdrv_latency_histogram_info(
+        &stats->latency_histogram[BLOCK_ACCT_WRITE]);
+    ds->has_flush_latency_histogram = true;
+    ds->flush_latency_histogram = bdrv_latency_histogram_info(
+        &stats->latency_histogram[BLOCK_ACCT_FLUSH]);
+    ds->has_rd_backend_latency_histogram = true;
+    ds->rd_backend_latency_histogram = bdrv_latency_histogram_info(
+        &stats->backend_latency_histogram[BLOCK_ACCT_READ]);
+    ds->has_wr_backend_latency_histogram = true;
+    ds->wr_backend_latency_histogram = bdrv_latency_histogram_info(
+        &stats->backend_latency_histogram[BLOCK_ACCT_WRITE]);
+    ds->has_flush_backend_latency_histogram = true;
+    ds->flush_backend_latency_histogram = bdrv_latency_histogram_info(
+        &stats->backend_latency_histogram[BLOCK_ACCT_FLUSH]);
+    qemu_mutex_unlock(&stats->lock);
+
     while ((ts = block_acct_interval_next(stats, ts))) {
         BlockDeviceTimedStatsList *timed_stats =
             g_malloc0(sizeof(*timed_stats));
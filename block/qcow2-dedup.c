@@ -0,0 +1,217 @@
+/*
+ * Deduplication of the data clusters written to a qcow2 image
+ *
+ * Full clusters written by the guest are hashed.  When a cluster written
+ * earlier in this session has the same content, the guest cluster is
+ * mapped to it instead of a new one, sharing it the way internal snapshots
+ * do: its refcount is raised and QCOW_OFLAG_COPIED is cleared, so the next
+ * write to either guest cluster copies it again.  The result is a plain
+ * qcow2 image that any reader understands.
+ *
+ * The index lives in memory only, it is built from the writes made while
+ * the option is set and needs a few dozen bytes per written cluster.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "crypto/hash.h"
+#include "block/block_int.h"
+#include "block/qcow2.h"
+
+typedef struct Qcow2DedupEntry {
+    /* Both are used as keys of the hash tables, keep them first */
+    uint64_t hash;
+    uint64_t host_offset;
+    /* A guest cluster mapping host_offset */
+    uint64_t guest_offset;
+} Qcow2DedupEntry;
+
+void qcow2_dedup_init(BDRVQcow2State *s)
+{
+    if (s->dedup_offsets) {
+        return;
+    }
+    s->dedup_hashes = g_hash_table_new(g_int64_hash, g_int64_equal);
+    s->dedup_offsets = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             NULL, g_free);
+}
+
+void qcow2_dedup_close(BDRVQcow2State *s)
+{
+    if (!s->dedup_offsets) {
+        return;
+    }
+    g_hash_table_destroy(s->dedup_hashes);
+    g_hash_table_destroy(s->dedup_offsets);
+    s->dedup_hashes = NULL;
+    s->dedup_offsets = NULL;
+}
+
+/* The first 64 bits of the SHA-256 of the cluster.  Collisions only cost
+ * a read, candidates are compared byte for byte before being shared.
+ */
+static uint64_t qcow2_dedup_hash(const uint8_t *buf, size_t len)
+{
+    uint8_t digest[32];
+    uint8_t *result = digest;
+    size_t result_len = sizeof(digest);
+
+    if (qcrypto_hash_bytes(QCRYPTO_HASH_ALG_SHA256, (const char *)buf, len,
+                           &result, &result_len, NULL) < 0) {
+        return 0;
+    }
+    return ldq_be_p(digest);
+}
+
+void qcow2_dedup_forget(BDRVQcow2State *s, uint64_t host_offset)
+{
+    Qcow2DedupEntry *e;
+
+    if (!s->dedup_offsets) {
+        return;
+    }
+    e = g_hash_table_lookup(s->dedup_offsets, &host_offset);
+    if (!e) {
+        return;
+    }
+    if (g_hash_table_lookup(s->dedup_hashes, &e->hash) == e) {
+        g_hash_table_remove(s->dedup_hashes, &e->hash);
+    }
+    g_hash_table_remove(s->dedup_offsets, &host_offset);
+}
+
+void qcow2_dedup_insert(BDRVQcow2State *s, uint64_t hash,
+                        uint64_t host_offset, uint64_t guest_offset)
+{
+    Qcow2DedupEntry *e;
+
+    if (!s->dedup_offsets) {
+        return;
+    }
+
+    /* The cluster was rewritten in place, whatever it held is gone */
+    qcow2_dedup_forget(s, host_offset);
+    if (g_hash_table_contains(s->dedup_hashes, &hash)) {
+        return;
+    }
+
+    e = g_new(Qcow2DedupEntry, 1);
+    e->hash = hash;
+    e->host_offset = host_offset;
+    e->guest_offset = guest_offset;
+    g_hash_table_insert(s->dedup_offsets, &e->host_offset, e);
+    g_hash_table_insert(s->dedup_hashes, &e->hash, e);
+}
+
+/* Requests writing the guest cluster in flight, other than ours.  Those
+ * may have looked up the host cluster before it lost QCOW_OFLAG_COPIED and
+ * would then overwrite it in place.  New writes wait for s->lock and see
+ * the flag cleared.
+ */
+static bool coroutine_fn qcow2_dedup_owner_busy(BlockDriverState *bs,
+                                                uint64_t offset,
+                                                uint64_t bytes)
+{
+    BdrvTrackedRequest *req;
+    bool busy = false;
+
+    qemu_co_mutex_lock(&bs->reqs_lock);
+    QLIST_FOREACH(req, &bs->tracked_requests, list) {
+        if (req->type != BDRV_TRACKED_READ &&
+            req->co != qemu_coroutine_self() &&
+            req->offset < offset + bytes &&
+            offset < req->offset + req->bytes) {
+            busy = true;
+            break;
+        }
+    }
+    qemu_co_mutex_unlock(&bs->reqs_lock);
+    return busy;
+}
+
+/*
+ * Called with s->lock held for a write of a whole guest cluster at
+ * @offset, whose data is at @qiov_offset in @qiov.  Stores the hash of the
+ * data in @hash for qcow2_dedup_insert().
+ *
+ * Returns 1 if the guest cluster now maps an existing cluster with the
+ * same content and nothing is left to write, 0 if the caller must write
+ * it and -errno on failure.
+ */
+int coroutine_fn qcow2_dedup_write(BlockDriverState *bs, uint64_t offset,
+                                   QEMUIOVector *qiov, uint64_t qiov_offset,
+                                   uint64_t *hash)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2DedupEntry *e;
+    QEMUIOVector hd_qiov;
+    struct iovec iov;
+    uint8_t *buf;
+    int ret;
+
+    buf = qemu_try_blockalign(bs->file->bs, 2 * s->cluster_size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+    qemu_iovec_to_buf(qiov, qiov_offset, buf, s->cluster_size);
+    *hash = qcow2_dedup_hash(buf, s->cluster_size);
+
+    ret = 0;
+    e = g_hash_table_lookup(s->dedup_hashes, hash);
+    if (!e || e->guest_offset == offset) {
+        goto out;
+    }
+    if (qcow2_check_metadata_overlap(bs, 0, e->host_offset,
+                                     s->cluster_size)) {
+        qcow2_dedup_forget(s, e->host_offset);
+        goto out;
+    }
+    if (qcow2_dedup_owner_busy(bs, e->guest_offset, s->cluster_size)) {
+        goto out;
+    }
+
+    /* s->lock stays held so that the candidate cannot be freed or
+     * rewritten between the comparison and the L2 update.
+     */
+    iov = (struct iovec) {
+        .iov_base   = buf + s->cluster_size,
+        .iov_len    = s->cluster_size,
+    };
+    qemu_iovec_init_external(&hd_qiov, &iov, 1);
+    BLKDBG_EVENT(bs->file, BLKDBG_READ_AIO);
+    ret = bdrv_co_preadv(bs->file, e->host_offset, s->cluster_size,
+                         &hd_qiov, 0);
+    if (ret < 0) {
+        goto out;
+    }
+    if (memcmp(buf, buf + s->cluster_size, s->cluster_size)) {
+        qcow2_dedup_forget(s, e->host_offset);
+        ret = 0;
+        goto out;
+    }
+
+    ret = qcow2_share_cluster(bs, offset, e->host_offset, e->guest_offset);
+    switch (ret) {
+    case 0:
+        ret = 1;
+        break;
+    case -ENOENT:
+        qcow2_dedup_forget(s, e->host_offset);
+        /* fall through */
+    case -EAGAIN:
+    case -EINVAL:
+        /* -EINVAL: the refcount cannot go any higher */
+        ret = 0;
+        break;
+    }
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
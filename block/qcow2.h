@@ -100,8 +100,10 @@
 #define QCOW2_OPT_OVERLAP_INACTIVE_L2 "overlap-check.inactive-l2"
 #define QCOW2_OPT_CACHE_SIZE "cache-size"
 #define QCOW2_OPT_L2_CACHE_SIZE "l2-cache-size"
+#define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_DEDUP "x-dedup"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -253,6 +255,7 @@ typedef struct BDRVQcow2State {
     int cluster_sectors;
     int l2_bits;
     int l2_size;
+    int l2_slice_size; /* entries per L2 cache entry */
     int l1_size;
     int l1_vm_state_index;
     int refcount_block_bits;
@@ -282,6 +285,12 @@ typedef struct BDRVQcow2State {
 
     CoMutex lock;
 
+    /* Clusters being compressed in the thread pool, and the requests
+     * waiting for a thread.
+     */
+    int nb_compress_threads;
+    CoQueue compress_wait_queue;
+
     Qcow2CryptoHeaderExtension crypto_header; /* QCow2 header extension */
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
     QCryptoBlock *crypto; /* Disk encryption format driver */
@@ -327,6 +336,11 @@ typedef struct BDRVQcow2State {
      * override) */
     char *image_backing_file;
     char *image_backing_format;
+
+    /* Data clusters written in this session by content hash and by host
+     * offset, NULL unless x-dedup is set */
+    GHashTable *dedup_hashes;
+    GHashTable *dedup_offsets;
 } BDRVQcow2State;
 
 typedef struct Qcow2COWRegion {
@@ -468,6 +482,11 @@ static inline int offset_to_l2_index(BDRVQcow2State *s, int64_t offset)
     return (offset >> s->cluster_bits) & (s->l2_size - 1);
 }
 
+static inline int offset_to_l2_slice_index(BDRVQcow2State *s, int64_t offset)
+{
+    return (offset >> s->cluster_bits) & (s->l2_slice_size - 1);
+}
+
 static inline int64_t align_offset(int64_t offset, int n)
 {
     offset = (offset + n - 1) & ~(n - 1);
@@ -604,6 +623,9 @@ int qcow2_encrypt_sectors(BDRVQcow2State *s, int64_t sector_num,
 
 int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
                              unsigned int *bytes, uint64_t *cluster_offset);
+int qcow2_get_cluster_offset_cached(BlockDriverState *bs, uint64_t offset,
+                                    unsigned int *bytes,
+                                    uint64_t *cluster_offset);
 int qcow2_alloc_cluster_offset(BlockDriverState *bs, uint64_t offset,
                                unsigned int *bytes, uint64_t *host_offset,
                                QCowL2Meta **m);
@@ -612,6 +634,8 @@ uint64_t qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs,
                                          int compressed_size);
 
 int qcow2_alloc_cluster_link_l2(BlockDriverState *bs, QCowL2Meta *m);
+int qcow2_share_cluster(BlockDriverState *bs, uint64_t offset,
+                        uint64_t host_offset, uint64_t owner_offset);
 int qcow2_cluster_discard(BlockDriverState *bs, uint64_t offset,
                           uint64_t bytes, enum qcow2_discard_type type,
                           bool full_discard);
@@ -639,7 +663,8 @@ void qcow2_free_snapshots(BlockDriverState *bs);
 int qcow2_read_snapshots(BlockDriverState *bs);
 
 /* qcow2-cache.c functions */
-Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables);
+Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
+                               unsigned table_size);
 int qcow2_cache_destroy(BlockDriverState* bs, Qcow2Cache *c);
 
 void qcow2_cache_entry_mark_dirty(BlockDriverState *bs, Qcow2Cache *c,
@@ -657,10 +682,24 @@ int qcow2_cache_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
 int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     void **table);
+int qcow2_cache_get_cached(BlockDriverState *bs, Qcow2Cache *c,
+                           uint64_t offset, void **table);
 void qcow2_cache_put(BlockDriverState *bs, Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(BlockDriverState *bs, Qcow2Cache *c,
                                   uint64_t offset);
 void qcow2_cache_discard(BlockDriverState *bs, Qcow2Cache *c, void *table);
+void qcow2_cache_discard_cluster(BlockDriverState *bs, Qcow2Cache *c,
+                                 uint64_t cluster_offset);
+
+/* qcow2-dedup.c functions */
+void qcow2_dedup_init(BDRVQcow2State *s);
+void qcow2_dedup_close(BDRVQcow2State *s);
+void qcow2_dedup_insert(BDRVQcow2State *s, uint64_t hash,
+                        uint64_t host_offset, uint64_t guest_offset);
+void qcow2_dedup_forget(BDRVQcow2State *s, uint64_t host_offset);
+int coroutine_fn qcow2_dedup_write(BlockDriverState *bs, uint64_t offset,
+                                   QEMUIOVector *qiov, uint64_t qiov_offset,
+                                   uint64_t *hash);
 
 /* qcow2-bitmap.c functions */
 int qcow2_check_bitmaps_refcounts(BlockDriverState *bs, BdrvCheckResult *res,
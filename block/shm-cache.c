@@ -0,0 +1,380 @@
+/*
+ * Host-wide shared memory cache for read-only images
+ *
+ * The filter keeps the clusters read from its child in a file that every
+ * QEMU instance opening the same image with the same cache path maps
+ * shared, typically on tmpfs.  Clusters read by one instance are then
+ * served to all the others from memory, without going through the child
+ * format and the host page cache again.
+ *
+ * The file holds a header, one state word per cluster and the clusters
+ * themselves at fixed places, so that it stays sparse.  The state words
+ * are the only thing the instances synchronize on: the first reader of a
+ * cluster claims it with a compare-and-swap, reads it into the file and
+ * then publishes it.  Readers that find a cluster being filled read from
+ * the child themselves.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/file.h>
+#include "qapi/error.h"
+#include "qemu/option.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/host-utils.h"
+#include "block/block_int.h"
+
+#define SHM_CACHE_MAGIC         0x5153484d43414348ULL   /* QSHMCACH */
+#define SHM_CACHE_VERSION       1
+#define SHM_CACHE_HEADER_SIZE   4096
+#define SHM_CACHE_TAG_SIZE      1024
+
+#define SHM_CACHE_OPT_PATH          "path"
+#define SHM_CACHE_OPT_CLUSTER_SIZE  "cluster-size"
+
+/* States of a cluster in the cache */
+enum {
+    SHM_CACHE_EMPTY,
+    SHM_CACHE_FILLING,
+    SHM_CACHE_VALID,
+};
+
+typedef struct ShmCacheHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t cluster_size;
+    uint64_t length;
+    uint64_t index_offset;
+    uint64_t data_offset;
+    /* Filename of the cached image, NUL terminated */
+    char tag[SHM_CACHE_TAG_SIZE];
+} ShmCacheHeader;
+
+QEMU_BUILD_BUG_ON(sizeof(ShmCacheHeader) > SHM_CACHE_HEADER_SIZE);
+
+typedef struct BDRVShmCacheState {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    uint32_t *index;
+    uint8_t *data;
+    uint32_t cluster_size;
+    uint64_t length;
+} BDRVShmCacheState;
+
+static QemuOptsList shm_cache_opts = {
+    .name = "shm-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(shm_cache_opts.head),
+    .desc = {
+        {
+            .name = SHM_CACHE_OPT_PATH,
+            .type = QEMU_OPT_STRING,
+            .help = "Path of the file shared by the instances",
+        },
+        {
+            .name = SHM_CACHE_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Cache granularity (default: 64k)",
+        },
+        { /* end of list */ }
+    },
+};
+
+static void shm_cache_layout(ShmCacheHeader *h, uint32_t cluster_size,
+                             uint64_t length, const char *tag)
+{
+    uint64_t nb_clusters = DIV_ROUND_UP(length, cluster_size);
+
+    memset(h, 0, sizeof(*h));
+    h->magic = SHM_CACHE_MAGIC;
+    h->version = SHM_CACHE_VERSION;
+    h->cluster_size = cluster_size;
+    h->length = length;
+    h->index_offset = SHM_CACHE_HEADER_SIZE;
+    h->data_offset = ROUND_UP(h->index_offset + nb_clusters * sizeof(uint32_t),
+                              MAX(cluster_size, getpagesize()));
+    pstrcpy(h->tag, sizeof(h->tag), tag);
+}
+
+/* Called with the file locked against the other instances */
+static int shm_cache_map(BDRVShmCacheState *s, const ShmCacheHeader *want,
+                         const char *path, Error **errp)
+{
+    ShmCacheHeader *h;
+    struct stat st;
+    bool created;
+    int ret;
+
+    s->map_size = want->data_offset +
+                  DIV_ROUND_UP(want->length, want->cluster_size) *
+                  want->cluster_size;
+
+    if (fstat(s->fd, &st) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not stat '%s'", path);
+        return ret;
+    }
+    created = st.st_size == 0;
+    if (created) {
+        if (ftruncate(s->fd, s->map_size) < 0) {
+            ret = -errno;
+            error_setg_errno(errp, -ret, "Could not resize '%s'", path);
+            return ret;
+        }
+    } else if (st.st_size != s->map_size) {
+        error_setg(errp, "'%s' caches a different image", path);
+        return -EINVAL;
+    }
+
+    s->map = mmap(NULL, s->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  s->fd, 0);
+    if (s->map == MAP_FAILED) {
+        s->map = NULL;
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not map '%s'", path);
+        return ret;
+    }
+
+    h = (ShmCacheHeader *)s->map;
+    if (created) {
+        *h = *want;
+    } else if (h->magic != want->magic || h->version != want->version ||
+               h->cluster_size != want->cluster_size ||
+               h->length != want->length ||
+               h->index_offset != want->index_offset ||
+               h->data_offset != want->data_offset ||
+               strncmp(h->tag, want->tag, sizeof(h->tag))) {
+        error_setg(errp, "'%s' caches a different image", path);
+        return -EINVAL;
+    }
+
+    s->index = (uint32_t *)(s->map + h->index_offset);
+    s->data = s->map + h->data_offset;
+    return 0;
+}
+
+static int shm_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                          Error **errp)
+{
+    BDRVShmCacheState *s = bs->opaque;
+    ShmCacheHeader want;
+    QemuOpts *opts;
+    Error *local_err = NULL;
+    const char *path;
+    uint64_t cluster_size;
+    int64_t length;
+    int ret;
+
+    s->fd = -1;
+
+    if (flags & BDRV_O_RDWR) {
+        error_setg(errp, "shm-cache only caches read-only images");
+        return -EINVAL;
+    }
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_file,
+                               false, errp);
+    if (!bs->file) {
+        return -EINVAL;
+    }
+
+    opts = qemu_opts_create(&shm_cache_opts, NULL, 0, &error_abort);
+    qemu_opts_absorb_qdict(opts, options, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    path = qemu_opt_get(opts, SHM_CACHE_OPT_PATH);
+    if (!path) {
+        error_setg(errp, "shm-cache needs a path");
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    cluster_size = qemu_opt_get_size(opts, SHM_CACHE_OPT_CLUSTER_SIZE,
+                                     64 * 1024);
+    if (!is_power_of_2(cluster_size) || cluster_size < BDRV_SECTOR_SIZE ||
+        cluster_size > 2 * 1024 * 1024) {
+        error_setg(errp, "cluster-size must be a power of two between 512 "
+                   "and 2M");
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    length = bdrv_getlength(bs->file->bs);
+    if (length < 0) {
+        error_setg_errno(errp, -length, "Could not get the image length");
+        ret = length;
+        goto fail;
+    }
+    s->cluster_size = cluster_size;
+    s->length = length;
+    shm_cache_layout(&want, cluster_size, length, bs->file->bs->filename);
+
+    s->fd = qemu_open(path, O_RDWR | O_CREAT, 0600);
+    if (s->fd < 0) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not open '%s'", path);
+        goto fail;
+    }
+
+    /* Whoever comes first lays out the file */
+    if (flock(s->fd, LOCK_EX) < 0) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Could not lock '%s'", path);
+        goto fail;
+    }
+    ret = shm_cache_map(s, &want, path, errp);
+    flock(s->fd, LOCK_UN);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    qemu_opts_del(opts);
+    return 0;
+
+fail:
+    qemu_opts_del(opts);
+    if (s->map) {
+        munmap(s->map, s->map_size);
+        s->map = NULL;
+    }
+    if (s->fd >= 0) {
+        qemu_close(s->fd);
+        s->fd = -1;
+    }
+    return ret;
+}
+
+static void shm_cache_close(BlockDriverState *bs)
+{
+    BDRVShmCacheState *s = bs->opaque;
+
+    munmap(s->map, s->map_size);
+    qemu_close(s->fd);
+}
+
+static int64_t shm_cache_getlength(BlockDriverState *bs)
+{
+    BDRVShmCacheState *s = bs->opaque;
+
+    return s->length;
+}
+
+/* Reads the whole of @cluster into the cache and publishes it */
+static int coroutine_fn shm_cache_fill(BlockDriverState *bs, uint64_t cluster)
+{
+    BDRVShmCacheState *s = bs->opaque;
+    uint64_t offset = cluster * s->cluster_size;
+    QEMUIOVector qiov;
+    struct iovec iov;
+    int ret;
+
+    iov.iov_base = s->data + offset;
+    iov.iov_len = MIN(s->cluster_size, s->length - offset);
+    qemu_iovec_init_external(&qiov, &iov, 1);
+
+    ret = bdrv_co_preadv(bs->file, offset, iov.iov_len, &qiov, 0);
+    atomic_store_release(&s->index[cluster],
+                         ret < 0 ? SHM_CACHE_EMPTY : SHM_CACHE_VALID);
+    return ret;
+}
+
+static int coroutine_fn shm_cache_co_preadv(BlockDriverState *bs,
+                                            uint64_t offset, uint64_t bytes,
+                                            QEMUIOVector *qiov, int flags)
+{
+    BDRVShmCacheState *s = bs->opaque;
+    QEMUIOVector hd_qiov;
+    uint64_t qiov_offset = 0;
+    int ret = 0;
+
+    qemu_iovec_init(&hd_qiov, qiov->niov);
+
+    while (bytes) {
+        uint64_t cluster = offset / s->cluster_size;
+        uint64_t in_cluster = offset % s->cluster_size;
+        uint64_t n = MIN(bytes, s->cluster_size - in_cluster);
+        uint32_t state = atomic_load_acquire(&s->index[cluster]);
+
+        if (state == SHM_CACHE_EMPTY &&
+            atomic_cmpxchg(&s->index[cluster], SHM_CACHE_EMPTY,
+                           SHM_CACHE_FILLING) == SHM_CACHE_EMPTY) {
+            ret = shm_cache_fill(bs, cluster);
+            if (ret < 0) {
+                break;
+            }
+            state = SHM_CACHE_VALID;
+        }
+
+        if (state == SHM_CACHE_VALID) {
+            qemu_iovec_from_buf(qiov, qiov_offset, s->data + offset, n);
+        } else {
+            /* Someone else is filling it, or died while doing so */
+            qemu_iovec_reset(&hd_qiov);
+            qemu_iovec_concat(&hd_qiov, qiov, qiov_offset, n);
+            ret = bdrv_co_preadv(bs->file, offset, n, &hd_qiov, 0);
+            if (ret < 0) {
+                break;
+            }
+        }
+
+        offset += n;
+        bytes -= n;
+        qiov_offset += n;
+    }
+
+    qemu_iovec_destroy(&hd_qiov);
+    return ret < 0 ? ret : 0;
+}
+
+static void shm_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                 const BdrvChildRole *role,
+                                 BlockReopenQueue *reopen_queue,
+                                 uint64_t perm, uint64_t shared,
+                                 uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_filter_default_perms(bs, c, role, reopen_queue, perm, shared,
+                              nperm, nshared);
+
+    /* The cached data must stay valid */
+    *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+}
+
+static bool shm_cache_recurse_is_first_non_filter(BlockDriverState *bs,
+                                                  BlockDriverState *candidate)
+{
+    return bdrv_recurse_is_first_non_filter(bs->file->bs, candidate);
+}
+
+static BlockDriver bdrv_shm_cache = {
+    .format_name                        = "shm-cache",
+    .protocol_name                      = "shm-cache",
+    .instance_size                      = sizeof(BDRVShmCacheState),
+
+    .bdrv_file_open                     = shm_cache_open,
+    .bdrv_close                         = shm_cache_close,
+    .bdrv_child_perm                    = shm_cache_child_perm,
+    .bdrv_getlength                     = shm_cache_getlength,
+
+    .bdrv_co_preadv                     = shm_cache_co_preadv,
+    .bdrv_co_get_block_status           = bdrv_co_get_block_status_from_file,
+
+    .bdrv_recurse_is_first_non_filter   = shm_cache_recurse_is_first_non_filter,
+
+    .is_filter                          = true,
+};
+
+static void bdrv_shm_cache_init(void)
+{
+    bdrv_register(&bdrv_shm_cache);
+}
+
+block_init(bdrv_shm_cache_init);
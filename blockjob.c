@@ -320,6 +320,7 @@ void block_job_start(BlockJob *job)
     assert(job && !block_job_started(job) && job->paused &&
            job->driver && job->driver->start);
     job->co = qemu_coroutine_create(block_job_co_entry, job);
+    qemu_coroutine_set_background(job->co, true);
     job->pause_count--;
     job->busy = true;
     job->paused = false;
@@ -0,0 +1,157 @@
+/*
+ * Boot milestone profiling
+ *
+ * The boot flow models mark milestones such as the PLM starting, the PL
+ * getting configured or the APU coming out of reset as they see them.
+ * The first hit of each milestone since the last system reset is timed
+ * in virtual and host time, reported with a BOOT_PHASE event and, when
+ * tracing, an etrace event.  query-boot-profile returns the whole list.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qapi/error.h"
+#include "qapi-event.h"
+#include "qmp-commands.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/etrace.h"
+#include "qom/cpu.h"
+#include "sysemu/reset.h"
+#include "sysemu/boot-profile.h"
+
+/* Enough for every core, controller and IPI pair of a Versal.  */
+#define BOOT_PROFILE_MAX_MARKS 64
+
+typedef struct BootProfileMark {
+    BootPhase phase;
+    char *detail;
+    int64_t vm_ns;
+    int64_t host_ns;
+    uint64_t count;
+} BootProfileMark;
+
+/* Marks may come from any vCPU thread.  Protects everything below.  */
+static QemuMutex boot_profile_lock;
+static BootProfileMark boot_profile_marks[BOOT_PROFILE_MAX_MARKS];
+static unsigned int boot_profile_num_marks;
+static uint64_t boot_profile_dropped;
+static int64_t boot_profile_vm_base;
+static int64_t boot_profile_host_base;
+/* One bit per phase that was hit, read without the lock.  */
+static unsigned long boot_profile_phases;
+
+bool boot_profile_seen(BootPhase phase)
+{
+    return atomic_read(&boot_profile_phases) & (1UL << phase);
+}
+
+void boot_profile_mark(BootPhase phase, const char *detail)
+{
+    BootProfileMark *m;
+    unsigned int i;
+    int64_t vm_ns, host_ns;
+
+    /* Whatever the PLM and the firmware print comes before.  */
+    if (phase == BOOT_PHASE_CONSOLE_OUTPUT &&
+        !boot_profile_seen(BOOT_PHASE_APU_RELEASE)) {
+        return;
+    }
+
+    qemu_mutex_lock(&boot_profile_lock);
+    for (i = 0; i < boot_profile_num_marks; i++) {
+        m = &boot_profile_marks[i];
+        if (m->phase == phase && !g_strcmp0(m->detail, detail)) {
+            m->count++;
+            qemu_mutex_unlock(&boot_profile_lock);
+            return;
+        }
+    }
+    if (boot_profile_num_marks == BOOT_PROFILE_MAX_MARKS) {
+        boot_profile_dropped++;
+        qemu_mutex_unlock(&boot_profile_lock);
+        return;
+    }
+
+    vm_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - boot_profile_vm_base;
+    host_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - boot_profile_host_base;
+    m = &boot_profile_marks[boot_profile_num_marks++];
+    m->phase = phase;
+    m->detail = g_strdup(detail);
+    m->vm_ns = vm_ns;
+    m->host_ns = host_ns;
+    m->count = 1;
+    atomic_or(&boot_profile_phases, 1UL << phase);
+    qemu_mutex_unlock(&boot_profile_lock);
+
+    qapi_event_send_boot_phase(phase, !!detail, detail, vm_ns, host_ns,
+                               &error_abort);
+    if (qemu_etrace_mask(ETRACE_F_TRACE)) {
+        CPUState *cpu = current_cpu;
+        char *name;
+
+        if (detail) {
+            name = g_strdup_printf("%s:%s", BootPhase_str(phase), detail);
+        } else {
+            name = g_strdup(BootPhase_str(phase));
+        }
+        etrace_event_u64(&qemu_etracer, cpu ? cpu->cpu_index : -1,
+                         ETRACE_EVU64_F_NONE, "boot-profile", name, vm_ns, 0);
+        g_free(name);
+    }
+}
+
+BootProfileInfo *qmp_query_boot_profile(Error **errp)
+{
+    BootProfileInfo *info = g_new0(BootProfileInfo, 1);
+    unsigned int i;
+
+    qemu_mutex_lock(&boot_profile_lock);
+    for (i = boot_profile_num_marks; i-- > 0; ) {
+        BootProfileMark *m = &boot_profile_marks[i];
+        BootProfileEntryList *elem = g_new0(BootProfileEntryList, 1);
+        BootProfileEntry *e = g_new0(BootProfileEntry, 1);
+
+        e->phase = m->phase;
+        e->has_detail = m->detail != NULL;
+        e->detail = g_strdup(m->detail);
+        e->vm_ns = m->vm_ns;
+        e->host_ns = m->host_ns;
+        e->count = m->count;
+        elem->value = e;
+        elem->next = info->entries;
+        info->entries = elem;
+    }
+    info->dropped = boot_profile_dropped;
+    qemu_mutex_unlock(&boot_profile_lock);
+
+    return info;
+}
+
+static void boot_profile_reset(void *opaque)
+{
+    unsigned int i;
+
+    qemu_mutex_lock(&boot_profile_lock);
+    for (i = 0; i < boot_profile_num_marks; i++) {
+        g_free(boot_profile_marks[i].detail);
+    }
+    boot_profile_num_marks = 0;
+    boot_profile_dropped = 0;
+    boot_profile_vm_base = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    boot_profile_host_base = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    atomic_set(&boot_profile_phases, 0);
+    qemu_mutex_unlock(&boot_profile_lock);
+}
+
+static void __attribute__((constructor)) boot_profile_init(void)
+{
+    qemu_mutex_init(&boot_profile_lock);
+    qemu_register_reset(boot_profile_reset, NULL);
+}
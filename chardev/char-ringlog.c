@@ -0,0 +1,325 @@
+/*
+ * Log chardev writing through a memory ring
+ *
+ * Guest output is copied into a ring and written to the file by a thread
+ * of its own, straight from the ring.  The guest never waits for the
+ * file: when the ring is full, output is dropped and a note about it is
+ * written to the log instead.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu-common.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "chardev/char.h"
+
+/* How long the writer thread lets output pile up before writing it */
+#define RINGLOG_FLUSH_MS 10
+
+typedef struct {
+    Chardev parent;
+
+    char *path;
+    int fd;
+    bool timestamp;
+    uint64_t rotate_size;
+    /* Bytes in the current file, only used by the thread */
+    uint64_t written;
+    int64_t start_ns;
+
+    /* [cons, prod) is being written out and left alone by ringlog_put */
+    QemuMutex lock;
+    QemuCond cond;
+    size_t size;
+    size_t prod;
+    size_t cons;
+    uint8_t *cbuf;
+    uint64_t dropped;
+    bool line_start;
+    bool idle;
+    bool exiting;
+
+    QemuThread thread;
+} RingLogChardev;
+
+#define RINGLOG_CHARDEV(obj) \
+    OBJECT_CHECK(RingLogChardev, (obj), TYPE_CHARDEV_RINGLOG)
+
+static int ringlog_open_file(RingLogChardev *d, bool append, Error **errp)
+{
+    int flags = O_WRONLY | O_CREAT | O_BINARY;
+
+    flags |= append ? O_APPEND : O_TRUNC;
+    d->fd = qemu_open(d->path, flags, 0666);
+    if (d->fd < 0) {
+        error_setg_file_open(errp, errno, d->path);
+        return -1;
+    }
+    d->written = append ? lseek(d->fd, 0, SEEK_END) : 0;
+    return 0;
+}
+
+/* The previous log is kept as path.1, older ones are lost.  */
+static void ringlog_rotate(RingLogChardev *d)
+{
+    char *old = g_strdup_printf("%s.1", d->path);
+    Error *err = NULL;
+
+    qemu_close(d->fd);
+    unlink(old);
+    if (rename(d->path, old) < 0) {
+        error_report("ringlog: cannot rename %s: %s", d->path,
+                     strerror(errno));
+    }
+    g_free(old);
+
+    if (ringlog_open_file(d, false, &err) < 0) {
+        error_report_err(err);
+    }
+}
+
+static void ringlog_write_file(RingLogChardev *d, const void *buf, size_t len)
+{
+    if (d->fd < 0 || !len) {
+        return;
+    }
+    if (qemu_write_full(d->fd, buf, len) != len) {
+        error_report("ringlog: write error on %s: %s", d->path,
+                     strerror(errno));
+        return;
+    }
+    d->written += len;
+    if (d->rotate_size && d->written >= d->rotate_size) {
+        ringlog_rotate(d);
+    }
+}
+
+static void *ringlog_thread(void *opaque)
+{
+    RingLogChardev *d = opaque;
+
+    qemu_mutex_lock(&d->lock);
+    for (;;) {
+        size_t cons, prod, off, n;
+        uint64_t dropped;
+
+        while (d->prod == d->cons && !d->dropped && !d->exiting) {
+            d->idle = true;
+            qemu_cond_wait(&d->cond, &d->lock);
+            d->idle = false;
+        }
+        if (d->prod == d->cons && !d->dropped) {
+            break;
+        }
+        if (!d->exiting && d->prod - d->cons < d->size / 2) {
+            /* Woken by the first byte, let the rest of the burst in */
+            qemu_cond_timedwait(&d->cond, &d->lock, RINGLOG_FLUSH_MS);
+        }
+
+        cons = d->cons;
+        prod = d->prod;
+        dropped = d->dropped;
+        d->dropped = 0;
+        qemu_mutex_unlock(&d->lock);
+
+        off = cons & (d->size - 1);
+        n = MIN(prod - cons, d->size - off);
+        ringlog_write_file(d, d->cbuf + off, n);
+        ringlog_write_file(d, d->cbuf, prod - cons - n);
+        if (dropped) {
+            char *msg = g_strdup_printf("\n[ringlog: %" PRIu64
+                                        " bytes dropped]\n", dropped);
+
+            ringlog_write_file(d, msg, strlen(msg));
+            g_free(msg);
+        }
+
+        qemu_mutex_lock(&d->lock);
+        d->cons = prod;
+    }
+    qemu_mutex_unlock(&d->lock);
+
+    return NULL;
+}
+
+/* Called with d->lock held.  */
+static void ringlog_put(RingLogChardev *d, const uint8_t *buf, size_t len)
+{
+    size_t off, n;
+
+    if (len > d->size - (d->prod - d->cons)) {
+        d->dropped += len;
+        return;
+    }
+
+    off = d->prod & (d->size - 1);
+    n = MIN(len, d->size - off);
+    memcpy(d->cbuf + off, buf, n);
+    memcpy(d->cbuf, buf + n, len - n);
+    d->prod += len;
+}
+
+static void ringlog_put_timestamp(RingLogChardev *d)
+{
+    int64_t ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - d->start_ns;
+    char stamp[32];
+    int len;
+
+    len = snprintf(stamp, sizeof(stamp), "[%5" PRId64 ".%06" PRId64 "] ",
+                   ns / NANOSECONDS_PER_SECOND,
+                   (ns % NANOSECONDS_PER_SECOND) / 1000);
+    ringlog_put(d, (uint8_t *)stamp, len);
+}
+
+static int ringlog_chr_write(Chardev *chr, const uint8_t *buf, int len)
+{
+    RingLogChardev *d = RINGLOG_CHARDEV(chr);
+    int done = 0;
+
+    qemu_mutex_lock(&d->lock);
+    if (!d->timestamp) {
+        ringlog_put(d, buf, len);
+    } else {
+        while (done < len) {
+            const uint8_t *nl = memchr(buf + done, '\n', len - done);
+            int n = nl ? nl - (buf + done) + 1 : len - done;
+
+            if (d->line_start) {
+                ringlog_put_timestamp(d);
+            }
+            ringlog_put(d, buf + done, n);
+            d->line_start = nl != NULL;
+            done += n;
+        }
+    }
+    if (d->idle || d->prod - d->cons >= d->size / 2) {
+        qemu_cond_signal(&d->cond);
+    }
+    qemu_mutex_unlock(&d->lock);
+
+    return len;
+}
+
+static void qemu_chr_open_ringlog(Chardev *chr,
+                                  ChardevBackend *backend,
+                                  bool *be_opened,
+                                  Error **errp)
+{
+    ChardevRinglog *opts = backend->u.ringlog.data;
+    RingLogChardev *d = RINGLOG_CHARDEV(chr);
+
+    d->size = opts->has_size ? opts->size : 1024 * 1024;
+    if (!d->size || (d->size & (d->size - 1))) {
+        error_setg(errp, "size of ringlog chardev must be power of two");
+        return;
+    }
+    if (opts->has_rotate_size && opts->rotate_size < 0) {
+        error_setg(errp, "rotate-size of ringlog chardev must not be "
+                   "negative");
+        return;
+    }
+
+    d->path = g_strdup(opts->out);
+    if (ringlog_open_file(d, opts->has_append && opts->append, errp) < 0) {
+        g_free(d->path);
+        d->path = NULL;
+        return;
+    }
+    d->timestamp = opts->has_timestamp && opts->timestamp;
+    d->rotate_size = opts->has_rotate_size ? opts->rotate_size : 0;
+    d->start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    d->line_start = true;
+    d->cbuf = g_malloc(d->size);
+
+    qemu_mutex_init(&d->lock);
+    qemu_cond_init(&d->cond);
+    qemu_thread_create(&d->thread, "ringlog", ringlog_thread, d,
+                       QEMU_THREAD_JOINABLE);
+}
+
+static void char_ringlog_finalize(Object *obj)
+{
+    RingLogChardev *d = RINGLOG_CHARDEV(obj);
+
+    if (!d->cbuf) {
+        return;
+    }
+
+    /* The thread drains the ring before it exits */
+    qemu_mutex_lock(&d->lock);
+    d->exiting = true;
+    qemu_cond_signal(&d->cond);
+    qemu_mutex_unlock(&d->lock);
+    qemu_thread_join(&d->thread);
+
+    qemu_cond_destroy(&d->cond);
+    qemu_mutex_destroy(&d->lock);
+    if (d->fd >= 0) {
+        qemu_close(d->fd);
+    }
+    g_free(d->cbuf);
+    g_free(d->path);
+}
+
+static void qemu_chr_parse_ringlog(QemuOpts *opts, ChardevBackend *backend,
+                                   Error **errp)
+{
+    const char *path = qemu_opt_get(opts, "path");
+    ChardevRinglog *ringlog;
+    uint64_t val;
+
+    backend->type = CHARDEV_BACKEND_KIND_RINGLOG;
+    if (path == NULL) {
+        error_setg(errp, "chardev: ringlog: no filename given");
+        return;
+    }
+    ringlog = backend->u.ringlog.data = g_new0(ChardevRinglog, 1);
+    qemu_chr_parse_common(opts, qapi_ChardevRinglog_base(ringlog));
+    ringlog->out = g_strdup(path);
+
+    val = qemu_opt_get_size(opts, "size", 0);
+    if (val != 0) {
+        ringlog->has_size = true;
+        ringlog->size = val;
+    }
+    val = qemu_opt_get_size(opts, "rotate-size", 0);
+    if (val != 0) {
+        ringlog->has_rotate_size = true;
+        ringlog->rotate_size = val;
+    }
+    ringlog->has_timestamp = true;
+    ringlog->timestamp = qemu_opt_get_bool(opts, "timestamp", false);
+    ringlog->has_append = true;
+    ringlog->append = qemu_opt_get_bool(opts, "append", false);
+}
+
+static void char_ringlog_class_init(ObjectClass *oc, void *data)
+{
+    ChardevClass *cc = CHARDEV_CLASS(oc);
+
+    cc->parse = qemu_chr_parse_ringlog;
+    cc->open = qemu_chr_open_ringlog;
+    cc->chr_write = ringlog_chr_write;
+}
+
+static const TypeInfo char_ringlog_type_info = {
+    .name = TYPE_CHARDEV_RINGLOG,
+    .parent = TYPE_CHARDEV,
+    .class_init = char_ringlog_class_init,
+    .instance_size = sizeof(RingLogChardev),
+    .instance_finalize = char_ringlog_finalize,
+};
+
+static void register_types(void)
+{
+    type_register_static(&char_ringlog_type_info);
+}
+
+type_init(register_types);
@@ -867,6 +867,12 @@ QemuOptsList qemu_chardev_opts = {
         },{
             .name = "append",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "timestamp",
+            .type = QEMU_OPT_BOOL,
+        },{
+            .name = "rotate-size",
+            .type = QEMU_OPT_SIZE,
         },{
             .name = "logfile",
             .type = QEMU_OPT_STRING,
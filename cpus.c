@@ -150,6 +150,24 @@ typedef struct TimersState {
 
 static TimersState timers_state;
 bool mttcg_enabled;
+/* MTTCG with one round-robin thread per CPU cluster (thread=cluster) */
+static bool tcg_cluster_threads;
+
+/* Quantum icount.  Each vCPU keeps its own instruction based clock in
+ * cpu->qicount_clock and runs until the end of the current quantum, where
+ * it waits for the others.  The last one to get there moves time forward
+ * and runs the QEMU_CLOCK_VIRTUAL timers.  All protected by the BQL, the
+ * boundaries are also read atomically by running vCPUs.
+ */
+static int64_t qicount_quantum;
+/* Start of the current quantum, the time seen outside vCPU threads.  */
+static int64_t qicount_now;
+/* End of the current quantum, where all vCPUs meet.  */
+static int64_t qicount_end;
+/* Paces quanta in real time while all vCPUs are halted.  */
+static QEMUTimer *qicount_idle_timer;
+static void qicount_idle_timer_cb(void *opaque);
+static bool tcg_poll_skip;
 
 /*
  * We default to false if we know other options have been enabled
@@ -197,9 +215,15 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
 {
     const char *t = qemu_opt_get(opts, "thread");
     if (t) {
-        if (strcmp(t, "multi") == 0) {
+        bool cluster = strcmp(t, "cluster") == 0;
+
+        if (cluster || strcmp(t, "multi") == 0) {
             if (TCG_OVERSIZED_GUEST) {
                 error_setg(errp, "No MTTCG when guest word size > hosts");
+            } else if (use_icount && cluster) {
+                /* Only icount quantum keeps parallel clusters in step.  */
+                warn_report("icount: TCG clusters share a single thread");
+                mttcg_enabled = false;
             } else if (use_icount) {
                 error_setg(errp, "No MTTCG when icount is enabled");
             } else {
@@ -213,6 +237,7 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
                     error_printf("This may cause strange/hard to debug errors\n");
                 }
                 mttcg_enabled = true;
+                tcg_cluster_threads = cluster;
             }
         } else if (strcmp(t, "single") == 0) {
             mttcg_enabled = false;
@@ -222,6 +247,9 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    tcg_poll_skip = qemu_opt_get_bool(opts, "poll-skip", false);
+    tb_hot_threshold = qemu_opt_get_number(opts, "superblock-threshold", 0);
 }
 
 /* The current number of executed instructions is based on what we
@@ -243,6 +271,12 @@ void cpu_update_icount(CPUState *cpu)
     int64_t executed = cpu_get_icount_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (use_icount_quantum) {
+        /* Only this vCPU's own clock moves.  */
+        cpu->qicount_clock += cpu_icount_to_ns(executed);
+        return;
+    }
+
 #ifdef CONFIG_ATOMIC64
     atomic_set__nocheck(&timers_state.qemu_icount,
                         atomic_read__nocheck(&timers_state.qemu_icount) +
@@ -277,11 +311,29 @@ static int64_t cpu_get_icount_locked(void)
     return timers_state.qemu_icount_bias + cpu_icount_to_ns(icount);
 }
 
+/* With quantum icount a vCPU sees its own clock, everybody else the start
+ * of the current quantum.
+ */
+static int64_t cpu_get_icount_quantum(void)
+{
+    CPUState *cpu = current_cpu;
+
+    if (cpu && qemu_in_vcpu_thread()) {
+        return cpu->qicount_clock +
+               cpu_icount_to_ns(cpu_get_icount_executed(cpu));
+    }
+    return atomic_read__nocheck(&qicount_now);
+}
+
 int64_t cpu_get_icount(void)
 {
     int64_t icount;
     unsigned start;
 
+    if (use_icount_quantum) {
+        return cpu_get_icount_quantum();
+    }
+
     do {
         start = seqlock_read_begin(&timers_state.vm_clock_seqlock);
         icount = cpu_get_icount_locked();
@@ -305,7 +357,7 @@ int64_t cpu_get_ticks(void)
 {
     int64_t ticks;
 
-    if (use_icount) {
+    if (use_icount || use_icount_quantum) {
         return cpu_get_icount();
     }
 
@@ -764,6 +816,46 @@ void cpu_ticks_init(void)
                                            cpu_throttle_timer_tick, NULL);
 }
 
+/* Unlike the other modes this one leaves use_icount clear: TBs count
+ * their instructions, but may do I/O anywhere and don't need to execute
+ * alone, so MTTCG stays available.
+ */
+static void configure_icount_quantum(QemuOpts *opts, const char *shift,
+                                     Error **errp)
+{
+    char *rem_str = NULL;
+
+    if (strcmp(shift, "auto") == 0) {
+        error_setg(errp, "shift=auto and quantum are incompatible");
+        return;
+    }
+    if (qemu_opt_get_bool(opts, "align", false)) {
+        error_setg(errp, "align=on and quantum are incompatible");
+        return;
+    }
+    if (qemu_opt_get(opts, "rr")) {
+        error_setg(errp, "record/replay and quantum are incompatible");
+        return;
+    }
+
+    errno = 0;
+    icount_time_shift = strtol(shift, &rem_str, 0);
+    if (errno != 0 || *rem_str != '\0' || !strlen(shift)) {
+        error_setg(errp, "icount: Invalid shift value");
+        return;
+    }
+    if (qicount_quantum < cpu_icount_to_ns(1)) {
+        error_setg(errp, "icount: quantum is shorter than one instruction");
+        return;
+    }
+
+    use_icount_quantum = true;
+    qicount_now = 0;
+    qicount_end = qicount_quantum;
+    qicount_idle_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
+                                      qicount_idle_timer_cb, NULL);
+}
+
 void configure_icount(QemuOpts *opts, Error **errp)
 {
     const char *option;
@@ -777,6 +869,12 @@ void configure_icount(QemuOpts *opts, Error **errp)
         return;
     }
 
+    qicount_quantum = qemu_opt_get_number(opts, "quantum", 0);
+    if (qicount_quantum) {
+        configure_icount_quantum(opts, option, errp);
+        return;
+    }
+
     icount_sleep = qemu_opt_get_bool(opts, "sleep", true);
     if (icount_sleep) {
         icount_warp_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
@@ -837,7 +935,23 @@ void configure_icount(QemuOpts *opts, Error **errp)
  */
 
 static QEMUTimer *tcg_kick_vcpu_timer;
-static CPUState *tcg_current_rr_cpu;
+
+/* Round-robin TCG threads.  There is a single one, running all vCPUs,
+ * unless thread=cluster asks for one per cluster, i.e. per QOM type of
+ * vCPU, so the APU, RPU... of a heterogeneous machine run side by side.
+ * Clusters past TCG_RR_THREADS_MAX share the last thread.
+ */
+#define TCG_RR_THREADS_MAX 8
+
+typedef struct TCGRRThread {
+    QemuThread *thread;
+    QemuCond *halt_cond;
+    const char *cluster;
+    CPUState *current_cpu;      /* the vCPU being run, if any */
+} TCGRRThread;
+
+static TCGRRThread tcg_rr_threads[TCG_RR_THREADS_MAX];
+static int tcg_rr_nb_threads;
 
 #define TCG_KICK_PERIOD (NANOSECONDS_PER_SECOND / 10)
 
@@ -846,16 +960,49 @@ static inline int64_t qemu_tcg_next_kick(void)
     return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + TCG_KICK_PERIOD;
 }
 
-/* Kick the currently round-robin scheduled vCPU */
-static void qemu_cpu_kick_rr_cpu(void)
+static TCGRRThread *tcg_rr_thread_of(CPUState *cpu)
+{
+    int i, n = atomic_mb_read(&tcg_rr_nb_threads);
+
+    for (i = 0; i < n; i++) {
+        if (tcg_rr_threads[i].thread == cpu->thread) {
+            return &tcg_rr_threads[i];
+        }
+    }
+    return NULL;
+}
+
+/* The vCPU after @cpu, or the first one if NULL, that @rr runs */
+static CPUState *tcg_rr_next_cpu(TCGRRThread *rr, CPUState *cpu)
+{
+    for (cpu = cpu ? CPU_NEXT(cpu) : first_cpu; cpu; cpu = CPU_NEXT(cpu)) {
+        if (cpu->thread == rr->thread) {
+            break;
+        }
+    }
+    return cpu;
+}
+
+/* Kick the vCPU currently scheduled by a round-robin thread */
+static void qemu_cpu_kick_rr_thread(TCGRRThread *rr)
 {
     CPUState *cpu;
     do {
-        cpu = atomic_mb_read(&tcg_current_rr_cpu);
+        cpu = atomic_mb_read(&rr->current_cpu);
         if (cpu) {
             cpu_exit(cpu);
         }
-    } while (cpu != atomic_mb_read(&tcg_current_rr_cpu));
+    } while (cpu != atomic_mb_read(&rr->current_cpu));
+}
+
+/* Kick the currently round-robin scheduled vCPUs */
+static void qemu_cpu_kick_rr_cpu(void)
+{
+    int i, n = atomic_mb_read(&tcg_rr_nb_threads);
+
+    for (i = 0; i < n; i++) {
+        qemu_cpu_kick_rr_thread(&tcg_rr_threads[i]);
+    }
 }
 
 static void do_nothing(CPUState *cpu, run_on_cpu_data unused)
@@ -887,7 +1034,8 @@ static void kick_tcg_thread(void *opaque)
 
 static void start_tcg_kick_timer(void)
 {
-    if (!mttcg_enabled && !tcg_kick_vcpu_timer && CPU_NEXT(first_cpu)) {
+    if ((!mttcg_enabled || tcg_cluster_threads) &&
+        !tcg_kick_vcpu_timer && CPU_NEXT(first_cpu)) {
         tcg_kick_vcpu_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                                            kick_tcg_thread, NULL);
         timer_mod(tcg_kick_vcpu_timer, qemu_tcg_next_kick());
@@ -1055,12 +1203,15 @@ static QemuThread io_thread;
 static QemuCond qemu_cpu_cond;
 /* system init */
 static QemuCond qemu_pause_cond;
+/* vCPU passed through wait_io_event after a kick */
+static QemuCond qemu_kick_ack_cond;
 
 void qemu_init_cpu_loop(void)
 {
     qemu_init_sigbus();
     qemu_cond_init(&qemu_cpu_cond);
     qemu_cond_init(&qemu_pause_cond);
+    qemu_cond_init(&qemu_kick_ack_cond);
     qemu_mutex_init(&qemu_global_mutex);
 
     qemu_thread_get_self(&io_thread);
@@ -1086,6 +1237,7 @@ static void qemu_tcg_destroy_vcpu(CPUState *cpu)
 static void qemu_wait_io_event_common(CPUState *cpu)
 {
     atomic_mb_set(&cpu->thread_kicked, false);
+    qemu_cond_broadcast(&qemu_kick_ack_cond);
     if (cpu->stop) {
         cpu->stop = false;
         cpu->stopped = true;
@@ -1094,10 +1246,104 @@ static void qemu_wait_io_event_common(CPUState *cpu)
     process_queued_cpu_work(cpu);
 }
 
+/* Budget of a vCPU up to the end of the current quantum.  */
+static int64_t qicount_budget(CPUState *cpu)
+{
+    /* Time spent halted is lost, catch up with the others.  */
+    if (cpu->qicount_clock < qicount_now) {
+        cpu->qicount_clock = qicount_now;
+    }
+    return qemu_icount_round(qicount_end - cpu->qicount_clock);
+}
+
+/* A vCPU that reached the end of the quantum waits for the others.  */
+static bool qicount_waiting(CPUState *cpu)
+{
+    return use_icount_quantum && !cpu->stop && !cpu->queued_work_first &&
+           cpu->qicount_clock >= qicount_end;
+}
+
+static bool qicount_all_arrived(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        if (cpu->qicount_clock < qicount_end && !cpu_thread_is_idle(cpu)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Called with the BQL by a vCPU thread about to wait.  Once all vCPUs are
+ * at the end of the quantum, or halted, start the next one.  It ends after
+ * the sync quantum or at the next QEMU_CLOCK_VIRTUAL deadline, whichever
+ * comes first, so remote-port syncs and guest timers land on a boundary.
+ * While all vCPUs are halted the following quanta are started by
+ * qicount_idle_timer, as long as they would last in real time.
+ */
+static void qicount_sync(void)
+{
+    CPUState *cpu;
+    int64_t deadline;
+    bool advanced = false;
+
+    while (use_icount_quantum && qicount_all_arrived()) {
+        if (advanced && all_cpu_threads_idle()) {
+            timer_mod(qicount_idle_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                      qicount_end - qicount_now);
+            break;
+        }
+        atomic_set__nocheck(&qicount_now, qicount_end);
+        CPU_FOREACH(cpu) {
+            cpu->qicount_clock = MAX(cpu->qicount_clock, qicount_now);
+        }
+        qemu_clock_run_timers(QEMU_CLOCK_VIRTUAL);
+
+        deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL);
+        if (deadline < 0 || deadline > qicount_quantum) {
+            deadline = qicount_quantum;
+        }
+        atomic_set__nocheck(&qicount_end, qicount_now +
+                            MAX(deadline, cpu_icount_to_ns(1)));
+        advanced = true;
+    }
+
+    if (advanced) {
+        qemu_clock_notify(QEMU_CLOCK_VIRTUAL);
+        CPU_FOREACH(cpu) {
+            qemu_cond_broadcast(cpu->halt_cond);
+        }
+    }
+}
+
+static void qicount_idle_timer_cb(void *opaque)
+{
+    qicount_sync();
+}
+
+/* All vCPUs of the cluster thread running @cpu have nothing to do.  */
+static bool tcg_cluster_idle(CPUState *cpu)
+{
+    CPUState *other;
+
+    CPU_FOREACH(other) {
+        if (other->thread == cpu->thread && !cpu_thread_is_idle(other) &&
+            !qicount_waiting(other)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool qemu_tcg_should_sleep(CPUState *cpu)
 {
-    if (mttcg_enabled) {
-        return cpu_thread_is_idle(cpu);
+    if (tcg_cluster_threads) {
+        return tcg_cluster_idle(cpu);
+    } else if (mttcg_enabled) {
+        return cpu_thread_is_idle(cpu) || qicount_waiting(cpu);
     } else {
         return all_cpu_threads_idle();
     }
@@ -1105,8 +1351,13 @@ static bool qemu_tcg_should_sleep(CPUState *cpu)
 
 static void qemu_tcg_wait_io_event(CPUState *cpu)
 {
+    qicount_sync();
+
     while (qemu_tcg_should_sleep(cpu)) {
-        stop_tcg_kick_timer();
+        if (!tcg_cluster_threads || all_cpu_threads_idle()) {
+            stop_tcg_kick_timer();
+        }
+        qemu_cond_broadcast(&qemu_kick_ack_cond);
         qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
     }
 
@@ -1118,6 +1369,7 @@ static void qemu_tcg_wait_io_event(CPUState *cpu)
 static void qemu_kvm_wait_io_event(CPUState *cpu)
 {
     while (cpu_thread_is_idle(cpu)) {
+        qemu_cond_broadcast(&qemu_kick_ack_cond);
         qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
     }
 
@@ -1248,7 +1500,14 @@ static void handle_icount_deadline(void)
 
 static void prepare_icount_for_run(CPUState *cpu)
 {
-    if (use_icount) {
+    if (use_icount_quantum) {
+        int insns_left;
+
+        cpu->icount_budget = qicount_budget(cpu);
+        insns_left = MIN(0xffff, cpu->icount_budget);
+        cpu->icount_decr.u16.low = insns_left;
+        cpu->icount_extra = cpu->icount_budget - insns_left;
+    } else if (use_icount) {
         int insns_left;
 
         /* These should always be cleared by process_icount_data after
@@ -1267,7 +1526,17 @@ static void prepare_icount_for_run(CPUState *cpu)
 
 static void process_icount_data(CPUState *cpu)
 {
-    if (use_icount) {
+    if (use_icount_quantum) {
+        cpu_update_icount(cpu);
+
+        /* What is left is less than the next TB, give it up.  */
+        if (cpu->icount_decr.u16.low + cpu->icount_extra == 0) {
+            cpu->qicount_clock = MAX(cpu->qicount_clock, qicount_end);
+        }
+        cpu->icount_decr.u16.low = 0;
+        cpu->icount_extra = 0;
+        cpu->icount_budget = 0;
+    } else if (use_icount) {
         /* Account for executed instructions */
         cpu_update_icount(cpu);
 
@@ -1281,6 +1550,87 @@ static void process_icount_data(CPUState *cpu)
 }
 
 
+/* Polling loop detection.
+ *
+ * Firmware spins on status bits (PLL lock, DDR init done...) that only
+ * change when a device timer fires. A vCPU that keeps reading the same
+ * value from the same MMIO register, at the same guest load, without
+ * writing MMIO or taking an interrupt in between is considered to be
+ * polling.
+ *
+ * With icount, idle vCPUs are fast-forwarded to the next QEMU_CLOCK_VIRTUAL
+ * deadline by accounting the skipped instructions, as if the loop had run
+ * until then. This only depends on the instruction stream, so replaying
+ * the same guest gives the same result. Without icount the guest clock
+ * can't be skipped, the polling vCPU only hands its time slice to the
+ * other vCPUs.
+ */
+#define POLL_SKIP_THRESHOLD 16
+/* Max instructions between two polls of a tight loop, icount only.  */
+#define POLL_SKIP_MAX_GAP   256
+
+void cpu_poll_mmio_read(CPUState *cpu, hwaddr addr, uint64_t val,
+                        uintptr_t pc)
+{
+    int64_t now = 0;
+
+    if (!tcg_poll_skip || mttcg_enabled) {
+        return;
+    }
+
+    if (use_icount) {
+        now = atomic_read__nocheck(&timers_state.qemu_icount)
+              + cpu_get_icount_executed(cpu);
+    }
+
+    if (addr != cpu->poll_addr || val != cpu->poll_val || pc != cpu->poll_pc
+        || (use_icount && now - cpu->poll_icount > POLL_SKIP_MAX_GAP)) {
+        cpu->poll_addr = addr;
+        cpu->poll_val = val;
+        cpu->poll_pc = pc;
+        cpu_poll_reset(cpu);
+    } else if (++cpu->poll_count == POLL_SKIP_THRESHOLD) {
+        cpu->poll_skip = true;
+        cpu_exit(cpu);
+    }
+    cpu->poll_icount = now;
+}
+
+static void tcg_poll_skip_ahead(CPUState *cpu)
+{
+    CPUState *other;
+    int64_t deadline;
+
+    cpu->poll_count = 0;
+    cpu->poll_skip = false;
+
+    if (!use_icount) {
+        return;
+    }
+
+    /* Skipping time would steal instructions from a vCPU doing real work. */
+    CPU_FOREACH(other) {
+        if (other != cpu && !other->poll_skip && !cpu_thread_is_idle(other)) {
+            return;
+        }
+    }
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL);
+    if (deadline <= 0 || deadline > INT32_MAX) {
+        /* Nothing will change the polled value, keep running.  */
+        return;
+    }
+
+#ifdef CONFIG_ATOMIC64
+    atomic_set__nocheck(&timers_state.qemu_icount,
+                        atomic_read__nocheck(&timers_state.qemu_icount) +
+                        qemu_icount_round(deadline));
+#else /* FIXME: we need 64bit atomics to do this safely */
+    timers_state.qemu_icount += qemu_icount_round(deadline);
+#endif
+}
+
+
 static int tcg_cpu_exec(CPUState *cpu)
 {
     int ret;
@@ -1331,6 +1681,7 @@ static void deal_with_unplugged_cpus(void)
 static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 {
     CPUState *cpu = arg;
+    TCGRRThread *rr = tcg_rr_thread_of(cpu);
 
     rcu_register_thread();
     tcg_register_thread();
@@ -1338,7 +1689,7 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
     qemu_mutex_lock_iothread();
     qemu_thread_get_self(cpu->thread);
 
-    CPU_FOREACH(cpu) {
+    for (cpu = tcg_rr_next_cpu(rr, NULL); cpu; cpu = tcg_rr_next_cpu(rr, cpu)) {
         cpu->thread_id = qemu_get_thread_id();
         cpu->created = true;
         cpu->can_do_io = 1;
@@ -1346,11 +1697,12 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
     qemu_cond_signal(&qemu_cpu_cond);
 
     /* wait for initial kick-off after machine start */
-    while (first_cpu->stopped) {
-        qemu_cond_wait(first_cpu->halt_cond, &qemu_global_mutex);
+    while (tcg_rr_next_cpu(rr, NULL)->stopped) {
+        qemu_cond_wait(rr->halt_cond, &qemu_global_mutex);
 
         /* process any pending work */
-        CPU_FOREACH(cpu) {
+        for (cpu = tcg_rr_next_cpu(rr, NULL); cpu;
+             cpu = tcg_rr_next_cpu(rr, cpu)) {
             current_cpu = cpu;
             qemu_wait_io_event_common(cpu);
         }
@@ -1358,7 +1710,7 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 
     start_tcg_kick_timer();
 
-    cpu = first_cpu;
+    cpu = tcg_rr_next_cpu(rr, NULL);
 
     /* process any pending work */
     cpu->exit_request = 1;
@@ -1373,18 +1725,18 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
         handle_icount_deadline();
 
         if (!cpu) {
-            cpu = first_cpu;
+            cpu = tcg_rr_next_cpu(rr, NULL);
         }
 
         while (cpu && !cpu->queued_work_first && !cpu->exit_request) {
 
-            atomic_mb_set(&tcg_current_rr_cpu, cpu);
+            atomic_mb_set(&rr->current_cpu, cpu);
             current_cpu = cpu;
 
             qemu_clock_enable(QEMU_CLOCK_VIRTUAL,
                               (cpu->singlestep_enabled & SSTEP_NOTIMER) == 0);
 
-            if (cpu_can_run(cpu)) {
+            if (cpu_can_run(cpu) && !qicount_waiting(cpu)) {
                 int r;
 
                 prepare_icount_for_run(cpu);
@@ -1393,6 +1745,10 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 
                 process_icount_data(cpu);
 
+                if (cpu->poll_skip) {
+                    tcg_poll_skip_ahead(cpu);
+                }
+
                 if (r == EXCP_DEBUG) {
                     cpu_handle_guest_debug(cpu);
                     break;
@@ -1404,22 +1760,22 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
                 }
             } else if (cpu->stop) {
                 if (cpu->unplug) {
-                    cpu = CPU_NEXT(cpu);
+                    cpu = tcg_rr_next_cpu(rr, cpu);
                 }
                 break;
             }
 
-            cpu = CPU_NEXT(cpu);
+            cpu = tcg_rr_next_cpu(rr, cpu);
         } /* while (cpu && !cpu->exit_request).. */
 
         /* Does not need atomic_mb_set because a spurious wakeup is okay.  */
-        atomic_set(&tcg_current_rr_cpu, NULL);
+        atomic_set(&rr->current_cpu, NULL);
 
         if (cpu && cpu->exit_request) {
             atomic_mb_set(&cpu->exit_request, 0);
         }
 
-        qemu_tcg_wait_io_event(cpu ? cpu : QTAILQ_FIRST(&cpus));
+        qemu_tcg_wait_io_event(cpu ? cpu : tcg_rr_next_cpu(rr, NULL));
         deal_with_unplugged_cpus();
     }
 
@@ -1496,9 +1852,12 @@ static void *qemu_tcg_cpu_thread_fn(void *arg)
     cpu->exit_request = 1;
 
     while (1) {
-        if (cpu_can_run(cpu)) {
+        if (cpu_can_run(cpu) && !qicount_waiting(cpu)) {
             int r;
+
+            prepare_icount_for_run(cpu);
             r = tcg_cpu_exec(cpu);
+            process_icount_data(cpu);
             switch (r) {
             case EXCP_DEBUG:
                 cpu_handle_guest_debug(cpu);
@@ -1568,9 +1927,13 @@ void qemu_cpu_kick(CPUState *cpu)
 {
     qemu_cond_broadcast(cpu->halt_cond);
     if (tcg_enabled()) {
+        TCGRRThread *rr = tcg_rr_thread_of(cpu);
+
         cpu_exit(cpu);
-        /* NOP unless doing single-thread RR */
-        qemu_cpu_kick_rr_cpu();
+        /* NULL unless doing RR */
+        if (rr) {
+            qemu_cpu_kick_rr_thread(rr);
+        }
     } else {
         if (hax_enabled()) {
             /*
@@ -1589,6 +1952,23 @@ void qemu_cpu_kick_self(void)
     qemu_cpu_kick_thread(current_cpu);
 }
 
+bool qemu_cpu_kick_wait(CPUState *cpu, int ms)
+{
+    int64_t deadline = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + ms;
+    int64_t left;
+
+    while (atomic_mb_read(&cpu->thread_kicked)) {
+        left = deadline - qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        if (cpu_thread_is_idle(cpu) || left <= 0) {
+            /* Nothing runs on a parked vCPU, don't wait for it.  */
+            atomic_mb_set(&cpu->thread_kicked, false);
+            return false;
+        }
+        qemu_cond_timedwait(&qemu_kick_ack_cond, &qemu_global_mutex, left);
+    }
+    return true;
+}
+
 bool qemu_cpu_is_self(CPUState *cpu)
 {
     return qemu_thread_is_self(cpu->thread);
@@ -1690,12 +2070,35 @@ void cpu_remove_sync(CPUState *cpu)
 /* For temporary buffers for forming a name */
 #define VCPU_THREAD_NAME_SIZE 16
 
+/* Find, or add, the round-robin thread that is to run @cpu */
+static TCGRRThread *tcg_rr_thread_lookup(CPUState *cpu)
+{
+    const char *cluster = NULL;
+    TCGRRThread *rr;
+    int i;
+
+    if (tcg_cluster_threads) {
+        cluster = object_get_typename(OBJECT(cpu));
+    }
+    for (i = 0; i < tcg_rr_nb_threads; i++) {
+        if (!g_strcmp0(tcg_rr_threads[i].cluster, cluster)) {
+            return &tcg_rr_threads[i];
+        }
+    }
+    if (tcg_rr_nb_threads == TCG_RR_THREADS_MAX) {
+        return &tcg_rr_threads[TCG_RR_THREADS_MAX - 1];
+    }
+
+    rr = &tcg_rr_threads[tcg_rr_nb_threads];
+    rr->cluster = cluster;
+    return rr;
+}
+
 static void qemu_tcg_init_vcpu(CPUState *cpu)
 {
     char thread_name[VCPU_THREAD_NAME_SIZE];
-    static QemuCond *single_tcg_halt_cond;
-    static QemuThread *single_tcg_cpu_thread;
     static int tcg_region_inited;
+    TCGRRThread *rr = NULL;
 
     /*
      * Initialize TCG regions--once. Now is a good time, because:
@@ -1708,12 +2111,16 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
         tcg_region_init();
     }
 
-    if (qemu_tcg_mttcg_enabled() || !single_tcg_cpu_thread) {
+    if (!qemu_tcg_mttcg_enabled() || tcg_cluster_threads) {
+        rr = tcg_rr_thread_lookup(cpu);
+    }
+
+    if (!rr || !rr->thread) {
         cpu->thread = g_malloc0(sizeof(QemuThread));
         cpu->halt_cond = g_malloc0(sizeof(QemuCond));
         qemu_cond_init(cpu->halt_cond);
 
-        if (qemu_tcg_mttcg_enabled()) {
+        if (!rr) {
             /* create a thread per vCPU with TCG (MTTCG) */
             parallel_cpus = true;
             snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
@@ -1723,14 +2130,20 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
                                cpu, QEMU_THREAD_JOINABLE);
 
         } else {
-            /* share a single thread for all cpus with TCG */
-            snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "ALL CPUs/TCG");
+            /* share a thread for all cpus of the cluster with TCG */
+            rr->thread = cpu->thread;
+            rr->halt_cond = cpu->halt_cond;
+            atomic_mb_set(&tcg_rr_nb_threads, tcg_rr_nb_threads + 1);
+            if (rr->cluster) {
+                parallel_cpus |= tcg_rr_nb_threads > 1;
+                snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "%s/TCG",
+                         rr->cluster);
+            } else {
+                snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "ALL CPUs/TCG");
+            }
             qemu_thread_create(cpu->thread, thread_name,
                                qemu_tcg_rr_cpu_thread_fn,
                                cpu, QEMU_THREAD_JOINABLE);
-
-            single_tcg_halt_cond = cpu->halt_cond;
-            single_tcg_cpu_thread = cpu->thread;
         }
 #ifdef _WIN32
         cpu->hThread = qemu_thread_get_handle(cpu->thread);
@@ -1740,8 +2153,8 @@ static void qemu_tcg_init_vcpu(CPUState *cpu)
         }
     } else {
         /* For non-MTTCG cases we share the thread */
-        cpu->thread = single_tcg_cpu_thread;
-        cpu->halt_cond = single_tcg_halt_cond;
+        cpu->thread = rr->thread;
+        cpu->halt_cond = rr->halt_cond;
     }
 }
 
@@ -1797,6 +2210,39 @@ static void qemu_dummy_start_vcpu(CPUState *cpu)
     }
 }
 
+/* Pin the thread of @cpu to the host CPUs of all the vCPUs it runs */
+static void qemu_cpu_update_affinity(CPUState *cpu)
+{
+    unsigned long *host_cpus = bitmap_new(CPU_HOST_CPUS_MAX);
+    CPUState *other;
+    int ret;
+
+    CPU_FOREACH(other) {
+        if (other->thread == cpu->thread && other->host_cpus) {
+            bitmap_or(host_cpus, host_cpus, other->host_cpus,
+                      CPU_HOST_CPUS_MAX);
+        }
+    }
+    ret = qemu_thread_set_affinity(cpu->thread, host_cpus, CPU_HOST_CPUS_MAX);
+    if (ret < 0) {
+        warn_report("Unable to pin the thread of CPU %d: %s",
+                    cpu->cpu_index, strerror(-ret));
+    }
+    g_free(host_cpus);
+}
+
+void qemu_cpu_set_host_cpus(CPUState *cpu, const unsigned long *host_cpus)
+{
+    if (!cpu->host_cpus) {
+        cpu->host_cpus = bitmap_new(CPU_HOST_CPUS_MAX);
+    }
+    bitmap_copy(cpu->host_cpus, host_cpus, CPU_HOST_CPUS_MAX);
+    /* Not started yet, qemu_init_vcpu() pins it */
+    if (cpu->thread) {
+        qemu_cpu_update_affinity(cpu);
+    }
+}
+
 void qemu_init_vcpu(CPUState *cpu)
 {
     cpu->nr_cores = smp_cores;
@@ -1823,6 +2269,10 @@ void qemu_init_vcpu(CPUState *cpu)
     } else {
         qemu_dummy_start_vcpu(cpu);
     }
+
+    if (cpu->host_cpus) {
+        qemu_cpu_update_affinity(cpu);
+    }
 }
 
 void cpu_stop_current(void)
@@ -2002,6 +2452,31 @@ CpuInfoList *qmp_query_cpus(Error **errp)
     return head;
 }
 
+/* Can run out of band without the BQL: CPUs are only removed from the
+ * list under RCU, and everything read here is set once at realize time
+ * or an atomic.
+ */
+CpuInfoFastList *qmp_query_cpus_fast(Error **errp)
+{
+    CpuInfoFastList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    rcu_read_lock();
+    CPU_FOREACH(cpu) {
+        CpuInfoFastList *info = g_new0(CpuInfoFastList, 1);
+
+        info->value = g_new0(CpuInfoFast, 1);
+        info->value->cpu_index = cpu->cpu_index;
+        info->value->thread_id = cpu->thread_id;
+        info->value->halted = atomic_read(&cpu->halted);
+        *tail = info;
+        tail = &info->next;
+    }
+    rcu_read_unlock();
+
+    return head;
+}
+
 void qmp_memsave(int64_t addr, int64_t size, const char *filename,
                  bool has_cpu, int64_t cpu_index, Error **errp)
 {
@@ -3,6 +3,7 @@
 #include "qemu-common.h"
 #include "disas/bfd.h"
 #include "elf.h"
+#include "qemu/thread.h"
 
 #include "cpu.h"
 #include "disas/disas.h"
@@ -420,13 +421,156 @@ static bool cap_disas_monitor(disassemble_info *info, uint64_t pc, int count)
 # define cap_disas_monitor(i, p, c)  false
 #endif /* CONFIG_CAPSTONE */
 
+/* Text of the blocks target_disas() printed last.  Guests that keep
+ * flushing or invalidating their code get the same blocks retranslated,
+ * and with -d in_asm each retranslation would be disassembled again.
+ * A hit needs the same address, the same decoder setup and the same
+ * bytes, so the text is the one the disassembler would print.
+ */
+#define DISAS_CACHE_ENTRIES     1024
+#define DISAS_CACHE_MAX_BYTES   4096
+
+typedef struct DisasCacheEntry {
+    target_ulong code;
+    target_ulong size;
+    /* What disas_set_info() picked for the block */
+    disassembler_ftype print_insn;
+    unsigned long mach;
+    unsigned long flags;
+    enum bfd_endian endian;
+    int cap_arch;
+    int cap_mode;
+    int cap_insn_unit;
+    int cap_insn_split;
+    uint8_t *bytes;
+    guint hash;
+    char *text;
+} DisasCacheEntry;
+
+static QemuMutex disas_cache_lock;
+static GHashTable *disas_cache;
+
+static void __attribute__((constructor)) disas_cache_init(void)
+{
+    qemu_mutex_init(&disas_cache_lock);
+}
+
+static guint disas_cache_hash(gconstpointer key)
+{
+    return ((const DisasCacheEntry *)key)->hash;
+}
+
+static gboolean disas_cache_equal(gconstpointer a, gconstpointer b)
+{
+    const DisasCacheEntry *x = a, *y = b;
+
+    return x->hash == y->hash && x->code == y->code && x->size == y->size &&
+           x->print_insn == y->print_insn && x->mach == y->mach &&
+           x->flags == y->flags && x->endian == y->endian &&
+           x->cap_arch == y->cap_arch && x->cap_mode == y->cap_mode &&
+           x->cap_insn_unit == y->cap_insn_unit &&
+           x->cap_insn_split == y->cap_insn_split &&
+           !memcmp(x->bytes, y->bytes, x->size);
+}
+
+static void disas_cache_free(gpointer data)
+{
+    DisasCacheEntry *e = data;
+
+    g_free(e->bytes);
+    g_free(e->text);
+    g_free(e);
+}
+
+/* Fill in the key of @e for the block at @code, false if its bytes
+ * can't be read.
+ */
+static bool disas_cache_key(DisasCacheEntry *e, CPUState *cpu,
+                            struct disassemble_info *info,
+                            target_ulong code, target_ulong size)
+{
+    guint h = 5381;
+    target_ulong i;
+
+    e->code = code;
+    e->size = size;
+    e->print_insn = info->print_insn;
+    e->mach = info->mach;
+    e->flags = info->flags;
+    e->endian = info->endian;
+    e->cap_arch = info->cap_arch;
+    e->cap_mode = info->cap_mode;
+    e->cap_insn_unit = info->cap_insn_unit;
+    e->cap_insn_split = info->cap_insn_split;
+    e->bytes = g_malloc(size);
+    if (cpu_memory_rw_debug(cpu, code, e->bytes, size, 0) < 0) {
+        g_free(e->bytes);
+        return false;
+    }
+
+    for (i = 0; i < size; i++) {
+        h = h * 33 + e->bytes[i];
+    }
+    e->hash = h ^ (guint)code ^ (guint)e->mach ^
+              ((guint)e->cap_mode << 16);
+    return true;
+}
+
+/* Output of the disassembler as it is being cached.  The GString stands
+ * in for the FILE, as the Monitor does in monitor_disas().
+ */
+static int GCC_FMT_ATTR(2, 3) disas_cache_printf(FILE *stream,
+                                                 const char *fmt, ...)
+{
+    GString *str = (GString *)stream;
+    gsize len = str->len;
+    va_list ap;
+
+    va_start(ap, fmt);
+    g_string_append_vprintf(str, fmt, ap);
+    va_end(ap);
+    return str->len - len;
+}
+
+static void target_disas_info(struct disassemble_info *info,
+                              target_ulong code, target_ulong size)
+{
+    fprintf_function print = info->fprintf_func;
+    target_ulong pc;
+    int count;
+
+    if (info->cap_arch >= 0 && cap_disas_target(info, code, size)) {
+        return;
+    }
+
+    if (info->print_insn == NULL) {
+        info->print_insn = print_insn_od_target;
+    }
+
+    for (pc = code; size > 0; pc += count, size -= count) {
+        print(info->stream, "0x" TARGET_FMT_lx ":  ", pc);
+        count = info->print_insn(pc, info);
+        print(info->stream, "\n");
+        if (count < 0) {
+            break;
+        }
+        if (size < count) {
+            print(info->stream,
+                  "Disassembler disagrees with translator over instruction "
+                  "decoding\n"
+                  "Please report this to qemu-devel@nongnu.org\n");
+            break;
+        }
+    }
+}
+
 /* Disassemble this for me please... (debugging).  */
 void target_disas(FILE *out, CPUState *cpu, target_ulong code,
                   target_ulong size)
 {
     CPUClass *cc = CPU_GET_CLASS(cpu);
-    target_ulong pc;
-    int count;
+    DisasCacheEntry *e, *hit;
+    GString *text;
     CPUDebug s;
 
     INIT_DISASSEMBLE_INFO(s.info, out, fprintf);
@@ -451,28 +595,44 @@ void target_disas(FILE *out, CPUState *cpu, target_ulong code,
         cc->disas_set_info(cpu, &s.info);
     }
 
-    if (s.info.cap_arch >= 0 && cap_disas_target(&s.info, code, size)) {
+    e = g_new0(DisasCacheEntry, 1);
+    if (size == 0 || size > DISAS_CACHE_MAX_BYTES ||
+        !disas_cache_key(e, cpu, &s.info, code, size)) {
+        g_free(e);
+        target_disas_info(&s.info, code, size);
         return;
     }
 
-    if (s.info.print_insn == NULL) {
-        s.info.print_insn = print_insn_od_target;
+    qemu_mutex_lock(&disas_cache_lock);
+    if (!disas_cache) {
+        disas_cache = g_hash_table_new_full(disas_cache_hash,
+                                            disas_cache_equal,
+                                            disas_cache_free, NULL);
     }
-
-    for (pc = code; size > 0; pc += count, size -= count) {
-	fprintf(out, "0x" TARGET_FMT_lx ":  ", pc);
-	count = s.info.print_insn(pc, &s.info);
-	fprintf(out, "\n");
-	if (count < 0)
-	    break;
-        if (size < count) {
-            fprintf(out,
-                    "Disassembler disagrees with translator over instruction "
-                    "decoding\n"
-                    "Please report this to qemu-devel@nongnu.org\n");
-            break;
-        }
+    hit = g_hash_table_lookup(disas_cache, e);
+    if (hit) {
+        fputs(hit->text, out);
+        qemu_mutex_unlock(&disas_cache_lock);
+        disas_cache_free(e);
+        return;
+    }
+    qemu_mutex_unlock(&disas_cache_lock);
+
+    /* Not under the lock, the disassemblers can be slow */
+    text = g_string_new(NULL);
+    s.info.stream = (FILE *)text;
+    s.info.fprintf_func = disas_cache_printf;
+    target_disas_info(&s.info, code, size);
+    fputs(text->str, out);
+    e->text = g_string_free(text, false);
+
+    qemu_mutex_lock(&disas_cache_lock);
+    if (g_hash_table_size(disas_cache) >= DISAS_CACHE_ENTRIES) {
+        g_hash_table_remove_all(disas_cache);
     }
+    /* Another vCPU may have added the same block meanwhile */
+    g_hash_table_replace(disas_cache, e, e);
+    qemu_mutex_unlock(&disas_cache_lock);
 }
 
 /* Disassemble this for me please... (debugging). */
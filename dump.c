@@ -26,6 +26,8 @@
 #include "qmp-commands.h"
 #include "qapi-event.h"
 #include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
 #include "hw/misc/vmcoreinfo.h"
 
 #include <zlib.h>
@@ -370,6 +372,16 @@ static void write_data(DumpState *s, void *buf, int length, Error **errp)
     }
 }
 
+/* leave a hole in place of a zero page */
+static void skip_data(DumpState *s, int length, Error **errp)
+{
+    if (lseek(s->fd, length, SEEK_CUR) < 0) {
+        error_setg_errno(errp, errno, "dump: failed to skip zero page");
+    } else {
+        s->written_size += length;
+    }
+}
+
 /* write the memory to vmcore. 1 page per I/O. */
 static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
                          int64_t size, Error **errp)
@@ -378,8 +390,13 @@ static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
     Error *local_err = NULL;
 
     for (i = 0; i < size / s->dump_info.page_size; i++) {
-        write_data(s, block->host_addr + start + i * s->dump_info.page_size,
-                   s->dump_info.page_size, &local_err);
+        uint8_t *buf = block->host_addr + start + i * s->dump_info.page_size;
+
+        if (s->sparse && buffer_is_zero(buf, s->dump_info.page_size)) {
+            skip_data(s, s->dump_info.page_size, &local_err);
+        } else {
+            write_data(s, buf, s->dump_info.page_size, &local_err);
+        }
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -654,6 +671,7 @@ static void dump_iterate(DumpState *s, Error **errp)
 static void create_vmcore(DumpState *s, Error **errp)
 {
     Error *local_err = NULL;
+    off_t end;
 
     dump_begin(s, &local_err);
     if (local_err) {
@@ -661,7 +679,19 @@ static void create_vmcore(DumpState *s, Error **errp)
         return;
     }
 
-    dump_iterate(s, errp);
+    dump_iterate(s, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    /* the file ends short of the zero pages skipped last */
+    if (s->sparse) {
+        end = lseek(s->fd, 0, SEEK_CUR);
+        if (end < 0 || ftruncate(s->fd, end) < 0) {
+            error_setg_errno(errp, errno, "dump: failed to extend vmcore");
+        }
+    }
 }
 
 static int write_start_flat_header(int fd)
@@ -1293,20 +1323,225 @@ static inline bool is_zero_page(const uint8_t *buf, size_t page_size)
     return buffer_is_zero(buf, page_size);
 }
 
+/* pages compressed in one go, per compression thread */
+#define DUMP_BATCH_PAGES 256
+#define DUMP_MAX_THREADS 255
+
+typedef struct DumpPage {
+    uint8_t *buf;               /* the guest page */
+    uint8_t *out;               /* its compressed data */
+    size_t size_out;            /* 0 for a zero page */
+    uint32_t flags;             /* DUMP_DH_COMPRESSED_*, 0 for plaintext */
+} DumpPage;
+
+/*
+ * The batch of pages being written out. The compression threads and the
+ * dump thread claim pages of a batch with @next, and the dump thread
+ * writes the batch out once @done reaches @n_pages and no thread is
+ * left in it.
+ */
+typedef struct DumpCompress {
+    DumpState *s;
+    size_t len_buf_out;
+    DumpPage *pages;
+    size_t n_pages;
+    size_t next;
+    size_t done;
+    int active;                 /* threads working on the batch */
+    unsigned int batch;         /* bumped for each new batch */
+    bool quit;
+    QemuMutex lock;
+    QemuCond batch_cond;
+    QemuCond done_cond;
+    QemuThread *threads;
+    int n_threads;
+} DumpCompress;
+
+/*
+ * Compress one page. Only one compression format is set in s->flag_compress,
+ * but when compression fails to work, we fall back to save in plaintext.
+ */
+static void dump_compress_page(DumpState *s, DumpPage *p, size_t len_buf_out,
+                               void *wrkmem)
+{
+    size_t page_size = s->dump_info.page_size;
+    size_t size_out = len_buf_out;
+
+    if (is_zero_page(p->buf, page_size)) {
+        p->size_out = 0;
+        return;
+    }
+
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+        (compress2(p->out, (uLongf *)&size_out, p->buf, page_size,
+                   Z_BEST_SPEED) == Z_OK) &&
+        (size_out < page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_ZLIB;
+        p->size_out = size_out;
+        return;
+    }
+#ifdef CONFIG_LZO
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+        (lzo1x_1_compress(p->buf, page_size, p->out,
+                          (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
+        (size_out < page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_LZO;
+        p->size_out = size_out;
+        return;
+    }
+#endif
+#ifdef CONFIG_SNAPPY
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+        (snappy_compress((char *)p->buf, page_size, (char *)p->out,
+                         &size_out) == SNAPPY_OK) &&
+        (size_out < page_size)) {
+        p->flags = DUMP_DH_COMPRESSED_SNAPPY;
+        p->size_out = size_out;
+        return;
+    }
+#endif
+    p->flags = 0;
+    p->size_out = page_size;
+}
+
+/* Returns the number of pages compressed */
+static size_t dump_compress_batch(DumpCompress *dc, void *wrkmem)
+{
+    size_t n = 0;
+    size_t i;
+
+    while ((i = atomic_fetch_inc(&dc->next)) < dc->n_pages) {
+        dump_compress_page(dc->s, &dc->pages[i], dc->len_buf_out, wrkmem);
+        n++;
+    }
+    return n;
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompress *dc = opaque;
+    unsigned int batch = 0;
+    void *wrkmem = NULL;
+    size_t n;
+
+#ifdef CONFIG_LZO
+    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+
+    qemu_mutex_lock(&dc->lock);
+    for (;;) {
+        while (dc->batch == batch && !dc->quit) {
+            qemu_cond_wait(&dc->batch_cond, &dc->lock);
+        }
+        if (dc->quit) {
+            break;
+        }
+        batch = dc->batch;
+        dc->active++;
+        qemu_mutex_unlock(&dc->lock);
+        n = dump_compress_batch(dc, wrkmem);
+        qemu_mutex_lock(&dc->lock);
+        dc->active--;
+        dc->done += n;
+        qemu_cond_signal(&dc->done_cond);
+    }
+    qemu_mutex_unlock(&dc->lock);
+
+    g_free(wrkmem);
+    return NULL;
+}
+
+static void dump_compress_init(DumpCompress *dc, DumpState *s)
+{
+    size_t batch_pages = DUMP_BATCH_PAGES * s->threads;
+    size_t i;
+
+    dc->s = s;
+    dc->len_buf_out = get_len_buf_out(s->dump_info.page_size,
+                                      s->flag_compress);
+    assert(dc->len_buf_out != 0);
+    dc->pages = g_new0(DumpPage, batch_pages);
+    for (i = 0; i < batch_pages; i++) {
+        dc->pages[i].out = g_malloc(dc->len_buf_out);
+    }
+    dc->n_pages = 0;
+    dc->next = 0;
+    dc->done = 0;
+    dc->active = 0;
+    dc->batch = 0;
+    dc->quit = false;
+    qemu_mutex_init(&dc->lock);
+    qemu_cond_init(&dc->batch_cond);
+    qemu_cond_init(&dc->done_cond);
+
+    /* the dump thread compresses its share as well */
+    dc->n_threads = s->threads - 1;
+    dc->threads = g_new(QemuThread, dc->n_threads);
+    for (i = 0; i < dc->n_threads; i++) {
+        qemu_thread_create(&dc->threads[i], "dump_compress",
+                           dump_compress_thread, dc, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void dump_compress_destroy(DumpCompress *dc)
+{
+    size_t i;
+
+    qemu_mutex_lock(&dc->lock);
+    dc->quit = true;
+    qemu_cond_broadcast(&dc->batch_cond);
+    qemu_mutex_unlock(&dc->lock);
+    for (i = 0; i < dc->n_threads; i++) {
+        qemu_thread_join(&dc->threads[i]);
+    }
+    g_free(dc->threads);
+
+    for (i = 0; i < DUMP_BATCH_PAGES * dc->s->threads; i++) {
+        g_free(dc->pages[i].out);
+    }
+    g_free(dc->pages);
+    qemu_cond_destroy(&dc->done_cond);
+    qemu_cond_destroy(&dc->batch_cond);
+    qemu_mutex_destroy(&dc->lock);
+}
+
+/* compress the first @n_pages of dc->pages, with the help of the threads */
+static void dump_compress_run(DumpCompress *dc, size_t n_pages, void *wrkmem)
+{
+    size_t n;
+
+    qemu_mutex_lock(&dc->lock);
+    dc->n_pages = n_pages;
+    dc->next = 0;
+    dc->done = 0;
+    dc->batch++;
+    qemu_cond_broadcast(&dc->batch_cond);
+    qemu_mutex_unlock(&dc->lock);
+
+    n = dump_compress_batch(dc, wrkmem);
+
+    /* no thread may still be claiming pages once the next batch is set up */
+    qemu_mutex_lock(&dc->lock);
+    dc->done += n;
+    while (dc->done != dc->n_pages || dc->active) {
+        qemu_cond_wait(&dc->done_cond, &dc->lock);
+    }
+    qemu_mutex_unlock(&dc->lock);
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    DumpCompress dc;
+    void *wrkmem = NULL;
     off_t offset_desc, offset_data;
     PageDescriptor pd, pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
+    size_t batch_pages = DUMP_BATCH_PAGES * s->threads;
+    size_t n, i;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1315,16 +1550,13 @@ static void write_dump_pages(DumpState *s, Error **errp)
     prepare_data_cache(&page_desc, s, offset_desc);
     prepare_data_cache(&page_data, s, offset_data);
 
-    /* prepare buffer to store compressed data */
-    len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
-    assert(len_buf_out != 0);
+    /* prepare the buffers to store compressed data */
+    dump_compress_init(&dc, s);
 
 #ifdef CONFIG_LZO
     wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
 #endif
 
-    buf_out = g_malloc(len_buf_out);
-
     /*
      * init zero page's page_desc and page_data, because every zero page
      * uses the same page_data
@@ -1344,101 +1576,53 @@ static void write_dump_pages(DumpState *s, Error **errp)
     offset_data += s->dump_info.page_size;
 
     /*
-     * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * dump memory to vmcore a batch of pages at a time. zero page will all
+     * be resided in the first page of page section
      */
-    while (get_next_page(&block_iter, &pfn_iter, &buf, s)) {
-        /* check zero page */
-        if (is_zero_page(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
+    do {
+        for (n = 0; n < batch_pages; n++) {
+            if (!get_next_page(&block_iter, &pfn_iter, &dc.pages[n].buf, s)) {
+                break;
             }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
+        }
+        dump_compress_run(&dc, n, wrkmem);
+
+        for (i = 0; i < n; i++) {
+            DumpPage *p = &dc.pages[i];
+
+            if (p->size_out == 0) {
+                ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
+                                  false);
                 if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
+                    error_setg(errp, "dump: failed to write page desc");
                     goto out;
                 }
+                s->written_size += s->dump_info.page_size;
+                continue;
+            }
+
+            ret = write_cache(&page_data, p->flags ? p->out : p->buf,
+                              p->size_out, false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                goto out;
             }
 
             /* get and write page desc here */
+            pd.flags = cpu_to_dump32(s, p->flags);
+            pd.size = cpu_to_dump32(s, p->size_out);
             pd.page_flags = cpu_to_dump64(s, 0);
             pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
+            offset_data += p->size_out;
 
             ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
             if (ret < 0) {
                 error_setg(errp, "dump: failed to write page desc");
                 goto out;
             }
+            s->written_size += s->dump_info.page_size;
         }
-        s->written_size += s->dump_info.page_size;
-    }
+    } while (n == batch_pages);
 
     ret = write_cache(&page_desc, NULL, 0, true);
     if (ret < 0) {
@@ -1454,12 +1638,8 @@ static void write_dump_pages(DumpState *s, Error **errp)
 out:
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
-
-#ifdef CONFIG_LZO
+    dump_compress_destroy(&dc);
     g_free(wrkmem);
-#endif
-
-    g_free(buf_out);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -1629,17 +1809,21 @@ static void vmcoreinfo_update_phys_base(DumpState *s)
 
 static void dump_init(DumpState *s, int fd, bool has_format,
                       DumpGuestMemoryFormat format, bool paging, bool has_filter,
-                      int64_t begin, int64_t length, Error **errp)
+                      int64_t begin, int64_t length, int threads, Error **errp)
 {
     VMCoreInfoState *vmci = vmcoreinfo_find();
     CPUState *cpu;
     int nr_cpus;
     Error *err = NULL;
+    struct stat st;
     int ret;
 
     s->has_format = has_format;
     s->format = format;
     s->written_size = 0;
+    s->threads = threads;
+    s->start_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    s->end_ms = 0;
 
     /* kdump-compressed is conflict with paging and filter */
     if (has_format && format != DUMP_GUEST_MEMORY_FORMAT_ELF) {
@@ -1663,6 +1847,11 @@ static void dump_init(DumpState *s, int fd, bool has_format,
     }
 
     s->fd = fd;
+    /*
+     * only an empty regular file reads back zeroes where we seek over a
+     * page; a file passed with fd: may still hold an older dump
+     */
+    s->sparse = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && !st.st_size;
     s->has_filter = has_filter;
     s->begin = begin;
     s->length = length;
@@ -1862,8 +2051,9 @@ static void dump_process(DumpState *s, Error **errp)
     } else {
         create_vmcore(s, &local_err);
     }
+    s->end_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
-    /* make sure status is written after written_size updates */
+    /* make sure status is written after written_size and end_ms updates */
     smp_wmb();
     atomic_set(&s->status,
                (local_err ? DUMP_STATUS_FAILED : DUMP_STATUS_COMPLETED));
@@ -1892,11 +2082,19 @@ DumpQueryResult *qmp_query_dump(Error **errp)
 {
     DumpQueryResult *result = g_new(DumpQueryResult, 1);
     DumpState *state = &dump_state_global;
+    int64_t end_ms;
+
     result->status = atomic_read(&state->status);
     /* make sure we are reading status and written_size in order */
     smp_rmb();
     result->completed = state->written_size;
     result->total = state->total_size;
+    result->throughput = 0;
+    if (result->status != DUMP_STATUS_NONE) {
+        end_ms = state->end_ms ?: qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+        result->throughput = result->completed * 1000 /
+                             MAX(end_ms - state->start_ms, 1);
+    }
     return result;
 }
 
@@ -1904,7 +2102,8 @@ void qmp_dump_guest_memory(bool paging, const char *file,
                            bool has_detach, bool detach,
                            bool has_begin, int64_t begin, bool has_length,
                            int64_t length, bool has_format,
-                           DumpGuestMemoryFormat format, Error **errp)
+                           DumpGuestMemoryFormat format, bool has_threads,
+                           int64_t threads, Error **errp)
 {
     const char *p;
     int fd = -1;
@@ -1945,6 +2144,13 @@ void qmp_dump_guest_memory(bool paging, const char *file,
     if (has_detach) {
         detach_p = detach;
     }
+    if (!has_threads) {
+        threads = 1;
+    } else if (threads < 1 || threads > DUMP_MAX_THREADS) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "threads",
+                   "an integer in the range of 1 to 255");
+        return;
+    }
 
     /* check whether lzo/snappy is supported */
 #ifndef CONFIG_LZO
@@ -1987,7 +2193,7 @@ void qmp_dump_guest_memory(bool paging, const char *file,
     dump_state_prepare(s);
 
     dump_init(s, fd, has_format, format, paging, has_begin,
-              begin, length, &local_err);
+              begin, length, threads, &local_err);
     if (local_err) {
         error_propagate(errp, local_err);
         atomic_set(&s->status, DUMP_STATUS_FAILED);
@@ -33,10 +33,17 @@
 #include "exec/address-spaces.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#ifdef CONFIG_TRACE_PERTHREAD
+#include "trace/perthread.h"
+#endif
+
+#include <zlib.h>
 
 /* Still under development.  */
 #define ETRACE_VERSION_MAJOR 0
-#define ETRACE_VERSION_MINOR 0
+#define ETRACE_VERSION_MINOR 1
 
 enum {
     TYPE_EXEC = 1,
@@ -47,6 +54,8 @@ enum {
     TYPE_BARRIER = 6,
     TYPE_OLD_EVENT_U64 = 7,
     TYPE_EVENT_U64 = 8,
+    TYPE_EXEC_DELTA = 9,
+    TYPE_MEM_DELTA = 10,
     TYPE_INFO = 0x4554,
 };
 
@@ -102,6 +111,19 @@ struct etrace_tb {
     uint32_t host_code_len;
 } QEMU_PACKED;
 
+/*
+ * Delta encoded records, with the delta flag. Fields are LEB128 varints,
+ * signed ones zigzag encoded. Deltas are against the previous record of
+ * the same type and unit, starting from zero.
+ *
+ * TYPE_EXEC_DELTA: start_time delta (signed), nr of entries, then per
+ *     entry: start - previous end (signed), end - start (signed), duration.
+ * TYPE_MEM_DELTA: time delta (signed), vaddr delta (signed),
+ *     paddr delta (signed), attr, size, value.
+ */
+#define ETRACE_VARINT_MAX 10
+#define ETRACE_EXEC_DELTA_MAX(n) ((2 + 3 * (n)) * ETRACE_VARINT_MAX)
+
 struct etrace_event_u64 {
     uint32_t flags;
     uint16_t unit_id;
@@ -113,6 +135,91 @@ struct etrace_event_u64 {
     uint16_t event_name_len;
 } QEMU_PACKED;
 
+/*
+ * Records are staged in per-thread rings and written out by a dedicated
+ * writer thread, so vCPUs never block on stdio. A ring only ever holds
+ * complete records in its published part, which lets the writer
+ * interleave rings at record granularity.
+ */
+#define ETRACE_RING_SIZE (4 * 1024 * 1024)
+#define ETRACE_WRITER_PERIOD_MS 10
+
+struct etrace_ring {
+    uint8_t *buf;
+    /* Producer side. wpos runs ahead of head while a record is built.  */
+    size_t wpos;
+    size_t head;
+    /* Consumer side.  */
+    size_t tail;
+    bool waiting;
+    QemuEvent space;
+    struct etrace_ring *next;
+};
+
+#define EXEC_CACHE_SIZE (16 * 1024)
+
+struct etrace_unit {
+    uint64_t exec_start;
+    /* End of the TB that opened the range, see etrace_exec_tb.  */
+    uint64_t exec_end;
+    bool exec_start_valid;
+    int64_t exec_start_time;
+    struct {
+        union {
+            struct etrace_entry64 t64[EXEC_CACHE_SIZE];
+            struct etrace_entry32 t32[2 * EXEC_CACHE_SIZE];
+        };
+        uint64_t start_time;
+        unsigned int pos;
+    } exec_cache;
+
+    /* Sampling counters.  */
+    unsigned int exec_sample_cnt;
+    unsigned int mem_sample_cnt;
+
+    /* Performance counters, see etrace_count.  */
+    struct {
+        uint64_t val[ETRACE_CNT_TLB_MISS];
+        uint64_t prev[ETRACE_CNT_TLB_MISS];
+        uint64_t tlb_miss[NB_MMU_MODES];
+        uint64_t tlb_miss_prev[NB_MMU_MODES];
+        /* struct etrace_io_counter keyed by MemoryRegion.  */
+        GHashTable *io;
+        char *dev_name;
+        uint64_t next_sample;
+        unsigned int polls;
+    } cnt;
+
+    /* Delta encoding state.  */
+    struct {
+        uint64_t exec_time;
+        uint64_t exec_end;
+        uint64_t mem_time;
+        uint64_t mem_vaddr;
+        uint64_t mem_paddr;
+        uint8_t *buf;
+    } delta;
+};
+
+#define ETRACE_COUNTER_PERIOD_NS 1000000
+/* Only look at the clock every so many polls.  */
+#define ETRACE_COUNTER_POLL_MASK 0xff
+
+struct etrace_io_counter {
+    char *name;
+    uint64_t val;
+    uint64_t prev;
+};
+
+static const char *etrace_counter_names[] = {
+    [ETRACE_CNT_TB] = "tbs",
+    [ETRACE_CNT_EXCP] = "exceptions",
+    [ETRACE_CNT_IRQ] = "irqs",
+};
+
+static __thread struct etrace_ring *etrace_thread_ring;
+static __thread unsigned int etrace_note_unit;
+
 const char *qemu_arg_etrace;
 const char *qemu_arg_etrace_flags;
 struct etracer qemu_etracer = {0};
@@ -133,10 +240,78 @@ struct {
     { "mem", ETRACE_F_MEM },
     { "cpu", ETRACE_F_CPU },
     { "gpio", ETRACE_F_GPIO },
-    { "all", ~0 },
+    { "counters", ETRACE_F_COUNTERS },
+    { "trace", ETRACE_F_TRACE },
+    { "delta", ETRACE_F_DELTA },
+    { "zlib", ETRACE_F_ZLIB },
+    { "all", ~(ETRACE_F_DELTA | ETRACE_F_ZLIB) },
     { NULL, 0 },
 };
 
+static bool qemu_etrace_parse_range(GArray **ranges, const char *str)
+{
+    struct etrace_range r;
+    const char *end;
+
+    if (qemu_strtou64(str, &end, 0, &r.start) || *end != '-'
+        || qemu_strtou64(end + 1, NULL, 0, &r.end) || r.end < r.start) {
+        return false;
+    }
+    if (!*ranges) {
+        *ranges = g_array_new(false, false, sizeof r);
+    }
+    g_array_append_val(*ranges, r);
+    return true;
+}
+
+static bool qemu_etrace_parse_sample(unsigned int *rate, const char *str)
+{
+    uint64_t v;
+
+    if (qemu_strtou64(str, NULL, 0, &v) || !v || v > UINT_MAX) {
+        return false;
+    }
+    *rate = v;
+    return true;
+}
+
+/*
+ * Filter options, key=value:
+ *   exec-range=START-END   only trace TBs starting at guest PCs START-END.
+ *   mem-range=START-END    only trace accesses to physical START-END.
+ *   exec-sample=N          trace one in N TB executions per unit.
+ *   mem-sample=N           trace one in N memory accesses per unit.
+ *   counter-period=NS      sample performance counters every NS of
+ *                          virtual time.
+ * Ranges are inclusive and may be given multiple times.
+ */
+static void qemu_etrace_parse_filter(struct etracer *t, const char *str,
+                                     size_t len)
+{
+    char *opt = g_strndup(str, len);
+    char *val = strchr(opt, '=');
+    bool ok = false;
+
+    *val++ = 0;
+    if (!strcmp(opt, "exec-range")) {
+        ok = qemu_etrace_parse_range(&t->filter.exec_ranges, val);
+    } else if (!strcmp(opt, "mem-range")) {
+        ok = qemu_etrace_parse_range(&t->filter.mem_ranges, val);
+    } else if (!strcmp(opt, "exec-sample")) {
+        ok = qemu_etrace_parse_sample(&t->filter.exec_sample, val);
+    } else if (!strcmp(opt, "mem-sample")) {
+        ok = qemu_etrace_parse_sample(&t->filter.mem_sample, val);
+    } else if (!strcmp(opt, "counter-period")) {
+        ok = !qemu_strtou64(val, NULL, 0, &t->counter_period)
+             && t->counter_period;
+    }
+    if (!ok) {
+        fprintf(stderr, "Invalid etrace filter %s=%s\n", opt, val);
+        exit(EXIT_FAILURE);
+    }
+    g_free(opt);
+}
+
 static uint64_t qemu_etrace_str2flags(const char *str, size_t len)
 {
     uint64_t flags = 0;
@@ -155,13 +330,13 @@ static uint64_t qemu_etrace_str2flags(const char *str, size_t len)
         pos++;
     }
     if (!flags) {
-        fprintf(stderr, "Invalid etrace flag %s\n", str);
+        fprintf(stderr, "Invalid etrace flag %.*s\n", (int) len, str);
         exit(EXIT_FAILURE);
     }
     return flags;
 }
 
-static uint64_t qemu_etrace_opts2flags(const char *opts)
+static uint64_t qemu_etrace_opts2flags(struct etracer *t, const char *opts)
 {
     uint64_t flags = 0;
     const char *prev = opts, *end = opts;
@@ -170,7 +345,11 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
         while (*end != ',' && *end != 0) {
             end++;
         }
-        flags |= qemu_etrace_str2flags(prev, end - prev);
+        if (memchr(prev, '=', end - prev)) {
+            qemu_etrace_parse_filter(t, prev, end - prev);
+        } else {
+            flags |= qemu_etrace_str2flags(prev, end - prev);
+        }
         while (*end == ',') {
             end++;
         }
@@ -179,7 +358,7 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
     return flags;
 }
 
-static void etrace_write(struct etracer *t, const void *buf, size_t len)
+static void etrace_fwrite_raw(struct etracer *t, const void *buf, size_t len)
 {
     size_t r;
 
@@ -195,6 +374,182 @@ static void etrace_write(struct etracer *t, const void *buf, size_t len)
     assert(r == len);
 }
 
+static void etrace_deflate(struct etracer *t, const void *buf, size_t len,
+                           int flush)
+{
+    z_stream *zs = t->zs;
+    uint8_t out[64 * 1024];
+    int r;
+
+    zs->next_in = (Bytef *) buf;
+    zs->avail_in = len;
+    do {
+        zs->next_out = out;
+        zs->avail_out = sizeof out;
+        r = deflate(zs, flush);
+        assert(r != Z_STREAM_ERROR);
+        etrace_fwrite_raw(t, out, sizeof out - zs->avail_out);
+    } while (zs->avail_out == 0);
+}
+
+static void etrace_fwrite(struct etracer *t, const void *buf, size_t len)
+{
+    if (t->zs) {
+        etrace_deflate(t, buf, len, Z_NO_FLUSH);
+        t->zs_pending = true;
+    } else {
+        etrace_fwrite_raw(t, buf, len);
+    }
+}
+
+/* Push everything written so far out to the peer.  */
+static void etrace_fflush(struct etracer *t)
+{
+    if (t->zs && t->zs_pending) {
+        /* Byte aligns the stream so readers can decode what we have.  */
+        etrace_deflate(t, NULL, 0, Z_SYNC_FLUSH);
+        t->zs_pending = false;
+    }
+    fflush(t->fp);
+}
+
+static void etrace_ring_drain(struct etracer *t, struct etrace_ring *r)
+{
+    size_t head = atomic_load_acquire(&r->head);
+    size_t tail = r->tail;
+
+    while (tail != head) {
+        size_t off = tail & (ETRACE_RING_SIZE - 1);
+        size_t len = MIN(head - tail, ETRACE_RING_SIZE - off);
+
+        etrace_fwrite(t, r->buf + off, len);
+        tail += len;
+    }
+    atomic_store_release(&r->tail, tail);
+
+    /* Pairs with the barrier in etrace_ring_reserve.  */
+    smp_mb();
+    if (atomic_read(&r->waiting)) {
+        qemu_event_set(&r->space);
+    }
+}
+
+static void *etrace_writer_thread(void *opaque)
+{
+    struct etracer *t = opaque;
+    struct etrace_ring *r;
+    bool stop;
+
+    do {
+        /* Sample before draining so the last pass sees everything.  */
+        stop = !atomic_read(&t->running);
+        for (r = atomic_rcu_read(&t->rings); r; r = r->next) {
+            etrace_ring_drain(t, r);
+        }
+        etrace_fflush(t);
+        if (!stop) {
+            qemu_sem_timedwait(&t->wake, ETRACE_WRITER_PERIOD_MS);
+        }
+    } while (!stop);
+    return NULL;
+}
+
+static struct etrace_ring *etrace_ring_get(struct etracer *t)
+{
+    struct etrace_ring *r = etrace_thread_ring;
+
+    if (likely(r)) {
+        return r;
+    }
+
+    r = g_new0(struct etrace_ring, 1);
+    r->buf = g_malloc(ETRACE_RING_SIZE);
+    qemu_event_init(&r->space, false);
+    do {
+        r->next = atomic_read(&t->rings);
+    } while (atomic_cmpxchg(&t->rings, r->next, r) != r->next);
+
+    etrace_thread_ring = r;
+    return r;
+}
+
+/* Wait until len more bytes fit in the ring.  */
+static void etrace_ring_reserve(struct etracer *t, struct etrace_ring *r,
+                                size_t len)
+{
+    /* A single record must fit or we would wait forever.  */
+    assert(r->wpos - r->head + len <= ETRACE_RING_SIZE);
+
+    while (r->wpos + len - atomic_load_acquire(&r->tail) > ETRACE_RING_SIZE) {
+        qemu_event_reset(&r->space);
+        atomic_mb_set(&r->waiting, true);
+        if (r->wpos + len - atomic_read(&r->tail) > ETRACE_RING_SIZE) {
+            qemu_sem_post(&t->wake);
+            qemu_event_wait(&r->space);
+        }
+        atomic_set(&r->waiting, false);
+    }
+}
+
+static void etrace_write(struct etracer *t, const void *buf, size_t len)
+{
+    struct etrace_ring *r;
+    size_t off, first;
+
+    if (!atomic_read(&t->running)) {
+        return;
+    }
+
+    r = etrace_ring_get(t);
+    etrace_ring_reserve(t, r, len);
+
+    off = r->wpos & (ETRACE_RING_SIZE - 1);
+    first = MIN(len, ETRACE_RING_SIZE - off);
+    memcpy(r->buf + off, buf, first);
+    memcpy(r->buf, (const uint8_t *) buf + first, len - first);
+    r->wpos += len;
+}
+
+/* Publish the record built by the previous etrace_write calls.  */
+static void etrace_commit(struct etracer *t)
+{
+    struct etrace_ring *r = etrace_thread_ring;
+    size_t used, prev_used;
+
+    if (!r || r->wpos == r->head) {
+        return;
+    }
+
+    prev_used = r->head - atomic_read(&r->tail);
+    used = r->wpos - atomic_read(&r->tail);
+    atomic_store_release(&r->head, r->wpos);
+
+    /* Kick the writer early once the ring gets half full.  */
+    if (prev_used < ETRACE_RING_SIZE / 2 && used >= ETRACE_RING_SIZE / 2) {
+        qemu_sem_post(&t->wake);
+    }
+}
+
+static struct etrace_unit *etrace_unit(struct etracer *t,
+                                       unsigned int unit_id)
+{
+    struct etrace_unit *u, *old;
+
+    assert(unit_id < ETRACE_MAX_UNITS);
+    u = atomic_rcu_read(&t->units[unit_id]);
+    if (likely(u)) {
+        return u;
+    }
+
+    u = g_new0(struct etrace_unit, 1);
+    old = atomic_cmpxchg(&t->units[unit_id], NULL, u);
+    if (old) {
+        g_free(u);
+        u = old;
+    }
+    return u;
+}
+
 static void etrace_write_header(struct etracer *t, uint16_t type,
                                 uint16_t unit_id, uint32_t len)
 {
@@ -206,6 +561,17 @@ static void etrace_write_header(struct etracer *t, uint16_t type,
     etrace_write(t, &hdr, sizeof hdr);
 }
 
+static void etrace_fwrite_header(struct etracer *t, uint16_t type,
+                                 uint16_t unit_id, uint32_t len)
+{
+    struct etrace_hdr hdr = {
+        .type = type,
+        .unit_id = unit_id,
+        .len = len
+    };
+    etrace_fwrite(t, &hdr, sizeof hdr);
+}
+
 #define UNIX_PREFIX "unix:"
 
 static int sk_unix_client(const char *descr)
@@ -266,6 +632,27 @@ static FILE *etrace_open(const char *descr)
  *
  * arch_id should identify the architecture. Maybe the ELF machine code?
  */
+#ifdef CONFIG_TRACE_PERTHREAD
+static __thread bool etrace_in_trace_event;
+
+/* Mirror enabled trace events into the stream, next to the exec records
+ * of the vCPU that hit them.  Events of other threads have no unit.
+ */
+static void etrace_trace_event(const char *name, uint64_t val)
+{
+    CPUState *cpu = current_cpu;
+
+    /* Trace events in the etrace code itself would nest records.  */
+    if (etrace_in_trace_event) {
+        return;
+    }
+    etrace_in_trace_event = true;
+    etrace_event_u64(&qemu_etracer, cpu ? cpu->cpu_index : -1,
+                     ETRACE_EVU64_F_NONE, "trace", name, val, 0);
+    etrace_in_trace_event = false;
+}
+#endif
+
 bool etrace_init(struct etracer *t, const char *filename,
                  const char *opts,
                  unsigned int arch_id, unsigned int arch_bits)
@@ -274,11 +661,27 @@ bool etrace_init(struct etracer *t, const char *filename,
     struct etrace_arch arch;
 
     memset(t, 0, sizeof *t);
+    memset(&arch, 0, sizeof arch);
+    t->counter_period = ETRACE_COUNTER_PERIOD_NS;
     t->fp = etrace_open(filename);
     if (!t->fp) {
         return false;
     }
 
+    t->flags = qemu_etrace_opts2flags(t, opts);
+    if (t->flags & ETRACE_F_ZLIB) {
+        t->zs = g_new0(z_stream, 1);
+        /* 31 selects gzip framing so the output works with zcat.  */
+        if (deflateInit2(t->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK) {
+            g_free(t->zs);
+            t->zs = NULL;
+            fclose(t->fp);
+            t->fp = NULL;
+            return false;
+        }
+    }
+
     memset(&id, 0, sizeof id);
     id.version.major = ETRACE_VERSION_MAJOR;
     id.version.minor = ETRACE_VERSION_MINOR;
@@ -286,8 +689,9 @@ bool etrace_init(struct etracer *t, const char *filename,
     if (qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
         id.attr |= ETRACE_INFO_F_TB_CHAINING;
     }
-    etrace_write_header(t, TYPE_INFO, 0, sizeof id);
-    etrace_write(t, &id, sizeof id);
+    /* The writer isn't running yet, so these go out first.  */
+    etrace_fwrite_header(t, TYPE_INFO, 0, sizeof id);
+    etrace_fwrite(t, &id, sizeof id);
 
 
     /* FIXME: Pass info about host.  */
@@ -296,17 +700,99 @@ bool etrace_init(struct etracer *t, const char *filename,
 #ifdef TARGET_WORDS_BIGENDIAN
     arch.guest.big_endian = 1;
 #endif
-    etrace_write_header(t, TYPE_ARCH, 0, sizeof arch);
-    etrace_write(t, &arch, sizeof arch);
-
-    t->flags = qemu_etrace_opts2flags(opts);
+    etrace_fwrite_header(t, TYPE_ARCH, 0, sizeof arch);
+    etrace_fwrite(t, &arch, sizeof arch);
+
+    qemu_sem_init(&t->wake, 0);
+    t->running = true;
+    qemu_thread_create(&t->writer, "etrace", etrace_writer_thread, t,
+                       QEMU_THREAD_JOINABLE);
+#ifdef CONFIG_TRACE_PERTHREAD
+    if (t == &qemu_etracer && (t->flags & ETRACE_F_TRACE)) {
+        atomic_set(&pt_event_hook, etrace_trace_event);
+    }
+#endif
     return true;
 }
 
-static void etrace_flush_exec_cache(struct etracer *t)
+/* Exec cache accessors. To avoid duplicating src code we use the cpp.  */
+#define XC_ACCESSOR(field)                                                \
+static inline void execache_set_ ## field(struct etracer *t,              \
+                                          struct etrace_unit *u,          \
+                                          unsigned int pos, uint64_t v)   \
+{                                                                         \
+    if (t->arch_bits == 32) {                                             \
+        u->exec_cache.t32[pos].field = v;                                 \
+    } else {                                                              \
+        u->exec_cache.t64[pos].field = v;                                 \
+    }                                                                     \
+}                                                                         \
+static inline uint64_t execache_get_ ## field(struct etracer *t,          \
+                                              struct etrace_unit *u,      \
+                                              unsigned int pos)           \
+{                                                                         \
+    if (t->arch_bits == 32) {                                             \
+        return u->exec_cache.t32[pos].field;                              \
+    } else {                                                              \
+        return u->exec_cache.t64[pos].field;                              \
+    }                                                                     \
+}
+
+XC_ACCESSOR(start)
+XC_ACCESSOR(end)
+XC_ACCESSOR(duration)
+
+static unsigned int etrace_put_uleb(uint8_t *p, uint64_t v)
 {
-    size_t size64 = t->exec_cache.pos * sizeof t->exec_cache.t64[0];
-    size_t size32 = t->exec_cache.pos * sizeof t->exec_cache.t32[0];
+    unsigned int n = 0;
+
+    while (v >= 0x80) {
+        p[n++] = v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+static unsigned int etrace_put_sleb(uint8_t *p, int64_t v)
+{
+    return etrace_put_uleb(p, ((uint64_t) v << 1) ^ (v >> 63));
+}
+
+static void etrace_write_exec_delta(struct etracer *t, unsigned int unit_id,
+                                    struct etrace_unit *u)
+{
+    unsigned int i, n = u->exec_cache.pos;
+    uint8_t *p;
+
+    if (!u->delta.buf) {
+        u->delta.buf = g_malloc(ETRACE_EXEC_DELTA_MAX(EXEC_CACHE_SIZE));
+    }
+    p = u->delta.buf;
+
+    p += etrace_put_sleb(p, u->exec_cache.start_time - u->delta.exec_time);
+    p += etrace_put_uleb(p, n);
+    u->delta.exec_time = u->exec_cache.start_time;
+
+    for (i = 0; i < n; i++) {
+        uint64_t start = execache_get_start(t, u, i);
+        uint64_t end = execache_get_end(t, u, i);
+
+        p += etrace_put_sleb(p, start - u->delta.exec_end);
+        p += etrace_put_sleb(p, end - start);
+        p += etrace_put_uleb(p, execache_get_duration(t, u, i));
+        u->delta.exec_end = end;
+    }
+
+    etrace_write_header(t, TYPE_EXEC_DELTA, unit_id, p - u->delta.buf);
+    etrace_write(t, u->delta.buf, p - u->delta.buf);
+}
+
+static void etrace_flush_unit(struct etracer *t, unsigned int unit_id,
+                              struct etrace_unit *u)
+{
+    size_t size64 = u->exec_cache.pos * sizeof u->exec_cache.t64[0];
+    size_t size32 = u->exec_cache.pos * sizeof u->exec_cache.t32[0];
     size_t size = t->arch_bits == 32 ? size32 : size64;
     struct etrace_exec ex;
 
@@ -314,17 +800,36 @@ static void etrace_flush_exec_cache(struct etracer *t)
         return;
     }
 
-    ex.start_time = t->exec_cache.start_time;
+    if (t->flags & ETRACE_F_DELTA) {
+        etrace_write_exec_delta(t, unit_id, u);
+    } else {
+        ex.start_time = u->exec_cache.start_time;
 
-    etrace_write_header(t, TYPE_EXEC, t->exec_cache.unit_id, size + sizeof ex);
-    etrace_write(t, &ex, sizeof ex);
-    etrace_write(t, &t->exec_cache.t64[0], size);
-    t->exec_cache.pos = 0;
-    memset(&t->exec_cache.t64[0], 0, sizeof t->exec_cache.t64);
+        etrace_write_header(t, TYPE_EXEC, unit_id, size + sizeof ex);
+        etrace_write(t, &ex, sizeof ex);
+        etrace_write(t, &u->exec_cache.t64[0], size);
+    }
+    u->exec_cache.pos = 0;
+    memset(&u->exec_cache.t64[0], 0, sizeof u->exec_cache.t64);
 
     /* A barrier indicates that the other side can assume order across the
        the barrier.  */
-    etrace_write_header(t, TYPE_BARRIER, t->exec_cache.unit_id, 0);
+    etrace_write_header(t, TYPE_BARRIER, unit_id, 0);
+    etrace_commit(t);
+}
+
+/* Flush the exec records of unit_id, if it has any.  */
+static void etrace_flush_exec_cache(struct etracer *t, unsigned int unit_id)
+{
+    struct etrace_unit *u;
+
+    if (unit_id >= ETRACE_MAX_UNITS) {
+        return;
+    }
+    u = atomic_rcu_read(&t->units[unit_id]);
+    if (u) {
+        etrace_flush_unit(t, unit_id, u);
+    }
 }
 
 #define PROXIMITY_MASK (~0xfff)
@@ -359,31 +864,6 @@ static bool qualify_merge(uint64_t start, uint64_t end,
     return true;
 }
 
-/* Exec cache accessors. To avoid duplicating src code we use the cpp.  */
-#define XC_ACCESSOR(field)                                                \
-static inline void execache_set_ ## field(struct etracer *t,              \
-                                          unsigned int pos, uint64_t v)   \
-{                                                                         \
-    if (t->arch_bits == 32) {                                             \
-        t->exec_cache.t32[pos].field = v;                                 \
-    } else {                                                              \
-        t->exec_cache.t64[pos].field = v;                                 \
-    }                                                                     \
-}                                                                         \
-static inline uint64_t execache_get_ ## field(struct etracer *t,          \
-                                              unsigned int pos)           \
-{                                                                         \
-    if (t->arch_bits == 32) {                                             \
-        return t->exec_cache.t32[pos].field;                              \
-    } else {                                                              \
-        return t->exec_cache.t64[pos].field;                              \
-    }                                                                     \
-}
-
-XC_ACCESSOR(start)
-XC_ACCESSOR(end)
-XC_ACCESSOR(duration)
-
 /*
  * dump an execution record.
  *
@@ -394,39 +874,37 @@ void etrace_dump_exec(struct etracer *t, unsigned int unit_id,
                       uint64_t start, uint64_t end,
                       uint64_t start_time, uint32_t duration)
 {
+    struct etrace_unit *u = etrace_unit(t, unit_id);
     unsigned int pos;
 
-    if (unit_id != t->exec_cache.unit_id) {
-        etrace_flush_exec_cache(t);
-        t->exec_cache.unit_id = unit_id;
-    }
-
-    pos = t->exec_cache.pos;
+    pos = u->exec_cache.pos;
     if (pos == 0) {
-        t->exec_cache.start_time = start_time;
+        u->exec_cache.start_time = start_time;
     }
 
     assert(t->arch_bits == 32 || t->arch_bits == 64);
     if (pos &&
-        qualify_merge(execache_get_start(t, pos), execache_get_end(t, pos),
+        qualify_merge(execache_get_start(t, u, pos),
+                      execache_get_end(t, u, pos),
                       start, end)) {
         /* Reuse the old entry.  */
         pos -= 1;
-        execache_set_duration(t, pos, execache_get_duration(t, pos) + duration);
+        execache_set_duration(t, u, pos,
+                              execache_get_duration(t, u, pos) + duration);
     } else {
         /* Advance.  */
-        t->exec_cache.pos += 1;
-        execache_set_start(t, pos, start);
-        execache_set_duration(t, pos, duration);
+        u->exec_cache.pos += 1;
+        execache_set_start(t, u, pos, start);
+        execache_set_duration(t, u, pos, duration);
     }
 
-    execache_set_end(t, pos, end);
+    execache_set_end(t, u, pos, end);
     if (!qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
-        assert(execache_get_start(t, pos) <= execache_get_end(t, pos));
+        assert(execache_get_start(t, u, pos) <= execache_get_end(t, u, pos));
     }
 
-    if (t->exec_cache.pos == EXEC_CACHE_SIZE) {
-        etrace_flush_exec_cache(t);
+    if (u->exec_cache.pos == EXEC_CACHE_SIZE) {
+        etrace_flush_unit(t, unit_id, u);
     }
 }
 
@@ -489,6 +967,7 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
     etrace_dump_guestmem(t, as, guest_vaddr, guest_paddr, guest_len);
     /* Host/native code.  */
     etrace_write(t, host_buf, host_len);
+    etrace_commit(t);
 }
 
 static uint64_t etrace_time(void)
@@ -500,13 +979,43 @@ static uint64_t etrace_time(void)
 #endif
 }
 
+static void etrace_mem_access_delta(struct etracer *t, uint16_t unit_id,
+                                    uint64_t guest_vaddr,
+                                    uint64_t guest_paddr,
+                                    size_t size, uint64_t attr, uint64_t val)
+{
+    struct etrace_unit *u = etrace_unit(t, unit_id);
+    uint8_t buf[6 * ETRACE_VARINT_MAX];
+    uint64_t now = etrace_time();
+    uint8_t *p = buf;
+
+    p += etrace_put_sleb(p, now - u->delta.mem_time);
+    p += etrace_put_sleb(p, guest_vaddr - u->delta.mem_vaddr);
+    p += etrace_put_sleb(p, guest_paddr - u->delta.mem_paddr);
+    p += etrace_put_uleb(p, attr);
+    p += etrace_put_uleb(p, size);
+    p += etrace_put_uleb(p, val);
+    u->delta.mem_time = now;
+    u->delta.mem_vaddr = guest_vaddr;
+    u->delta.mem_paddr = guest_paddr;
+
+    etrace_write_header(t, TYPE_MEM_DELTA, unit_id, p - buf);
+    etrace_write(t, buf, p - buf);
+    etrace_commit(t);
+}
+
 void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val)
 {
     struct etrace_mem mem;
 
-    etrace_flush_exec_cache(t);
+    etrace_flush_exec_cache(t, unit_id);
+    if ((t->flags & ETRACE_F_DELTA) && unit_id < ETRACE_MAX_UNITS) {
+        etrace_mem_access_delta(t, unit_id, guest_vaddr, guest_paddr,
+                                size, attr, val);
+        return;
+    }
     mem.time = etrace_time();
     mem.vaddr = guest_vaddr;
     mem.paddr = guest_paddr;
@@ -517,35 +1026,126 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
     /* Write headers.  */
     etrace_write_header(t, TYPE_MEM, unit_id, sizeof mem);
     etrace_write(t, &mem, sizeof mem);
+    etrace_commit(t);
 }
 
 void etrace_dump_exec_start(struct etracer *t,
                             unsigned int unit_id,
                             uint64_t start)
 {
-    assert(!t->exec_start_valid);
-    t->exec_start = start;
-    t->exec_start_time = etrace_time();
-    t->exec_start_valid = true;
+    struct etrace_unit *u = etrace_unit(t, unit_id);
+
+    assert(!u->exec_start_valid);
+    u->exec_start = start;
+    u->exec_start_time = etrace_time();
+    u->exec_start_valid = true;
 }
 
 void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end)
 {
+    struct etrace_unit *u = etrace_unit(t, unit_id);
     int64_t tdiff;
-    if (!t->exec_start_valid) {
-        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n", t->exec_start, end);
+
+    if (!u->exec_start_valid) {
+        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n",
+               u->exec_start, end);
     }
-    tdiff = etrace_time() - t->exec_start_time;
+    tdiff = etrace_time() - u->exec_start_time;
     if (tdiff < 0) {
         printf("tdiff=%" PRId64 "\n", tdiff);
         fflush(NULL);
     }
     assert(tdiff >= 0);
-    assert(t->exec_start_valid);
-    t->exec_start_valid = false;
-    etrace_dump_exec(t, unit_id, t->exec_start, end, t->exec_start_time, tdiff);
+    assert(u->exec_start_valid);
+    u->exec_start_valid = false;
+    etrace_dump_exec(t, unit_id, u->exec_start, end, u->exec_start_time,
+                     tdiff);
+}
+
+bool etrace_exec_start_valid(struct etracer *t, unsigned int unit_id)
+{
+    return etrace_unit(t, unit_id)->exec_start_valid;
+}
+
+void etrace_exec_tb(struct etracer *t, unsigned int unit_id,
+                    uint64_t start, uint64_t end)
+{
+    struct etrace_unit *u = etrace_unit(t, unit_id);
+
+    if (u->exec_start_valid) {
+        /* Still open, so the previous TB ran to its end.  */
+        etrace_dump_exec_end(t, unit_id, u->exec_end);
+    }
+    if (etrace_exec_sample(t, unit_id)) {
+        etrace_dump_exec_start(t, unit_id, start);
+        u->exec_end = end;
+    }
+}
+
+void etrace_exec_tb_end(struct etracer *t, unsigned int unit_id)
+{
+    struct etrace_unit *u = etrace_unit(t, unit_id);
+
+    if (u->exec_start_valid) {
+        etrace_dump_exec_end(t, unit_id, u->exec_end);
+    }
+}
+
+static bool etrace_ranges_match(GArray *ranges, uint64_t start, uint64_t end)
+{
+    unsigned int i;
+
+    if (!ranges) {
+        return true;
+    }
+    for (i = 0; i < ranges->len; i++) {
+        struct etrace_range *r = &g_array_index(ranges, struct etrace_range, i);
+
+        if (start <= r->end && end >= r->start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Does any exec range overlap the guest code start - end? (inclusive)  */
+bool etrace_exec_filter(struct etracer *t, uint64_t start, uint64_t end)
+{
+    return etrace_ranges_match(t->filter.exec_ranges, start, end);
+}
+
+bool etrace_mem_filter(struct etracer *t, uint64_t start, uint64_t end)
+{
+    return etrace_ranges_match(t->filter.mem_ranges, start, end);
+}
+
+static bool etrace_sample(unsigned int rate, unsigned int *cnt)
+{
+    if (rate <= 1) {
+        return true;
+    }
+    if (++*cnt < rate) {
+        return false;
+    }
+    *cnt = 0;
+    return true;
+}
+
+bool etrace_exec_sample(struct etracer *t, unsigned int unit_id)
+{
+    return etrace_sample(t->filter.exec_sample,
+                         &etrace_unit(t, unit_id)->exec_sample_cnt);
+}
+
+bool etrace_mem_sample(struct etracer *t, unsigned int unit_id)
+{
+    if (t->filter.mem_sample <= 1 || unit_id >= ETRACE_MAX_UNITS) {
+        return true;
+    }
+    return etrace_sample(t->filter.mem_sample,
+                         &etrace_unit(t, unit_id)->mem_sample_cnt);
 }
 
 void etrace_note_write(struct etracer *t, unsigned int unit_id,
@@ -553,12 +1153,18 @@ void etrace_note_write(struct etracer *t, unsigned int unit_id,
 {
     struct etrace_note nt;
 
-    etrace_flush_exec_cache(t);
+    etrace_flush_exec_cache(t, unit_id);
 
     nt.time = etrace_time();
     etrace_write_header(t, TYPE_NOTE, unit_id, sizeof nt + len);
     etrace_write(t, &nt, sizeof nt);
     etrace_write(t, buf, len);
+    etrace_commit(t);
+}
+
+void etrace_note_set_unit(struct etracer *t, unsigned int unit_id)
+{
+    etrace_note_unit = unit_id;
 }
 
 int etrace_note_fprintf(FILE *fp,
@@ -572,7 +1178,7 @@ int etrace_note_fprintf(FILE *fp,
     va_start(ap, fmt);
     r = vasprintf(&s, fmt, ap);
     if (r > 0) {
-        etrace_note_write(t, t->current_unit_id, s, r);
+        etrace_note_write(t, etrace_note_unit, s, r);
     }
     va_end(ap);
     return r;
@@ -587,7 +1193,7 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
     struct etrace_event_u64 event;
     size_t dev_len, event_len;
 
-    etrace_flush_exec_cache(t);
+    etrace_flush_exec_cache(t, unit_id);
 
     dev_len = strlen(dev_name) + 1;
     event_len = strlen(event_name) + 1;
@@ -604,12 +1210,173 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
     etrace_write(t, &event, sizeof event);
     etrace_write(t, dev_name, dev_len);
     etrace_write(t, event_name, event_len);
+    etrace_commit(t);
+}
+
+void etrace_count(struct etracer *t, unsigned int unit_id,
+                  enum etrace_counter c, unsigned int idx)
+{
+    struct etrace_unit *u;
+
+    if (unit_id >= ETRACE_MAX_UNITS) {
+        return;
+    }
+    u = etrace_unit(t, unit_id);
+    if (c == ETRACE_CNT_TLB_MISS) {
+        assert(idx < NB_MMU_MODES);
+        u->cnt.tlb_miss[idx]++;
+    } else {
+        u->cnt.val[c]++;
+    }
+}
+
+static void etrace_io_counter_free(gpointer data)
+{
+    struct etrace_io_counter *c = data;
+
+    g_free(c->name);
+    g_free(c);
+}
+
+void etrace_count_io(struct etracer *t, unsigned int unit_id,
+                     MemoryRegion *mr)
+{
+    struct etrace_io_counter *c;
+    struct etrace_unit *u;
+
+    if (unit_id >= ETRACE_MAX_UNITS) {
+        return;
+    }
+    u = etrace_unit(t, unit_id);
+    if (!u->cnt.io) {
+        u->cnt.io = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                          NULL, etrace_io_counter_free);
+    }
+    c = g_hash_table_lookup(u->cnt.io, mr);
+    if (!c) {
+        c = g_new0(struct etrace_io_counter, 1);
+        c->name = g_strdup_printf("io:%s", memory_region_name(mr));
+        g_hash_table_insert(u->cnt.io, mr, c);
+    }
+    c->val++;
+}
+
+static void etrace_counter_emit(struct etracer *t, unsigned int unit_id,
+                                struct etrace_unit *u, const char *name,
+                                uint64_t val, uint64_t *prev)
+{
+    if (val != *prev) {
+        etrace_event_u64(t, unit_id, ETRACE_EVU64_F_PREV_VAL,
+                         u->cnt.dev_name, name, val, *prev);
+        *prev = val;
+    }
+}
+
+void etrace_counters_poll(struct etracer *t, CPUState *cpu)
+{
+    unsigned int unit_id = cpu->cpu_index;
+    struct etrace_io_counter *c;
+    struct etrace_unit *u;
+    GHashTableIter iter;
+    uint64_t now;
+    unsigned int i;
+
+    if (unit_id >= ETRACE_MAX_UNITS) {
+        return;
+    }
+    u = etrace_unit(t, unit_id);
+    if (++u->cnt.polls & ETRACE_COUNTER_POLL_MASK) {
+        return;
+    }
+    now = etrace_time();
+    if (now < u->cnt.next_sample) {
+        return;
+    }
+    u->cnt.next_sample = now + t->counter_period;
+
+    if (!u->cnt.dev_name) {
+        u->cnt.dev_name = object_get_canonical_path(OBJECT(cpu));
+    }
+    for (i = 0; i < ARRAY_SIZE(etrace_counter_names); i++) {
+        etrace_counter_emit(t, unit_id, u, etrace_counter_names[i],
+                            u->cnt.val[i], &u->cnt.prev[i]);
+    }
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        char name[32];
+
+        if (u->cnt.tlb_miss[i] == u->cnt.tlb_miss_prev[i]) {
+            continue;
+        }
+        snprintf(name, sizeof name, "tlb-miss-mmu%u", i);
+        etrace_counter_emit(t, unit_id, u, name, u->cnt.tlb_miss[i],
+                            &u->cnt.tlb_miss_prev[i]);
+    }
+    if (u->cnt.io) {
+        g_hash_table_iter_init(&iter, u->cnt.io);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &c)) {
+            etrace_counter_emit(t, unit_id, u, c->name, c->val, &c->prev);
+        }
+    }
 }
 
 void etrace_close(struct etracer *t)
 {
-    if (t->fp) {
-        etrace_flush_exec_cache(t);
-        fclose(t->fp);
+    struct etrace_ring *r;
+    unsigned int i;
+
+    if (!t->fp) {
+        return;
+    }
+
+#ifdef CONFIG_TRACE_PERTHREAD
+    if (t == &qemu_etracer) {
+        atomic_set(&pt_event_hook, NULL);
+    }
+#endif
+    if (t->running) {
+        for (i = 0; i < ETRACE_MAX_UNITS; i++) {
+            etrace_flush_exec_cache(t, i);
+        }
+
+        atomic_mb_set(&t->running, false);
+        if (qemu_thread_is_self(&t->writer)) {
+            /* The writer is exiting due to a broken peer.  */
+            return;
+        }
+        qemu_sem_post(&t->wake);
+        qemu_thread_join(&t->writer);
+    }
+
+    if (t->zs) {
+        etrace_deflate(t, NULL, 0, Z_FINISH);
+        deflateEnd(t->zs);
+        g_free(t->zs);
+        t->zs = NULL;
+    }
+    fclose(t->fp);
+    t->fp = NULL;
+
+    while ((r = t->rings)) {
+        t->rings = r->next;
+        qemu_event_destroy(&r->space);
+        g_free(r->buf);
+        g_free(r);
+    }
+    for (i = 0; i < ETRACE_MAX_UNITS; i++) {
+        if (t->units[i]) {
+            g_free(t->units[i]->delta.buf);
+            g_free(t->units[i]->cnt.dev_name);
+            if (t->units[i]->cnt.io) {
+                g_hash_table_destroy(t->units[i]->cnt.io);
+            }
+        }
+        g_free(t->units[i]);
+        t->units[i] = NULL;
+    }
+    if (t->filter.exec_ranges) {
+        g_array_free(t->filter.exec_ranges, true);
+    }
+    if (t->filter.mem_ranges) {
+        g_array_free(t->filter.mem_ranges, true);
     }
 }
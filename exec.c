@@ -63,6 +63,7 @@
 #include "sysemu/replay.h"
 
 #include "exec/memory-internal.h"
+#include "exec/mmio-profile.h"
 #include "exec/ram_addr.h"
 #include "exec/log.h"
 
@@ -121,6 +122,8 @@ __thread CPUState *current_cpu;
    1 = Precise instruction counting.
    2 = Adaptive rate instruction counting.  */
 int use_icount;
+/* Count instructions per vCPU and sync them at quanta, see -icount.  */
+bool use_icount_quantum;
 
 uintptr_t qemu_host_page_size;
 intptr_t qemu_host_page_mask;
@@ -463,6 +466,58 @@ address_space_translate_internal(AddressSpaceDispatch *d, hwaddr addr, hwaddr *x
     return section;
 }
 
+/* Translations through IOMMUs with dma_cacheable set, one per master and
+ * starting FlatView.  Per thread, so that lookups need no locking.  Any
+ * topology change or IOMMU invalidation bumps the generation, which
+ * drops all entries.
+ */
+#define IOMMU_XLAT_CACHE_BITS 5
+#define IOMMU_XLAT_CACHE_SIZE (1 << IOMMU_XLAT_CACHE_BITS)
+
+typedef struct IOMMUXlatCacheEntry {
+    unsigned gen;
+    FlatView *fv;
+    uint16_t requester_id;
+    bool secure;
+    bool is_write;
+    /* iova & ~mask translates to translated_addr in target_as */
+    hwaddr iova;
+    hwaddr mask;
+    hwaddr translated_addr;
+    AddressSpace *target_as;
+} IOMMUXlatCacheEntry;
+
+static __thread IOMMUXlatCacheEntry iommu_xlat_cache[IOMMU_XLAT_CACHE_SIZE];
+static unsigned iommu_xlat_cache_gen = 1;
+
+void iommu_xlat_cache_flush(void)
+{
+    atomic_inc(&iommu_xlat_cache_gen);
+}
+
+static IOMMUXlatCacheEntry *iommu_xlat_cache_entry(FlatView *fv,
+                                                   bool is_write,
+                                                   const MemTxAttrs *attr)
+{
+    uintptr_t h = (uintptr_t)fv >> 4;
+
+    h ^= attr->requester_id * 0x9e37u;
+    h ^= (attr->secure << 1 | is_write) << (IOMMU_XLAT_CACHE_BITS - 2);
+    return &iommu_xlat_cache[h & (IOMMU_XLAT_CACHE_SIZE - 1)];
+}
+
+static bool iommu_xlat_cache_hit(IOMMUXlatCacheEntry *e, unsigned gen,
+                                 FlatView *fv, hwaddr addr, bool is_write,
+                                 const MemTxAttrs *attr)
+{
+    return e->gen == gen
+        && e->fv == fv
+        && e->requester_id == attr->requester_id
+        && e->secure == attr->secure
+        && e->is_write == is_write
+        && (addr & ~e->mask) == e->iova;
+}
+
 /**
  * flatview_do_translate - translate an address in FlatView
  *
@@ -495,13 +550,33 @@ static MemoryRegionSection flatview_do_translate(FlatView *fv,
     MemoryRegionSection *section;
     IOMMUMemoryRegion *iommu_mr;
     IOMMUMemoryRegionClass *imrc;
+    IOMMUXlatCacheEntry *ce = NULL;
+    FlatView *orig_fv = fv;
+    hwaddr orig_addr = addr;
+    hwaddr as_addr = addr;
     hwaddr page_mask = (hwaddr)(-1);
     hwaddr plen = (hwaddr)(-1);
+    unsigned gen = 0;
 
     if (plen_out) {
         plen = *plen_out;
     }
 
+    if (attr) {
+        gen = atomic_read(&iommu_xlat_cache_gen);
+        /* Pairs with the atomic_inc in iommu_xlat_cache_flush.  */
+        smp_rmb();
+        ce = iommu_xlat_cache_entry(fv, is_write, attr);
+        if (iommu_xlat_cache_hit(ce, gen, fv, addr, is_write, attr)) {
+            addr = ce->translated_addr | (addr & ce->mask);
+            page_mask = ce->mask;
+            plen = MIN(plen, (addr | ce->mask) - addr + 1);
+            fv = address_space_to_flatview(ce->target_as);
+            *target_as = ce->target_as;
+            ce = NULL;
+        }
+    }
+
     for (;;) {
         section = address_space_translate_internal(
                 flatview_to_dispatch(fv), addr, &addr,
@@ -512,6 +587,9 @@ static MemoryRegionSection flatview_do_translate(FlatView *fv,
             break;
         }
         imrc = memory_region_get_iommu_class_nocheck(iommu_mr);
+        if (!iommu_mr->dma_cacheable) {
+            ce = NULL;
+        }
 
         if (imrc->translate_attr) {
             iotlb = imrc->translate_attr(iommu_mr, addr, is_write, attr);
@@ -521,6 +599,7 @@ static MemoryRegionSection flatview_do_translate(FlatView *fv,
         }
         addr = ((iotlb.translated_addr & ~iotlb.addr_mask)
                 | (addr & iotlb.addr_mask));
+        as_addr = addr;
         page_mask &= iotlb.addr_mask;
         plen = MIN(plen, (addr | iotlb.addr_mask) - addr + 1);
         if (!(iotlb.perm & (1 << is_write))) {
@@ -533,6 +612,20 @@ static MemoryRegionSection flatview_do_translate(FlatView *fv,
 
     *xlat = addr;
 
+    if (ce && page_mask != (hwaddr)(-1)) {
+        *ce = (IOMMUXlatCacheEntry) {
+            .gen = gen,
+            .fv = orig_fv,
+            .requester_id = attr->requester_id,
+            .secure = attr->secure,
+            .is_write = is_write,
+            .iova = orig_addr & ~page_mask,
+            .mask = page_mask,
+            .translated_addr = as_addr & ~page_mask,
+            .target_as = *target_as,
+        };
+    }
+
     if (page_mask == (hwaddr)(-1)) {
         /* Not behind an IOMMU, use default page size. */
         page_mask = ~TARGET_PAGE_MASK;
@@ -646,6 +739,14 @@ address_space_translate_for_iotlb(CPUState *cpu, int asidx, hwaddr addr,
         }
         imrc = memory_region_get_iommu_class_nocheck(iommu_mr);
 
+        /* Flag before translating, so that a concurrent reprogramming either
+         * is seen by the translation or flushes the entry we install.
+         */
+        if (!atomic_read(&iommu_mr->cpu_tlb_cached)) {
+            atomic_set(&iommu_mr->cpu_tlb_cached, true);
+            smp_mb();
+        }
+
         /* FIXME: these are not necessarily accesses, so is_write doesn't make
            sense!  */
         if (imrc->translate_attr) {
@@ -680,6 +781,23 @@ address_space_translate_for_iotlb(CPUState *cpu, int asidx, hwaddr addr,
 
     return section;
 }
+
+void memory_region_iommu_invalidate_cpu_tlbs(IOMMUMemoryRegion *iommu_mr)
+{
+    CPUState *cpu;
+
+    iommu_xlat_cache_flush();
+
+    /* Pairs with the barrier in address_space_translate_for_iotlb.  */
+    smp_mb();
+    if (!atomic_xchg(&iommu_mr->cpu_tlb_cached, false)) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        tlb_flush(cpu);
+    }
+}
 #endif
 
 #if !defined(CONFIG_USER_ONLY)
@@ -815,6 +933,7 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     CPUClass *cc = CPU_GET_CLASS(cpu);
 
     cpu_list_remove(cpu);
+    tlb_destroy(cpu);
 
     if (cc->vmsd != NULL) {
         vmstate_unregister(NULL, cc->vmsd, cpu);
@@ -879,6 +998,7 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
         cc->tcg_initialize();
     }
+    tlb_init(cpu);
 
 #ifndef CONFIG_USER_ONLY
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
@@ -1097,11 +1217,10 @@ void cpu_single_step(CPUState *cpu, int enabled)
         cpu->singlestep_enabled = enabled;
         if (kvm_enabled()) {
             kvm_update_guest_debug(cpu, 0);
-        } else {
-            /* must flush all the translated code to avoid inconsistencies */
-            /* XXX: only flush what is necessary */
-            tb_flush(cpu);
         }
+        /* TCG looks up TBs with CF_SINGLESTEP while stepping, so the code
+         * translated for either mode stays valid.
+         */
     }
 }
 
@@ -3040,6 +3159,12 @@ static int memory_access_size(MemoryRegion *mr, unsigned l, hwaddr addr)
     return l;
 }
 
+/* Whether an MMIO access of l bytes at addr should go out as one burst.  */
+static bool memory_access_is_burst(MemoryRegion *mr, hwaddr l, hwaddr addr)
+{
+    return mr->ops->access_burst && l > memory_access_size(mr, l, addr);
+}
+
 static bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool unlocked = !qemu_mutex_iothread_locked();
@@ -3078,6 +3203,13 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
     for (;;) {
         if (!memory_access_is_direct(mr, true)) {
             release_lock |= prepare_mmio_access(mr);
+            if (memory_access_is_burst(mr, l, addr1)) {
+                struct iovec iov = { .iov_base = (void *) buf, .iov_len = l };
+
+                result |= memory_region_dispatch_burst(mr, addr1, &iov, 1,
+                                                       true, attrs);
+                goto next;
+            }
             l = memory_access_size(mr, l, addr1);
             /* XXX: could force current_cpu to NULL to avoid
                potential bugs */
@@ -3128,6 +3260,7 @@ static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
             invalidate_and_set_dirty(mr, addr1, l);
         }
 
+next:
         if (release_lock) {
             qemu_mutex_unlock_iothread();
             release_lock = false;
@@ -3190,6 +3323,13 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
         if (!memory_access_is_direct(mr, false)) {
             /* I/O case */
             release_lock |= prepare_mmio_access(mr);
+            if (memory_access_is_burst(mr, l, addr1)) {
+                struct iovec iov = { .iov_base = buf, .iov_len = l };
+
+                result |= memory_region_dispatch_burst(mr, addr1, &iov, 1,
+                                                       false, attrs);
+                goto next;
+            }
             l = memory_access_size(mr, l, addr1);
             switch (l) {
             case 8:
@@ -3237,6 +3377,7 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
             memcpy(buf, ptr, l);
         }
 
+next:
         if (release_lock) {
             qemu_mutex_unlock_iothread();
             release_lock = false;
@@ -3291,8 +3432,13 @@ MemTxResult address_space_rw(AddressSpace *as, hwaddr addr,
                              MemTxAttrs attrs, uint8_t *buf,
                              int len, bool is_write)
 {
-    return flatview_rw(address_space_to_flatview(as),
-                       addr, attrs, buf, len, is_write);
+    const char *caller = mmio_profile_caller_push(as->name);
+    MemTxResult r;
+
+    r = flatview_rw(address_space_to_flatview(as),
+                    addr, attrs, buf, len, is_write);
+    mmio_profile_caller_pop(caller);
+    return r;
 }
 
 void cpu_physical_memory_rw(hwaddr addr, uint8_t *buf,
@@ -3578,6 +3724,35 @@ void *address_space_map(AddressSpace *as,
     return ptr;
 }
 
+/* Like address_space_map but translates with the master's attributes and
+ * only maps memory that can be accessed directly, the bounce buffer is
+ * never used. Returns NULL for anything else, callers then fall back to
+ * address_space_rw. The mapping never crosses into another section.
+ */
+void *address_space_map_ram(AddressSpace *as, hwaddr addr, hwaddr *plen,
+                            bool is_write, MemTxAttrs attrs)
+{
+    hwaddr l = *plen, xlat;
+    MemoryRegion *mr;
+    void *ptr = NULL;
+
+    if (l == 0) {
+        return NULL;
+    }
+
+    rcu_read_lock();
+    mr = flatview_translate(address_space_to_flatview(as), addr, &xlat, &l,
+                            is_write, &attrs);
+    if (memory_access_is_direct(mr, is_write)) {
+        memory_region_ref(mr);
+        *plen = l;
+        ptr = qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+    }
+    rcu_read_unlock();
+
+    return ptr;
+}
+
 /* Unmaps a memory region previously mapped by address_space_map().
  * Will also mark the memory as dirty if is_write == 1.  access_len gives
  * the amount of memory that was actually read or written by the caller.
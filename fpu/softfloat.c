@@ -83,6 +83,8 @@ this code that are retained.
  * target-dependent and needs the TARGET_* macros.
  */
 #include "qemu/osdep.h"
+#include <math.h>
+#include <float.h>
 
 #include "fpu/softfloat.h"
 
@@ -105,6 +107,290 @@ this code that are retained.
 *----------------------------------------------------------------------------*/
 #include "softfloat-specialize.h"
 
+/*----------------------------------------------------------------------------
+| Host FPU fast path.
+|
+| For the common case -- round to nearest even, zero or normal operands and
+| a normal result -- the host FPU computes exactly the IEEE result softfloat
+| would, so the float32/float64 add, sub, mul, div, muladd and sqrt entry
+| points try it first.  The host exception flags are not read back (that is
+| much slower than the operation itself); instead the fast path is only used
+|  - when float_flag_inexact is already set in the guest status.  The flag is
+|    sticky, so whether this operation is inexact cannot be observed;
+|  - when no input is a denormal, infinity or NaN, so invalid, divbyzero and
+|    input_denormal cannot be raised and no NaN propagation rules apply;
+|  - when the result is neither infinite nor tiny, so overflow, underflow and
+|    flush_to_zero do not come into play.
+| Everything else falls back to the softfloat implementation below.
+*----------------------------------------------------------------------------*/
+#if defined(__FAST_MATH__) || \
+    (defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0)
+/* Excess precision (e.g. x87) would double round.  */
+# define QEMU_NO_HARDFLOAT 1
+#else
+# define QEMU_NO_HARDFLOAT 0
+#endif
+
+typedef union {
+    float32 s;
+    float h;
+} union_float32;
+
+typedef union {
+    float64 s;
+    double h;
+} union_float64;
+
+static inline bool can_use_fpu(const float_status *s)
+{
+    if (QEMU_NO_HARDFLOAT) {
+        return false;
+    }
+    return likely((s->float_exception_flags & float_flag_inexact) &&
+                  s->float_rounding_mode == float_round_nearest_even);
+}
+
+static inline bool float32_is_zero_or_normal(float32 a)
+{
+    uint32_t e = (float32_val(a) >> 23) & 0xff;
+
+    return (e != 0 && e != 0xff) || float32_is_zero(a);
+}
+
+static inline bool float64_is_zero_or_normal(float64 a)
+{
+    uint64_t e = (float64_val(a) >> 52) & 0x7ff;
+
+    return (e != 0 && e != 0x7ff) || float64_is_zero(a);
+}
+
+/* Accept a host result unless it overflowed or may have underflowed.
+   A tiny result is only trusted when it is the exact zero that zero_ok
+   says the operands produce.  */
+static inline bool float32_hard_result_ok(float h, bool zero_ok)
+{
+    if (unlikely(isinf(h))) {
+        return false;
+    }
+    return likely(fabsf(h) > FLT_MIN) || zero_ok;
+}
+
+static inline bool float64_hard_result_ok(double h, bool zero_ok)
+{
+    if (unlikely(isinf(h))) {
+        return false;
+    }
+    return likely(fabs(h) > DBL_MIN) || zero_ok;
+}
+
+static bool float32_hard_addsub(float32 a, float32 b, bool subtract,
+                                float32 *r, float_status *s)
+{
+    union_float32 ua, ub, ur;
+
+    if (!can_use_fpu(s) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    ur.h = subtract ? ua.h - ub.h : ua.h + ub.h;
+    if (!float32_hard_result_ok(ur.h,
+                                float32_is_zero(a) && float32_is_zero(b))) {
+        return false;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float32_hard_mul(float32 a, float32 b, float32 *r,
+                             float_status *s)
+{
+    union_float32 ua, ub, ur;
+
+    if (!can_use_fpu(s) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    ur.h = ua.h * ub.h;
+    if (!float32_hard_result_ok(ur.h,
+                                float32_is_zero(a) || float32_is_zero(b))) {
+        return false;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float32_hard_div(float32 a, float32 b, float32 *r,
+                             float_status *s)
+{
+    union_float32 ua, ub, ur;
+
+    if (!can_use_fpu(s) || !float32_is_zero_or_normal(a) ||
+        !float32_is_zero_or_normal(b) || float32_is_zero(b)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    ur.h = ua.h / ub.h;
+    if (!float32_hard_result_ok(ur.h, float32_is_zero(a))) {
+        return false;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float32_hard_muladd(float32 a, float32 b, float32 c, int flags,
+                                float32 *r, float_status *s)
+{
+    union_float32 ua, ub, uc, ur;
+
+    if (!can_use_fpu(s) || (flags & float_muladd_halve_result) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b) ||
+        !float32_is_zero_or_normal(c)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    uc.s = c;
+    if (flags & float_muladd_negate_product) {
+        ua.h = -ua.h;
+    }
+    if (flags & float_muladd_negate_c) {
+        uc.h = -uc.h;
+    }
+    ur.h = fmaf(ua.h, ub.h, uc.h);
+    if (!float32_hard_result_ok(ur.h, float32_is_zero(c) &&
+                                (float32_is_zero(a) || float32_is_zero(b)))) {
+        return false;
+    }
+    if (flags & float_muladd_negate_result) {
+        ur.h = -ur.h;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float32_hard_sqrt(float32 a, float32 *r, float_status *s)
+{
+    union_float32 ua, ur;
+
+    if (!can_use_fpu(s) || !float32_is_zero_or_normal(a) ||
+        (float32_is_neg(a) && !float32_is_zero(a))) {
+        return false;
+    }
+    ua.s = a;
+    ur.h = sqrtf(ua.h);
+    *r = ur.s;
+    return true;
+}
+
+static bool float64_hard_addsub(float64 a, float64 b, bool subtract,
+                                float64 *r, float_status *s)
+{
+    union_float64 ua, ub, ur;
+
+    if (!can_use_fpu(s) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    ur.h = subtract ? ua.h - ub.h : ua.h + ub.h;
+    if (!float64_hard_result_ok(ur.h,
+                                float64_is_zero(a) && float64_is_zero(b))) {
+        return false;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float64_hard_mul(float64 a, float64 b, float64 *r,
+                             float_status *s)
+{
+    union_float64 ua, ub, ur;
+
+    if (!can_use_fpu(s) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    ur.h = ua.h * ub.h;
+    if (!float64_hard_result_ok(ur.h,
+                                float64_is_zero(a) || float64_is_zero(b))) {
+        return false;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float64_hard_div(float64 a, float64 b, float64 *r,
+                             float_status *s)
+{
+    union_float64 ua, ub, ur;
+
+    if (!can_use_fpu(s) || !float64_is_zero_or_normal(a) ||
+        !float64_is_zero_or_normal(b) || float64_is_zero(b)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    ur.h = ua.h / ub.h;
+    if (!float64_hard_result_ok(ur.h, float64_is_zero(a))) {
+        return false;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float64_hard_muladd(float64 a, float64 b, float64 c, int flags,
+                                float64 *r, float_status *s)
+{
+    union_float64 ua, ub, uc, ur;
+
+    if (!can_use_fpu(s) || (flags & float_muladd_halve_result) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b) ||
+        !float64_is_zero_or_normal(c)) {
+        return false;
+    }
+    ua.s = a;
+    ub.s = b;
+    uc.s = c;
+    if (flags & float_muladd_negate_product) {
+        ua.h = -ua.h;
+    }
+    if (flags & float_muladd_negate_c) {
+        uc.h = -uc.h;
+    }
+    ur.h = fma(ua.h, ub.h, uc.h);
+    if (!float64_hard_result_ok(ur.h, float64_is_zero(c) &&
+                                (float64_is_zero(a) || float64_is_zero(b)))) {
+        return false;
+    }
+    if (flags & float_muladd_negate_result) {
+        ur.h = -ur.h;
+    }
+    *r = ur.s;
+    return true;
+}
+
+static bool float64_hard_sqrt(float64 a, float64 *r, float_status *s)
+{
+    union_float64 ua, ur;
+
+    if (!can_use_fpu(s) || !float64_is_zero_or_normal(a) ||
+        (float64_is_neg(a) && !float64_is_zero(a))) {
+        return false;
+    }
+    ua.s = a;
+    ur.h = sqrt(ua.h);
+    *r = ur.s;
+    return true;
+}
+
 /*----------------------------------------------------------------------------
 | Returns the fraction bits of the half-precision floating-point value `a'.
 *----------------------------------------------------------------------------*/
@@ -2186,6 +2472,12 @@ static float32 subFloat32Sigs(float32 a, float32 b, flag zSign,
 float32 float32_add(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign;
+    float32 r;
+
+    if (float32_hard_addsub(a, b, false, &r, status)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2209,6 +2501,12 @@ float32 float32_add(float32 a, float32 b, float_status *status)
 float32 float32_sub(float32 a, float32 b, float_status *status)
 {
     flag aSign, bSign;
+    float32 r;
+
+    if (float32_hard_addsub(a, b, true, &r, status)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2236,6 +2534,11 @@ float32 float32_mul(float32 a, float32 b, float_status *status)
     uint32_t aSig, bSig;
     uint64_t zSig64;
     uint32_t zSig;
+    float32 r;
+
+    if (float32_hard_mul(a, b, &r, status)) {
+        return r;
+    }
 
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
@@ -2299,6 +2602,12 @@ float32 float32_div(float32 a, float32 b, float_status *status)
     flag aSign, bSign, zSign;
     int aExp, bExp, zExp;
     uint32_t aSig, bSig, zSig;
+    float32 r;
+
+    if (float32_hard_div(a, b, &r, status)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
 
@@ -2482,6 +2791,11 @@ float32 float32_muladd(float32 a, float32 b, float32 c, int flags,
     uint32_t pSig;
     int shiftcount;
     flag signflip, infzero;
+    float32 r;
+
+    if (float32_hard_muladd(a, b, c, flags, &r, status)) {
+        return r;
+    }
 
     a = float32_squash_input_denormal(a, status);
     b = float32_squash_input_denormal(b, status);
@@ -2698,6 +3012,12 @@ float32 float32_sqrt(float32 a, float_status *status)
     int aExp, zExp;
     uint32_t aSig, zSig;
     uint64_t rem, term;
+    float32 r;
+
+    if (float32_hard_sqrt(a, &r, status)) {
+        return r;
+    }
+
     a = float32_squash_input_denormal(a, status);
 
     aSig = extractFloat32Frac( a );
@@ -3981,6 +4301,12 @@ static float64 subFloat64Sigs(float64 a, float64 b, flag zSign,
 float64 float64_add(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign;
+    float64 r;
+
+    if (float64_hard_addsub(a, b, false, &r, status)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -4004,6 +4330,12 @@ float64 float64_add(float64 a, float64 b, float_status *status)
 float64 float64_sub(float64 a, float64 b, float_status *status)
 {
     flag aSign, bSign;
+    float64 r;
+
+    if (float64_hard_addsub(a, b, true, &r, status)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -4029,6 +4361,11 @@ float64 float64_mul(float64 a, float64 b, float_status *status)
     flag aSign, bSign, zSign;
     int aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig0, zSig1;
+    float64 r;
+
+    if (float64_hard_mul(a, b, &r, status)) {
+        return r;
+    }
 
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
@@ -4094,6 +4431,12 @@ float64 float64_div(float64 a, float64 b, float_status *status)
     uint64_t aSig, bSig, zSig;
     uint64_t rem0, rem1;
     uint64_t term0, term1;
+    float64 r;
+
+    if (float64_hard_div(a, b, &r, status)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
 
@@ -4268,6 +4611,11 @@ float64 float64_muladd(float64 a, float64 b, float64 c, int flags,
     uint64_t pSig0, pSig1, cSig0, cSig1, zSig0, zSig1;
     int shiftcount;
     flag signflip, infzero;
+    float64 r;
+
+    if (float64_hard_muladd(a, b, c, flags, &r, status)) {
+        return r;
+    }
 
     a = float64_squash_input_denormal(a, status);
     b = float64_squash_input_denormal(b, status);
@@ -4506,6 +4854,12 @@ float64 float64_sqrt(float64 a, float_status *status)
     int aExp, zExp;
     uint64_t aSig, zSig, doubleZSig;
     uint64_t rem0, rem1, term0, term1;
+    float64 r;
+
+    if (float64_hard_sqrt(a, &r, status)) {
+        return r;
+    }
+
     a = float64_squash_input_denormal(a, status);
 
     aSig = extractFloat64Frac( a );
@@ -32,7 +32,7 @@
 #include "hw/remote-port.h"
 #endif
 
-#define MAX_PACKET_LENGTH 4096
+#define MAX_PACKET_LENGTH 16384
 
 #include "qemu/sockets.h"
 #include "sysemu/hw_accel.h"
@@ -335,6 +335,7 @@ typedef struct GDBState {
     int signal;
     bool client_connected;
     bool multiprocess;
+    bool binary_upload;
     char threadid_str[64];
     bool break_on_guest_error;
     bool breakpoints_per_core;
@@ -945,16 +946,66 @@ static const char *gdb_gen_thread_id(GDBState *s, uint32_t pid, uint32_t tid)
 
 static void gdb_match_supported(GDBState *s, const char *p)
 {
-    p = strchr(p, ':');
+    p = strpbrk(p, ":;");
     while (p) {
         p++;
-        if (strncmp(p, "multiprocess", 12) == 0) {
+        if (strncmp(p, "multiprocess+", 13) == 0) {
             s->multiprocess = true;
+        } else if (strncmp(p, "binary-upload+", 14) == 0) {
+            s->binary_upload = true;
         }
-        p = strchr(p, ':');
+        p = strpbrk(p, ":;");
     }
 }
 
+static int gdb_thread_extra_info(CPUState *cpu, char *buf, size_t size)
+{
+    int len;
+
+    if (!cpu->gdb_id) {
+        const char *name = object_get_canonical_path(OBJECT(cpu));
+
+        len = snprintf(buf, size, "CPU#%d %s", cpu->cpu_index, name);
+    } else {
+        len = snprintf(buf, size, "%s", cpu->gdb_id);
+    }
+    len += snprintf(buf + len, size - len, " [%s]",
+                    cpu->halted ? "halted " : "running");
+    return len;
+}
+
+/* The threads of all attached clusters, for qXfer:threads:read.  This
+ * replaces a qfThreadInfo/qsThreadInfo round trip per CPU and a
+ * qThreadExtraInfo one for each of them.
+ */
+static char *gdb_get_thread_list(GDBState *s)
+{
+    GString *xml = g_string_new("<?xml version=\"1.0\"?>\n<threads>\n");
+    char info[256];
+    CPUState *cpu;
+    int i;
+
+    for (i = 0; i < s->num_clusters; i++) {
+        if (!s->clusters[i].attached) {
+            continue;
+        }
+        for (cpu = s->clusters[i].cpus.first; cpu; cpu = CPU_NEXT(cpu)) {
+            gdb_thread_extra_info(cpu, info, sizeof(info));
+            g_string_append_printf(xml, "<thread id=\"%s\" core=\"%d\">",
+                                   gdb_gen_thread_id(s, i + 1,
+                                                     cpu->cpu_index + 1),
+                                   cpu->cpu_index);
+            g_string_append(xml, info);
+            g_string_append(xml, "</thread>\n");
+            if (cpu == s->clusters[i].cpus.last) {
+                break;
+            }
+        }
+    }
+    g_string_append(xml, "</threads>\n");
+    return g_string_free(xml, false);
+}
+
 static int is_query_packet(const char *p, const char *query, char separator)
 {
     unsigned int query_len = strlen(query);
@@ -963,7 +1014,7 @@ static int is_query_packet(const char *p, const char *query, char separator)
         (p[query_len] == '\0' || p[query_len] == separator);
 }
 
-static int gdb_handle_packet(GDBState *s, const char *line_buf)
+static int gdb_handle_packet(GDBState *s, const char *line_buf, int line_len)
 {
     GDBCluster *cl = &s->clusters[s->cur_cluster];
     CPUState *cpu;
@@ -1216,6 +1267,47 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             put_packet(s, "OK");
         }
         break;
+    case 'x':
+        addr = strtoull(p, (char **)&p, 16);
+        if (*p == ',')
+            p++;
+        len = strtoull(p, NULL, 16);
+
+        /* memtox() may double the data, a short read is fine */
+        len = MIN(len, (MAX_PACKET_LENGTH - 1) / 2);
+        if (target_memory_rw_debug(s->g_cpu, addr, mem_buf, len, false) != 0) {
+            put_packet(s, "E14");
+        } else {
+            /* Clients that negotiated binary-upload expect a 'b' marker */
+            res = 0;
+            if (s->binary_upload) {
+                buf[res++] = 'b';
+            }
+            res += memtox(buf + res, (char *)mem_buf, len);
+            put_packet_binary(s, buf, res);
+        }
+        break;
+    case 'X':
+        addr = strtoull(p, (char **)&p, 16);
+        if (*p == ',')
+            p++;
+        len = strtoull(p, (char **)&p, 16);
+        if (*p == ':')
+            p++;
+
+        /* The data is binary, it was unescaped when the packet came in */
+        if (len > line_len - (p - line_buf)) {
+            put_packet(s, "E22");
+            break;
+        }
+        memcpy(mem_buf, p, len);
+        if (len && target_memory_rw_debug(s->g_cpu, addr, mem_buf, len,
+                                          true) != 0) {
+            put_packet(s, "E14");
+        } else {
+            put_packet(s, "OK");
+        }
+        break;
     case 'p':
         /* Older gdb are really dumb, and don't use 'g' if 'p' is avaialable.
            This works, but can be very slow.  Anything new enough to
@@ -1405,17 +1497,8 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             cpu = find_cpu(s, cluster, thread);
             if (cpu != NULL) {
                 cpu_synchronize_state(cpu);
-                if (!cpu->gdb_id) {
-                    const char *name = object_get_canonical_path(OBJECT(cpu));
-
-                    len = snprintf((char *)mem_buf, sizeof(mem_buf),
-                                   "CPU#%d %s", cpu->cpu_index, name);
-                } else {
-                    len = snprintf((char *)mem_buf, sizeof(mem_buf),
-                                   "%s", cpu->gdb_id);
-                }
-                len += snprintf((char *)mem_buf + len, sizeof(mem_buf) - len,
-                               " [%s]", cpu->halted ? "halted " : "running");
+                len = gdb_thread_extra_info(cpu, (char *)mem_buf,
+                                            sizeof(mem_buf));
                 memtohex(buf, mem_buf, len);
                 put_packet(s, buf);
             } else {
@@ -1473,7 +1556,9 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
                 pstrcat(buf, sizeof(buf), ";qXfer:features:read+");
             }
             pstrcat(buf, sizeof(buf), ";qXfer:osdata:read+");
+            pstrcat(buf, sizeof(buf), ";qXfer:threads:read+");
             pstrcat(buf, sizeof(buf), ";multiprocess+");
+            pstrcat(buf, sizeof(buf), ";binary-upload+");
             put_packet(s, buf);
             break;
         }
@@ -1555,6 +1640,38 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             g_free((void *) plist);
             break;
         }
+        if (strncmp(p, "Xfer:threads:read::", 19) == 0) {
+            char *tlist;
+            target_ulong total_len;
+
+            tlist = gdb_get_thread_list(s);
+
+            p += 19;
+            addr = strtoul(p, (char **)&p, 16);
+            if (*p == ',')
+                p++;
+            len = strtoul(p, (char **)&p, 16);
+
+            total_len = strlen(tlist);
+            if (addr > total_len) {
+                put_packet(s, "E00");
+                g_free(tlist);
+                break;
+            }
+
+            if (len > (MAX_PACKET_LENGTH - 5) / 2)
+                len = (MAX_PACKET_LENGTH - 5) / 2;
+            if (len < total_len - addr) {
+                buf[0] = 'm';
+                len = memtox(buf + 1, tlist + addr, len);
+            } else {
+                buf[0] = 'l';
+                len = memtox(buf + 1, tlist + addr, total_len - addr);
+            }
+            put_packet_binary(s, buf, len + 1);
+            g_free(tlist);
+            break;
+        }
         /* Unrecognised 'q' command.  */
         goto unknown_command;
 
@@ -1587,11 +1704,35 @@ static void gdb_output(GDBState *s, const char *msg, int len)
     put_packet(s, buf);
 }
 
+/* Append the 'g' registers of @cpu as "n:value;" pairs to the stop reply
+ * in @buf, so that the client needs no register read to show where the
+ * CPU stopped.  Registers that don't fit are left for it to fetch.
+ */
+static void gdb_expedite_registers(CPUState *cpu, char *buf, size_t size)
+{
+    size_t pos = strlen(buf);
+    uint8_t mem_buf[MAX_PACKET_LENGTH / 2];
+    int reg, len;
+
+    cpu_synchronize_state(cpu);
+    for (reg = 0; reg < cpu->gdb_num_g_regs; reg++) {
+        len = gdb_read_register(cpu, mem_buf, reg);
+        if (!len || pos + 2 * len + 16 > size) {
+            break;
+        }
+        pos += snprintf(buf + pos, size - pos, "%x:", reg);
+        memtohex(buf + pos, mem_buf, len);
+        pos += 2 * len;
+        buf[pos++] = ';';
+        buf[pos] = '\0';
+    }
+}
+
 static void gdb_vm_state_change(void *opaque, int running, RunState state)
 {
     GDBState *s = gdbserver_state;
     CPUState *cpu = s->c_cpu;
-    char buf[256];
+    char buf[MAX_PACKET_LENGTH];
     const char *type;
     int ret;
 
@@ -1627,7 +1768,10 @@ static void gdb_vm_state_change(void *opaque, int running, RunState state)
             cpu->watchpoint_hit = NULL;
             goto send_packet;
         }
-        tb_flush(cpu);
+        /* Step stops are frequent and need no flush, see CF_SINGLESTEP */
+        if (!cpu->singlestep_enabled) {
+            tb_flush(cpu);
+        }
         ret = GDB_SIGNAL_TRAP;
         break;
     case RUN_STATE_PAUSED:
@@ -1660,6 +1804,7 @@ static void gdb_vm_state_change(void *opaque, int running, RunState state)
              gdb_gen_thread_id(s, s->cur_cluster + 1, (cpu->cpu_index + 1)));
 
 send_packet:
+    gdb_expedite_registers(cpu, buf, sizeof(buf));
     put_packet(s, buf);
 
     /* disable single step if it was enabled */
@@ -1879,7 +2024,8 @@ static void gdb_read_byte(GDBState *s, int ch)
                 /* send ACK reply */
                 reply = '+';
                 put_buffer(s, &reply, 1);
-                s->state = gdb_handle_packet(s, s->line_buf);
+                s->state = gdb_handle_packet(s, s->line_buf,
+                                             s->line_buf_index);
 #ifdef CONFIG_REMOTE_PORT
                 bool tw_en = rp_time_warp_enable(false);
                 rp_time_warp_enable(tw_en);
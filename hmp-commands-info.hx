@@ -279,6 +279,26 @@ STEXI
 Show dynamic compiler info.
 ETEXI
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-stats",
+        .args_type  = "disas:-d,count:i?,sort:s?",
+        .params     = "[-d] [count] [executions|host-cost|translate-ns]",
+        .help       = "show the most executed or expensive translation blocks"
+                      " (-d: disassemble them)",
+        .cmd        = hmp_info_tb_stats,
+    },
+#endif
+
+STEXI
+@item info tb-stats [-d] [@var{count}] [executions|host-cost|translate-ns]
+@findex info tb-stats
+Show the statistics collected since the QMP command @code{tb-stats-start} for
+the @var{count} translation blocks, 10 by default, entered most often, with
+the most host code run or that took the longest to translate. With @option{-d},
+disassemble the guest code of each of them.
+ETEXI
+
 #if defined(CONFIG_TCG)
     {
         .name       = "opcount",
@@ -705,6 +725,65 @@ STEXI
 @item info iothreads
 @findex info iothreads
 Show iothread's identifiers.
+ETEXI
+
+    {
+        .name       = "remote-port",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show remote-port statistics",
+        .cmd        = hmp_info_remote_port,
+    },
+
+STEXI
+@item info remote-port
+@findex info remote-port
+Show remote-port packet, latency and sync statistics.
+ETEXI
+
+    {
+        .name       = "mmio-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the MMIO access profile",
+        .cmd        = hmp_info_mmio_profile,
+    },
+
+STEXI
+@item info mmio-profile
+@findex info mmio-profile
+Show the device accesses counted since the QMP command
+@code{mmio-profile-start}, per memory region and caller.
+ETEXI
+
+    {
+        .name       = "irq-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the IRQ line statistics",
+        .cmd        = hmp_info_irq_stats,
+    },
+
+STEXI
+@item info irq-stats
+@findex info irq-stats
+Show the IRQ line updates counted since the QMP command
+@code{irq-stats-start}, busiest lines first.
+ETEXI
+
+    {
+        .name       = "boot-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show when the boot milestones were hit",
+        .cmd        = hmp_info_boot_profile,
+    },
+
+STEXI
+@item info boot-profile
+@findex info boot-profile
+Show the boot milestones hit since the last system reset, with the
+virtual and host time it took to get there.
 ETEXI
 
     {
@@ -2013,7 +2013,8 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
     prot = g_strconcat("file:", file, NULL);
 
     qmp_dump_guest_memory(paging, prot, true, detach, has_begin, begin,
-                          has_length, length, true, dump_format, &err);
+                          has_length, length, true, dump_format, false, 0,
+                          &err);
     hmp_handle_error(mon, &err);
     g_free(prot);
 }
@@ -2471,11 +2472,160 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-max-ns=%" PRId64 "\n", value->poll_max_ns);
         monitor_printf(mon, "  poll-grow=%" PRId64 "\n", value->poll_grow);
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
+        monitor_printf(mon, "  poll-ns=%" PRId64 " poll-blockers=%" PRId64
+                       "\n", value->poll_ns, value->poll_blockers);
+        monitor_printf(mon, "  poll-attempts=%" PRIu64 " poll-successes=%"
+                       PRIu64 "\n", value->poll_attempts,
+                       value->poll_successes);
     }
 
     qapi_free_IOThreadInfoList(info_list);
 }
 
+void hmp_info_remote_port(Monitor *mon, const QDict *qdict)
+{
+    RemotePortInfoList *info_list = qmp_query_remote_port(NULL);
+    RemotePortInfoList *info;
+
+    for (info = info_list; info; info = info->next) {
+        RemotePortInfo *value = info->value;
+        RemotePortCmdStatsList *cmd;
+        RemotePortDevInfoList *dev;
+
+        monitor_printf(mon, "%s:\n", value->path);
+        monitor_printf(mon, "  rx-bytes=%" PRIu64 " tx-bytes=%" PRIu64 "\n",
+                       value->rx_bytes, value->tx_bytes);
+        monitor_printf(mon, "  rx-packets:");
+        for (cmd = value->rx_packets; cmd; cmd = cmd->next) {
+            monitor_printf(mon, " %s=%" PRIu64, cmd->value->cmd,
+                           cmd->value->count);
+        }
+        monitor_printf(mon, "\n");
+        monitor_printf(mon, "  sync: count=%" PRIu64 " stall=%" PRIu64
+                       " ns quantum=%" PRIu64 " ns\n",
+                       value->sync_count, value->sync_stall_ns,
+                       value->sync_quantum);
+        monitor_printf(mon, "  warp: count=%" PRIu64 " total=%" PRId64
+                       " ns\n", value->warp_count, value->warp_ns);
+
+        for (dev = value->devices; dev; dev = dev->next) {
+            RemotePortDevInfo *d = dev->value;
+            uint64List *bucket;
+            int i;
+
+            monitor_printf(mon, "  dev %u %s:\n", d->dev, d->path);
+            monitor_printf(mon, "    rx-packets=%" PRIu64 " rx-bytes=%" PRIu64
+                           "\n", d->rx_packets, d->rx_bytes);
+            if (!d->transactions) {
+                continue;
+            }
+            monitor_printf(mon, "    transactions=%" PRIu64 " avg=%" PRIu64
+                           " ns max=%" PRIu64 " ns\n", d->transactions,
+                           d->latency_total_ns / d->transactions,
+                           d->latency_max_ns);
+            monitor_printf(mon, "    latency-us:");
+            for (bucket = d->latency_histogram, i = 0; bucket;
+                 bucket = bucket->next, i++) {
+                if (bucket->value) {
+                    monitor_printf(mon, " %s%u=%" PRIu64,
+                                   bucket->next ? "<" : ">=",
+                                   bucket->next ? 2u << i : 1u << i,
+                                   bucket->value);
+                }
+            }
+            monitor_printf(mon, "\n");
+        }
+    }
+
+    qapi_free_RemotePortInfoList(info_list);
+}
+
+void hmp_info_mmio_profile(Monitor *mon, const QDict *qdict)
+{
+    MmioProfileInfo *info = qmp_query_mmio_profile(NULL);
+    MmioProfileEntryList *entry;
+
+    monitor_printf(mon, "MMIO profile %s\n",
+                   info->enabled ? "enabled" : "disabled");
+    for (entry = info->entries; entry; entry = entry->next) {
+        MmioProfileEntry *e = entry->value;
+        uint64_t count = e->reads + e->writes;
+        MmioProfileSizeList *size;
+
+        monitor_printf(mon, "%s%s%s from %s:\n", e->region,
+                       e->has_owner ? " @ " : "",
+                       e->has_owner ? e->owner : "", e->caller);
+        monitor_printf(mon, "  reads=%" PRIu64 " (%" PRIu64 " bytes)"
+                       " writes=%" PRIu64 " (%" PRIu64 " bytes)\n",
+                       e->reads, e->read_bytes, e->writes, e->write_bytes);
+        monitor_printf(mon, "  host=%" PRIu64 " ns avg=%" PRIu64
+                       " ns max=%" PRIu64 " ns\n", e->host_ns,
+                       count ? e->host_ns / count : 0, e->max_host_ns);
+        monitor_printf(mon, "  sizes:");
+        for (size = e->sizes; size; size = size->next) {
+            monitor_printf(mon, " %" PRIu64 "=%" PRIu64, size->value->size,
+                           size->value->count);
+        }
+        monitor_printf(mon, "\n");
+    }
+
+    qapi_free_MmioProfileInfo(info);
+}
+
+void hmp_info_irq_stats(Monitor *mon, const QDict *qdict)
+{
+    IrqStatsInfo *info = qmp_query_irq_stats(NULL);
+    IrqStatsEntryList *entry;
+
+    monitor_printf(mon, "IRQ statistics %s", info->enabled ? "enabled" :
+                                                              "disabled");
+    if (info->rate_limit) {
+        monitor_printf(mon, ", limit %" PRIu64 " toggles/s", info->rate_limit);
+    }
+    monitor_printf(mon, "\n");
+    for (entry = info->entries; entry; entry = entry->next) {
+        IrqStatsEntry *e = entry->value;
+        IrqStatsCallerList *caller;
+
+        monitor_printf(mon, "%s:\n", e->has_path ? e->path : "(anonymous)");
+        monitor_printf(mon, "  updates=%" PRIu64 " toggles=%" PRIu64
+                       " suppressed=%" PRIu64 " rate=%" PRIu64 "/s max=%"
+                       PRIu64 "/s\n", e->updates, e->toggles, e->suppressed,
+                       e->rate, e->max_rate);
+        monitor_printf(mon, "  callers:");
+        for (caller = e->callers; caller; caller = caller->next) {
+            monitor_printf(mon, " 0x%" PRIx64 "=%" PRIu64, caller->value->pc,
+                           caller->value->count);
+        }
+        monitor_printf(mon, "\n");
+    }
+
+    qapi_free_IrqStatsInfo(info);
+}
+
+void hmp_info_boot_profile(Monitor *mon, const QDict *qdict)
+{
+    BootProfileInfo *info = qmp_query_boot_profile(NULL);
+    BootProfileEntryList *entry;
+
+    for (entry = info->entries; entry; entry = entry->next) {
+        BootProfileEntry *e = entry->value;
+
+        monitor_printf(mon, "%-15s %-12s vm=%" PRIu64 ".%06" PRIu64 "s"
+                       " host=%" PRIu64 ".%06" PRIu64 "s count=%" PRIu64 "\n",
+                       BootPhase_str(e->phase), e->has_detail ? e->detail : "",
+                       e->vm_ns / NANOSECONDS_PER_SECOND,
+                       e->vm_ns % NANOSECONDS_PER_SECOND / 1000,
+                       e->host_ns / NANOSECONDS_PER_SECOND,
+                       e->host_ns % NANOSECONDS_PER_SECOND / 1000, e->count);
+    }
+    if (info->dropped) {
+        monitor_printf(mon, "%" PRIu64 " milestones dropped\n", info->dropped);
+    }
+
+    qapi_free_BootProfileInfo(info);
+}
+
 void hmp_qom_list(Monitor *mon, const QDict *qdict)
 {
     const char *path = qdict_get_try_str(qdict, "path");
@@ -2839,6 +2989,10 @@ void hmp_info_dump(Monitor *mon, const QDict *qdict)
         percent = 100.0 * result->completed / result->total;
         monitor_printf(mon, "Finished: %.2f %%\n", percent);
     }
+    if (result->status != DUMP_STATUS_NONE) {
+        monitor_printf(mon, "Throughput: %.2f MB/s\n",
+                       (double)result->throughput / (1024 * 1024));
+    }
 
     qapi_free_DumpQueryResult(result);
 }
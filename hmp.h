@@ -42,6 +42,10 @@ void hmp_info_pci(Monitor *mon, const QDict *qdict);
 void hmp_info_block_jobs(Monitor *mon, const QDict *qdict);
 void hmp_info_tpm(Monitor *mon, const QDict *qdict);
 void hmp_info_iothreads(Monitor *mon, const QDict *qdict);
+void hmp_info_remote_port(Monitor *mon, const QDict *qdict);
+void hmp_info_mmio_profile(Monitor *mon, const QDict *qdict);
+void hmp_info_irq_stats(Monitor *mon, const QDict *qdict);
+void hmp_info_boot_profile(Monitor *mon, const QDict *qdict);
 void hmp_quit(Monitor *mon, const QDict *qdict);
 void hmp_stop(Monitor *mon, const QDict *qdict);
 void hmp_system_reset(Monitor *mon, const QDict *qdict);
@@ -1869,49 +1869,27 @@ out_nofid:
     pdu_complete(pdu, err);
 }
 
-static size_t v9fs_readdir_data_size(V9fsString *name)
-{
-    /*
-     * Size of each dirent on the wire: size of qid (13) + size of offset (8)
-     * size of type (1) + size of name.size (2) + strlen(name.data)
-     */
-    return 24 + v9fs_string_size(name);
-}
-
 static int coroutine_fn v9fs_do_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
                                         int32_t max_count)
 {
     size_t size;
     V9fsQID qid;
     V9fsString name;
-    int len, err = 0;
+    int len, err;
     int32_t count = 0;
-    off_t saved_dir_pos;
     struct dirent *dent;
+    V9fsDirEnt *entries, *e;
 
-    /* save the directory position */
-    saved_dir_pos = v9fs_co_telldir(pdu, fidp);
-    if (saved_dir_pos < 0) {
-        return saved_dir_pos;
+    /* One trip to the worker thread for the whole response */
+    err = v9fs_co_readdir_many(pdu, fidp, &entries, max_count);
+    if (err < 0) {
+        goto out;
     }
 
-    while (1) {
-        v9fs_readdir_lock(&fidp->fs.dir);
-
-        err = v9fs_co_readdir(pdu, fidp, &dent);
-        if (err || !dent) {
-            break;
-        }
+    for (e = entries; e; e = e->next) {
+        dent = e->dent;
         v9fs_string_init(&name);
         v9fs_string_sprintf(&name, "%s", dent->d_name);
-        if ((count + v9fs_readdir_data_size(&name)) > max_count) {
-            v9fs_readdir_unlock(&fidp->fs.dir);
-
-            /* Ran out of buffer. Set dir back to old position and return */
-            v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
-            v9fs_string_free(&name);
-            return count;
-        }
         /*
          * Fill up just the path field of qid because the client uses
          * only that. To fill the entire qid structure we will have
@@ -1927,25 +1905,17 @@ static int coroutine_fn v9fs_do_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
         len = pdu_marshal(pdu, 11 + count, "Qqbs",
                           &qid, dent->d_off,
                           dent->d_type, &name);
-
-        v9fs_readdir_unlock(&fidp->fs.dir);
-
+        v9fs_string_free(&name);
         if (len < 0) {
-            v9fs_co_seekdir(pdu, fidp, saved_dir_pos);
-            v9fs_string_free(&name);
-            return len;
+            err = len;
+            goto out;
         }
         count += len;
-        v9fs_string_free(&name);
-        saved_dir_pos = dent->d_off;
     }
 
-    v9fs_readdir_unlock(&fidp->fs.dir);
-
-    if (err < 0) {
-        return err;
-    }
-    return count;
+out:
+    v9fs_free_dirents(entries);
+    return err < 0 ? err : count;
 }
 
 static void coroutine_fn v9fs_readdir(void *opaque)
@@ -198,6 +198,21 @@ static inline void v9fs_readdir_init(V9fsDir *dir)
     qemu_mutex_init(&dir->readdir_mutex);
 }
 
+/* Directory entries copied out of the stream by v9fs_co_readdir_many() */
+typedef struct V9fsDirEnt {
+    struct dirent *dent;
+    struct V9fsDirEnt *next;
+} V9fsDirEnt;
+
+static inline size_t v9fs_readdir_response_size(const char *name)
+{
+    /*
+     * Size of each dirent on the wire: size of qid (13) + size of offset (8)
+     * size of type (1) + size of name.size (2) + strlen(name.data)
+     */
+    return 24 + strlen(name);
+}
+
 /*
  * Filled by fs driver on open and other
  * calls.
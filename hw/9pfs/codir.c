@@ -42,6 +42,90 @@ int coroutine_fn v9fs_co_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
     return err;
 }
 
+/*
+ * Copy out as many entries as fit in @maxsize bytes of a Rreaddir response,
+ * from the current position of the stream on.  The stream is left right
+ * after the last entry returned.
+ */
+static int do_readdir_many(V9fsPDU *pdu, V9fsFidState *fidp,
+                           V9fsDirEnt **entries, int32_t maxsize)
+{
+    V9fsState *s = pdu->s;
+    V9fsDirEnt *e, **tail = entries;
+    struct dirent *dent;
+    off_t saved_dir_pos;
+    int32_t size = 0;
+    int err = 0;
+
+    *entries = NULL;
+    v9fs_readdir_lock(&fidp->fs.dir);
+
+    saved_dir_pos = s->ops->telldir(&s->ctx, &fidp->fs);
+    if (saved_dir_pos < 0) {
+        err = -errno;
+        goto out;
+    }
+
+    while (true) {
+        errno = 0;
+        dent = s->ops->readdir(&s->ctx, &fidp->fs);
+        if (!dent) {
+            err = errno ? -errno : 0;
+            break;
+        }
+
+        size += v9fs_readdir_response_size(dent->d_name);
+        if (size > maxsize) {
+            /* Ran out of buffer, leave this one for the next request */
+            s->ops->seekdir(&s->ctx, &fidp->fs, saved_dir_pos);
+            break;
+        }
+
+        /* The stream reuses its buffer on the next readdir */
+        e = g_new0(V9fsDirEnt, 1);
+        e->dent = g_memdup(dent, sizeof(*dent));
+        *tail = e;
+        tail = &e->next;
+        saved_dir_pos = dent->d_off;
+    }
+
+out:
+    v9fs_readdir_unlock(&fidp->fs.dir);
+    return err;
+}
+
+/*
+ * Like v9fs_co_readdir(), but fetches a whole response worth of entries in
+ * a single trip to the worker thread.  The entries must be freed with
+ * v9fs_free_dirents(), even on failure.
+ */
+int coroutine_fn v9fs_co_readdir_many(V9fsPDU *pdu, V9fsFidState *fidp,
+                                      V9fsDirEnt **entries, int32_t maxsize)
+{
+    int err;
+
+    *entries = NULL;
+    if (v9fs_request_cancelled(pdu)) {
+        return -EINTR;
+    }
+    v9fs_co_run_in_worker(
+        {
+            err = do_readdir_many(pdu, fidp, entries, maxsize);
+        });
+    return err;
+}
+
+void v9fs_free_dirents(V9fsDirEnt *e)
+{
+    V9fsDirEnt *next;
+
+    for (; e; e = next) {
+        next = e->next;
+        g_free(e->dent);
+        g_free(e);
+    }
+}
+
 off_t v9fs_co_telldir(V9fsPDU *pdu, V9fsFidState *fidp)
 {
     off_t err;
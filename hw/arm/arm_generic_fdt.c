@@ -23,6 +23,8 @@
 #include "qemu/log.h"
 #include "qemu/config-file.h"
 #include "sysemu/qtest.h"
+#include "sysemu/numa.h"
+#include "sysemu/hostmem.h"
 #include "hw/arm/xlnx-zynqmp.h"
 
 #include <libfdt.h>
@@ -106,9 +108,7 @@ static int zynq7000_mdio_phy_connect(char *node_path, FDTMachineInfo *fdti,
     }
 
     /* Wait for the parent to be created */
-    while (!fdt_init_has_opaque(fdti, parent_node_path)) {
-        fdt_init_yield(fdti);
-    }
+    fdt_init_wait_opaque(fdti, parent_node_path);
 
     /* Get the parent obj (i.e gem object), which was registerd in fdti */
     parent = fdt_init_get_opaque(fdti, parent_node_path);
@@ -155,9 +155,7 @@ static int zynq7000_mdio_phy_create(char *node_path, FDTMachineInfo *fdti,
     }
 
     /* Wait for the parent to be created */
-    while (!fdt_init_has_opaque(fdti, parent_node_path)) {
-        fdt_init_yield(fdti);
-    }
+    fdt_init_wait_opaque(fdti, parent_node_path);
 
     dev = DEVICE(object_new("88e1116r"));
     qdev_set_parent_bus(dev, qdev_get_child_bus(Opaque, "mdio-bus"));
@@ -237,6 +235,97 @@ static char *zynq7000_qspi_flash_node_clone(void *fdt)
     return qspi_clone_name;
 }
 
+/*
+ * A memory region node with a numa-node-id is backed by the memdev of that
+ * -numa node, unless it names a qemu,memdev itself.
+ */
+static void init_numa_memdevs(void *fdt)
+{
+    char node_path[DT_PATH_LENGTH];
+    int offset = 0;
+
+    if (!nb_numa_nodes) {
+        return;
+    }
+
+    for (;;) {
+        const uint32_t *prop;
+        HostMemoryBackend *backend;
+        uint32_t node_id;
+        char *id;
+        int len;
+
+        offset = fdt_node_offset_by_compatible(fdt, offset,
+                                               "qemu:memory-region");
+        if (offset < 0) {
+            break;
+        }
+        prop = fdt_getprop(fdt, offset, "numa-node-id", &len);
+        if (!prop || len != sizeof(*prop) ||
+            fdt_getprop(fdt, offset, "qemu,memdev", NULL)) {
+            continue;
+        }
+        node_id = be32_to_cpu(*prop);
+        if (node_id >= MAX_NODES || !numa_info[node_id].node_memdev) {
+            continue;
+        }
+
+        backend = numa_info[node_id].node_memdev;
+        id = object_get_canonical_path_component(OBJECT(backend));
+        fdt_get_path(fdt, offset, node_path, DT_PATH_LENGTH);
+        DB_PRINT(0, "%s is backed by %s\n", node_path, id);
+        qemu_fdt_setprop_string(fdt, node_path, "qemu,memdev", id);
+        g_free(id);
+    }
+}
+
+/*
+ * Pin the vCPUs of a NUMA node that have no qemu,host-cpus to the host CPUs
+ * local to the memory of that node.
+ */
+static void init_numa_cpus(MachineState *machine)
+{
+    MachineClass *mc = MACHINE_GET_CLASS(machine);
+    const CPUArchIdList *possible_cpus;
+    unsigned long *host_cpus;
+    CPUState *cs;
+
+    if (!nb_numa_nodes || !mc->possible_cpu_arch_ids) {
+        return;
+    }
+
+    possible_cpus = mc->possible_cpu_arch_ids(machine);
+    host_cpus = bitmap_new(CPU_HOST_CPUS_MAX);
+    CPU_FOREACH(cs) {
+        int64_t node_id = CPU_UNSET_NUMA_NODE_ID;
+        Error *err = NULL;
+
+        if (object_property_find(OBJECT(cs), "node-id", NULL)) {
+            node_id = object_property_get_int(OBJECT(cs), "node-id",
+                                              &error_abort);
+        }
+        if (node_id == CPU_UNSET_NUMA_NODE_ID &&
+            cs->cpu_index < possible_cpus->len &&
+            possible_cpus->cpus[cs->cpu_index].props.has_node_id) {
+            node_id = possible_cpus->cpus[cs->cpu_index].props.node_id;
+        }
+        if (cs->host_cpus || node_id < 0 || node_id >= MAX_NODES ||
+            !numa_info[node_id].node_memdev) {
+            continue;
+        }
+
+        bitmap_zero(host_cpus, CPU_HOST_CPUS_MAX);
+        if (host_memory_backend_get_host_cpus(numa_info[node_id].node_memdev,
+                                              host_cpus, CPU_HOST_CPUS_MAX,
+                                              &err)) {
+            qemu_cpu_set_host_cpus(cs, host_cpus);
+        } else if (err) {
+            warn_report_err(err);
+        }
+    }
+    g_free(host_cpus);
+}
+
 static memory_info init_memory(void *fdt, ram_addr_t ram_size, bool zynq_7000)
 {
     FDTMachineInfo *fdti;
@@ -258,6 +347,8 @@ static memory_info init_memory(void *fdt, ram_addr_t ram_size, bool zynq_7000)
         qemu_fdt_setprop_cells(fdt, "/memory", "qemu,ram", 1);
     }
 
+    init_numa_memdevs(fdt);
+
     /* Instantiate peripherals from the FDT.  */
     fdti = fdt_generic_create_machine(fdt, NULL);
 
@@ -525,6 +616,7 @@ static void arm_generic_fdt_init(MachineState *machine)
     }
 
     kernel_info = init_memory(fdt, machine->ram_size, zynq_7000);
+    init_numa_cpus(machine);
 
     arm_generic_fdt_binfo.fdt = sw_fdt;
     arm_generic_fdt_binfo.fdt_size = sw_fdt_size;
@@ -607,6 +699,44 @@ static void arm_generic_fdt_7000_init(MachineState *machine)
     sysbus_mmio_map(busdev, 0, ZYNQ7000_MPCORE_PERIPHBASE);
 }
 
+static CpuInstanceProperties
+arm_generic_fdt_cpu_index_to_props(MachineState *ms, unsigned cpu_index)
+{
+    MachineClass *mc = MACHINE_GET_CLASS(ms);
+    const CPUArchIdList *possible_cpus = mc->possible_cpu_arch_ids(ms);
+
+    assert(cpu_index < possible_cpus->len);
+    return possible_cpus->cpus[cpu_index].props;
+}
+
+static int64_t arm_generic_fdt_get_default_cpu_node_id(const MachineState *ms,
+                                                       int idx)
+{
+    return idx % nb_numa_nodes;
+}
+
+/* The CPUs come from the DTB, -numa node,cpus= refers to them by index */
+static const CPUArchIdList *arm_generic_fdt_possible_cpu_arch_ids(
+                                                            MachineState *ms)
+{
+    int n;
+
+    if (ms->possible_cpus) {
+        assert(ms->possible_cpus->len == max_cpus);
+        return ms->possible_cpus;
+    }
+
+    ms->possible_cpus = g_malloc0(sizeof(CPUArchIdList) +
+                                  sizeof(CPUArchId) * max_cpus);
+    ms->possible_cpus->len = max_cpus;
+    for (n = 0; n < ms->possible_cpus->len; n++) {
+        ms->possible_cpus->cpus[n].arch_id = n;
+        ms->possible_cpus->cpus[n].props.has_thread_id = true;
+        ms->possible_cpus->cpus[n].props.thread_id = n;
+    }
+    return ms->possible_cpus;
+}
+
 static void arm_generic_fdt_machine_init(MachineClass *mc)
 {
     mc->desc = "ARM device tree driven machine model";
@@ -615,6 +745,9 @@ static void arm_generic_fdt_machine_init(MachineClass *mc)
     /* 4 A53s and 2 R5s */
     mc->max_cpus = 6;
     mc->default_cpus = 6;
+    mc->possible_cpu_arch_ids = arm_generic_fdt_possible_cpu_arch_ids;
+    mc->cpu_index_to_instance_props = arm_generic_fdt_cpu_index_to_props;
+    mc->get_default_cpu_node_id = arm_generic_fdt_get_default_cpu_node_id;
 }
 
 static void arm_generic_fdt_7000_machine_init(MachineClass *mc)
@@ -32,6 +32,7 @@
 #include "hw/register-dep.h"
 #include "hw/sysbus.h"
 #include "hw/block/flash.h"
+#include "qemu/nand-image.h"
 #include "qapi/qmp/qerror.h"
 #include "qemu/fifo.h"
 #include "sysemu/blockdev.h"
@@ -210,10 +211,14 @@ DEP_REG32(DATA_INTERFACE,   0x6C)
 
 #define ECC_CODEWORD_SIZE 512
 
+/* Bounce buffer size for bulk transfers */
+#define ARASAN_NFC_CHUNK 1024
+
 typedef struct ArasanNFCState {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
     MemoryRegion *dma_mr;
     AddressSpace *dma_as;
     qemu_irq irq;
@@ -224,10 +229,11 @@ typedef struct ArasanNFCState {
     /* FIXME: Use a saner size */
     uint8_t ecc_digest[128 * 1024];
     uint8_t ecc_oob[128 * 1024];
-    uint32_t ecc_pos, ecc_subpage_offset;
+    NandEccState ecc_st;
 
     bool has_mdma;
     bool boot_en;
+    bool skip_ecc_check;
     uint8_t num_cs;
 
     uint64_t dma_sar;
@@ -252,35 +258,28 @@ static inline bool arasan_nfc_ecc_enabled(ArasanNFCState *s)
 
 static void arasan_nfc_ecc_init(ArasanNFCState *s)
 {
-    /* FIXME: Bad performance */
-    memset(s->ecc_digest, 0xFF, 16 * 1024);
-    s->ecc_pos = 0;
-    s->ecc_subpage_offset = 0;
+    memset(s->ecc_digest, 0xFF, DEP_AF_EX32(s->regs, ECC, ECC_SIZE));
+    s->ecc_st = (NandEccState) { 0, 0 };
 }
 
 /* not an ECC algorithm, but gives a deterministic OOB that
  * depends on the in band data
  */
 
-static void arasan_nfc_ecc_digest(ArasanNFCState *s, uint8_t data)
+static void arasan_nfc_ecc_digest(ArasanNFCState *s, const uint8_t *data,
+                                  uint32_t len)
 {
     uint32_t page_size = arasan_nfc_page_size_lookup[DEP_AF_EX32(s->regs, CMD,
                                                              PAGE_SIZE)];
-    int ecc_bytes_per_subpage = DEP_AF_EX32(s->regs, ECC, ECC_SIZE) /
-                                (page_size / ECC_CODEWORD_SIZE);
-
-    s->ecc_digest[s->ecc_pos++] ^= ~data;
-    if (!(s->ecc_pos % ecc_bytes_per_subpage)) {
-        s->ecc_pos -= ecc_bytes_per_subpage;
-    }
+    uint32_t ecc_size = DEP_AF_EX32(s->regs, ECC, ECC_SIZE);
 
-    s->ecc_subpage_offset++;
-    if (s->ecc_subpage_offset == ECC_CODEWORD_SIZE) {
-        s->ecc_subpage_offset = 0;
-        do {
-            s->ecc_pos++;
-        } while (s->ecc_pos % ecc_bytes_per_subpage);
+    if (!page_size || ecc_size < page_size / ECC_CODEWORD_SIZE) {
+        qemu_log_mask(LOG_GUEST_ERROR, "ECC size %" PRIu32 " too small for "
+                      "page size %" PRIu32 "\n", ecc_size, page_size);
+        return;
     }
+    nand_ecc_digest(&s->ecc_st, s->ecc_digest, ecc_size, data, len,
+                    page_size);
 }
 
 static bool arasan_nfc_ecc_correct(ArasanNFCState *s)
@@ -375,40 +374,39 @@ static inline void arasan_nfc_sync_dma_addr(ArasanNFCState *s)
 
 static inline void arasan_nfc_do_dma(ArasanNFCState *s, bool rnw)
 {
-    DMADirection dir = rnw ? DMA_DIRECTION_FROM_DEVICE :
-                             DMA_DIRECTION_TO_DEVICE;
-    int debug_squelch = 5;
+    uint8_t buf[ARASAN_NFC_CHUNK];
 
-    /* FIXME: Be less dumb */
     while (DEP_AF_EX32(s->regs, CMD, DMA_EN) == 0x2 &&
            !(rnw ? fifo_is_empty : fifo_is_full)(&s->buffer) &&
            !s->dbb_blocked) {
         uint32_t dbb_mask = MAKE_64BIT_MASK(0,
                                             s->regs[R_DMA_BUF_BOUNDARY] + 12);
-        uint8_t tmp;
+        bool dbb = s->regs[R_DMA_BUF_BOUNDARY] & 1 << 3;
+        uint32_t len = rnw ? fifo_num_used(&s->buffer) :
+                             fifo_num_free(&s->buffer);
 
-        if (rnw) {
-            tmp = fifo_pop8(&s->buffer);
+        /* Stop at the buffer boundary, if any */
+        if (dbb) {
+            len = MIN(len, dbb_mask - (s->dma_sar & dbb_mask) + 1);
         }
 
-        dma_memory_rw(s->dma_as, s->dma_sar, &tmp, 1, dir);
-
-        if (debug_squelch) {
-            DB_PRINT("Doing dma %s with addr %08" PRIx64 " = %02" PRIx8 "\n",
-                     rnw ? "read" : "write", s->dma_sar, tmp);
-            debug_squelch--;
-        }
+        if (rnw) {
+            const void *data = fifo_pop_buf(&s->buffer, len, &len);
 
-        if (!rnw) {
-            fifo_push8(&s->buffer, tmp);
+            dma_memory_write(s->dma_as, s->dma_sar, data, len);
+        } else {
+            len = MIN(len, sizeof(buf));
+            dma_memory_read(s->dma_as, s->dma_sar, buf, len);
+            fifo_push_all(&s->buffer, buf, len);
         }
+        DB_PRINT("Did dma %s of %" PRIu32 " bytes at addr %08" PRIx64 "\n",
+                 rnw ? "read" : "write", len, s->dma_sar);
+        s->dma_sar += len;
 
-        if ((s->regs[R_DMA_BUF_BOUNDARY] & 1 << 3) &&
-            (s->dma_sar & dbb_mask) == dbb_mask) {
+        if (dbb && ((s->dma_sar - 1) & dbb_mask) == dbb_mask) {
             s->dbb_blocked = true;
-	        arasan_nfc_irq_event(s, R_INT_DMA_INT);
+            arasan_nfc_irq_event(s, R_INT_DMA_INT);
         }
-        s->dma_sar++;
     }
 }
 
@@ -449,7 +447,6 @@ static void arasan_nfc_set_current(ArasanNFCState *s)
 
 static inline void arasan_nfc_update_state(ArasanNFCState *s)
 {
-    int i;
     uint32_t packet_size;
 
     switch (s->regs[R_PGRAM]) {
@@ -488,21 +485,23 @@ static inline void arasan_nfc_update_state(ArasanNFCState *s)
             if (arasan_nfc_write_check_ecc(s)) {
                 arasan_nfc_ecc_init(s);
             }
-		    while (!fifo_is_empty(&s->buffer)) {
-		    	uint8_t to_write = fifo_pop8(&s->buffer);
+            while (!fifo_is_empty(&s->buffer)) {
+                uint32_t num;
+                const uint8_t *to_write = fifo_pop_buf(&s->buffer,
+                                                fifo_num_used(&s->buffer),
+                                                &num);
+
                 if (arasan_nfc_write_check_ecc(s)) {
-                    arasan_nfc_ecc_digest(s, to_write);
+                    arasan_nfc_ecc_digest(s, to_write, num);
                 }
-		    	nand_setio(s->current, to_write);
-				DB_PRINT("write byte %#02" PRIx8 "\n", to_write);
-		    }
+                nand_setio_buf(s->current, to_write, num);
+                DB_PRINT("write %" PRIu32 " bytes\n", num);
+            }
             if (arasan_nfc_write_check_ecc(s)) {
                 arasan_nfc_do_cmd(s, 2, true, false);
                 nand_setpins(s->current, 0, 0, 0, 1, 0); /* data */
-                for (i = 0; i < DEP_AF_EX32(s->regs, ECC, ECC_SIZE); ++i) {
-                    nand_setio(s->current, s->ecc_digest[i]);
-                    DB_PRINT("write ecc byte %#02" PRIx8 "\n", s->ecc_digest[i]);
-                }
+                nand_setio_buf(s->current, s->ecc_digest,
+                               DEP_AF_EX32(s->regs, ECC, ECC_SIZE));
             }
             if (s->regs[R_PGRAM] & R_PGRAM_PAGE_PROGRAM) {
                 arasan_nfc_do_cmd2(s, false);
@@ -599,6 +598,8 @@ static void arasan_nfc_r_dma_system_addr_pw(DepRegisterInfo *reg, uint64_t val)
 static uint64_t r_program_pre_write(DepRegisterInfo *reg, uint64_t val)
 {
     ArasanNFCState *s = ARASAN_NFC(reg->opaque);
+    uint32_t num;
+    bool check_ecc;
     int i, j;
 
     DB_PRINT("val = %#08" PRIx32 "\n", (uint32_t)val);
@@ -682,29 +683,33 @@ static uint64_t r_program_pre_write(DepRegisterInfo *reg, uint64_t val)
             }
             break;
         case R_PGRAM_READ:
+            check_ecc = arasan_nfc_ecc_enabled(s) && !s->skip_ecc_check;
             if (arasan_nfc_ecc_enabled(s)) {
                 s->regs[R_ECC_ERR_COUNT] = 0;
+            }
+            if (check_ecc) {
                 arasan_nfc_ecc_init(s);
             }
             nand_setpins(s->current, 0, 0, 0, 1, 0); /* data */
-            for (j = 0; j < payload_size; ++j) {
-                uint8_t to_read = nand_getio(s->current);
-                if (arasan_nfc_ecc_enabled(s)) {
-                    arasan_nfc_ecc_digest(s, to_read);
+            for (j = 0; j < payload_size; j += num) {
+                uint8_t buf[ARASAN_NFC_CHUNK];
+
+                num = MIN(payload_size - j, sizeof(buf));
+                nand_getio_buf(s->current, buf, num);
+                if (check_ecc) {
+                    arasan_nfc_ecc_digest(s, buf, num);
                 }
-                fifo_push8(&s->buffer, to_read);
-                DB_PRINT("read byte %#02" PRIx8 "\n", to_read);
+                fifo_push_all(&s->buffer, buf, num);
             }
+            DB_PRINT("read %" PRIu32 " bytes\n", payload_size);
             /* FIXME: ECC is done backwards for reads, reading the payload
              * first, then the ECC data late. Real HW is the other way round.
              */
-            if (arasan_nfc_ecc_enabled(s)) {
+            if (check_ecc) {
                 arasan_nfc_do_cmd(s, 2, true, false);
                 arasan_nfc_do_cmd2(s, true);
-                for (j = 0; j < DEP_AF_EX32(s->regs, ECC, ECC_SIZE); ++j) {
-                    s->ecc_oob[j] = nand_getio(s->current);
-                    DB_PRINT("read ecc %#02" PRIx8 "\n", s->ecc_oob[j]);
-                }
+                nand_getio_buf(s->current, s->ecc_oob,
+                               DEP_AF_EX32(s->regs, ECC, ECC_SIZE));
                 arasan_nfc_ecc_correct(s);
             }
         }
@@ -714,8 +719,8 @@ static uint64_t r_program_pre_write(DepRegisterInfo *reg, uint64_t val)
 }
 
 static const MemoryRegionOps arasan_nfc_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_NATIVE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -790,6 +795,8 @@ static void arasan_nfc_realize(DeviceState *dev, Error ** errp)
         s->nand[1] = nand_init(dinfo ? blk_by_legacy_dinfo(dinfo) : NULL,
                                NAND_MFR_MICRON, 0x44);
     }
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &arasan_nfc_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(arasan_nfc_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -801,9 +808,7 @@ static void arasan_nfc_realize(DeviceState *dev, Error ** errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &arasan_nfc_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
 
     fifo_create8(&s->buffer, 1);
@@ -848,6 +853,8 @@ static Property arasan_nfc_properties[] = {
     DEFINE_PROP_UINT8("num-cs", ArasanNFCState, num_cs, 2),
     DEFINE_PROP_BOOL("has-mdma", ArasanNFCState, has_mdma, true),
     DEFINE_PROP_BOOL("boot-en", ArasanNFCState, boot_en, false),
+    /* Trust the image, do not check the ECC of the pages read */
+    DEFINE_PROP_BOOL("skip-ecc-check", ArasanNFCState, skip_ecc_check, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -42,6 +42,14 @@ struct VirtIOBlockDataPlane {
      */
     IOThread *iothread;
     AioContext *ctx;
+
+    /* Where each virtqueue is served.  With vq-iothreads these are other
+     * IOThreads than the one the BlockBackend runs in, ctx.  Its lock
+     * serializes the virtqueues with each other and with the completions.
+     */
+    unsigned num_vq_iothreads;
+    IOThread **vq_iothreads;
+    AioContext **vq_ctx;
 };
 
 /* Raise an interrupt to signal guest, if necessary */
@@ -58,8 +66,11 @@ static void notify_guest_bh(void *opaque)
     unsigned long bitmap[BITS_TO_LONGS(nvqs)];
     unsigned j;
 
+    /* Virtqueues served by other IOThreads complete requests there too */
+    aio_context_acquire(s->ctx);
     memcpy(bitmap, s->batch_notify_vqs, sizeof(bitmap));
     memset(s->batch_notify_vqs, 0, sizeof(bitmap));
+    aio_context_release(s->ctx);
 
     for (j = 0; j < nvqs; j += BITS_PER_LONG) {
         unsigned long bits = bitmap[j];
@@ -75,6 +86,24 @@ static void notify_guest_bh(void *opaque)
     }
 }
 
+static IOThread *virtio_blk_find_iothread(VirtIOBlkConf *conf, unsigned i,
+                                          Error **errp)
+{
+    const char *id = conf->vq_iothreads[i];
+    Object *obj;
+
+    if (!id) {
+        error_setg(errp, "vq-iothreads[%u] is not set", i);
+        return NULL;
+    }
+    obj = object_resolve_path_component(object_get_objects_root(), id);
+    if (!obj || !object_dynamic_cast(obj, TYPE_IOTHREAD)) {
+        error_setg(errp, "'%s' is not an iothread", id);
+        return NULL;
+    }
+    return IOTHREAD(obj);
+}
+
 /* Context: QEMU global mutex held */
 void virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
                                   VirtIOBlockDataPlane **dataplane,
@@ -83,9 +112,16 @@ void virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     VirtIOBlockDataPlane *s;
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    IOThread **vq_iothreads;
+    unsigned i;
 
     *dataplane = NULL;
 
+    if (conf->num_vq_iothreads && !conf->iothread) {
+        error_setg(errp, "vq-iothreads requires iothread");
+        return;
+    }
+
     if (conf->iothread) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
@@ -111,6 +147,15 @@ void virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
         return;
     }
 
+    vq_iothreads = g_new(IOThread *, conf->num_vq_iothreads);
+    for (i = 0; i < conf->num_vq_iothreads; i++) {
+        vq_iothreads[i] = virtio_blk_find_iothread(conf, i, errp);
+        if (!vq_iothreads[i]) {
+            g_free(vq_iothreads);
+            return;
+        }
+    }
+
     s = g_new0(VirtIOBlockDataPlane, 1);
     s->vdev = vdev;
     s->conf = conf;
@@ -125,6 +170,18 @@ void virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     s->bh = aio_bh_new(s->ctx, notify_guest_bh, s);
     s->batch_notify_vqs = bitmap_new(conf->num_queues);
 
+    s->num_vq_iothreads = conf->num_vq_iothreads;
+    s->vq_iothreads = vq_iothreads;
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        object_ref(OBJECT(vq_iothreads[i]));
+    }
+    s->vq_ctx = g_new(AioContext *, conf->num_queues);
+    for (i = 0; i < conf->num_queues; i++) {
+        s->vq_ctx[i] = s->num_vq_iothreads
+            ? iothread_get_aio_context(vq_iothreads[i % s->num_vq_iothreads])
+            : s->ctx;
+    }
+
     *dataplane = s;
 }
 
@@ -132,6 +189,7 @@ void virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
 void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 {
     VirtIOBlock *vblk;
+    unsigned i;
 
     if (!s) {
         return;
@@ -139,6 +197,11 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
 
     vblk = VIRTIO_BLK(s->vdev);
     assert(!vblk->dataplane_started);
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        object_unref(OBJECT(s->vq_iothreads[i]));
+    }
+    g_free(s->vq_iothreads);
+    g_free(s->vq_ctx);
     g_free(s->batch_notify_vqs);
     qemu_bh_delete(s->bh);
     if (s->iothread) {
@@ -158,6 +221,49 @@ static bool virtio_blk_data_plane_handle_output(VirtIODevice *vdev,
     return virtio_blk_handle_vq(s, vq);
 }
 
+/* For virtqueues served by an IOThread of their own.  Requests are popped
+ * and parsed here, the block layer then runs them in the BlockBackend's
+ * AioContext, where coroutines entered from here get scheduled.
+ */
+static bool virtio_blk_data_plane_handle_vq_output(VirtIODevice *vdev,
+                                                   VirtQueue *vq)
+{
+    VirtIOBlock *s = (VirtIOBlock *)vdev;
+    VirtIOBlockDataPlane *dp = s->dataplane;
+    bool progress = false;
+
+    aio_context_acquire(dp->ctx);
+    /* The handler may have been on its way while dataplane stopped */
+    if (s->dataplane_started && !dp->stopping) {
+        progress = virtio_blk_handle_vq(s, vq);
+    }
+    aio_context_release(dp->ctx);
+    return progress;
+}
+
+static void virtio_blk_data_plane_sync_bh(void *opaque)
+{
+    qemu_event_set(opaque);
+}
+
+/* Wait for the virtqueue IOThreads to be done with handlers that started
+ * before they were removed.
+ */
+static void virtio_blk_data_plane_sync_vq_iothreads(VirtIOBlockDataPlane *s)
+{
+    QemuEvent done;
+    unsigned i;
+
+    qemu_event_init(&done, false);
+    for (i = 0; i < s->num_vq_iothreads; i++) {
+        qemu_event_reset(&done);
+        aio_bh_schedule_oneshot(iothread_get_aio_context(s->vq_iothreads[i]),
+                                virtio_blk_data_plane_sync_bh, &done);
+        qemu_event_wait(&done);
+    }
+    qemu_event_destroy(&done);
+}
+
 /* Context: QEMU global mutex held */
 int virtio_blk_data_plane_start(VirtIODevice *vdev)
 {
@@ -213,8 +319,10 @@ int virtio_blk_data_plane_start(VirtIODevice *vdev)
     for (i = 0; i < nvqs; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx,
-                virtio_blk_data_plane_handle_output);
+        virtio_queue_aio_set_host_notifier_handler(vq, s->vq_ctx[i],
+                s->vq_ctx[i] == s->ctx
+                ? virtio_blk_data_plane_handle_output
+                : virtio_blk_data_plane_handle_vq_output);
     }
     aio_context_release(s->ctx);
     return 0;
@@ -255,7 +363,7 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
     for (i = 0; i < nvqs; i++) {
         VirtQueue *vq = virtio_get_queue(s->vdev, i);
 
-        virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, NULL);
+        virtio_queue_aio_set_host_notifier_handler(vq, s->vq_ctx[i], NULL);
     }
 
     /* Drain and switch bs back to the QEMU main loop */
@@ -263,6 +371,8 @@ void virtio_blk_data_plane_stop(VirtIODevice *vdev)
 
     aio_context_release(s->ctx);
 
+    virtio_blk_data_plane_sync_vq_iothreads(s);
+
     for (i = 0; i < nvqs; i++) {
         virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
     }
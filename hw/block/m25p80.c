@@ -27,7 +27,10 @@
 #include "sysemu/blockdev.h"
 #include "hw/ssi/ssi.h"
 #include "qemu/bitops.h"
+#include "qemu/bitmap.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 
@@ -431,6 +434,17 @@ typedef enum {
 } Manufacturer;
 
 #define M25P80_INTERNAL_DATA_BUFFER_SZ 16
+
+/* Dirty storage is written back this long after the command that
+ * dirtied it, in runs of whole chunks.
+ */
+#define M25P80_WB_CHUNK 4096
+#define M25P80_WB_DELAY_MS 100
+
+/* Storage is only read in from blk (or filled) on first access, this
+ * many bytes at a time.
+ */
+#define M25P80_LAZY_CHUNK (64 * 1024)
 #define MICRON_OCTAL_CFG_SIZE 256
 
 typedef struct Flash {
@@ -439,6 +453,8 @@ typedef struct Flash {
     BlockBackend *blk;
 
     uint8_t *storage;
+    /* Chunks of storage that hold the flash contents, M25P80_LAZY_CHUNK.  */
+    unsigned long *populated;
     uint32_t size;
     int page_size;
 
@@ -474,7 +490,15 @@ typedef struct Flash {
     bool quad_enable;
     uint8_t ear;
 
-    int64_t dirty_page;
+    /* Writeback of storage to blk, coalesced by M25P80_WB_CHUNK.  */
+    unsigned long *wb_dirty;
+    bool wb_pending;
+    QEMUTimer *wb_timer;
+    VMChangeStateEntry *wb_vmstate;
+
+    /* Whoever mapped storage through map_read, told once on change.  */
+    void (*changed)(void *opaque);
+    void *changed_opaque;
 
     const FlashPartInfo *pi;
 
@@ -525,41 +549,110 @@ static void blk_sync_complete(void *opaque, int ret)
      */
 }
 
-static void flash_sync_page(Flash *s, int page)
+static void flash_populate_slow(Flash *s, unsigned long first,
+                                unsigned long last)
 {
-    QEMUIOVector *iov;
+    unsigned long start, end;
+
+    for (start = find_next_zero_bit(s->populated, last + 1, first);
+         start <= last;
+         start = find_next_zero_bit(s->populated, last + 1, end)) {
+        uint64_t off, len;
+
+        end = find_next_bit(s->populated, last + 1, start);
+        off = (uint64_t)start * M25P80_LAZY_CHUNK;
+        len = MIN((uint64_t)end * M25P80_LAZY_CHUNK, s->size) - off;
+        if (!s->blk) {
+            memset(s->storage + off, 0xFF, len);
+        } else if (blk_pread(s->blk, off, s->storage + off, len) != len) {
+            error_report("m25p80: failed to read the flash content at 0x%"
+                         PRIx64, off);
+            exit(1);
+        }
+        bitmap_set(s->populated, start, end - start);
+    }
+}
+
+/* Make sure storage holds the flash contents for off to off + len.  */
+static inline void flash_populate(Flash *s, uint64_t off, uint64_t len)
+{
+    unsigned long first = off / M25P80_LAZY_CHUNK;
+    unsigned long last;
 
-    if (!s->blk || blk_is_read_only(s->blk)) {
+    if (!len || off >= s->size) {
         return;
     }
+    last = (MIN(off + len, s->size) - 1) / M25P80_LAZY_CHUNK;
+    if (first != last || !test_bit(first, s->populated)) {
+        flash_populate_slow(s, first, last);
+    }
+}
 
-    iov = g_new(QEMUIOVector, 1);
-    qemu_iovec_init(iov, 1);
-    qemu_iovec_add(iov, s->storage + page * s->pi->page_size,
-                   s->pi->page_size);
-    blk_aio_pwritev(s->blk, page * s->pi->page_size, iov, 0,
-                    blk_sync_complete, iov);
+static void flash_writeback(Flash *s)
+{
+    unsigned long nr = DIV_ROUND_UP(s->size, M25P80_WB_CHUNK);
+    unsigned long start, end;
+
+    timer_del(s->wb_timer);
+    s->wb_pending = false;
+
+    for (start = find_first_bit(s->wb_dirty, nr); start < nr;
+         start = find_next_bit(s->wb_dirty, nr, end)) {
+        QEMUIOVector *iov;
+        uint64_t off, len;
+
+        end = find_next_zero_bit(s->wb_dirty, nr, start);
+        bitmap_clear(s->wb_dirty, start, end - start);
+
+        off = (uint64_t)start * M25P80_WB_CHUNK;
+        len = MIN((uint64_t)end * M25P80_WB_CHUNK, s->size) - off;
+        iov = g_new(QEMUIOVector, 1);
+        qemu_iovec_init(iov, 1);
+        qemu_iovec_add(iov, s->storage + off, len);
+        blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
+    }
 }
 
-static inline void flash_sync_area(Flash *s, int64_t off, int64_t len)
+static void flash_writeback_timer(void *opaque)
 {
-    QEMUIOVector *iov;
+    flash_writeback(opaque);
+}
 
-    if (!s->blk || blk_is_read_only(s->blk)) {
+static void flash_writeback_vm_state(void *opaque, int running,
+                                     RunState state)
+{
+    if (!running) {
+        flash_writeback(opaque);
+    }
+}
+
+/* Written back once the command is over, see m25p80_cs.  */
+static void flash_mark_dirty(Flash *s, uint32_t off, uint32_t len)
+{
+    if (!s->wb_dirty || !len) {
         return;
     }
 
-    assert(!(len % BDRV_SECTOR_SIZE));
-    iov = g_new(QEMUIOVector, 1);
-    qemu_iovec_init(iov, 1);
-    qemu_iovec_add(iov, s->storage + off, len);
-    blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
+    bitmap_set(s->wb_dirty, off / M25P80_WB_CHUNK,
+               (off + len - 1) / M25P80_WB_CHUNK - off / M25P80_WB_CHUNK + 1);
+    s->wb_pending = true;
+}
+
+static void flash_storage_changed(Flash *s)
+{
+    void (*changed)(void *opaque) = s->changed;
+
+    if (changed) {
+        s->changed = NULL;
+        changed(s->changed_opaque);
+    }
 }
 
 static void flash_erase(Flash *s, int offset, FlashCMD cmd)
 {
     uint32_t len;
     uint8_t capa_to_assert = 0;
+    unsigned long first, end;
 
     switch (cmd) {
     case ERASE_4K:
@@ -603,23 +696,29 @@ static void flash_erase(Flash *s, int offset, FlashCMD cmd)
         qemu_log_mask(LOG_GUEST_ERROR, "M25P80: erase with write protect!\n");
         return;
     }
-    memset(s->storage + offset, 0xff, len);
-    flash_sync_area(s, offset, len);
-}
-
-static inline void flash_sync_dirty(Flash *s, int64_t newpage)
-{
-    if (s->dirty_page >= 0 && s->dirty_page != newpage) {
-        flash_sync_page(s, s->dirty_page);
-        s->dirty_page = newpage;
+    /* Chunks that are erased whole never need to be read in.  */
+    first = DIV_ROUND_UP(offset, M25P80_LAZY_CHUNK);
+    end = MIN((uint64_t)offset + len, s->size) / M25P80_LAZY_CHUNK;
+    if (first < end) {
+        flash_populate(s, offset, first * M25P80_LAZY_CHUNK - offset);
+        flash_populate(s, end * M25P80_LAZY_CHUNK,
+                       (uint64_t)offset + len - end * M25P80_LAZY_CHUNK);
+        bitmap_set(s->populated, first, end - first);
+    } else {
+        flash_populate(s, offset, len);
     }
+    memset(s->storage + offset, 0xff, len);
+    flash_storage_changed(s);
+    flash_mark_dirty(s, offset, len);
 }
 
 static inline
 void flash_write8(Flash *s, uint32_t addr, uint8_t data)
 {
-    uint32_t page = addr / s->pi->page_size;
-    uint8_t prev = s->storage[s->cur_addr];
+    uint8_t prev;
+
+    flash_populate(s, s->cur_addr, 1);
+    prev = s->storage[s->cur_addr];
 
     if (!s->write_enable) {
         qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
@@ -635,9 +734,8 @@ void flash_write8(Flash *s, uint32_t addr, uint8_t data)
     } else {
         s->storage[s->cur_addr] &= data;
     }
-
-    flash_sync_dirty(s, page);
-    s->dirty_page = page;
+    flash_storage_changed(s);
+    flash_mark_dirty(s, s->cur_addr, 1);
 }
 
 static inline int get_addr_length(Flash *s)
@@ -1282,7 +1380,10 @@ static int m25p80_cs(SSISlave *ss, bool select)
         s->len = 0;
         s->pos = 0;
         s->state = STATE_IDLE;
-        flash_sync_dirty(s, -1);
+        if (s->wb_pending && !timer_pending(s->wb_timer)) {
+            timer_mod(s->wb_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                                   M25P80_WB_DELAY_MS);
+        }
         s->data_read_loop = false;
     }
 
@@ -1306,6 +1407,7 @@ static uint32_t m25p80_transfer8(SSISlave *ss, uint32_t tx)
         break;
 
     case STATE_READ:
+        flash_populate(s, s->cur_addr, 1);
         r = s->storage[s->cur_addr];
         DB_PRINT_L(1, "READ 0x%" PRIx32 "=%" PRIx8 "\n", s->cur_addr,
                    (uint8_t)r);
@@ -1364,10 +1466,61 @@ static uint32_t m25p80_transfer8(SSISlave *ss, uint32_t tx)
     return r;
 }
 
+/* Data phase of the read commands straight from storage. Everything
+ * before it (address, mode bits, dummy cycles) still goes through
+ * m25p80_transfer8, so by the time we get here the protocol state is
+ * already settled.
+ */
+static size_t m25p80_transfer_read(SSISlave *ss, uint8_t *buf, size_t len)
+{
+    Flash *s = M25P80(ss);
+    size_t done = 0;
+
+    if (s->state != STATE_READ) {
+        return 0;
+    }
+
+    while (done < len) {
+        size_t n = MIN(len - done, s->size - s->cur_addr);
+
+        flash_populate(s, s->cur_addr, n);
+        memcpy(buf + done, s->storage + s->cur_addr, n);
+        s->cur_addr = (s->cur_addr + n) & (s->size - 1);
+        done += n;
+    }
+    DB_PRINT_L(1, "READ %zu bytes up to 0x%" PRIx32 "\n", len, s->cur_addr);
+    return done;
+}
+
+static const uint8_t *m25p80_map_read(SSISlave *ss, uint64_t *len,
+                                      void (*changed)(void *opaque),
+                                      void *opaque)
+{
+    Flash *s = M25P80(ss);
+
+    if (s->state != STATE_READ) {
+        return NULL;
+    }
+
+    s->changed = changed;
+    s->changed_opaque = opaque;
+    *len = s->size - s->cur_addr;
+    flash_populate(s, s->cur_addr, *len);
+    return s->storage + s->cur_addr;
+}
+
 static void m25p80_exit(Object *obj)
 {
     Flash *s = M25P80(obj);
 
+    if (s->wb_dirty) {
+        flash_writeback(s);
+        blk_drain(s->blk);
+        qemu_del_vm_change_state_handler(s->wb_vmstate);
+        timer_free(s->wb_timer);
+        g_free(s->wb_dirty);
+    }
+    g_free(s->populated);
     g_free(s->nonvolatile_cfg_large);
     g_free(s->volatile_cfg_large);
     g_free(s->nv_cfg_large_stage);
@@ -1382,7 +1535,6 @@ static void m25p80_realize(SSISlave *ss, Error **errp)
     s->pi = mc->pi;
 
     s->size = s->pi->sector_size * s->pi->n_sectors;
-    s->dirty_page = -1;
 
     if (get_man(s) == MAN_MICRON_OCTAL) {
         s->nonvolatile_cfg_large = g_new(uint8_t, MICRON_OCTAL_CFG_SIZE);
@@ -1413,16 +1565,20 @@ static void m25p80_realize(SSISlave *ss, Error **errp)
 
         DB_PRINT_L(0, "Binding to IF_MTD drive\n");
         s->storage = blk_blockalign(s->blk, s->size);
-        if (blk_pread(s->blk, 0, s->storage, s->size) != s->size) {
-            fprintf(stderr, "failed to read the initial flash content");
-            exit(1);
-        }
 
+        if (!blk_is_read_only(s->blk)) {
+            s->wb_dirty = bitmap_new(DIV_ROUND_UP(s->size, M25P80_WB_CHUNK));
+            s->wb_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                       flash_writeback_timer, s);
+            s->wb_vmstate = qemu_add_vm_change_state_handler(
+                                flash_writeback_vm_state, s);
+        }
     } else {
         DB_PRINT_L(0, "No BDRV - binding to RAM\n");
         s->storage = blk_blockalign(NULL, s->size);
-        memset(s->storage, 0xFF, s->size);
     }
+    /* Large allocations are mmapped, untouched chunks cost no memory.  */
+    s->populated = bitmap_new(DIV_ROUND_UP(s->size, M25P80_LAZY_CHUNK));
 }
 
 static void m25p80_reset(DeviceState *d)
@@ -1434,7 +1590,11 @@ static void m25p80_reset(DeviceState *d)
 
 static int m25p80_pre_save(void *opaque)
 {
-    flash_sync_dirty((Flash *)opaque, -1);
+    Flash *s = opaque;
+
+    if (s->wb_dirty) {
+        flash_writeback(s);
+    }
 
     return 0;
 }
@@ -1545,6 +1705,8 @@ static void m25p80_class_init(ObjectClass *klass, void *data)
 
     k->realize = m25p80_realize;
     k->transfer = m25p80_transfer8;
+    k->transfer_read = m25p80_transfer_read;
+    k->map_read = m25p80_map_read;
     k->set_cs = m25p80_cs;
     k->cs_polarity = SSI_CS_LOW;
     dc->vmsd = &vmstate_m25p80;
@@ -752,13 +752,11 @@ void nand_setio(DeviceState *dev, uint32_t value)
     }
 }
 
-uint32_t nand_getio(DeviceState *dev)
+/* Allow sequential reading */
+static void nand_load_next(NANDFlashState *s)
 {
     int offset;
-    uint32_t x = 0;
-    NANDFlashState *s = NAND(dev);
 
-    /* Allow sequential reading */
     if (!s->iolen && s->cmd == NAND_CMD_READ0) {
         offset = (int) (s->addr & ((1 << s->addr_shift) - 1)) + s->offset;
         s->offset = 0;
@@ -769,6 +767,15 @@ uint32_t nand_getio(DeviceState *dev)
         else
             s->iolen = (1 << s->page_shift) + (1 << s->oob_shift) - offset;
     }
+}
+
+uint32_t nand_getio(DeviceState *dev)
+{
+    int offset;
+    uint32_t x = 0;
+    NANDFlashState *s = NAND(dev);
+
+    nand_load_next(s);
 
     if (s->ce || s->iolen <= 0) {
         return 0;
@@ -788,6 +795,57 @@ uint32_t nand_getio(DeviceState *dev)
     return x;
 }
 
+void nand_getio_buf(DeviceState *dev, uint8_t *buf, int len)
+{
+    NANDFlashState *s = NAND(dev);
+
+    if (s->buswidth != 1 || s->cmd == NAND_CMD_READSTATUS) {
+        while (len--) {
+            *buf++ = nand_getio(dev);
+        }
+        return;
+    }
+
+    while (len) {
+        int n;
+
+        nand_load_next(s);
+        if (s->ce || s->iolen <= 0) {
+            memset(buf, 0, len);
+            return;
+        }
+
+        n = MIN(len, s->iolen);
+        memcpy(buf, s->ioaddr, n);
+        s->addr   += n;
+        s->ioaddr += n;
+        s->iolen  -= n;
+        buf += n;
+        len -= n;
+    }
+}
+
+void nand_setio_buf(DeviceState *dev, const uint8_t *buf, int len)
+{
+    NANDFlashState *s = NAND(dev);
+    int n;
+
+    if (s->buswidth != 1 || s->cle || s->ale ||
+        s->cmd != NAND_CMD_PAGEPROGRAM1) {
+        while (len--) {
+            nand_setio(dev, *buf++);
+        }
+        return;
+    }
+
+    /* Anything past the page and its OOB is dropped */
+    n = MIN(len, (1 << s->page_shift) + (1 << s->oob_shift) - s->iolen);
+    if (n > 0) {
+        memcpy(s->io + s->iolen, buf, n);
+        s->iolen += n;
+    }
+}
+
 uint32_t nand_getbuswidth(DeviceState *dev)
 {
     NANDFlashState *s = (NANDFlashState *) dev;
@@ -50,6 +50,7 @@
 
 typedef struct PL35xItf {
     MemoryRegion mm;
+    MemoryRegion sram_alias;
     DeviceState *dev;
     uint8_t nand_pending_addr_cycles;
 } PL35xItf;
@@ -224,8 +225,17 @@ static void pl35x_init_sram(SysBusDevice *dev, PL35xItf *itf)
 
     memory_region_init(&itf->mm, OBJECT(dev), "pl35x.sram", 1 << 24);
     if (sbd) {
-        memory_region_add_subregion(&itf->mm, 0,
-                                    sysbus_mmio_get_region(sbd, 0));
+        MemoryRegion *mr = sysbus_mmio_get_region(sbd, 0);
+
+        /* Alias the region of the device rather than taking it over, so
+         * that it can stay mapped elsewhere too.  The alias resolves to
+         * the region itself, so NOR flash in array (romd) mode stays a
+         * direct RAM mapping and XIP code does not go through MMIO.
+         */
+        memory_region_init_alias(&itf->sram_alias, OBJECT(dev),
+                                 "pl35x.sram-alias", mr, 0,
+                                 MIN(memory_region_size(mr), 1 << 24));
+        memory_region_add_subregion(&itf->mm, 0, &itf->sram_alias);
     }
     sysbus_init_mmio(dev, &itf->mm);
 }
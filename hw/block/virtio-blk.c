@@ -42,7 +42,7 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    virtqueue_free_element(req->vq, req);
 }
 
 static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
@@ -199,14 +199,29 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+/* Requests popped from the virtqueue at a time */
+#define VIRTIO_BLK_POP_BATCH 16
+
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, n;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs,
+                            VIRTIO_BLK_POP_BATCH);
+    for (i = 0; i < n; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
+    }
+    return n;
+}
+
+/* Give back requests that were popped but not handled, latest first */
+static void virtio_blk_unpop_requests(VirtIOBlockReq **reqs, unsigned int n)
+{
+    while (n--) {
+        virtqueue_unpop(reqs[n]->vq, &reqs[n]->elem, 0);
+        virtio_blk_free_request(reqs[n]);
     }
-    return req;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -594,9 +609,10 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
     MultiReqBuffer mrb = {};
     bool progress = false;
+    unsigned int i, n;
 
     aio_context_acquire(blk_get_aio_context(s->blk));
     blk_io_plug(s->blk);
@@ -604,11 +620,17 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
     do {
         virtio_queue_set_notification(vq, 0);
 
-        while ((req = virtio_blk_get_request(s, vq))) {
+        while ((n = virtio_blk_get_requests(s, vq, reqs))) {
             progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+            for (i = 0; i < n; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                    virtio_blk_unpop_requests(reqs + i + 1, n - i - 1);
+                    break;
+                }
+            }
+            if (i < n) {
                 break;
             }
         }
@@ -1014,6 +1036,8 @@ static Property virtio_blk_properties[] = {
     DEFINE_PROP_UINT16("num-queues", VirtIOBlock, conf.num_queues, 1),
     DEFINE_PROP_LINK("iothread", VirtIOBlock, conf.iothread, TYPE_IOTHREAD,
                      IOThread *),
+    DEFINE_PROP_ARRAY("vq-iothreads", VirtIOBlock, conf.num_vq_iothreads,
+                      conf.vq_iothreads, qdev_prop_string, char *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -50,6 +50,8 @@
 #define XLNX_EFUSE_ERR_DEBUG 0
 #endif
 
+#define XLNX_EFUSE_WB_DELAY_MS 100
+
 bool efuse_get_bit(XLNXEFuse *s, unsigned int bit)
 {
     bool b = s->fuse32[bit / 32] & (1 << bit);
@@ -114,6 +116,38 @@ void efuse_sync_u32(XLNXEFuse *s, uint32_t *u32,
     }
 }
 
+static void efuse_writeback(XLNXEFuse *s)
+{
+    timer_del(s->wb_timer);
+    if (s->wb_start >= s->wb_end) {
+        return;
+    }
+
+    if (blk_pwrite(s->blk, s->wb_start, ((uint8_t *) s->fuse32) + s->wb_start,
+                   s->wb_end - s->wb_start, 0) < 0) {
+        error_report("%s: write error in bytes %" PRIu32 "-%" PRIu32 ".",
+                      __func__, s->wb_start, s->wb_end - 1);
+    }
+    s->wb_start = UINT32_MAX;
+    s->wb_end = 0;
+}
+
+static void efuse_writeback_timer(void *opaque)
+{
+    efuse_writeback(opaque);
+}
+
+static void efuse_writeback_vm_state(void *opaque, int running,
+                                     RunState state)
+{
+    if (!running) {
+        efuse_writeback(opaque);
+    }
+}
+
+/* Programming loops burn fuses one by one, coalesce them into a write
+ * every XLNX_EFUSE_WB_DELAY_MS.
+ */
 static void efuse_sync_bdrv(XLNXEFuse *s)
 {
     unsigned int efuse_byte;
@@ -123,11 +157,11 @@ static void efuse_sync_bdrv(XLNXEFuse *s)
     }
 
     efuse_byte = s->efuse_idx / 8;
-
-    if (blk_pwrite(s->blk, efuse_byte, ((uint8_t *) s->fuse32) + efuse_byte,
-                   1, 0) < 0) {
-        error_report("%s: write error in byte %" PRIu32 ".",
-                      __func__, efuse_byte);
+    s->wb_start = MIN(s->wb_start, efuse_byte);
+    s->wb_end = MAX(s->wb_end, efuse_byte + 1);
+    if (!timer_pending(s->wb_timer)) {
+        timer_mod(s->wb_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                               XLNX_EFUSE_WB_DELAY_MS);
     }
 }
 
@@ -231,6 +265,15 @@ static void efuse_realize(DeviceState *dev, Error **errp)
                           prefix,
                           (unsigned int) (nr_bytes));
         }
+
+        if (!s->blk_ro) {
+            s->wb_start = UINT32_MAX;
+            s->wb_end = 0;
+            s->wb_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                       efuse_writeback_timer, s);
+            s->wb_vmstate = qemu_add_vm_change_state_handler(
+                                efuse_writeback_vm_state, s);
+        }
     }
 
     s->bh_ps = qemu_bh_new(timer_ps_hit, s);
@@ -243,6 +286,29 @@ static void efuse_realize(DeviceState *dev, Error **errp)
     ptimer_set_freq(s->timer_pgm, 1000 * 1000);
 }
 
+static void efuse_unrealize(DeviceState *dev, Error **errp)
+{
+    XLNXEFuse *s = XLNX_EFUSE(dev);
+
+    if (s->wb_timer) {
+        efuse_writeback(s);
+        qemu_del_vm_change_state_handler(s->wb_vmstate);
+        timer_free(s->wb_timer);
+        s->wb_timer = NULL;
+    }
+}
+
+static int efuse_pre_save(void *opaque)
+{
+    XLNXEFuse *s = opaque;
+
+    if (s->wb_timer) {
+        efuse_writeback(s);
+    }
+
+    return 0;
+}
+
 static Property efuse_properties[] = {
     DEFINE_PROP_UINT8("efuse-nr", XLNXEFuse, efuse_nr, 3),
     DEFINE_PROP_UINT32("efuse-size", XLNXEFuse, efuse_size, 64 * 32),
@@ -255,6 +321,7 @@ static const VMStateDescription vmstate_efuse = {
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .pre_save = efuse_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_BOOL(programming, XLNXEFuse),
         VMSTATE_PTIMER(timer_ps, XLNXEFuse),
@@ -268,6 +335,7 @@ static void efuse_class_init(ObjectClass *klass, void *data)
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = efuse_realize;
+    dc->unrealize = efuse_unrealize;
     dc->vmsd = &vmstate_efuse;
     dc->props = efuse_properties;
 }
@@ -155,6 +155,7 @@ static void uart_rx_reset(CadenceUARTState *s)
 static void uart_tx_reset(CadenceUARTState *s)
 {
     s->tx_count = 0;
+    timer_del(s->tx_flush_timer);
 }
 
 static void uart_send_breaks(CadenceUARTState *s)
@@ -288,6 +289,7 @@ static gboolean cadence_uart_xmit(GIOChannel *chan, GIOCondition cond,
         return FALSE;
     }
 
+    timer_del(s->tx_flush_timer);
     ret = qemu_chr_fe_write(&s->chr, s->tx_fifo, s->tx_count);
 
     if (ret >= 0) {
@@ -329,7 +331,25 @@ static void uart_write_tx_fifo(CadenceUARTState *s, const uint8_t *buf,
     memcpy(s->tx_fifo + s->tx_count, buf, size);
     s->tx_count += size;
 
-    cadence_uart_xmit(NULL, G_IO_OUT, s);
+    /* Hand the FIFO to the backend in bursts rather than a write per
+     * character: once it reaches the trigger level, at the end of a line
+     * or when the guest has been quiet for a few character times.
+     */
+    if (s->tx_count >= s->r[R_TTRIG] ||
+        s->tx_count == CADENCE_UART_TX_FIFO_SIZE ||
+        memchr(buf, '\n', size) ||
+        !qemu_chr_fe_backend_connected(&s->chr)) {
+        cadence_uart_xmit(NULL, G_IO_OUT, s);
+    } else {
+        timer_mod(s->tx_flush_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                     (s->char_tx_time * 4));
+        uart_update_status(s);
+    }
+}
+
+static void uart_tx_flush(void *opaque)
+{
+    cadence_uart_xmit(NULL, G_IO_OUT, opaque);
 }
 
 static void uart_receive(void *opaque, const uint8_t *buf, int size)
@@ -366,10 +386,15 @@ static void uart_read_rx_fifo(CadenceUARTState *s, uint32_t *c)
     if (s->rx_count) {
         uint32_t rx_rpos = (CADENCE_UART_RX_FIFO_SIZE + s->rx_wpos -
                             s->rx_count) % CADENCE_UART_RX_FIFO_SIZE;
+        bool stalled = !uart_can_receive(s);
+
         *c = s->rx_fifo[rx_rpos];
         s->rx_count--;
 
-        qemu_chr_fe_accept_input(&s->chr);
+        /* The backend only needs a kick when it was held back.  */
+        if (stalled) {
+            qemu_chr_fe_accept_input(&s->chr);
+        }
     } else {
         *c = 0;
     }
@@ -483,6 +508,7 @@ static void cadence_uart_realize(DeviceState *dev, Error **errp)
 
     s->fifo_trigger_handle = timer_new_ns(QEMU_CLOCK_VIRTUAL,
                                           fifo_trigger_update, s);
+    s->tx_flush_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, uart_tx_flush, s);
 
     qemu_chr_fe_set_handlers(&s->chr, uart_can_receive, uart_receive,
                              uart_event, NULL, s, NULL, true);
@@ -513,6 +539,9 @@ static int cadence_uart_post_load(void *opaque, int version_id)
 
     uart_parameters_setup(s);
     uart_update_status(s);
+    if (s->tx_count) {
+        timer_mod(s->tx_flush_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    }
     return 0;
 }
 
@@ -12,6 +12,7 @@
 #include "chardev/char-fe.h"
 #include "qemu/log.h"
 #include "trace.h"
+#include "sysemu/boot-profile.h"
 
 #define TYPE_PL011 "pl011"
 #define PL011(obj) OBJECT_CHECK(PL011State, (obj), TYPE_PL011)
@@ -169,6 +170,9 @@ static void pl011_write(void *opaque, hwaddr offset,
         /* XXX this blocks entire thread. Rewrite to use
          * qemu_chr_fe_write and background I/O callbacks */
         qemu_chr_fe_write_all(&s->chr, &ch, 1);
+        if (!boot_profile_seen(BOOT_PHASE_CONSOLE_OUTPUT)) {
+            boot_profile_mark(BOOT_PHASE_CONSOLE_OUTPUT, NULL);
+        }
         s->int_level |= PL011_INT_TX;
         pl011_update(s);
         break;
@@ -57,6 +57,7 @@
 typedef struct XilinxUART {
     SysBusDevice parent_obj;
     MemoryRegion iomem[2];
+    DepRegisterBlock regs_block[2];
     qemu_irq irq_rx;
     qemu_irq irq_tx;
     qemu_irq irq_err;
@@ -166,8 +167,8 @@ static const unsigned int uart_reginfo_sizes[] = {
 };
 
 static const MemoryRegionOps iom_uart_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -197,6 +198,8 @@ static void xlx_iom_realize(DeviceState *dev, Error **errp)
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
     for (rmap = 0; rmap < ARRAY_SIZE(uart_reginfos); rmap++) {
+        dep_register_block_init(&s->regs_block[rmap], OBJECT(dev),
+                                &iom_uart_ops, &s->iomem[rmap], s->prefix);
         for (i = 0; i < uart_reginfo_sizes[rmap]; ++i) {
             DepRegisterInfo *r = &s->regs_infos[rmap][i];
 
@@ -208,9 +211,7 @@ static void xlx_iom_realize(DeviceState *dev, Error **errp)
                 .prefix = s->prefix,
                 .opaque = s,
             };
-            memory_region_init_io(&r->mem, OBJECT(dev), &iom_uart_ops, r,
-                                  r->access->name, 4);
-            memory_region_add_subregion(&s->iomem[rmap], i * 4, &r->mem);
+            dep_register_block_add(&s->regs_block[rmap], r, i * 4);
         }
     }
 
@@ -232,8 +233,8 @@ static void xlx_iom_init(Object *obj)
     for (i = 0; i < ARRAY_SIZE(s->iomem); i++) {
         char *region_name = g_strdup_printf("%s-%d", TYPE_XILINX_IO_MODULE_UART,
                                             i);
-        memory_region_init_io(&s->iomem[i], obj, &iom_uart_ops, s,
-                              region_name, uart_reginfo_sizes[i] * 4);
+        memory_region_init(&s->iomem[i], obj, region_name,
+                           uart_reginfo_sizes[i] * 4);
         g_free(region_name);
         sysbus_init_mmio(sbd, &s->iomem[i]);
     }
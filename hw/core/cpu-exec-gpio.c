@@ -18,45 +18,20 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
-#include "qemu/timer.h"
 
 #include "cpu.h"
 #include "hw/core/cpu-exec-gpio.h"
 
 static bool cpu_exec_kick(CPUState *cpu)
 {
-    int32_t poll_pause = 10 * 1000;   /* both in usecs */
-    int64_t poll_stop  = 100 * 1000 + qemu_clock_get_us(QEMU_CLOCK_HOST);
-
-    bool rc = false;
-
     /* More of a hack, especially the need to mimic qemu_cpu_kick_thread() */
     if (tcg_enabled()) {
         cpu->thread_kicked = true;
     }
     qemu_cpu_kick(cpu);
 
-    /* Need to release iothread lock during polling */
-    qemu_mutex_unlock_iothread();
-
-    for (;;) {
-        if (cpu->thread_kicked == false) {
-            rc = true; /* Don't poll next time */
-            break;
-        }
-
-        if (qemu_clock_get_us(QEMU_CLOCK_HOST) >= poll_stop) {
-            atomic_mb_set(&cpu->thread_kicked, false);
-            rc = false;
-            break;
-        }
-
-        g_usleep(poll_pause);
-    }
-
-    qemu_mutex_lock_iothread();
-
-    return rc;
+    /* Sleeps on a condition, releasing the iothread lock meanwhile */
+    return qemu_cpu_kick_wait(cpu, 100);
 }
 
 static void cpu_exec_ack(CPUState *cpu, run_on_cpu_data arg)
@@ -66,7 +41,8 @@ static void cpu_exec_ack(CPUState *cpu, run_on_cpu_data arg)
 
 static void cpu_exec_pin_update(CPUState *cpu, bool reset_pin)
 {
-    bool val = reset_pin || cpu->halt_pin || cpu->arch_halt_pin;
+    bool val = reset_pin || cpu->halt_pin || cpu->arch_halt_pin ||
+               cpu->power_gated;
 
     if (val) {
         cpu_interrupt(cpu, CPU_INTERRUPT_HALT);
@@ -92,9 +68,9 @@ static void cpu_exec_pin_sync(CPUState *cpu, bool reset_pin)
      *    could lead to memory leak if the vCPU is indeed not
      *    ready to process async work.
      *
-     * The solution is to initially poll for kick acknowledge,
-     * and switching to use run_on_cpu() after vCPU can indeed
-     * acknowledge kicking.
+     * The solution is to initially wait for kick acknowledge,
+     * with a timeout, and switching to use run_on_cpu() after
+     * vCPU can indeed acknowledge kicking.
      */
     static uint64_t can_run_on_cpu;
 
@@ -0,0 +1,128 @@
+/*
+ * Shared deadline service for device timeouts
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "hw/deadline.h"
+
+/* Pending deadlines, sorted by expiry.  Devices do not keep many pending
+ * at once so a plain list is enough.
+ */
+static QLIST_HEAD(, Deadline) deadlines = QLIST_HEAD_INITIALIZER(deadlines);
+static QEMUTimer *deadline_timer;
+
+static void deadline_rearm(void)
+{
+    Deadline *first = QLIST_FIRST(&deadlines);
+
+    if (first) {
+        timer_mod_ns(deadline_timer, first->expire_ns);
+    } else {
+        timer_del(deadline_timer);
+    }
+}
+
+static void deadline_timer_hit(void *opaque)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    Deadline *d;
+
+    /* Callbacks may re-arm or delete any deadline, including their own,
+     * so pop one at a time.
+     */
+    while ((d = QLIST_FIRST(&deadlines)) && d->expire_ns <= now) {
+        QLIST_REMOVE(d, next);
+        d->expire_ns = -1;
+        d->cb(d->opaque);
+    }
+    deadline_rearm();
+}
+
+void deadline_init(Deadline *d, DeadlineCB *cb, void *opaque)
+{
+    if (!deadline_timer) {
+        deadline_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                      deadline_timer_hit, NULL);
+    }
+    d->cb = cb;
+    d->opaque = opaque;
+    d->expire_ns = -1;
+}
+
+void deadline_del(Deadline *d)
+{
+    bool was_first = QLIST_FIRST(&deadlines) == d;
+
+    if (!deadline_pending(d)) {
+        return;
+    }
+    QLIST_REMOVE(d, next);
+    d->expire_ns = -1;
+    if (was_first) {
+        deadline_rearm();
+    }
+}
+
+void deadline_mod_ns(Deadline *d, int64_t expire_ns)
+{
+    Deadline *it, *prev = NULL;
+
+    if (deadline_pending(d)) {
+        QLIST_REMOVE(d, next);
+    }
+    d->expire_ns = MAX(expire_ns, 0);
+
+    QLIST_FOREACH(it, &deadlines, next) {
+        if (it->expire_ns > d->expire_ns) {
+            break;
+        }
+        prev = it;
+    }
+    if (prev) {
+        QLIST_INSERT_AFTER(prev, d, next);
+    } else {
+        QLIST_INSERT_HEAD(&deadlines, d, next);
+    }
+    deadline_rearm();
+}
+
+void deadline_mod_delay_ns(Deadline *d, int64_t delay_ns)
+{
+    deadline_mod_ns(d, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay_ns);
+}
+
+static int deadline_pre_load(void *opaque)
+{
+    deadline_del(opaque);
+    return 0;
+}
+
+static int deadline_post_load(void *opaque, int version_id)
+{
+    Deadline *d = opaque;
+    int64_t expire_ns = d->expire_ns;
+
+    if (expire_ns >= 0) {
+        d->expire_ns = -1;
+        deadline_mod_ns(d, expire_ns);
+    }
+    return 0;
+}
+
+const VMStateDescription vmstate_deadline = {
+    .name = "deadline",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .pre_load = deadline_pre_load,
+    .post_load = deadline_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_INT64(expire_ns, Deadline),
+        VMSTATE_END_OF_LIST()
+    }
+};
@@ -28,6 +28,10 @@
 #include "hw/fdt_generic.h"
 #include "qemu/coroutine.h"
 #include "qemu/log.h"
+#include "hw/qdev-core.h"
+#include "qemu/cutils.h"
+
+#include <libfdt.h>
 
 #ifndef FDT_GENERIC_ERR_DEBUG
 #define FDT_GENERIC_ERR_DEBUG 0
@@ -39,29 +43,30 @@
     } \
 } while (0);
 
-#define FDT_GENERIC_MAX_PATTERN_LEN 1024
-
 typedef struct TableListNode {
-    void *next;
-    char key[FDT_GENERIC_MAX_PATTERN_LEN];
     FDTInitFn fdt_init;
     void *opaque;
 } TableListNode;
 
-/* add a node to the table specified by *head_p */
+/* add a node to the table specified by *table_p. Later registrations of
+ * the same key take precedence.
+ */
 
 static void add_to_table(
         FDTInitFn fdt_init,
         const char *key,
         void *opaque,
-        TableListNode **head_p)
+        GHashTable **table_p)
 {
-    TableListNode *nn = malloc(sizeof(*nn));
-    nn->next = (void *)(*head_p);
-    strcpy(nn->key, key);
+    TableListNode *nn = g_new0(TableListNode, 1);
+
+    if (!*table_p) {
+        *table_p = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                         g_free, g_free);
+    }
     nn->fdt_init = fdt_init;
     nn->opaque = opaque;
-    *head_p = nn;
+    g_hash_table_replace(*table_p, g_strdup(key), nn);
 }
 
 /* FIXME: add return codes that differentiate between not found and error */
@@ -74,62 +79,69 @@ static int fdt_init_search_table(
         char *node_path,
         FDTMachineInfo *fdti,
         const char *key, /* string to match */
-        TableListNode **head) /* head of the list to search */
+        GHashTable *table) /* table to search */
 {
-    TableListNode *c = *head;
-    if (c == NULL) {
+    TableListNode *c;
+
+    if (!table || !key) {
+        return 1;
+    }
+    c = g_hash_table_lookup(table, key);
+    if (!c) {
         return 1;
-    } else if (!strcmp(key, c->key)) {
-        return c->fdt_init ? c->fdt_init(node_path, fdti, c->opaque) : 0;
     }
-    return fdt_init_search_table(node_path, fdti, key,
-        (TableListNode **)(&(*head)->next));
+    return c->fdt_init ? c->fdt_init(node_path, fdti, c->opaque) : 0;
 }
 
-TableListNode *compat_list_head;
+static GHashTable *compat_table;
 
 void add_to_compat_table(FDTInitFn fdt_init, const char *compat, void *opaque)
 {
-    add_to_table(fdt_init, compat, opaque, &compat_list_head);
+    add_to_table(fdt_init, compat, opaque, &compat_table);
 }
 
 int fdt_init_compat(char *node_path, FDTMachineInfo *fdti, const char *compat)
 {
-    return fdt_init_search_table(node_path, fdti, compat, &compat_list_head);
+    return fdt_init_search_table(node_path, fdti, compat, compat_table);
 }
 
-TableListNode *inst_bind_list_head;
+static GHashTable *inst_bind_table;
 
 void add_to_inst_bind_table(FDTInitFn fdt_init, const char *name, void *opaque)
 {
-    add_to_table(fdt_init, name, opaque, &inst_bind_list_head);
+    add_to_table(fdt_init, name, opaque, &inst_bind_table);
 }
 
 int fdt_init_inst_bind(char *node_path, FDTMachineInfo *fdti,
         const char *name)
 {
-    return fdt_init_search_table(node_path, fdti, name, &inst_bind_list_head);
+    return fdt_init_search_table(node_path, fdti, name, inst_bind_table);
 }
 
-static void dump_table(TableListNode *head)
+static void dump_table_entry(gpointer key, gpointer value, gpointer opaque)
 {
-    if (head == NULL) {
-        return;
+    TableListNode *c = value;
+
+    printf("key : %s, opaque data %p\n", (char *)key, c->opaque);
+}
+
+static void dump_table(GHashTable *table)
+{
+    if (table) {
+        g_hash_table_foreach(table, dump_table_entry, NULL);
     }
-    printf("key : %s, opaque data %p\n", head->key, head->opaque);
-    dump_table(head->next);
 }
 
 void dump_compat_table(void)
 {
     printf("FDT COMPATIBILITY TABLE:\n");
-    dump_table(compat_list_head);
+    dump_table(compat_table);
 }
 
 void dump_inst_bind_table(void)
 {
     printf("FDT INSTANCE BINDING TABLE:\n");
-    dump_table(inst_bind_list_head);
+    dump_table(inst_bind_table);
 }
 
 void fdt_init_yield(FDTMachineInfo *fdti)
@@ -142,38 +154,174 @@ void fdt_init_yield(FDTMachineInfo *fdti)
     DB_PRINT(1, "Unyield #%d\n", this_yield);
 }
 
+static CoQueue *fdt_init_waiters(FDTMachineInfo *fdti, const char *node_path)
+{
+    CoQueue *q = g_hash_table_lookup(fdti->waiters, node_path);
+
+    if (!q) {
+        q = g_new(CoQueue, 1);
+        qemu_co_queue_init(q);
+        g_hash_table_insert(fdti->waiters, g_strdup(node_path), q);
+    }
+    return q;
+}
+
+/* Enter everything currently waiting on q. Waiters that go back to sleep
+ * are queued again but not re-entered.
+ */
+static void fdt_init_wake(CoQueue *q)
+{
+    CoQueue woken;
+
+    if (qemu_in_coroutine()) {
+        /* Runs the waiters once we yield or terminate.  */
+        qemu_co_queue_restart_all(q);
+        return;
+    }
+
+    qemu_co_queue_init(&woken);
+    QSIMPLEQ_CONCAT(&woken.entries, &q->entries);
+    while (qemu_co_enter_next(&woken));
+}
+
+void fdt_init_node_notify(FDTMachineInfo *fdti, const char *node_path)
+{
+    CoQueue *q = g_hash_table_lookup(fdti->waiters, node_path);
+
+    fdti->progress++;
+    if (q) {
+        fdt_init_wake(q);
+    }
+}
+
+void *fdt_init_wait_opaque(FDTMachineInfo *fdti, char *node_path)
+{
+    while (!fdt_init_has_opaque(fdti, node_path)) {
+        DB_PRINT(1, "Waiting for %s\n", node_path);
+        qemu_co_queue_wait(fdt_init_waiters(fdti, node_path), NULL);
+    }
+    return fdt_init_get_opaque(fdti, node_path);
+}
+
+void fdt_init_wait_realized(FDTMachineInfo *fdti, char *node_path,
+                            DeviceState *dev)
+{
+    while (!dev->realized) {
+        DB_PRINT(1, "Waiting for %s to realize\n", node_path);
+        qemu_co_queue_wait(fdt_init_waiters(fdti, node_path), NULL);
+    }
+}
+
+static void fdt_init_wake_all(gpointer key, gpointer value, gpointer opaque)
+{
+    fdt_init_wake(value);
+}
+
+bool fdt_init_run(FDTMachineInfo *fdti)
+{
+    unsigned int progress;
+    bool stuck;
+
+    do {
+        progress = fdti->progress;
+
+        /* Give every generic yielder one go.  */
+        fdt_init_wake(fdti->cq);
+
+        if (progress == fdti->progress) {
+            /* Dependencies may have changed state without notifying,
+             * e.g devices realized outside of the framework. Recheck.
+             */
+            g_hash_table_foreach(fdti->waiters, fdt_init_wake_all, NULL);
+        }
+    } while (progress != fdti->progress);
+
+    stuck = !qemu_co_queue_empty(fdti->cq);
+    if (!stuck) {
+        GHashTableIter iter;
+        gpointer key, value;
+
+        g_hash_table_iter_init(&iter, fdti->waiters);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            if (!qemu_co_queue_empty(value)) {
+                DB_PRINT(0, "Unresolved dependency on %s\n", (char *)key);
+                stuck = true;
+            }
+        }
+    }
+    return !stuck;
+}
+
 void fdt_init_set_opaque(FDTMachineInfo *fdti, char *node_path, void *opaque)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques;
-        dp->node_path && strcmp(dp->node_path, node_path);
-        dp++);
-    if (!dp->node_path) {
-        dp->node_path = strdup(node_path);
+    FDTDevOpaque *dp = g_hash_table_lookup(fdti->dev_opaques, node_path);
+
+    if (!dp) {
+        dp = g_new0(FDTDevOpaque, 1);
+        dp->node_path = g_strdup(node_path);
+        g_hash_table_insert(fdti->dev_opaques, dp->node_path, dp);
     }
     dp->opaque = opaque;
+    fdt_init_node_notify(fdti, node_path);
 }
 
 int fdt_init_has_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return 1;
-         }
-    }
-    return 0;
+    return g_hash_table_contains(fdti->dev_opaques, node_path);
 }
 
 void *fdt_init_get_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return dp->opaque;
+    FDTDevOpaque *dp = g_hash_table_lookup(fdti->dev_opaques, node_path);
+
+    return dp ? dp->opaque : NULL;
+}
+
+int fdt_init_get_node_by_phandle(FDTMachineInfo *fdti, char *node_path,
+                                 uint32_t phandle)
+{
+    const char *path = g_hash_table_lookup(fdti->phandles,
+                                           GUINT_TO_POINTER(phandle));
+    int ret;
+
+    if (path) {
+        pstrcpy(node_path, DT_PATH_LENGTH, path);
+        return 0;
+    }
+
+    /* Not indexed, the node may have been added after the DTB was loaded. */
+    ret = qemu_devtree_get_node_by_phandle(fdti->fdt, node_path, phandle);
+    if (!ret) {
+        g_hash_table_insert(fdti->phandles, GUINT_TO_POINTER(phandle),
+                            g_strdup(node_path));
+    }
+    return ret;
+}
+
+static void fdt_init_index_phandles(FDTMachineInfo *fdti)
+{
+    char node_path[DT_PATH_LENGTH];
+    int offset;
+
+    for (offset = fdt_next_node(fdti->fdt, -1, NULL); offset >= 0;
+         offset = fdt_next_node(fdti->fdt, offset, NULL)) {
+        uint32_t phandle = fdt_get_phandle(fdti->fdt, offset);
+
+        if (!phandle
+            || fdt_get_path(fdti->fdt, offset, node_path, DT_PATH_LENGTH)) {
+            continue;
         }
+        g_hash_table_insert(fdti->phandles, GUINT_TO_POINTER(phandle),
+                            g_strdup(node_path));
     }
-    return NULL;
+}
+
+static void fdt_dev_opaque_free(gpointer data)
+{
+    FDTDevOpaque *dp = data;
+
+    g_free(dp->node_path);
+    g_free(dp);
 }
 
 FDTMachineInfo *fdt_init_new_fdti(void *fdt)
@@ -182,17 +330,26 @@ FDTMachineInfo *fdt_init_new_fdti(void *fdt)
     fdti->fdt = fdt;
     fdti->cq = g_malloc0(sizeof(*(fdti->cq)));
     qemu_co_queue_init(fdti->cq);
-    fdti->dev_opaques = g_malloc0(sizeof(*(fdti->dev_opaques)) *
-        (devtree_get_num_nodes(fdt) + 1));
+    fdti->waiters = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, g_free);
+    /* The key is owned by the FDTDevOpaque.  */
+    fdti->dev_opaques = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                              NULL, fdt_dev_opaque_free);
+    fdti->phandles = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                           NULL, g_free);
+    fdt_init_index_phandles(fdti);
     return fdti;
 }
 
 void fdt_init_destroy_fdti(FDTMachineInfo *fdti)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        g_free(dp->node_path);
+    g_hash_table_destroy(fdti->dev_opaques);
+    g_hash_table_destroy(fdti->phandles);
+    g_hash_table_destroy(fdti->waiters);
+    if (fdti->plan) {
+        g_hash_table_destroy(fdti->plan);
     }
-    g_free(fdti->dev_opaques);
+    g_free(fdti->plan_hash);
+    g_free(fdti->cq);
     g_free(fdti);
 }
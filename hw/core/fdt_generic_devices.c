@@ -55,15 +55,10 @@ static int i2c_bus_fdt_init(char *node_path, FDTMachineInfo *fdti, void *priv)
     if (qemu_devtree_getparent(fdti->fdt, parent_node_path, node_path)) {
         abort();
     }
-    while (!fdt_init_has_opaque(fdti, parent_node_path)) {
-        fdt_init_yield(fdti);
-    }
-    parent = fdt_init_get_opaque(fdti, parent_node_path);
+    parent = fdt_init_wait_opaque(fdti, parent_node_path);
     dev = (DeviceState *)object_dynamic_cast(parent, TYPE_DEVICE);
     if (parent && dev) {
-        while (!dev->realized) {
-            fdt_init_yield(fdti);
-        }
+        fdt_init_wait_realized(fdti, parent_node_path, dev);
         DB_PRINT_NP(0, "parenting i2c bus to %s bus %s\n", parent_node_path,
                  node_name);
         fdt_init_set_opaque(fdti, node_path,
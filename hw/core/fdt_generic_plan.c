@@ -0,0 +1,224 @@
+/*
+ * FDT generic machine plans. Cache how the nodes of a device tree were
+ * bound to device models so that later runs can skip the matching.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/fdt_generic.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "qemu/error-report.h"
+
+#include <libfdt.h>
+
+#ifndef FDT_GENERIC_ERR_DEBUG
+#define FDT_GENERIC_ERR_DEBUG 0
+#endif
+#define DB_PRINT(lvl, ...) do { \
+    if (FDT_GENERIC_ERR_DEBUG > (lvl)) { \
+        qemu_log_mask(LOG_FDT, ": %s: ", __func__); \
+        qemu_log_mask(LOG_FDT, ## __VA_ARGS__); \
+    } \
+} while (0);
+
+/*
+ * File layout, all integers big endian:
+ *   magic[8], nr_entries (u32)
+ *   nr_entries times: kind (u8), path_len (u16), arg_len (u16), path, arg
+ */
+#define FDT_PLAN_MAGIC "FDTPLAN1"
+
+static void fdt_plan_entry_free(gpointer data)
+{
+    FDTPlanEntry *e = data;
+
+    g_free(e->arg);
+    g_free(e);
+}
+
+static char *fdt_plan_file(FDTMachineInfo *fdti, const char *dir)
+{
+    char *name = g_strdup_printf("%s.plan", fdti->plan_hash);
+    char *file = g_build_filename(dir, name, NULL);
+
+    g_free(name);
+    return file;
+}
+
+/* Plans are only valid for the exact same DTB and QEMU build.  */
+static char *fdt_plan_hash(void *fdt)
+{
+    GChecksum *cs = g_checksum_new(G_CHECKSUM_SHA256);
+    char *hash;
+
+    g_checksum_update(cs, (const guchar *)QEMU_VERSION, strlen(QEMU_VERSION));
+    g_checksum_update(cs, fdt, fdt_totalsize(fdt));
+    hash = g_strdup(g_checksum_get_string(cs));
+    g_checksum_free(cs);
+    return hash;
+}
+
+static bool fdt_plan_parse(FDTMachineInfo *fdti, const uint8_t *p,
+                           size_t len)
+{
+    const uint8_t *end = p + len;
+    uint32_t nr, i;
+
+    if (len < sizeof FDT_PLAN_MAGIC - 1 + 4
+        || memcmp(p, FDT_PLAN_MAGIC, sizeof FDT_PLAN_MAGIC - 1)) {
+        return false;
+    }
+    p += sizeof FDT_PLAN_MAGIC - 1;
+    nr = ldl_be_p(p);
+    p += 4;
+
+    for (i = 0; i < nr; i++) {
+        FDTPlanEntry *e;
+        uint16_t path_len, arg_len;
+        uint8_t kind;
+
+        if (end - p < 5) {
+            return false;
+        }
+        kind = *p;
+        path_len = lduw_be_p(p + 1);
+        arg_len = lduw_be_p(p + 3);
+        p += 5;
+        if (kind > FDT_PLAN_QDEV || end - p < path_len + arg_len) {
+            return false;
+        }
+
+        e = g_new0(FDTPlanEntry, 1);
+        e->kind = kind;
+        e->arg = arg_len ? g_strndup((const char *)p + path_len, arg_len)
+                         : NULL;
+        g_hash_table_insert(fdti->plan, g_strndup((const char *)p, path_len),
+                            e);
+        p += path_len + arg_len;
+    }
+    return true;
+}
+
+bool fdt_plan_load(FDTMachineInfo *fdti, const char *dir)
+{
+    char *file;
+    gchar *buf;
+    gsize len;
+
+    fdti->plan = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       g_free, fdt_plan_entry_free);
+    fdti->plan_hash = fdt_plan_hash(fdti->fdt);
+    fdti->plan_loaded = false;
+
+    file = fdt_plan_file(fdti, dir);
+    if (g_file_get_contents(file, &buf, &len, NULL)) {
+        fdti->plan_loaded = fdt_plan_parse(fdti, (uint8_t *)buf, len);
+        if (!fdti->plan_loaded) {
+            warn_report("FDT: ignoring corrupt machine plan %s", file);
+            g_hash_table_remove_all(fdti->plan);
+        }
+        g_free(buf);
+    }
+    DB_PRINT(0, "%s plan %s\n", fdti->plan_loaded ? "using" : "recording",
+             file);
+    g_free(file);
+    return fdti->plan_loaded;
+}
+
+void fdt_plan_save(FDTMachineInfo *fdti, const char *dir)
+{
+    GByteArray *out;
+    GHashTableIter iter;
+    gpointer key, value;
+    char *file, *tmp;
+    uint8_t b[5];
+    GError *err = NULL;
+
+    if (!fdti->plan || fdti->plan_loaded) {
+        return;
+    }
+
+    out = g_byte_array_new();
+    g_byte_array_append(out, (const guint8 *)FDT_PLAN_MAGIC,
+                        sizeof FDT_PLAN_MAGIC - 1);
+    stl_be_p(b, g_hash_table_size(fdti->plan));
+    g_byte_array_append(out, b, 4);
+
+    g_hash_table_iter_init(&iter, fdti->plan);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        FDTPlanEntry *e = value;
+        size_t path_len = strlen(key);
+        size_t arg_len = e->arg ? strlen(e->arg) : 0;
+
+        b[0] = e->kind;
+        stw_be_p(b + 1, path_len);
+        stw_be_p(b + 3, arg_len);
+        g_byte_array_append(out, b, 5);
+        g_byte_array_append(out, key, path_len);
+        if (arg_len) {
+            g_byte_array_append(out, (const guint8 *)e->arg, arg_len);
+        }
+    }
+
+    /* Write and rename so concurrent instances never see partial plans.  */
+    g_mkdir_with_parents(dir, 0755);
+    file = fdt_plan_file(fdti, dir);
+    tmp = g_strdup_printf("%s.%d", file, getpid());
+    if (!g_file_set_contents(tmp, (const gchar *)out->data, out->len, &err)
+        || rename(tmp, file)) {
+        warn_report("FDT: unable to save machine plan %s: %s", file,
+                    err ? err->message : strerror(errno));
+        unlink(tmp);
+    }
+    if (err) {
+        g_error_free(err);
+    }
+
+    g_free(tmp);
+    g_free(file);
+    g_byte_array_free(out, true);
+}
+
+const FDTPlanEntry *fdt_plan_lookup(FDTMachineInfo *fdti,
+                                    const char *node_path)
+{
+    if (!fdti->plan_loaded) {
+        return NULL;
+    }
+    return g_hash_table_lookup(fdti->plan, node_path);
+}
+
+void fdt_plan_record(FDTMachineInfo *fdti, const char *node_path,
+                     FDTPlanKind kind, const char *arg)
+{
+    FDTPlanEntry *e;
+
+    if (!fdti->plan || fdti->plan_loaded) {
+        return;
+    }
+
+    e = g_new0(FDTPlanEntry, 1);
+    e->kind = kind;
+    e->arg = g_strdup(arg);
+    g_hash_table_replace(fdti->plan, g_strdup(node_path), e);
+}
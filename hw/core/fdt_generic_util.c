@@ -181,17 +181,34 @@ FDTMachineInfo *fdt_generic_create_machine(void *fdt, qemu_irq *cpu_irq)
     char node_path[DT_PATH_LENGTH];
     QemuOpts *opts = qemu_opts_find(qemu_find_opts("smp-opts"), NULL);
     FDTMachineInfo *fdti = fdt_init_new_fdti(fdt);
+    char *plan_dir;
 
     fdti->irq_base = cpu_irq;
 
     fdt_serial_ports = 0;
 
+    plan_dir = object_property_get_str(OBJECT(qdev_get_machine()),
+                                        "fdt-plan-cache", NULL);
+    if (plan_dir && !*plan_dir) {
+        g_free(plan_dir);
+        plan_dir = NULL;
+    }
+    if (plan_dir) {
+        fdt_plan_load(fdti, plan_dir);
+    }
+
     /* parse the device tree */
     if (!qemu_devtree_get_root_node(fdt, node_path)) {
         memory_region_transaction_begin();
         fdt_init_set_opaque(fdti, node_path, NULL);
         simple_bus_fdt_init(node_path, fdti);
-        while (qemu_co_enter_next(fdti->cq));
+        if (!fdt_init_run(fdti)) {
+            error_report("FDT: unresolved dependencies between nodes");
+            exit(1);
+        }
+        if (plan_dir) {
+            fdt_plan_save(fdti, plan_dir);
+        }
         fdt_init_all_irqs(fdti);
         memory_region_transaction_commit();
     } else {
@@ -199,6 +216,7 @@ FDTMachineInfo *fdt_generic_create_machine(void *fdt, qemu_irq *cpu_irq)
             , node_path);
     }
 
+    g_free(plan_dir);
     bdrv_drain_all();
     DB_PRINT(0, "FDT: Device tree scan complete\n");
 
@@ -219,6 +237,32 @@ struct FDTInitNodeArgs {
 };
 
 static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat);
+static int fdt_init_qdev_type(char *node_path, FDTMachineInfo *fdti,
+                              const char *type);
+
+/* Bind a node the way the plan says. Returns non-zero if that failed and
+ * the node needs the full matching.
+ */
+static int fdt_init_node_from_plan(char *node_path, FDTMachineInfo *fdti,
+                                   const FDTPlanEntry *plan, char *node_name)
+{
+    switch (plan->kind) {
+    case FDT_PLAN_INST_BIND:
+        return fdt_init_inst_bind(node_path, fdti, node_name);
+    case FDT_PLAN_COMPAT:
+        return fdt_init_compat(node_path, fdti, plan->arg);
+    case FDT_PLAN_QDEV:
+        return fdt_init_qdev_type(node_path, fdti, plan->arg);
+    case FDT_PLAN_NONE:
+        if (qemu_fdt_getprop(fdti->fdt, node_path, "compatible", NULL,
+                             false, NULL)) {
+            qemu_fdt_setprop_string(fdti->fdt, node_path, "compatible",
+                                    "invalidated");
+        }
+        return 0;
+    }
+    return 1;
+}
 
 static void fdt_init_node(void *args)
 {
@@ -231,6 +275,7 @@ static void fdt_init_node(void *args)
 
     char *all_compats = NULL, *compat, *node_name, *next_compat;
     char *device_type = NULL;
+    const FDTPlanEntry *plan;
     int compat_len;
 
     DB_PRINT_NP(1, "enter\n");
@@ -241,8 +286,16 @@ static void fdt_init_node(void *args)
     if (!node_name) {
         printf("FDT: ERROR: nameless node: %s\n", node_path);
     }
+
+    plan = fdt_plan_lookup(fdti, node_path);
+    if (plan && !fdt_init_node_from_plan(node_path, fdti, plan, node_name)) {
+        DB_PRINT_NP(1, "bound from plan\n");
+        goto exit;
+    }
+
     if (!fdt_init_inst_bind(node_path, fdti, node_name)) {
         DB_PRINT_NP(0, "instance bind successful\n");
+        fdt_plan_record(fdti, node_path, FDT_PLAN_INST_BIND, NULL);
         goto exit;
     }
 
@@ -256,6 +309,9 @@ static void fdt_init_node(void *args)
     for (compat = all_compats; compat && compat_len; compat = next_compat+1) {
         char *compat_prefixed = g_strdup_printf("compatible:%s", compat);
         if (!fdt_init_compat(node_path, fdti, compat_prefixed)) {
+            fdt_plan_record(fdti, node_path, FDT_PLAN_COMPAT,
+                            compat_prefixed);
+            g_free(compat_prefixed);
             goto exit;
         }
         g_free(compat_prefixed);
@@ -273,6 +329,7 @@ static void fdt_init_node(void *args)
                                    "device_type", NULL, false, NULL);
     device_type = g_strdup_printf("device_type:%s", device_type);
     if (!fdt_init_compat(node_path, fdti, device_type)) {
+        fdt_plan_record(fdti, node_path, FDT_PLAN_COMPAT, device_type);
         goto exit;
     }
 
@@ -284,6 +341,7 @@ static void fdt_init_node(void *args)
         goto exit;
     }
 
+    fdt_plan_record(fdti, node_path, FDT_PLAN_NONE, NULL);
     if (!all_compats) {
         goto exit;
     }
@@ -297,6 +355,7 @@ exit:
     if (!fdt_init_has_opaque(fdti, node_path)) {
         fdt_init_set_opaque(fdti, node_path, NULL);
     }
+    fdt_init_node_notify(fdti, node_path);
     g_free(node_path);
     g_free(all_compats);
     g_free(device_type);
@@ -321,7 +380,8 @@ static int simple_bus_fdt_init(char *node_path, FDTMachineInfo *fdti)
         struct FDTInitNodeArgs *init_args = g_malloc0(sizeof(*init_args));
         init_args->node_path = children[i];
         init_args->fdti = fdti;
-        qemu_coroutine_enter(qemu_coroutine_create(fdt_init_node, init_args));
+        qemu_coroutine_enter(qemu_coroutine_create_small_stack(fdt_init_node,
+                                                               init_args));
     }
 
     g_free(children);
@@ -354,8 +414,8 @@ static qemu_irq fdt_get_gpio(FDTMachineInfo *fdti, char *node_path,
         free_reason = true;
         goto fail_silent;
     }
-    if (qemu_devtree_get_node_by_phandle(fdt, parent_node_path,
-                                         parent_phandle)) {
+    if (fdt_init_get_node_by_phandle(fdti, parent_node_path,
+                                     parent_phandle)) {
         *end = true;
         reason = "cant get node from phandle\n";
         goto fail;
@@ -381,19 +441,14 @@ static qemu_irq fdt_get_gpio(FDTMachineInfo *fdti, char *node_path,
         }
     }
 
-    while (!fdt_init_has_opaque(fdti, parent_node_path)) {
-        fdt_init_yield(fdti);
-    }
-    parent = DEVICE(fdt_init_get_opaque(fdti, parent_node_path));
+    parent = DEVICE(fdt_init_wait_opaque(fdti, parent_node_path));
 
     if (!parent) {
         reason = "parent is not a device";
         goto fail_silent;
     }
 
-    while (!parent->realized) {
-        fdt_init_yield(fdti);
-    }
+    fdt_init_wait_realized(fdti, parent_node_path, parent);
 
     {
         const FDTGenericGPIOConnection *fgg_con = NULL;
@@ -509,18 +564,13 @@ static void fdt_get_irq_info_from_intc(FDTMachineInfo *fdti, qemu_irq *ret,
     FDTGenericIntcClass *intc_fdt_class;
     DeviceState *intc;
 
-    while (!fdt_init_has_opaque(fdti, intc_node_path)) {
-        fdt_init_yield(fdti);
-    }
-    intc = DEVICE(fdt_init_get_opaque(fdti, intc_node_path));
+    intc = DEVICE(fdt_init_wait_opaque(fdti, intc_node_path));
 
     if (!intc) {
         goto fail;
     }
 
-    while (!intc->realized) {
-        fdt_init_yield(fdti);
-    }
+    fdt_init_wait_realized(fdti, intc_node_path, intc);
 
     intc_fdt_class = FDT_GENERIC_INTC_GET_CLASS(intc);
     if (!intc_fdt_class) {
@@ -555,8 +605,8 @@ qemu_irq *fdt_get_irq_info(FDTMachineInfo *fdti, char *node_path, int irq_idx,
                                            "#interrupt-cells", 0, true, &errp);
         *map_mode = true;
     } else {
-        if (qemu_devtree_get_node_by_phandle(fdt, intc_node_path,
-                                             intc_phandle)) {
+        if (fdt_init_get_node_by_phandle(fdti, intc_node_path,
+                                         intc_phandle)) {
             goto fail;
         }
 
@@ -671,8 +721,8 @@ qemu_irq *fdt_get_irq_info(FDTMachineInfo *fdti, char *node_path, int irq_idx,
             if (intc_phandle & (0xffu << 24)) {
                 new_intc_cells = (intc_phandle >> 24) - 1;
             } else {
-                if (qemu_devtree_get_node_by_phandle(fdt, intc_node_path,
-                                                     intc_phandle)) {
+                if (fdt_init_get_node_by_phandle(fdti, intc_node_path,
+                                                 intc_phandle)) {
                     goto fail;
                 }
                 new_intc_cells = qemu_fdt_getprop_cell(fdt, intc_node_path,
@@ -691,9 +741,9 @@ qemu_irq *fdt_get_irq_info(FDTMachineInfo *fdti, char *node_path, int irq_idx,
                 num_matches++;
                 ret = g_renew(qemu_irq, ret, num_matches + 1);
                 if (intc_phandle & (0xffu << 24)) {
-                    if (qemu_devtree_get_node_by_phandle(fdt, intc_node_path,
-                                                         intc_phandle &
-                                                         ((1 << 24) - 1))) {
+                    if (fdt_init_get_node_by_phandle(fdti, intc_node_path,
+                                                     intc_phandle &
+                                                     ((1 << 24) - 1))) {
                         goto fail;
                     }
                 }
@@ -902,50 +952,82 @@ static void fdt_attach_drive(FDTMachineInfo *fdti, char *node_path,
     return;
 }
 
-static Object *fdt_create_from_compat(const char *compat, char **dev_type)
+static bool fdt_type_exists(const char *name)
+{
+    return object_class_by_name(name) != NULL;
+}
+
+/* Map a compatible string onto a QOM type name by trying the mangled
+ * forms in turn. Returns NULL if nothing matches.
+ */
+static char *fdt_resolve_compat_uncached(const char *compat)
 {
-    Object *ret = NULL;
     char *c = g_strdup(compat);
+    const char *no_vendor;
 
-    /* Try to create the object */
-    ret = object_new(c);
+    if (fdt_type_exists(c)) {
+        return c;
+    }
 
-    if (!ret) {
-        /* Trim the version off the end and try again */
-        trim_version(c);
-        ret = object_new(c);
+    /* Trim the version off the end and try again */
+    trim_version(c);
+    if (fdt_type_exists(c)) {
+        return c;
+    }
 
-        if (!ret) {
-            /* Replace commas with full stops */
-            substitute_char(c, ',', '.');
-            ret = object_new(c);
-        }
+    /* Replace commas with full stops */
+    substitute_char(c, ',', '.');
+    if (fdt_type_exists(c)) {
+        return c;
     }
 
-    if (!ret) {
-        /* Restart with the orginal string and now replace commas with full stops
-         * and try again. This means that versions are still included.
-         */
-        g_free(c);
-        c = g_strdup(compat);
-        substitute_char(c, ',', '.');
-        ret = object_new(c);
+    /* Restart with the orginal string and now replace commas with full stops
+     * and try again. This means that versions are still included.
+     */
+    g_free(c);
+    c = g_strdup(compat);
+    substitute_char(c, ',', '.');
+    if (fdt_type_exists(c)) {
+        return c;
     }
+    g_free(c);
 
-    if (dev_type) {
-        *dev_type = c;
-    } else {
-        g_free(c);
+    no_vendor = trim_vendor(compat);
+    if (no_vendor != compat) {
+        return fdt_resolve_compat_uncached(no_vendor);
     }
+    return NULL;
+}
 
-    if (!ret) {
-        const char *no_vendor = trim_vendor(compat);
+/* The same compatibles show up over and over in large trees and the set of
+ * types is fixed by the time machines get created, so remember the answers,
+ * including misses.
+ */
+static const char *fdt_resolve_compat(const char *compat)
+{
+    static GHashTable *compat_types;
+    gpointer type;
 
-        if (no_vendor != compat) {
-            return fdt_create_from_compat(no_vendor, dev_type);
-        }
+    if (!compat_types) {
+        compat_types = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                             g_free, g_free);
     }
-    return ret;
+
+    if (!g_hash_table_lookup_extended(compat_types, compat, NULL, &type)) {
+        type = fdt_resolve_compat_uncached(compat);
+        g_hash_table_insert(compat_types, g_strdup(compat), type);
+    }
+    return type;
+}
+
+static Object *fdt_create_from_compat(const char *compat, char **dev_type)
+{
+    const char *type = fdt_resolve_compat(compat);
+
+    if (dev_type) {
+        *dev_type = g_strdup(type);
+    }
+    return type ? object_new(type) : NULL;
 }
 
 /*FIXME: roll into device tree functionality */
@@ -1012,17 +1094,13 @@ static void fdt_dev_error(FDTMachineInfo *fdti, char *node_path, char *compat)
     }
 }
 
+static int fdt_init_qdev_common(char *node_path, FDTMachineInfo *fdti,
+                                Object *dev, char *dev_type);
+
 static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
 {
-    Object *dev, *parent;
+    Object *dev;
     char *dev_type = NULL;
-    int is_intc;
-    Error *errp = NULL;
-    int i, j;
-    QEMUDevtreeProp *prop, *props;
-    char parent_node_path[DT_PATH_LENGTH];
-    const FDTGenericGPIOSet *gpio_set = NULL;
-    FDTGenericGPIOClass *fggc = NULL;
 
     if (!compat) {
         return 1;
@@ -1031,23 +1109,94 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
     if (!dev) {
         DB_PRINT_NP(1, "no match found for %s\n", compat);
         fdt_dev_error(fdti, node_path, compat);
+        g_free(dev_type);
         return 1;
     }
     DB_PRINT_NP(1, "matched compat %s\n", compat);
+    fdt_plan_record(fdti, node_path, FDT_PLAN_QDEV, object_get_typename(dev));
+
+    return fdt_init_qdev_common(node_path, fdti, dev, dev_type);
+}
+
+/* Create the device from an already resolved QOM type.  */
+static int fdt_init_qdev_type(char *node_path, FDTMachineInfo *fdti,
+                              const char *type)
+{
+    Object *dev = object_new(type);
+
+    if (!dev) {
+        return 1;
+    }
+    return fdt_init_qdev_common(node_path, fdti, dev, g_strdup(type));
+}
+
+/*
+ * Place a CPU: numa-node-id gives its guest NUMA node, qemu,host-cpus of
+ * its node or cluster the host CPUs its thread is pinned to.
+ */
+static void fdt_init_cpu_placement(FDTMachineInfo *fdti, char *node_path,
+                                   CPUState *cpu)
+{
+    unsigned long *host_cpus;
+    uint32_t *cells;
+    Error *err = NULL;
+    uint32_t node_id;
+    int len, i;
+
+    node_id = qemu_fdt_getprop_cell(fdti->fdt, node_path, "numa-node-id", 0,
+                                    true, &err);
+    if (err) {
+        error_free(err);
+    } else if (object_property_find(OBJECT(cpu), "node-id", NULL)) {
+        object_property_set_int(OBJECT(cpu), node_id, "node-id",
+                                &error_abort);
+    }
+
+    cells = qemu_fdt_getprop(fdti->fdt, node_path, "qemu,host-cpus", &len,
+                             true, NULL);
+    if (!cells) {
+        return;
+    }
+
+    host_cpus = bitmap_new(CPU_HOST_CPUS_MAX);
+    for (i = 0; i < len / 4; i++) {
+        uint32_t host_cpu = be32_to_cpu(cells[i]);
+
+        if (host_cpu >= CPU_HOST_CPUS_MAX) {
+            error_report("%s: host CPU %" PRIu32 " is out of range",
+                         node_path, host_cpu);
+            exit(1);
+        }
+        set_bit(host_cpu, host_cpus);
+    }
+    qemu_cpu_set_host_cpus(cpu, host_cpus);
+    g_free(host_cpus);
+    g_free(cells);
+}
+
+static int fdt_init_qdev_common(char *node_path, FDTMachineInfo *fdti,
+                                Object *dev, char *dev_type)
+{
+    Object *parent;
+    int is_intc;
+    Error *errp = NULL;
+    int i, j;
+    QEMUDevtreeProp *prop, *props;
+    char parent_node_path[DT_PATH_LENGTH];
+    const FDTGenericGPIOSet *gpio_set = NULL;
+    FDTGenericGPIOClass *fggc = NULL;
 
     /* Do this super early so fdt_generic_num_cpus is correct ASAP */
     if (object_dynamic_cast(dev, TYPE_CPU)) {
         fdt_generic_num_cpus++;
         DB_PRINT_NP(0, "is a CPU - total so far %d\n", fdt_generic_num_cpus);
+        fdt_init_cpu_placement(fdti, node_path, CPU(dev));
     }
 
     if (qemu_devtree_getparent(fdti->fdt, parent_node_path, node_path)) {
         abort();
     }
-    while (!fdt_init_has_opaque(fdti, parent_node_path)) {
-        fdt_init_yield(fdti);
-    }
-    parent = fdt_init_get_opaque(fdti, parent_node_path);
+    parent = fdt_init_wait_opaque(fdti, parent_node_path);
     if (dev->parent) {
         DB_PRINT_NP(0, "Node already parented - skipping node\n");
     } else if (parent) {
@@ -1173,14 +1322,11 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
 
             Object *linked_dev, *proxy;
 
-            if (qemu_devtree_get_node_by_phandle(fdti->fdt, target_node_path,
-                                                get_int_be(val, len))) {
+            if (fdt_init_get_node_by_phandle(fdti, target_node_path,
+                                             get_int_be(val, len))) {
                 abort();
             }
-            while (!fdt_init_has_opaque(fdti, target_node_path)) {
-                fdt_init_yield(fdti);
-            }
-            linked_dev = fdt_init_get_opaque(fdti, target_node_path);
+            linked_dev = fdt_init_wait_opaque(fdti, target_node_path);
 
             proxy = linked_dev ? object_property_get_link(linked_dev,
                                                           propname_target,
@@ -1235,15 +1381,12 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
                             "property\n");
                 break;
             }
-            if (qemu_devtree_get_node_by_phandle(fdti->fdt, adaptor_node_path,
-                                                 adaptor_phandle)) {
+            if (fdt_init_get_node_by_phandle(fdti, adaptor_node_path,
+                                             adaptor_phandle)) {
                 DB_PRINT_NP(1, "cant get node from phandle\n");
                 break;
             }
-            while (!fdt_init_has_opaque(fdti, adaptor_node_path)) {
-                fdt_init_yield(fdti);
-            }
-            adaptor = DEVICE(fdt_init_get_opaque(fdti, adaptor_node_path));
+            adaptor = DEVICE(fdt_init_wait_opaque(fdti, adaptor_node_path));
             name = g_strdup_printf("rp-adaptor%" PRId32, i);
             object_property_set_link(OBJECT(dev), OBJECT(adaptor), name, &errp);
             DB_PRINT_NP(0, "connecting RP to adaptor %s channel %d",
@@ -1335,6 +1478,7 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
         (DEVICE(dev))->id = g_strdup(short_name);
         qdev_init_nofail(DEVICE(dev));
         qemu_register_reset((void (*)(void *))dc->reset, dev);
+        fdt_init_node_notify(fdti, node_path);
     }
 
     if (object_dynamic_cast(dev, TYPE_SYS_BUS_DEVICE) || 
@@ -1369,14 +1513,11 @@ static int fdt_init_qdev(char *node_path, FDTMachineInfo *fdti, char *compat)
                     errp = NULL;
                     goto exit_reg_parse;
                 }
-                if (qemu_devtree_get_node_by_phandle(fdti->fdt, ph_parent,
-                                                     p_ph)) {
+                if (fdt_init_get_node_by_phandle(fdti, ph_parent,
+                                                 p_ph)) {
                     goto exit_reg_parse;
                 }
-                while (!fdt_init_has_opaque(fdti, ph_parent)) {
-                    fdt_init_yield(fdti);
-                }
-                reg.parents[reg.n] = fdt_init_get_opaque(fdti, ph_parent);
+                reg.parents[reg.n] = fdt_init_wait_opaque(fdti, ph_parent);
                 pnp = ph_parent;
             }
 
@@ -0,0 +1,248 @@
+/*
+ * IRQ line statistics
+ *
+ * Counts the updates and level changes of every qemu_irq, along with
+ * where they came from, to track down interrupt storms.  Optionally
+ * rate limits the toggles of each line.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qmp-commands.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/log.h"
+#include "hw/irq.h"
+
+#define IRQ_STATS_CALLERS 4
+
+typedef struct IRQStats {
+    /* NULL once the line went away.  */
+    qemu_irq irq;
+    /* QOM path of the line, looked up when first reported.  */
+    char *path;
+    int level;
+    uint64_t updates;
+    uint64_t toggles;
+    uint64_t suppressed;
+    int64_t window_start;
+    uint64_t window_toggles;
+    uint64_t rate;
+    uint64_t max_rate;
+    bool storm_logged;
+    struct {
+        uintptr_t pc;
+        uint64_t count;
+    } callers[IRQ_STATS_CALLERS];
+} IRQStats;
+
+bool irq_stats_enabled;
+
+/* Lines may be updated from any thread.  Protects everything below.  */
+static QemuSpin irq_stats_lock;
+static GPtrArray *irq_stats;
+static uint64_t irq_stats_rate_limit;
+
+static void irq_stats_free(gpointer data)
+{
+    IRQStats *st = data;
+
+    if (st->irq) {
+        st->irq->stats = NULL;
+    }
+    g_free(st->path);
+    g_free(st);
+}
+
+static void irq_stats_note_caller(IRQStats *st, void *caller)
+{
+    int i;
+
+    for (i = 0; i < IRQ_STATS_CALLERS; i++) {
+        if (!st->callers[i].pc) {
+            st->callers[i].pc = (uintptr_t)caller;
+        }
+        if (st->callers[i].pc == (uintptr_t)caller) {
+            st->callers[i].count++;
+            return;
+        }
+    }
+}
+
+bool irq_stats_account(qemu_irq irq, int level, void *caller)
+{
+    IRQStats *st;
+    int64_t now;
+    bool deliver = true;
+
+    qemu_spin_lock(&irq_stats_lock);
+    if (!irq_stats) {
+        /* Stopped meanwhile.  */
+        goto out;
+    }
+
+    st = irq->stats;
+    if (!st) {
+        st = g_new0(IRQStats, 1);
+        st->irq = irq;
+        /* Lines start out low.  */
+        st->window_start = get_clock_realtime();
+        irq->stats = st;
+        g_ptr_array_add(irq_stats, st);
+    }
+
+    st->updates++;
+    irq_stats_note_caller(st, caller);
+    if (!!level == st->level) {
+        goto out;
+    }
+
+    /* Toggles are counted per second of host time, storms burn host CPU
+     * whatever the guest clock does.
+     */
+    now = get_clock_realtime();
+    if (now - st->window_start >= NANOSECONDS_PER_SECOND) {
+        st->rate = st->window_toggles;
+        st->window_toggles = 0;
+        st->window_start = now;
+    }
+
+    if (irq_stats_rate_limit && st->window_toggles >= irq_stats_rate_limit) {
+        st->suppressed++;
+        deliver = false;
+        if (!st->storm_logged) {
+            st->storm_logged = true;
+            qemu_log_mask(LOG_GUEST_ERROR, "irq %p: over %" PRIu64
+                          " toggles/s, dropping toggles\n", irq,
+                          irq_stats_rate_limit);
+        }
+        goto out;
+    }
+
+    st->toggles++;
+    st->window_toggles++;
+    st->max_rate = MAX(st->max_rate, MAX(st->rate, st->window_toggles));
+    st->level = !!level;
+out:
+    qemu_spin_unlock(&irq_stats_lock);
+    return deliver;
+}
+
+void irq_stats_release(qemu_irq irq)
+{
+    qemu_spin_lock(&irq_stats_lock);
+    if (irq->stats) {
+        /* The line is unparented by now, keep whatever path we had.  */
+        irq->stats->irq = NULL;
+        irq->stats = NULL;
+    }
+    qemu_spin_unlock(&irq_stats_lock);
+}
+
+void qmp_irq_stats_start(bool has_rate_limit, uint64_t rate_limit,
+                         Error **errp)
+{
+    qemu_spin_lock(&irq_stats_lock);
+    if (irq_stats) {
+        g_ptr_array_free(irq_stats, true);
+    }
+    irq_stats = g_ptr_array_new_with_free_func(irq_stats_free);
+    irq_stats_rate_limit = has_rate_limit ? rate_limit : 0;
+    atomic_set(&irq_stats_enabled, true);
+    qemu_spin_unlock(&irq_stats_lock);
+}
+
+void qmp_irq_stats_stop(Error **errp)
+{
+    atomic_set(&irq_stats_enabled, false);
+    qemu_spin_lock(&irq_stats_lock);
+    irq_stats_rate_limit = 0;
+    qemu_spin_unlock(&irq_stats_lock);
+}
+
+static IrqStatsEntry *irq_stats_entry(IRQStats *st)
+{
+    IrqStatsEntry *e = g_new0(IrqStatsEntry, 1);
+    IrqStatsCallerList **tail = &e->callers;
+    int i;
+
+    e->has_path = st->path != NULL;
+    e->path = g_strdup(st->path);
+    e->updates = st->updates;
+    e->toggles = st->toggles;
+    e->suppressed = st->suppressed;
+    e->rate = st->rate;
+    e->max_rate = st->max_rate;
+
+    for (i = 0; i < IRQ_STATS_CALLERS && st->callers[i].pc; i++) {
+        IrqStatsCallerList *c = g_new0(IrqStatsCallerList, 1);
+
+        c->value = g_new0(IrqStatsCaller, 1);
+        c->value->pc = st->callers[i].pc;
+        c->value->count = st->callers[i].count;
+        *tail = c;
+        tail = &c->next;
+    }
+    return e;
+}
+
+static gint irq_stats_compare(gconstpointer a, gconstpointer b)
+{
+    const IRQStats *sa = a, *sb = b;
+
+    if (sa->toggles == sb->toggles) {
+        return 0;
+    }
+    return sa->toggles > sb->toggles ? -1 : 1;
+}
+
+IrqStatsInfo *qmp_query_irq_stats(Error **errp)
+{
+    IrqStatsInfo *info = g_new0(IrqStatsInfo, 1);
+    IrqStatsEntryList **tail = &info->entries;
+    GSList *all = NULL, *l;
+    guint i;
+
+    info->enabled = atomic_read(&irq_stats_enabled);
+
+    /* Lines are only finalized and statistics only freed under the BQL,
+     * so they stay around while the lock is dropped for the QOM lookups.
+     */
+    qemu_spin_lock(&irq_stats_lock);
+    info->rate_limit = irq_stats_rate_limit;
+    for (i = 0; irq_stats && i < irq_stats->len; i++) {
+        all = g_slist_prepend(all, g_ptr_array_index(irq_stats, i));
+    }
+    qemu_spin_unlock(&irq_stats_lock);
+
+    for (l = all; l; l = l->next) {
+        IRQStats *st = l->data;
+
+        if (st->irq && !st->path && OBJECT(st->irq)->parent) {
+            st->path = object_get_canonical_path(OBJECT(st->irq));
+        }
+    }
+
+    /* Snapshot the counters.  */
+    qemu_spin_lock(&irq_stats_lock);
+    for (l = all; l; l = l->next) {
+        l->data = g_memdup(l->data, sizeof(IRQStats));
+    }
+    qemu_spin_unlock(&irq_stats_lock);
+
+    all = g_slist_sort(all, irq_stats_compare);
+    for (l = all; l; l = l->next) {
+        IrqStatsEntryList *e = g_new0(IrqStatsEntryList, 1);
+
+        e->value = irq_stats_entry(l->data);
+        *tail = e;
+        tail = &e->next;
+    }
+    g_slist_free_full(all, g_free);
+    return info;
+}
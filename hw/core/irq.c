@@ -34,6 +34,11 @@ void qemu_set_irq(qemu_irq irq, int level)
     if (!irq)
         return;
 
+    if (unlikely(atomic_read(&irq_stats_enabled)) &&
+        !irq_stats_account(irq, level, __builtin_return_address(0))) {
+        return;
+    }
+
     irq->handler(irq->opaque, irq->n, level);
 }
 
@@ -133,15 +138,22 @@ void qemu_irq_intercept_in(qemu_irq *gpio_in, qemu_irq_handler handler, int n)
     qemu_irq *old_irqs = qemu_allocate_irqs(NULL, NULL, n);
     for (i = 0; i < n; i++) {
         *old_irqs[i] = *gpio_in[i];
+        old_irqs[i]->stats = NULL;
         gpio_in[i]->handler = handler;
         gpio_in[i]->opaque = &old_irqs[i];
     }
 }
 
+static void irq_finalize(Object *obj)
+{
+    irq_stats_release(IRQ(obj));
+}
+
 static const TypeInfo irq_type_info = {
    .name = TYPE_IRQ,
    .parent = TYPE_OBJECT,
    .instance_size = sizeof(struct IRQState),
+   .instance_finalize = irq_finalize,
 };
 
 static void irq_register_types(void)
@@ -814,6 +814,8 @@ struct Rom {
     size_t datasize;
 
     uint8_t *data;
+    /* data is a private mapping of the file rather than a copy of it */
+    bool mapped;
     MemoryRegion *mr;
     AddressSpace *as;
     int isrom;
@@ -824,6 +826,9 @@ struct Rom {
     QTAILQ_ENTRY(Rom) next;
 };
 
+/* Files at least this large are mapped instead of read into a buffer */
+#define ROM_MAP_MIN_SIZE (1024 * 1024)
+
 static FWCfgState *fw_cfg;
 static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
 
@@ -864,6 +869,46 @@ static void rom_insert(Rom *rom)
     QTAILQ_INSERT_TAIL(&roms, rom, next);
 }
 
+static void rom_free_data(Rom *rom)
+{
+#ifndef _WIN32
+    if (rom->mapped) {
+        munmap(rom->data, rom->datasize);
+        rom->data = NULL;
+        return;
+    }
+#endif
+    g_free(rom->data);
+    rom->data = NULL;
+}
+
+/* Map a large file instead of reading it.  The pages come straight from
+ * the page cache when the ROM is copied into the guest and the kernel
+ * reads ahead while the other images are being loaded.  The mapping is
+ * private so that the ROM data can still be patched through rom_ptr().
+ */
+static bool rom_map_file(Rom *rom, int fd)
+{
+#ifndef _WIN32
+    void *data;
+
+    if (rom->datasize < ROM_MAP_MIN_SIZE) {
+        return false;
+    }
+    data = mmap(NULL, rom->datasize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                fd, 0);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    qemu_madvise(data, rom->datasize, QEMU_MADV_WILLNEED);
+    rom->data = data;
+    rom->mapped = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
 static void fw_cfg_resized(const char *id, uint64_t length, void *host)
 {
     if (fw_cfg) {
@@ -934,13 +979,16 @@ int rom_add_file(const char *file, const char *fw_dir,
     }
 
     rom->datasize = rom->romsize;
-    rom->data     = g_malloc0(rom->datasize);
-    lseek(fd, 0, SEEK_SET);
-    rc = read(fd, rom->data, rom->datasize);
-    if (rc != rom->datasize) {
-        fprintf(stderr, "rom: file %-20s: read error: rc=%d (expected %zd)\n",
-                rom->name, rc, rom->datasize);
-        goto err;
+    if (fw_dir || !rom_map_file(rom, fd)) {
+        rom->data = g_malloc0(rom->datasize);
+        lseek(fd, 0, SEEK_SET);
+        rc = read(fd, rom->data, rom->datasize);
+        if (rc != rom->datasize) {
+            fprintf(stderr,
+                    "rom: file %-20s: read error: rc=%d (expected %zd)\n",
+                    rom->name, rc, rom->datasize);
+            goto err;
+        }
     }
     close(fd);
     rom_insert(rom);
@@ -982,7 +1030,7 @@ err:
     if (fd != -1)
         close(fd);
 
-    g_free(rom->data);
+    rom_free_data(rom);
     g_free(rom->path);
     g_free(rom->name);
     if (fw_dir) {
@@ -1067,6 +1115,66 @@ int rom_add_option(const char *file, int32_t bootindex)
     return rom_add_file(file, "genroms", 0, bootindex, true, NULL, NULL);
 }
 
+/* Granule at which rom_reset() compares a blob with what the guest left */
+#define ROM_RESET_CHUNK 4096
+
+/*
+ * Is the RAM behind @addr already what a blob holds? Only the part
+ * mapped by one region is compared, @len is trimmed to it.
+ */
+static bool rom_reset_unchanged(AddressSpace *as, hwaddr addr,
+                                const uint8_t *data, hwaddr *len)
+{
+    MemoryRegion *mr;
+    hwaddr xlat;
+    bool same = false;
+
+    rcu_read_lock();
+    mr = address_space_translate(as, addr, &xlat, len, false);
+    if (memory_region_is_ram(mr) || memory_region_is_romd(mr)) {
+        same = !memcmp(memory_region_get_ram_ptr(mr) + xlat, data, *len);
+    }
+    rcu_read_unlock();
+    return same;
+}
+
+/*
+ * Copy back the parts of a blob the guest modified, a chunk at a time.
+ * Chunks that are unchanged aren't written, so the code translated from
+ * them survives the reset.
+ */
+static void rom_reset_data(Rom *rom)
+{
+    hwaddr off, len;
+
+    for (off = 0; off < rom->datasize; off += len) {
+        hwaddr addr = rom->addr + off;
+
+        len = MIN(ROM_RESET_CHUNK - (addr & (ROM_RESET_CHUNK - 1)),
+                  rom->datasize - off);
+        if (rom->mr) {
+            uint8_t *host = memory_region_get_ram_ptr(rom->mr);
+
+            if (!memcmp(host + off, rom->data + off, len)) {
+                continue;
+            }
+            memcpy(host + off, rom->data + off, len);
+        } else {
+            if (rom_reset_unchanged(rom->as, addr, rom->data + off, &len)) {
+                continue;
+            }
+            cpu_physical_memory_write_rom(rom->as, addr, rom->data + off, len);
+        }
+        /*
+         * The rom loader is really on the same level as firmware in the guest
+         * shadowing a ROM into RAM. Such a shadowing mechanism needs to ensure
+         * that the instruction cache for that new region is clear, so that the
+         * CPU definitely fetches its instructions from the just written data.
+         */
+        cpu_flush_icache_range(addr, len);
+    }
+}
+
 static void rom_reset(void *unused)
 {
     Rom *rom;
@@ -1078,25 +1186,11 @@ static void rom_reset(void *unused)
         if (rom->data == NULL) {
             continue;
         }
-        if (rom->mr) {
-            void *host = memory_region_get_ram_ptr(rom->mr);
-            memcpy(host, rom->data, rom->datasize);
-        } else {
-            cpu_physical_memory_write_rom(rom->as, rom->addr, rom->data,
-                                          rom->datasize);
-        }
+        rom_reset_data(rom);
         if (rom->isrom) {
             /* rom needs to be written only once */
-            g_free(rom->data);
-            rom->data = NULL;
+            rom_free_data(rom);
         }
-        /*
-         * The rom loader is really on the same level as firmware in the guest
-         * shadowing a ROM into RAM. Such a shadowing mechanism needs to ensure
-         * that the instruction cache for that new region is clear, so that the
-         * CPU definitely fetches its instructions from the just written data.
-         */
-        cpu_flush_icache_range(rom->addr, rom->datasize);
     }
 }
 
@@ -38,6 +38,7 @@
 #include "hw/sysbus.h"
 #include "qapi-event.h"
 #include "hw/pm_debug.h"
+#include "qemu/timer.h"
 
 bool qdev_hotplug = false;
 static bool qdev_hot_added = false;
@@ -1116,6 +1117,7 @@ static void device_initfn(Object *obj)
     qdev_init_gpio_in_named(dev, dc->rst_cntrl, "rst_cntrl", 6);
 
     QLIST_INIT(&dev->gpios);
+    QLIST_INIT(&dev->pm_timers);
 }
 
 static void device_post_init(Object *obj)
@@ -1127,9 +1129,15 @@ static void device_post_init(Object *obj)
 static void device_finalize(Object *obj)
 {
     NamedGPIOList *ngl, *next;
+    PowerGatedTimer *pt, *next_pt;
 
     DeviceState *dev = DEVICE(obj);
 
+    QLIST_FOREACH_SAFE(pt, &dev->pm_timers, node, next_pt) {
+        QLIST_REMOVE(pt, node);
+        g_free(pt);
+    }
+
     QLIST_FOREACH_SAFE(ngl, &dev->gpios, node, next) {
         QLIST_REMOVE(ngl, node);
         qemu_free_irqs(ngl->in, ngl->num_in);
@@ -1187,6 +1195,45 @@ static Property device_props[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+struct PowerGatedTimer {
+    QEMUTimer *timer;
+    /* Expiry time of the timer while the device is gated, -1 if none */
+    int64_t expire;
+    QLIST_ENTRY(PowerGatedTimer) node;
+};
+
+void qdev_pm_add_timer(DeviceState *dev, QEMUTimer *timer)
+{
+    PowerGatedTimer *pt = g_new0(PowerGatedTimer, 1);
+
+    pt->timer = timer;
+    pt->expire = -1;
+    QLIST_INSERT_HEAD(&dev->pm_timers, pt, node);
+}
+
+static void device_pm_gate_timers(DeviceState *dev, bool gate)
+{
+    PowerGatedTimer *pt;
+
+    if (dev->ps.timers_gated == gate) {
+        return;
+    }
+    dev->ps.timers_gated = gate;
+
+    QLIST_FOREACH(pt, &dev->pm_timers, node) {
+        if (gate) {
+            pt->expire = timer_expire_time_ns(pt->timer);
+            timer_del(pt->timer);
+        } else if (pt->expire != -1) {
+            /* Lets the device catch up on what it missed while gated */
+            if (!timer_pending(pt->timer)) {
+                timer_mod(pt->timer, pt->expire);
+            }
+            pt->expire = -1;
+        }
+    }
+}
+
 static void device_pwr_hlt_cntrl(void *opaque, const char *from)
 {
     const char *to;
@@ -1195,6 +1242,8 @@ static void device_pwr_hlt_cntrl(void *opaque, const char *from)
     dev->ps.active = dev->ps.power && !dev->ps.halt;
     to = PM_STATE(dev);
 
+    device_pm_gate_timers(dev, !dev->ps.active);
+
     if (from != to) {
         PM_DEBUG_PRINT("%s: from %s to %s\n", dev->id, from, to);
     }
@@ -408,6 +408,113 @@ uint64_t dep_register_read_memory_le(void *opaque, hwaddr addr, unsigned size)
     return register_read_memory(opaque, addr, size, false);
 }
 
+void dep_register_block_init(DepRegisterBlock *b, Object *owner,
+                             const MemoryRegionOps *ops,
+                             MemoryRegion *container, const char *prefix)
+{
+    uint64_t size = memory_region_size(container);
+
+    b->nr_index = DIV_ROUND_UP(size, 4);
+    b->index = g_new0(DepRegisterInfo *, b->nr_index);
+    b->prefix = prefix;
+    memory_region_init_io(&b->mem, owner, ops, b, "regs", size);
+    memory_region_add_subregion(container, 0, &b->mem);
+}
+
+void dep_register_block_add(DepRegisterBlock *b, DepRegisterInfo *reg,
+                            hwaddr offset)
+{
+    unsigned int i;
+
+    assert(!(offset % reg->data_size));
+    assert(offset + reg->data_size <= b->nr_index * 4);
+    for (i = 0; i < DIV_ROUND_UP(reg->data_size, 4); i++) {
+        b->index[offset / 4 + i] = reg;
+    }
+}
+
+static DepRegisterInfo *register_block_find(DepRegisterBlock *b, hwaddr addr,
+                                            unsigned size, bool is_write)
+{
+    DepRegisterInfo *reg = addr / 4 < b->nr_index ? b->index[addr / 4] : NULL;
+
+    if (!reg) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: %s unimplemented register at "
+                      "address: %#" HWADDR_PRIx "\n", b->prefix,
+                      is_write ? "write to" : "read from", addr);
+        return NULL;
+    }
+    /* Registers are aligned to their size, so accesses can't straddle.  */
+    assert(addr % reg->data_size + size <= reg->data_size);
+    return reg;
+}
+
+MemTxResult dep_register_block_read_be(void *opaque, hwaddr addr,
+                                       uint64_t *value, unsigned size,
+                                       MemTxAttrs attrs)
+{
+    DepRegisterInfo *reg = register_block_find(opaque, addr, size, false);
+
+    if (!reg) {
+        *value = 0;
+        return MEMTX_DECODE_ERROR;
+    }
+    *value = register_read_memory(reg, addr % reg->data_size, size, true);
+    return MEMTX_OK;
+}
+
+MemTxResult dep_register_block_read_le(void *opaque, hwaddr addr,
+                                       uint64_t *value, unsigned size,
+                                       MemTxAttrs attrs)
+{
+    DepRegisterInfo *reg = register_block_find(opaque, addr, size, false);
+
+    if (!reg) {
+        *value = 0;
+        return MEMTX_DECODE_ERROR;
+    }
+    *value = register_read_memory(reg, addr % reg->data_size, size, false);
+    return MEMTX_OK;
+}
+
+MemTxResult dep_register_block_write_be(void *opaque, hwaddr addr,
+                                        uint64_t value, unsigned size,
+                                        MemTxAttrs attrs)
+{
+    DepRegisterInfo *reg = register_block_find(opaque, addr, size, true);
+    DepRegisterInfo reg_d;
+    DepRegisterAccessInfo access_d;
+
+    if (!reg) {
+        return MEMTX_DECODE_ERROR;
+    }
+    if (attrs.debug) {
+        dep_register_trap_access(reg, &reg_d, &access_d);
+        reg = &reg_d;
+    }
+    register_write_memory(reg, addr % reg->data_size, value, size, true);
+    return MEMTX_OK;
+}
+
+MemTxResult dep_register_block_write_le(void *opaque, hwaddr addr,
+                                        uint64_t value, unsigned size,
+                                        MemTxAttrs attrs)
+{
+    DepRegisterInfo *reg = register_block_find(opaque, addr, size, true);
+    DepRegisterInfo reg_d;
+    DepRegisterAccessInfo access_d;
+
+    if (!reg) {
+        return MEMTX_DECODE_ERROR;
+    }
+    if (attrs.debug) {
+        dep_register_trap_access(reg, &reg_d, &access_d);
+        reg = &reg_d;
+    }
+    register_write_memory(reg, addr % reg->data_size, value, size, false);
+    return MEMTX_OK;
+}
+
 static const TypeInfo register_info = {
     .name  = TYPE_DEP_REGISTER,
     .parent = TYPE_DEVICE,
@@ -18,7 +18,10 @@
 #include "qemu/osdep.h"
 #include "hw/register.h"
 #include "hw/qdev.h"
+#include "qemu/bitmap.h"
 #include "qemu/log.h"
+#include "qemu/error-report.h"
+#include "migration/qemu-file-types.h"
 
 static inline void register_write_val(RegisterInfo *reg, uint64_t val)
 {
@@ -168,6 +171,18 @@ void register_reset(RegisterInfo *reg)
     register_write_val(reg, reg->access->reset);
 }
 
+void register_reset_block(RegisterInfoArray *r_array)
+{
+    unsigned int i;
+
+    for (i = 0; i < r_array->num_reset_runs; i++) {
+        const RegisterResetRun *run = &r_array->reset_runs[i];
+
+        memcpy(&r_array->data[run->start], &r_array->reset_data[run->start],
+               run->len * sizeof(uint32_t));
+    }
+}
+
 void register_init(RegisterInfo *reg)
 {
     assert(reg);
@@ -179,34 +194,126 @@ void register_init(RegisterInfo *reg)
     object_initialize((void *)reg, sizeof(*reg), TYPE_REGISTER);
 }
 
-void register_write_memory(void *opaque, hwaddr addr,
-                           uint64_t value, unsigned size)
+/*
+ * Per block dispatch table, sorted by address. Registers without side
+ * effects are flagged so that accesses skip register_read/write.
+ */
+struct RegisterLookup {
+    hwaddr addr;
+    RegisterInfo *reg;
+    /* Bits a plain write may change.  */
+    uint64_t wmask;
+    bool plain_read;
+    bool plain_write;
+};
+
+static int register_lookup_cmp(const void *a, const void *b)
+{
+    const RegisterLookup *x = a;
+    const RegisterLookup *y = b;
+
+    return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static void register_build_lookup(RegisterInfoArray *reg_array)
 {
-    RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
-    uint64_t we;
     int i;
 
+    reg_array->lookup = g_new0(RegisterLookup, reg_array->num_elements);
     for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
-        }
+        RegisterInfo *reg = reg_array->r[i];
+        const RegisterAccessInfo *ac = reg->access;
+        RegisterLookup *e = &reg_array->lookup[i];
+        bool plain = reg->data && ac->name && !reg_array->debug;
+
+        e->addr = ac->addr;
+        e->reg = reg;
+        e->wmask = ~(ac->ro | ac->rsvd);
+        e->plain_read = plain && !ac->cor && !ac->post_read;
+        e->plain_write = plain && !ac->w1c && !ac->unimp
+                         && !ac->pre_write && !ac->post_write;
     }
+    qsort(reg_array->lookup, reg_array->num_elements,
+          sizeof *reg_array->lookup, register_lookup_cmp);
+}
 
-    if (!reg) {
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unimplemented register " \
-                      "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
-        return;
+static RegisterLookup *register_lookup(RegisterInfoArray *reg_array,
+                                       hwaddr addr)
+{
+    RegisterLookup *e = reg_array->last;
+    int lo = 0, hi = reg_array->num_elements;
+
+    /* Firmware tends to poll the same register over and over.  */
+    if (e && e->addr == addr) {
+        return e;
+    }
+
+    if (!reg_array->lookup) {
+        register_build_lookup(reg_array);
+    }
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+
+        e = &reg_array->lookup[mid];
+        if (e->addr == addr) {
+            reg_array->last = e;
+            return e;
+        }
+        if (e->addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
     }
+    return NULL;
+}
+
+static void register_write_lookup(RegisterInfoArray *reg_array,
+                                  RegisterLookup *e, uint64_t value,
+                                  unsigned size, bool debug_access)
+{
+    RegisterInfo reg_d;
+    RegisterAccessInfo access_d;
+    RegisterInfo *reg = e->reg;
+    uint64_t we;
 
     /* Generate appropriate write enable mask */
     we = register_enabled_mask(reg->data_size, size);
 
+    if (e->plain_write && !debug_access
+        && (!reg->access->rsvd || !qemu_loglevel_mask(LOG_GUEST_ERROR))) {
+        uint64_t wmask = e->wmask & we;
+
+        register_write_val(reg, (register_read_val(reg) & ~wmask)
+                                | (value & wmask));
+        return;
+    }
+
+    if (debug_access) {
+        register_trap_access(reg, &reg_d, &access_d);
+        reg = &reg_d;
+    }
+
     register_write(reg, value, we, reg_array->prefix,
                    reg_array->debug);
 }
 
+void register_write_memory(void *opaque, hwaddr addr,
+                           uint64_t value, unsigned size)
+{
+    RegisterInfoArray *reg_array = opaque;
+    RegisterLookup *e = register_lookup(reg_array, addr);
+
+    if (!e) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unimplemented register " \
+                      "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
+        return;
+    }
+
+    register_write_lookup(reg_array, e, value, size, false);
+}
+
 void register_trap_access(RegisterInfo *reg,
                           RegisterInfo *reg_d,
                           RegisterAccessInfo *access_d)
@@ -221,37 +328,16 @@ void register_trap_access(RegisterInfo *reg,
 MemTxResult register_write_memory_with_attrs(void *opaque, hwaddr addr,
                              uint64_t value, unsigned size, MemTxAttrs attrs)
 {
-    RegisterInfo reg_d;
-    RegisterAccessInfo access_d;
     RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
-    uint64_t we;
-    int i;
-
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
-        }
-    }
+    RegisterLookup *e = register_lookup(reg_array, addr);
 
-    if (!reg) {
+    if (!e) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: write to unimplemented register " \
                       "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
         return MEMTX_DECODE_ERROR;
     }
 
-    if (attrs.debug) {
-        register_trap_access(reg, &reg_d, &access_d);
-        reg = &reg_d;
-    }
-
-    /* Generate appropriate write enable mask */
-    we = register_enabled_mask(reg->data_size, size);
-
-    register_write(reg, value, we, reg_array->prefix,
-                   reg_array->debug);
-
+    register_write_lookup(reg_array, e, value, size, attrs.debug);
     return MEMTX_OK;
 }
 
@@ -260,29 +346,27 @@ uint64_t register_read_memory(void *opaque, hwaddr addr,
                               unsigned size)
 {
     RegisterInfoArray *reg_array = opaque;
-    RegisterInfo *reg = NULL;
+    RegisterLookup *e = register_lookup(reg_array, addr);
+    RegisterInfo *reg;
     uint64_t read_val;
     uint64_t re;
-    int i;
-
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr == addr) {
-            reg = reg_array->r[i];
-            break;
-        }
-    }
 
-    if (!reg) {
+    if (!e) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s:  read to unimplemented register " \
                       "at address: %#" PRIx64 "\n", reg_array->prefix, addr);
         return 0;
     }
+    reg = e->reg;
 
     /* Generate appropriate read enable mask */
     re = register_enabled_mask(reg->data_size, size);
 
-    read_val = register_read(reg, re, reg_array->prefix,
-                             reg_array->debug);
+    if (e->plain_read) {
+        read_val = register_read_val(reg) & re;
+    } else {
+        read_val = register_read(reg, re, reg_array->prefix,
+                                 reg_array->debug);
+    }
 
     return extract64(read_val, 0, size * 8);
 }
@@ -297,6 +381,8 @@ RegisterInfoArray *register_init_block32(DeviceState *owner,
 {
     const char *device_prefix = object_get_typename(OBJECT(owner));
     RegisterInfoArray *r_array = g_new0(RegisterInfoArray, 1);
+    unsigned long *described;
+    unsigned int nr_regs = 0, start, end;
     int i;
 
     r_array->r = g_new0(RegisterInfo *, num);
@@ -304,6 +390,13 @@ RegisterInfoArray *register_init_block32(DeviceState *owner,
     r_array->debug = debug_enabled;
     r_array->prefix = device_prefix;
 
+    for (i = 0; i < num; i++) {
+        nr_regs = MAX(nr_regs, rae[i].addr / 4 + 1);
+    }
+    r_array->data = data;
+    r_array->reset_data = g_new0(uint32_t, nr_regs);
+    described = bitmap_new(nr_regs);
+
     for (i = 0; i < num; i++) {
         int index = rae[i].addr / 4;
         RegisterInfo *r = &ri[index];
@@ -317,17 +410,112 @@ RegisterInfoArray *register_init_block32(DeviceState *owner,
         register_init(r);
 
         r_array->r[i] = r;
+        r_array->reset_data[index] = rae[i].reset;
+        set_bit(index, described);
     }
 
+    /* Runs of consecutive registers, each reset with a single copy */
+    for (start = find_first_bit(described, nr_regs); start < nr_regs;
+         start = find_next_bit(described, nr_regs, end)) {
+        end = find_next_zero_bit(described, nr_regs, start);
+        r_array->reset_runs = g_renew(RegisterResetRun, r_array->reset_runs,
+                                      r_array->num_reset_runs + 1);
+        r_array->reset_runs[r_array->num_reset_runs++] = (RegisterResetRun) {
+            .start = start,
+            .len = end - start,
+        };
+    }
+    g_free(described);
+
     memory_region_init_io(&r_array->mem, OBJECT(owner), ops, r_array,
                           device_prefix, memory_size);
 
     return r_array;
 }
 
+/*
+ * Register blocks in the migration stream: a be32 count, then for every
+ * register away from its reset value a be32 index and the value, be32 or
+ * be64 depending on the size of the register.
+ */
+static void register_delta_put_val(QEMUFile *f, RegisterInfo *reg,
+                                   uint64_t val)
+{
+    if (reg->data_size == 8) {
+        qemu_put_be64(f, val);
+    } else {
+        qemu_put_be32(f, val);
+    }
+}
+
+static int put_register_delta(QEMUFile *f, void *pv, size_t size,
+                              VMStateField *field, QJSON *vmdesc)
+{
+    RegisterInfo *ri = pv;
+    unsigned int num = size / sizeof(RegisterInfo);
+    unsigned int i, count = 0;
+
+    for (i = 0; i < num; i++) {
+        if (ri[i].access && register_read_val(&ri[i]) != ri[i].access->reset) {
+            count++;
+        }
+    }
+
+    qemu_put_be32(f, count);
+    for (i = 0; i < num; i++) {
+        uint64_t val;
+
+        if (!ri[i].access) {
+            continue;
+        }
+        val = register_read_val(&ri[i]);
+        if (val != ri[i].access->reset) {
+            qemu_put_be32(f, i);
+            register_delta_put_val(f, &ri[i], val);
+        }
+    }
+    return 0;
+}
+
+static int get_register_delta(QEMUFile *f, void *pv, size_t size,
+                              VMStateField *field)
+{
+    RegisterInfo *ri = pv;
+    unsigned int num = size / sizeof(RegisterInfo);
+    unsigned int i, count;
+
+    /* Straight into the backing store, the post_write hooks do not run.  */
+    for (i = 0; i < num; i++) {
+        if (ri[i].access) {
+            register_write_val(&ri[i], ri[i].access->reset);
+        }
+    }
+
+    count = qemu_get_be32(f);
+    while (count--) {
+        i = qemu_get_be32(f);
+        if (i >= num || !ri[i].access) {
+            error_report("%s: no register at index %u", field->name, i);
+            return -EINVAL;
+        }
+        register_write_val(&ri[i], ri[i].data_size == 8 ? qemu_get_be64(f)
+                                                        : qemu_get_be32(f));
+    }
+    return 0;
+}
+
+const VMStateInfo vmstate_info_register_delta = {
+    .name = "register-delta",
+    .get  = get_register_delta,
+    .put  = put_register_delta,
+};
+
 void register_finalize_block(RegisterInfoArray *r_array)
 {
     object_unparent(OBJECT(&r_array->mem));
+    g_free(r_array->lookup);
+    g_free(r_array->reset_runs);
+    g_free(r_array->reset_data);
     g_free(r_array->r);
     g_free(r_array);
 }
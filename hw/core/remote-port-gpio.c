@@ -24,13 +24,53 @@
 
 #define CACHE_INVALID -1
 
+static void rp_gpio_send(RemotePortGPIO *s, void *pkt, size_t len,
+                         uint32_t id)
+{
+    if (s->peer->caps.wire_posted_updates && !s->posted_updates) {
+        rp_rsp_mutex_lock(s->rp);
+    }
+
+    rp_write(s->rp, pkt, len);
+
+    /* If peer supports posted updates it will respect our flag and
+     * not respond.  */
+    if (s->peer->caps.wire_posted_updates && !s->posted_updates) {
+        RemotePortRespSlot *rsp_slot;
+
+        rsp_slot = rp_dev_wait_resp(s->rp, s->rp_dev, id);
+        assert(rsp_slot->rsp.pkt->hdr.id == id);
+        rp_resp_slot_done(s->rp, rsp_slot);
+        rp_rsp_mutex_unlock(s->rp);
+    }
+}
+
+static void rp_gpio_batch_flush(void *opaque)
+{
+    RemotePortGPIO *s = opaque;
+    struct {
+        struct rp_pkt_interrupt_batch pkt;
+        uint32_t words[2 * RP_GPIO_BATCH_WORDS];
+    } pay;
+    uint32_t id = rp_new_id(s->rp);
+    uint32_t flags = s->posted_updates ? RP_PKT_FLAGS_posted : 0;
+    size_t len;
+
+    len = rp_encode_interrupt_batch(id, s->rp_dev, &pay.pkt,
+                                    rp_normalized_vmclk(s->rp),
+                                    0, s->num_gpios,
+                                    s->batch_changed, s->batch_vals, flags);
+    memset(s->batch_changed, 0, sizeof s->batch_changed);
+    rp_gpio_send(s, &pay, len, id);
+}
+
 static void rp_gpio_handler(void *opaque, int irq, int level)
 {
     RemotePortGPIO *s = opaque;
     struct rp_pkt pkt;
     size_t len;
     int64_t clk;
-    uint32_t id = rp_new_id(s->rp);
+    uint32_t id;
     uint32_t flags = s->posted_updates ? RP_PKT_FLAGS_posted : 0;
 
     /* If we hit the cache, return early.  */
@@ -41,32 +81,87 @@ static void rp_gpio_handler(void *opaque, int irq, int level)
     s->cache[irq] = level;
 
     clk = rp_normalized_vmclk(s->rp);
+    if (s->batch_window_ns && s->peer->caps.wire_batched_updates) {
+        uint32_t bit = 1U << (irq % 32);
+
+        s->batch_changed[irq / 32] |= bit;
+        s->batch_vals[irq / 32] &= ~bit;
+        s->batch_vals[irq / 32] |= level ? bit : 0;
+        if (!timer_pending(s->batch_timer)) {
+            timer_mod(s->batch_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)
+                                      + s->batch_window_ns);
+        }
+        return;
+    }
+
+    id = rp_new_id(s->rp);
     len = rp_encode_interrupt_f(id, s->rp_dev, &pkt.interrupt, clk,
                               irq, 0, level, flags);
+    rp_gpio_send(s, &pkt, len, id);
+}
 
-    if (s->peer->caps.wire_posted_updates && !s->posted_updates) {
-        rp_rsp_mutex_lock(s->rp);
-    }
+/* Inputs [n * 32, n * 32 + 32) as a GPIO vector.  Changes to several of
+ * them go out as a single batch when the peer understands batches.
+ */
+static void rp_gpio_vector_handler(void *opaque, int n, int level)
+{
+    RemotePortGPIO *s = opaque;
+    unsigned int base = n * 32;
+    uint32_t changed = 0;
+    unsigned int i;
 
-    rp_write(s->rp, (void *)&pkt, len);
+    for (i = 0; i < 32 && base + i < s->num_gpios; i++) {
+        if (s->cache[base + i] != extract32(level, i, 1)) {
+            changed |= 1U << i;
+        }
+    }
+    if (!changed) {
+        return;
+    }
 
-    /* If peer supports posted updates it will respect our flag and
-     * not respond.  */
-    if (s->peer->caps.wire_posted_updates && !s->posted_updates) {
-        RemotePortRespSlot *rsp_slot;
+    if (!s->peer->caps.wire_batched_updates || ctpop32(changed) == 1) {
+        for (i = 0; i < 32; i++) {
+            if (changed & (1U << i)) {
+                rp_gpio_handler(s, base + i, extract32(level, i, 1));
+            }
+        }
+        return;
+    }
 
-        rsp_slot = rp_dev_wait_resp(s->rp, s->rp_dev, id);
-        assert(rsp_slot->rsp.pkt->hdr.id == id);
-        rp_resp_slot_done(s->rp, rsp_slot);
-        rp_rsp_mutex_unlock(s->rp);
+    for (i = 0; i < 32; i++) {
+        if (changed & (1U << i)) {
+            s->cache[base + i] = extract32(level, i, 1);
+        }
+    }
+    s->batch_changed[n] |= changed;
+    s->batch_vals[n] = (s->batch_vals[n] & ~changed) | (level & changed);
+    if (!s->batch_window_ns) {
+        rp_gpio_batch_flush(s);
+    } else if (!timer_pending(s->batch_timer)) {
+        timer_mod(s->batch_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL)
+                                  + s->batch_window_ns);
     }
 }
 
+static void rp_gpio_vector_update(RemotePortGPIO *s, unsigned int line,
+                                  bool level)
+{
+    unsigned int w = line / 32;
+
+    s->vector_vals[w] = deposit32(s->vector_vals[w], line % 32, 1, level);
+}
+
 static void rp_gpio_interrupt(RemotePortDevice *rpdev, struct rp_pkt *pkt)
 {
     RemotePortGPIO *s = REMOTE_PORT_GPIO(rpdev);
 
     qemu_set_irq(s->gpio_out[pkt->interrupt.line], pkt->interrupt.val);
+    if (pkt->interrupt.line < s->num_gpios) {
+        unsigned int w = pkt->interrupt.line / 32;
+
+        rp_gpio_vector_update(s, pkt->interrupt.line, pkt->interrupt.val);
+        qemu_set_irq(s->vector_out[w], s->vector_vals[w]);
+    }
 
     if (s->peer->caps.wire_posted_updates
         && !(pkt->hdr.flags & RP_PKT_FLAGS_posted)) {
@@ -86,12 +181,61 @@ static void rp_gpio_interrupt(RemotePortDevice *rpdev, struct rp_pkt *pkt)
     }
 }
 
+static void rp_gpio_interrupt_batch(RemotePortDevice *rpdev,
+                                    struct rp_pkt *pkt)
+{
+    RemotePortGPIO *s = REMOTE_PORT_GPIO(rpdev);
+    struct rp_pkt_interrupt_batch *pib = &pkt->interrupt_batch;
+    uint32_t *changed = rp_interrupt_batch_changed(pib);
+    uint32_t *vals = rp_interrupt_batch_vals(pib);
+    uint32_t words = 0;
+    unsigned int i;
+
+    for (i = 0; i < pib->nr_lines; i++) {
+        uint32_t line = pib->base_line + i;
+        uint32_t bit = 1U << (i % 32);
+
+        if (!(changed[i / 32] & bit)) {
+            continue;
+        }
+        if (line >= s->num_gpios) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: line %u out of range\n",
+                          object_get_canonical_path(OBJECT(s)), line);
+            continue;
+        }
+        qemu_set_irq(s->gpio_out[line], !!(vals[i / 32] & bit));
+        rp_gpio_vector_update(s, line, vals[i / 32] & bit);
+        words |= 1U << (line / 32);
+    }
+    /* One update per vector for the whole batch */
+    for (i = 0; i < RP_GPIO_BATCH_WORDS; i++) {
+        if (words & (1U << i)) {
+            qemu_set_irq(s->vector_out[i], s->vector_vals[i]);
+        }
+    }
+
+    if (s->peer->caps.wire_posted_updates
+        && !(pkt->hdr.flags & RP_PKT_FLAGS_posted)) {
+        struct rp_pkt_interrupt_batch rsp;
+        size_t len;
+
+        len = rp_encode_interrupt_batch(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                                        pib->timestamp, pib->base_line, 0,
+                                        NULL, NULL,
+                                        pkt->hdr.flags | RP_PKT_FLAGS_response);
+        rp_write(s->rp, (void *)&rsp, len);
+    }
+}
+
 static void rp_gpio_reset(DeviceState *dev)
 {
     RemotePortGPIO *s = REMOTE_PORT_GPIO(dev);
 
     /* Mark as invalid.  */
     memset(s->cache, CACHE_INVALID, s->num_gpios);
+
+    timer_del(s->batch_timer);
+    memset(s->batch_changed, 0, sizeof s->batch_changed);
 }
 
 static void rp_gpio_realize(DeviceState *dev, Error **errp)
@@ -101,9 +245,21 @@ static void rp_gpio_realize(DeviceState *dev, Error **errp)
 
     s->peer = rp_get_peer(s->rp);
 
+    if (s->num_gpios > MAX_GPIOS) {
+        error_setg(errp, "%s: num-gpios %u too large! MAX is %d",
+                   TYPE_REMOTE_PORT_GPIO, s->num_gpios, MAX_GPIOS);
+        return;
+    }
+
+    s->batch_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, rp_gpio_batch_flush, s);
+
     s->gpio_out = g_new0(qemu_irq, s->num_gpios);
     qdev_init_gpio_out(dev, s->gpio_out, s->num_gpios);
     qdev_init_gpio_in(dev, rp_gpio_handler, s->num_gpios);
+    qdev_init_gpio_out_named(dev, s->vector_out, GPIO_VECTOR_OUT_NAME,
+                             DIV_ROUND_UP(s->num_gpios, 32));
+    qdev_init_gpio_in_named(dev, rp_gpio_vector_handler, GPIO_VECTOR_IN_NAME,
+                            DIV_ROUND_UP(s->num_gpios, 32));
 
     for (i = 0; i < s->num_gpios; i++) {
         sysbus_init_irq(SYS_BUS_DEVICE(s), &s->gpio_out[i]);
@@ -127,6 +283,7 @@ static Property rp_properties[] = {
     DEFINE_PROP_UINT16("cell-offset-irq-num", RemotePortGPIO,
                        cell_offset_irq_num, 0),
     DEFINE_PROP_BOOL("posted-updates", RemotePortGPIO, posted_updates, true),
+    DEFINE_PROP_UINT64("batch-window-ns", RemotePortGPIO, batch_window_ns, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -147,17 +304,32 @@ static int rp_fdt_get_irq(FDTGenericIntc *obj, qemu_irq *irqs,
     return 1;
 };
 
+static const FDTGenericGPIOSet rp_gpio_controller_gpios[] = {
+    {
+        .names = &fdt_generic_gpio_name_set_gpio_vector,
+        .gpios = (FDTGenericGPIOConnection []) {
+            { .name = GPIO_VECTOR_OUT_NAME, .fdt_index = 0,
+              .range = RP_GPIO_BATCH_WORDS },
+            { },
+        },
+    },
+    { },
+};
+
 static void rp_gpio_class_init(ObjectClass *oc, void *data)
 {
     RemotePortDeviceClass *rpdc = REMOTE_PORT_DEVICE_CLASS(oc);
     DeviceClass *dc = DEVICE_CLASS(oc);
     FDTGenericIntcClass *fgic = FDT_GENERIC_INTC_CLASS(oc);
+    FDTGenericGPIOClass *fggc = FDT_GENERIC_GPIO_CLASS(oc);
 
     rpdc->ops[RP_CMD_interrupt] = rp_gpio_interrupt;
+    rpdc->ops[RP_CMD_interrupt_batch] = rp_gpio_interrupt_batch;
     dc->reset = rp_gpio_reset;
     dc->realize = rp_gpio_realize;
     dc->props = rp_properties;
     fgic->get_irq = rp_fdt_get_irq;
+    fggc->controller_gpios = rp_gpio_controller_gpios;
 }
 
 static const TypeInfo rp_info = {
@@ -169,6 +341,7 @@ static const TypeInfo rp_info = {
     .interfaces    = (InterfaceInfo[]) {
         { TYPE_REMOTE_PORT_DEVICE },
         { TYPE_FDT_GENERIC_INTC },
+        { TYPE_FDT_GENERIC_GPIO },
         { },
     },
 };
@@ -10,6 +10,7 @@
 #include "qemu/osdep.h"
 #include "sysemu/sysemu.h"
 #include "qemu/log.h"
+#include "qemu/iov.h"
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "hw/sysbus.h"
@@ -60,7 +61,9 @@ struct RemotePortMemoryMaster {
     /* public */
     uint32_t rp_dev;
     bool relative;
+    bool posted_writes;
     uint32_t max_access_size;
+    uint32_t max_burst_size;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
 };
@@ -109,16 +112,32 @@ static void rp_io_access(MemoryTransaction *tr)
     in.attr |= tr->attr.secure ? RP_BUS_ATTR_SECURE : 0;
     in.size = tr->size;
     in.stream_width = tr->size;
+    if (tr->rw && s->posted_writes) {
+        in.flags |= RP_PKT_FLAGS_posted;
+    }
     len = rp_encode_busaccess(s->peer, &pay.pkt, &in);
     len += tr->rw ? tr->size : 0;
 
+    if (in.flags & RP_PKT_FLAGS_posted) {
+        /*
+         * Fire and forget. The channel keeps packets in order so later
+         * reads will still observe this write. Any response the peer
+         * sends anyway gets dropped by the remote-port thread.
+         */
+        rp_write(s->rp, (void *) &pay, len);
+        rp_leave_iothread(s->rp);
+        return;
+    }
+
     rp_rsp_mutex_lock(s->rp);
     rp_write(s->rp, (void *) &pay, len);
 
+    /*
+     * Responses are matched by id, other masters may have transactions
+     * in flight on the same channel and they may complete out of order.
+     */
     rsp_slot = rp_dev_wait_resp(s->rp, in.dev, in.id);
     rsp = &rsp_slot->rsp;
-
-    /* We dont support out of order answers yet.  */
     assert(rsp->pkt->hdr.id == in.id);
 
     if (!tr->rw) {
@@ -143,6 +162,84 @@ static void rp_io_access(MemoryTransaction *tr)
     DB_PRINT_L(1, "\n");
 }
 
+/* Send one burst packet covering [offset, offset + size) of tr.  */
+static void rp_io_burst_packet(MemoryBurstTransaction *tr, uint64_t offset,
+                               uint32_t size)
+{
+    RemotePortMap *map = tr->opaque;
+    RemotePortMemoryMaster *s = map->parent;
+    struct rp_pkt_busaccess_ext_base pkt;
+    struct rp_encode_busaccess_in in = {0};
+    struct iovec *iov;
+    RemotePortRespSlot *rsp_slot;
+    RemotePortDynPkt *rsp;
+    int64_t rclk;
+    int iovcnt = 1;
+    uint8_t *data;
+
+    in.cmd = tr->rw ? RP_CMD_write : RP_CMD_read;
+    in.id = rp_new_id(s->rp);
+    in.dev = s->rp_dev;
+    in.clk = rp_normalized_vmclk(s->rp);
+    in.master_id = tr->attr.requester_id;
+    in.addr = tr->addr + offset + (s->relative ? 0 : map->offset);
+    in.attr |= tr->attr.secure ? RP_BUS_ATTR_SECURE : 0;
+    in.size = size;
+    in.stream_width = size;
+    if (tr->rw && s->posted_writes) {
+        in.flags |= RP_PKT_FLAGS_posted;
+    }
+
+    /* Writes go out straight from the callers buffers.  */
+    iov = g_new(struct iovec, tr->iovcnt + 1);
+    iov[0].iov_base = &pkt;
+    iov[0].iov_len = rp_encode_busaccess(s->peer, &pkt, &in);
+    if (tr->rw) {
+        iovcnt += iov_copy(iov + 1, tr->iovcnt, tr->iov, tr->iovcnt,
+                           offset, size);
+    }
+
+    if (in.flags & RP_PKT_FLAGS_posted) {
+        rp_writev(s->rp, iov, iovcnt);
+        rp_leave_iothread(s->rp);
+        g_free(iov);
+        return;
+    }
+
+    rp_rsp_mutex_lock(s->rp);
+    rp_writev(s->rp, iov, iovcnt);
+    g_free(iov);
+
+    rsp_slot = rp_dev_wait_resp(s->rp, in.dev, in.id);
+    rsp = &rsp_slot->rsp;
+    assert(rsp->pkt->hdr.id == in.id);
+
+    if (!tr->rw) {
+        data = rp_busaccess_rx_dataptr(s->peer, &rsp->pkt->busaccess_ext_base);
+        iov_from_buf(tr->iov, tr->iovcnt, offset, data, size);
+    }
+
+    rclk = rsp->pkt->busaccess.timestamp;
+    rp_resp_slot_done(s->rp, rsp_slot);
+    rp_rsp_mutex_unlock(s->rp);
+    rp_sync_vmclock(s->rp, in.clk, rclk);
+    rp_restart_sync_timer(s->rp);
+    rp_leave_iothread(s->rp);
+}
+
+static MemTxResult rp_io_access_burst(MemoryBurstTransaction *tr)
+{
+    RemotePortMap *map = tr->opaque;
+    RemotePortMemoryMaster *s = map->parent;
+    uint64_t offset;
+
+    for (offset = 0; offset < tr->size; offset += s->max_burst_size) {
+        rp_io_burst_packet(tr, offset,
+                           MIN(tr->size - offset, s->max_burst_size));
+    }
+    return MEMTX_OK;
+}
+
 static const MemoryRegionOps rp_ops_template = {
     .access = rp_io_access,
     .valid.max_access_size = RP_MAX_ACCESS_SIZE,
@@ -168,6 +265,14 @@ static void rp_memory_master_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (s->max_burst_size && s->max_burst_size < s->max_access_size) {
+        error_setg(errp, "%s: max-burst-size %d smaller than "
+                   "max-access-size %d",
+                   TYPE_REMOTE_PORT_MEMORY_MASTER, s->max_burst_size,
+                   s->max_access_size);
+        return;
+    }
+
     assert(s->rp);
     s->peer = rp_get_peer(s->rp);
 }
@@ -194,6 +299,9 @@ static bool rp_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
     s->rp_ops = g_malloc(sizeof *s->rp_ops);
     memcpy(s->rp_ops, &rp_ops_template, sizeof *s->rp_ops);
     s->rp_ops->valid.max_access_size = s->max_access_size;
+    if (s->max_burst_size) {
+        s->rp_ops->access_burst = rp_io_access_burst;
+    }
 
     s->mmaps = g_new0(typeof(*s->mmaps), reg.n);
     for (i = 0; i < reg.n; ++i) {
@@ -213,8 +321,15 @@ static bool rp_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
 static Property rp_properties[] = {
     DEFINE_PROP_UINT32("rp-chan0", RemotePortMemoryMaster, rp_dev, 0),
     DEFINE_PROP_BOOL("relative", RemotePortMemoryMaster, relative, false),
+    DEFINE_PROP_BOOL("posted-writes", RemotePortMemoryMaster, posted_writes,
+                     false),
     DEFINE_PROP_UINT32("max-access-size", RemotePortMemoryMaster,
                        max_access_size, RP_MAX_ACCESS_SIZE),
+    /* Accesses wider than max-access-size go out in packets of up to
+     * max-burst-size bytes. 0 splits them into max-access-size accesses.
+     */
+    DEFINE_PROP_UINT32("max-burst-size", RemotePortMemoryMaster,
+                       max_burst_size, 0),
     DEFINE_PROP_END_OF_LIST()
 };
 
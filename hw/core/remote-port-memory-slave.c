@@ -16,9 +16,11 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "hw/qdev.h"
+#include "sysemu/hostmem.h"
 
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
+#include "hw/remote-port.h"
 #include "hw/remote-port-memory-slave.h"
 
 #ifndef REMOTE_PORT_ERR_DEBUG
@@ -52,6 +54,46 @@ static void process_data_slow(RemotePortMemorySlave *s,
     }
 }
 
+/*
+ * Payload passed by reference. Move the data straight between the shared
+ * window and the address space, the response only echoes the reference.
+ */
+static void rp_cmd_rw_ref(RemotePortMemorySlave *s, struct rp_pkt *pkt,
+                          DMADirection dir)
+{
+    size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base) +
+                    sizeof(struct rp_busaccess_data_ref);
+    struct rp_busaccess_data_ref *ref;
+    struct rp_encode_busaccess_in in = {0};
+    size_t enclen;
+    void *win;
+
+    ref = (void *) rp_busaccess_rx_dataptr(s->peer, &pkt->busaccess_ext_base);
+    win = rp_data_window_ptr(s->rp, ref->offset, pkt->busaccess.len);
+
+    s->attr.secure = !!(pkt->busaccess.attributes & RP_BUS_ATTR_SECURE);
+    s->attr.requester_id = pkt->busaccess.master_id;
+
+    if (win) {
+        dma_memory_rw_attr(s->as, pkt->busaccess.addr, win,
+                           pkt->busaccess.len, dir, s->attr);
+    } else {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: data reference %" PRIx64
+                      "/%x outside of the data window\n",
+                      object_get_canonical_path(OBJECT(s)),
+                      ref->offset, pkt->busaccess.len);
+    }
+
+    rp_dpkt_alloc(&s->rsp, pktlen);
+    rp_encode_busaccess_in_rsp_init(&in, pkt);
+    in.clk = pkt->busaccess.timestamp;
+    enclen = rp_encode_busaccess(s->peer, &s->rsp.pkt->busaccess_ext_base,
+                                 &in);
+    assert(enclen <= pktlen);
+
+    rp_write(s->rp, (void *)s->rsp.pkt, enclen);
+}
+
 static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
                       DMADirection dir)
 {
@@ -62,6 +104,11 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
     uint8_t *data = NULL;
     uint8_t *byte_en;
 
+    if (pkt->busaccess.attributes & RP_BUS_ATTR_DATA_REF) {
+        rp_cmd_rw_ref(s, pkt, dir);
+        return;
+    }
+
     byte_en = rp_busaccess_byte_en_ptr(s->peer, &pkt->busaccess_ext_base);
 
     if (dir == DMA_DIRECTION_TO_DEVICE) {
@@ -112,6 +159,153 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
     rp_write(s->rp, (void *)s->rsp.pkt, enclen);
 }
 
+typedef struct RemotePortRamExport {
+    MemoryRegion *mr;
+    hwaddr addr;
+    uint64_t size;
+    uint64_t offset;
+    uint32_t flags;
+    char *path;
+    QTAILQ_ENTRY(RemotePortRamExport) next;
+} RemotePortRamExport;
+
+/*
+ * Only RAM the peer can open by name and whose stores are visible to us
+ * can be shared, i.e memory-backend-file with share=on and a file path.
+ */
+static char *rp_ram_backing_path(MemoryRegion *mr)
+{
+    Object *owner = memory_region_owner(mr);
+    char *path;
+
+    if (!owner || !object_dynamic_cast(owner, TYPE_MEMORY_BACKEND)
+        || !object_property_find(owner, "mem-path", NULL)
+        || !object_property_get_bool(owner, "share", NULL)) {
+        return NULL;
+    }
+
+    path = object_property_get_str(owner, "mem-path", NULL);
+    if (path && g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        /* Backed by an anonymous temp file.  */
+        g_free(path);
+        return NULL;
+    }
+    return path;
+}
+
+static void rp_ram_announce(RemotePortMemorySlave *s,
+                            RemotePortRamExport *e, uint32_t flags)
+{
+    struct rp_pkt_ram_map pkt;
+    uint32_t path_len = strlen(e->path);
+    struct iovec iov[2];
+
+    iov[0].iov_base = &pkt;
+    iov[0].iov_len = rp_encode_ram_map(rp_new_id(s->rp), s->rp_dev, &pkt,
+                                       e->addr, e->size, e->offset,
+                                       e->flags | flags, path_len);
+    iov[1].iov_base = e->path;
+    iov[1].iov_len = path_len;
+    rp_writev(s->rp, iov, ARRAY_SIZE(iov));
+}
+
+static void rp_ram_region_add(MemoryListener *listener,
+                              MemoryRegionSection *section)
+{
+    RemotePortMemorySlave *s = container_of(listener, RemotePortMemorySlave,
+                                            ram_listener);
+    RemotePortRamExport *e;
+    char *path;
+
+    if (!memory_region_is_ram(section->mr)
+        || memory_region_is_ram_device(section->mr)) {
+        return;
+    }
+
+    path = rp_ram_backing_path(section->mr);
+    if (!path) {
+        return;
+    }
+
+    e = g_new0(RemotePortRamExport, 1);
+    e->mr = section->mr;
+    e->addr = section->offset_within_address_space;
+    e->size = int128_get64(section->size);
+    e->offset = section->offset_within_region;
+    e->flags = section->readonly ? RP_RAM_MAP_READONLY : 0;
+    e->path = path;
+    QTAILQ_INSERT_TAIL(&s->ram_exports, e, next);
+
+    if (s->ram_announce) {
+        rp_ram_announce(s, e, 0);
+    }
+}
+
+static void rp_ram_region_del(MemoryListener *listener,
+                              MemoryRegionSection *section)
+{
+    RemotePortMemorySlave *s = container_of(listener, RemotePortMemorySlave,
+                                            ram_listener);
+    RemotePortRamExport *e, *next;
+
+    QTAILQ_FOREACH_SAFE(e, &s->ram_exports, next, next) {
+        if (e->mr != section->mr
+            || e->addr != section->offset_within_address_space) {
+            continue;
+        }
+        if (s->ram_announce) {
+            rp_ram_announce(s, e, RP_RAM_MAP_UNMAP);
+        }
+        QTAILQ_REMOVE(&s->ram_exports, e, next);
+        g_free(e->path);
+        g_free(e);
+    }
+}
+
+/*
+ * The peer stores into shared RAM behind our back. Conservatively mark
+ * everything it may have written as dirty whenever the dirty log is
+ * synced, so migration and snapshots pick up its updates.
+ */
+static void rp_ram_log_sync(MemoryListener *listener,
+                            MemoryRegionSection *section)
+{
+    RemotePortMemorySlave *s = container_of(listener, RemotePortMemorySlave,
+                                            ram_listener);
+    RemotePortRamExport *e;
+
+    if (!s->ram_announce) {
+        return;
+    }
+
+    QTAILQ_FOREACH(e, &s->ram_exports, next) {
+        if (e->mr == section->mr && !(e->flags & RP_RAM_MAP_READONLY)) {
+            memory_region_set_dirty(section->mr,
+                                    section->offset_within_region,
+                                    int128_get64(section->size));
+            break;
+        }
+    }
+}
+
+static void rp_ram_hello(Notifier *notifier, void *data)
+{
+    RemotePortMemorySlave *s = container_of(notifier, RemotePortMemorySlave,
+                                            hello_notifier);
+    RemotePortRamExport *e;
+
+    if (!s->peer->caps.ram_map) {
+        qemu_log_mask(LOG_UNIMP, "%s: peer can't map RAM, using packets\n",
+                      object_get_canonical_path(OBJECT(s)));
+        return;
+    }
+
+    s->ram_announce = true;
+    QTAILQ_FOREACH(e, &s->ram_exports, next) {
+        rp_ram_announce(s, e, 0);
+    }
+}
+
 static void rp_memory_slave_realize(DeviceState *dev, Error **errp)
 {
     RemotePortMemorySlave *s = REMOTE_PORT_MEMORY_SLAVE(dev);
@@ -125,6 +319,19 @@ static void rp_memory_slave_realize(DeviceState *dev, Error **errp)
     } else {
         s->as = &address_space_memory;
     }
+
+    if (s->share_ram) {
+        QTAILQ_INIT(&s->ram_exports);
+        s->ram_listener = (MemoryListener) {
+            .region_add = rp_ram_region_add,
+            .region_del = rp_ram_region_del,
+            .log_sync = rp_ram_log_sync,
+        };
+        memory_listener_register(&s->ram_listener, s->as);
+
+        s->hello_notifier.notify = rp_ram_hello;
+        rp_add_hello_notifier(s->rp, &s->hello_notifier);
+    }
 }
 
 static void rp_memory_slave_write(RemotePortDevice *s, struct rp_pkt *pkt)
@@ -155,6 +362,12 @@ static void rp_memory_slave_init(Object *obj)
                              &error_abort);
 }
 
+static Property rp_memory_slave_properties[] = {
+    DEFINE_PROP_UINT32("rp-chan0", RemotePortMemorySlave, rp_dev, 0),
+    DEFINE_PROP_BOOL("share-ram", RemotePortMemorySlave, share_ram, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void rp_memory_slave_class_init(ObjectClass *oc, void *data)
 {
     RemotePortDeviceClass *rpdc = REMOTE_PORT_DEVICE_CLASS(oc);
@@ -163,6 +376,7 @@ static void rp_memory_slave_class_init(ObjectClass *oc, void *data)
     rpdc->ops[RP_CMD_write] = rp_memory_slave_write;
     rpdc->ops[RP_CMD_read] = rp_memory_slave_read;
     dc->realize = rp_memory_slave_realize;
+    dc->props = rp_memory_slave_properties;
 }
 
 static const TypeInfo rp_info = {
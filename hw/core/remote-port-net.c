@@ -31,6 +31,7 @@
 #include "sysemu/dma.h"
 #include "hw/hw.h"
 #include "net/net.h"
+#include "qemu/main-loop.h"
 
 #include "hw/remote-port.h"
 #include "hw/remote-port-device.h"
@@ -41,6 +42,17 @@
     }             \
 } while (0);
 
+/*
+ * Batched transfers are writes to RP_NET_BATCH_ADDR, in both directions.
+ * The payload is a sequence of frames, each a 32-bit little endian
+ * length followed by the frame and padding up to the next 4 bytes.
+ * Plain writes to any other address carry a single frame.
+ */
+#define RP_NET_BATCH_ADDR 0x100
+#define RP_NET_BATCH_ALIGN 4
+/* Room for the largest frame a backend hands over.  */
+#define RP_NET_BATCH_SIZE (72 * 1024)
+
 #define TYPE_REMOTE_PORT_NET "remote-port-net"
 #define REMOTE_PORT_NET(obj) \
     OBJECT_CHECK(struct RemotePortNet, (obj), TYPE_REMOTE_PORT_NET)
@@ -63,6 +75,16 @@ typedef struct RemotePortNet {
     RemotePortNetChannel tx;
 
     RemotePortDynPkt rsp;
+
+    /* Frames from the NIC backend packed up for the peer, batch mode.  */
+    bool batch;
+    uint32_t rxq_depth;
+    struct {
+        struct rp_pkt_busaccess_ext_base *pkt;
+        size_t len;
+        uint32_t frames;
+        QEMUBH *bh;
+    } rxq;
 } RemotePortNet;
 
 static void rp_net_tx(RemotePortDevice *rpd, struct rp_pkt *pkt)
@@ -91,13 +113,102 @@ static void rp_net_tx(RemotePortDevice *rpd, struct rp_pkt *pkt)
 
         rp_write(s->tx.rp, (void *)rsp.pkt, enclen);
     }
+    if (pkt->busaccess.addr == RP_NET_BATCH_ADDR) {
+        uint32_t pos = 0;
+
+        while (pos + sizeof(uint32_t) <= pkt->busaccess.len) {
+            uint32_t len = ldl_le_p(data + pos);
+
+            pos += sizeof(uint32_t);
+            if (len > pkt->busaccess.len - pos) {
+                error_report("%s: truncated frame in batch", __func__);
+                break;
+            }
+            qemu_send_packet(qemu_get_queue(s->nic), data + pos, len);
+            pos += ROUND_UP(len, RP_NET_BATCH_ALIGN);
+        }
+        return;
+    }
+
     qemu_send_packet(qemu_get_queue(s->nic),
                      data,  pkt->busaccess.len);
 }
 
+/* Push the frames packed up so far to the peer in one write.  */
+static void rp_net_rx_flush(RemotePortNet *s)
+{
+    struct rp_encode_busaccess_in in = {0};
+    size_t len;
+
+    if (!s->rxq.frames) {
+        return;
+    }
+
+    in.cmd = RP_CMD_write;
+    in.flags = RP_PKT_FLAGS_posted;
+    in.id = rp_new_id(s->rx.rp);
+    in.dev = s->rx.rp_dev;
+    in.clk = rp_normalized_vmclk(s->rx.rp);
+    in.master_id = 0;
+    in.addr = RP_NET_BATCH_ADDR;
+    in.attr = RP_BUS_ATTR_EOP;
+    in.size = s->rxq.len;
+    in.stream_width = s->rxq.len;
+    len = rp_encode_busaccess(s->rx.peer, s->rxq.pkt, &in);
+    len += s->rxq.len;
+
+    rp_write(s->rx.rp, (void *)s->rxq.pkt, len);
+    s->rxq.len = 0;
+    s->rxq.frames = 0;
+}
+
+static void rp_net_rx_bh(void *opaque)
+{
+    RemotePortNet *s = opaque;
+
+    rp_net_rx_flush(s);
+    qemu_flush_queued_packets(qemu_get_queue(s->nic));
+}
+
+/*
+ * Pack a frame up for the peer. Writes go out once rx-queue-depth frames
+ * are in, or right after the current burst from the backend.
+ */
+static ssize_t rp_net_rx_batch(RemotePortNet *s, const uint8_t *buf,
+                               size_t size)
+{
+    size_t need = sizeof(uint32_t) + ROUND_UP(size, RP_NET_BATCH_ALIGN);
+    uint8_t *data;
+
+    if (need > RP_NET_BATCH_SIZE) {
+        error_report("%s: %zu byte frame dropped", __func__, size);
+        return size;
+    }
+    if (s->rxq.len + need > RP_NET_BATCH_SIZE) {
+        rp_net_rx_flush(s);
+    }
+
+    data = rp_busaccess_tx_dataptr(s->rx.peer, s->rxq.pkt) + s->rxq.len;
+    stl_le_p(data, size);
+    memcpy(data + sizeof(uint32_t), buf, size);
+    memset(data + sizeof(uint32_t) + size, 0,
+           need - sizeof(uint32_t) - size);
+    s->rxq.len += need;
+    s->rxq.frames++;
+
+    if (s->rxq.frames >= s->rxq_depth) {
+        rp_net_rx_flush(s);
+    } else {
+        qemu_bh_schedule(s->rxq.bh);
+    }
+    return size;
+}
+
 static int rp_net_can_rx(NetClientState *nc)
 {
-    return true;
+    struct RemotePortNet *s = qemu_get_nic_opaque(nc);
+
+    return !s->batch || s->rxq.frames < s->rxq_depth;
 }
 
 #define RP_NET_MAX_PACKET_SIZE (4 * 1024)
@@ -112,6 +223,10 @@ static ssize_t rp_net_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     struct rp_encode_busaccess_in in = {0};
     int len;
 
+    if (s->batch) {
+        return rp_net_rx_batch(s, buf, size);
+    }
+
     memcpy(data, buf, size);
 
     in.cmd = RP_CMD_write;
@@ -133,6 +248,13 @@ static ssize_t rp_net_rx(NetClientState *nc, const uint8_t *buf, size_t size)
 
 static void rp_net_reset(DeviceState *dev)
 {
+    struct RemotePortNet *s = REMOTE_PORT_NET(dev);
+
+    if (s->batch) {
+        qemu_bh_cancel(s->rxq.bh);
+        s->rxq.len = 0;
+        s->rxq.frames = 0;
+    }
 }
 
 static NetClientInfo net_rp_net_info = {
@@ -164,6 +286,15 @@ static void rp_net_realize(DeviceState *dev, Error **errp)
     s->rx.peer = rp_get_peer(s->rx.rp);
     s->tx.peer = rp_get_peer(s->tx.rp);
 
+    if (s->batch) {
+        if (!s->rxq_depth) {
+            error_setg(errp, "rx-queue-depth must be non-zero");
+            return;
+        }
+        s->rxq.pkt = g_malloc(sizeof(*s->rxq.pkt) + RP_NET_BATCH_SIZE);
+        s->rxq.bh = qemu_bh_new(rp_net_rx_bh, s);
+    }
+
     qemu_macaddr_default_if_unset(&s->conf.macaddr);
     s->nic = qemu_new_nic(&net_rp_net_info, &s->conf,
                           object_get_typename(OBJECT(dev)), dev->id, s);
@@ -189,6 +320,8 @@ static void rp_net_init(Object *obj)
 static Property rp_net_properties[] = {
     DEFINE_PROP_UINT32("rp-chan0", RemotePortNet, rx.rp_dev, 0),
     DEFINE_PROP_UINT32("rp-chan1", RemotePortNet, tx.rp_dev, 0),
+    DEFINE_PROP_BOOL("batch", RemotePortNet, batch, false),
+    DEFINE_PROP_UINT32("rx-queue-depth", RemotePortNet, rxq_depth, 32),
     DEFINE_NIC_PROPERTIES(struct RemotePortNet, conf),
     DEFINE_PROP_END_OF_LIST(),
 };
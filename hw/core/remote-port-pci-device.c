@@ -14,6 +14,8 @@
 #include "qapi/error.h"
 #include "hw/pci/pci.h"
 #include "hw/sysbus.h"
+#include "qemu/timer.h"
+#include "sysemu/hostmem.h"
 
 #include "hw/remote-port.h"
 #include "hw/remote-port-device.h"
@@ -61,13 +63,34 @@
 #define RPDEV_PCI_DMA           3
 #define RPDEV_PCI_BAR_BASE     10
 
+/* Doorbell writes pending per BAR before they are flushed early.  */
+#define RP_PCI_MAX_DOORBELLS    8
+
 typedef struct RemotePortPCIDevice RemotePortPCIDevice;
 
+typedef struct RemotePortDoorbell {
+    hwaddr addr;
+    uint64_t value;
+    unsigned size;
+    MemTxAttrs attr;
+} RemotePortDoorbell;
+
 typedef struct RemotePortMap {
     RemotePortPCIDevice *parent;
     MemoryRegion iomem;
     uint32_t rp_dev;
     uint64_t offset;
+
+    /*
+     * BARs backed by a shared memory backend are accessed directly by
+     * both sides. Only writes to the doorbell window go to the peer, the
+     * last value written to each register within a sync quantum.
+     */
+    MemoryRegion doorbell;
+    hwaddr doorbell_offset;
+    QEMUTimer *doorbell_timer;
+    RemotePortDoorbell doorbells[RP_PCI_MAX_DOORBELLS];
+    unsigned int nr_doorbells;
 } RemotePortMap;
 
 struct RemotePortPCIDevice {
@@ -84,6 +107,9 @@ struct RemotePortPCIDevice {
         uint32_t nr_io_bars;
         uint32_t nr_mm_bars;
         uint64_t bar_size[6];
+        HostMemoryBackend *bar_memdev[6];
+        uint64_t bar_doorbell_offset[6];
+        uint64_t bar_doorbell_size[6];
         uint32_t nr_devs;
         uint32_t vendor_id;
         uint32_t device_id;
@@ -94,6 +120,8 @@ struct RemotePortPCIDevice {
     } cfg;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
+    /* Number of BARs with BAR-mapped shared memory, i.e doorbells.  */
+    unsigned int nr_shared_bars;
 };
 
 static uint64_t rp_io_read(void *opaque, hwaddr addr, unsigned size,
@@ -201,6 +229,85 @@ static void rp_io_write(void *opaque, hwaddr addr, uint64_t value,
     DB_PRINT_L(1, "\n");
 }
 
+static void rp_doorbell_flush(RemotePortMap *map)
+{
+    unsigned int i;
+
+    timer_del(map->doorbell_timer);
+    for (i = 0; i < map->nr_doorbells; i++) {
+        RemotePortDoorbell *db = &map->doorbells[i];
+
+        rp_io_write(map, db->addr, db->value, db->size, db->attr);
+    }
+    map->nr_doorbells = 0;
+}
+
+/*
+ * Reads and writes through the other BARs or config space must not pass
+ * the doorbell writes that are still pending.
+ */
+static void rp_doorbell_flush_all(RemotePortPCIDevice *s)
+{
+    unsigned int i;
+
+    if (!s->nr_shared_bars) {
+        return;
+    }
+    for (i = 0; i < s->cfg.nr_io_bars + s->cfg.nr_mm_bars; i++) {
+        if (s->maps[i].nr_doorbells) {
+            rp_doorbell_flush(&s->maps[i]);
+        }
+    }
+}
+
+static void rp_doorbell_timer(void *opaque)
+{
+    rp_doorbell_flush(opaque);
+}
+
+static void rp_doorbell_access(MemoryTransaction *tr)
+{
+    RemotePortMap *map = tr->opaque;
+    RemotePortPCIDevice *s = map->parent;
+    hwaddr addr = map->doorbell_offset + tr->addr;
+    RemotePortDoorbell *db;
+    unsigned int i;
+
+    if (!tr->rw) {
+        rp_doorbell_flush_all(s);
+        tr->data.u64 = rp_io_read(map, addr, tr->size, tr->attr);
+        return;
+    }
+
+    for (i = 0; i < map->nr_doorbells; i++) {
+        db = &map->doorbells[i];
+        if (db->addr == addr && db->size == tr->size) {
+            db->value = tr->data.u64;
+            db->attr = tr->attr;
+            return;
+        }
+    }
+
+    if (map->nr_doorbells == RP_PCI_MAX_DOORBELLS) {
+        rp_doorbell_flush(map);
+    }
+    map->doorbells[map->nr_doorbells++] = (RemotePortDoorbell) {
+        .addr = addr,
+        .value = tr->data.u64,
+        .size = tr->size,
+        .attr = tr->attr,
+    };
+    if (!timer_pending(map->doorbell_timer)) {
+        timer_mod(map->doorbell_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + s->rp->sync.quantum);
+    }
+}
+
+static const MemoryRegionOps rp_doorbell_ops = {
+    .access = rp_doorbell_access,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+};
+
 static void rp_io_access(MemoryTransaction *tr)
 {
     MemTxAttrs attr = tr->attr;
@@ -210,6 +317,7 @@ static void rp_io_access(MemoryTransaction *tr)
     uint64_t value = tr->data.u64;;
     bool is_write = tr->rw;
 
+    rp_doorbell_flush_all(((RemotePortMap *) opaque)->parent);
     if (is_write) {
         rp_io_write(opaque, addr, value, size, attr);
     } else {
@@ -240,6 +348,7 @@ static void rp_pci_write_config(PCIDevice *pci_dev, uint32_t addr,
 
     DB_PRINT_L(0, "addr: %x data: %x\n", addr, value);
 
+    rp_doorbell_flush_all(s);
     for (i = 0; i < 8; i++) {
         data[i] = value >> (i * 8);
     }
@@ -286,6 +395,57 @@ static void rp_gpio_interrupt(RemotePortDevice *rpd, struct rp_pkt *pkt)
     pci_set_irq(d, level);
 }
 
+static bool rp_pci_init_shared_bar(RemotePortPCIDevice *s,
+                                   RemotePortMap *map, int bar,
+                                   const char *name, Error **errp)
+{
+    HostMemoryBackend *backend = s->cfg.bar_memdev[bar];
+    uint64_t db_offset = s->cfg.bar_doorbell_offset[bar];
+    uint64_t db_size = s->cfg.bar_doorbell_size[bar];
+    MemoryRegion *ram;
+
+    if (host_memory_backend_is_mapped(backend)) {
+        error_setg(errp, "memory backend %s for BAR %d is already in use",
+                   object_get_canonical_path_component(OBJECT(backend)),
+                   bar);
+        return false;
+    }
+    ram = host_memory_backend_get_memory(backend, errp);
+    if (!ram) {
+        return false;
+    }
+    if (memory_region_size(ram) > s->cfg.bar_size[bar]) {
+        error_setg(errp, "memory backend for BAR %d is larger than "
+                   "bar-size%d", bar, bar);
+        return false;
+    }
+    if (db_size && (db_offset >= s->cfg.bar_size[bar]
+                    || db_size > s->cfg.bar_size[bar] - db_offset)) {
+        error_setg(errp, "doorbell window of BAR %d is out of range", bar);
+        return false;
+    }
+
+    memory_region_init(&map->iomem, OBJECT(s), name, s->cfg.bar_size[bar]);
+    memory_region_add_subregion(&map->iomem, 0, ram);
+    vmstate_register_ram(ram, DEVICE(s));
+    host_memory_backend_set_mapped(backend, true);
+
+    if (db_size) {
+        char *db_name = g_strdup_printf("%s-doorbell", name);
+
+        memory_region_init_io(&map->doorbell, OBJECT(s), &rp_doorbell_ops,
+                              map, db_name, db_size);
+        memory_region_add_subregion_overlap(&map->iomem, db_offset,
+                                            &map->doorbell, 1);
+        map->doorbell_offset = db_offset;
+        map->doorbell_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                           rp_doorbell_timer, map);
+        g_free(db_name);
+    }
+    s->nr_shared_bars++;
+    return true;
+}
+
 static void rp_pci_realize(PCIDevice *pci_dev, Error **errp)
 {
     RemotePortPCIDevice *s = REMOTE_PORT_PCI_DEVICE(pci_dev);
@@ -321,8 +481,16 @@ static void rp_pci_realize(PCIDevice *pci_dev, Error **errp)
     }
     for (; i < s->cfg.nr_mm_bars; i++) {
         char *name = g_strdup_printf("rp-pci-mmio-%d", i);
-        memory_region_init_io(&s->maps[i].iomem, OBJECT(s), &rp_ops,
-                              &s->maps[i], name, s->cfg.bar_size[i]);
+
+        if (s->cfg.bar_memdev[i]) {
+            if (!rp_pci_init_shared_bar(s, &s->maps[i], i, name, errp)) {
+                g_free(name);
+                return;
+            }
+        } else {
+            memory_region_init_io(&s->maps[i].iomem, OBJECT(s), &rp_ops,
+                                  &s->maps[i], name, s->cfg.bar_size[i]);
+        }
         pci_register_bar(pci_dev, s->cfg.nr_io_bars + i,
                          PCI_BASE_ADDRESS_SPACE_MEMORY,
                          &s->maps[i].iomem);
@@ -384,6 +552,48 @@ static Property rp_properties[] = {
     DEFINE_PROP_UINT64("bar-size5", RemotePortPCIDevice,
                                     cfg.bar_size[5], 0x1000),
 
+    /*
+     * Memory BARs backed by shared memory, e.g memory-backend-file with
+     * share=on, that the peer maps as well. Only the optional doorbell
+     * window of such a BAR is forwarded to the peer.
+     */
+    DEFINE_PROP_LINK("bar-memdev0", RemotePortPCIDevice, cfg.bar_memdev[0],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("bar-memdev1", RemotePortPCIDevice, cfg.bar_memdev[1],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("bar-memdev2", RemotePortPCIDevice, cfg.bar_memdev[2],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("bar-memdev3", RemotePortPCIDevice, cfg.bar_memdev[3],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("bar-memdev4", RemotePortPCIDevice, cfg.bar_memdev[4],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_LINK("bar-memdev5", RemotePortPCIDevice, cfg.bar_memdev[5],
+                     TYPE_MEMORY_BACKEND, HostMemoryBackend *),
+    DEFINE_PROP_UINT64("bar-doorbell-offset0", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_offset[0], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-offset1", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_offset[1], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-offset2", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_offset[2], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-offset3", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_offset[3], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-offset4", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_offset[4], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-offset5", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_offset[5], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-size0", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_size[0], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-size1", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_size[1], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-size2", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_size[2], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-size3", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_size[3], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-size4", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_size[4], 0),
+    DEFINE_PROP_UINT64("bar-doorbell-size5", RemotePortPCIDevice,
+                                    cfg.bar_doorbell_size[5], 0),
+
     /* These are read-only.  */
     DEFINE_PROP_UINT32("nr-devs", RemotePortPCIDevice, cfg.nr_devs, 20),
     DEFINE_PROP_END_OF_LIST()
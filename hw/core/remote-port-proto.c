@@ -87,6 +87,9 @@ static const char *rp_cmd_names[RP_CMD_max + 1] = {
     [RP_CMD_write] = "write",
     [RP_CMD_interrupt] = "interrupt",
     [RP_CMD_sync] = "sync",
+    [RP_CMD_interrupt_batch] = "interrupt_batch",
+    [RP_CMD_ram_map] = "ram_map",
+    [RP_CMD_checkpoint] = "checkpoint",
 };
 
 const char *rp_cmd_to_string(enum rp_cmd cmd)
@@ -174,6 +177,15 @@ int rp_decode_payload(struct rp_pkt *pkt)
             pext->byte_enable_len = be32toh(pext->byte_enable_len);
 
             used += sizeof *pext - sizeof pkt->busaccess;
+
+            if (pkt->busaccess.attributes & RP_BUS_ATTR_DATA_REF) {
+                struct rp_busaccess_data_ref *ref;
+
+                assert(pext->data_offset + sizeof *ref
+                       <= pkt->hdr.len + sizeof pkt->hdr);
+                ref = (void *) ((char *) pkt + pext->data_offset);
+                ref->offset = be64toh(ref->offset);
+            }
         }
         pkt->busaccess.master_id = master_id;
         break;
@@ -184,10 +196,41 @@ int rp_decode_payload(struct rp_pkt *pkt)
         pkt->interrupt.val = pkt->interrupt.val;
         used += pkt->hdr.len;
         break;
+    case RP_CMD_interrupt_batch: {
+        struct rp_pkt_interrupt_batch *pib = &pkt->interrupt_batch;
+        uint32_t *words = rp_interrupt_batch_changed(pib);
+        unsigned int i;
+
+        assert(pkt->hdr.len >= sizeof *pib - sizeof pkt->hdr);
+        pib->timestamp = be64toh(pib->timestamp);
+        pib->base_line = be32toh(pib->base_line);
+        pib->nr_lines = be32toh(pib->nr_lines);
+        assert(pkt->hdr.len >= sizeof *pib - sizeof pkt->hdr
+               + 2 * RP_INTERRUPT_BATCH_WORDS(pib->nr_lines) * sizeof *words);
+        for (i = 0; i < 2 * RP_INTERRUPT_BATCH_WORDS(pib->nr_lines); i++) {
+            words[i] = be32toh(words[i]);
+        }
+        used += pkt->hdr.len;
+        break;
+    }
     case RP_CMD_sync:
         pkt->sync.timestamp = be64toh(pkt->interrupt.timestamp);
         used += pkt->hdr.len;
         break;
+    case RP_CMD_ram_map:
+        assert(pkt->hdr.len >= sizeof pkt->ram_map - sizeof pkt->hdr);
+        pkt->ram_map.addr = be64toh(pkt->ram_map.addr);
+        pkt->ram_map.size = be64toh(pkt->ram_map.size);
+        pkt->ram_map.offset = be64toh(pkt->ram_map.offset);
+        pkt->ram_map.flags = be32toh(pkt->ram_map.flags);
+        pkt->ram_map.path_len = be32toh(pkt->ram_map.path_len);
+        used += pkt->hdr.len;
+        break;
+    case RP_CMD_checkpoint:
+        assert(pkt->hdr.len >= sizeof pkt->checkpoint - sizeof pkt->hdr);
+        pkt->checkpoint.id = be64toh(pkt->checkpoint.id);
+        used += pkt->hdr.len;
+        break;
     default:
         break;
     }
@@ -312,6 +355,12 @@ size_t rp_encode_busaccess(struct rp_peer_state *peer,
         hsize = in->size;
         ret_size = in->size;
     }
+    if (in->attr & RP_BUS_ATTR_DATA_REF) {
+        /* Data lives in the shared window, we only carry the reference.  */
+        assert(peer->caps.busaccess_data_ref);
+        hsize = sizeof(struct rp_busaccess_data_ref);
+        ret_size = hsize;
+    }
 
     /* If peer does not support the busaccess base extensions, use the
      * old layout. For responses, what matters is if we're responding
@@ -341,6 +390,13 @@ size_t rp_encode_busaccess(struct rp_peer_state *peer,
     pkt->byte_enable_len = htobe32(in->byte_enable_len);
     hsize += in->byte_enable_len;
 
+    if (in->attr & RP_BUS_ATTR_DATA_REF) {
+        struct rp_busaccess_data_ref *ref = (void *) (pkt + 1);
+
+        ref->offset = htobe64(in->data_ref_offset);
+        ref->reserved0 = 0;
+    }
+
     rp_encode_hdr(&pkt->hdr, in->cmd, in->id, in->dev,
                   sizeof *pkt - sizeof pkt->hdr + hsize, in->flags);
     rp_encode_busaccess_common(pkt_v4_0, in->clk, in->master_id, in->addr,
@@ -373,6 +429,58 @@ size_t rp_encode_interrupt(uint32_t id, uint32_t dev,
     return rp_encode_interrupt_f(id, dev, pkt, clk, line, vector, val, 0);
 }
 
+size_t rp_encode_interrupt_batch(uint32_t id, uint32_t dev,
+                                 struct rp_pkt_interrupt_batch *pkt,
+                                 int64_t clk,
+                                 uint32_t base_line, uint32_t nr_lines,
+                                 const uint32_t *changed,
+                                 const uint32_t *vals,
+                                 uint32_t flags)
+{
+    unsigned int nr_words = RP_INTERRUPT_BATCH_WORDS(nr_lines);
+    uint32_t *words = (uint32_t *) (pkt + 1);
+    size_t psize = sizeof *pkt + 2 * nr_words * sizeof *words;
+    unsigned int i;
+
+    rp_encode_hdr(&pkt->hdr, RP_CMD_interrupt_batch, id, dev,
+                  psize - sizeof pkt->hdr, flags);
+    pkt->timestamp = htobe64(clk);
+    pkt->base_line = htobe32(base_line);
+    pkt->nr_lines = htobe32(nr_lines);
+
+    for (i = 0; i < nr_words; i++) {
+        words[i] = htobe32(changed[i]);
+        words[nr_words + i] = htobe32(vals[i]);
+    }
+    return psize;
+}
+
+size_t rp_encode_ram_map(uint32_t id, uint32_t dev,
+                         struct rp_pkt_ram_map *pkt,
+                         uint64_t addr, uint64_t size, uint64_t offset,
+                         uint32_t flags, uint32_t path_len)
+{
+    rp_encode_hdr(&pkt->hdr, RP_CMD_ram_map, id, dev,
+                  sizeof *pkt - sizeof pkt->hdr + path_len,
+                  RP_PKT_FLAGS_posted);
+    pkt->addr = htobe64(addr);
+    pkt->size = htobe64(size);
+    pkt->offset = htobe64(offset);
+    pkt->flags = htobe32(flags);
+    pkt->path_len = htobe32(path_len);
+    return sizeof *pkt;
+}
+
+size_t rp_encode_checkpoint(uint32_t id, uint32_t dev,
+                            struct rp_pkt_checkpoint *pkt,
+                            uint64_t checkpoint_id)
+{
+    rp_encode_hdr(&pkt->hdr, RP_CMD_checkpoint, id, dev,
+                  sizeof *pkt - sizeof pkt->hdr, RP_PKT_FLAGS_posted);
+    pkt->id = htobe64(checkpoint_id);
+    return sizeof *pkt;
+}
+
 static size_t rp_encode_sync_common(uint32_t id, uint32_t dev,
                                     struct rp_pkt_sync *pkt,
                                     int64_t clk, uint32_t flags)
@@ -419,6 +527,18 @@ void rp_process_caps(struct rp_peer_state *peer,
         case CAP_WIRE_POSTED_UPDATES:
             peer->caps.wire_posted_updates = true;
             break;
+        case CAP_BUSACCESS_DATA_REF:
+            peer->caps.busaccess_data_ref = true;
+            break;
+        case CAP_WIRE_BATCHED_UPDATES:
+            peer->caps.wire_batched_updates = true;
+            break;
+        case CAP_RAM_MAP:
+            peer->caps.ram_map = true;
+            break;
+        case CAP_CHECKPOINT_ID:
+            peer->caps.checkpoint_id = true;
+            break;
         }
     }
 }
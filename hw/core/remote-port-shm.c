@@ -0,0 +1,173 @@
+/*
+ * QEMU remote-port shared memory transport.
+ *
+ * Copyright (c) 2018 Xilinx Inc
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/processor.h"
+#include "qemu/host-utils.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#ifdef CONFIG_LINUX
+#include "qemu/futex.h"
+#endif
+
+#include <sys/mman.h>
+
+#include "hw/remote-port-shm.h"
+
+static void rp_shm_doorbell_wait(uint32_t *seq, uint32_t *waiting,
+                                 uint32_t seen)
+{
+    atomic_set(waiting, 1);
+    smp_mb();
+    if (atomic_read(seq) == seen) {
+#ifdef CONFIG_LINUX
+        qemu_futex_wait(seq, seen);
+#else
+        g_usleep(10);
+#endif
+    }
+    atomic_set(waiting, 0);
+}
+
+static void rp_shm_doorbell_ring(uint32_t *seq, uint32_t *waiting)
+{
+    atomic_inc(seq);
+    smp_mb();
+    if (atomic_read(waiting)) {
+#ifdef CONFIG_LINUX
+        qemu_futex_wake(seq, INT_MAX);
+#endif
+    }
+}
+
+void rp_shm_write(RemotePortShm *shm, const void *buf, size_t count)
+{
+    RemotePortShmRing *r = &shm->hdr->tx;
+    const uint8_t *src = buf;
+    uint32_t mask = shm->ring_size - 1;
+    uint32_t spins = 0;
+
+    while (count) {
+        uint32_t head = r->head;
+        uint32_t seq = atomic_read(&r->space_seq);
+        uint32_t space;
+        size_t chunk;
+        size_t first;
+
+        /* Pairs with the release on tail in rp_shm_read.  */
+        space = shm->ring_size - (head - atomic_load_acquire(&r->tail));
+        if (!space) {
+            if (spins++ < shm->poll_spins) {
+                cpu_relax();
+            } else {
+                rp_shm_doorbell_wait(&r->space_seq, &r->producer_waiting, seq);
+            }
+            continue;
+        }
+        spins = 0;
+
+        chunk = MIN(count, space);
+        first = MIN(chunk, shm->ring_size - (head & mask));
+        memcpy(shm->tx_data + (head & mask), src, first);
+        memcpy(shm->tx_data, src + first, chunk - first);
+
+        atomic_store_release(&r->head, head + chunk);
+        rp_shm_doorbell_ring(&r->data_seq, &r->consumer_waiting);
+        src += chunk;
+        count -= chunk;
+    }
+}
+
+void rp_shm_read(RemotePortShm *shm, void *buf, size_t count)
+{
+    RemotePortShmRing *r = &shm->hdr->rx;
+    uint8_t *dst = buf;
+    uint32_t mask = shm->ring_size - 1;
+    uint32_t spins = 0;
+
+    while (count) {
+        uint32_t tail = r->tail;
+        uint32_t seq = atomic_read(&r->data_seq);
+        uint32_t used;
+        size_t chunk;
+        size_t first;
+
+        /* Pairs with the release on head in the producer.  */
+        used = atomic_load_acquire(&r->head) - tail;
+        if (!used) {
+            if (spins++ < shm->poll_spins) {
+                cpu_relax();
+            } else {
+                rp_shm_doorbell_wait(&r->data_seq, &r->consumer_waiting, seq);
+            }
+            continue;
+        }
+        spins = 0;
+
+        chunk = MIN(count, used);
+        first = MIN(chunk, shm->ring_size - (tail & mask));
+        memcpy(dst, shm->rx_data + (tail & mask), first);
+        memcpy(dst + first, shm->rx_data, chunk - first);
+
+        atomic_store_release(&r->tail, tail + chunk);
+        rp_shm_doorbell_ring(&r->space_seq, &r->producer_waiting);
+        dst += chunk;
+        count -= chunk;
+    }
+}
+
+bool rp_shm_init(RemotePortShm *shm, const char *path, uint32_t ring_size,
+                 uint32_t poll_spins, Error **errp)
+{
+    void *p;
+
+    if (!is_power_of_2(ring_size) || ring_size < 4096) {
+        error_setg(errp, "shm ring size %u must be a power of 2 >= 4096",
+                   ring_size);
+        return false;
+    }
+
+    shm->ring_size = ring_size;
+    shm->poll_spins = poll_spins;
+    shm->map_size = sizeof *shm->hdr + 2 * (size_t) ring_size;
+
+    shm->fd = qemu_open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (shm->fd < 0) {
+        error_setg_errno(errp, errno, "Unable to open %s", path);
+        return false;
+    }
+
+    if (ftruncate(shm->fd, shm->map_size) < 0) {
+        error_setg_errno(errp, errno, "Unable to size %s", path);
+        goto fail;
+    }
+
+    p = mmap(NULL, shm->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+             shm->fd, 0);
+    if (p == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Unable to map %s", path);
+        goto fail;
+    }
+
+    shm->hdr = p;
+    shm->tx_data = (uint8_t *) p + sizeof *shm->hdr;
+    shm->rx_data = shm->tx_data + ring_size;
+
+    memset(shm->hdr, 0, sizeof *shm->hdr);
+    shm->hdr->version = RP_SHM_VERSION;
+    shm->hdr->ring_size = ring_size;
+    /* Publish the region to the peer.  */
+    atomic_store_release(&shm->hdr->magic, RP_SHM_MAGIC);
+    return true;
+
+fail:
+    qemu_close(shm->fd);
+    shm->fd = -1;
+    return false;
+}
@@ -27,11 +27,14 @@
 #include "qemu/log.h"
 
 #include "qemu/bitops.h"
+#include "qemu/iov.h"
+#include "qemu/queue.h"
 #include "qapi/qmp/qerror.h"
 #include "hw/register-dep.h"
 #include "hw/stream.h"
 #include "qapi/error.h"
 #include "hw/remote-port-device.h"
+#include "hw/remote-port.h"
 
 #ifndef REMOTE_PORT_STREAM_ERR_DEBUG
 #define REMOTE_PORT_STREAM_ERR_DEBUG 0
@@ -44,6 +47,15 @@
 
 typedef struct RemotePortStream RemotePortStream;
 
+/* A packet from the peer waiting to be pushed to tx_dev.  */
+typedef struct RemotePortStreamRxPkt {
+    struct rp_pkt pkt;
+    uint8_t *data;
+    size_t len;
+    size_t pos;
+    QSIMPLEQ_ENTRY(RemotePortStreamRxPkt) next;
+} RemotePortStreamRxPkt;
+
 struct RemotePortStream {
     DeviceState parent_obj;
 
@@ -51,70 +63,91 @@ struct RemotePortStream {
     uint32_t rp_dev;
     uint16_t stream_width;
 
+    /*
+     * Credit based flow control for pushes towards the peer. Up to
+     * tx_credits packets may be in flight, each response returns a
+     * credit. 0 means every push waits for its response.
+     */
+    uint32_t tx_credits;
+    uint32_t tx_inflight;
+
     StreamSlave *tx_dev;
 
     StreamCanPushNotifyFn notify;
     void *notify_opaque;
 
-    uint8_t *buf;
-    struct rp_pkt pkt;
-
-    bool rsp_pending;
-    uint32_t current_id;
+    QSIMPLEQ_HEAD(, RemotePortStreamRxPkt) rx_queue;
 };
 
 static void rp_stream_notify(void *opaque)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(opaque);
 
-    /* FIXME: This is completely bogus.  */
-    if (s->buf && stream_can_push(s->tx_dev, rp_stream_notify, s)) {
-        RemotePortDynPkt rsp;
+    while (!QSIMPLEQ_EMPTY(&s->rx_queue)
+           && stream_can_push(s->tx_dev, rp_stream_notify, s)) {
+        RemotePortStreamRxPkt *rx = QSIMPLEQ_FIRST(&s->rx_queue);
         struct rp_encode_busaccess_in in = {0};
-        size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base);
+        struct rp_pkt_busaccess_ext_base rsp;
+        uint32_t attr = 0;
         size_t enclen;
         int64_t delay = 0; /* FIXME - Implement */
 
-        size_t ret = stream_push(s->tx_dev, s->buf, 4, 0);
-        assert(ret == 4);
-        s->buf = NULL;
+        if (rx->pkt.busaccess.attributes & RP_BUS_ATTR_EOP) {
+            attr |= STREAM_ATTR_EOP;
+        }
+        rx->pos += stream_push(s->tx_dev, rx->data + rx->pos,
+                               rx->len - rx->pos, attr);
+        if (rx->pos < rx->len) {
+            /* Short push, the sink will notify us.  */
+            break;
+        }
 
-        memset(&rsp, 0, sizeof(rsp));
-        rp_dpkt_alloc(&rsp, pktlen);
-        rp_encode_busaccess_in_rsp_init(&in, &s->pkt);
-        in.clk = s->pkt.busaccess.timestamp + delay;
-        enclen = rp_encode_busaccess(rp_get_peer(s->rp),
-                                     &rsp.pkt->busaccess_ext_base,
-                                     &in);
-        assert(enclen <= pktlen);
+        rp_encode_busaccess_in_rsp_init(&in, &rx->pkt);
+        in.clk = rx->pkt.busaccess.timestamp + delay;
+        enclen = rp_encode_busaccess(rp_get_peer(s->rp), &rsp, &in);
+        assert(enclen <= sizeof rsp);
+        rp_write(s->rp, (void *) &rsp, enclen);
 
-        rp_write(s->rp, (void *)rsp.pkt, pktlen);
+        QSIMPLEQ_REMOVE_HEAD(&s->rx_queue, next);
+        g_free(rx->data);
+        g_free(rx);
     }
 }
 
 static void rp_stream_write(RemotePortDevice *obj, struct rp_pkt *pkt)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
+    RemotePortStreamRxPkt *rx;
+    uint8_t *data;
 
     assert(pkt->busaccess.width == 0);
     assert(pkt->busaccess.stream_width == pkt->busaccess.len);
     assert(pkt->busaccess.addr == 0);
 
     if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
-        /* FXIME - probably need to do syncs and stuff */
-        assert(s->rsp_pending);
-        s->rsp_pending = false;
+        /* A credit came back.  */
+        assert(s->tx_inflight);
+        s->tx_inflight--;
         if (s->notify) {
             StreamCanPushNotifyFn notify = s->notify;
             s->notify = NULL;
             notify(s->notify_opaque);
         }
-    } else {
-        assert(!s->buf);
-        s->buf = g_memdup(pkt + 1, 4);
-        s->pkt = *pkt;
-        rp_stream_notify(s);
+        return;
     }
+
+    /*
+     * Queue the packet and only respond once it has been pushed. The peer
+     * may keep several packets in flight.
+     */
+    data = rp_busaccess_rx_dataptr(rp_get_peer(s->rp),
+                                   &pkt->busaccess_ext_base);
+    rx = g_new0(RemotePortStreamRxPkt, 1);
+    rx->pkt = *pkt;
+    rx->len = pkt->busaccess.len;
+    rx->data = g_memdup(data, rx->len);
+    QSIMPLEQ_INSERT_TAIL(&s->rx_queue, rx, next);
+    rp_stream_notify(s);
 }
 
 static bool rp_stream_stream_can_push(StreamSlave *obj,
@@ -123,7 +156,7 @@ static bool rp_stream_stream_can_push(StreamSlave *obj,
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
 
-    if (s->rsp_pending) {
+    if (s->tx_credits && s->tx_inflight >= s->tx_credits) {
         s->notify = notify;
         s->notify_opaque = notify_opaque;
         return false;
@@ -131,17 +164,25 @@ static bool rp_stream_stream_can_push(StreamSlave *obj,
     return true;
 }
 
-static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
-                                    size_t len, uint32_t attr)
+static size_t rp_stream_stream_pushv(StreamSlave *obj,
+                                     const struct iovec *iov, int iovcnt,
+                                     uint32_t attr)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
     RemotePortDynPkt rsp;
     struct rp_pkt_busaccess_ext_base pkt;
     struct rp_encode_busaccess_in in = {0};
     uint64_t rp_attr = stream_attr_has_eop(attr) ? RP_BUS_ATTR_EOP : 0;
+    size_t len = iov_size(iov, iovcnt);
+    struct iovec *wiov;
     int64_t clk;
     int enclen;
 
+    if (s->tx_credits && s->tx_inflight >= s->tx_credits) {
+        /* Out of credits, the master should have checked can_push.  */
+        return 0;
+    }
+
     clk = rp_normalized_vmclk(s->rp);
 
     in.cmd = RP_CMD_write;
@@ -153,22 +194,58 @@ static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
     in.stream_width = s->stream_width;
     enclen = rp_encode_busaccess(rp_get_peer(s->rp), &pkt, &in);
 
+    wiov = g_new(struct iovec, iovcnt + 1);
+    wiov[0].iov_base = &pkt;
+    wiov[0].iov_len = enclen;
+    memcpy(wiov + 1, iov, iovcnt * sizeof *iov);
+
+    if (s->tx_credits) {
+        s->tx_inflight++;
+        rp_writev(s->rp, wiov, iovcnt + 1);
+        g_free(wiov);
+        rp_leave_iothread(s->rp);
+        return len;
+    }
+
     rp_rsp_mutex_lock(s->rp);
-    rp_write(s->rp, (void *) &pkt, enclen);
-    rp_write(s->rp, buf, len);
+    rp_writev(s->rp, wiov, iovcnt + 1);
     rsp = rp_wait_resp(s->rp);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pkt.hdr.id));
     rp_dpkt_invalidate(&rsp);
     rp_rsp_mutex_unlock(s->rp);
+    g_free(wiov);
     rp_restart_sync_timer(s->rp);
     rp_leave_iothread(s->rp);
     return len;
 }
 
+static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
+                                    size_t len, uint32_t attr)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return rp_stream_stream_pushv(obj, &iov, 1, attr);
+}
+
+static void rp_stream_realize(DeviceState *dev, Error **errp)
+{
+    RemotePortStream *s = REMOTE_PORT_STREAM(dev);
+
+    if (s->tx_credits) {
+        if (!s->rp) {
+            error_setg(errp, "%s: tx-credits requires rp-adaptor0",
+                       TYPE_REMOTE_PORT_STREAM);
+            return;
+        }
+        rp_dev_set_async_responses(s->rp, s->rp_dev, true);
+    }
+}
+
 static void rp_stream_init(Object *obj)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
 
+    QSIMPLEQ_INIT(&s->rx_queue);
     object_property_add_link(obj, "axistream-connected",
                              TYPE_STREAM_SLAVE, (Object **) &s->tx_dev,
                              qdev_prop_allow_set_link_before_realize,
@@ -184,6 +261,7 @@ static void rp_stream_init(Object *obj)
 static Property rp_properties[] = {
     DEFINE_PROP_UINT32("rp-chan0", RemotePortStream, rp_dev, 0),
     DEFINE_PROP_UINT16("stream-width", RemotePortStream, stream_width, 4),
+    DEFINE_PROP_UINT32("tx-credits", RemotePortStream, tx_credits, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -194,8 +272,10 @@ static void rp_stream_class_init(ObjectClass *oc, void *data)
     RemotePortDeviceClass *rpdc = REMOTE_PORT_DEVICE_CLASS(oc);
 
     ssc->push = rp_stream_stream_push;
+    ssc->pushv = rp_stream_stream_pushv;
     ssc->can_push = rp_stream_stream_can_push;
     dc->props = rp_properties;
+    dc->realize = rp_stream_realize;
     rpdc->ops[RP_CMD_write] = rp_stream_write;
 }
 
@@ -16,8 +16,13 @@
 #include "hw/ptimer.h"
 #include "qemu/sockets.h"
 #include "qemu/thread.h"
+#include "qemu/main-loop.h"
 #include "qemu/log.h"
+#include "qemu/host-utils.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qmp-commands.h"
+#include "sysemu/telemetry.h"
 #include "qemu/error-report.h"
 #include "qom/cpu.h"
 
@@ -93,7 +98,26 @@ int64_t rp_normalized_vmclk(RemotePort *s)
     return clk;
 }
 
-void rp_restart_sync_timer(RemotePort *s)
+/* Nothing happens locally before the next virtual clock deadline, there
+ * is no point in breaking the peers out of their quantum before it.
+ * Must be called with our own sync timer stopped.
+ */
+static uint64_t rp_sync_tickless_quantum(RemotePort *s)
+{
+    int64_t deadline;
+
+    if (!s->sync.tickless || atomic_read(&s->sync.activity)) {
+        return s->sync.quantum;
+    }
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL);
+    if (deadline < 0 || deadline > s->sync.quantum_max) {
+        return s->sync.quantum_max;
+    }
+    return MAX(deadline, s->sync.quantum);
+}
+
+static void rp_sync_timer_rearm(RemotePort *s)
 {
     if (!s->do_sync) {
         return;
@@ -101,11 +125,43 @@ void rp_restart_sync_timer(RemotePort *s)
 
     if (s->sync.quantum) {
         ptimer_stop(s->sync.ptimer);
-        ptimer_set_limit(s->sync.ptimer, s->sync.quantum, 1);
+        ptimer_set_limit(s->sync.ptimer, rp_sync_tickless_quantum(s), 1);
         ptimer_run(s->sync.ptimer, 1);
     }
 }
 
+/* Flag traffic for the adaptive and tickless quantum logic.  */
+static void rp_sync_note_activity(RemotePort *s)
+{
+    if (s->sync.adaptive || s->sync.tickless) {
+        atomic_set(&s->sync.activity, true);
+    }
+}
+
+void rp_restart_sync_timer(RemotePort *s)
+{
+    rp_sync_note_activity(s);
+    rp_sync_timer_rearm(s);
+}
+
+/* Pick the quantum for the next sync period.  */
+static void rp_sync_adapt_quantum(RemotePort *s)
+{
+    uint64_t base = s->peer.local_cfg.quantum;
+
+    if (!s->sync.adaptive) {
+        atomic_set(&s->sync.activity, false);
+        return;
+    }
+
+    if (atomic_xchg(&s->sync.activity, false)) {
+        s->sync.quantum = MAX(s->sync.quantum / 2, base);
+    } else {
+        s->sync.quantum = MIN(s->sync.quantum * 2, s->sync.quantum_max);
+    }
+    SYNCD(printf("%s: quantum %" PRIu64 "\n", s->prefix, s->sync.quantum));
+}
+
 static void rp_fatal_error(RemotePort *s, const char *reason)
 {
     int64_t clk = rp_normalized_vmclk(s);
@@ -117,6 +173,20 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
 {
     ssize_t r;
 
+    if (s->trace.replay) {
+        if (fread(buf, count, 1, s->trace.f) != 1) {
+            rp_fatal_error(s, "Truncated replay trace");
+        }
+        return count;
+    }
+
+#ifndef _WIN32
+    if (s->use_shm) {
+        rp_shm_read(&s->shm.t, buf, count);
+        return count;
+    }
+#endif
+
     r = qemu_chr_fe_read_all(&s->chr, buf, count);
     if (r <= 0) {
         rp_fatal_error(s, "Disconnected");
@@ -135,7 +205,20 @@ ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
     ssize_t r;
 
     qemu_mutex_lock(&s->write_mutex);
-    r = qemu_chr_fe_write_all(&s->chr, buf, count);
+    if (s->trace.replay) {
+        /* Nobody is listening.  */
+        r = count;
+    } else
+#ifndef _WIN32
+    if (s->use_shm) {
+        rp_shm_write(&s->shm.t, buf, count);
+        r = count;
+    } else
+#endif
+    {
+        r = qemu_chr_fe_write_all(&s->chr, buf, count);
+    }
+    s->stats.tx_bytes += count;
     qemu_mutex_unlock(&s->write_mutex);
     assert(r == count);
     if (r <= 0) {
@@ -146,34 +229,101 @@ ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
     return r;
 }
 
-static unsigned int rp_has_work(RemotePort *s)
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt)
+{
+    ssize_t r = 0;
+    int i;
+
+    /* Hold the write lock across all parts to keep the packet together.  */
+    qemu_mutex_lock(&s->write_mutex);
+    for (i = 0; i < iovcnt; i++) {
+        ssize_t ret;
+
+        if (s->trace.replay) {
+            ret = iov[i].iov_len;
+        } else
+#ifndef _WIN32
+        if (s->use_shm) {
+            rp_shm_write(&s->shm.t, iov[i].iov_base, iov[i].iov_len);
+            ret = iov[i].iov_len;
+        } else
+#endif
+        {
+            ret = qemu_chr_fe_write_all(&s->chr, iov[i].iov_base,
+                                        iov[i].iov_len);
+        }
+        if (ret != iov[i].iov_len) {
+            qemu_mutex_unlock(&s->write_mutex);
+            error_report("%s: Disconnected r=%zd count=%zd\n",
+                         s->prefix, ret, iov[i].iov_len);
+            rp_fatal_error(s, "Bad write");
+        }
+        r += ret;
+    }
+    s->stats.tx_bytes += r;
+    qemu_mutex_unlock(&s->write_mutex);
+    return r;
+}
+
+void rp_dev_set_async_responses(RemotePort *s, uint32_t dev, bool async)
+{
+    assert(dev < ARRAY_SIZE(s->dev_state));
+    s->dev_state[dev].async_rsp = async;
+}
+
+static unsigned int rp_rx_has_work(RemotePort *s)
 {
     unsigned int work = s->rx_queue.wpos - s->rx_queue.rpos;
     return work;
 }
 
+static unsigned int rp_has_work(RemotePort *s)
+{
+    return rp_rx_has_work(s) + atomic_read(&s->chan_pending);
+}
+
 void rp_leave_iothread(RemotePort *s)
 {
 }
 
+/* Account a round-trip. Called with the rsp lock held.  */
+static void rp_dev_stats_latency(RemotePortDevStats *st, uint64_t ns)
+{
+    unsigned int b = 0;
+    uint64_t us = ns / 1000;
+
+    if (us >= 2) {
+        b = MIN(63 - clz64(us), RP_LATENCY_BUCKETS - 1);
+    }
+    st->latency_hist[b]++;
+    st->transactions++;
+    st->latency_total_ns += ns;
+    st->latency_max_ns = MAX(st->latency_max_ns, ns);
+}
+
 /* Response handling.  */
 RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
 {
+    int64_t start;
     int i;
 
     assert(s->devs[dev]);
 
-    /* Find a free slot.  */
-    for (i = 0; i < ARRAY_SIZE(s->dev_state[dev].rsp_queue); i++) {
-        if (s->dev_state[dev].rsp_queue[i].used == false) {
+    /*
+     * Find a free slot. Responses are matched by id so we may have up to
+     * max_outstanding transactions in flight per device, completing in any
+     * order. If all slots are busy, wait for one of them to retire.
+     */
+    while (true) {
+        for (i = 0; i < s->max_outstanding; i++) {
+            if (s->dev_state[dev].rsp_queue[i].used == false) {
+                break;
+            }
+        }
+        if (i < s->max_outstanding) {
             break;
         }
-    }
-
-    if (s->dev_state[dev].rsp_queue[i].used == true) {
-        error_report("Number of outstanding transactions exceeded! %d",
-                      RP_MAX_OUTSTANDING_TRANSACTIONS);
-        rp_fatal_error(s, "Internal error");
+        qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
     }
 
     /* Got a slot, fill it in.  */
@@ -181,6 +331,7 @@ RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
     s->dev_state[dev].rsp_queue[i].valid = false;
     s->dev_state[dev].rsp_queue[i].used = true;
 
+    start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     while (!s->dev_state[dev].rsp_queue[i].valid) {
         rp_rsp_mutex_unlock(s);
         rp_event_read(s);
@@ -192,6 +343,8 @@ RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
             qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
         }
     }
+    rp_dev_stats_latency(&s->dev_state[dev].stats,
+                         qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start);
     return &s->dev_state[dev].rsp_queue[i];
 }
 
@@ -215,6 +368,8 @@ RemotePortDynPkt rp_wait_resp(RemotePort *s)
 
 void rp_sync_vmclock(RemotePort *s, int64_t lclk, int64_t rclk)
 {
+    atomic_inc(&s->stats.warp_count);
+    atomic_add(&s->stats.warp_ns, rclk - lclk);
 }
 
 static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
@@ -232,6 +387,51 @@ static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
 
         rp_process_caps(&s->peer, caps, pkt->hello.caps.len);
     }
+    /* Let devices act on the peer caps from the main loop.  */
+    qemu_bh_schedule(s->hello_bh);
+}
+
+static void rp_send_checkpoint(RemotePort *s)
+{
+    struct rp_pkt_checkpoint pkt;
+    size_t len;
+
+    if (!s->peer.caps.checkpoint_id) {
+        if (s->checkpoint_id) {
+            warn_report("%s: peer cannot confirm checkpoint %" PRIu64,
+                        s->prefix, s->checkpoint_id);
+        }
+        return;
+    }
+    len = rp_encode_checkpoint(rp_new_id(s), 0, &pkt, s->checkpoint_id);
+    rp_write(s, (void *) &pkt, len);
+}
+
+static void rp_cmd_checkpoint(RemotePort *s, struct rp_pkt *pkt)
+{
+    if (pkt->checkpoint.id != s->checkpoint_id) {
+        error_report("%s: checkpoint mismatch remote=%" PRIu64
+                     " local=%" PRIu64, s->prefix, pkt->checkpoint.id,
+                     s->checkpoint_id);
+        rp_fatal_error(s, "Checkpoint mismatch");
+    }
+}
+
+static void rp_hello_bh(void *opaque)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+
+    rp_send_checkpoint(s);
+    s->hello_done = true;
+    notifier_list_notify(&s->hello_notifiers, s);
+}
+
+void rp_add_hello_notifier(RemotePort *s, Notifier *n)
+{
+    notifier_list_add(&s->hello_notifiers, n);
+    if (s->hello_done) {
+        n->notify(n, s);
+    }
 }
 
 static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
@@ -271,18 +471,76 @@ static void rp_say_hello(RemotePort *s)
         CAP_BUSACCESS_EXT_BASE,
         CAP_BUSACCESS_EXT_BYTE_EN,
         CAP_WIRE_POSTED_UPDATES,
+        CAP_WIRE_BATCHED_UPDATES,
+        CAP_CHECKPOINT_ID,
+        CAP_BUSACCESS_DATA_REF,
     };
+    unsigned int nr_caps = ARRAY_SIZE(caps);
     size_t len;
 
+    if (!s->data_window.ptr) {
+        /* DATA_REF is last, only announce it if we have a window.  */
+        nr_caps--;
+    }
+
     len = rp_encode_hello_caps(s->current_id++, 0, &pkt, RP_VERSION_MAJOR,
                                RP_VERSION_MINOR,
-                               caps, caps, sizeof caps / sizeof caps[0]);
+                               caps, caps, nr_caps);
     rp_write(s, (void *) &pkt, len);
 
-    if (sizeof caps) {
-        rp_write(s, caps, sizeof caps);
+    if (nr_caps) {
+        rp_write(s, caps, nr_caps * sizeof caps[0]);
+    }
+}
+
+void *rp_data_window_ptr(RemotePort *s, uint64_t offset, uint64_t len)
+{
+    if (!s->data_window.ptr
+        || offset > s->data_window.size
+        || len > s->data_window.size - offset) {
+        return NULL;
+    }
+    return s->data_window.ptr + offset;
+}
+
+#ifndef _WIN32
+static bool rp_data_window_init(RemotePort *s, Error **errp)
+{
+    void *p;
+    int fd;
+
+    if (!s->data_window.size) {
+        error_setg(errp, "%s: data-window-size must be set", s->prefix);
+        return false;
+    }
+
+    fd = qemu_open(s->data_window.path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "%s: Unable to open %s",
+                         s->prefix, s->data_window.path);
+        return false;
+    }
+
+    if (ftruncate(fd, s->data_window.size) < 0) {
+        error_setg_errno(errp, errno, "%s: Unable to size %s",
+                         s->prefix, s->data_window.path);
+        qemu_close(fd);
+        return false;
+    }
+
+    p = mmap(NULL, s->data_window.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+             fd, 0);
+    /* The mapping keeps the file referenced.  */
+    qemu_close(fd);
+    if (p == MAP_FAILED) {
+        error_setg_errno(errp, errno, "%s: Unable to map %s",
+                         s->prefix, s->data_window.path);
+        return false;
     }
+    s->data_window.ptr = p;
+    return true;
 }
+#endif
 
 static void rp_say_sync(RemotePort *s, int64_t clk)
 {
@@ -310,6 +568,7 @@ static void sync_timer_hit(void *opaque)
     RemotePort *s = REMOTE_PORT(opaque);
     int64_t clk;
     int64_t rclk;
+    int64_t start;
     RemotePortDynPkt rsp;
 
     clk = rp_normalized_vmclk(s);
@@ -317,13 +576,14 @@ static void sync_timer_hit(void *opaque)
         SYNCD(printf("%s: sync while delaying a resp! clk=%lu\n",
                      s->prefix, clk));
         s->sync.need_sync = true;
-        rp_restart_sync_timer(s);
+        rp_sync_timer_rearm(s);
         rp_leave_iothread(s);
         return;
     }
 
     /* Sync.  */
     s->sync.need_sync = false;
+    start = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     qemu_mutex_lock(&s->rsp_mutex);
     /* Send the sync.  */
     rp_say_sync(s, clk);
@@ -334,8 +594,13 @@ static void sync_timer_hit(void *opaque)
     rp_dpkt_invalidate(&rsp);
     qemu_mutex_unlock(&s->rsp_mutex);
 
+    s->sync.stats.count++;
+    s->sync.stats.stall_ns += qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+    s->sync.stats.skew_ns += rclk - clk;
+
     rp_sync_vmclock(s, clk, rclk);
-    rp_restart_sync_timer(s);
+    rp_sync_adapt_quantum(s);
+    rp_sync_timer_rearm(s);
 }
 
 static char *rp_sanitize_prefix(RemotePort *s)
@@ -382,17 +647,126 @@ static Chardev *rp_autocreate_chardev(RemotePort *s, char *name)
     return chr;
 }
 
+/* Run the device op for a request packet.  */
+static bool rp_dispatch_dev_pkt(RemotePort *s, struct rp_pkt *pkt)
+{
+    RemotePortDevice *dev = s->devs[pkt->hdr.dev];
+    RemotePortDeviceClass *rpdc;
+
+    if (dev) {
+        rpdc = REMOTE_PORT_DEVICE_GET_CLASS(dev);
+        if (rpdc->ops[pkt->hdr.cmd]) {
+            rpdc->ops[pkt->hdr.cmd](dev, pkt);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Must be called with the iothread lock held.  */
+static void rp_chan_process(RemotePort *s, RemotePortChannel *c)
+{
+    while (true) {
+        struct rp_pkt *pkt;
+        bool actioned;
+
+        qemu_mutex_lock(&s->rsp_mutex);
+        if (c->wpos == c->rpos) {
+            qemu_mutex_unlock(&s->rsp_mutex);
+            break;
+        }
+        pkt = c->pkt[c->rpos & (ARRAY_SIZE(c->pkt) - 1)].pkt;
+
+        /* Advance before processing to handle recursiveness.  */
+        c->rpos++;
+        atomic_dec(&s->chan_pending);
+        qemu_mutex_unlock(&s->rsp_mutex);
+        qemu_sem_post(&c->sem);
+
+        actioned = rp_dispatch_dev_pkt(s, pkt);
+        assert(actioned);
+    }
+}
+
+static void *rp_chan_thread(void *arg)
+{
+    RemotePortChannel *c = arg;
+    RemotePort *s = c->rp;
+
+    while (true) {
+        qemu_mutex_lock(&s->rsp_mutex);
+        while (c->wpos == c->rpos) {
+            qemu_cond_wait(&c->cond, &s->rsp_mutex);
+        }
+        qemu_mutex_unlock(&s->rsp_mutex);
+
+        /*
+         * Take the iothread lock before dequeing anything. Threads waiting
+         * for responses with the lock held process channels inline, a
+         * packet we dequeued while blocking on the lock would be stuck.
+         */
+        qemu_mutex_lock_iothread();
+        rp_chan_process(s, c);
+        qemu_mutex_unlock_iothread();
+    }
+    return NULL;
+}
+
+static RemotePortChannel *rp_chan_get(RemotePort *s, uint32_t dev)
+{
+    RemotePortChannel *c = s->chan[dev];
+    char *name;
+    unsigned int i;
+
+    if (c) {
+        return c;
+    }
+
+    c = g_new0(RemotePortChannel, 1);
+    c->rp = s;
+    qemu_cond_init(&c->cond);
+    qemu_sem_init(&c->sem, ARRAY_SIZE(c->pkt) - 1);
+    for (i = 0; i < ARRAY_SIZE(c->pkt); i++) {
+        rp_dpkt_alloc(&c->pkt[i], sizeof c->pkt[i].pkt->busaccess + 1024);
+    }
+    atomic_mb_set(&s->chan[dev], c);
+
+    name = g_strdup_printf("remote-port-dev%d", dev);
+    qemu_thread_create(&c->thread, name, rp_chan_thread, c,
+                       QEMU_THREAD_DETACHED);
+    g_free(name);
+    return c;
+}
+
+/* Process all channels inline, used by threads waiting for responses.  */
+static void rp_chan_process_all(RemotePort *s)
+{
+    unsigned int i;
+
+    if (!s->dispatch_threads || !atomic_read(&s->chan_pending)) {
+        return;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(s->chan); i++) {
+        RemotePortChannel *c = atomic_rcu_read(&s->chan[i]);
+
+        if (c) {
+            rp_chan_process(s, c);
+        }
+    }
+}
+
 static void rp_process(RemotePort *s)
 {
+    rp_chan_process_all(s);
+
     while (true) {
         struct rp_pkt *pkt;
         unsigned int rpos;
         bool actioned = false;
-        RemotePortDevice *dev;
-        RemotePortDeviceClass *rpdc;
 
         qemu_mutex_lock(&s->rsp_mutex);
-        if (!rp_has_work(s)) {
+        if (!rp_rx_has_work(s)) {
             qemu_mutex_unlock(&s->rsp_mutex);
             break;
         }
@@ -410,14 +784,7 @@ static void rp_process(RemotePort *s)
         qemu_mutex_unlock(&s->rsp_mutex);
         qemu_sem_post(&s->rx_queue.sem);
 
-        dev = s->devs[pkt->hdr.dev];
-        if (dev) {
-            rpdc = REMOTE_PORT_DEVICE_GET_CLASS(dev);
-            if (rpdc->ops[pkt->hdr.cmd]) {
-                rpdc->ops[pkt->hdr.cmd](dev, pkt);
-                actioned = true;
-            }
-        }
+        actioned = rp_dispatch_dev_pkt(s, pkt);
 
         switch (pkt->hdr.cmd) {
         case RP_CMD_sync:
@@ -493,6 +860,26 @@ static void rp_pt_handover_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     }
 }
 
+/* Handover a device request to its dispatch channel.  */
+static void rp_pt_chan_handover_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
+{
+    RemotePortChannel *c = rp_chan_get(s, dpkt->pkt->hdr.dev);
+    unsigned int wpos;
+
+    qemu_sem_wait(&c->sem);
+
+    qemu_mutex_lock(&s->rsp_mutex);
+    wpos = c->wpos & (ARRAY_SIZE(c->pkt) - 1);
+    rp_dpkt_swap(&c->pkt[wpos], dpkt);
+    c->wpos++;
+    atomic_inc(&s->chan_pending);
+    qemu_cond_signal(&c->cond);
+    /* Wake up anyone waiting for a response, they may need to process
+       this request first.  */
+    qemu_cond_broadcast(&s->progress_cond);
+    qemu_mutex_unlock(&s->rsp_mutex);
+}
+
 static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
 {
     size_t enclen;
@@ -502,7 +889,7 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
 
     assert(!(pkt->hdr.flags & RP_PKT_FLAGS_response));
 
-    if (use_icount) {
+    if (use_icount || use_icount_quantum) {
         clk = rp_normalized_vmclk(s);
         diff = pkt->sync.timestamp - clk;
     }
@@ -510,7 +897,7 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
                                  pkt->sync.timestamp);
     assert(enclen == sizeof rsp.sync);
 
-    if (!use_icount || diff < s->sync.quantum) {
+    if (!(use_icount || use_icount_quantum) || diff < s->sync.quantum) {
         /* We are still OK.  */
         rp_write(s, (void *) &rsp, enclen);
         return true;
@@ -539,7 +926,9 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
         int i;
 
         if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
-            printf("Drop response for posted packets\n");
+            /* Nobody is waiting for these, drop them.  */
+            D(qemu_log("%s: drop response for posted pkt id=%d\n",
+                       s->prefix, id));
             return;
         }
 
@@ -561,6 +950,15 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
             s->dev_state[dev].rsp_queue[i].valid = true;
 
             qemu_cond_signal(&s->progress_cond);
+        } else if (s->dev_state[dev].async_rsp) {
+            /* Nobody waits for this one, let the device handle it.  */
+            qemu_mutex_unlock(&s->rsp_mutex);
+            if (s->dispatch_threads) {
+                rp_pt_chan_handover_pkt(s, dpkt);
+            } else {
+                rp_pt_handover_pkt(s, dpkt);
+            }
+            return;
         } else {
             rp_dpkt_swap(&s->rspqueue, dpkt);
             qemu_cond_signal(&s->progress_cond);
@@ -574,15 +972,29 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     case RP_CMD_hello:
         rp_cmd_hello(s, pkt);
         break;
+    case RP_CMD_ram_map:
+        /* We don't map peer memory.  */
+        D(qemu_log("%s: ignoring ram_map from peer\n", s->prefix));
+        break;
+    case RP_CMD_checkpoint:
+        rp_cmd_checkpoint(s, pkt);
+        break;
     case RP_CMD_sync:
         if (rp_pt_cmd_sync(s, pkt)) {
             return;
         }
-        /* Fall-through.  */
+        rp_pt_handover_pkt(s, dpkt);
+        break;
     case RP_CMD_read:
     case RP_CMD_write:
     case RP_CMD_interrupt:
-        rp_pt_handover_pkt(s, dpkt);
+    case RP_CMD_interrupt_batch:
+        rp_sync_note_activity(s);
+        if (s->dispatch_threads && s->devs[pkt->hdr.dev]) {
+            rp_pt_chan_handover_pkt(s, dpkt);
+        } else {
+            rp_pt_handover_pkt(s, dpkt);
+        }
         break;
     default:
         assert(0);
@@ -590,22 +1002,150 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     }
 }
 
-static void rp_read_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
+static void rp_read_pkt_stats(RemotePort *s, struct rp_pkt *pkt)
+{
+    size_t len = sizeof pkt->hdr + pkt->hdr.len;
+
+    if (pkt->hdr.cmd <= RP_CMD_max) {
+        s->stats.rx_pkts[pkt->hdr.cmd]++;
+    }
+    s->stats.rx_bytes += len;
+    if (pkt->hdr.dev < ARRAY_SIZE(s->dev_state)) {
+        s->dev_state[pkt->hdr.dev].stats.rx_pkts++;
+        s->dev_state[pkt->hdr.dev].stats.rx_bytes += len;
+    }
+}
+
+/*
+ * Packet trace. With record set, every packet received from the peer is
+ * logged in wire format, prefixed with the vmclk at reception. With
+ * replay set, such a log stands in for the peer and anything we send is
+ * dropped. Requests are held back until the vmclk catches up with the
+ * recorded time, responses until we have allocated the id they answer.
+ */
+#define RP_TRACE_MAGIC "RPTRACE1"
+
+struct rp_trace_rec {
+    int64_t clk;
+    uint32_t len;
+} PACKED;
+
+static bool rp_trace_init(RemotePort *s, Error **errp)
+{
+    char magic[sizeof RP_TRACE_MAGIC - 1];
+    const char *path;
+
+    if (s->trace.record_path && s->trace.replay_path) {
+        error_setg(errp, "%s: record and replay are mutually exclusive",
+                   s->prefix);
+        return false;
+    }
+
+    path = s->trace.replay_path ? s->trace.replay_path : s->trace.record_path;
+    s->trace.f = fopen(path, s->trace.replay_path ? "rb" : "wb");
+    if (!s->trace.f) {
+        error_setg_errno(errp, errno, "%s: Unable to open %s",
+                         s->prefix, path);
+        return false;
+    }
+
+    if (s->trace.record_path) {
+        fwrite(RP_TRACE_MAGIC, sizeof magic, 1, s->trace.f);
+        s->trace.record = true;
+        return true;
+    }
+
+    if (fread(magic, sizeof magic, 1, s->trace.f) != 1
+        || memcmp(magic, RP_TRACE_MAGIC, sizeof magic)) {
+        error_setg(errp, "%s: %s is not a remote-port trace",
+                   s->prefix, path);
+        fclose(s->trace.f);
+        s->trace.f = NULL;
+        return false;
+    }
+    s->trace.replay = true;
+    return true;
+}
+
+static void rp_trace_record(RemotePort *s, const struct rp_pkt_hdr *raw_hdr,
+                            const void *payload, uint32_t len)
+{
+    struct rp_trace_rec rec;
+
+    rec.clk = cpu_to_be64(rp_normalized_vmclk(s));
+    rec.len = cpu_to_be32(sizeof *raw_hdr + len);
+    if (fwrite(&rec, sizeof rec, 1, s->trace.f) != 1
+        || fwrite(raw_hdr, sizeof *raw_hdr, 1, s->trace.f) != 1
+        || (len && fwrite(payload, len, 1, s->trace.f) != 1)) {
+        error_report("%s: Failed to record trace, stopping", s->prefix);
+        s->trace.record = false;
+        return;
+    }
+    /* Keep the trace usable if we get killed.  */
+    fflush(s->trace.f);
+}
+
+/* Wait until the next recorded packet may be delivered.  */
+static bool rp_trace_replay_next(RemotePort *s)
+{
+    struct rp_trace_rec rec;
+    struct rp_pkt_hdr hdr;
+    long pos;
+
+    if (fread(&rec, sizeof rec, 1, s->trace.f) != 1) {
+        return false;
+    }
+    rec.clk = be64_to_cpu(rec.clk);
+
+    /* Peek at the header without consuming it.  */
+    pos = ftell(s->trace.f);
+    if (fread(&hdr, sizeof hdr, 1, s->trace.f) != 1) {
+        rp_fatal_error(s, "Truncated replay trace");
+    }
+    fseek(s->trace.f, pos, SEEK_SET);
+    rp_decode_hdr((void *) &hdr);
+
+    if (hdr.flags & RP_PKT_FLAGS_response) {
+        while ((int32_t) (atomic_read(&s->current_id) - hdr.id) <= 0) {
+            g_usleep(10);
+        }
+    } else {
+        while (rp_normalized_vmclk(s) < rec.clk) {
+            g_usleep(10);
+        }
+    }
+    return true;
+}
+
+static bool rp_read_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
 {
     struct rp_pkt *pkt = dpkt->pkt;
+    struct rp_pkt_hdr raw_hdr;
     int used;
 
+    if (s->trace.replay && !rp_trace_replay_next(s)) {
+        return false;
+    }
+
     rp_recv(s, pkt, sizeof pkt->hdr);
+    raw_hdr = pkt->hdr;
     used = rp_decode_hdr((void *) &pkt->hdr);
     assert(used == sizeof pkt->hdr);
+    rp_read_pkt_stats(s, pkt);
 
     if (pkt->hdr.len) {
         rp_dpkt_alloc(dpkt, sizeof pkt->hdr + pkt->hdr.len);
         /* pkt may move due to realloc.  */
         pkt = dpkt->pkt;
         rp_recv(s, &pkt->hdr + 1, pkt->hdr.len);
+    }
+    if (s->trace.record) {
+        rp_trace_record(s, &raw_hdr, &pkt->hdr + 1, pkt->hdr.len);
+    }
+    if (pkt->hdr.len) {
         rp_decode_payload(pkt);
     }
+    return true;
 }
 
 static void *rp_protocol_thread(void *arg)
@@ -630,7 +1170,10 @@ static void *rp_protocol_thread(void *arg)
         wpos &= ARRAY_SIZE(s->rx_queue.pkt) - 1;
         dpkt = &s->rx_queue.pkt[wpos];
 
-        rp_read_pkt(s, dpkt);
+        if (!rp_read_pkt(s, dpkt)) {
+            info_report("%s: End of replay trace", s->prefix);
+            break;
+        }
         if (0) {
             rp_pkt_dump("rport-pkt", (void *) dpkt->pkt,
                         sizeof dpkt->pkt->hdr + dpkt->pkt->hdr.len);
@@ -647,13 +1190,59 @@ static void rp_realize(DeviceState *dev, Error **errp)
 
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
+    if (s->max_outstanding < 1
+        || s->max_outstanding > RP_MAX_OUTSTANDING_TRANSACTIONS) {
+        error_setg(errp, "%s: max-outstanding must be within 1 - %d",
+                   s->prefix, RP_MAX_OUTSTANDING_TRANSACTIONS);
+        return;
+    }
+
     s->peer.clk_base = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
     qemu_mutex_init(&s->write_mutex);
     qemu_mutex_init(&s->rsp_mutex);
     qemu_cond_init(&s->progress_cond);
 
-    if (!qemu_chr_fe_get_driver(&s->chr)) {
+#ifndef _WIN32
+    if (s->shm.path) {
+        Error *err = NULL;
+
+        if (!rp_shm_init(&s->shm.t, s->shm.path, s->shm.ring_size,
+                         s->shm.poll_spins, &err)) {
+            error_propagate(errp, err);
+            return;
+        }
+        s->use_shm = true;
+    }
+#endif
+
+    if (s->trace.record_path || s->trace.replay_path) {
+        Error *err = NULL;
+
+        if (!rp_trace_init(s, &err)) {
+            error_propagate(errp, err);
+            return;
+        }
+    }
+
+    if (s->data_window.path) {
+#ifndef _WIN32
+        Error *err = NULL;
+
+        if (!rp_data_window_init(s, &err)) {
+            error_propagate(errp, err);
+            return;
+        }
+#else
+        error_setg(errp, "%s: data windows are not supported on this host",
+                   s->prefix);
+        return;
+#endif
+    }
+
+    if (s->use_shm || s->trace.replay) {
+        /* No chardev needed.  */
+    } else if (!qemu_chr_fe_get_driver(&s->chr)) {
         char *name;
         Chardev *chr = NULL;
         static int nr = 0;
@@ -690,10 +1279,12 @@ static void rp_realize(DeviceState *dev, Error **errp)
         qdev_prop_set_chr(dev, "chardev", chr);
     }
 
-    /* Force RP sockets into blocking mode since our RP-thread will deal
-     * with the IO and bypassing QEMUs main-loop.
-     */
-    qemu_chr_fe_set_blocking(&s->chr, true);
+    if (!s->use_shm && !s->trace.replay) {
+        /* Force RP sockets into blocking mode since our RP-thread will deal
+         * with the IO and bypassing QEMUs main-loop.
+         */
+        qemu_chr_fe_set_blocking(&s->chr, true);
+    }
 
 #ifdef _WIN32
     /* Create a socket connection between two sockets. We auto-bind
@@ -770,7 +1361,12 @@ static void rp_realize(DeviceState *dev, Error **errp)
        After config negotiation with the peer, sync.quantum value might
        change.  */
     s->sync.quantum = s->peer.local_cfg.quantum;
+    if ((s->sync.adaptive || s->sync.tickless) &&
+        s->sync.quantum_max < s->sync.quantum) {
+        s->sync.quantum_max = s->sync.quantum;
+    }
 
+    s->hello_bh = qemu_bh_new(rp_hello_bh, s);
     s->sync.bh = qemu_bh_new(sync_timer_hit, s);
     s->sync.bh_resp = qemu_bh_new(syncresp_timer_hit, s);
     s->sync.ptimer = ptimer_init(s->sync.bh, PTIMER_POLICY_DEFAULT);
@@ -783,7 +1379,7 @@ static void rp_realize(DeviceState *dev, Error **errp)
     qemu_sem_init(&s->rx_queue.sem, ARRAY_SIZE(s->rx_queue.pkt) - 1);
     qemu_thread_create(&s->thread, "remote-port", rp_protocol_thread, s,
                        QEMU_THREAD_JOINABLE);
-    rp_restart_sync_timer(s);
+    rp_sync_timer_rearm(s);
 }
 
 static const VMStateDescription vmstate_rp = {
@@ -800,12 +1396,43 @@ static Property rp_properties[] = {
     DEFINE_PROP_CHR("chardev", RemotePort, chr),
     DEFINE_PROP_STRING("chardesc", RemotePort, chardesc),
     DEFINE_PROP_STRING("chrdev-id", RemotePort, chrdev_id),
+#ifndef _WIN32
+    DEFINE_PROP_STRING("shm-path", RemotePort, shm.path),
+    DEFINE_PROP_UINT32("shm-ring-size", RemotePort, shm.ring_size,
+                       1 * 1024 * 1024),
+    DEFINE_PROP_UINT32("shm-poll-spins", RemotePort, shm.poll_spins, 0),
+#endif
+    DEFINE_PROP_STRING("data-window-path", RemotePort, data_window.path),
+    DEFINE_PROP_UINT64("data-window-size", RemotePort, data_window.size, 0),
+    DEFINE_PROP_STRING("record", RemotePort, trace.record_path),
+    DEFINE_PROP_STRING("replay", RemotePort, trace.replay_path),
+    DEFINE_PROP_BOOL("dispatch-threads", RemotePort, dispatch_threads,
+                     false),
     DEFINE_PROP_BOOL("sync", RemotePort, do_sync, false),
     DEFINE_PROP_UINT64("sync-quantum", RemotePort, peer.local_cfg.quantum,
                        1000000),
+    DEFINE_PROP_BOOL("sync-adaptive", RemotePort, sync.adaptive, false),
+    DEFINE_PROP_UINT64("sync-quantum-max", RemotePort, sync.quantum_max,
+                       64 * 1000000),
+    DEFINE_PROP_BOOL("sync-tickless", RemotePort, sync.tickless, false),
+    DEFINE_PROP_UINT64("checkpoint-id", RemotePort, checkpoint_id, 0),
+    DEFINE_PROP_UINT32("max-outstanding", RemotePort, max_outstanding,
+                       RP_MAX_OUTSTANDING_TRANSACTIONS),
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static void rp_get_sync_avg_skew(Object *obj, Visitor *v, const char *name,
+                                 void *opaque, Error **errp)
+{
+    RemotePort *s = REMOTE_PORT(obj);
+    int64_t avg = 0;
+
+    if (s->sync.stats.count) {
+        avg = s->sync.stats.skew_ns / (int64_t) s->sync.stats.count;
+    }
+    visit_type_int64(v, name, &avg, errp);
+}
+
 static void rp_init(Object *obj)
 {
     RemotePort *s = REMOTE_PORT(obj);
@@ -815,6 +1442,18 @@ static void rp_init(Object *obj)
     /* Disable icount IDLE time warping. remoteport will take care of it.  */
     qemu_icount_enable_idle_timewarps(false);
 
+    notifier_list_init(&s->hello_notifiers);
+
+    object_property_add_uint64_ptr(obj, "sync-count",
+                                   &s->sync.stats.count, &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-stall-ns",
+                                   &s->sync.stats.stall_ns, &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-cur-quantum",
+                                   &s->sync.quantum, &error_abort);
+    object_property_add(obj, "sync-avg-skew-ns", "int64",
+                        rp_get_sync_avg_skew, NULL, NULL, NULL,
+                        &error_abort);
+
     for (i = 0; i < REMOTE_PORT_MAX_DEVS; ++i) {
         char *name = g_strdup_printf("remote-port-dev%d", i);
         object_property_add_link(obj, name, TYPE_REMOTE_PORT_DEVICE,
@@ -834,6 +1473,169 @@ static void rp_init(Object *obj)
     }
 }
 
+static RemotePortDevInfoList *rp_query_devs(RemotePort *s)
+{
+    RemotePortDevInfoList *head = NULL;
+    int i;
+    int b;
+
+    qemu_mutex_lock(&s->rsp_mutex);
+    for (i = ARRAY_SIZE(s->devs) - 1; i >= 0; i--) {
+        RemotePortDevStats *st = &s->dev_state[i].stats;
+        RemotePortDevInfoList *elem;
+        RemotePortDevInfo *info;
+
+        if (!s->devs[i]) {
+            continue;
+        }
+
+        info = g_new0(RemotePortDevInfo, 1);
+        info->dev = i;
+        info->path = object_get_canonical_path(OBJECT(s->devs[i]));
+        info->rx_packets = st->rx_pkts;
+        info->rx_bytes = st->rx_bytes;
+        info->transactions = st->transactions;
+        info->latency_total_ns = st->latency_total_ns;
+        info->latency_max_ns = st->latency_max_ns;
+        for (b = RP_LATENCY_BUCKETS - 1; b >= 0; b--) {
+            uint64List *bucket = g_new0(uint64List, 1);
+
+            bucket->value = st->latency_hist[b];
+            bucket->next = info->latency_histogram;
+            info->latency_histogram = bucket;
+        }
+
+        elem = g_new0(RemotePortDevInfoList, 1);
+        elem->value = info;
+        elem->next = head;
+        head = elem;
+    }
+    qemu_mutex_unlock(&s->rsp_mutex);
+    return head;
+}
+
+static int rp_query_one(Object *obj, void *opaque)
+{
+    RemotePortInfoList **head = opaque;
+    RemotePortInfoList *elem;
+    RemotePortInfo *info;
+    RemotePort *s;
+    int i;
+
+    s = (RemotePort *) object_dynamic_cast(obj, TYPE_REMOTE_PORT);
+    if (!s || !DEVICE(s)->realized) {
+        return 0;
+    }
+
+    info = g_new0(RemotePortInfo, 1);
+    info->path = object_get_canonical_path(obj);
+    for (i = RP_CMD_max; i >= 0; i--) {
+        RemotePortCmdStatsList *cmd = g_new0(RemotePortCmdStatsList, 1);
+
+        cmd->value = g_new0(RemotePortCmdStats, 1);
+        cmd->value->cmd = g_strdup(rp_cmd_to_string(i));
+        cmd->value->count = atomic_read(&s->stats.rx_pkts[i]);
+        cmd->next = info->rx_packets;
+        info->rx_packets = cmd;
+    }
+    info->rx_bytes = atomic_read(&s->stats.rx_bytes);
+    info->tx_bytes = atomic_read(&s->stats.tx_bytes);
+    info->sync_count = s->sync.stats.count;
+    info->sync_stall_ns = s->sync.stats.stall_ns;
+    info->sync_quantum = s->sync.quantum;
+    info->warp_count = atomic_read(&s->stats.warp_count);
+    info->warp_ns = atomic_read(&s->stats.warp_ns);
+    info->devices = rp_query_devs(s);
+
+    elem = g_new0(RemotePortInfoList, 1);
+    elem->value = info;
+    elem->next = *head;
+    *head = elem;
+    return 0;
+}
+
+RemotePortInfoList *qmp_query_remote_port(Error **errp)
+{
+    RemotePortInfoList *head = NULL;
+
+    object_child_foreach_recursive(object_get_root(), rp_query_one, &head);
+    return head;
+}
+
+enum {
+    RP_TELEMETRY_RX_BYTES,
+    RP_TELEMETRY_TX_BYTES,
+    RP_TELEMETRY_SYNC_COUNT,
+    RP_TELEMETRY_SYNC_STALL_NS,
+    RP_TELEMETRY_WARP_COUNT,
+    RP_TELEMETRY__MAX,
+};
+
+static const char *const rp_telemetry_names[RP_TELEMETRY__MAX] = {
+    [RP_TELEMETRY_RX_BYTES] = "rx-bytes",
+    [RP_TELEMETRY_TX_BYTES] = "tx-bytes",
+    [RP_TELEMETRY_SYNC_COUNT] = "sync-count",
+    [RP_TELEMETRY_SYNC_STALL_NS] = "sync-stall-ns",
+    [RP_TELEMETRY_WARP_COUNT] = "warp-count",
+};
+
+/* Every counter has a single writer, so no lock is needed to read it.  */
+static uint64_t rp_telemetry_read(void *opaque, unsigned int idx)
+{
+    RemotePort *s = opaque;
+
+    switch (idx) {
+    case RP_TELEMETRY_RX_BYTES:
+        return atomic_read(&s->stats.rx_bytes);
+    case RP_TELEMETRY_TX_BYTES:
+        return atomic_read(&s->stats.tx_bytes);
+    case RP_TELEMETRY_SYNC_COUNT:
+        return atomic_read(&s->sync.stats.count);
+    case RP_TELEMETRY_SYNC_STALL_NS:
+        return atomic_read(&s->sync.stats.stall_ns);
+    case RP_TELEMETRY_WARP_COUNT:
+        return atomic_read(&s->stats.warp_count);
+    }
+    return 0;
+}
+
+static void rp_telemetry_release(void *opaque)
+{
+    object_unref(opaque);
+}
+
+static int rp_telemetry_bind_one(Object *obj, void *opaque)
+{
+    TelemetrySet *set = opaque;
+    RemotePort *s;
+    char *path;
+    int i;
+
+    s = (RemotePort *) object_dynamic_cast(obj, TYPE_REMOTE_PORT);
+    if (!s || !DEVICE(s)->realized) {
+        return 0;
+    }
+
+    object_ref(obj);
+    telemetry_add_release(set, rp_telemetry_release, obj);
+    path = object_get_canonical_path(obj);
+    for (i = 0; i < RP_TELEMETRY__MAX; i++) {
+        char *name = g_strdup_printf("remote-port.%s.%s", path,
+                                     rp_telemetry_names[i]);
+
+        telemetry_add_counter(set, name, rp_telemetry_read, s, i);
+        g_free(name);
+    }
+    g_free(path);
+    return 0;
+}
+
+static void rp_telemetry_bind(TelemetrySet *set)
+{
+    object_child_foreach_recursive(object_get_root(), rp_telemetry_bind_one,
+                                   set);
+}
+
 struct rp_peer_state *rp_get_peer(RemotePort *s)
 {
     return &s->peer;
@@ -869,6 +1671,8 @@ static void rp_register_types(void)
 {
     type_register_static(&rp_info);
     type_register_static(&rp_device_info);
+    telemetry_register_source(TELEMETRY_SOURCE_REMOTE_PORT,
+                              rp_telemetry_bind);
 }
 
 type_init(rp_register_types)
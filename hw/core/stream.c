@@ -1,4 +1,6 @@
 #include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
 #include "hw/stream.h"
 
 size_t
@@ -9,6 +11,32 @@ stream_push(StreamSlave *sink, uint8_t *buf, size_t len, uint32_t attr)
     return k->push(sink, buf, len, attr);
 }
 
+size_t
+stream_pushv(StreamSlave *sink, const struct iovec *iov, int iovcnt,
+             uint32_t attr)
+{
+    StreamSlaveClass *k =  STREAM_SLAVE_GET_CLASS(sink);
+    size_t len;
+    uint8_t *buf;
+    size_t ret;
+
+    if (k->pushv) {
+        return k->pushv(sink, iov, iovcnt, attr);
+    }
+
+    if (iovcnt == 1) {
+        return k->push(sink, iov[0].iov_base, iov[0].iov_len, attr);
+    }
+
+    len = iov_size(iov, iovcnt);
+    buf = g_malloc(len);
+    iov_to_buf(iov, iovcnt, 0, buf, len);
+    /* The copy is ours.  */
+    ret = k->push(sink, buf, len, attr & ~STREAM_ATTR_READONLY);
+    g_free(buf);
+    return ret;
+}
+
 bool
 stream_can_push(StreamSlave *sink, StreamCanPushNotifyFn notify,
                 void *notify_opaque)
@@ -18,6 +46,85 @@ stream_can_push(StreamSlave *sink, StreamCanPushNotifyFn notify,
     return k->can_push ? k->can_push(sink, notify, notify_opaque) : true;
 }
 
+static void stream_coalescer_flush(void *opaque)
+{
+    StreamCoalescer *c = opaque;
+    StreamCanPushNotifyFn notify;
+
+    while (c->pos < c->len &&
+           stream_can_push(c->sink, stream_coalescer_flush, c)) {
+        size_t n = c->len - c->pos;
+        size_t ret = stream_push(c->sink, c->buf + c->pos, n,
+                                 c->eop ? STREAM_ATTR_EOP : 0);
+
+        if (!ret) {
+            break;
+        }
+        c->pos += ret;
+    }
+    if (c->pos < c->len) {
+        return;
+    }
+
+    c->pos = c->len = 0;
+    c->eop = false;
+    notify = c->notify;
+    if (notify) {
+        c->notify = NULL;
+        notify(c->notify_opaque);
+    }
+}
+
+void stream_coalescer_init(StreamCoalescer *c, StreamSlave *sink,
+                           size_t size)
+{
+    c->sink = sink;
+    c->size = size;
+    c->buf = g_malloc(size);
+    c->bh = qemu_bh_new(stream_coalescer_flush, c);
+    stream_coalescer_reset(c);
+}
+
+void stream_coalescer_reset(StreamCoalescer *c)
+{
+    qemu_bh_cancel(c->bh);
+    c->pos = c->len = 0;
+    c->eop = false;
+    c->notify = NULL;
+}
+
+size_t stream_coalescer_push(StreamCoalescer *c, const uint8_t *buf,
+                             size_t len, uint32_t attr)
+{
+    /* Nothing goes after EOP until it has been pushed on.  */
+    size_t n = c->eop ? 0 : MIN(len, c->size - c->len);
+
+    memcpy(c->buf + c->len, buf, n);
+    c->len += n;
+    if (n == len && stream_attr_has_eop(attr)) {
+        c->eop = true;
+    }
+
+    if (c->len == c->size || c->eop) {
+        stream_coalescer_flush(c);
+    } else if (c->len) {
+        qemu_bh_schedule(c->bh);
+    }
+    return n;
+}
+
+bool stream_coalescer_can_push(StreamCoalescer *c,
+                               StreamCanPushNotifyFn notify,
+                               void *notify_opaque)
+{
+    if (!c->eop && c->len < c->size) {
+        return true;
+    }
+    c->notify = notify;
+    c->notify_opaque = notify_opaque;
+    return false;
+}
+
 static const TypeInfo stream_slave_info = {
     .name          = TYPE_STREAM_SLAVE,
     .parent        = TYPE_INTERFACE,
@@ -25,6 +25,9 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "hw/display/xlnx_dp.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifndef DEBUG_DP
 #define DEBUG_DP 0
@@ -327,42 +330,74 @@ static inline void xlnx_dp_audio_activate(XlnxDPState *s)
                                       &s->audio_buffer_1);
 }
 
+/*
+ * Mix @n samples of @a and @b, scaled by @va and @vb where 8192 is unity.
+ * Output audio is 16bits saturated.
+ */
+static void xlnx_dp_audio_mix(int16_t *out, const int16_t *a, uint32_t va,
+                              const int16_t *b, uint32_t vb, size_t n)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    /*
+     * _mm_madd_epi16 multiplies and sums the interleaved samples of both
+     * channels in one go, as long as the volumes fit in signed 16 bits.
+     */
+    if (va <= INT16_MAX && vb <= INT16_MAX) {
+        __m128i vol = _mm_set1_epi32(va | (vb << 16));
+        __m128i min = _mm_set1_epi16(-32767);
+
+        for (; i + 8 <= n; i += 8) {
+            __m128i sa = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i sb = _mm_loadu_si128((const __m128i *)(b + i));
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(sa, sb), vol);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(sa, sb), vol);
+
+            lo = _mm_srai_epi32(lo, 13);
+            hi = _mm_srai_epi32(hi, 13);
+            _mm_storeu_si128((__m128i *)(out + i),
+                             _mm_max_epi16(_mm_packs_epi32(lo, hi), min));
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        int64_t v = ((int64_t)a[i] * va + (int64_t)b[i] * vb) >> 13;
+
+        out[i] = MAX(-32767, MIN(v, 32767));
+    }
+}
+
 static inline void xlnx_dp_audio_mix_buffer(XlnxDPState *s)
 {
     /*
      * Audio packets are signed and have this shape:
      * | 16 | 16 | 16 | 16 | 16 | 16 | 16 | 16 |
      * | R3 | L3 | R2 | L2 | R1 | L1 | R0 | L0 |
-     *
-     * Output audio is 16bits saturated.
      */
-    int i;
+    uint32_t vol0 = xlnx_dp_audio_get_volume(s, 0);
+    uint32_t vol1 = xlnx_dp_audio_get_volume(s, 1);
+    bool use0 = s->audio_data_available[0] && vol0;
+    bool use1 = s->audio_data_available[1] && vol1;
 
-    if ((s->audio_data_available[0]) && (xlnx_dp_audio_get_volume(s, 0))) {
-        for (i = 0; i < s->audio_data_available[0] / 2; i++) {
-            s->temp_buffer[i] = (int64_t)(s->audio_buffer_0[i])
-                              * xlnx_dp_audio_get_volume(s, 0) / 8192;
-        }
+    s->byte_left = 0;
+    if (use0) {
         s->byte_left = s->audio_data_available[0];
-    } else {
-        memset(s->temp_buffer, 0, s->audio_data_available[1] / 2);
     }
-
-    if ((s->audio_data_available[1]) && (xlnx_dp_audio_get_volume(s, 1))) {
-        if ((s->audio_data_available[0] == 0)
-        || (s->audio_data_available[1] == s->audio_data_available[0])) {
-            for (i = 0; i < s->audio_data_available[1] / 2; i++) {
-                s->temp_buffer[i] += (int64_t)(s->audio_buffer_1[i])
-                                   * xlnx_dp_audio_get_volume(s, 1) / 8192;
-            }
-            s->byte_left = s->audio_data_available[1];
-        }
-    }
-
-    for (i = 0; i < s->byte_left / 2; i++) {
-        s->out_buffer[i] = MAX(-32767, MIN(s->temp_buffer[i], 32767));
+    if (use1 && (!use0 || s->audio_data_available[1] == s->byte_left)) {
+        s->byte_left = s->audio_data_available[1];
+    } else {
+        use1 = false;
     }
 
+    /* A channel that isn't mixed in reads the other one at no volume */
+    xlnx_dp_audio_mix(s->out_buffer,
+                      use0 ? s->audio_buffer_0 : s->audio_buffer_1,
+                      use0 ? vol0 : 0,
+                      use1 ? s->audio_buffer_1 : s->audio_buffer_0,
+                      use1 ? vol1 : 0,
+                      s->byte_left / 2);
     s->data_ptr = 0;
 }
 
@@ -373,37 +408,46 @@ static void xlnx_dp_audio_callback(void *opaque, int avail)
      * Then wait for QEMU's audio subsystem to call this callback.
      */
     XlnxDPState *s = XLNX_DP(opaque);
-    size_t written = 0;
-
-    /* If there are already some data don't get more data. */
-    if (s->byte_left == 0) {
-        s->audio_data_available[0] = xlnx_dpdma_start_operation(s->dpdma, 4,
-                                                                  true);
-        s->audio_data_available[1] = xlnx_dpdma_start_operation(s->dpdma, 5,
-                                                                  true);
-        xlnx_dp_audio_mix_buffer(s);
-    }
+    bool played = false;
 
-    /* Send the buffer through the audio. */
-    if (s->byte_left <= MAX_QEMU_BUFFER_SIZE) {
-        if (s->byte_left != 0) {
-            written = AUD_write(s->amixer_output_stream,
-                                &s->out_buffer[s->data_ptr], s->byte_left);
-        } else {
-            /*
-             * There is nothing to play.. We don't have any data! Fill the
-             * buffer with zero's and send it.
-             */
-            written = 0;
-            memset(s->out_buffer, 0, 1024);
-            AUD_write(s->amixer_output_stream, s->out_buffer, 1024);
+    /*
+     * Fill all the room the backend has, fetching more descriptors as
+     * needed, rather than one chunk per callback.
+     */
+    while (avail > 0) {
+        size_t written;
+
+        if (s->byte_left == 0) {
+            s->audio_data_available[0] =
+                xlnx_dpdma_start_operation(s->dpdma, 4, true);
+            s->audio_data_available[1] =
+                xlnx_dpdma_start_operation(s->dpdma, 5, true);
+            xlnx_dp_audio_mix_buffer(s);
+            if (s->byte_left == 0) {
+                break;
+            }
         }
-    } else {
+
         written = AUD_write(s->amixer_output_stream,
-                            &s->out_buffer[s->data_ptr], MAX_QEMU_BUFFER_SIZE);
+                            (uint8_t *)s->out_buffer + s->data_ptr,
+                            MIN(s->byte_left, avail));
+        if (written == 0) {
+            break;
+        }
+        played = true;
+        s->byte_left -= written;
+        s->data_ptr += written;
+        avail -= written;
+    }
+
+    if (!played && s->byte_left == 0) {
+        /*
+         * There is nothing to play.. We don't have any data! Fill the
+         * buffer with zero's and send it.
+         */
+        memset(s->out_buffer, 0, 1024);
+        AUD_write(s->amixer_output_stream, s->out_buffer, 1024);
     }
-    s->byte_left -= written;
-    s->data_ptr += written;
 }
 
 /*
@@ -590,6 +634,7 @@ static void xlnx_dp_recreate_surface(XlnxDPState *s)
                                             surface_data(s->g_plane.surface));
         xlnx_dpdma_set_host_data_location(s->dpdma, DP_VIDEO_DMA_CHANNEL,
                                             surface_data(s->v_plane.surface));
+        s->full_update = true;
     }
 }
 
@@ -913,6 +958,7 @@ static void xlnx_dp_vblend_write(void *opaque, hwaddr offset,
         if (xlnx_dp_global_alpha_enabled(s) != alpha_was_enabled) {
             xlnx_dp_recreate_surface(s);
         }
+        s->full_update = true;
         break;
     case V_BLEND_OUTPUT_VID_FORMAT:
         s->vblend_registers[offset] = value & 0x00000017;
@@ -1113,16 +1159,16 @@ static const MemoryRegionOps avbufm_ops = {
 /*
  * This is a global alpha blending using pixman.
  * Both graphic and video planes are multiplied with the global alpha
- * coefficient and added.
+ * coefficient and added. Solid masks keep this on pixman's SIMD fast paths,
+ * unlike convolution filters which go through the per pixel general path.
+ * Only the lines from @y to @y + @h are blended.
  */
-static inline void xlnx_dp_blend_surface(XlnxDPState *s)
+static inline void xlnx_dp_blend_surface(XlnxDPState *s, int y, int h)
 {
-    pixman_fixed_t alpha1[] = { pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1.0) };
-    pixman_fixed_t alpha2[] = { pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1),
-                                pixman_double_to_fixed(1.0) };
+    uint16_t alpha = xlnx_dp_global_alpha_value(s) * 0x101;
+    pixman_color_t alpha1 = { .alpha = alpha };
+    pixman_color_t alpha2 = { .alpha = 0xFFFF - alpha };
+    pixman_image_t *mask;
 
     if ((surface_width(s->g_plane.surface)
          != surface_width(s->v_plane.surface)) ||
@@ -1131,29 +1177,36 @@ static inline void xlnx_dp_blend_surface(XlnxDPState *s)
         return;
     }
 
-    alpha1[2] = pixman_double_to_fixed((double)(xlnx_dp_global_alpha_value(s))
-                                       / 256.0);
-    alpha2[2] = pixman_double_to_fixed((255.0
-                                    - (double)xlnx_dp_global_alpha_value(s))
-                                       / 256.0);
-
-    pixman_image_set_filter(s->g_plane.surface->image,
-                            PIXMAN_FILTER_CONVOLUTION, alpha1, 3);
-    pixman_image_composite(PIXMAN_OP_SRC, s->g_plane.surface->image, 0,
-                           s->bout_plane.surface->image, 0, 0, 0, 0, 0, 0,
-                           surface_width(s->g_plane.surface),
-                           surface_height(s->g_plane.surface));
-    pixman_image_set_filter(s->v_plane.surface->image,
-                            PIXMAN_FILTER_CONVOLUTION, alpha2, 3);
-    pixman_image_composite(PIXMAN_OP_ADD, s->v_plane.surface->image, 0,
-                           s->bout_plane.surface->image, 0, 0, 0, 0, 0, 0,
-                           surface_width(s->g_plane.surface),
-                           surface_height(s->g_plane.surface));
+    mask = pixman_image_create_solid_fill(&alpha1);
+    pixman_image_composite(PIXMAN_OP_SRC, s->g_plane.surface->image, mask,
+                           s->bout_plane.surface->image, 0, y, 0, 0, 0, y,
+                           surface_width(s->g_plane.surface), h);
+    pixman_image_unref(mask);
+
+    mask = pixman_image_create_solid_fill(&alpha2);
+    pixman_image_composite(PIXMAN_OP_ADD, s->v_plane.surface->image, mask,
+                           s->bout_plane.surface->image, 0, y, 0, 0, 0, y,
+                           surface_width(s->g_plane.surface), h);
+    pixman_image_unref(mask);
+}
+
+/* Widen the dirty lines [*y0, *y1) of @surface by what @channel fetched */
+static void xlnx_dp_take_dirty(XlnxDPState *s, uint8_t channel,
+                               DisplaySurface *surface, int *y0, int *y1)
+{
+    int stride = surface_stride(surface);
+    size_t start, end;
+
+    if (xlnx_dpdma_take_dirty(s->dpdma, channel, &start, &end)) {
+        *y0 = MIN(*y0, (int)(start / stride));
+        *y1 = MAX(*y1, (int)DIV_ROUND_UP(end, stride));
+    }
 }
 
 static void xlnx_dp_update_display(void *opaque)
 {
     XlnxDPState *s = XLNX_DP(opaque);
+    int height, y0, y1;
 
     if ((s->core_registers[DP_TRANSMITTER_ENABLE] & 0x01) == 0) {
         return;
@@ -1174,23 +1227,48 @@ static void xlnx_dp_update_display(void *opaque)
         return;
     }
 
+    height = surface_height(s->g_plane.surface);
+    y0 = s->full_update ? 0 : height;
+    y1 = s->full_update ? height : 0;
+    s->full_update = false;
+    xlnx_dp_take_dirty(s, DP_GRAPHIC_DMA_CHANNEL, s->g_plane.surface,
+                       &y0, &y1);
+
     if (xlnx_dp_global_alpha_enabled(s)) {
         if (!xlnx_dpdma_start_operation(s->dpdma, 0, false)) {
             s->core_registers[DP_INT_STATUS] |= (1 << 21);
             xlnx_dp_update_irq(s);
             return;
         }
-        xlnx_dp_blend_surface(s);
+        xlnx_dp_take_dirty(s, DP_VIDEO_DMA_CHANNEL, s->v_plane.surface,
+                           &y0, &y1);
     }
 
     /*
-     * XXX: We might want to update only what changed.
+     * Only blend and report the lines the DPDMA wrote to.  A guest that
+     * doesn't touch its framebuffers costs neither a blend nor an update
+     * of the display listeners.
      */
-    dpy_gfx_update(s->console, 0, 0, surface_width(s->g_plane.surface),
-                                     surface_height(s->g_plane.surface));
+    y1 = MIN(y1, height);
+    if (y0 >= y1) {
+        return;
+    }
+    if (xlnx_dp_global_alpha_enabled(s)) {
+        xlnx_dp_blend_surface(s, y0, y1 - y0);
+    }
+    dpy_gfx_update(s->console, 0, y0, surface_width(s->g_plane.surface),
+                   y1 - y0);
+}
+
+static void xlnx_dp_invalidate_display(void *opaque)
+{
+    XlnxDPState *s = XLNX_DP(opaque);
+
+    s->full_update = true;
 }
 
 static const GraphicHwOps xlnx_dp_gfx_ops = {
+    .invalidate  = xlnx_dp_invalidate_display,
     .gfx_update  = xlnx_dp_update_display,
 };
 
@@ -1286,6 +1364,7 @@ static void xlnx_dp_reset(DeviceState *dev)
     XlnxDPState *s = XLNX_DP(dev);
 
     memset(s->core_registers, 0, sizeof(s->core_registers));
+    s->full_update = true;
     s->core_registers[DP_VERSION_REGISTER] = 0x04010000;
     s->core_registers[DP_CORE_ID] = 0x01020000;
     s->core_registers[DP_REPLY_STATUS] = 0x00000010;
@@ -30,12 +30,13 @@
 
 #include "hw/stream.h"
 #include "hw/dma-ctrl.h"
-#include "hw/ptimer.h"
+#include "hw/deadline.h"
+#include "qemu/timer.h"
 #include "qemu/bitops.h"
+#include "qemu/iov.h"
 #include "sysemu/dma.h"
 #include "hw/register.h"
 #include "qapi/error.h"
-#include "qemu/main-loop.h"
 
 #include "hw/fdt_generic_util.h"
 
@@ -146,8 +147,7 @@ typedef struct ZynqMPCSUDMA {
     StreamSlave *tx_dev;  /* Used as generic StreamSlave */
     StreamSlave *tx_dev0; /* Used for pmc dma0 */
     StreamSlave *tx_dev1; /* Used for pmc dma1 */
-    QEMUBH *bh;
-    ptimer_state *src_timer;
+    Deadline src_timeout;
 
     bool is_dst;
     uint16_t width;
@@ -293,10 +293,33 @@ static inline uint64_t dmach_addr(ZynqMPCSUDMA *s)
 }
 
 /* len is in bytes.  */
-static void dmach_write(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len)
+static void dmach_write(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len,
+                        uint32_t attr)
 {
     uint64_t addr = dmach_addr(s);
+    uint8_t *copy = NULL;
 
+    if (!dmach_burst_is_fixed(s)) {
+        hwaddr l = len;
+        uint8_t *p = address_space_map_ram(s->dma_as, addr, &l, true,
+                                           *s->attr);
+
+        if (p && l == len) {
+            /* Process the copy in RAM, buf may be the source RAM.  */
+            memmove(p, buf, len);
+            dmach_data_process(s, p, len);
+            address_space_unmap(s->dma_as, p, l, true, len);
+            return;
+        }
+        if (p) {
+            address_space_unmap(s->dma_as, p, l, true, 0);
+        }
+    }
+
+    if ((attr & STREAM_ATTR_READONLY)
+        && (s->regs[R_CTRL] & R_CTRL_ENDIANNESS_MASK)) {
+        buf = copy = g_memdup(buf, len);
+    }
     dmach_data_process(s, buf, len);
     if (dmach_burst_is_fixed(s)) {
         unsigned int i;
@@ -310,6 +333,7 @@ static void dmach_write(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len)
     } else {
         address_space_rw(s->dma_as, addr, *s->attr, buf, len, true);
     }
+    g_free(copy);
 }
 
 /* len is in bytes.  */
@@ -331,6 +355,30 @@ static inline void dmach_read(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len)
     dmach_data_process(s, buf, len);
 }
 
+/* Map the source RAM so that it can be pushed without copying. Only done
+ * when the data goes out untouched, i.e without byteswaps. Returns NULL
+ * if the data must be read into a local buffer.
+ */
+static uint8_t *dmach_map_read(ZynqMPCSUDMA *s, hwaddr *plen)
+{
+    hwaddr len = *plen;
+    uint8_t *p;
+
+    if (dmach_burst_is_fixed(s)
+        || (s->regs[R_CTRL] & R_CTRL_ENDIANNESS_MASK)) {
+        return NULL;
+    }
+
+    p = address_space_map_ram(s->dma_as, dmach_addr(s), &len, false,
+                              *s->attr);
+    if (p && len < 4) {
+        address_space_unmap(s->dma_as, p, len, false, 0);
+        return NULL;
+    }
+    *plen = len;
+    return p;
+}
+
 static void ronaldu_csu_dma_update_irq(ZynqMPCSUDMA *s)
 {
     qemu_set_irq(s->irq, !!(s->regs[R_INT_STATUS] & ~s->regs[R_INT_MASK]));
@@ -366,12 +414,46 @@ static size_t zynqmp_csu_dma_stream_push(StreamSlave *obj, uint8_t *buf,
     }
 
     /* DMA transfer.  */
-    dmach_write(s, buf, btt);
+    dmach_write(s, buf, btt, attr);
     dmach_advance(s, btt);
     ronaldu_csu_dma_update_irq(s);
     return btt;
 }
 
+static size_t zynqmp_csu_dma_stream_pushv(StreamSlave *obj,
+                                           const struct iovec *iov,
+                                           int iovcnt, uint32_t attr)
+{
+    ZynqMPCSUDMA *s = ZYNQMP_CSU_DMA(obj);
+    size_t len = iov_size(iov, iovcnt);
+    size_t done = 0;
+    uint8_t *buf;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len & 3) {
+            /* Words would straddle elements, process a linear copy.  */
+            buf = g_malloc(len);
+            iov_to_buf(iov, iovcnt, 0, buf, len);
+            done = zynqmp_csu_dma_stream_push(obj, buf, len,
+                                              attr & ~STREAM_ATTR_READONLY);
+            g_free(buf);
+            return done;
+        }
+    }
+
+    /* Write each element straight from the senders buffers.  */
+    for (i = 0; i < iovcnt; i++) {
+        size_t ret = zynqmp_csu_dma_stream_push(obj, iov[i].iov_base,
+                                                iov[i].iov_len, attr);
+        done += ret;
+        if (ret < iov[i].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
 static bool zynqmp_csu_dma_stream_can_push(StreamSlave *obj,
                                             StreamCanPushNotifyFn notify,
                                             void *notify_opaque)
@@ -393,23 +475,37 @@ static void zynqmp_csu_dma_src_notify(void *opaque)
     unsigned char buf[4 * 1024];
 
     /* Stop the backpreassure timer.  */
-    ptimer_stop(s->src_timer);
+    deadline_del(&s->src_timeout);
 
     while (dmach_get_size(s) && !dmach_is_paused(s) &&
            stream_can_push(s->tx_dev, zynqmp_csu_dma_src_notify, s)) {
         uint32_t size = dmach_get_size(s);
         unsigned int plen = MIN(size, sizeof buf);
+        hwaddr mlen = size;
+        uint8_t *data = dmach_map_read(s, &mlen);
         uint32_t attr = 0;
         size_t ret;
 
+        if (data) {
+            /* Push straight from RAM, in as few chunks as possible.  */
+            plen = mlen & ~3;
+            attr |= STREAM_ATTR_READONLY;
+        }
+
         /* Did we fit it all?  */
         if (size == plen && dmach_get_eop(s)) {
             attr |= STREAM_ATTR_EOP;
         }
 
         /* DMA transfer.  */
-        dmach_read(s, buf, plen);
-        ret = stream_push(s->tx_dev, buf, plen, attr);
+        if (data) {
+            dmach_data_process(s, data, plen);
+            ret = stream_push(s->tx_dev, data, plen, attr);
+            address_space_unmap(s->dma_as, data, mlen, false, plen);
+        } else {
+            dmach_read(s, buf, plen);
+            ret = stream_push(s->tx_dev, buf, plen, attr);
+        }
         dmach_advance(s, ret);
     }
 
@@ -422,9 +518,8 @@ static void zynqmp_csu_dma_src_notify(void *opaque)
         unsigned int freq = 400 * 1000 * 1000;
 
         freq /= div;
-        ptimer_set_freq(s->src_timer, freq);
-        ptimer_set_count(s->src_timer, timeout);
-        ptimer_run(s->src_timer, 1);
+        deadline_mod_delay_ns(&s->src_timeout,
+                              muldiv64(timeout, NANOSECONDS_PER_SECOND, freq));
     }
 
     ronaldu_csu_dma_update_irq(s);
@@ -627,8 +722,7 @@ static void zynqmp_csu_dma_realize(DeviceState *dev, Error **errp)
         s->tx_dev = s->tx_dev0 ? s->tx_dev0 :
                                  s->tx_dev1 ? s->tx_dev1 : 0;
     }
-    s->bh = qemu_bh_new(src_timeout_hit, s);
-    s->src_timer = ptimer_init(s->bh, PTIMER_POLICY_DEFAULT);
+    deadline_init(&s->src_timeout, src_timeout_hit, s);
 
     if (s->dma_mr) {
         s->dma_as = g_malloc0(sizeof(AddressSpace));
@@ -683,11 +777,11 @@ static void zynqmp_csu_dma_init(Object *obj)
 
 static const VMStateDescription vmstate_zynqmp_csu_dma = {
     .name = "zynqmp_csu_dma",
-    .version_id = 2,
-    .minimum_version_id = 2,
-    .minimum_version_id_old = 2,
+    .version_id = 3,
+    .minimum_version_id = 3,
+    .minimum_version_id_old = 3,
     .fields = (VMStateField[]) {
-        VMSTATE_PTIMER(src_timer, ZynqMPCSUDMA),
+        VMSTATE_DEADLINE(src_timeout, ZynqMPCSUDMA),
         VMSTATE_UINT32_ARRAY(regs, ZynqMPCSUDMA, R_MAX),
         VMSTATE_END_OF_LIST(),
     }
@@ -711,6 +805,7 @@ static void zynqmp_csu_dma_class_init(ObjectClass *klass, void *data)
     dc->props = zynqmp_csu_dma_properties;
 
     ssc->push = zynqmp_csu_dma_stream_push;
+    ssc->pushv = zynqmp_csu_dma_stream_pushv;
     ssc->can_push = zynqmp_csu_dma_stream_can_push;
     dcc->read = zynqmp_csu_dma_dma_ctrl_read;
 }
@@ -30,6 +30,8 @@
 #include "hw/register-dep.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
+#include "qemu/host-utils.h"
 #include "qapi/error.h"
 #include "sysemu/dma.h"
 
@@ -42,6 +44,9 @@
 #define XILINX_ZDMA(obj) \
      OBJECT_CHECK(ZDMA, (obj), TYPE_XILINX_ZDMA)
 
+/* Bytes moved per timer tick when the channel is paced.  */
+#define ZDMA_ASYNC_CHUNK 4096
+
 #define ZDMA_INT_BF(REG) \
     DEP_FIELD(ZDMA_CH_ ## REG, DMA_PAUSE, 1, 11)       \
     DEP_FIELD(ZDMA_CH_ ## REG, DMA_DONE, 1, 10)        \
@@ -201,9 +206,14 @@ typedef struct ZDMA {
     MemoryRegion *dma_mr;
     AddressSpace *dma_as;
     qemu_irq irq_zdma_ch0;
+    QEMUTimer *timer;
 
     struct {
         uint32_t bus_width;
+        /* Bytes per second of QEMU_CLOCK_VIRTUAL, 0 transfers everything
+         * synchronously from the register write.
+         */
+        uint64_t bandwidth;
     } cfg;
 
     ZDMAState state;
@@ -212,6 +222,15 @@ typedef struct ZDMA {
     ZDMADescr dsc_src;
     ZDMADescr dsc_dst;
 
+    /* Progress within the current src descriptor.  */
+    struct {
+        bool active;
+        uint64_t addr;
+        uint32_t size;
+        unsigned int rw_mode;
+        unsigned int burst_type;
+    } xfer;
+
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
 
@@ -384,6 +403,29 @@ static uint64_t zdma_update_descr_addr(ZDMA *s, bool type, unsigned int basereg)
     return next;
 }
 
+/* Incrementing burst write of buf, straight into RAM when possible. The
+ * unmap takes care of dirty tracking.
+ */
+static void zdma_write_incr(ZDMA *s, hwaddr addr, uint8_t *buf, hwaddr len)
+{
+    while (len) {
+        hwaddr l = len;
+        uint8_t *p = address_space_map_ram(s->dma_as, addr, &l, true,
+                                          *s->attr);
+
+        if (!p) {
+            address_space_rw(s->dma_as, addr, *s->attr, buf, len, true);
+            return;
+        }
+        /* buf may be mapped RAM overlapping the destination.  */
+        memmove(p, buf, l);
+        address_space_unmap(s->dma_as, p, l, true, l);
+        addr += l;
+        buf += l;
+        len -= l;
+    }
+}
+
 static void zdma_write_dst(ZDMA *s, uint8_t *buf, uint32_t len)
 {
     uint32_t dst_size, dlen;
@@ -426,10 +468,12 @@ static void zdma_write_dst(ZDMA *s, uint8_t *buf, uint32_t len)
             }
         }
 
-        address_space_rw(s->dma_as, s->dsc_dst.addr, *s->attr, buf, dlen,
-                         true);
         if (burst_type == AXI_BURST_INCR) {
+            zdma_write_incr(s, s->dsc_dst.addr, buf, dlen);
             s->dsc_dst.addr += dlen;
+        } else {
+            address_space_rw(s->dma_as, s->dsc_dst.addr, *s->attr, buf, dlen,
+                             true);
         }
         dst_size -= dlen;
         buf += dlen;
@@ -444,21 +488,15 @@ static void zdma_write_dst(ZDMA *s, uint8_t *buf, uint32_t len)
     }
 }
 
-static void zdma_process_descr(ZDMA *s)
+/* Setup the transfer of the src descriptor just loaded.  */
+static void zdma_start_descr(ZDMA *s)
 {
-    uint64_t src_addr;
-    uint32_t src_size, len;
-    unsigned int src_cmd;
-    bool src_intr, src_type;
     unsigned int ptype = DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, POINT_TYPE);
     unsigned int rw_mode = DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, MODE);
     unsigned int burst_type = DEP_AF_EX32(s->regs, ZDMA_CH_DATA_ATTR, ARBURST);
+    uint32_t src_size;
 
-    src_addr = s->dsc_src.addr;
     src_size = DEP_F_EX32(s->dsc_src.words[2], ZDMA_CH_SRC_DSCR_WORD2, SIZE);
-    src_cmd = DEP_F_EX32(s->dsc_src.words[3], ZDMA_CH_SRC_DSCR_WORD3, CMD);
-    src_type = DEP_F_EX32(s->dsc_src.words[3], ZDMA_CH_SRC_DSCR_WORD3, TYPE);
-    src_intr = DEP_F_EX32(s->dsc_src.words[3], ZDMA_CH_SRC_DSCR_WORD3, INTR);
 
     /* FIXED burst types and non-rw modes are only supported in
      * simple dma mode.
@@ -485,38 +523,80 @@ static void zdma_process_descr(ZDMA *s)
         memcpy(s->buf, &s->regs[R_ZDMA_CH_WR_ONLY_WORD0], s->cfg.bus_width / 8);
     }
 
-    while (src_size) {
-        len = src_size > ARRAY_SIZE(s->buf) ? ARRAY_SIZE(s->buf) : src_size;
-        if (burst_type == AXI_BURST_FIXED) {
-            if (len > (s->cfg.bus_width / 8)) {
-                len = s->cfg.bus_width / 8;
-            }
+    s->xfer.active = true;
+    s->xfer.addr = s->dsc_src.addr;
+    s->xfer.size = src_size;
+    s->xfer.rw_mode = rw_mode;
+    s->xfer.burst_type = burst_type;
+}
+
+/* Move up to budget bytes of the current src descriptor and move on to
+ * the next descriptor once it's done. Returns the number of bytes moved.
+ */
+static uint64_t zdma_process_descr(ZDMA *s, uint64_t budget)
+{
+    unsigned int src_cmd;
+    bool src_intr, src_type;
+    unsigned int ptype = DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, POINT_TYPE);
+    unsigned int rw_mode = s->xfer.rw_mode;
+    unsigned int burst_type = s->xfer.burst_type;
+    uint64_t done = 0;
+
+    while (s->xfer.size && done < budget) {
+        hwaddr len = MIN(s->xfer.size, budget - done);
+        uint8_t *src = NULL;
+
+        if (rw_mode == RW_MODE_RW && burst_type == AXI_BURST_INCR) {
+            src = address_space_map_ram(s->dma_as, s->xfer.addr, &len, false,
+                                        *s->attr);
         }
 
-        if (rw_mode == RW_MODE_WO) {
-            if (len > s->cfg.bus_width / 8) {
-                len = s->cfg.bus_width / 8;
+        if (!src) {
+            len = MIN(len, ARRAY_SIZE(s->buf));
+            if (burst_type == AXI_BURST_FIXED) {
+                if (len > (s->cfg.bus_width / 8)) {
+                    len = s->cfg.bus_width / 8;
+                }
             }
-        } else {
-            address_space_rw(s->dma_as, src_addr, *s->attr, s->buf, len,
-                             false);
-            if (burst_type == AXI_BURST_INCR) {
-                src_addr += len;
+
+            if (rw_mode == RW_MODE_WO) {
+                if (len > s->cfg.bus_width / 8) {
+                    len = s->cfg.bus_width / 8;
+                }
+            } else {
+                address_space_rw(s->dma_as, s->xfer.addr, *s->attr, s->buf,
+                                 len, false);
             }
         }
 
         if (rw_mode != RW_MODE_RO) {
-            zdma_write_dst(s, s->buf, len);
+            zdma_write_dst(s, src ? src : s->buf, len);
+        }
+        if (src) {
+            address_space_unmap(s->dma_as, src, len, false, len);
+        }
+        if (rw_mode != RW_MODE_WO && burst_type == AXI_BURST_INCR) {
+            s->xfer.addr += len;
         }
 
         s->regs[R_ZDMA_CH_TOTAL_BYTE] += len;
-        src_size -= len;
+        s->xfer.size -= len;
+        done += len;
 
-        if (src_size == 0) {
+        if (s->xfer.size == 0) {
             DEP_AF_DP32(s->regs, ZDMA_CH_ISR, DMA_DONE, true);
         }
+    }
 
+    if (s->xfer.size) {
+        /* Out of budget, carry on later.  */
+        return done;
     }
+    s->xfer.active = false;
+
+    src_cmd = DEP_F_EX32(s->dsc_src.words[3], ZDMA_CH_SRC_DSCR_WORD3, CMD);
+    src_type = DEP_F_EX32(s->dsc_src.words[3], ZDMA_CH_SRC_DSCR_WORD3, TYPE);
+    src_intr = DEP_F_EX32(s->dsc_src.words[3], ZDMA_CH_SRC_DSCR_WORD3, INTR);
 
     if (src_intr) {
         zdma_src_done(s);
@@ -526,31 +606,65 @@ static void zdma_process_descr(ZDMA *s)
     if (ptype == PT_REG || src_cmd == CMD_STOP) {
         DEP_AF_DP32(s->regs, ZDMA_CH_CTRL2, EN, 0);
         zdma_set_state(s, DISABLED);
-        return;
+        return done;
     }
 
     if (src_cmd == CMD_HALT) {
         zdma_set_state(s, PAUSED);
         DEP_AF_DP32(s->regs, ZDMA_CH_ISR, DMA_PAUSE, 1);
         zdma_ch_update_irq(s);
-        return;
+        return done;
     }
 
     zdma_update_descr_addr(s, src_type, R_ZDMA_CH_SRC_CUR_DSCR_LSB);
+    return done;
 }
 
-static void zdma_run(ZDMA *s)
+static uint64_t zdma_run_budget(ZDMA *s, uint64_t budget)
 {
-    while (s->state == ENABLED && !s->error) {
-        zdma_load_src_descriptor(s);
+    uint64_t done = 0;
 
-        if (s->error) {
-            zdma_set_state(s, DISABLED);
-        } else {
-            zdma_process_descr(s);
+    while (s->state == ENABLED && !s->error && done < budget) {
+        if (!s->xfer.active) {
+            zdma_load_src_descriptor(s);
+
+            if (s->error) {
+                zdma_set_state(s, DISABLED);
+                break;
+            }
+            zdma_start_descr(s);
         }
+        done += zdma_process_descr(s, budget - done);
+    }
+
+    zdma_ch_update_irq(s);
+    return done;
+}
+
+/* Paced channels move a chunk per tick, off the vCPU that started them,
+ * and wait for as long as the chunk takes at the configured bandwidth.
+ */
+static void zdma_timer_cb(void *opaque)
+{
+    ZDMA *s = XILINX_ZDMA(opaque);
+    uint64_t done = zdma_run_budget(s, ZDMA_ASYNC_CHUNK);
+
+    if (s->state == ENABLED && !s->error) {
+        timer_mod(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                  muldiv64(done, NANOSECONDS_PER_SECOND, s->cfg.bandwidth));
+    }
+}
+
+static void zdma_run(ZDMA *s)
+{
+    if (!s->cfg.bandwidth) {
+        zdma_run_budget(s, UINT64_MAX);
+        return;
     }
 
+    if (s->state == ENABLED && !timer_pending(s->timer)) {
+        timer_mod(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    }
     zdma_ch_update_irq(s);
 }
 
@@ -571,6 +685,7 @@ static void zdma_ch_ctrlx_postw(DepRegisterInfo *reg, uint64_t val64)
 
     if (DEP_AF_EX32(s->regs, ZDMA_CH_CTRL2, EN)) {
         s->error = false;
+        s->xfer.active = false;
 
         if (s->state == PAUSED && DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, CONT)) {
             if (DEP_AF_EX32(s->regs, ZDMA_CH_CTRL0, CONT_ADDR) == 1) {
@@ -709,6 +824,10 @@ static void zdma_reset(DeviceState *dev)
         dep_register_reset(&s->regs_info[i]);
     }
 
+    timer_del(s->timer);
+    s->xfer.active = false;
+    s->state = DISABLED;
+    s->error = false;
     zdma_ch_update_irq(s);
 }
 
@@ -781,6 +900,8 @@ static void zdma_realize(DeviceState *dev, Error **errp)
     } else {
         s->dma_as = &address_space_memory;
     }
+
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, zdma_timer_cb, s);
 }
 
 static void zdma_init(Object *obj)
@@ -818,6 +939,7 @@ static const VMStateDescription vmstate_zdma = {
 
 static Property zdma_props[] = {
     DEFINE_PROP_UINT32("bus-width", ZDMA, cfg.bus_width, 64),
+    DEFINE_PROP_UINT64("bandwidth", ZDMA, cfg.bandwidth, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -30,6 +30,7 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 
+#include "qemu/iov.h"
 #include "sysemu/dma.h"
 #include "hw/stream.h"
 
@@ -59,6 +60,14 @@
 #define CONTROL_PAYLOAD_WORDS 5
 #define CONTROL_PAYLOAD_SIZE (CONTROL_PAYLOAD_WORDS * (sizeof(uint32_t)))
 
+/* Descriptors are fetched in bursts of up to this many bytes, 16
+ * descriptors with the usual 64 byte alignment.
+ */
+#define SG_PREFETCH_SIZE 1024
+#define SG_MAX_DIRTY     16
+/* Max mapped buffers per frame before falling back to txbuf.  */
+#define TX_MAX_IOV       16
+
 typedef struct XilinxAXIDMA XilinxAXIDMA;
 typedef struct XilinxAXIDMAStreamSlave XilinxAXIDMAStreamSlave;
 
@@ -117,6 +126,25 @@ struct Stream {
     AddressSpace *data_as;
     AddressSpace *sg_as;
 
+    /* Prefetched descriptors, a copy of [sg_base, sg_base + sg_len). Only
+     * valid while processing, descriptor updates are written back in
+     * batches of contiguous spans of sg_buf.
+     */
+    uint8_t sg_buf[SG_PREFETCH_SIZE];
+    hwaddr sg_base;
+    hwaddr sg_len;
+    struct {
+        hwaddr start;
+        hwaddr end;
+    } sg_dirty[SG_MAX_DIRTY];
+    int sg_ndirty;
+
+    /* Frame being sent, the first pos bytes in txbuf followed by
+     * tx_niov buffers mapped straight from guest RAM.
+     */
+    struct iovec tx_iov[TX_MAX_IOV];
+    int tx_niov;
+
     unsigned char txbuf[16 * 1024];
 };
 
@@ -189,11 +217,59 @@ static inline int streamid_from_addr(hwaddr addr)
     return sid;
 }
 
+static void stream_desc_flush(struct Stream *s)
+{
+    int i;
+
+    for (i = 0; i < s->sg_ndirty; i++) {
+        hwaddr start = s->sg_dirty[i].start;
+
+        dma_memory_write(s->sg_as, s->sg_base + start, s->sg_buf + start,
+                         s->sg_dirty[i].end - start);
+    }
+    s->sg_ndirty = 0;
+}
+
+/* Writes back pending descriptor updates and forgets about the prefetched
+ * ones, the guest owns them again.
+ */
+static void stream_desc_sync(struct Stream *s)
+{
+    stream_desc_flush(s);
+    s->sg_len = 0;
+}
+
+static void stream_desc_prefetch(struct Stream *s, hwaddr addr)
+{
+    hwaddr tail = s->regs[R_TAILDESC];
+    hwaddr len = sizeof(struct SDesc);
+
+    stream_desc_flush(s);
+
+    /* Never read past the tail, what's after it may not be descriptors.  */
+    if (tail >= addr) {
+        len = MAX(len, MIN(tail - addr + sizeof(struct SDesc),
+                           sizeof s->sg_buf));
+    }
+    dma_memory_read(s->sg_as, addr, s->sg_buf, len);
+    s->sg_base = addr;
+    s->sg_len = len;
+}
+
+static bool stream_desc_cached(struct Stream *s, hwaddr addr)
+{
+    return addr >= s->sg_base
+           && addr + sizeof(struct SDesc) <= s->sg_base + s->sg_len;
+}
+
 static void stream_desc_load(struct Stream *s, hwaddr addr)
 {
     struct SDesc *d = &s->desc;
 
-    dma_memory_read(s->sg_as, addr, d, sizeof *d);
+    if (!stream_desc_cached(s, addr)) {
+        stream_desc_prefetch(s, addr);
+    }
+    memcpy(d, s->sg_buf + (addr - s->sg_base), sizeof *d);
 
     /* Convert from LE into host endianness.  */
     d->buffer_address = le64_to_cpu(d->buffer_address);
@@ -204,14 +280,114 @@ static void stream_desc_load(struct Stream *s, hwaddr addr)
 
 static void stream_desc_store(struct Stream *s, hwaddr addr)
 {
-    struct SDesc *d = &s->desc;
+    struct SDesc d = s->desc;
+    hwaddr start = addr - s->sg_base;
+    hwaddr end = start + sizeof d;
 
     /* Convert from host endianness into LE.  */
-    d->buffer_address = cpu_to_le64(d->buffer_address);
-    d->nxtdesc = cpu_to_le64(d->nxtdesc);
-    d->control = cpu_to_le32(d->control);
-    d->status = cpu_to_le32(d->status);
-    dma_memory_write(s->sg_as, addr, d, sizeof *d);
+    d.buffer_address = cpu_to_le64(d.buffer_address);
+    d.nxtdesc = cpu_to_le64(d.nxtdesc);
+    d.control = cpu_to_le32(d.control);
+    d.status = cpu_to_le32(d.status);
+
+    if (!stream_desc_cached(s, addr)) {
+        dma_memory_write(s->sg_as, addr, &d, sizeof d);
+        return;
+    }
+
+    memcpy(s->sg_buf + start, &d, sizeof d);
+    if (s->sg_ndirty && s->sg_dirty[s->sg_ndirty - 1].end == start) {
+        /* Packed ring, grow the last span.  */
+        s->sg_dirty[s->sg_ndirty - 1].end = end;
+        return;
+    }
+    if (s->sg_ndirty == SG_MAX_DIRTY) {
+        stream_desc_flush(s);
+    }
+    s->sg_dirty[s->sg_ndirty].start = start;
+    s->sg_dirty[s->sg_ndirty].end = end;
+    s->sg_ndirty++;
+}
+
+static void stream_tx_unmap(struct Stream *s, bool copy)
+{
+    int i;
+
+    for (i = 0; i < s->tx_niov; i++) {
+        struct iovec *iov = &s->tx_iov[i];
+
+        if (copy) {
+            if (s->pos + iov->iov_len > sizeof s->txbuf) {
+                hw_error("%s: too small internal txbuf! %zu\n", __func__,
+                         s->pos + iov->iov_len);
+            }
+            memcpy(s->txbuf + s->pos, iov->iov_base, iov->iov_len);
+            s->pos += iov->iov_len;
+        }
+        dma_memory_unmap(s->data_as, iov->iov_base, iov->iov_len,
+                         DMA_DIRECTION_TO_DEVICE, iov->iov_len);
+    }
+    s->tx_niov = 0;
+}
+
+/* Add a buffer to the frame being sent. RAM is mapped, everything else
+ * gets copied into txbuf.
+ */
+static void stream_tx_add(struct Stream *s, hwaddr addr, unsigned int len)
+{
+    hwaddr mlen = len;
+    void *p = NULL;
+
+    if (!len) {
+        return;
+    }
+
+    if (s->tx_niov < TX_MAX_IOV) {
+        p = address_space_map_ram(s->data_as, addr, &mlen, false,
+                                  MEMTXATTRS_UNSPECIFIED);
+        if (p && mlen < len) {
+            dma_memory_unmap(s->data_as, p, mlen, DMA_DIRECTION_TO_DEVICE, 0);
+            p = NULL;
+        }
+    }
+
+    if (p) {
+        s->tx_iov[s->tx_niov].iov_base = p;
+        s->tx_iov[s->tx_niov].iov_len = len;
+        s->tx_niov++;
+        return;
+    }
+
+    /* Keep the frame in order.  */
+    stream_tx_unmap(s, true);
+    if ((len + s->pos) > sizeof s->txbuf) {
+        hw_error("%s: too small internal txbuf! %d\n", __func__,
+                 len + s->pos);
+    }
+    dma_memory_read(s->data_as, addr, s->txbuf + s->pos, len);
+    s->pos += len;
+}
+
+static void stream_tx_push(struct Stream *s, StreamSlave *tx_data_dev)
+{
+    struct iovec iov[TX_MAX_IOV + 1];
+    uint32_t attr = STREAM_ATTR_EOP;
+    int n = 0;
+
+    if (s->pos) {
+        iov[n].iov_base = s->txbuf;
+        iov[n].iov_len = s->pos;
+        n++;
+    }
+    if (s->tx_niov) {
+        memcpy(iov + n, s->tx_iov, s->tx_niov * sizeof iov[0]);
+        n += s->tx_niov;
+        attr |= STREAM_ATTR_READONLY;
+    }
+
+    stream_pushv(tx_data_dev, iov, n, attr);
+    stream_tx_unmap(s, false);
+    s->pos = 0;
 }
 
 static void stream_update_irq(struct Stream *s)
@@ -281,24 +457,17 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
         }
 
         if (stream_desc_sof(&s->desc)) {
+            stream_tx_unmap(s, false);
             s->pos = 0;
             stream_push(tx_control_dev, s->desc.app, sizeof(s->desc.app),
                         STREAM_ATTR_EOP);
         }
 
         txlen = s->desc.control & SDESC_CTRL_LEN_MASK;
-        if ((txlen + s->pos) > sizeof s->txbuf) {
-            hw_error("%s: too small internal txbuf! %d\n", __func__,
-                     txlen + s->pos);
-        }
-
-        dma_memory_read(s->data_as, s->desc.buffer_address,
-                        s->txbuf + s->pos, txlen);
-        s->pos += txlen;
+        stream_tx_add(s, s->desc.buffer_address, txlen);
 
         if (stream_desc_eof(&s->desc)) {
-            stream_push(tx_data_dev, s->txbuf, s->pos, STREAM_ATTR_EOP);
-            s->pos = 0;
+            stream_tx_push(s, tx_data_dev);
             stream_complete(s);
         }
 
@@ -314,13 +483,41 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
             break;
         }
     }
+
+    /* Mappings don't outlive a run, the rest of the frame comes later.  */
+    stream_tx_unmap(s, true);
+    stream_desc_sync(s);
+}
+
+/* Write len bytes starting at offset into the iovec to guest memory.  */
+static void stream_write_iov(struct Stream *s, dma_addr_t addr,
+                             const struct iovec *iov, int iovcnt,
+                             size_t offset, size_t len)
+{
+    int i;
+
+    for (i = 0; i < iovcnt && len; i++) {
+        size_t l;
+
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        l = MIN(len, iov[i].iov_len - offset);
+        dma_memory_write(s->data_as, addr,
+                         (uint8_t *)iov[i].iov_base + offset, l);
+        addr += l;
+        len -= l;
+        offset = 0;
+    }
 }
 
-static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
-                                   size_t len, uint32_t attr)
+static size_t stream_process_s2mem(struct Stream *s, const struct iovec *iov,
+                                   int iovcnt, uint32_t attr)
 {
     uint32_t prev_d;
     unsigned int rxlen;
+    size_t len = iov_size(iov, iovcnt);
     size_t pos = 0;
     int sof = 1;
 
@@ -342,7 +539,7 @@ static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
             rxlen = len;
         }
 
-        dma_memory_write(s->data_as, s->desc.buffer_address, buf + pos, rxlen);
+        stream_write_iov(s, s->desc.buffer_address, iov, iovcnt, pos, rxlen);
         len -= rxlen;
         pos += rxlen;
 
@@ -367,6 +564,7 @@ static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
         }
     }
 
+    stream_desc_sync(s);
     return pos;
 }
 
@@ -414,18 +612,27 @@ xilinx_axidma_data_stream_can_push(StreamSlave *obj,
 }
 
 static size_t
-xilinx_axidma_data_stream_push(StreamSlave *obj, unsigned char *buf, size_t len,
-                               uint32_t attr)
+xilinx_axidma_data_stream_pushv(StreamSlave *obj, const struct iovec *iov,
+                                int iovcnt, uint32_t attr)
 {
     XilinxAXIDMAStreamSlave *ds = XILINX_AXI_DMA_DATA_STREAM(obj);
     struct Stream *s = &ds->dma->streams[1];
     size_t ret;
 
-    ret = stream_process_s2mem(s, buf, len, attr);
+    ret = stream_process_s2mem(s, iov, iovcnt, attr);
     stream_update_irq(s);
     return ret;
 }
 
+static size_t
+xilinx_axidma_data_stream_push(StreamSlave *obj, unsigned char *buf, size_t len,
+                               uint32_t attr)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return xilinx_axidma_data_stream_pushv(obj, &iov, 1, attr);
+}
+
 static uint64_t axidma_read(void *opaque, hwaddr addr,
                             unsigned size)
 {
@@ -633,6 +840,7 @@ static void axidma_class_init(ObjectClass *klass, void *data)
 
 static StreamSlaveClass xilinx_axidma_data_stream_class = {
     .push = xilinx_axidma_data_stream_push,
+    .pushv = xilinx_axidma_data_stream_pushv,
     .can_push = xilinx_axidma_data_stream_can_push,
 };
 
@@ -645,6 +853,7 @@ static void xilinx_axidma_stream_class_init(ObjectClass *klass, void *data)
     StreamSlaveClass *ssc = STREAM_SLAVE_CLASS(klass);
 
     ssc->push = ((StreamSlaveClass *)data)->push;
+    ssc->pushv = ((StreamSlaveClass *)data)->pushv;
     ssc->can_push = ((StreamSlaveClass *)data)->can_push;
 }
 
@@ -180,6 +180,7 @@ typedef struct XilinxDevcfg {
     SysBusDevice parent_obj;
 
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
     MemoryRegion *dma_mr;
     AddressSpace *dma_as;
     qemu_irq irq;
@@ -389,8 +390,8 @@ static const DepRegisterAccessInfo xilinx_devcfg_regs_info[] = {
 };
 
 static const MemoryRegionOps devcfg_reg_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -404,6 +405,8 @@ static void xilinx_devcfg_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &devcfg_reg_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(xilinx_devcfg_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -416,9 +419,7 @@ static void xilinx_devcfg_realize(DeviceState *dev, Error **errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &devcfg_reg_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
 
         if (s->dma_mr) {
             s->dma_as = g_malloc0(sizeof *as);
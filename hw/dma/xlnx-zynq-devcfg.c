@@ -27,6 +27,8 @@
 #include "qemu/osdep.h"
 #include "hw/dma/xlnx-zynq-devcfg.h"
 #include "qemu/bitops.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/dma.h"
 #include "qemu/log.h"
@@ -35,6 +37,9 @@
 
 #define BTT_MAX 0x400
 
+/* 32 bits per cycle of the 100 MHz PCAP clock */
+#define PCAP_BANDWIDTH 400000000
+
 #ifndef XLNX_ZYNQ_DEVCFG_ERR_DEBUG
 #define XLNX_ZYNQ_DEVCFG_ERR_DEBUG 0
 #endif
@@ -136,6 +141,15 @@ static void xlnx_zynq_devcfg_update_ixr(XlnxZynqDevcfg *s)
     qemu_set_irq(s->irq, ~s->regs[R_INT_MASK] & s->regs[R_INT_STS]);
 }
 
+static void xlnx_zynq_devcfg_update_status(XlnxZynqDevcfg *s)
+{
+    s->regs[R_STATUS] = FIELD_DP32(s->regs[R_STATUS], STATUS, DMA_CMD_Q_E,
+                                   !s->dma_cmd_fifo_num);
+    s->regs[R_STATUS] = FIELD_DP32(s->regs[R_STATUS], STATUS, DMA_CMD_Q_F,
+                                   s->dma_cmd_fifo_num ==
+                                   XLNX_ZYNQ_DEVCFG_DMA_CMD_FIFO_LEN);
+}
+
 static void xlnx_zynq_devcfg_reset(DeviceState *dev)
 {
     XlnxZynqDevcfg *s = XLNX_ZYNQ_DEVCFG(dev);
@@ -144,40 +158,111 @@ static void xlnx_zynq_devcfg_reset(DeviceState *dev)
     for (i = 0; i < XLNX_ZYNQ_DEVCFG_R_MAX; ++i) {
         register_reset(&s->regs_info[i]);
     }
+    timer_del(s->dma_timer);
+    s->dma_cmd_fifo_num = 0;
 }
 
-static void xlnx_zynq_devcfg_dma_go(XlnxZynqDevcfg *s)
+/* Move all of a DMA command, in one access wherever both ends are RAM.
+ * Without the loopback the bitstream goes to the fabric, which isn't
+ * modelled, so RAM sources are only mapped and never copied.  Neither is
+ * readback from the fabric, nor the remainder of a loopback with mismatched
+ * lengths.
+ */
+static void xlnx_zynq_devcfg_dma_xfer(XlnxZynqDevcfg *s,
+                                      XlnxZynqDevcfgDMACmd *dmah)
 {
-    do {
+    AddressSpace *as = &address_space_memory;
+    bool loopback = s->regs[R_MCTRL] & R_MCTRL_INT_PCAP_LPBK_MASK;
+    uint32_t len = loopback ? MIN(dmah->src_len, dmah->dest_len)
+                            : dmah->src_len;
+
+    while (len) {
         uint8_t buf[BTT_MAX];
-        XlnxZynqDevcfgDMACmd *dmah = s->dma_cmd_fifo;
-        uint32_t btt = BTT_MAX;
-        bool loopback = s->regs[R_MCTRL] & R_MCTRL_INT_PCAP_LPBK_MASK;
+        hwaddr src_len = len, dst_len = 0, btt;
+        uint8_t *src, *dst = NULL;
+
+        src = address_space_map_ram(as, dmah->src_addr, &src_len, false,
+                                    MEMTXATTRS_UNSPECIFIED);
+        if (src) {
+            btt = src_len;
+            if (loopback) {
+                dst_len = btt;
+                dst = address_space_map_ram(as, dmah->dest_addr, &dst_len,
+                                            true, MEMTXATTRS_UNSPECIFIED);
+                if (dst) {
+                    btt = MIN(btt, dst_len);
+                }
+            }
+        } else {
+            btt = MIN(len, BTT_MAX);
+            DB_PRINT("reading %" HWADDR_PRIx " bytes from %x\n",
+                     btt, dmah->src_addr);
+            dma_memory_read(as, dmah->src_addr, buf, btt);
+        }
 
-        btt = MIN(btt, dmah->src_len);
         if (loopback) {
-            btt = MIN(btt, dmah->dest_len);
-        }
-        DB_PRINT("reading %x bytes from %x\n", btt, dmah->src_addr);
-        dma_memory_read(&address_space_memory, dmah->src_addr, buf, btt);
-        dmah->src_len -= btt;
-        dmah->src_addr += btt;
-        if (loopback && (dmah->src_len || dmah->dest_len)) {
-            DB_PRINT("writing %x bytes from %x\n", btt, dmah->dest_addr);
-            dma_memory_write(&address_space_memory, dmah->dest_addr, buf, btt);
-            dmah->dest_len -= btt;
+            DB_PRINT("writing %" HWADDR_PRIx " bytes to %x\n",
+                     btt, dmah->dest_addr);
+            if (dst) {
+                memcpy(dst, src, btt);
+                address_space_unmap(as, dst, dst_len, true, btt);
+            } else {
+                dma_memory_write(as, dmah->dest_addr, src ? src : buf, btt);
+            }
             dmah->dest_addr += btt;
         }
-        if (!dmah->src_len && !dmah->dest_len) {
-            DB_PRINT("dma operation finished\n");
-            s->regs[R_INT_STS] |= R_INT_STS_DMA_DONE_MASK |
-                                  R_INT_STS_DMA_P_DONE_MASK;
-            s->dma_cmd_fifo_num--;
-            memmove(s->dma_cmd_fifo, &s->dma_cmd_fifo[1],
-                    sizeof(s->dma_cmd_fifo) - sizeof(s->dma_cmd_fifo[0]));
+        if (src) {
+            address_space_unmap(as, src, src_len, false, btt);
         }
-        xlnx_zynq_devcfg_update_ixr(s);
-    } while (s->dma_cmd_fifo_num);
+        dmah->src_addr += btt;
+        len -= btt;
+    }
+    dmah->src_len = 0;
+    dmah->dest_len = 0;
+}
+
+static void xlnx_zynq_devcfg_dma_done(XlnxZynqDevcfg *s)
+{
+    DB_PRINT("dma operation finished\n");
+    s->regs[R_INT_STS] |= R_INT_STS_DMA_DONE_MASK | R_INT_STS_DMA_P_DONE_MASK;
+    s->dma_cmd_fifo_num--;
+    memmove(s->dma_cmd_fifo, &s->dma_cmd_fifo[1],
+            sizeof(s->dma_cmd_fifo) - sizeof(s->dma_cmd_fifo[0]));
+    xlnx_zynq_devcfg_update_status(s);
+    xlnx_zynq_devcfg_update_ixr(s);
+}
+
+/* A paced command completes, and is only then moved, once the PCAP would
+ * have gotten through it at the configured bandwidth.
+ */
+static void xlnx_zynq_devcfg_dma_go(XlnxZynqDevcfg *s)
+{
+    XlnxZynqDevcfgDMACmd *dmah = s->dma_cmd_fifo;
+    uint64_t len;
+
+    if (!s->bandwidth) {
+        while (s->dma_cmd_fifo_num) {
+            xlnx_zynq_devcfg_dma_xfer(s, dmah);
+            xlnx_zynq_devcfg_dma_done(s);
+        }
+        return;
+    }
+
+    if (!s->dma_cmd_fifo_num || timer_pending(s->dma_timer)) {
+        return;
+    }
+    len = MAX(dmah->src_len, dmah->dest_len);
+    timer_mod(s->dma_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              muldiv64(len, NANOSECONDS_PER_SECOND, s->bandwidth));
+}
+
+static void xlnx_zynq_devcfg_dma_timer_cb(void *opaque)
+{
+    XlnxZynqDevcfg *s = XLNX_ZYNQ_DEVCFG(opaque);
+
+    xlnx_zynq_devcfg_dma_xfer(s, s->dma_cmd_fifo);
+    xlnx_zynq_devcfg_dma_done(s);
+    xlnx_zynq_devcfg_dma_go(s);
 }
 
 static void r_ixr_post_write(RegisterInfo *reg, uint64_t val)
@@ -244,6 +329,13 @@ static void r_dma_dst_len_post_write(RegisterInfo *reg, uint64_t val)
 {
     XlnxZynqDevcfg *s = XLNX_ZYNQ_DEVCFG(reg->opaque);
 
+    if (s->dma_cmd_fifo_num == XLNX_ZYNQ_DEVCFG_DMA_CMD_FIFO_LEN) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA command queue overflow\n",
+                      object_get_typename(OBJECT(s)));
+        s->regs[R_INT_STS] |= R_INT_STS_DMA_Q_OV_MASK;
+        xlnx_zynq_devcfg_update_ixr(s);
+        return;
+    }
     s->dma_cmd_fifo[s->dma_cmd_fifo_num] = (XlnxZynqDevcfgDMACmd) {
             .src_addr = s->regs[R_DMA_SRC_ADDR] & ~0x3UL,
             .dest_addr = s->regs[R_DMA_DST_ADDR] & ~0x3UL,
@@ -253,6 +345,7 @@ static void r_dma_dst_len_post_write(RegisterInfo *reg, uint64_t val)
     s->dma_cmd_fifo_num++;
     DB_PRINT("dma transfer started; %d total transfers pending\n",
              s->dma_cmd_fifo_num);
+    xlnx_zynq_devcfg_update_status(s);
     xlnx_zynq_devcfg_dma_go(s);
 }
 
@@ -338,6 +431,24 @@ static const VMStateDescription vmstate_xlnx_zynq_devcfg_dma_cmd = {
     }
 };
 
+static bool xlnx_zynq_devcfg_dma_timer_needed(void *opaque)
+{
+    XlnxZynqDevcfg *s = XLNX_ZYNQ_DEVCFG(opaque);
+
+    return timer_pending(s->dma_timer);
+}
+
+static const VMStateDescription vmstate_xlnx_zynq_devcfg_dma_timer = {
+    .name = "xlnx_zynq_devcfg/dma_timer",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = xlnx_zynq_devcfg_dma_timer_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_TIMER_PTR(dma_timer, XlnxZynqDevcfg),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_xlnx_zynq_devcfg = {
     .name = "xlnx_zynq_devcfg",
     .version_id = 1,
@@ -350,9 +461,18 @@ static const VMStateDescription vmstate_xlnx_zynq_devcfg = {
         VMSTATE_UINT8(dma_cmd_fifo_num, XlnxZynqDevcfg),
         VMSTATE_UINT32_ARRAY(regs, XlnxZynqDevcfg, XLNX_ZYNQ_DEVCFG_R_MAX),
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_xlnx_zynq_devcfg_dma_timer,
+        NULL
     }
 };
 
+static Property xlnx_zynq_devcfg_props[] = {
+    DEFINE_PROP_UINT64("bandwidth", XlnxZynqDevcfg, bandwidth, PCAP_BANDWIDTH),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void xlnx_zynq_devcfg_init(Object *obj)
 {
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
@@ -360,6 +480,8 @@ static void xlnx_zynq_devcfg_init(Object *obj)
     RegisterInfoArray *reg_array;
 
     sysbus_init_irq(sbd, &s->irq);
+    s->dma_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                xlnx_zynq_devcfg_dma_timer_cb, s);
 
     memory_region_init(&s->iomem, obj, "devcfg", XLNX_ZYNQ_DEVCFG_R_MAX * 4);
     reg_array =
@@ -382,6 +504,7 @@ static void xlnx_zynq_devcfg_class_init(ObjectClass *klass, void *data)
 
     dc->reset = xlnx_zynq_devcfg_reset;
     dc->vmsd = &vmstate_xlnx_zynq_devcfg;
+    dc->props = xlnx_zynq_devcfg_props;
 }
 
 static const TypeInfo xlnx_zynq_devcfg_info = {
@@ -561,6 +561,100 @@ static const MemoryRegionOps dma_ops = {
     },
 };
 
+/* Display channels, the audio ones consume what they fetch.  */
+#define DPDMA_FB_CHANNELS 4
+
+static void xlnx_dpdma_fb_release(XlnxDPDMAState *s, uint8_t channel)
+{
+    XlnxDPDMAFrameCache *fb = &s->fb[channel];
+
+    if (fb->mr) {
+        memory_region_set_log(fb->mr, false, DIRTY_MEMORY_VGA);
+        memory_region_unref(fb->mr);
+    }
+    memset(fb, 0, sizeof(*fb));
+}
+
+/*
+ * Fetch a contiguous frame directly from guest RAM. Lines that weren't
+ * written since the previous fetch of the same frame into the same buffer
+ * are skipped. Returns false if the frame isn't in RAM.
+ */
+static void xlnx_dpdma_mark_dirty(XlnxDPDMAState *s, uint8_t channel,
+                                  size_t start, size_t end)
+{
+    if (s->dirty_start[channel] >= s->dirty_end[channel]) {
+        s->dirty_start[channel] = start;
+        s->dirty_end[channel] = end;
+    } else {
+        s->dirty_start[channel] = MIN(s->dirty_start[channel], start);
+        s->dirty_end[channel] = MAX(s->dirty_end[channel], end);
+    }
+}
+
+static bool xlnx_dpdma_fetch_mapped(XlnxDPDMAState *s, uint8_t channel,
+                                    uint64_t addr, uint8_t *data,
+                                    uint32_t line_size, uint32_t line_stride,
+                                    uint32_t lines)
+{
+    XlnxDPDMAFrameCache *fb = &s->fb[channel];
+    uint64_t span = (uint64_t)(lines - 1) * line_stride + line_size;
+    MemoryRegionSection section;
+    DirtyBitmapSnapshot *snap;
+    uint8_t *host;
+    hwaddr offset;
+    bool full;
+    uint32_t i;
+
+    section = memory_region_find(s->dma_as->root, addr, span);
+    if (!section.mr) {
+        return false;
+    }
+    if (!memory_region_is_ram(section.mr)
+        || int128_lt(section.size, int128_make64(span))) {
+        memory_region_unref(section.mr);
+        return false;
+    }
+
+    if (fb->mr != section.mr) {
+        /* Keeps the reference taken by memory_region_find.  */
+        xlnx_dpdma_fb_release(s, channel);
+        memory_region_set_log(section.mr, true, DIRTY_MEMORY_VGA);
+        fb->mr = section.mr;
+    } else {
+        memory_region_unref(section.mr);
+    }
+
+    offset = section.offset_within_region;
+    full = fb->data != data || fb->offset != offset
+           || fb->line_size != line_size || fb->line_stride != line_stride
+           || fb->lines != lines;
+
+    snap = memory_region_snapshot_and_clear_dirty(fb->mr, offset, span,
+                                                  DIRTY_MEMORY_VGA);
+    host = memory_region_get_ram_ptr(fb->mr) + offset;
+    for (i = 0; i < lines; i++) {
+        hwaddr line = (hwaddr)i * line_stride;
+
+        if (full || memory_region_snapshot_get_dirty(fb->mr, snap,
+                                                     offset + line,
+                                                     line_size)) {
+            size_t pos = data - s->data[channel] + (size_t)i * line_size;
+
+            memcpy(data + (size_t)i * line_size, host + line, line_size);
+            xlnx_dpdma_mark_dirty(s, channel, pos, pos + line_size);
+        }
+    }
+    g_free(snap);
+
+    fb->offset = offset;
+    fb->line_size = line_size;
+    fb->line_stride = line_stride;
+    fb->lines = lines;
+    fb->data = data;
+    return true;
+}
+
 static void xlnx_dpdma_realize(DeviceState *dev, Error **errp)
 {
     XlnxDPDMAState *s = XLNX_DPDMA(dev);
@@ -603,9 +697,15 @@ static void xlnx_dpdma_reset(DeviceState *dev)
     for (i = 0; i < 6; i++) {
         s->data[i] = NULL;
         s->operation_finished[i] = true;
+        xlnx_dpdma_fb_release(s, i);
     }
 }
 
+static Property xlnx_dpdma_properties[] = {
+    DEFINE_PROP_BOOL("map-framebuffer", XlnxDPDMAState, map_fb, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void xlnx_dpdma_class_init(ObjectClass *oc, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(oc);
@@ -613,6 +713,7 @@ static void xlnx_dpdma_class_init(ObjectClass *oc, void *data)
     dc->vmsd = &vmstate_xlnx_dpdma;
     dc->reset = xlnx_dpdma_reset;
     dc->realize = xlnx_dpdma_realize;
+    dc->props = xlnx_dpdma_properties;
 }
 
 static const TypeInfo xlnx_dpdma_info = {
@@ -718,6 +819,16 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
             uint32_t line_stride = xlnx_dpdma_desc_get_line_stride(&desc);
             if (xlnx_dpdma_desc_is_contiguous(&desc)) {
                 source_addr[0] = xlnx_dpdma_desc_get_source_address(&desc, 0);
+                if (s->map_fb && channel < DPDMA_FB_CHANNELS
+                    && line_size && transfer_len > 0
+                    && transfer_len % line_size == 0
+                    && xlnx_dpdma_fetch_mapped(s, channel, source_addr[0],
+                                               &s->data[channel][ptr],
+                                               line_size, line_stride,
+                                               transfer_len / line_size)) {
+                    ptr += transfer_len;
+                    transfer_len = 0;
+                }
                 while (transfer_len != 0) {
                     if (dma_memory_read(s->dma_as,
                                         source_addr[0],
@@ -728,6 +839,7 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
                         DPRINTF("Can't get data.\n");
                         break;
                     }
+                    xlnx_dpdma_mark_dirty(s, channel, ptr, ptr + line_size);
                     ptr += line_size;
                     transfer_len -= line_size;
                     source_addr[0] += line_stride;
@@ -756,6 +868,8 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
                         DPRINTF("Can't get data.\n");
                         break;
                     }
+                    xlnx_dpdma_mark_dirty(s, channel, ptr,
+                                          ptr + fragment_len);
                     ptr += fragment_len;
                     transfer_len -= fragment_len;
                     frag += 1;
@@ -793,6 +907,21 @@ void xlnx_dpdma_set_host_data_location(XlnxDPDMAState *s, uint8_t channel,
 
     assert(channel <= 5);
     s->data[channel] = p;
+    /* The buffer may be new even if p isn't.  */
+    s->fb[channel].data = NULL;
+}
+
+bool xlnx_dpdma_take_dirty(XlnxDPDMAState *s, uint8_t channel,
+                           size_t *start, size_t *end)
+{
+    assert(channel <= 5);
+    if (s->dirty_start[channel] >= s->dirty_end[channel]) {
+        return false;
+    }
+    *start = s->dirty_start[channel];
+    *end = s->dirty_end[channel];
+    s->dirty_start[channel] = s->dirty_end[channel] = 0;
+    return true;
 }
 
 void xlnx_dpdma_trigger_vsync_irq(XlnxDPDMAState *s)
@@ -28,6 +28,7 @@
 #include "hw/register-dep.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "hw/fdt_generic_util.h"
 
 #ifndef XLNX_AXI_GPIO_ERR_DEBUG
 #define XLNX_AXI_GPIO_ERR_DEBUG 0
@@ -59,6 +60,7 @@ typedef struct XlnxAXIGPIO {
 
     qemu_irq parent_irq;
     qemu_irq outputs1[32], outputs2[32];
+    qemu_irq vector_out[2];
 
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
@@ -112,6 +114,36 @@ static void data_handler2(void *opaque, int irq, int level)
     data_handler(opaque, irq, level, 2);
 }
 
+/* Inputs of channel n + 1 as a GPIO vector */
+static void data_vector_handler(void *opaque, int n, int level)
+{
+    XlnxAXIGPIO *s = XLNX_AXI_GPIO(opaque);
+    unsigned int data_regnr, tri_regnr;
+    uint32_t data;
+
+    assert(n >= 0 && n < 2);
+    data_regnr = n == 0 ? R_GPIO_DATA : R_GPIO2_DATA;
+    tri_regnr = n == 0 ? R_GPIO_TRI : R_GPIO2_TRI;
+
+    data = (s->regs[data_regnr] & ~s->regs[tri_regnr]) |
+           (level & s->regs[tri_regnr]);
+    if (data == s->regs[data_regnr]) {
+        return;
+    }
+    s->regs[data_regnr] = data;
+
+    switch (n) {
+    case 0:
+        DEP_AF_DP32(s->regs, IP_ISR, CHANNEL1_ST, 1);
+        break;
+    case 1:
+        DEP_AF_DP32(s->regs, IP_ISR, CHANNEL2_ST, 1);
+        break;
+    }
+
+    irq_update(s);
+}
+
 static void xlnx_axi_gpio_data_post_write(XlnxAXIGPIO *s, uint64_t val,
                                           int channel)
 {
@@ -139,6 +171,8 @@ static void xlnx_axi_gpio_data_post_write(XlnxAXIGPIO *s, uint64_t val,
             break;
         }
     }
+
+    qemu_set_irq(s->vector_out[channel - 1], val & ~s->regs[tri_regnr]);
 }
 
 static void xlnx_axi_gpio_data_post_write1(DepRegisterInfo *reg, uint64_t val)
@@ -284,6 +318,10 @@ static void xlnx_axi_gpio_realize(DeviceState *dev, Error **errp)
     /* Create GPIO banks as well */
     qdev_init_gpio_out(dev, s->outputs1, 32);
     qdev_init_gpio_out(dev, s->outputs2, 32);
+
+    /* And both channels as GPIO vectors */
+    qdev_init_gpio_in_named(dev, data_vector_handler, GPIO_VECTOR_IN_NAME, 2);
+    qdev_init_gpio_out_named(dev, s->vector_out, GPIO_VECTOR_OUT_NAME, 2);
 }
 
 static void xlnx_axi_gpio_init(Object *obj)
@@ -309,13 +347,26 @@ static const VMStateDescription vmstate_gpio = {
     }
 };
 
+static const FDTGenericGPIOSet xlnx_axi_gpio_controller_gpios[] = {
+    {
+        .names = &fdt_generic_gpio_name_set_gpio_vector,
+        .gpios = (FDTGenericGPIOConnection []) {
+            { .name = GPIO_VECTOR_OUT_NAME, .fdt_index = 0, .range = 2 },
+            { },
+        },
+    },
+    { },
+};
+
 static void xlnx_axi_gpio_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
+    FDTGenericGPIOClass *fggc = FDT_GENERIC_GPIO_CLASS(klass);
 
     dc->reset = xlnx_axi_gpio_reset;
     dc->realize = xlnx_axi_gpio_realize;
     dc->vmsd = &vmstate_gpio;
+    fggc->controller_gpios = xlnx_axi_gpio_controller_gpios;
 }
 
 static const TypeInfo xlnx_axi_gpio_info = {
@@ -324,6 +375,10 @@ static const TypeInfo xlnx_axi_gpio_info = {
     .instance_size = sizeof(XlnxAXIGPIO),
     .class_init    = xlnx_axi_gpio_class_init,
     .instance_init = xlnx_axi_gpio_init,
+    .interfaces    = (InterfaceInfo[]) {
+        { TYPE_FDT_GENERIC_GPIO },
+        { }
+    },
 };
 
 static void xlnx_axi_gpio_register_types(void)
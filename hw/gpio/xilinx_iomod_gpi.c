@@ -25,7 +25,6 @@
 
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
-#include "hw/register-dep.h"
 #include "qemu/log.h"
 
 #include "hw/fdt_generic_util.h"
@@ -55,7 +54,6 @@ typedef struct XilinxGPI {
         uint32_t size;
     } cfg;
     uint32_t regs[R_MAX];
-    DepRegisterInfo regs_info[R_MAX];
     const char *prefix;
 } XilinxGPI;
 
@@ -66,9 +64,25 @@ static Property xlx_iom_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+/* Firmware polls GPI in its idle loop, so reads go straight to the
+ * latched inputs rather than through the register API.
+ */
+static uint64_t iom_gpi_read(void *opaque, hwaddr addr, unsigned size)
+{
+    XilinxGPI *s = XILINX_IO_MODULE_GPI(opaque);
+
+    return s->regs[R_IOM_GPI];
+}
+
+static void iom_gpi_write(void *opaque, hwaddr addr, uint64_t value,
+                          unsigned size)
+{
+    /* GPI is read-only */
+}
+
 static const MemoryRegionOps iom_gpi_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read = iom_gpi_read,
+    .write = iom_gpi_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -115,18 +129,11 @@ static void ien_handler(void *opaque, int n, int level)
     }
 }
 
-static const DepRegisterAccessInfo gpi_regs_info[] = {
-    [R_IOM_GPI] = { .name = "GPI", .ro = ~0 },
-};
-
 static void iom_gpi_reset(DeviceState *dev)
 {
     XilinxGPI *s = XILINX_IO_MODULE_GPI(dev);
-    unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        dep_register_reset(&s->regs_info[i]);
-    }
+    s->regs[R_IOM_GPI] = 0;
     /* Disable all interrupts initially. */
     s->ien = 0;
 }
@@ -134,25 +141,8 @@ static void iom_gpi_reset(DeviceState *dev)
 static void xlx_iom_realize(DeviceState *dev, Error **errp)
 {
     XilinxGPI *s = XILINX_IO_MODULE_GPI(dev);
-    unsigned int i;
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        DepRegisterInfo *r = &s->regs_info[i];
-
-        *r = (DepRegisterInfo) {
-            .data = (uint8_t *)&s->regs[i],
-            .data_size = sizeof(uint32_t),
-            .access = &gpi_regs_info[i],
-            .debug = XILINX_IO_MODULE_GPI_ERR_DEBUG,
-            .prefix = s->prefix,
-            .opaque = s,
-        };
-        memory_region_init_io(&r->mem, OBJECT(dev), &iom_gpi_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, i * 4, &r->mem);
-    }
-
     assert(s->cfg.size <= 32);
     /* FIXME: Leave the std ones for qtest. Add a qtest way to name
        the GPIO namespace.  */
@@ -167,8 +157,7 @@ static void xlx_iom_init(Object *obj)
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
     memory_region_init_io(&s->iomem, obj, &iom_gpi_ops, s,
-                          TYPE_XILINX_IO_MODULE_GPI,
-                          R_MAX * 4);
+                          TYPE_XILINX_IO_MODULE_GPI, R_MAX * 4);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->parent_irq);
 }
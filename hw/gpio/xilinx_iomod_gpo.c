@@ -43,6 +43,7 @@
 typedef struct XilinxGPO {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     struct {
         bool use;
@@ -51,6 +52,8 @@ typedef struct XilinxGPO {
     } cfg;
     DepRegisterInfo regs_info[R_MAX];
 
+    /* Levels last driven on outputs */
+    uint32_t value;
     qemu_irq outputs[32];
     const char *prefix;
 } XilinxGPO;
@@ -63,8 +66,8 @@ static Property xlx_iom_properties[] = {
 };
 
 static const MemoryRegionOps iom_gpo_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -72,17 +75,29 @@ static const MemoryRegionOps iom_gpo_ops = {
     },
 };
 
-static void gpo_pw(DepRegisterInfo *reg, uint64_t value)
+static void gpo_set_outputs(XilinxGPO *s, uint32_t changed)
 {
-    XilinxGPO *s = XILINX_IO_MODULE_GPO(reg->opaque);
     unsigned int i;
 
     for (i = 0; i < s->cfg.size; i++) {
-        bool flag = !!(value & (1 << i));
-        qemu_set_irq(s->outputs[i], flag);
+        if (changed & (1 << i)) {
+            qemu_set_irq(s->outputs[i], !!(s->value & (1 << i)));
+        }
     }
 }
 
+/* Only lines that change are driven, so the GPIs and PITs behind them
+ * don't see every write the firmware does.
+ */
+static void gpo_pw(DepRegisterInfo *reg, uint64_t value)
+{
+    XilinxGPO *s = XILINX_IO_MODULE_GPO(reg->opaque);
+    uint32_t changed = s->value ^ value;
+
+    s->value = value;
+    gpo_set_outputs(s, changed);
+}
+
 static uint64_t gpo_pr(DepRegisterInfo *reg, uint64_t value)
 {
     return 0;
@@ -96,7 +111,8 @@ static void iom_gpo_reset(DeviceState *dev)
 {
     XilinxGPO *s = XILINX_IO_MODULE_GPO(dev);
 
-    gpo_pw(&s->regs_info[R_IOM_GPO], s->cfg.init);
+    s->value = s->cfg.init;
+    gpo_set_outputs(s, ~0);
 }
 
 static void xlx_iom_realize(DeviceState *dev, Error **errp)
@@ -105,6 +121,8 @@ static void xlx_iom_realize(DeviceState *dev, Error **errp)
     unsigned int i;
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &iom_gpo_ops,
+                            &s->iomem, s->prefix);
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -115,9 +133,7 @@ static void xlx_iom_realize(DeviceState *dev, Error **errp)
             .prefix = s->prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &iom_gpo_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, i * 4, &r->mem);
+        dep_register_block_add(&s->regs_block, r, i * 4);
     }
 
     assert(s->cfg.size <= 32);
@@ -129,9 +145,8 @@ static void xlx_iom_init(Object *obj)
     XilinxGPO *s = XILINX_IO_MODULE_GPO(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
-    memory_region_init_io(&s->iomem, obj, &iom_gpo_ops, s,
-                          TYPE_XILINX_IO_MODULE_GPO,
-                          R_MAX * 4);
+    memory_region_init(&s->iomem, obj, TYPE_XILINX_IO_MODULE_GPO,
+                       R_MAX * 4);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
@@ -217,6 +217,7 @@ typedef struct XlnxZynqmpGPIO {
     qemu_irq irq;
     qemu_irq *gpio_out;
     qemu_irq *gpio_oen;
+    qemu_irq gpio_vector_out[ZYNQMP_GPIO_NUM_BANKS];
 
     bool por_done;
     uint32_t regs[R_MAX];
@@ -336,6 +337,10 @@ static void gpio_update_pins(XlnxZynqmpGPIO *s, int bank, int offset, int width,
             qemu_set_irq(s->gpio_out[i], extract32(val, i - pin, 1));
         }
     }
+
+    qemu_set_irq(s->gpio_vector_out[bank],
+                 deposit32(s->regs[R_GPIO_DATA_X(bank)], offset, width, val) &
+                 s->regs[R_GPIO_OEN_X(bank)] & s->regs[R_GPIO_DIRM_X(bank)]);
 }
 
 static void zynqmp_gpio_in_handler(void *opaque, int n, int level)
@@ -360,6 +365,36 @@ static void zynqmp_gpio_in_handler(void *opaque, int n, int level)
     gpio_update_irq(s);
 }
 
+/* The inputs of bank n as a GPIO vector */
+static void zynqmp_gpio_vector_in_handler(void *opaque, int n, int level)
+{
+    XlnxZynqmpGPIO *s = XLNX_ZYNQMP_GPIO(opaque);
+    uint32_t data_old = s->regs[R_GPIO_DATA_X(n)];
+    uint32_t mask = ~s->regs[R_GPIO_DIRM_X(n)];
+    uint32_t changed;
+    int i;
+
+    /* BANK 0,1,2 have 26 pins each
+     * BANK 3,4,5 have 32 pins each
+     */
+    if (n < ZYNQMP_GPIO_NUM_MIO_BANKS) {
+        mask &= MAKE_64BIT_MASK(0, ZYNQMP_NUM_MIO_PINS_PER_BANK);
+    }
+    changed = (data_old ^ level) & mask;
+    if (!changed) {
+        return;
+    }
+
+    s->regs[R_GPIO_DATA_X(n)] ^= changed;
+    for (i = 0; i < 32; i++) {
+        if (changed & (1U << i)) {
+            gpio_update_isr(s, n, i, extract32(level, i, 1),
+                            extract32(data_old, i, 1));
+        }
+    }
+    gpio_update_irq(s);
+}
+
 static uint64_t gpio_data_reg_prew(RegisterInfo *reg, uint64_t val)
 {
     XlnxZynqmpGPIO *s = XLNX_ZYNQMP_GPIO(reg->opaque);
@@ -812,6 +847,11 @@ static void gpio_realize(DeviceState *dev, Error **errp)
     qdev_init_gpio_in_named(dev, zynqmp_gpio_in_handler, gpios_name,
                             ZYNQMP_NUM_GPIOS);
     g_free((gpointer)gpios_name);
+
+    qdev_init_gpio_out_named(dev, s->gpio_vector_out, GPIO_VECTOR_OUT_NAME,
+                             ZYNQMP_GPIO_NUM_BANKS);
+    qdev_init_gpio_in_named(dev, zynqmp_gpio_vector_in_handler,
+                            GPIO_VECTOR_IN_NAME, ZYNQMP_GPIO_NUM_BANKS);
 }
 
 static void gpio_init(Object *obj)
@@ -857,6 +897,14 @@ static const FDTGenericGPIOSet xlnx_gpio_controller_gpios[] = {
             { },
         },
     },
+    {
+        .names = &fdt_generic_gpio_name_set_gpio_vector,
+        .gpios = (FDTGenericGPIOConnection []) {
+            { .name = GPIO_VECTOR_OUT_NAME, .fdt_index = 0,
+              .range = ZYNQMP_GPIO_NUM_BANKS },
+            { },
+        },
+    },
     { },
 };
 
@@ -869,6 +917,14 @@ static const FDTGenericGPIOSet xlnx_gpio_client_gpios[] = {
            { },
         },
     },
+    {
+        .names = &fdt_generic_gpio_name_set_gpio_vector,
+        .gpios = (FDTGenericGPIOConnection []) {
+           { .name = GPIO_VECTOR_IN_NAME, .fdt_index = 0,
+             .range = ZYNQMP_GPIO_NUM_BANKS },
+           { },
+        },
+    },
     { },
 };
 
@@ -188,16 +188,21 @@ static void cadence_i2c_do_txrx(void *opaque)
         if (fifo_is_empty(&s->fifo)) {
             cadence_i2c_do_stop(s);
         } else {
-            uint8_t t = fifo_pop8(&s->fifo);
-            if (i2c_send(s->bus, t)) {
+            /* Hand the whole FIFO to the bus at once */
+            uint32_t num, sent;
+            const uint8_t *buf = fifo_peek_buf(&s->fifo, s->fifo.num, &num);
+
+            sent = i2c_send_buf(s->bus, buf, num);
+            if (sent < num) {
+                /* The NAKed byte is gone, the rest goes out next time */
                 s->regs[R_ISR] |= ISR_NACK;
+                sent++;
             }
+            fifo_pop_buf(&s->fifo, sent, &num);
             if (fifo_is_empty(&s->fifo)) {
                 s->regs[R_ISR] |= ISR_COMP;
             }
-            if (s->regs[R_TRANSFER_SIZE]) {
-                s->regs[R_TRANSFER_SIZE]--;
-            }
+            s->regs[R_TRANSFER_SIZE] -= MIN(s->regs[R_TRANSFER_SIZE], sent);
             if (s->fifo.num <= 2) {
                 s->regs[R_ISR] |= ISR_DATA;
             }
@@ -218,9 +223,19 @@ static void cadence_i2c_do_txrx(void *opaque)
             cadence_i2c_do_stop(s);
         /* fifo not full - do a byte sucessfully */
         } else if (!fifo_is_full(&s->fifo)) {
-            uint8_t r = i2c_recv(s->bus);
-            DB_PRINT("receiving from I2C bus: %02x\n", r);
-            fifo_push8(&s->fifo, r);
+            uint8_t buf[FIFO_WIDTH];
+            uint32_t n = MIN(fifo_num_free(&s->fifo),
+                             s->regs[R_TRANSFER_SIZE]);
+
+            /* Without ACKEN every byte is NAKed, so take them one by one */
+            if (!(s->regs[R_CONTROL] & CONTROL_ACKEN)) {
+                n = 1;
+            }
+            if (i2c_recv_buf(s->bus, buf, n) < 0) {
+                memset(buf, 0xff, n);
+            }
+            DB_PRINT("received %u bytes from I2C bus\n", n);
+            fifo_push_all(&s->fifo, buf, n);
             s->regs[R_STATUS] |= STATUS_RXDV;
             if (s->fifo.num >= FIFO_WIDTH - 2) {
                 s->regs[R_ISR] |= ISR_DATA;
@@ -228,7 +243,7 @@ static void cadence_i2c_do_txrx(void *opaque)
             if (!(s->regs[R_CONTROL] & CONTROL_ACKEN)) {
                 i2c_nack(s->bus);
             }
-            s->regs[R_TRANSFER_SIZE]--;
+            s->regs[R_TRANSFER_SIZE] -= n;
             if (!s->regs[R_TRANSFER_SIZE]) {
                 DB_PRINT("Nacking last byte of read transaction\n");
                 i2c_nack(s->bus);
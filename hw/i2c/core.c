@@ -250,6 +250,70 @@ int i2c_recv(I2CBus *bus)
     return ret < 0 ? ret : data;
 }
 
+/*
+ * Send @len bytes in one go.  Returns the number of bytes acknowledged by
+ * all the addressed slaves, the byte after them, if any, was NAKed and
+ * nothing was sent past it.
+ */
+int i2c_send_buf(I2CBus *bus, const uint8_t *buf, int len)
+{
+    I2CSlaveClass *sc;
+    I2CNode *node;
+    int acked = len;
+
+    if (QLIST_EMPTY(&bus->current_devs)) {
+        return 0;
+    }
+
+    QLIST_FOREACH(node, &bus->current_devs, next) {
+        int n = 0;
+
+        sc = I2C_SLAVE_GET_CLASS(node->elt);
+        if (sc->send_buf) {
+            n = sc->send_buf(node->elt, buf, len);
+        } else if (sc->send) {
+            while (n < len && !sc->send(node->elt, buf[n])) {
+                n++;
+            }
+        }
+        acked = MIN(acked, n);
+    }
+    return acked;
+}
+
+/*
+ * Receive @len bytes in one go.  Returns @len, or a negative value if
+ * nothing could be received.  The master may NAK the last byte with
+ * i2c_nack() afterwards.
+ */
+int i2c_recv_buf(I2CBus *bus, uint8_t *buf, int len)
+{
+    I2CSlaveClass *sc;
+    I2CSlave *slave;
+    int i, ret;
+
+    if ((QLIST_EMPTY(&bus->current_devs)) || (bus->broadcast)) {
+        return -1;
+    }
+
+    slave = QLIST_FIRST(&bus->current_devs)->elt;
+    sc = I2C_SLAVE_GET_CLASS(slave);
+    if (sc->recv_buf) {
+        return sc->recv_buf(slave, buf, len);
+    }
+    if (!sc->recv) {
+        return -1;
+    }
+    for (i = 0; i < len; i++) {
+        ret = sc->recv(slave);
+        if (ret < 0) {
+            return ret;
+        }
+        buf[i] = ret;
+    }
+    return len;
+}
+
 void i2c_nack(I2CBus *bus)
 {
     I2CSlaveClass *sc;
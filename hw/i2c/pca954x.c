@@ -115,6 +115,64 @@ static int pca954x_send(I2CSlave *i2c, uint8_t data)
     return ret;
 }
 
+/* Forward whole data phases, so that sensors behind the switch see them
+ * at once too.
+ */
+static int pca954x_send_buf(I2CSlave *i2c, const uint8_t *buf, int len)
+{
+    PCA954XState *s = PCA954X(i2c);
+    int i;
+    int acked = 0;
+
+    if (s->control_decoded) {
+        if (len) {
+            DB_PRINT("setting control register: %x\n", buf[len - 1]);
+            s->control_reg = buf[len - 1];
+            pca954x_decode_lane(s);
+        }
+        return len;
+    }
+
+    for (i = 0; i < s->lanes; ++i) {
+        if (s->active_lanes & (1 << i)) {
+            DB_PRINT("sending %d bytes to active bus %d\n", len, i);
+            acked = MAX(acked, i2c_send_buf(s->busses[i], buf, len));
+        }
+    }
+    return acked;
+}
+
+static int pca954x_recv_buf(I2CSlave *i2c, uint8_t *buf, int len)
+{
+    PCA954XState *s = PCA954X(i2c);
+    uint8_t lane_buf[32];
+    int i, j, done, n;
+
+    if (s->control_decoded) {
+        DB_PRINT("returning control register: %x\n", s->control_reg);
+        memset(buf, s->control_reg, len);
+        return len;
+    }
+
+    memset(buf, 0, len);
+    for (i = 0; i < s->lanes; ++i) {
+        if (!(s->active_lanes & (1 << i))) {
+            continue;
+        }
+        DB_PRINT("receiving %d bytes from active bus %d\n", len, i);
+        for (done = 0; done < len; done += n) {
+            n = MIN(len - done, sizeof(lane_buf));
+            if (i2c_recv_buf(s->busses[i], lane_buf, n) < 0) {
+                memset(lane_buf, 0xff, n);
+            }
+            for (j = 0; j < n; j++) {
+                buf[done + j] |= lane_buf[j];
+            }
+        }
+    }
+    return len;
+}
+
 static int pca954x_event(I2CSlave *i2c, enum i2c_event event)
 {
     PCA954XState *s = PCA954X(i2c);
@@ -241,6 +299,8 @@ static void pca954x_class_init(ObjectClass *klass, void *data)
     k->event = pca954x_event;
     k->recv = pca954x_recv;
     k->send = pca954x_send;
+    k->send_buf = pca954x_send_buf;
+    k->recv_buf = pca954x_recv_buf;
     k->decode_address = pca954x_decode_address;
 
     dc->realize = pca954x_realize;
@@ -255,6 +255,16 @@ void gic_update(GICState *s)
     int cpu;
     int cm;
 
+    /* Forget the interrupts that were disabled or taken since.  */
+    for (irq = find_first_bit(s->irq_maybe_pending, s->num_irq);
+         irq < s->num_irq;
+         irq = find_next_bit(s->irq_maybe_pending, s->num_irq, irq + 1)) {
+        if (!GIC_TEST_ENABLED(irq, ALL_CPU_MASK) ||
+            !gic_test_pending(s, irq, ALL_CPU_MASK)) {
+            clear_bit(irq, s->irq_maybe_pending);
+        }
+    }
+
     for (cpu = 0; cpu < NUM_CPU(s); cpu++) {
         bool cpu_irq = false;
         bool cpu_fiq = false;
@@ -264,7 +274,9 @@ void gic_update(GICState *s)
         s->current_pending[cpu] = 1023;
         best_prio = 0x100;
         best_irq = 1023;
-        for (irq = 0; irq < s->num_irq; irq++) {
+        for (irq = find_first_bit(s->irq_maybe_pending, s->num_irq);
+             irq < s->num_irq;
+             irq = find_next_bit(s->irq_maybe_pending, s->num_irq, irq + 1)) {
             if (GIC_TEST_ENABLED(irq, cm) && gic_test_pending(s, irq, cm) &&
                 (irq < GIC_INTERNAL || GIC_TARGET(irq) & cm)) {
                 if (GIC_GET_PRIORITY(irq, cpu) < best_prio &&
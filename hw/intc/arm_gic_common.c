@@ -43,6 +43,7 @@ static int gic_post_load(void *opaque, int version_id)
     GICState *s = (GICState *)opaque;
     ARMGICCommonClass *c = ARM_GIC_COMMON_GET_CLASS(s);
 
+    bitmap_fill(s->irq_maybe_pending, GIC_MAXIRQ);
     if (c->post_load) {
         c->post_load(s);
     }
@@ -194,6 +195,7 @@ static void arm_gic_common_reset(DeviceState *dev)
     }
 
     memset(s->irq_state, 0, GIC_MAXIRQ * sizeof(gic_irq_state));
+    bitmap_zero(s->irq_maybe_pending, GIC_MAXIRQ);
     for (i = 0 ; i < GIC_NCPU; i++) {
         if (s->revision == REV_11MPCORE) {
             s->priority_mask[i] = 0xf0;
@@ -16,6 +16,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitops.h"
 #include "qapi/error.h"
 #include "hw/sysbus.h"
 #include "hw/intc/arm_gicv3.h"
@@ -150,17 +151,14 @@ static void gicv3_redist_update_noirqset(GICv3CPUState *cs)
      */
     pend = gicr_int_pending(cs);
 
-    if (pend) {
-        for (i = 0; i < GIC_INTERNAL; i++) {
-            if (!(pend & (1 << i))) {
-                continue;
-            }
-            prio = cs->gicr_ipriorityr[i];
-            if (irqbetter(cs, i, prio)) {
-                cs->hppi.irq = i;
-                cs->hppi.prio = prio;
-                seenbetter = true;
-            }
+    while (pend) {
+        i = ctz32(pend);
+        pend &= pend - 1;
+        prio = cs->gicr_ipriorityr[i];
+        if (irqbetter(cs, i, prio)) {
+            cs->hppi.irq = i;
+            cs->hppi.prio = prio;
+            seenbetter = true;
         }
     }
 
@@ -200,9 +198,9 @@ void gicv3_redist_update(GICv3CPUState *cs)
  */
 static void gicv3_update_noirqset(GICv3State *s, int start, int len)
 {
-    int i;
+    int i, base;
     uint8_t prio;
-    uint32_t pend = 0;
+    uint32_t pend;
 
     assert(start >= GIC_INTERNAL);
     assert(len > 0);
@@ -211,30 +209,36 @@ static void gicv3_update_noirqset(GICv3State *s, int start, int len)
         s->cpu[i].seenbetter = false;
     }
 
-    /* Find the highest priority pending interrupt in this range. */
-    for (i = start; i < start + len; i++) {
-        GICv3CPUState *cs;
-
-        if (i == start || (i & 0x1f) == 0) {
-            /* Calculate the next 32 bits worth of pending status */
-            pend = gicd_int_pending(s, i & ~0x1f);
-        }
-
-        if (!(pend & (1 << (i & 0x1f)))) {
-            continue;
+    /* Find the highest priority pending interrupt in this range,
+     * 32 at a time, only looking at the ones actually pending.
+     */
+    for (base = start & ~0x1f; base < start + len; base += 32) {
+        pend = gicd_int_pending(s, base);
+        if (base < start) {
+            pend &= ~0U << (start - base);
         }
-        cs = s->gicd_irouter_target[i];
-        if (!cs) {
-            /* Interrupts targeting no implemented CPU should remain pending
-             * and not be forwarded to any CPU.
-             */
-            continue;
+        if (start + len - base < 32) {
+            pend &= ~(~0U << (start + len - base));
         }
-        prio = s->gicd_ipriority[i];
-        if (irqbetter(cs, i, prio)) {
-            cs->hppi.irq = i;
-            cs->hppi.prio = prio;
-            cs->seenbetter = true;
+
+        while (pend) {
+            GICv3CPUState *cs;
+
+            i = base + ctz32(pend);
+            pend &= pend - 1;
+            cs = s->gicd_irouter_target[i];
+            if (!cs) {
+                /* Interrupts targeting no implemented CPU should remain
+                 * pending and not be forwarded to any CPU.
+                 */
+                continue;
+            }
+            prio = s->gicd_ipriority[i];
+            if (irqbetter(cs, i, prio)) {
+                cs->hppi.irq = i;
+                cs->hppi.prio = prio;
+                cs->seenbetter = true;
+            }
         }
     }
 
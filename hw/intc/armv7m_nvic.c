@@ -1377,6 +1377,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
         }
 
         cpu->env.pmsav7.drbar[region] = value & ~0x1f;
+        cpu->env.pmsav7.map_dirty = true;
         tlb_flush(CPU(cpu));
         break;
     }
@@ -1412,6 +1413,7 @@ static void nvic_writel(NVICState *s, uint32_t offset, uint32_t value,
 
         cpu->env.pmsav7.drsr[region] = value & 0xff3f;
         cpu->env.pmsav7.dracr[region] = (value >> 16) & 0x173f;
+        cpu->env.pmsav7.map_dirty = true;
         tlb_flush(CPU(cpu));
         break;
     }
@@ -340,6 +340,7 @@ static void gic_proxy_set_irq(void *opaque, int irq, int level)
     GICProxy *s = XILINX_GIC_PROXY(opaque);
     int group = irq / 32;
     int bit = irq % 32;
+    uint32_t status = s->regs[GICPN_STATUS_REG(group)];
 
     if (level) {
         s->pinState[group] |= 1 << bit;
@@ -347,7 +348,14 @@ static void gic_proxy_set_irq(void *opaque, int irq, int level)
         s->pinState[group] &= ~(1 << bit);
     }
     s->regs[GICPN_STATUS_REG(group)] |= s->pinState[group];
-    gicp_update(s, group);
+
+    /* The status is sticky, lines that fall or stay up change nothing
+     * for the PMU.  Don't bother it then, this sits on every device's
+     * interrupt line.
+     */
+    if (s->regs[GICPN_STATUS_REG(group)] != status) {
+        gicp_update(s, group);
+    }
 }
 
 static void gic_proxy_init(Object *obj)
@@ -56,22 +56,10 @@ typedef struct INTCRedirect {
 
 } INTCRedirect;
 
-static void intc_redirect_update_irqs(void *opaque)
+static void intc_redirect_update_pmu(INTCRedirect *s)
 {
-    INTCRedirect *s = XILINX_ZYNQMP_INTC_REDIRECT(opaque);
-    bool gic_pmu_int = 0;
-    unsigned int i;
-
     /* If CPU has set PWRDWN to 1, direct interrupts to PMU.  */
-    if (s->cpu_pwrdwn_en) {
-        gic_pmu_int = !!s->irq_in;
-    }
-    qemu_set_irq(s->pmu_out, gic_pmu_int);
-
-    /* Always propagate IRQs between GIC and APU.  */
-    for (i = 0; i < NUM_LINES_FROM_GIC; i++) {
-        qemu_set_irq(s->cpu_out[i], !!(s->irq_in & (1 << i)));
-    }
+    qemu_set_irq(s->pmu_out, s->cpu_pwrdwn_en && s->irq_in);
 }
 
 static void intc_redirect_in_from_gic(void *opaque, int irq, int level)
@@ -79,7 +67,14 @@ static void intc_redirect_in_from_gic(void *opaque, int irq, int level)
     INTCRedirect *s = XILINX_ZYNQMP_INTC_REDIRECT(opaque);
 
     s->irq_in = deposit32(s->irq_in, irq, 1, level);
-    intc_redirect_update_irqs(s);
+
+    /* Always propagate IRQs between GIC and APU.  Only the line that
+     * changed, the PMU one can only move while the CPU is powering down.
+     */
+    qemu_set_irq(s->cpu_out[irq], level);
+    if (s->cpu_pwrdwn_en) {
+        intc_redirect_update_pmu(s);
+    }
 }
 
 static void intc_redirect_pwr_cntrl_enable(void *opaque, int irq, int level)
@@ -87,7 +82,7 @@ static void intc_redirect_pwr_cntrl_enable(void *opaque, int irq, int level)
     INTCRedirect *s = XILINX_ZYNQMP_INTC_REDIRECT(opaque);
 
     s->cpu_pwrdwn_en = level;
-    intc_redirect_update_irqs(s);
+    intc_redirect_update_pmu(s);
 }
 
 static void intc_redirect_init(Object *obj)
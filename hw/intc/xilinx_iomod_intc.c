@@ -27,6 +27,7 @@
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "qemu/log.h"
+#include "qemu/host-utils.h"
 #include "hw/fdt_generic_util.h"
 
 #ifndef XILINX_IO_MODULE_INTC_ERR_DEBUG
@@ -99,6 +100,9 @@ typedef struct XilinxIntC {
 
     uint32_t irq_raw;
     uint32_t irq_mode;
+    /* IRQ_STATUS as last driven on status_out */
+    uint32_t status_out_level;
+    qemu_irq status_out[32];
     uint32_t regs[R_MAX_1];
     uint32_t vectors[R_MAX_1];
     RegisterInfo regs_info0[R_MAX_0];
@@ -124,10 +128,28 @@ static Property xlx_iom_properties[] = {
 static void iom_intc_irq_ack(RegisterInfo *reg, uint64_t val64);
 static void iom_intc_update(RegisterInfo *reg, uint64_t val64);
 
+/* Let the sources know which of their interrupts are latched, hits on
+ * those change nothing so the sources may stop generating them.
+ */
+static void xlx_iom_status_update(XilinxIntC *s)
+{
+    uint32_t changed = s->status_out_level ^ s->regs[R_IOM_IRQ_STATUS];
+
+    s->status_out_level = s->regs[R_IOM_IRQ_STATUS];
+    while (changed) {
+        unsigned int i = ctz32(changed);
+
+        qemu_set_irq(s->status_out[i], extract32(s->status_out_level, i, 1));
+        changed &= changed - 1;
+    }
+}
+
 static void xlx_iom_irq_update(XilinxIntC *s)
 {
     bool old_state = s->irq_output;
 
+    xlx_iom_status_update(s);
+
     s->regs[R_IOM_IRQ_PENDING] = s->regs[R_IOM_IRQ_STATUS];
     s->regs[R_IOM_IRQ_PENDING] &= s->regs[R_IOM_IRQ_ENABLE];
     s->irq_output = s->regs[R_IOM_IRQ_PENDING];
@@ -268,6 +290,7 @@ static void iom_intc_reset(DeviceState *dev)
             register_reset(&s->regs_infos[rmap][i]);
         }
     }
+    xlx_iom_status_update(s);
 }
 
 static void xlx_iom_realize(DeviceState *dev, Error **errp)
@@ -318,6 +341,8 @@ static void xlx_iom_init(Object *obj)
         sysbus_init_mmio(sbd, &s->iomem[i]);
     }
     qdev_init_gpio_out(DEVICE(obj), &s->parent_irq, 1);
+    qdev_init_gpio_out_named(DEVICE(obj), s->status_out, "IRQ_STATUS",
+                             ARRAY_SIZE(s->status_out));
 }
 
 static int xilinx_iom_fdt_get_irq(FDTGenericIntc *obj, qemu_irq *irqs,
@@ -339,16 +364,29 @@ static const VMStateDescription vmstate_xlx_iom = {
     }
 };
 
+static const FDTGenericGPIOSet gpio_sets[] = {
+    {
+      .names = &fdt_generic_gpio_name_set_gpio,
+      .gpios = (FDTGenericGPIOConnection[]) {
+        { .name = "IRQ_STATUS", .fdt_index = 0, .range = 32 },
+        { },
+      },
+    },
+    { },
+};
+
 static void xlx_iom_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
     FDTGenericIntcClass *fgic = FDT_GENERIC_INTC_CLASS(klass);
+    FDTGenericGPIOClass *fggc = FDT_GENERIC_GPIO_CLASS(klass);
 
     dc->reset = iom_intc_reset;
     dc->realize = xlx_iom_realize;
     dc->props = xlx_iom_properties;
     dc->vmsd = &vmstate_xlx_iom;
     fgic->get_irq = xilinx_iom_fdt_get_irq;
+    fggc->controller_gpios = gpio_sets;
 }
 
 static const TypeInfo xlx_iom_info = {
@@ -359,6 +397,7 @@ static const TypeInfo xlx_iom_info = {
     .instance_init = xlx_iom_init,
     .interfaces = (InterfaceInfo[]) {
         { TYPE_FDT_GENERIC_INTC },
+        { TYPE_FDT_GENERIC_GPIO },
         { }
     },
 };
@@ -263,6 +263,12 @@ static void ipi_handler(void *opaque, int n, int level)
     DB_PRINT("%s: %s: irq[%d]=%d\n", __func__,
              object_get_canonical_path(OBJECT(s)), n, level);
 
+    /* Triggers are pulses, the falling edge (or a retrigger of a pending
+     * IPI) leaves the sticky ISR, and so the line and observers, as is.
+     */
+    if ((s->regs[R_IPI_ISR] | val) == old_value) {
+        return;
+    }
     s->regs[R_IPI_ISR] |= val;
     ipi_update_irq(s);
     dep_register_refresh_gpios(r_isr, old_value);
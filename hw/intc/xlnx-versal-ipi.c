@@ -30,6 +30,7 @@
 #include "hw/register.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "sysemu/boot-profile.h"
 
 #ifndef XILINX_IPI_ERR_DEBUG
 #define XILINX_IPI_ERR_DEBUG 0
@@ -961,6 +962,12 @@ static const hwaddr map_agent_to_obs[] = {
     MAP_AGENT_TO_REG(IPI6, OBS),
 };
 
+/* Agent names by index, for the boot profile.  */
+static const char *const ipi_agent_names[] = {
+    "PSM", "PMC", "IPI0", "IPI1", "IPI2", "IPI3", "IPI4", "IPI5",
+    "PMC_NOBUF", "IPI6",
+};
+
 /* This maps an IPI agents base register address to agent index.  */
 static unsigned int map_base_to_agent(hwaddr addr)
 {
@@ -983,36 +990,25 @@ static unsigned int map_base_to_agent(hwaddr addr)
     return 0;
 }
 
-/* Generate all observer bits.  */
-static void ipi_update_obs(XlnxVersalIPI *s)
+/* The observer bits of the agent at @addr, i.e. which agents it has an
+ * interrupt pending for.  Only generated when read, they derive from the
+ * ISRs of the other agents.
+ */
+static uint64_t x_obs_postr(RegisterInfo *reg, uint64_t val64)
 {
-    unsigned int agent2isr[] = {
-        R_PSM_ISR,
-        R_PMC_ISR,
-        R_IPI0_ISR,
-        R_IPI1_ISR,
-        R_IPI2_ISR,
-        R_IPI3_ISR,
-        R_IPI4_ISR,
-        R_IPI5_ISR,
-        R_PMC_NOBUF_ISR,
-        R_IPI6_ISR,
-    };
+    XlnxVersalIPI *s = XILINX_IPI(reg->opaque);
+    unsigned int target = map_base_to_agent(reg->access->addr - A_PSM_OBS +
+                                            A_PSM_TRIG);
+    uint32_t obs = 0;
     int agent;
-    int i;
 
-    for (agent = 0; agent < ARRAY_SIZE(agent2isr); agent++) {
-        for (i = 0; i < ARRAY_SIZE(map_agent_to_obs); i++) {
-            hwaddr target_obs = map_agent_to_obs[i];
-            unsigned int r_isr = agent2isr[agent];
-            uint32_t isr = s->regs[r_isr];
-            bool active;
+    for (agent = 0; agent < ARRAY_SIZE(map_agent_to_isr); agent++) {
+        uint32_t isr = s->regs[map_agent_to_isr[agent]];
 
-            active = extract32(isr, i, 1);
-            s->regs[target_obs] = deposit32(s->regs[target_obs],
-                                            agent, 1, active);
-        }
+        obs = deposit32(obs, agent, 1, extract32(isr, target, 1));
     }
+    s->regs[map_agent_to_obs[target]] = obs;
+    return obs;
 }
 
 /* The IPIs connected between agents.  */
@@ -1037,9 +1033,6 @@ static void x_update_irq(XlnxVersalIPI *s)
     };
     int i;
 
-    /* Update the observer registers.  */
-    ipi_update_obs(s);
-
     for (i = 0; i < ARRAY_SIZE(irqmap); i++) {
         uint32_t isr = s->regs[irqmap[i].r_isr];
         uint32_t imr = s->regs[irqmap[i].r_imr];
@@ -1101,7 +1094,12 @@ static void x_trig_postw(RegisterInfo *reg, uint64_t val64)
         unsigned int target_bit = map_base_to_agent(reg->access->addr);
 
         if (val & (1 << i)) {
+            char name[24];
+
             s->regs[target_isr] |= 1UL << target_bit;
+            snprintf(name, sizeof(name), "%s->%s",
+                     ipi_agent_names[target_bit], ipi_agent_names[i]);
+            boot_profile_mark(BOOT_PHASE_IPI, name);
         }
     }
 
@@ -1281,23 +1279,24 @@ static const RegisterAccessInfo ipi_regs_info[] = {
     },
 
 /* Macros to generate IPI registers.  */
-#define GEN_IPI_REG(AGENT, REG, RO, W1C, PREW, POSTW) {      \
-        .name = stringify(AGENT) "_" stringify(REG),         \
-        .addr = A_ ## AGENT ## _ ## REG,                     \
-        .rsvd = 0xfffffc00,                                  \
-        .w1c = W1C,                                          \
-        .ro = RO,                                            \
-        .pre_write = PREW,                                   \
-        .post_write = POSTW,                                 \
+#define GEN_IPI_REG(AGENT, REG, RO, W1C, PREW, POSTW, POSTR) {   \
+        .name = stringify(AGENT) "_" stringify(REG),              \
+        .addr = A_ ## AGENT ## _ ## REG,                          \
+        .rsvd = 0xfffffc00,                                       \
+        .w1c = W1C,                                               \
+        .ro = RO,                                                 \
+        .pre_write = PREW,                                        \
+        .post_write = POSTW,                                      \
+        .post_read = POSTR,                                       \
     }
 
-#define GEN_IPI_REG_ACCESS_INFO(AGENT)                              \
-    GEN_IPI_REG(AGENT, TRIG, 0xfffffc00, 0, NULL, x_trig_postw),    \
-    GEN_IPI_REG(AGENT, OBS, 0xffffffff, 0, NULL, NULL),             \
-    GEN_IPI_REG(AGENT, ISR, 0, 0xffffffff, NULL, x_isr_postw),      \
-    GEN_IPI_REG(AGENT, IMR, 0xffffffff, 0, NULL, NULL),             \
-    GEN_IPI_REG(AGENT, IER, 0xfffffc00, 0, x_ier_prew, NULL),       \
-    GEN_IPI_REG(AGENT, IDR, 0xfffffc00, 0, x_idr_prew, NULL)
+#define GEN_IPI_REG_ACCESS_INFO(AGENT)                                    \
+    GEN_IPI_REG(AGENT, TRIG, 0xfffffc00, 0, NULL, x_trig_postw, NULL),    \
+    GEN_IPI_REG(AGENT, OBS, 0xffffffff, 0, NULL, NULL, x_obs_postr),      \
+    GEN_IPI_REG(AGENT, ISR, 0, 0xffffffff, NULL, x_isr_postw, NULL),      \
+    GEN_IPI_REG(AGENT, IMR, 0xffffffff, 0, NULL, NULL, NULL),             \
+    GEN_IPI_REG(AGENT, IER, 0xfffffc00, 0, x_ier_prew, NULL, NULL),       \
+    GEN_IPI_REG(AGENT, IDR, 0xfffffc00, 0, x_idr_prew, NULL, NULL)
 
     GEN_IPI_REG_ACCESS_INFO(PSM),
     GEN_IPI_REG_ACCESS_INFO(PMC),
@@ -321,6 +321,7 @@ static size_t xlx_aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
 {
     ZynqMPCSUAES *s = ZYNQMP_CSU_AES(obj);
     unsigned char outbuf[8 * 1024 + 16];
+    uint8_t *copy = NULL;
     int outlen = 0;
     bool feedback;
     size_t ret;
@@ -331,6 +332,12 @@ static size_t xlx_aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
         attr &= ~STREAM_ATTR_EOP;
     }
 
+    /* We byteswap in place.  */
+    if (attr & STREAM_ATTR_READONLY) {
+        buf = copy = g_memdup(buf, len);
+        attr &= ~STREAM_ATTR_READONLY;
+    }
+
     /* TODO: Add explicit eop to the stream interface.  */
     bswap32_buf8(buf, len);
     ret = xlx_aes_push_data(s, buf, len, stream_attr_has_eop(attr), 4,
@@ -347,6 +354,7 @@ static size_t xlx_aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
         memset(outbuf, 0, outlen);
     }
     stream_push(s->tx_dev, outbuf, outlen, attr);
+    g_free(copy);
 /*
       printf("%s len=%zd ret=%zd outlen=%d eop=%d\n",
              __func__, len, ret, outlen, attr);
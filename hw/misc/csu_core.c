@@ -364,6 +364,7 @@ DEP_REG32(CSU_TAMPER_12, 0x5034)
 typedef struct CSU {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     struct {
         uint32_t idcode;
@@ -523,8 +524,8 @@ static const DepRegisterAccessInfo csu_core_regs_info[] = {
 };
 
 static const MemoryRegionOps csu_core_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -555,6 +556,8 @@ static void csu_core_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &csu_core_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(csu_core_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -567,9 +570,7 @@ static void csu_core_realize(DeviceState *dev, Error **errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &csu_core_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
     return;
 }
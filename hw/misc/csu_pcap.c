@@ -35,6 +35,9 @@
 
 #include "hw/stream.h"
 #include "qemu/bitops.h"
+#include "qapi/error.h"
+
+#include <zlib.h> /* For crc32 */
 
 #ifndef ZYNQMP_CSU_PCAP_ERR_DEBUG
 #define ZYNQMP_CSU_PCAP_ERR_DEBUG 0
@@ -50,6 +53,15 @@
  */
 #define CHUNK_SIZE (8 << 10)
 
+/* Bitstream data forwarded to the PL is pushed on in chunks of this.  */
+#define PCAP_FWD_SIZE (64 << 10)
+
+typedef enum {
+    PCAP_SINK_DISCARD,
+    PCAP_SINK_CHECKSUM,
+    PCAP_SINK_FORWARD,
+} PCAPSinkMode;
+
 REG32(PCAP_PROG, 0x0)
     FIELD(PCAP_PROG, PCFG_PROG_B, 0, 1)
 REG32(PCAP_RDWR, 0x4)
@@ -87,6 +99,14 @@ typedef struct ZynqMPCSUPCAP {
     StreamSlave *tx_dev;
     MemoryRegion iomem;
 
+    /* What happens to the bitstream, see the sink-mode property.  */
+    char *sink_mode;
+    PCAPSinkMode mode;
+    StreamSlave *pl_dev;
+    StreamCoalescer fwd;
+    /* CRC32 of everything since reset, for sink-mode=checksum.  */
+    uint32_t checksum;
+
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
 } ZynqMPCSUPCAP;
@@ -161,6 +181,10 @@ static void zynqmp_csu_pcap_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
 
+    s->checksum = 0;
+    if (s->mode == PCAP_SINK_FORWARD) {
+        stream_coalescer_reset(&s->fwd);
+    }
     zynqmp_csu_pcap_notify(s);
 }
 
@@ -171,10 +195,31 @@ static size_t zynqmp_csu_pcap_stream_push(StreamSlave *obj, uint8_t *buf,
     assert(!(len % 4));
 
     ARRAY_FIELD_DP32(s->regs, PCAP_STATUS, PL_DONE, 1);
+    switch (s->mode) {
+    case PCAP_SINK_CHECKSUM:
+        s->checksum = crc32(s->checksum, buf, len);
+        break;
+    case PCAP_SINK_FORWARD:
+        return stream_coalescer_push(&s->fwd, buf, len, attr);
+    default:
+        break;
+    }
     /* consume all the data with no action */
     return len;
 }
 
+static bool zynqmp_csu_pcap_stream_can_push(StreamSlave *obj,
+                                            StreamCanPushNotifyFn notify,
+                                            void *notify_opaque)
+{
+    ZynqMPCSUPCAP *s = ZYNQMP_CSU_PCAP(obj);
+
+    if (s->mode != PCAP_SINK_FORWARD) {
+        return true;
+    }
+    return stream_coalescer_can_push(&s->fwd, notify, notify_opaque);
+}
+
 static const MemoryRegionOps pcap_ops = {
     .read = register_read_memory,
     .write = register_write_memory,
@@ -185,6 +230,28 @@ static const MemoryRegionOps pcap_ops = {
     },
 };
 
+static void zynqmp_csu_pcap_realize(DeviceState *dev, Error **errp)
+{
+    ZynqMPCSUPCAP *s = ZYNQMP_CSU_PCAP(dev);
+
+    if (!s->sink_mode || !strcmp(s->sink_mode, "discard")) {
+        s->mode = PCAP_SINK_DISCARD;
+    } else if (!strcmp(s->sink_mode, "checksum")) {
+        s->mode = PCAP_SINK_CHECKSUM;
+    } else if (!strcmp(s->sink_mode, "forward")) {
+        if (!s->pl_dev) {
+            error_setg(errp, "csu-pcap: sink-mode=forward needs "
+                       "stream-connected-pl");
+            return;
+        }
+        s->mode = PCAP_SINK_FORWARD;
+        stream_coalescer_init(&s->fwd, s->pl_dev, PCAP_FWD_SIZE);
+    } else {
+        error_setg(errp, "csu-pcap: sink-mode must be discard, checksum "
+                   "or forward");
+    }
+}
+
 static void zynqmp_csu_pcap_init(Object *obj)
 {
     ZynqMPCSUPCAP *s = ZYNQMP_CSU_PCAP(obj);
@@ -197,6 +264,13 @@ static void zynqmp_csu_pcap_init(Object *obj)
                              qdev_prop_allow_set_link_before_realize,
                              OBJ_PROP_LINK_UNREF_ON_RELEASE,
                              NULL);
+    /* Where the bitstream goes with sink-mode=forward, e.g remote-port.  */
+    object_property_add_link(obj, "stream-connected-pl", TYPE_STREAM_SLAVE,
+                             (Object **) &s->pl_dev,
+                             qdev_prop_allow_set_link_before_realize,
+                             OBJ_PROP_LINK_UNREF_ON_RELEASE,
+                             NULL);
+    object_property_add_uint32_ptr(obj, "checksum", &s->checksum, NULL);
 
     memory_region_init(&s->iomem, obj, TYPE_ZYNQMP_CSU_PCAP, R_MAX * 4);
     reg_array =
@@ -221,15 +295,24 @@ static const VMStateDescription vmstate_zynqmp_csu_pcap = {
     }
 };
 
+static Property zynqmp_csu_pcap_props[] = {
+    /* discard, checksum or forward.  */
+    DEFINE_PROP_STRING("sink-mode", ZynqMPCSUPCAP, sink_mode),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void zynqmp_csu_pcap_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
     StreamSlaveClass *ssc = STREAM_SLAVE_CLASS(klass);
 
     dc->reset = zynqmp_csu_pcap_reset;
+    dc->realize = zynqmp_csu_pcap_realize;
     dc->vmsd = &vmstate_zynqmp_csu_pcap;
+    dc->props = zynqmp_csu_pcap_props;
 
     ssc->push = zynqmp_csu_pcap_stream_push;
+    ssc->can_push = zynqmp_csu_pcap_stream_can_push;
 }
 
 static const TypeInfo zynqmp_csu_pcap_info = {
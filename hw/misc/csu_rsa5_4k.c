@@ -104,6 +104,7 @@ static const struct {
 typedef struct XilinxRSA {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
     qemu_irq parent_irq;
 
     IPCoresRSA rsa;
@@ -116,8 +117,8 @@ typedef struct XilinxRSA {
 } XilinxRSA;
 
 static const MemoryRegionOps csu_rsa_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 1,
@@ -333,6 +334,8 @@ static void xlx_rsa_realize(DeviceState *dev, Error **errp)
     unsigned int i;
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &csu_rsa_ops,
+                            &s->iomem, s->prefix);
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -344,9 +347,7 @@ static void xlx_rsa_realize(DeviceState *dev, Error **errp)
             .prefix = s->prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &csu_rsa_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, i * 4, &r->mem);
+        dep_register_block_add(&s->regs_block, r, i * 4);
     }
 }
 
@@ -355,9 +356,8 @@ static void xlx_rsa_init(Object *obj)
     XilinxRSA *s = XILINX_CSU_RSA(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
-    memory_region_init_io(&s->iomem, obj, &csu_rsa_ops, s,
-                          TYPE_XILINX_CSU_RSA,
-                          R_MAX * 4);
+    memory_region_init(&s->iomem, obj, TYPE_XILINX_CSU_RSA,
+                       R_MAX * 4);
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->parent_irq);
 }
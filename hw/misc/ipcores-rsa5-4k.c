@@ -115,29 +115,46 @@ static bool rsa_verify_minv(IPCoresRSA *s)
 /* Load from reg into MPI.  */
 static void load_mpi(gcry_mpi_t d, struct reg *s, unsigned int len)
 {
-    int i;
+    uint8_t buf[MAX_LEN / 8];
+    gcry_mpi_t t;
+    int i, words;
 
     /* We assume lengths are 32bit aligned.  */
     assert((len & 3) == 0);
-    len /= 4;
+    assert(len <= sizeof buf);
+    words = len / 4;
+
+    /* Scanning a big endian image is linear, unlike shifting in words.  */
+    for (i = 0; i < words; i++) {
+        uint32_t v = s->u32[words - 1 - i];
 
-    gcry_mpi_set_ui(d, 0);
-    for (i = len - 1; i >= 0; i--) {
-        gcry_mpi_mul_2exp(d, d, 32);
-        gcry_mpi_add_ui(d, d, s->u32[i]);
+        buf[i * 4] = v >> 24;
+        buf[i * 4 + 1] = v >> 16;
+        buf[i * 4 + 2] = v >> 8;
+        buf[i * 4 + 3] = v;
     }
+    gcry_mpi_scan(&t, GCRYMPI_FMT_USG, buf, len, NULL);
+    gcry_mpi_set(d, t);
+    gcry_mpi_release(t);
 }
 
 /* Store from MPI into reg.  */
 static void store_mpi(struct reg *d, gcry_mpi_t s, unsigned int len)
 {
+    unsigned char sbuf[MAX_LEN / 8 + 1];
     unsigned char *buf, *cbuf;
     size_t writelen;
     size_t buflen = 0;
     int i;
     int pos;
 
-    gcry_mpi_aprint(GCRYMPI_FMT_STD, &buf, &buflen, s);
+    /* Most values fit on the stack, one sign byte on top of the bits.  */
+    if (gcry_mpi_get_nbits(s) / 8 + 2 <= sizeof sbuf) {
+        buf = sbuf;
+        gcry_mpi_print(GCRYMPI_FMT_STD, buf, sizeof sbuf, &buflen, s);
+    } else {
+        gcry_mpi_aprint(GCRYMPI_FMT_STD, &buf, &buflen, s);
+    }
     cbuf = buf;
 
     /* Remove insignificant top zero bytes.  */
@@ -172,7 +189,9 @@ static void store_mpi(struct reg *d, gcry_mpi_t s, unsigned int len)
         }
     }
 
-    free(buf);
+    if (buf != sbuf) {
+        free(buf);
+    }
 }
 
 int rsa_do_nop(IPCoresRSA *s, unsigned int bitlen, unsigned int digits)
@@ -572,7 +591,7 @@ int rsa_do_montmul(IPCoresRSA *s,
                    unsigned int r_addr, unsigned int m2_addr,
                    unsigned int digits)
 {
-    gcry_mpi_t a, b, m2, q, c, r;
+    gcry_mpi_t a, b, m2, q, c, r, b32;
     unsigned int bytelen;
     int ret = RSA_NO_ERROR;
     int i;
@@ -585,6 +604,7 @@ int rsa_do_montmul(IPCoresRSA *s,
     q = gcry_mpi_new(bytelen * 8);
     c = gcry_mpi_new(bytelen * 8);
     r = gcry_mpi_new(bytelen * 8);
+    b32 = gcry_mpi_new(33);
 
     load_mpi(a, (struct reg *) &s->mem.words[a_addr], bytelen);
     load_mpi(b, (struct reg *) &s->mem.words[b_addr], bytelen);
@@ -599,15 +619,15 @@ int rsa_do_montmul(IPCoresRSA *s,
 
     gcry_mpi_mul(c, a, b);
     gcry_mpi_lshift(c, c, 32);
+    gcry_mpi_set_ui(b32, 1);
+    gcry_mpi_lshift(b32, b32, 32);
     for (i = 0; i < digits + 2; i++) {
-        gcry_mpi_set_ui(r, 1);
-        gcry_mpi_lshift(r, r, 32);
-
         gcry_mpi_rshift(q, c, i * 32);
-        gcry_mpi_mod(q, q, r);
+        gcry_mpi_mod(q, q, b32);
 
-        gcry_mpi_lshift(r, m2, i * 32);
-        gcry_mpi_mul(r, q, r);
+        /* Multiply before shifting, q * m2 is short.  */
+        gcry_mpi_mul(r, m2, q);
+        gcry_mpi_lshift(r, r, i * 32);
         gcry_mpi_add(c, c, r);
     }
 
@@ -622,6 +642,7 @@ int rsa_do_montmul(IPCoresRSA *s,
     gcry_mpi_release(q);
     gcry_mpi_release(c);
     gcry_mpi_release(r);
+    gcry_mpi_release(b32);
     return ret;
 }
 
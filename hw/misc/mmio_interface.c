@@ -54,6 +54,43 @@ static void mmio_interface_init(Object *obj)
     s->subregion = 0;
 }
 
+/* Read-only mappings are ROM devices, writes still reach the device that
+ * handed out the pointer.
+ */
+static MemTxResult mmio_interface_read(void *opaque, hwaddr addr,
+                                       uint64_t *data, unsigned size,
+                                       MemTxAttrs attrs)
+{
+    MMIOInterface *s = MMIO_INTERFACE(opaque);
+
+    return memory_region_dispatch_read(s->subregion, s->start + addr, data,
+                                       size, attrs);
+}
+
+static MemTxResult mmio_interface_write(void *opaque, hwaddr addr,
+                                        uint64_t data, unsigned size,
+                                        MemTxAttrs attrs)
+{
+    MMIOInterface *s = MMIO_INTERFACE(opaque);
+    const MemoryRegionOps *ops = s->subregion->ops;
+
+    if (!ops->write && !ops->write_with_attrs) {
+        return MEMTX_DECODE_ERROR;
+    }
+    return memory_region_dispatch_write(s->subregion, s->start + addr, data,
+                                        size, attrs);
+}
+
+static const MemoryRegionOps mmio_interface_ops = {
+    .read_with_attrs = mmio_interface_read,
+    .write_with_attrs = mmio_interface_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 8,
+    },
+};
+
 static void mmio_interface_realize(DeviceState *dev, Error **errp)
 {
     MMIOInterface *s = MMIO_INTERFACE(dev);
@@ -71,9 +108,14 @@ static void mmio_interface_realize(DeviceState *dev, Error **errp)
         return;
     }
 
-    memory_region_init_ram_ptr(&s->ram_mem, OBJECT(s), "ram",
-                               s->end - s->start + 1, s->host_ptr);
-    memory_region_set_readonly(&s->ram_mem, s->ro);
+    if (s->ro) {
+        memory_region_init_rom_device_ptr(&s->ram_mem, OBJECT(s),
+                                          &mmio_interface_ops, s, "ram",
+                                          s->end - s->start + 1, s->host_ptr);
+    } else {
+        memory_region_init_ram_ptr(&s->ram_mem, OBJECT(s), "ram",
+                                   s->end - s->start + 1, s->host_ptr);
+    }
     memory_region_add_subregion(s->subregion, s->start, &s->ram_mem);
 }
 
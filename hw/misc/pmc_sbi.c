@@ -90,6 +90,9 @@ DEP_REG32(SBI_ECO, 0x1000)
 #define SMAP_BURST_SIZE(s) \
         ((1 << DEP_AF_EX32(s->regs, SMAP_CTRL, BURST_SIZE)) * 1024)
 
+#define SBI_FIFO_SIZE      (4 * 1024)
+#define SBI_BULK_FIFO_SIZE (64 * 1024)
+
 typedef struct SlaveBootInt {
     SysBusDevice parent_obj;
 
@@ -110,6 +113,11 @@ typedef struct SlaveBootInt {
                            * 1: read-back */
     CharBackend chr; /* Data bus */
     qemu_irq smap_busy;
+
+    /* Move all buffered data at once instead of a word or burst at a
+     * time, for hosts pumping whole images through the chardev.
+     */
+    bool bulk;
 } SlaveBootInt;
 
 static int sbi_can_receive_from_dma(SlaveBootInt *s)
@@ -258,6 +266,34 @@ static uint64_t sbi_irq_trigger_prew(DepRegisterInfo *reg, uint64_t val64)
     return 0;
 }
 
+/* Push every whole word in the fifo, wrapped or not, in one go and only
+ * consume what the sink accepted.
+ */
+static bool ss_stream_push_bulk(SlaveBootInt *s)
+{
+    uint32_t len = s->fifo.num & ~3;
+    struct iovec iov[2];
+    uint32_t num;
+    size_t ret;
+
+    if (!len) {
+        return false;
+    }
+
+    iov[0].iov_base = (void *) fifo_peek_buf(&s->fifo, len, &num);
+    iov[0].iov_len = num;
+    iov[1].iov_base = s->fifo.data;
+    iov[1].iov_len = len - num;
+
+    ret = stream_pushv(s->tx_dev, iov, iov[1].iov_len ? 2 : 1, 0);
+    len = ret;
+    while (len) {
+        fifo_pop_buf(&s->fifo, len, &num);
+        len -= num;
+    }
+    return ret != 0;
+}
+
 static void ss_stream_notify(void *opaque)
 {
     SlaveBootInt *s = SBI(opaque);
@@ -268,6 +304,12 @@ static void ss_stream_notify(void *opaque)
         if (fifo_is_empty(&s->fifo)) {
             break;
         }
+        if (s->bulk) {
+            if (!ss_stream_push_bulk(s)) {
+                break;
+            }
+            continue;
+        }
         /* num is equal to number of bytes read as its a fifo of width 1byte.
          * the same dosent holds good if width is grater than 1 byte
          */
@@ -278,17 +320,35 @@ static void ss_stream_notify(void *opaque)
     }
     ss_update_busy_line(s);
     sbi_update_irq(s);
+    if (s->bulk && !s->cs && !s->rdwr) {
+        /* Space was freed, let the host send more right away.  */
+        qemu_chr_fe_accept_input(&s->chr);
+    }
 }
 
 static void ss_stream_out(SlaveBootInt *s)
 {
     uint8_t *data;
     uint32_t len;
+    int ret;
 
     if (!DEP_AF_EX32(s->regs, SBI_MODE, SELECT)) {
         return;
     }
 
+    if (s->bulk) {
+        while (!s->cs && s->rdwr && !fifo_is_empty(&s->fifo)) {
+            data = (uint8_t *) fifo_peek_buf(&s->fifo, s->fifo.num, &len);
+            ret = qemu_chr_fe_write(&s->chr, data, len);
+            if (ret <= 0) {
+                break;
+            }
+            fifo_pop_buf(&s->fifo, ret, &len);
+        }
+        ss_update_busy_line(s);
+        return;
+    }
+
     /*FIXME: Impement JTAG, AXI interface */
     while (!s->cs && s->rdwr) {
         if (IF_BURST(s->fifo.num)) {
@@ -340,13 +400,13 @@ static size_t ss_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
                 uint32_t attr)
 {
     SlaveBootInt *s = SBI(obj);
-    uint32_t free = fifo_num_free(&s->fifo);
+    uint32_t free = MIN(fifo_num_free(&s->fifo), len);
 
     /* FIXME: Implement Other Interfaces mentioned above */
     fifo_push_all(&s->fifo, buf, free);
     ss_update_busy_line(s);
     sbi_update_irq(s);
-    return free > len ? len : free;
+    return free;
 }
 
 /*** Chardev Stream handlers */
@@ -368,7 +428,9 @@ static int ss_sbi_can_receive(void *opaque)
      */
     if (DEP_AF_EX32(s->regs, SBI_CTRL, ENABLE) &&
         !DEP_AF_EX32(s->regs, SBI_MODE, SELECT)) {
-        if (IF_BURST(num)) {
+        if (s->bulk) {
+            recvb = num & ~3;
+        } else if (IF_BURST(num)) {
             recvb = (1 << DEP_AF_EX32(s->regs, SMAP_CTRL, BURST_SIZE)) *
                      1024;
         } else if (num >= 4) {
@@ -403,12 +465,13 @@ static void ss_sbi_receive(void *opaque, const uint8_t *buf, int size)
     DPRINT("%s: Payload of size: %d recv\n", __func__, size);
     if (size <= free) {
         fifo_push_all(&s->fifo, buf, size);
-        if (IF_BURST(free)) {
+        if (s->bulk) {
             ss_stream_notify(s);
             DEP_AF_DP32(s->regs, SBI_IRQ_STATUS, DATA_RDY, 1);
-        }
-
-        if (IF_NON_BURST(free)) {
+        } else if (IF_BURST(free)) {
+            ss_stream_notify(s);
+            DEP_AF_DP32(s->regs, SBI_IRQ_STATUS, DATA_RDY, 1);
+        } else if (IF_NON_BURST(free)) {
             ss_stream_notify(s);
             DEP_AF_DP32(s->regs, SBI_IRQ_STATUS, DATA_RDY, 1);
         }
@@ -550,7 +613,7 @@ static void ss_realize(DeviceState *dev, Error **errp)
                                  NULL, NULL, s, NULL, true);
     }
 
-    fifo_create8(&s->fifo, 1024 * 4);
+    fifo_create8(&s->fifo, s->bulk ? SBI_BULK_FIFO_SIZE : SBI_FIFO_SIZE);
 }
 
 static void ss_reset(DeviceState *dev)
@@ -620,6 +683,7 @@ static const FDTGenericGPIOSet sbi_client_gpios[] = {
 
 static Property sbi_props[] = {
         DEFINE_PROP_CHR("chardev", SlaveBootInt, chr),
+        DEFINE_PROP_BOOL("bulk", SlaveBootInt, bulk, false),
         DEFINE_PROP_END_OF_LIST(),
 };
 
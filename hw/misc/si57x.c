@@ -252,6 +252,14 @@ static int si57x_rx(I2CSlave *s)
     return slave->regs[slave->ptr];
 }
 
+static int si57x_rx_buf(I2CSlave *s, uint8_t *buf, int len)
+{
+    Si57xState *slave = SI57X(s);
+
+    memset(buf, slave->regs[slave->ptr], len);
+    return len;
+}
+
 static int si57x_event(I2CSlave *i2c, enum i2c_event event)
 {
     Si57xState *s = SI57X(i2c);
@@ -292,6 +300,7 @@ static void si57x_class_init(ObjectClass *klass, void *data)
     k->init = si57x_init;
     k->event = si57x_event;
     k->recv = si57x_rx;
+    k->recv_buf = si57x_rx_buf;
     k->send = si57x_tx;
     dc->props = si57x_properties;
     dc->reset = si57x_reset;
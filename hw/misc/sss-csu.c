@@ -101,6 +101,7 @@ typedef struct ZynqMPCSUSSS ZynqMPCSUSSS;
 struct ZynqMPCSUSSS {
     SSSBase parent;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
@@ -127,8 +128,8 @@ static const DepRegisterAccessInfo zynqmp_csu_sss_regs_info[] = {
 };
 
 static const MemoryRegionOps sss_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -143,6 +144,8 @@ static void zynqmp_csu_sss_realize(DeviceState *dev, Error **errp)
     Error *local_errp = NULL;
     int r, i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &sss_ops, &s->iomem,
+                            object_get_canonical_path(OBJECT(dev)));
     for (i = 0; i < R_MAX; ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -154,9 +157,7 @@ static void zynqmp_csu_sss_realize(DeviceState *dev, Error **errp)
             .prefix = object_get_canonical_path(OBJECT(dev)),
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &sss_ops, r,
-                              "sss-regs", 4);
-        memory_region_add_subregion(&s->iomem, i * 4, &r->mem);
+        dep_register_block_add(&s->regs_block, r, i * 4);
     }
 
     for (r = 0; r < NO_REMOTE; ++r) {
@@ -194,6 +195,7 @@ static void sss_reset(DeviceState *dev)
     for (i = 0; i < R_MAX; ++i) {
         dep_register_reset(&s->regs_info[i]);
     }
+    sss_drop_backlog(p);
     sss_notify_all(p);
 }
 
@@ -211,6 +213,7 @@ static void zynqmp_csu_sss_init(Object *obj)
     p->num_remotes = CSU_NUM_REMOTES;
     p->notifys = g_new0(StreamCanPushNotifyFn, CSU_NUM_REMOTES);
     p->notify_opaques = g_new0(void *, CSU_NUM_REMOTES);
+    p->backlog = g_new0(SSSBacklog, CSU_NUM_REMOTES);
     p->get_sss_regfield = zynqmp_csu_get_sss_regfield;
 
     p->rx_devs = (SSSStream *) g_new(SSSStream, CSU_NUM_REMOTES);
@@ -234,8 +237,8 @@ static void zynqmp_csu_sss_init(Object *obj)
         g_free(name);
     }
 
-    memory_region_init_io(&s->iomem, obj, &sss_ops, s,
-                          "zynqmp.csu-stream-switch", R_MAX * 4);
+    memory_region_init(&s->iomem, obj,
+                       "zynqmp.csu-stream-switch", R_MAX * 4);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
@@ -94,6 +94,7 @@ typedef struct PMCSSS PMCSSS;
 struct PMCSSS {
     SSSBase parent;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
@@ -132,8 +133,8 @@ static const DepRegisterAccessInfo pmc_sss_regs_info[] = {
 };
 
 static const MemoryRegionOps sss_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -148,6 +149,8 @@ static void pmc_sss_realize(DeviceState *dev, Error **errp)
     Error *local_errp = NULL;
     int r, i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &sss_ops, &s->iomem,
+                            object_get_canonical_path(OBJECT(dev)));
     for (i = 0; i < R_MAX; ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -159,9 +162,7 @@ static void pmc_sss_realize(DeviceState *dev, Error **errp)
             .prefix = object_get_canonical_path(OBJECT(dev)),
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &sss_ops, r,
-                              "sss-regs", 4);
-        memory_region_add_subregion(&s->iomem, i * 4, &r->mem);
+        dep_register_block_add(&s->regs_block, r, i * 4);
     }
 
     for (r = 0; r < NO_REMOTE; ++r) {
@@ -198,6 +199,7 @@ static void sss_reset(DeviceState *dev)
     for (i = 0; i < R_MAX; ++i) {
         dep_register_reset(&s->regs_info[i]);
     }
+    sss_drop_backlog(p);
     sss_notify_all(p);
 }
 
@@ -215,6 +217,7 @@ static void pmc_sss_init(Object *obj)
     p->num_remotes = PMC_NUM_REMOTES;
     p->notifys = g_new0(StreamCanPushNotifyFn, PMC_NUM_REMOTES);
     p->notify_opaques = g_new0(void *, PMC_NUM_REMOTES);
+    p->backlog = g_new0(SSSBacklog, PMC_NUM_REMOTES);
     p->get_sss_regfield = pmc_get_sss_regfield;
 
     p->rx_devs = (SSSStream *) g_new(SSSStream, PMC_NUM_REMOTES);
@@ -238,8 +241,8 @@ static void pmc_sss_init(Object *obj)
         g_free(name);
     }
 
-    memory_region_init_io(&s->iomem, obj, &sss_ops, s,
-                          "versal.pmc-stream-switch", R_MAX * 4);
+    memory_region_init(&s->iomem, obj,
+                       "versal.pmc-stream-switch", R_MAX * 4);
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
@@ -31,8 +31,10 @@
 #include "hw/sysbus.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
+#include "qemu/iov.h"
 
 #include "qemu/bitops.h"
+#include "qemu/host-utils.h"
 #include "qapi/qmp/qerror.h"
 #include "hw/misc/sss.h"
 
@@ -61,29 +63,103 @@ sss_lookup_rx_remote(SSSBase *s, SSSStream *ss)
     return ret;
 }
 
-static inline int
-sss_lookup_tx_remote(SSSBase *s, int rx_remote)
+/* Returns the set of units currently fed by rx_remote, as a bitmask.  */
+static uint32_t
+sss_lookup_tx_remotes(SSSBase *s, int rx_remote)
 {
-    uint32_t enc;
+    uint32_t enc, txs = 0;
+    int tx;
+
     if (rx_remote == NOT_REMOTE(s)) {
-        return NOT_REMOTE(s);
+        return 0;
     }
 
-    int ret;
-
-    for (ret = 0; ret < NOT_REMOTE(s); ++ret) {
-        if (s->r_sss_shifts[ret] == -1) {
-            /* This unit has no input. Ignore it.  */
+    for (tx = 0; tx < NOT_REMOTE(s); ++tx) {
+        if (s->r_sss_shifts[tx] == -1 || !s->tx_devs[tx]) {
+            /* This unit has no input or is not connected. Ignore it.  */
             continue;
         }
 
-        enc = s->get_sss_regfield(s, ret);
-        if (s->r_sss_encodings[rx_remote] == enc) {
-            break;
+        enc = s->get_sss_regfield(s, tx);
+        if (s->r_sss_encodings[rx_remote] == enc &&
+            (s->sss_population[tx] & (1 << rx_remote))) {
+            txs |= 1 << tx;
+        }
+    }
+    return txs;
+}
+
+static void sss_backlog_drain(void *opaque)
+{
+    SSSBacklog *bl = opaque;
+    SSSBase *s = bl->sss;
+    StreamSlave *tx_dev = s->tx_devs[bl->tx];
+    StreamCanPushNotifyFn notify;
+    size_t ret;
+
+    while (bl->pos < bl->len) {
+        if (!stream_can_push(tx_dev, sss_backlog_drain, bl)) {
+            return;
+        }
+        ret = stream_push(tx_dev, bl->buf + bl->pos, bl->len - bl->pos,
+                          bl->attr);
+        if (!ret) {
+            qemu_log_mask(LOG_GUEST_ERROR, "SSS: remote %d stalled with %zu"
+                          " bytes pending\n", bl->tx, bl->len - bl->pos);
+            return;
         }
+        bl->pos += ret;
     }
-    return (s->sss_population[ret] & (1 << rx_remote)) ?
-                    ret : NOT_REMOTE(s);
+
+    g_free(bl->buf);
+    bl->buf = NULL;
+    bl->len = bl->pos = 0;
+
+    /* The source may have been waiting for the slowest consumer.  */
+    notify = s->notifys[bl->rx];
+    if (notify) {
+        s->notifys[bl->rx] = NULL;
+        notify(s->notify_opaques[bl->rx]);
+    }
+}
+
+/* Takes a private copy of what tx did not accept and feeds it from there.  */
+static void sss_backlog_start(SSSBase *s, int rx, int tx, uint8_t *buf,
+                              size_t len, uint32_t attr)
+{
+    SSSBacklog *bl = &s->backlog[tx];
+
+    bl->sss = s;
+    bl->rx = rx;
+    bl->tx = tx;
+    bl->buf = buf;
+    bl->len = len;
+    bl->pos = 0;
+    bl->attr = attr & ~STREAM_ATTR_READONLY;
+    sss_backlog_drain(bl);
+}
+
+void sss_drop_backlog(SSSBase *s)
+{
+    int tx;
+
+    for (tx = 0; tx < s->num_remotes; ++tx) {
+        g_free(s->backlog[tx].buf);
+        s->backlog[tx].buf = NULL;
+        s->backlog[tx].len = s->backlog[tx].pos = 0;
+    }
+}
+
+static bool sss_backlogged(SSSBase *s, uint32_t txs)
+{
+    int tx;
+
+    for (tx = 0; tx < s->num_remotes; ++tx) {
+        if ((txs & (1 << tx)) && s->backlog[tx].len) {
+            return true;
+        }
+    }
+    return false;
 }
 
 static bool
@@ -93,30 +169,102 @@ sss_stream_can_push(StreamSlave *obj, StreamCanPushNotifyFn notify,
     SSSStream *ss = SSS_STREAM(obj);
     SSSBase *s = SSS_BASE(ss->sss);
     int rx = sss_lookup_rx_remote(s, ss);
-    int tx = sss_lookup_tx_remote(s, rx);
+    uint32_t txs = sss_lookup_tx_remotes(s, rx);
+    bool ready = txs;
+    int tx;
 
-    if (tx != NOT_REMOTE(s) && s->tx_devs[tx] &&
-            stream_can_push(s->tx_devs[tx], notify, notify_opaque)) {
-        return true;
+    for (tx = 0; tx < NOT_REMOTE(s); ++tx) {
+        if (!(txs & (1 << tx))) {
+            continue;
+        }
+        /* Backlogged units notify us through sss_backlog_drain.  */
+        if (s->backlog[tx].len ||
+            !stream_can_push(s->tx_devs[tx], notify, notify_opaque)) {
+            ready = false;
+        }
     }
 
-    s->notifys[rx] = notify;
-    s->notify_opaques[rx] = notify_opaque;
-    return false;
+    if (!ready) {
+        s->notifys[rx] = notify;
+        s->notify_opaques[rx] = notify_opaque;
+    }
+    return ready;
 }
 
-
-
+/*
+ * With more than one consumer, every one of them sees the same data.
+ * All but the last get it read-only, as sinks like the AES engine
+ * transform their input in place. Whatever a consumer does not take
+ * right away is buffered here, so the source always advances by the
+ * full length and nobody sees data twice. The source is held off in
+ * can_push until the slowest consumer has caught up.
+ */
 static size_t sss_stream_push(StreamSlave *obj, uint8_t *buf,
                                           size_t len, uint32_t attr)
 {
     SSSStream *ss = SSS_STREAM(obj);
     SSSBase *s = SSS_BASE(ss->sss);
     int rx = sss_lookup_rx_remote(s, ss);
-    int tx = sss_lookup_tx_remote(s, rx);
+    uint32_t txs = sss_lookup_tx_remotes(s, rx);
+    int tx, last;
+    size_t ret;
+
+    if (!txs || sss_backlogged(s, txs)) {
+        return 0;
+    }
+    last = 31 - clz32(txs);
+    if (txs == 1 << last) {
+        return stream_push(s->tx_devs[last], buf, len, attr);
+    }
 
-    return (tx != NOT_REMOTE(s)) ?
-            stream_push(s->tx_devs[tx], buf, len, attr) : 0;
+    for (tx = 0; tx <= last; ++tx) {
+        if (!(txs & (1 << tx))) {
+            continue;
+        }
+        ret = stream_push(s->tx_devs[tx], buf, len,
+                          tx == last ? attr : attr | STREAM_ATTR_READONLY);
+        if (ret < len) {
+            sss_backlog_start(s, rx, tx, g_memdup(buf + ret, len - ret),
+                              len - ret, attr);
+        }
+    }
+    return len;
+}
+
+static size_t sss_stream_pushv(StreamSlave *obj, const struct iovec *iov,
+                               int iovcnt, uint32_t attr)
+{
+    SSSStream *ss = SSS_STREAM(obj);
+    SSSBase *s = SSS_BASE(ss->sss);
+    int rx = sss_lookup_rx_remote(s, ss);
+    uint32_t txs = sss_lookup_tx_remotes(s, rx);
+    size_t len = iov_size(iov, iovcnt);
+    int tx, last;
+    size_t ret;
+
+    if (!txs || sss_backlogged(s, txs)) {
+        return 0;
+    }
+    last = 31 - clz32(txs);
+    if (txs == 1 << last) {
+        return stream_pushv(s->tx_devs[last], iov, iovcnt, attr);
+    }
+
+    for (tx = 0; tx <= last; ++tx) {
+        uint8_t *rest;
+
+        if (!(txs & (1 << tx))) {
+            continue;
+        }
+        ret = stream_pushv(s->tx_devs[tx], iov, iovcnt,
+                           tx == last ? attr : attr | STREAM_ATTR_READONLY);
+        if (ret < len) {
+            rest = g_malloc(len - ret);
+            iov_to_buf(iov, iovcnt, ret, rest, len - ret);
+            sss_backlog_start(s, rx, tx, rest, len - ret, attr);
+        }
+    }
+    return len;
 }
 
 /* FIXME: With no regs we are actually stateless. Although post load we need
@@ -128,6 +276,7 @@ static void sss_stream_class_init(ObjectClass *klass, void *data)
     StreamSlaveClass *ssc = STREAM_SLAVE_CLASS(klass);
 
     ssc->push = sss_stream_push;
+    ssc->pushv = sss_stream_pushv;
     ssc->can_push = sss_stream_can_push;
 }
 
@@ -52,6 +52,7 @@ typedef struct StreamFifo StreamFifo;
 struct StreamFifo {
     SysBusDevice busdev;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     Fifo fifo;
 
@@ -172,8 +173,8 @@ static void stream_fifo_reset(DeviceState *dev)
 }
 
 static const MemoryRegionOps stream_fifo_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -187,6 +188,8 @@ static void stream_fifo_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &stream_fifo_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(stream_fifo_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -199,9 +202,7 @@ static void stream_fifo_realize(DeviceState *dev, Error **errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &stream_fifo_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
 #define STREAM_FIFO_DEPTH 64
         fifo_create32(&s->fifo, STREAM_FIFO_DEPTH);
     }
@@ -158,6 +158,17 @@ static int tmp105_rx(I2CSlave *i2c)
     }
 }
 
+static int tmp105_rx_buf(I2CSlave *i2c, uint8_t *buf, int len)
+{
+    TMP105State *s = TMP105(i2c);
+    int n = MIN(len, MAX(2 - s->len, 0));
+
+    memcpy(buf, s->buf + s->len, n);
+    memset(buf + n, 0xff, len - n);
+    s->len += n;
+    return len;
+}
+
 static int tmp105_tx(I2CSlave *i2c, uint8_t data)
 {
     TMP105State *s = TMP105(i2c);
@@ -255,6 +266,7 @@ static void tmp105_class_init(ObjectClass *klass, void *data)
     k->init = tmp105_init;
     k->event = tmp105_event;
     k->recv = tmp105_rx;
+    k->recv_buf = tmp105_rx_buf;
     k->send = tmp105_tx;
     dc->vmsd = &vmstate_tmp105;
 }
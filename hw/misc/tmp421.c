@@ -260,6 +260,17 @@ static int tmp421_rx(I2CSlave *i2c)
     }
 }
 
+static int tmp421_rx_buf(I2CSlave *i2c, uint8_t *buf, int len)
+{
+    TMP421State *s = TMP421(i2c);
+    int n = MIN(len, MAX(2 - s->len, 0));
+
+    memcpy(buf, s->buf + s->len, n);
+    memset(buf + n, 0xff, len - n);
+    s->len += n;
+    return len;
+}
+
 static int tmp421_tx(I2CSlave *i2c, uint8_t data)
 {
     TMP421State *s = TMP421(i2c);
@@ -369,6 +380,7 @@ static void tmp421_class_init(ObjectClass *klass, void *data)
     k->init = tmp421_init;
     k->event = tmp421_event;
     k->recv = tmp421_rx;
+    k->recv_buf = tmp421_rx_buf;
     k->send = tmp421_tx;
     dc->vmsd = &vmstate_tmp421;
     sc->dev = (DeviceInfo *) data;
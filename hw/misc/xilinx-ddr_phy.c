@@ -3791,10 +3791,16 @@ REG32(DX8SLBIOCR, 0x17f0)
 
 #define DDR_PHY_R_MAX (R_DX8SLBIOCR + 1)
 
+/* PLL locked, every init and training step done and no errors */
+#define DDR_PHY_PGSR0_TRAINED (R_PGSR0_APLOCK_MASK | 0xffff)
+
 typedef struct DDR_PHY {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
 
+    /* Report the PHY as trained out of reset */
+    bool fast_init;
+
     uint32_t regs[DDR_PHY_R_MAX];
     RegisterInfo regs_info[DDR_PHY_R_MAX];
 } DDR_PHY;
@@ -3831,6 +3837,10 @@ static uint64_t ddr_phy_pgsr0_post_read(RegisterInfo *reg, uint64_t val)
 {
     DDR_PHY *s = reg->opaque;
 
+    if (s->fast_init) {
+        return val;
+    }
+
     /* Flip the bits stored in the register as some guests require the status
      * to change and we don't fully model the device.
      */
@@ -4918,6 +4928,9 @@ static void ddr_phy_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
 
+    if (s->fast_init) {
+        s->regs[R_PGSR0] = DDR_PHY_PGSR0_TRAINED;
+    }
 }
 
 static const MemoryRegionOps ddr_phy_ops = {
@@ -4966,6 +4979,11 @@ static const VMStateDescription vmstate_ddr_phy = {
     }
 };
 
+static Property ddr_phy_properties[] = {
+    DEFINE_PROP_BOOL("fast-init", DDR_PHY, fast_init, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void ddr_phy_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -4973,6 +4991,7 @@ static void ddr_phy_class_init(ObjectClass *klass, void *data)
     dc->reset = ddr_phy_reset;
     dc->realize = ddr_phy_realize;
     dc->vmsd = &vmstate_ddr_phy;
+    dc->props = ddr_phy_properties;
 }
 
 static const TypeInfo ddr_phy_info = {
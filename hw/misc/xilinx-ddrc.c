@@ -811,6 +811,9 @@ typedef struct DDRC {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
 
+    /* Report the controller as initialized out of reset */
+    bool fast_init;
+
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
 } DDRC;
@@ -1148,6 +1151,11 @@ static void ddrc_reset(DeviceState *dev)
         dep_register_reset(&s->regs_info[i]);
     }
 
+    if (s->fast_init) {
+        DEP_AF_DP32(s->regs, STAT, OPERATING_MODE,
+                    R_STAT_OPERATING_MODE_NORMAL);
+        DEP_AF_DP32(s->regs, SWSTAT, SW_DONE_ACK, 1);
+    }
 }
 
 static uint64_t ddrc_read(void *opaque, hwaddr addr, unsigned size)
@@ -1231,6 +1239,11 @@ static const VMStateDescription vmstate_ddrc = {
     }
 };
 
+static Property ddrc_properties[] = {
+    DEFINE_PROP_BOOL("fast-init", DDRC, fast_init, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void ddrc_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -1238,6 +1251,7 @@ static void ddrc_class_init(ObjectClass *klass, void *data)
     dc->reset = ddrc_reset;
     dc->realize = ddrc_realize;
     dc->vmsd = &vmstate_ddrc;
+    dc->props = ddrc_properties;
 }
 
 static const TypeInfo ddrc_info = {
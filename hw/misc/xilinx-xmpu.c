@@ -299,6 +299,26 @@ DEP_REG32(R15_CONFIG, 0x1fc)
 
 typedef struct XMPU XMPU;
 
+typedef struct XMPURegion {
+    uint64_t start;
+    uint64_t end;
+    uint64_t size;
+    union {
+        uint32_t u32;
+        struct {
+            uint16_t mask;
+            uint16_t id;
+        };
+    } master;
+    struct {
+        bool nschecktype;
+        bool regionns;
+        bool wrallowed;
+        bool rdallowed;
+        bool enable;
+    } config;
+} XMPURegion;
+
 typedef struct XMPUMaster {
     XMPU *parent;
 
@@ -348,27 +368,22 @@ struct XMPU {
     const char *prefix;
     bool enabled;
     qemu_irq enabled_signal;
-};
 
-typedef struct XMPURegion {
-    uint64_t start;
-    uint64_t end;
-    uint64_t size;
-    union {
-        uint32_t u32;
-        struct {
-            uint16_t mask;
-            uint16_t id;
-        };
-    } master;
+    /*
+     * Decoded regions, rebuilt by xmpu_update. The enabled regions split
+     * the protected space into segments [bounds[i], bounds[i + 1]), the
+     * last one running to the end of the address space. Within a segment
+     * the set of covering regions, and thereby all translations, is the
+     * same.
+     */
     struct {
-        bool nschecktype;
-        bool regionns;
-        bool wrallowed;
-        bool rdallowed;
-        bool enable;
-    } config;
-} XMPURegion;
+        XMPURegion regions[NR_XMPU_REGIONS];
+        uint64_t bounds[NR_XMPU_REGIONS * 2 + 1];
+        uint16_t cover[NR_XMPU_REGIONS * 2 + 1];
+        unsigned int nr_bounds;
+        uint32_t ctrl;
+    } dec;
+};
 
 static void xmpu_decode_region(XMPU *s, XMPURegion *xr, unsigned int region)
 {
@@ -424,6 +439,104 @@ static uint64_t ids_prew(DepRegisterInfo *reg, uint64_t val64)
     return 0;
 }
 
+static bool xmpu_region_equal(XMPURegion *a, XMPURegion *b)
+{
+    return a->start == b->start && a->end == b->end
+           && a->master.u32 == b->master.u32
+           && a->config.enable == b->config.enable
+           && a->config.rdallowed == b->config.rdallowed
+           && a->config.wrallowed == b->config.wrallowed
+           && a->config.regionns == b->config.regionns
+           && a->config.nschecktype == b->config.nschecktype;
+}
+
+static void xmpu_check_region(XMPU *s, XMPURegion *xr)
+{
+    if (xr->start & s->addr_mask) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Bad region start address %" PRIx64 "\n",
+                      s->prefix, xr->start);
+    }
+
+    if (xr->end & s->addr_mask) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Bad region end address %" PRIx64 "\n",
+                       s->prefix, xr->end);
+    }
+
+    if (xr->start < s->cfg.base) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: Too low region start address %" PRIx64 "\n",
+                       s->prefix, xr->start);
+    }
+}
+
+static int xmpu_bound_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Split the address space into segments at the enabled region edges.  */
+static void xmpu_build_segments(XMPU *s)
+{
+    uint64_t *bounds = s->dec.bounds;
+    unsigned int i, j, n = 0;
+
+    bounds[n++] = 0;
+    for (i = 0; i < NR_XMPU_REGIONS; i++) {
+        XMPURegion *xr = &s->dec.regions[i];
+        uint64_t start = xr->start & ~s->addr_mask;
+        uint64_t end = xr->end & ~s->addr_mask;
+
+        if (xr->config.enable && start < end) {
+            bounds[n++] = start;
+            bounds[n++] = end;
+        }
+    }
+
+    qsort(bounds, n, sizeof *bounds, xmpu_bound_cmp);
+    for (i = 1, j = 1; i < n; i++) {
+        if (bounds[i] != bounds[j - 1]) {
+            bounds[j++] = bounds[i];
+        }
+    }
+    s->dec.nr_bounds = j;
+
+    for (i = 0; i < s->dec.nr_bounds; i++) {
+        s->dec.cover[i] = 0;
+        for (j = 0; j < NR_XMPU_REGIONS; j++) {
+            XMPURegion *xr = &s->dec.regions[j];
+
+            if (xr->config.enable
+                && (xr->start & ~s->addr_mask) <= bounds[i]
+                && (xr->end & ~s->addr_mask) > bounds[i]) {
+                s->dec.cover[i] |= 1 << j;
+            }
+        }
+    }
+}
+
+/* Index of the segment containing the absolute address addr.  */
+static unsigned int xmpu_find_segment(XMPU *s, uint64_t addr)
+{
+    unsigned int lo = 0, hi = s->dec.nr_bounds;
+
+    /* bounds[0] is always 0, find the last bound <= addr.  */
+    while (hi - lo > 1) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (s->dec.bounds[mid] <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
 static void xmpu_update_enabled(XMPU *s)
 {
     bool regions_enabled = false;
@@ -431,15 +544,11 @@ static void xmpu_update_enabled(XMPU *s)
     bool default_rd = DEP_AF_EX32(s->regs, CTRL, DEFRDALLOWED);
     int i;
 
-    /* Lookup if this address fits a region.  */
     for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
-        XMPURegion xr;
-        xmpu_decode_region(s, &xr, i);
-        if (!xr.config.enable) {
-            continue;
+        if (s->dec.regions[i].config.enable) {
+            regions_enabled = true;
+            break;
         }
-        regions_enabled = true;
-        break;
     }
 
     s->enabled = true;
@@ -448,35 +557,126 @@ static void xmpu_update_enabled(XMPU *s)
     }
 }
 
-static void xmpu_flush(XMPU *s)
+/*
+ * Invalidate the translations for the absolute range [start, last] in
+ * all masters. IOMMU notifiers only see the range, TCG has no physical
+ * address based TLB flush so CPUs that cached translations through a
+ * master flush everything.
+ */
+static void xmpu_invalidate(XMPU *s, uint64_t start, uint64_t last)
 {
     unsigned int i;
 
+    /* Convert to offsets into the masters' IOMMU regions.  */
+    if (last < s->cfg.base) {
+        return;
+    }
+    last -= s->cfg.base;
+    start = start > s->cfg.base ? start - s->cfg.base : 0;
+
+    for (i = 0; i < s->cfg.nr_masters; i++) {
+        uint64_t addr = start;
+
+        for (;;) {
+            /* Largest naturally aligned block at addr within the range.  */
+            uint64_t mask = addr ? (addr & -addr) - 1 : UINT64_MAX;
+            IOMMUTLBEntry entry = {
+                .target_as = s->masters[i].parent_as,
+                .translated_addr = 0,
+                .perm = IOMMU_NONE,
+            };
+
+            while ((addr | mask) > last) {
+                mask >>= 1;
+            }
+            entry.iova = addr;
+            entry.addr_mask = mask;
+            memory_region_notify_iommu(&s->masters[i].iommu, entry);
+            if ((addr | mask) == last) {
+                break;
+            }
+            addr = (addr | mask) + 1;
+        }
+    }
+
+    /* Only a change of s->enabled alters the memory topology.  */
+    memory_region_transaction_begin();
+    for (i = 0; i < s->cfg.nr_masters; i++) {
+        memory_region_iommu_invalidate_cpu_tlbs(&s->masters[i].iommu);
+        memory_region_set_enabled(MEMORY_REGION(&s->masters[i].iommu),
+                                  s->enabled);
+    }
+    memory_region_transaction_commit();
+}
+
+/* Grow [start, last] to cover the addresses mapped by an enabled xr.  */
+static void xmpu_region_extend(XMPU *s, XMPURegion *xr,
+                               uint64_t *start, uint64_t *last, bool *dirty)
+{
+    uint64_t xr_start = xr->start & ~s->addr_mask;
+    uint64_t xr_end = xr->end & ~s->addr_mask;
+
+    if (!xr->config.enable || xr_start >= xr_end) {
+        return;
+    }
+    *start = MIN(*start, xr_start);
+    *last = MAX(*last, xr_end - 1);
+    *dirty = true;
+}
+
+/*
+ * Re-decode the region setup and invalidate what changed since the last
+ * call. force invalidates everything, for reset and migration.
+ */
+static void xmpu_update(XMPU *s, bool force)
+{
+    uint32_t defaults = R_CTRL_DEFWRALLOWED_MASK | R_CTRL_DEFRDALLOWED_MASK;
+    uint32_t ctrl = s->regs[R_CTRL] & defaults;
+    bool was_enabled = s->enabled;
+    uint64_t start = UINT64_MAX;
+    uint64_t last = 0;
+    bool dirty = false;
+    unsigned int i;
+
+    for (i = 0; i < NR_XMPU_REGIONS; i++) {
+        XMPURegion *cur = &s->dec.regions[i];
+        XMPURegion xr;
+
+        xmpu_decode_region(s, &xr, i);
+        if (!force && xmpu_region_equal(&xr, cur)) {
+            continue;
+        }
+
+        /* Both the old and the new mapping of the region are affected.  */
+        xmpu_region_extend(s, cur, &start, &last, &dirty);
+        if (xr.config.enable) {
+            xmpu_check_region(s, &xr);
+        }
+        xmpu_region_extend(s, &xr, &start, &last, &dirty);
+        *cur = xr;
+    }
+
+    xmpu_build_segments(s);
     xmpu_update_enabled(s);
     qemu_set_irq(s->enabled_signal, s->enabled);
 
-    for (i = 0; i < s->cfg.nr_masters; i++) {
-        IOMMUTLBEntry entry = {
-            .target_as = s->masters[i].parent_as,
-            .iova = 0,
-            .translated_addr = 0,
-            .addr_mask = ~0,
-            .perm = IOMMU_NONE,
-        };
-        memory_region_notify_iommu(&s->masters[i].iommu, entry);
-        /* Temporary hack.  */
-        memory_region_transaction_begin();
-        memory_region_set_readonly(MEMORY_REGION(&s->masters[i].iommu), false);
-        memory_region_set_readonly(MEMORY_REGION(&s->masters[i].iommu), true);
-        memory_region_set_enabled(MEMORY_REGION(&s->masters[i].iommu), s->enabled);
-        memory_region_transaction_commit();
+    if (force || s->enabled != was_enabled || ctrl != s->dec.ctrl) {
+        /* The defaults apply to the gaps between regions, anywhere.  */
+        start = 0;
+        last = UINT64_MAX;
+        dirty = true;
+    }
+    s->dec.ctrl = ctrl;
+
+    if (dirty) {
+        xmpu_invalidate(s, start, last);
     }
 }
 
 static void xmpu_setup_postw(DepRegisterInfo *reg, uint64_t val64)
 {
     XMPU *s = XILINX_XMPU(reg->opaque);
-    xmpu_flush(s);
+    xmpu_update(s, false);
 }
 
 static DepRegisterAccessInfo xmpu_regs_info[] = {
@@ -736,7 +936,7 @@ static void xmpu_reset(DeviceState *dev)
 
     DEP_AF_DP32(s->regs, CTRL, ALIGNCFG, s->cfg.align);
     isr_update_irq(s);
-    xmpu_flush(s);
+    xmpu_update(s, true);
 }
 
 static uint64_t xmpu_read(void *opaque, hwaddr addr, unsigned size,
@@ -779,8 +979,8 @@ static void xmpu_write(void *opaque, hwaddr addr, uint64_t value,
     }
     dep_register_write(r, value, ~0);
 
-    if (addr > R_R00_MASTER) {
-        xmpu_flush(s);
+    if (addr >= A_R00_START) {
+        xmpu_update(s, false);
     }
 }
 
@@ -826,7 +1026,6 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
                                            bool *sec_vio)
 {
     XMPU *s = xm->parent;
-    XMPURegion xr;
     IOMMUTLBEntry ret = {
         .iova = addr,
         .translated_addr = addr,
@@ -844,6 +1043,9 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     bool sec = attr->secure;
     bool sec_access_check;
     unsigned int nr_matched = 0;
+    unsigned int seg;
+    uint64_t seg_start, seg_last;
+    uint16_t cover;
     int i;
 
     /* No security violation by default.  */
@@ -852,68 +1054,52 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     if (!s->enabled) {
         ret.target_as = &xm->down.rw.as;
         ret.perm = IOMMU_RW;
+        ret.iova = 0;
+        ret.translated_addr = 0;
+        ret.addr_mask = UINT64_MAX;
         return ret;
     }
 
     /* Convert to an absolute address to simplify the compare logic.  */
     addr += s->cfg.base;
 
-    /* Lookup if this address fits a region.  */
-    for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
+    /* Only the regions covering the segment of addr can match.  */
+    seg = xmpu_find_segment(s, addr);
+    cover = s->dec.cover[seg];
+
+    for (i = NR_XMPU_REGIONS - 1; cover && i >= 0; i--) {
+        XMPURegion *xr = &s->dec.regions[i];
         bool id_match;
-        bool match;
 
-        xmpu_decode_region(s, &xr, i);
-        if (!xr.config.enable) {
+        if (!(cover & (1 << i))) {
             continue;
         }
+        cover &= ~(1 << i);
 
-        if (xr.start & s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad region start address %" PRIx64 "\n",
-                          s->prefix, xr.start);
-        }
-
-        if (xr.end & s->addr_mask) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Bad region end address %" PRIx64 "\n",
-                           s->prefix, xr.end);
-        }
-
-        if (xr.start < s->cfg.base) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "%s: Too low region start address %" PRIx64 "\n",
-                           s->prefix, xr.end);
-        }
-
-        xr.start &= ~s->addr_mask;
-        xr.end &= ~s->addr_mask;
-
-        id_match = (xr.master.mask & xr.master.id) ==
-                       (xr.master.mask & attr->requester_id);
-        match = id_match && (addr >= xr.start && addr < xr.end);
-        if (match) {
+        id_match = (xr->master.mask & xr->master.id) ==
+                       (xr->master.mask & attr->requester_id);
+        if (id_match) {
             nr_matched++;
             /* Determine if this region is accessible by the transactions
              * security domain.
              */
-            if (xr.config.nschecktype) {
+            if (xr->config.nschecktype) {
                 /* In strict mode, secure accesses are not allowed to
                  * non-secure regions (and vice-versa).
                  */
-                sec_access_check = (sec != xr.config.regionns);
+                sec_access_check = (sec != xr->config.regionns);
             } else {
                 /* In relaxed mode secure accesses can access any region
                  * while non-secure can only access non-secure areas.
                  */
-                sec_access_check = (sec || xr.config.regionns);
+                sec_access_check = (sec || xr->config.regionns);
             }
 
             if (sec_access_check) {
-                if (xr.config.rdallowed) {
+                if (xr->config.rdallowed) {
                     ret.perm |= IOMMU_RO;
                 }
-                if (xr.config.wrallowed) {
+                if (xr->config.wrallowed) {
                     ret.perm |= IOMMU_WO;
                 }
             } else {
@@ -936,6 +1122,27 @@ static IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     if (ret.perm == IOMMU_RO) {
         ret.target_as = &xm->down.none.as;
     }
+
+    /*
+     * The result holds for the whole segment, hand out the largest
+     * naturally aligned block around addr that stays within it.
+     */
+    seg_start = s->dec.bounds[seg];
+    seg_last = seg + 1 < s->dec.nr_bounds ? s->dec.bounds[seg + 1] - 1
+                                          : UINT64_MAX;
+    seg_start = seg_start > s->cfg.base ? seg_start - s->cfg.base : 0;
+    seg_last -= s->cfg.base;
+    addr -= s->cfg.base;
+    while (ret.addr_mask != UINT64_MAX) {
+        uint64_t mask = (ret.addr_mask << 1) | 1;
+
+        if ((addr & ~mask) < seg_start || (addr | mask) > seg_last) {
+            break;
+        }
+        ret.addr_mask = mask;
+    }
+    ret.iova = addr & ~ret.addr_mask;
+    ret.translated_addr = ret.iova;
 #if 0
     qemu_log("%s: nr_matched=%d AS=%p addr=%lx - > %lx (%lx) perm=%x\n",
            __func__, nr_matched, ret.target_as, ret.iova,
@@ -1155,6 +1362,7 @@ static bool xmpu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
                                  TYPE_XILINX_XMPU_IOMMU_MEMORY_REGION,
                                  OBJECT(s),
                                  name, reg.s[i + 1]);
+        s->masters[mid].iommu.dma_cacheable = true;
         g_free(name);
 
         name = g_strdup_printf("xmpu-mr-%d\n", mid);
@@ -1182,11 +1390,20 @@ static Property xmpu_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static int xmpu_post_load(void *opaque, int version_id)
+{
+    XMPU *s = XILINX_XMPU(opaque);
+
+    xmpu_update(s, true);
+    return 0;
+}
+
 static const VMStateDescription vmstate_xmpu = {
     .name = TYPE_XILINX_XMPU,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = xmpu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XMPU, R_MAX),
         VMSTATE_END_OF_LIST(),
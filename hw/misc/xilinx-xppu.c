@@ -29,6 +29,7 @@
 #include "hw/sysbus.h"
 #include "hw/register-dep.h"
 #include "qemu/bitops.h"
+#include "qemu/bitmap.h"
 #include "sysemu/dma.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
@@ -207,6 +208,7 @@ DEP_REG32(RAM_ADJ, 0x1fc)
 #define R_MAX (R_RAM_ADJ + 1)
 
 #define NR_MID_ENTRIES 20
+#define NR_REQUESTER_IDS (1 << 10)
 
 #define NR_32B_APL_ENTRIES 128
 #define NR_64K_APL_ENTRIES 256
@@ -250,6 +252,20 @@ struct XPPU {
 
     uint32_t perm_ram[NR_APL_ENTRIES];
 
+    /*
+     * Decoded permission state, so that accesses don't have to walk
+     * the MID list. Rebuilt by xppu_update_mids when the MIDs or CTRL
+     * change, apl_bad_parity follows perm_ram writes.
+     */
+    struct {
+        /* Bitmap of the MIDs that match each requester ID.  */
+        uint32_t match[NR_REQUESTER_IDS];
+        /* Bitmaps of MIDs with good (or unchecked) parity, and RO MIDs.  */
+        uint32_t parity_ok;
+        uint32_t readonly;
+    } mid;
+    DECLARE_BITMAP(apl_bad_parity, NR_APL_ENTRIES);
+
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
 };
@@ -306,7 +322,8 @@ static void check_mid_parities(XPPU *s)
     }
 }
 
-static bool check_apl_parity(XPPU *s, uint32_t val32)
+/* Raw APL parity check, regardless of CTRL.APER_PARITY_EN.  */
+static bool apl_parity_ok(uint32_t val32)
 {
     unsigned int i;
     /* Bit 31 - Parity of 27, 19:15.
@@ -321,11 +338,6 @@ static bool check_apl_parity(XPPU *s, uint32_t val32)
         (0x1f << 15) | 1 << 27,
     };
     uint32_t p = 0, p_written;
-    bool ok;
-
-    if (!DEP_AF_EX32(s->regs, CTRL, APER_PARITY_EN)) {
-        return true;
-    }
 
     for (i = 0; i < ARRAY_SIZE(apl_parities); i++) {
         uint32_t v = val32;
@@ -338,13 +350,52 @@ static bool check_apl_parity(XPPU *s, uint32_t val32)
     }
 
     p_written = val32 >> 28;
-    ok = p_written == p;
+    return p_written == p;
+}
 
-    if (!ok) {
-        qemu_log_mask(LOG_GUEST_ERROR, "Bad APL parity!\n");
-        DEP_AF_DP32(s->regs, ISR, APER_PARITY, true);
+static void update_apl(XPPU *s, unsigned int i)
+{
+    if (apl_parity_ok(s->perm_ram[i])) {
+        clear_bit(i, s->apl_bad_parity);
+    } else {
+        set_bit(i, s->apl_bad_parity);
+    }
+}
+
+static void update_apls(XPPU *s)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(s->perm_ram); i++) {
+        update_apl(s, i);
+    }
+}
+
+static void xppu_update_mids(XPPU *s)
+{
+    unsigned int i, rid;
+
+    memset(s->mid.match, 0, sizeof s->mid.match);
+    s->mid.parity_ok = 0;
+    s->mid.readonly = 0;
+
+    for (i = 0; i < NR_MID_ENTRIES; i++) {
+        uint32_t val32 = s->regs[R_MASTER_ID00 + i];
+        uint32_t mid = DEP_F_EX32(val32, MASTER_ID00, MID);
+        uint32_t mask = DEP_F_EX32(val32, MASTER_ID00, MIDM);
+
+        if (check_mid_parity(s, val32)) {
+            s->mid.parity_ok |= 1U << i;
+        }
+        if (DEP_F_EX32(val32, MASTER_ID00, MIDR)) {
+            s->mid.readonly |= 1U << i;
+        }
+        for (rid = 0; rid < NR_REQUESTER_IDS; rid++) {
+            if ((mid & mask) == (rid & mask)) {
+                s->mid.match[rid] |= 1U << i;
+            }
+        }
     }
-    return ok;
 }
 
 static void isr_update_irq(XPPU *s)
@@ -393,6 +444,7 @@ static void ctrl_postw(DepRegisterInfo *reg, uint64_t val64)
 {
     XPPU *s = XILINX_XPPU(reg->opaque);
     update_mrs(s);
+    xppu_update_mids(s);
     check_mid_parities(s);
     isr_update_irq(s);
 }
@@ -400,7 +452,7 @@ static void ctrl_postw(DepRegisterInfo *reg, uint64_t val64)
 static void mid_postw(DepRegisterInfo *reg, uint64_t val64)
 {
     XPPU *s = XILINX_XPPU(reg->opaque);
-    check_mid_parity(s, val64);
+    xppu_update_mids(s);
     isr_update_irq(s);
 }
 
@@ -488,54 +540,70 @@ static DepRegisterAccessInfo xppu_regs_info[] = {
         .reset = 0x83c30080,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID05",  .decode.addr = A_MASTER_ID05,
         .reset = 0x3c30081,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID06",  .decode.addr = A_MASTER_ID06,
         .reset = 0x3c30082,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID07",  .decode.addr = A_MASTER_ID07,
         .reset = 0x83c30083,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID08",  .decode.addr = A_MASTER_ID08,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID09",  .decode.addr = A_MASTER_ID09,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID10",  .decode.addr = A_MASTER_ID10,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID11",  .decode.addr = A_MASTER_ID11,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID12",  .decode.addr = A_MASTER_ID12,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID13",  .decode.addr = A_MASTER_ID13,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID14",  .decode.addr = A_MASTER_ID14,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID15",  .decode.addr = A_MASTER_ID15,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID16",  .decode.addr = A_MASTER_ID16,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID17",  .decode.addr = A_MASTER_ID17,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID18",  .decode.addr = A_MASTER_ID18,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "MASTER_ID19",  .decode.addr = A_MASTER_ID19,
         .rsvd = 0x3c00fc00,
         .ro = 0x3c00fc00,
+        .post_write = mid_postw,
     },{ .name = "RAM_ADJ",  .decode.addr = A_RAM_ADJ,
         .reset = 0xb0b,
         .rsvd = 0xffffc0c0,
@@ -552,66 +620,58 @@ static void xppu_reset(DeviceState *dev)
         dep_register_reset(&s->regs_info[i]);
     }
     update_mrs(s);
+    xppu_update_mids(s);
     isr_update_irq(s);
 }
 
-static bool xppu_ap_check(XPPU *s, MemoryTransaction *tr, uint32_t apl)
+static bool xppu_ap_check(XPPU *s, MemoryTransaction *tr,
+                          unsigned int ram_offset)
 {
-    unsigned int i;
-    bool mid_match = false;
+    uint32_t apl = s->perm_ram[ram_offset];
     bool tz = extract32(apl, 27, 1);
-    bool ok;
+    bool tz_fail = !tr->attr.secure && !tz;
+    uint32_t cand, checked, pass;
 
-    ok = check_apl_parity(s, apl);
-    if (!ok) {
+    if (DEP_AF_EX32(s->regs, CTRL, APER_PARITY_EN)
+        && test_bit(ram_offset, s->apl_bad_parity)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "Bad APL parity!\n");
+        DEP_AF_DP32(s->regs, ISR, APER_PARITY, true);
         return false;
     }
 
-    /* Check MIDs.  */
-    for (i = 0; i < NR_MID_ENTRIES; i++) {
-        uint32_t val32, mid, mask;
-        bool readonly;
-
-        if (!extract32(apl, i, 1)) {
-            continue;
-        }
-
-        val32 = s->regs[R_MASTER_ID00 + i];
-        mid = DEP_F_EX32(val32, MASTER_ID00, MID);
-        readonly = DEP_F_EX32(val32, MASTER_ID00, MIDR);
-        mask = DEP_F_EX32(val32, MASTER_ID00, MIDM);
-
-        if ((mid & mask) != (tr->attr.requester_id & mask)) {
-            continue;
-        }
-
-        mid_match = true;
-
-        /* Check MID parity.  */
-        if (check_mid_parity(s, val32) == false) {
-            DEP_AF_DP32(s->regs, ISR, MID_PARITY, true);
-            continue;
-        }
-
-        if (readonly && tr->rw) {
-            DEP_AF_DP32(s->regs, ISR, MID_RO, true);
-            continue;
-        }
-
-        if (!tr->attr.secure && !tz) {
-            DEP_AF_DP32(s->regs, ISR, APER_TZ, true);
-            continue;
-        }
+    /* MIDs enabled by this APL that match the requester.  */
+    cand = apl & s->mid.match[tr->attr.requester_id % NR_REQUESTER_IDS];
+    if (!cand) {
+        /* Set if MID checks don't make it past masking and compare.  */
+        DEP_AF_DP32(s->regs, ISR, MID_MISS, true);
+        return false;
+    }
 
-        break;
+    pass = cand & s->mid.parity_ok;
+    if (tr->rw) {
+        pass &= ~s->mid.readonly;
+    }
+    if (tz_fail) {
+        pass = 0;
     }
 
-    if (!mid_match) {
-        /* Set if MID checks don't make it past masking and compare.  */
-        DEP_AF_DP32(s->regs, ISR, MID_MISS, true);
+    /*
+     * The hardware checks the candidates in MID order and stops at the
+     * first one that passes, only the ones before it flag errors.
+     */
+    checked = pass ? cand & ((pass & -pass) - 1) : cand;
+    if (checked & ~s->mid.parity_ok) {
+        DEP_AF_DP32(s->regs, ISR, MID_PARITY, true);
+    }
+    checked &= s->mid.parity_ok;
+    if (tr->rw && (checked & s->mid.readonly)) {
+        DEP_AF_DP32(s->regs, ISR, MID_RO, true);
+    }
+    if (tz_fail && (checked & ~(tr->rw ? s->mid.readonly : 0))) {
+        DEP_AF_DP32(s->regs, ISR, APER_TZ, true);
     }
 
-    return i < NR_MID_ENTRIES;
+    return pass != 0;
 }
 
 static void xppu_ap_access(MemoryTransaction *tr)
@@ -620,7 +680,6 @@ static void xppu_ap_access(MemoryTransaction *tr)
     XPPU *s = ap->parent;
     hwaddr addr = tr->addr;
     uint32_t ram_offset;
-    uint32_t apl;
     bool valid;
     bool isr_free;
     bool xppu_enabled = DEP_AF_EX32(s->regs, CTRL, ENABLE);
@@ -636,8 +695,7 @@ static void xppu_ap_access(MemoryTransaction *tr)
     ram_offset >>= ap->extract_shift;
 
     ram_offset += ap->ram_base;
-    apl = s->perm_ram[ram_offset];
-    valid = xppu_ap_check(s, tr, apl);
+    valid = xppu_ap_check(s, tr, ram_offset);
 
     if (!valid) {
         if (isr_free) {
@@ -728,6 +786,7 @@ static void xppu_write(void *opaque, hwaddr addr, uint64_t value,
         unsigned int i = (addr - 0x1000) / 4;
         assert(i < ARRAY_SIZE(s->perm_ram));
         s->perm_ram[i] = value;
+        update_apl(s, i);
         return;
     }
 
@@ -802,6 +861,7 @@ static void xppu_realize(DeviceState *dev, Error **errp)
 
     s->as = s->mr ? address_space_init_shareable(s->mr, NULL)
                           : &address_space_memory;
+    update_apls(s);
 }
 
 static void xppu_init(Object *obj)
@@ -882,11 +942,21 @@ static bool xppu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
     return parent_fmc ? parent_fmc->parse_reg(obj, reg, errp) : false;
 }
 
+static int xppu_post_load(void *opaque, int version_id)
+{
+    XPPU *s = XILINX_XPPU(opaque);
+
+    xppu_update_mids(s);
+    update_apls(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_xppu = {
     .name = TYPE_XILINX_XPPU,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = xppu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XPPU, R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -217,6 +217,7 @@ DEP_REG32(ECO_1, 0x64)
 typedef struct AMS {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
     qemu_irq irq_isr;
 
     uint32_t regs[R_MAX];
@@ -224,8 +225,8 @@ typedef struct AMS {
 } AMS;
 
 static const MemoryRegionOps ams_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -334,6 +335,8 @@ static void ams_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     unsigned int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &ams_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(ams_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -346,9 +349,7 @@ static void ams_realize(DeviceState *dev, Error **errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &ams_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
 }
 
@@ -77,6 +77,7 @@ typedef struct ZynqMPAPU ZynqMPAPU;
 struct ZynqMPAPU {
     SysBusDevice busdev;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     ARMCPU *cpus[NUM_CPUS];
     /* WFIs towards PMU. */
@@ -197,8 +198,8 @@ static const DepRegisterAccessInfo zynqmp_apu_regs_info[] = {
 };
 
 static const MemoryRegionOps zynqmp_apu_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -220,6 +221,8 @@ static void zynqmp_apu_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &zynqmp_apu_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(zynqmp_apu_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -232,9 +235,7 @@ static void zynqmp_apu_realize(DeviceState *dev, Error **errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &zynqmp_apu_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
     return;
 }
@@ -228,6 +228,7 @@ DEP_REG32(RST_DDR_SS, 0x108)
 typedef struct CRF_APB {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
     qemu_irq irq_ir;
 
     uint32_t regs[R_MAX];
@@ -235,8 +236,8 @@ typedef struct CRF_APB {
 } CRF_APB;
 
 static const MemoryRegionOps crf_apb_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -404,6 +405,8 @@ static void crf_apb_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     unsigned int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &crf_apb_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(crf_apb_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -419,9 +422,7 @@ static void crf_apb_realize(DeviceState *dev, Error **errp)
         dep_register_init(r);
         qdev_pass_all_gpios(DEVICE(r), dev);
 
-        memory_region_init_io(&r->mem, OBJECT(dev), &crf_apb_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
 }
 
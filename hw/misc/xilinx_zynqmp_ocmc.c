@@ -160,6 +160,7 @@ DEP_REG32(OCM_ECO, 0xffc)
 typedef struct OCMC {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
     qemu_irq irq;
 
     struct {
@@ -171,8 +172,8 @@ typedef struct OCMC {
 } OCMC;
 
 static const MemoryRegionOps ocm_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -340,6 +341,8 @@ static void ocm_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     unsigned int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &ocm_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(ocm_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -352,9 +355,7 @@ static void ocm_realize(DeviceState *dev, Error **errp)
             .prefix = prefix,
             .opaque = s,
         };
-        memory_region_init_io(&r->mem, OBJECT(dev), &ocm_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
 }
 
@@ -424,9 +424,12 @@ static void rpu_0_update_halt_gpio(XlnxZynqMPRPUCtrl *s)
 
 static void rpu_1_update_halt_gpio(XlnxZynqMPRPUCtrl *s)
 {
-    /* Inverse polarity */
+    /* In lockstep mode only R5-0 runs, R5-1 stays halted even if it had
+     * been released before leaving split mode.  Inverse polarity.
+     */
     qemu_set_irq(s->cont_out_gpios[R5_1_HALT],
-                !(s->regs[R_RPU_1_CFG] & R_RPU_1_CFG_NCPUHALT_MASK));
+                !(s->regs[R_RPU_1_CFG] & R_RPU_1_CFG_NCPUHALT_MASK) ||
+                !ARRAY_FIELD_EX32(s->regs, RPU_GLBL_CNTL, SLSPLIT));
 }
 
 static void rpu_0_update_vinithi_gpio(XlnxZynqMPRPUCtrl *s)
@@ -542,6 +545,27 @@ static uint64_t rpu_0_ids_prew(RegisterInfo *reg, uint64_t val64)
     return 0;
 }
 
+static void update_wfi_out(void *opaque)
+{
+    XlnxZynqMPRPUCtrl *s = XLNX_RPU_CTRL(opaque);
+    bool sls_split = ARRAY_FIELD_EX32(s->regs, RPU_GLBL_CNTL, SLSPLIT);
+    unsigned int i, wfi_pending;
+    unsigned int pwrdnreq[2];
+    bool cpu_in_wfi;
+
+    pwrdnreq[0] = ARRAY_FIELD_EX32(s->regs, RPU_0_PWRDWN, EN);
+    pwrdnreq[1] = ARRAY_FIELD_EX32(s->regs, RPU_1_PWRDWN, EN);
+
+    for (i = 0; i < 2; i++) {
+        /* R5-1 is not emulated in lockstep mode, it would execute the
+         * same thing as R5-0 so it mirrors its WFI state.
+         */
+        cpu_in_wfi = s->cpu_in_wfi[sls_split ? i : 0];
+        wfi_pending = pwrdnreq[i] && cpu_in_wfi;
+        qemu_set_irq(s->wfi_out[i], wfi_pending);
+    }
+}
+
 static void rpu_rpu_glbl_cntl_postw(RegisterInfo *reg, uint64_t val64)
 {
     XlnxZynqMPRPUCtrl *s = XLNX_RPU_CTRL(reg->opaque);
@@ -556,21 +580,8 @@ static void rpu_rpu_glbl_cntl_postw(RegisterInfo *reg, uint64_t val64)
     memory_region_set_enabled(s->ddr, sls_split);
 
     rpu_update_split_gpio(s);
-}
-
-static void update_wfi_out(void *opaque)
-{
-    XlnxZynqMPRPUCtrl *s = XLNX_RPU_CTRL(opaque);
-    unsigned int i, wfi_pending;
-    unsigned int pwrdnreq[2];
-
-    pwrdnreq[0] = ARRAY_FIELD_EX32(s->regs, RPU_0_PWRDWN, EN);
-    pwrdnreq[1] = ARRAY_FIELD_EX32(s->regs, RPU_1_PWRDWN, EN);
-
-    for (i = 0; i < 2; i++) {
-        wfi_pending = pwrdnreq[i] && s->cpu_in_wfi[i];
-        qemu_set_irq(s->wfi_out[i], wfi_pending);
-    }
+    rpu_1_update_halt_gpio(s);
+    update_wfi_out(s);
 }
 
 static void zynqmp_rpu_pwrctl_post_write(RegisterInfo *reg, uint64_t val)
@@ -27,8 +27,10 @@
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
 #include "hw/register-dep.h"
+#include "hw/misc/xlnx-sysmon-waveform.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qapi/error.h"
 
 #ifndef XILINX_SYSMON_ERR_DEBUG
 #define XILINX_SYSMON_ERR_DEBUG 0
@@ -271,29 +273,84 @@ DEP_REG32(MIN_TEMPERATURE_REMOTE, 0x2b4)
 
 #define R_MAX (R_MIN_TEMPERATURE_REMOTE + 1)
 
+typedef struct SysmonChannel {
+    unsigned int reg;
+    unsigned int max_reg;
+    unsigned int min_reg;
+} SysmonChannel;
+
+#define SYSMON_CHANNEL(x) { R_ ## x, R_MAX_ ## x, R_MIN_ ## x }
+
+static const SysmonChannel sysmon_channels[] = {
+    SYSMON_CHANNEL(TEMPERATURE),
+    SYSMON_CHANNEL(SUPPLY1),
+    SYSMON_CHANNEL(SUPPLY2),
+    SYSMON_CHANNEL(SUPPLY3),
+    SYSMON_CHANNEL(SUPPLY4),
+    SYSMON_CHANNEL(SUPPLY5),
+    SYSMON_CHANNEL(SUPPLY6),
+    SYSMON_CHANNEL(SUPPLY7),
+    SYSMON_CHANNEL(SUPPLY8),
+    SYSMON_CHANNEL(SUPPLY9),
+    SYSMON_CHANNEL(SUPPLY10),
+    SYSMON_CHANNEL(VCCAMS),
+    SYSMON_CHANNEL(TEMPERATURE_REMOTE),
+};
+
 typedef struct SYSMON {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
 
+    char *waveform_file;
+    XlnxSysmonWaveforms waveforms;
+    /* Indexed by register, for the sample registers with a waveform.  */
+    const XlnxSysmonWaveform *wave[R_MAX];
+    const SysmonChannel *chan[R_MAX];
+
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
 } SYSMON;
 
+static uint64_t sysmon_sample_postr(DepRegisterInfo *reg, uint64_t val)
+{
+    SYSMON *s = XILINX_SYSMON(reg->opaque);
+    unsigned int i = reg->access->decode.addr / 4;
+    const SysmonChannel *ch = s->chan[i];
+    uint16_t sample;
+
+    if (!s->wave[i]) {
+        return val;
+    }
+
+    sample = xlnx_sysmon_waveform_sample(s->wave[i]);
+    s->regs[i] = sample;
+    s->regs[ch->max_reg] = MAX(s->regs[ch->max_reg], sample);
+    s->regs[ch->min_reg] = MIN(s->regs[ch->min_reg], sample);
+    return sample;
+}
+
 static DepRegisterAccessInfo sysmon_regs_info[] = {
     {   .name = "TEMPERATURE",  .decode.addr = A_TEMPERATURE,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY1",  .decode.addr = A_SUPPLY1,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY2",  .decode.addr = A_SUPPLY2,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY3",  .decode.addr = A_SUPPLY3,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY4",  .decode.addr = A_SUPPLY4,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY5",  .decode.addr = A_SUPPLY5,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY6",  .decode.addr = A_SUPPLY6,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "MAX_TEMPERATURE",  .decode.addr = A_MAX_TEMPERATURE,
         .ro = 0xffff,
     },{ .name = "MAX_SUPPLY1",  .decode.addr = A_MAX_SUPPLY1,
@@ -389,16 +446,22 @@ static DepRegisterAccessInfo sysmon_regs_info[] = {
     },{ .name = "SEQ_ACQ2",  .decode.addr = A_SEQ_ACQ2,
     },{ .name = "SUPPLY7",  .decode.addr = A_SUPPLY7,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY8",  .decode.addr = A_SUPPLY8,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY9",  .decode.addr = A_SUPPLY9,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY10",  .decode.addr = A_SUPPLY10,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "VCCAMS",  .decode.addr = A_VCCAMS,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "TEMPERATURE_REMOTE",  .decode.addr = A_TEMPERATURE_REMOTE,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "MAX_SUPPLY7",  .decode.addr = A_MAX_SUPPLY7,
         .ro = 0xffff,
     },{ .name = "MAX_SUPPLY8",  .decode.addr = A_MAX_SUPPLY8,
@@ -505,6 +568,20 @@ static void sysmon_realize(DeviceState *dev, Error **errp)
             .opaque = s,
         };
     }
+
+    if (!s->waveform_file) {
+        return;
+    }
+    if (!xlnx_sysmon_waveforms_load(&s->waveforms, s->waveform_file, errp)) {
+        return;
+    }
+    for (i = 0; i < ARRAY_SIZE(sysmon_channels); ++i) {
+        unsigned int reg = sysmon_channels[i].reg;
+
+        s->wave[reg] = xlnx_sysmon_waveform_find(&s->waveforms,
+                                             s->regs_info[reg].access->name);
+        s->chan[reg] = &sysmon_channels[i];
+    }
 }
 
 static void sysmon_init(Object *obj)
@@ -528,6 +605,11 @@ static const VMStateDescription vmstate_sysmon = {
     }
 };
 
+static Property sysmon_properties[] = {
+    DEFINE_PROP_STRING("waveform-file", SYSMON, waveform_file),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void sysmon_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -535,6 +617,7 @@ static void sysmon_class_init(ObjectClass *klass, void *data)
     dc->reset = sysmon_reset;
     dc->realize = sysmon_realize;
     dc->vmsd = &vmstate_sysmon;
+    dc->props = sysmon_properties;
 }
 
 static const TypeInfo sysmon_info = {
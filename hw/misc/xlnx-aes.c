@@ -229,11 +229,60 @@ void xlnx_aes_load_key(XlnxAES *s, int len)
     s->key_zeroed = 0;
 }
 
+/* Messages under a recently used key start from its cached context rather
+ * than expanding the key again.  Entries are tagged with the key they were
+ * expanded from, so key writes can't make them stale.
+ */
+static XlnxAESKeyCache *xlnx_aes_key_cache_find(XlnxAES *s,
+                                                unsigned int keylen)
+{
+    unsigned int i;
+
+    for (i = 0; i < XLNX_AES_KEY_CACHE_LEN; i++) {
+        XlnxAESKeyCache *e = &s->key_cache[i];
+
+        if (e->valid && e->keylen == keylen &&
+            !memcmp(e->key, s->key, keylen / 8)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int xlnx_aes_gcm_init(XlnxAES *s, unsigned int keylen)
+{
+    XlnxAESKeyCache *e = xlnx_aes_key_cache_find(s, keylen);
+    int r;
+
+    if (!e) {
+        e = &s->key_cache[s->key_cache_next];
+        s->key_cache_next = (s->key_cache_next + 1) % XLNX_AES_KEY_CACHE_LEN;
+
+        e->valid = false;
+        r = gcm_init(&e->gcm_ctx, (void *) s->key, keylen);
+        if (r != 0) {
+            return r;
+        }
+        e->valid = true;
+        e->keylen = keylen;
+        memcpy(e->key, s->key, sizeof e->key);
+    }
+    s->gcm_ctx = e->gcm_ctx;
+    return 0;
+}
+
 void xlnx_aes_key_zero(XlnxAES *s)
 {
+    XlnxAESKeyCache *e;
+
     if (xlnx_check_state(s, IDLE, "Clearing key")) {
         return;
     }
+    /* Don't keep the schedule of a cleared key around either */
+    e = xlnx_aes_key_cache_find(s, s->keylen);
+    if (e) {
+        memset(e, 0, sizeof *e);
+    }
     memset(s->key, 0, sizeof s->key);
     s->key_zeroed = 1;
 }
@@ -257,7 +306,7 @@ static void xlnx_aes_push_iv(XlnxAES *s, uint32_t v)
             memset(s->key, 0, sizeof s->key);
             keylen = 256;
         }
-        r = gcm_init(&s->gcm_ctx, (void *) s->key, keylen);
+        r = xlnx_aes_gcm_init(s, keylen);
         if (r != 0) {
             qemu_log_mask(LOG_GUEST_ERROR, "CSU-AES: GCM init failed\n");
             return;
@@ -391,6 +440,8 @@ static void xlnx_aes_reset(DeviceState *dev)
     memset(s->tag, 0, 16);
     memset(s->key, 0, 32);
     s->keylen = 256;
+    memset(s->key_cache, 0, sizeof s->key_cache);
+    s->key_cache_next = 0;
 
     qemu_set_irq(s->s_done, false);
     qemu_set_irq(s->s_busy, false);
@@ -33,6 +33,8 @@
 #include "qapi/error.h"
 #include "sysemu/blockdev.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/sysemu.h"
+#include "qemu/timer.h"
 
 #include "hw/zynqmp_aes_key.h"
 
@@ -95,6 +97,8 @@ DEP_REG32(BBRAM_MSW_LOCK, 0x64)
 
 #define ZYNQ3_PGM_MAGIC 0x757BDF0F
 
+#define BBRAM_WB_DELAY_MS 100
+
 typedef struct BBRAMCtrl {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -106,10 +110,41 @@ typedef struct BBRAMCtrl {
     uint32_t size;
     bool msw_lock;
 
+    /* ram32 is written back to blk behind wb_timer.  */
+    bool wb_pending;
+    QEMUTimer *wb_timer;
+    VMChangeStateEntry *wb_vmstate;
+
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
 } BBRAMCtrl;
 
+static void bbram_writeback(BBRAMCtrl *s)
+{
+    timer_del(s->wb_timer);
+    if (!s->wb_pending) {
+        return;
+    }
+
+    s->wb_pending = false;
+    if (blk_pwrite(s->blk, 0, (void *) s->ram32, s->size, 0) < 0) {
+        error_report("%s: write error in sector", __func__);
+    }
+}
+
+static void bbram_writeback_timer(void *opaque)
+{
+    bbram_writeback(opaque);
+}
+
+static void bbram_writeback_vm_state(void *opaque, int running,
+                                     RunState state)
+{
+    if (!running) {
+        bbram_writeback(opaque);
+    }
+}
+
 static void bbram_ram_sync(BBRAMCtrl *s)
 {
     /* Check if there is a ZynqMP key */
@@ -128,8 +163,10 @@ static void bbram_ram_sync(BBRAMCtrl *s)
     }
 
     memcpy(s->ram32, &s->regs[R_BBRAM_0], (R_BBRAM_8 - R_BBRAM_0) * 4);
-    if (blk_pwrite(s->blk, 0, (void *) s->ram32, s->size, 0) < 0) {
-        error_report("%s: write error in sector", __func__);
+    s->wb_pending = true;
+    if (!timer_pending(s->wb_timer)) {
+        timer_mod(s->wb_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                               BBRAM_WB_DELAY_MS);
     }
 }
 
@@ -415,6 +452,10 @@ static void bbram_ctrl_realize(DeviceState *dev, Error **errp)
                          "backing file too small? Expecting %u bytes",
                           prefix, s->size);
         }
+        s->wb_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                   bbram_writeback_timer, s);
+        s->wb_vmstate = qemu_add_vm_change_state_handler(
+                            bbram_writeback_vm_state, s);
     }
     memcpy(&s->regs[R_BBRAM_0], s->ram32, (R_BBRAM_8 - R_BBRAM_0) * 4);
 
@@ -434,6 +475,18 @@ static void bbram_ctrl_realize(DeviceState *dev, Error **errp)
     }
 }
 
+static void bbram_ctrl_unrealize(DeviceState *dev, Error **errp)
+{
+    BBRAMCtrl *s = XILINX_BBRAM_CTRL(dev);
+
+    if (s->wb_timer) {
+        bbram_writeback(s);
+        qemu_del_vm_change_state_handler(s->wb_vmstate);
+        timer_free(s->wb_timer);
+        s->wb_timer = NULL;
+    }
+}
+
 static void bbram_ctrl_init(Object *obj)
 {
     BBRAMCtrl *s = XILINX_BBRAM_CTRL(obj);
@@ -445,10 +498,22 @@ static void bbram_ctrl_init(Object *obj)
     sysbus_init_irq(sbd, &s->irq_bbram);
 }
 
+static int bbram_ctrl_pre_save(void *opaque)
+{
+    BBRAMCtrl *s = opaque;
+
+    if (s->wb_timer) {
+        bbram_writeback(s);
+    }
+
+    return 0;
+}
+
 static const VMStateDescription vmstate_bbram_ctrl = {
     .name = TYPE_XILINX_BBRAM_CTRL,
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = bbram_ctrl_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, BBRAMCtrl, R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -469,6 +534,7 @@ static void bbram_ctrl_class_init(ObjectClass *klass, void *data)
 
     dc->reset = bbram_ctrl_reset;
     dc->realize = bbram_ctrl_realize;
+    dc->unrealize = bbram_ctrl_unrealize;
     dc->vmsd = &vmstate_bbram_ctrl;
     dc->props = bbram_ctrl_props;
 }
@@ -0,0 +1,119 @@
+/*
+ * Scripted sensor waveforms for the Xilinx system monitors
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+#include "hw/misc/xlnx-sysmon-waveform.h"
+
+/* Split on blanks, dropping the empty tokens runs of blanks leave.  */
+static char **xlnx_sysmon_waveform_split(const char *line)
+{
+    char **tok = g_strsplit_set(line, " \t", -1);
+    unsigned int i, n;
+
+    for (i = n = 0; tok[i]; i++) {
+        if (*tok[i]) {
+            tok[n++] = tok[i];
+        } else {
+            g_free(tok[i]);
+        }
+    }
+    tok[n] = NULL;
+    return tok;
+}
+
+static bool xlnx_sysmon_waveform_parse(XlnxSysmonWaveform *w,
+                                       char **tok, const char *path,
+                                       unsigned int lineno, Error **errp)
+{
+    unsigned int i;
+    uint64_t v;
+
+    if (!tok[0] || !tok[1] || !tok[2]) {
+        error_setg(errp, "%s:%u: expected <channel> <step-ns> <samples>",
+                   path, lineno);
+        return false;
+    }
+    if (qemu_strtoi64(tok[1], NULL, 0, &w->step_ns) || w->step_ns <= 0) {
+        error_setg(errp, "%s:%u: bad step '%s'", path, lineno, tok[1]);
+        return false;
+    }
+
+    w->nb_samples = g_strv_length(tok + 2);
+    w->samples = g_new(uint16_t, w->nb_samples);
+    for (i = 0; i < w->nb_samples; i++) {
+        if (qemu_strtou64(tok[i + 2], NULL, 0, &v) || v > UINT16_MAX) {
+            error_setg(errp, "%s:%u: bad sample '%s'", path, lineno,
+                       tok[i + 2]);
+            return false;
+        }
+        w->samples[i] = v;
+    }
+    w->name = g_strdup(tok[0]);
+    return true;
+}
+
+bool xlnx_sysmon_waveforms_load(XlnxSysmonWaveforms *ws, const char *path,
+                                Error **errp)
+{
+    GError *gerr = NULL;
+    char *contents;
+    char **lines;
+    unsigned int i;
+    bool ok = true;
+
+    if (!g_file_get_contents(path, &contents, NULL, &gerr)) {
+        error_setg(errp, "%s", gerr->message);
+        g_error_free(gerr);
+        return false;
+    }
+
+    lines = g_strsplit(contents, "\n", -1);
+    ws->w = g_new0(XlnxSysmonWaveform, g_strv_length(lines));
+    ws->nb = 0;
+    for (i = 0; ok && lines[i]; i++) {
+        char *line = g_strstrip(lines[i]);
+        char **tok;
+
+        if (!*line || *line == '#') {
+            continue;
+        }
+        tok = xlnx_sysmon_waveform_split(line);
+        ok = xlnx_sysmon_waveform_parse(&ws->w[ws->nb], tok, path, i + 1,
+                                        errp);
+        ws->nb++;
+        g_strfreev(tok);
+    }
+
+    g_strfreev(lines);
+    g_free(contents);
+    return ok;
+}
+
+const XlnxSysmonWaveform *xlnx_sysmon_waveform_find(XlnxSysmonWaveforms *ws,
+                                                    const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < ws->nb; i++) {
+        if (!g_strcmp0(ws->w[i].name, name)) {
+            return &ws->w[i];
+        }
+    }
+    return NULL;
+}
+
+uint16_t xlnx_sysmon_waveform_sample(const XlnxSysmonWaveform *w)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    return w->samples[(now / w->step_ns) % w->nb_samples];
+}
@@ -1060,6 +1060,7 @@ static size_t aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
 {
     Zynq3AES *s = XILINX_AES(obj);
     unsigned char outbuf[8 * 1024 + 16];
+    uint8_t *copy = NULL;
     int outlen = 0;
     bool feedback;
     size_t ret;
@@ -1070,6 +1071,12 @@ static size_t aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
         attr &= ~STREAM_ATTR_EOP;
     }
 
+    /* We byteswap in place.  */
+    if (attr & STREAM_ATTR_READONLY) {
+        buf = copy = g_memdup(buf, len);
+        attr &= ~STREAM_ATTR_READONLY;
+    }
+
     /* TODO: Add explicit eop to the stream interface.  */
     /* As QEMU aes is big endian, we would change the endianess when
      * user dosent request endianess swapp, i.e data is sent le.
@@ -1092,6 +1099,7 @@ static size_t aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
         memset(outbuf, 0, outlen);
     }
     stream_push(s->tx_dev, outbuf, outlen, attr);
+    g_free(copy);
 
     /* printf("%s len=%zd ret=%zd outlen=%d eop=%d\n",
            __func__, len, ret, outlen, attr); */
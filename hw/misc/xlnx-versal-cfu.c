@@ -28,9 +28,15 @@
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 #include "qemu/log.h"
+#include "qapi/error.h"
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
+#include "hw/stream.h"
+#include "sysemu/boot-profile.h"
+
+#include <zlib.h> /* For crc32 */
 
 #ifndef XILINX_CFU_APB_ERR_DEBUG
 #define XILINX_CFU_APB_ERR_DEBUG 0
@@ -217,6 +223,15 @@ REG32(CFU_ECO2, 0x11c)
 #define KEYHOLE_STREAM_4K 0x1000
 #define KEYHOLE_STREAM_256K 0x40000
 
+/* CFI packets forwarded to the PL are pushed on in chunks of this.  */
+#define CFU_FWD_SIZE (64 << 10)
+
+typedef enum {
+    CFU_SINK_DISCARD,
+    CFU_SINK_CHECKSUM,
+    CFU_SINK_FORWARD,
+} CFUSinkMode;
+
 typedef struct CFU {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -227,6 +242,17 @@ typedef struct CFU {
     uint32_t wfifo[4];
 
     CharBackend chr;
+
+    /* What happens to the CFI packets, see the sink-mode property.  */
+    char *sink_mode;
+    CFUSinkMode mode;
+    StreamSlave *pl_dev;
+    StreamCoalescer fwd;
+    /* CRC32 of every packet since reset, for sink-mode=checksum.  */
+    uint32_t checksum;
+    /* A PL partition is streaming in, for the boot profile.  */
+    bool pl_loading;
+
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
 } CFU;
@@ -274,6 +300,16 @@ static uint64_t cfu_itr_prew(RegisterInfo *reg, uint64_t val64)
 }
 
 
+static void cfu_fgcr_postw(RegisterInfo *reg, uint64_t val64)
+{
+    CFU *s = XILINX_CFU_APB(reg->opaque);
+
+    if (s->pl_loading && FIELD_EX32(val64, CFU_FGCR, EOS)) {
+        boot_profile_mark(BOOT_PHASE_PL_CONFIGURED, "cfu");
+        s->pl_loading = false;
+    }
+}
+
 static const RegisterAccessInfo cfu_apb_regs_info[] = {
     {   .name = "CFU_ISR",  .addr = A_CFU_ISR,
         .rsvd = 0xfffffc00,
@@ -296,6 +332,7 @@ static const RegisterAccessInfo cfu_apb_regs_info[] = {
         .reset = 0x1,
     },{ .name = "CFU_FGCR",  .addr = A_CFU_FGCR,
         .rsvd = 0xffff8000,
+        .post_write = cfu_fgcr_postw,
     },{ .name = "CFU_CTL",  .addr = A_CFU_CTL,
         .rsvd = 0xffff0000,
     },{ .name = "CFU_CRAM_RW",  .addr = A_CFU_CRAM_RW,
@@ -343,6 +380,12 @@ static void cfu_apb_reset(DeviceState *dev)
 
     s->regs[R_CFU_STATUS] |= R_CFU_STATUS_HC_COMPLETE_MASK;
     cfu_imr_update_irq(s);
+
+    s->checksum = 0;
+    s->pl_loading = false;
+    if (s->mode == CFU_SINK_FORWARD) {
+        stream_coalescer_reset(&s->fwd);
+    }
 }
 
 static const MemoryRegionOps cfu_apb_ops = {
@@ -376,8 +419,32 @@ static void cfu_stream_write(void *opaque, hwaddr addr, uint64_t value,
     /* Writing to the top word triggers the transmit onto CFI.  */
     if (idx == 3) {
         uint8_t packet_type, row_addr, reg_addr, crc8;
+        uint8_t pkt[sizeof(s->wfifo)];
         int i;
 
+        for (i = 0; i < ARRAY_SIZE(s->wfifo); i++) {
+            stl_le_p(pkt + i * 4, s->wfifo[i]);
+        }
+        if (!s->pl_loading) {
+            boot_profile_mark(BOOT_PHASE_PDI_LOAD, "cfu");
+            s->pl_loading = true;
+        }
+        switch (s->mode) {
+        case CFU_SINK_CHECKSUM:
+            s->checksum = crc32(s->checksum, pkt, sizeof(pkt));
+            break;
+        case CFU_SINK_FORWARD:
+            /* MMIO can't be pushed back on.  */
+            if (stream_coalescer_push(&s->fwd, pkt, sizeof(pkt), 0)
+                < sizeof(pkt)) {
+                qemu_log_mask(LOG_GUEST_ERROR, "CFU: PL not accepting, "
+                              "dropping CFI packet\n");
+            }
+            break;
+        default:
+            break;
+        }
+
         if (qemu_chr_fe_get_driver(&s->chr)) {
             for (i = idx; i >= 0; i--) {
                 qemu_chr_fe_printf(&s->chr, "%08x", (unsigned int)s->wfifo[i]);
@@ -415,6 +482,23 @@ static void cfu_apb_realize(DeviceState *dev, Error **errp)
     if (!qemu_chr_fe_get_driver(&s->chr)) {
         DPRINT("CFU Debug socket not connected\n");
     }
+
+    if (!s->sink_mode || !strcmp(s->sink_mode, "discard")) {
+        s->mode = CFU_SINK_DISCARD;
+    } else if (!strcmp(s->sink_mode, "checksum")) {
+        s->mode = CFU_SINK_CHECKSUM;
+    } else if (!strcmp(s->sink_mode, "forward")) {
+        if (!s->pl_dev) {
+            error_setg(errp, "CFU: sink-mode=forward needs "
+                       "stream-connected-pl");
+            return;
+        }
+        s->mode = CFU_SINK_FORWARD;
+        stream_coalescer_init(&s->fwd, s->pl_dev, CFU_FWD_SIZE);
+    } else {
+        error_setg(errp, "CFU: sink-mode must be discard, checksum "
+                   "or forward");
+    }
 }
 
 static void cfu_apb_init(Object *obj)
@@ -446,10 +530,20 @@ static void cfu_apb_init(Object *obj)
         g_free(name);
     }
     sysbus_init_irq(sbd, &s->irq_cfu_imr);
+
+    /* Where the packets go with sink-mode=forward, e.g remote-port.  */
+    object_property_add_link(obj, "stream-connected-pl", TYPE_STREAM_SLAVE,
+                             (Object **) &s->pl_dev,
+                             qdev_prop_allow_set_link_before_realize,
+                             OBJ_PROP_LINK_UNREF_ON_RELEASE,
+                             NULL);
+    object_property_add_uint32_ptr(obj, "checksum", &s->checksum, NULL);
 }
 
 static Property cfu_props[] = {
         DEFINE_PROP_CHR("chardev", CFU, chr),
+        /* discard, checksum or forward.  */
+        DEFINE_PROP_STRING("sink-mode", CFU, sink_mode),
         DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -32,6 +32,7 @@
 #include "qemu/log.h"
 
 #include "hw/fdt_generic_util.h"
+#include "sysemu/boot-profile.h"
 
 #ifndef XILINX_CRF_ERR_DEBUG
 #define XILINX_CRF_ERR_DEBUG 0
@@ -134,9 +135,12 @@ typedef struct XlnxZynq3Crf {
     qemu_irq rst_fpd_swdt;
     qemu_irq rst_sysmon_cfg;
     qemu_irq rst_sysmon_seq;
+    /* ACPU cores out of reset, for the boot profile.  */
+    uint8_t acpu_running;
 
     uint32_t regs[CRF_R_MAX];
     RegisterInfo regs_info[CRF_R_MAX];
+    RegisterInfoArray *reg_array;
 } XlnxZynq3Crf;
 
 #define PROPAGATE_GPIO(reg, f, irq) { \
@@ -178,6 +182,20 @@ static uint64_t ir_disable_prew(RegisterInfo *reg, uint64_t val64)
 
 static void crf_update_gpios(XlnxZynq3Crf *s)
 {
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(s->rst_acpu); i++) {
+        bool held = s->regs[R_RST_APU] & (R_RST_APU_ACPU0_MASK << i);
+
+        if (!held && !(s->acpu_running & (1 << i))) {
+            char name[8];
+
+            snprintf(name, sizeof(name), "acpu%u", i);
+            boot_profile_mark(BOOT_PHASE_APU_RELEASE, name);
+        }
+        s->acpu_running = deposit32(s->acpu_running, i, 1, !held);
+    }
+
     PROPAGATE_GPIO(RST_APU, ACPU0, s->rst_acpu[0]);
     PROPAGATE_GPIO(RST_APU, ACPU1, s->rst_acpu[1]);
     PROPAGATE_GPIO(RST_APU, ACPU2, s->rst_acpu[2]);
@@ -264,11 +282,8 @@ static const RegisterAccessInfo crf_regs_info[] = {
 static void crf_reset(DeviceState *dev)
 {
     XlnxZynq3Crf *s = XILINX_CRF(dev);
-    unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        register_reset(&s->regs_info[i]);
-    }
+    register_reset_block(s->reg_array);
     ir_update_irq(s);
     crf_update_gpios(s);
 }
@@ -305,6 +320,7 @@ static void crf_init(Object *obj)
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
+    s->reg_array = reg_array;
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq_ir);
 
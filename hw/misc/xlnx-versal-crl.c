@@ -276,6 +276,7 @@ typedef struct Zynq3CRL {
 
     uint32_t regs[CRL_R_MAX];
     RegisterInfo regs_info[CRL_R_MAX];
+    RegisterInfoArray *reg_array;
 } Zynq3CRL;
 
 static void ir_update_irq(Zynq3CRL *s)
@@ -541,11 +542,8 @@ static const RegisterAccessInfo crl_regs_info[] = {
 static void crl_reset(DeviceState *dev)
 {
     Zynq3CRL *s = XILINX_CRL(dev);
-    unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        register_reset(&s->regs_info[i]);
-    }
+    register_reset_block(s->reg_array);
 
     ir_update_irq(s);
     crl_update_gpios(s);
@@ -583,6 +581,7 @@ static void crl_init(Object *obj)
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
+    s->reg_array = reg_array;
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq_ir);
 
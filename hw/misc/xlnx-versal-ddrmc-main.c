@@ -6439,10 +6439,10 @@ static void ddrmc_main_init(Object *obj)
 
 static const VMStateDescription vmstate_ddrmc_main = {
     .name = TYPE_XILINX_DDRMC_MAIN,
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 2,
+    .minimum_version_id = 2,
     .fields = (VMStateField[]) {
-        VMSTATE_UINT32_ARRAY(regs, DDRMC_MAIN, DDRMC_MAIN_R_MAX),
+        VMSTATE_REGISTER_DELTA(regs_info, DDRMC_MAIN, DDRMC_MAIN_R_MAX),
         VMSTATE_END_OF_LIST(),
     }
 };
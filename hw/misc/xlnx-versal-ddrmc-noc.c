@@ -2582,10 +2582,10 @@ static void ddrmc_noc_init(Object *obj)
 
 static const VMStateDescription vmstate_ddrmc_noc = {
     .name = TYPE_XILINX_DDRMC_NOC,
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 2,
+    .minimum_version_id = 2,
     .fields = (VMStateField[]) {
-        VMSTATE_UINT32_ARRAY(regs, DDRMC_NOC, DDRMC_NOC_R_MAX),
+        VMSTATE_REGISTER_DELTA(regs_info, DDRMC_NOC, DDRMC_NOC_R_MAX),
         VMSTATE_END_OF_LIST(),
     }
 };
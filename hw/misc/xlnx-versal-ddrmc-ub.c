@@ -31,6 +31,7 @@
 #include "qemu/log.h"
 
 #include "hw/fdt_generic_util.h"
+#include "sysemu/boot-profile.h"
 
 #ifndef XILINX_DDRMC_UB_ERR_DEBUG
 #define XILINX_DDRMC_UB_ERR_DEBUG 0
@@ -210,6 +211,11 @@ typedef struct DDRMC_UB {
     qemu_irq rst_ub;
     qemu_irq wake_ub;
 
+    /* Answer the PMC handshakes here and keep the MicroBlaze in reset */
+    bool fast_init;
+    /* Software saw the calibration done, for the boot profile.  */
+    bool cal_seen;
+
     uint32_t regs[DDRMC_UB_R_MAX];
     RegisterInfo regs_info[DDRMC_UB_R_MAX];
 } DDRMC_UB;
@@ -224,6 +230,11 @@ typedef struct DDRMC_UB {
 
 static void update_gpios(DDRMC_UB *s)
 {
+    if (s->fast_init) {
+        qemu_set_irq(s->rst_ub, 1);
+        qemu_set_irq(s->wake_ub, 0);
+        return;
+    }
     PROPAGATE_GPIO(DDRMC_PCSR_CONTROL, UB_INITSTATE, s->rst_ub, s->wake_ub);
 }
 
@@ -248,6 +259,35 @@ static void ddrmc_ub_lock_postw(RegisterInfo *reg, uint64_t val64)
     ARRAY_FIELD_DP32(s->regs, DDRMC_PCSR_STATUS, PCSRLOCK, locked);
 }
 
+/* With fast-init, requests are acknowledged and completed at once, the way
+ * the firmware would once it is done with them.
+ */
+static void ddrmc_ub_pmc2ub_interrupt_postw(RegisterInfo *reg, uint64_t val64)
+{
+    DDRMC_UB *s = XILINX_DDRMC_UB(reg->opaque);
+
+    if (!s->fast_init) {
+        return;
+    }
+    s->regs[R_UB2PMC_ACK] = s->regs[R_PMC2UB_INTERRUPT];
+    s->regs[R_UB2PMC_DONE] = s->regs[R_PMC2UB_INTERRUPT];
+}
+
+static uint64_t ddrmc_ub_pcsr_status_postr(RegisterInfo *reg,
+                                           uint64_t val64)
+{
+    DDRMC_UB *s = XILINX_DDRMC_UB(reg->opaque);
+
+    if (!s->cal_seen && FIELD_EX32(val64, DDRMC_PCSR_STATUS, CALDONE)) {
+        char *name = object_get_canonical_path_component(OBJECT(s));
+
+        boot_profile_mark(BOOT_PHASE_DDR_CALIBRATED, name);
+        g_free(name);
+        s->cal_seen = true;
+    }
+    return val64;
+}
+
 static const RegisterAccessInfo ddrmc_ub_regs_info[] = {
     {   .name = "DDRMC_PCSR_MASK",  .addr = A_DDRMC_PCSR_MASK,
         .rsvd = 0xfce07900,
@@ -266,6 +306,7 @@ static const RegisterAccessInfo ddrmc_ub_regs_info[] = {
                  | R_DDRMC_PCSR_STATUS_MEM_CLEAR_PASS_MASK,
         .rsvd = 0xffffc000,
         .ro = 0x3fff,
+        .post_read = ddrmc_ub_pcsr_status_postr,
     },{ .name = "DDRMC_PCSR_LOCK",  .addr = A_DDRMC_PCSR_LOCK,
         .reset = 0x1,
         .post_write = ddrmc_ub_lock_postw,
@@ -316,6 +357,7 @@ static const RegisterAccessInfo ddrmc_ub_regs_info[] = {
         .rsvd = 0xfffffff8,
     },{ .name = "PMC2UB_INTERRUPT",  .addr = A_PMC2UB_INTERRUPT,
         .rsvd = 0xffffffe0,
+        .post_write = ddrmc_ub_pmc2ub_interrupt_postw,
     },{ .name = "UB2PMC_ACK",  .addr = A_UB2PMC_ACK,
         .rsvd = 0xffffffe0,
     },{ .name = "UB2PMC_DONE",  .addr = A_UB2PMC_DONE,
@@ -350,7 +392,12 @@ static void ddrmc_ub_reset(DeviceState *dev)
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         register_reset(&s->regs_info[i]);
     }
+    s->cal_seen = false;
 
+    if (s->fast_init) {
+        ARRAY_FIELD_DP32(s->regs, UB_STATUS, AWAKE, 1);
+        ARRAY_FIELD_DP32(s->regs, UB_STATUS, RESTORE_DONE, 1);
+    }
     update_gpios(s);
 }
 
@@ -414,6 +461,11 @@ static const VMStateDescription vmstate_ddrmc_ub = {
     }
 };
 
+static Property ddrmc_ub_properties[] = {
+    DEFINE_PROP_BOOL("fast-init", DDRMC_UB, fast_init, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static const FDTGenericGPIOSet ddrmc_ub_gpios[] = {
     {
       .names = &fdt_generic_gpio_name_set_gpio,
@@ -433,6 +485,7 @@ static void ddrmc_ub_class_init(ObjectClass *klass, void *data)
 
     dc->reset = ddrmc_ub_reset;
     dc->vmsd = &vmstate_ddrmc_ub;
+    dc->props = ddrmc_ub_properties;
     fggc->controller_gpios = ddrmc_ub_gpios;
 }
 
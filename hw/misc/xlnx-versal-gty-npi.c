@@ -9878,6 +9878,7 @@ typedef struct GTY_NPI_SLAVE {
 
     uint32_t regs[GTY_NPI_SLAVE_R_MAX];
     RegisterInfo regs_info[GTY_NPI_SLAVE_R_MAX];
+    RegisterInfoArray *reg_array;
 } GTY_NPI_SLAVE;
 
 #define LOCK_VAL 0xF9E8D7C6
@@ -13148,11 +13149,8 @@ static const RegisterAccessInfo gty_npi_slave_regs_info[] = {
 static void gty_npi_slave_reset(DeviceState *dev)
 {
     GTY_NPI_SLAVE *s = XILINX_GTY_NPI_SLAVE(dev);
-    unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        register_reset(&s->regs_info[i]);
-    }
+    register_reset_block(s->reg_array);
 }
 
 static MemTxResult reg_write(void *opaque, hwaddr addr,
@@ -13204,15 +13202,16 @@ static void gty_npi_slave_init(Object *obj)
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
+    s->reg_array = reg_array;
     sysbus_init_mmio(sbd, &s->iomem);
 }
 
 static const VMStateDescription vmstate_gty_npi_slave = {
     .name = TYPE_XILINX_GTY_NPI_SLAVE,
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 2,
+    .minimum_version_id = 2,
     .fields = (VMStateField[]) {
-        VMSTATE_UINT32_ARRAY(regs, GTY_NPI_SLAVE, GTY_NPI_SLAVE_R_MAX),
+        VMSTATE_REGISTER_DELTA(regs_info, GTY_NPI_SLAVE, GTY_NPI_SLAVE_R_MAX),
         VMSTATE_END_OF_LIST(),
     }
 };
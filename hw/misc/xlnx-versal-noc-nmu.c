@@ -29,13 +29,12 @@
 #include "hw/register.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "hw/misc/xlnx-versal-noc-nmu.h"
 
 #ifndef XILINX_NOC_NMU_ERR_DEBUG
 #define XILINX_NOC_NMU_ERR_DEBUG 0
 #endif
 
-#define TYPE_XILINX_NOC_NMU "xlnx.noc-nmu"
-
 #define XILINX_NOC_NMU(obj) \
      OBJECT_CHECK(NOC_NMU, (obj), TYPE_XILINX_NOC_NMU)
 
@@ -1155,20 +1154,94 @@ REG32(REG_SPARE, 0x914)
 
 #define LOCK_VAL 0xF9E8D7C6
 
+#define NOC_NMU_ADDR_ENTRIES 16
+
+/* An enabled entry of the address map, in address bits 47:16 */
+typedef struct NocNmuRoute {
+    uint32_t maddr;
+    uint32_t mask;
+    uint32_t rpaddr;
+    uint16_t dst;
+    bool remap;
+} NocNmuRoute;
+
 typedef struct NOC_NMU {
     SysBusDevice parent_obj;
     RegisterInfoArray *reg_array;
 
+    /* The address map compiled from the registers.  Firmware programs
+     * the map with the PCSR unlocked, so the table is only rebuilt when
+     * it is next used or the PCSR is locked again.
+     */
+    NocNmuRoute routes[NOC_NMU_ADDR_ENTRIES];
+    unsigned int num_routes;
+    bool routes_dirty;
+
     uint32_t regs[NOC_NMU_R_MAX];
     RegisterInfo regs_info[NOC_NMU_R_MAX];
 } NOC_NMU;
 
+static void noc_nmu_compile_routes(NOC_NMU *s)
+{
+    uint32_t enable = ARRAY_FIELD_EX32(s->regs, REG_ADDR_ENABLE, REMAP);
+    uint32_t remap = ARRAY_FIELD_EX32(s->regs, REG_ADDR_REMAP, REMAP);
+    unsigned int i;
+
+    s->num_routes = 0;
+    for (i = 0; i < NOC_NMU_ADDR_ENTRIES; i++) {
+        NocNmuRoute *r = &s->routes[s->num_routes];
+
+        if (!(enable & (1 << i))) {
+            continue;
+        }
+        r->mask = s->regs[R_REG_ADDR_MASK0 + i];
+        r->maddr = s->regs[R_REG_ADDR_MADDR0 + i] & r->mask;
+        r->rpaddr = s->regs[R_REG_ADDR_RPADDR0 + i] & r->mask;
+        r->dst = FIELD_EX32(s->regs[R_REG_ADDR_DST0 + i], REG_ADDR_DST0,
+                            REMAP_ID);
+        r->remap = remap & (1 << i);
+        s->num_routes++;
+    }
+    s->routes_dirty = false;
+}
+
+bool xlnx_noc_nmu_route(Object *nmu, uint64_t addr, uint64_t *xaddr,
+                        uint16_t *dst)
+{
+    NOC_NMU *s = XILINX_NOC_NMU(nmu);
+    uint32_t page = addr >> NOC_NMU_ADDR_SHIFT;
+    unsigned int i;
+
+    if (s->routes_dirty) {
+        noc_nmu_compile_routes(s);
+    }
+
+    for (i = 0; i < s->num_routes; i++) {
+        NocNmuRoute *r = &s->routes[i];
+
+        if ((page & r->mask) != r->maddr) {
+            continue;
+        }
+        *dst = r->dst;
+        *xaddr = addr;
+        if (r->remap) {
+            *xaddr &= ~((uint64_t)r->mask << NOC_NMU_ADDR_SHIFT);
+            *xaddr |= (uint64_t)r->rpaddr << NOC_NMU_ADDR_SHIFT;
+        }
+        return true;
+    }
+    return false;
+}
+
 static void noc_nmu_lock_postw(RegisterInfo *reg, uint64_t val64)
 {
     NOC_NMU *s = XILINX_NOC_NMU(reg->opaque);
     bool locked = val64 != LOCK_VAL;
 
     ARRAY_FIELD_DP32(s->regs, REG_PCSR_STATUS, PCSRLOCK, locked);
+    if (locked && s->routes_dirty) {
+        noc_nmu_compile_routes(s);
+    }
 }
 
 static const RegisterAccessInfo noc_nmu_regs_info[] = {
@@ -1739,11 +1812,27 @@ static void noc_nmu_reset(DeviceState *dev)
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         register_reset(&s->regs_info[i]);
     }
+    s->routes_dirty = true;
+}
+
+/* Writes to the address map only mark the compiled table stale, keeping
+ * the plain register write path for all of them.
+ */
+static void noc_nmu_write(void *opaque, hwaddr addr, uint64_t value,
+                          unsigned size)
+{
+    RegisterInfoArray *reg_array = opaque;
+    NOC_NMU *s = XILINX_NOC_NMU(reg_array->r[0]->opaque);
+
+    if (addr >= A_REG_ADDR_MADDR0 && addr <= A_REG_ADDR_REMAP) {
+        s->routes_dirty = true;
+    }
+    register_write_memory(opaque, addr, value, size);
 }
 
 static const MemoryRegionOps noc_nmu_ops = {
     .read = register_read_memory,
-    .write = register_write_memory,
+    .write = noc_nmu_write,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -1766,10 +1855,19 @@ static void noc_nmu_init(Object *obj)
     sysbus_init_mmio(sbd, &s->reg_array->mem);
 }
 
+static int noc_nmu_post_load(void *opaque, int version_id)
+{
+    NOC_NMU *s = opaque;
+
+    s->routes_dirty = true;
+    return 0;
+}
+
 static const VMStateDescription vmstate_noc_nmu = {
     .name = TYPE_XILINX_NOC_NMU,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = noc_nmu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, NOC_NMU, NOC_NMU_R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -4201,10 +4201,10 @@ static void noc_nps_init(Object *obj)
 
 static const VMStateDescription vmstate_noc_nps = {
     .name = TYPE_XILINX_NOC_NPS,
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 2,
+    .minimum_version_id = 2,
     .fields = (VMStateField[]) {
-        VMSTATE_UINT32_ARRAY(regs, NOC_NPS, NOC_NPS_R_MAX),
+        VMSTATE_REGISTER_DELTA(regs_info, NOC_NPS, NOC_NPS_R_MAX),
         VMSTATE_END_OF_LIST(),
     }
 };
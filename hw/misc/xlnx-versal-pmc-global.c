@@ -32,6 +32,7 @@
 #include "qemu/log.h"
 
 #include "hw/fdt_generic_util.h"
+#include "sysemu/boot-profile.h"
 
 #ifndef XILINX_PMC_GLOBAL_ERR_DEBUG
 #define XILINX_PMC_GLOBAL_ERR_DEBUG 0
@@ -865,8 +866,13 @@ static void ppu1_update_ctrl(PMC_GLOBAL *s)
         break;
     default:
         qemu_log_mask(LOG_GUEST_ERROR, "Invalid PPU1_RST_MODE %x\n", rst_mode);
-        break;
+        return;
     };
+
+    /* The ROM hands over to the PLM on PPU1.  */
+    if (!rst && (rst_mode == 0 || wakeup)) {
+        boot_profile_mark(BOOT_PHASE_PLM_START, "ppu1");
+    }
 }
 
 static void pmc_ppu1_gpi_update_irq(PMC_GLOBAL *s)
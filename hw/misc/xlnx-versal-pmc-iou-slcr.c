@@ -773,6 +773,7 @@ typedef struct PMC_IOU_SLCR {
 
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
+    RegisterInfoArray *reg_array;
 } PMC_IOU_SLCR;
 
 static void parity_imr_update_irq(PMC_IOU_SLCR *s)
@@ -1360,11 +1361,8 @@ static RegisterAccessInfo pmc_iou_slcr_regs_info[] = {
 static void pmc_iou_slcr_reset(DeviceState *dev)
 {
     PMC_IOU_SLCR *s = XILINX_PMC_IOU_SLCR(dev);
-    unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        register_reset(&s->regs_info[i]);
-    }
+    register_reset_block(s->reg_array);
 
     parity_imr_update_irq(s);
     imr_update_irq(s);
@@ -1411,6 +1409,7 @@ static void pmc_iou_slcr_init(Object *obj)
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
+    s->reg_array = reg_array;
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq_parity_imr);
     sysbus_init_irq(sbd, &s->irq_imr);
@@ -27,8 +27,10 @@
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
 #include "hw/register.h"
+#include "hw/misc/xlnx-sysmon-waveform.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qapi/error.h"
 
 #ifndef PMC_SYSMON_ERR_DEBUG
 #define PMC_SYSMON_ERR_DEBUG 0
@@ -241,16 +243,42 @@ REG32(ABUS_SWITCH1415, 0x394)
 
 #define SYSMON_R_MAX (R_ABUS_SWITCH1415 + 1)
 
+/* TEMPERATURE and SUPPLY0-6, with their _MAX and _MIN registers.  */
+#define SYSMON_NUM_CHANNELS (R_SUPPLY6 - R_TEMPERATURE + 1)
+
 typedef struct PMCSysMon {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
     qemu_irq irq_sysmon_alarm_imr;
     qemu_irq irq_sysmon_ot_imr;
 
+    char *waveform_file;
+    XlnxSysmonWaveforms waveforms;
+    const XlnxSysmonWaveform *wave[SYSMON_NUM_CHANNELS];
+
     uint32_t regs[SYSMON_R_MAX];
     RegisterInfo regs_info[SYSMON_R_MAX];
 } PMCSysMon;
 
+static uint64_t sysmon_sample_postr(RegisterInfo *reg, uint64_t val)
+{
+    PMCSysMon *s = PMC_SYSMON(reg->opaque);
+    unsigned int ch = reg->access->addr / 4 - R_TEMPERATURE;
+    uint16_t sample;
+
+    if (!s->wave[ch]) {
+        return val;
+    }
+
+    sample = xlnx_sysmon_waveform_sample(s->wave[ch]);
+    s->regs[R_TEMPERATURE + ch] = sample;
+    s->regs[R_TEMPERATURE_MAX + ch] = MAX(s->regs[R_TEMPERATURE_MAX + ch],
+                                          sample);
+    s->regs[R_TEMPERATURE_MIN + ch] = MIN(s->regs[R_TEMPERATURE_MIN + ch],
+                                          sample);
+    return sample;
+}
+
 static void sysmon_alarm_imr_update_irq(PMCSysMon *s)
 {
     bool pending = s->regs[R_SYSMON_ALARM_ISR] & ~s->regs[R_SYSMON_ALARM_IMR];
@@ -359,27 +387,35 @@ static const RegisterAccessInfo sysmon_regs_info[] = {
     },{ .name = "TEMPERATURE",  .addr = A_TEMPERATURE,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY0",  .addr = A_SUPPLY0,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY1",  .addr = A_SUPPLY1,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY2",  .addr = A_SUPPLY2,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY3",  .addr = A_SUPPLY3,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY4",  .addr = A_SUPPLY4,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY5",  .addr = A_SUPPLY5,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "SUPPLY6",  .addr = A_SUPPLY6,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
+        .post_read = sysmon_sample_postr,
     },{ .name = "TEMPERATURE_MAX",  .addr = A_TEMPERATURE_MAX,
         .rsvd = 0xffff0000,
         .ro = 0xffff,
@@ -548,7 +584,20 @@ static const MemoryRegionOps sysmon_ops = {
 
 static void sysmon_realize(DeviceState *dev, Error **errp)
 {
-    /* Delete this if you don't need it */
+    PMCSysMon *s = PMC_SYSMON(dev);
+    unsigned int i;
+
+    if (!s->waveform_file) {
+        return;
+    }
+    if (!xlnx_sysmon_waveforms_load(&s->waveforms, s->waveform_file, errp)) {
+        return;
+    }
+    for (i = 0; i < SYSMON_NUM_CHANNELS; i++) {
+        const RegisterAccessInfo *ac = s->regs_info[R_TEMPERATURE + i].access;
+
+        s->wave[i] = xlnx_sysmon_waveform_find(&s->waveforms, ac->name);
+    }
 }
 
 static void sysmon_init(Object *obj)
@@ -583,6 +632,11 @@ static const VMStateDescription vmstate_sysmon = {
     }
 };
 
+static Property sysmon_properties[] = {
+    DEFINE_PROP_STRING("waveform-file", PMCSysMon, waveform_file),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void sysmon_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -590,6 +644,7 @@ static void sysmon_class_init(ObjectClass *klass, void *data)
     dc->reset = sysmon_reset;
     dc->realize = sysmon_realize;
     dc->vmsd = &vmstate_sysmon;
+    dc->props = sysmon_properties;
 }
 
 static const TypeInfo sysmon_info = {
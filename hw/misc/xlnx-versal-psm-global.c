@@ -669,6 +669,7 @@ typedef struct PSM_GLOBAL_REG {
 
     uint32_t regs[PSM_GLOBAL_REG_R_MAX];
     RegisterInfo regs_info[PSM_GLOBAL_REG_R_MAX];
+    RegisterInfoArray *reg_array;
 } PSM_GLOBAL_REG;
 
 static void req_pwrdwn_int_update_irq(PSM_GLOBAL_REG *s)
@@ -1216,11 +1217,8 @@ static const RegisterAccessInfo psm_global_reg_regs_info[] = {
 static void psm_global_reg_reset(DeviceState *dev)
 {
     PSM_GLOBAL_REG *s = XILINX_PSM_GLOBAL_REG(dev);
-    unsigned int i;
 
-    for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
-        register_reset(&s->regs_info[i]);
-    }
+    register_reset_block(s->reg_array);
 
     req_pwrdwn_int_update_irq(s);
     wakeup_irq_update_irq(s);
@@ -1280,6 +1278,7 @@ static void psm_global_reg_init(Object *obj)
     memory_region_add_subregion(&s->iomem,
                                 0x0,
                                 &reg_array->mem);
+    s->reg_array = reg_array;
     sysbus_init_mmio(sbd, &s->iomem);
     sysbus_init_irq(sbd, &s->irq_req_pwrdwn_int);
     sysbus_init_irq(sbd, &s->irq_wakeup_irq);
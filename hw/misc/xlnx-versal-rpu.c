@@ -522,6 +522,19 @@ static void rpu_update_gpios_pw(RegisterInfo *reg, uint64_t val64)
     rpu_update_gpios(s);
 }
 
+static uint64_t rpu_1_status_postr(RegisterInfo *reg, uint64_t val64)
+{
+    RPU *s = XILINX_VERSAL_RPU(reg->opaque);
+
+    /* Core1 does not run in lockstep mode, report the state it would share
+     * with core0 instead.
+     */
+    if (!ARRAY_FIELD_EX32(s->regs, RPU_GLBL_CNTL, SLSPLIT)) {
+        return s->regs[R_RPU_0_STATUS];
+    }
+    return val64;
+}
+
 static void rpu_update_gic_axprot(RPU *s, bool secure)
 {
     unsigned int i;
@@ -606,6 +619,7 @@ static const RegisterAccessInfo rpu_regs_info[] = {
         .reset = 0x3f,
         .rsvd = 0xffffffc0,
         .ro = 0x3f,
+        .post_read = rpu_1_status_postr,
     },{ .name = "RPU_1_PWRDWN",  .addr = A_RPU_1_PWRDWN,
         .rsvd = 0xfffffffe,
     },{ .name = "RPU_1_ISR",  .addr = A_RPU_1_ISR,
@@ -30,6 +30,7 @@
 #include "hw/register-dep.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 
 #ifndef XILINX_TRNG_ERR_DEBUG
 #define XILINX_TRNG_ERR_DEBUG 0
@@ -117,6 +118,11 @@ DEP_REG32(SLV_ERR_TRIG, 0x114)
 
 #define R_MAX (R_SLV_ERR_TRIG + 1)
 
+/* Words generated ahead of the guest, refilled once half are gone */
+#define TRNG_POOL_LEN 1024
+#define TRNG_SEED_LEN 24
+#define TRNG_DEFAULT_SEED 1
+
 typedef struct TRNG {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -127,7 +133,20 @@ typedef struct TRNG {
      * to be indicated in the status reg.  */
     uint32_t out[7];
     uint32_t count;
-    unsigned int seed;
+
+    /* The generator only depends on the seed and on how many words were
+     * taken out of it, not on when the pool got refilled, so a given
+     * seed always yields the same output.
+     */
+    GRand *rand;
+    QEMUBH *refill_bh;
+    uint32_t pool[TRNG_POOL_LEN];
+    unsigned int pool_pos;
+    unsigned int pool_len;
+    /* Applied to the generator with the next refill */
+    bool reseed;
+    uint32_t seed[TRNG_SEED_LEN];
+    uint32_t seed_len;
 
     uint32_t regs[R_MAX];
     DepRegisterInfo regs_info[R_MAX];
@@ -215,14 +234,61 @@ static uint64_t slv_err_trig_prew(DepRegisterInfo *reg, uint64_t val64)
     return 0;
 }
 
+static void trng_pool_refill(TRNG *s)
+{
+    unsigned int left = s->pool_len - s->pool_pos;
+    unsigned int i;
+
+    if (s->reseed) {
+        g_rand_set_seed_array(s->rand, s->seed, s->seed_len);
+        s->reseed = false;
+        left = 0;
+    }
+
+    memmove(s->pool, &s->pool[s->pool_pos], left * sizeof(s->pool[0]));
+    for (i = left; i < TRNG_POOL_LEN; i++) {
+        s->pool[i] = g_rand_int(s->rand);
+    }
+    s->pool_pos = 0;
+    s->pool_len = TRNG_POOL_LEN;
+}
+
+static void trng_refill_bh(void *opaque)
+{
+    trng_pool_refill(XILINX_TRNG(opaque));
+}
+
+static uint32_t trng_pool_get(TRNG *s)
+{
+    if (s->reseed || s->pool_pos == s->pool_len) {
+        /* The bottom half didn't get to it in time */
+        trng_pool_refill(s);
+    }
+    if (s->pool_len - s->pool_pos == TRNG_POOL_LEN / 2) {
+        qemu_bh_schedule(s->refill_bh);
+    }
+    return s->pool[s->pool_pos++];
+}
+
+static void trng_pool_seed(TRNG *s, const uint32_t *seed, unsigned int len)
+{
+    assert(len <= TRNG_SEED_LEN);
+    memcpy(s->seed, seed, len * sizeof(s->seed[0]));
+    s->seed_len = len;
+    s->reseed = true;
+    qemu_bh_schedule(s->refill_bh);
+}
+
 static void trng_reset(DeviceState *dev)
 {
     TRNG *s = XILINX_TRNG(dev);
+    static const uint32_t default_seed = TRNG_DEFAULT_SEED;
     unsigned int i;
 
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         dep_register_reset(&s->regs_info[i]);
     }
+    trng_pool_seed(s, &default_seed, 1);
 
     int_imr_update_irq(s);
     slv_err_imr_update_irq(s);
@@ -254,21 +320,21 @@ static void trng_done(TRNG *s)
 
 static inline void trng_reseed(TRNG *s, bool ext)
 {
+    uint32_t seed[TRNG_SEED_LEN];
+    unsigned int len = 0;
     int i;
 
-    /* Accumulate the seed regs and the personalization string.  */
-    s->seed = 0;
-
+    /* Seed with the personalization string and the seed regs.  */
     for (i = 0; i < 12; i++) {
-        s->seed += s->regs[R_PER_STRNG_0 + i];
+        seed[len++] = s->regs[R_PER_STRNG_0 + i];
     }
 
     if (ext) {
         for (i = 0; i < 12; i++) {
-            s->seed += s->regs[R_EXT_SEED_0 + i];
+            seed[len++] = s->regs[R_EXT_SEED_0 + i];
         }
     }
-    srand(s->seed);
+    trng_pool_seed(s, seed, len);
 }
 
 static inline void trng_regen(TRNG *s)
@@ -277,7 +343,7 @@ static inline void trng_regen(TRNG *s)
 
     /* Re-gen.  */
     for (i = 0; i < ARRAY_SIZE(s->out); i++) {
-        s->out[i] = rand();
+        s->out[i] = trng_pool_get(s);
     }
 
     s->count = ARRAY_SIZE(s->out);
@@ -353,7 +419,7 @@ static uint64_t trng_rand_seed_postr(DepRegisterInfo *reg, uint64_t val)
         return 0xbad;
     }
 
-    return rand();
+    return trng_pool_get(s);
 }
 
 static DepRegisterAccessInfo trng_regs_info[] = {
@@ -488,6 +554,9 @@ static void trng_init(Object *obj)
     TRNG *s = XILINX_TRNG(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
 
+    s->rand = g_rand_new_with_seed(TRNG_DEFAULT_SEED);
+    s->refill_bh = qemu_bh_new(trng_refill_bh, s);
+
     memory_region_init_io(&s->iomem, obj, &trng_ops, s,
                           TYPE_XILINX_TRNG, R_MAX * 4);
     sysbus_init_mmio(sbd, &s->iomem);
@@ -495,14 +564,34 @@ static void trng_init(Object *obj)
     sysbus_init_irq(sbd, &s->irq_slv_err_imr);
 }
 
+/* The generator state doesn't migrate, start over from the last seed.  */
+static int trng_post_load(void *opaque, int version_id)
+{
+    TRNG *s = XILINX_TRNG(opaque);
+
+    if (s->seed_len > TRNG_SEED_LEN) {
+        return -EINVAL;
+    }
+    if (!s->seed_len) {
+        /* From a version 1 stream */
+        s->seed[0] = TRNG_DEFAULT_SEED;
+        s->seed_len = 1;
+    }
+    s->reseed = true;
+    return 0;
+}
+
 static const VMStateDescription vmstate_trng = {
     .name = TYPE_XILINX_TRNG,
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = trng_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(out, TRNG, 7),
         VMSTATE_UINT32_ARRAY(regs, TRNG, R_MAX),
+        VMSTATE_UINT32_ARRAY_V(seed, TRNG, TRNG_SEED_LEN, 2),
+        VMSTATE_UINT32_V(seed_len, TRNG, 2),
         VMSTATE_END_OF_LIST(),
     }
 };
@@ -96,6 +96,7 @@ typedef struct ZynqMPIOUSLCR ZynqMPIOUSLCR;
 struct ZynqMPIOUSLCR {
     SysBusDevice busdev;
     MemoryRegion iomem;
+    DepRegisterBlock regs_block;
 
     bool mio_bank0v;
     bool mio_bank1v;
@@ -176,8 +177,8 @@ static void zynqmp_iou_slcr_reset(DeviceState *dev)
 }
 
 static const MemoryRegionOps zynqmp_iou_slcr_ops = {
-    .read = dep_register_read_memory_le,
-    .write = dep_register_write_memory_le,
+    .read_with_attrs = dep_register_block_read_le,
+    .write_with_attrs = dep_register_block_write_le,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -191,6 +192,8 @@ static void zynqmp_iou_slcr_realize(DeviceState *dev, Error **errp)
     const char *prefix = object_get_canonical_path(OBJECT(dev));
     int i;
 
+    dep_register_block_init(&s->regs_block, OBJECT(dev), &zynqmp_iou_slcr_ops,
+                            &s->iomem, prefix);
     for (i = 0; i < ARRAY_SIZE(zynqmp_iou_slcr_regs_info); ++i) {
         DepRegisterInfo *r = &s->regs_info[i];
 
@@ -206,9 +209,7 @@ static void zynqmp_iou_slcr_realize(DeviceState *dev, Error **errp)
         dep_register_init(r);
         qdev_pass_all_gpios(DEVICE(r), dev);
 
-        memory_region_init_io(&r->mem, OBJECT(dev), &zynqmp_iou_slcr_ops, r,
-                              r->access->name, 4);
-        memory_region_add_subregion(&s->iomem, r->access->decode.addr, &r->mem);
+        dep_register_block_add(&s->regs_block, r, r->access->decode.addr);
     }
     return;
 }
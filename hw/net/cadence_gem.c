@@ -28,8 +28,14 @@
 #include "hw/net/cadence_gem.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
+#include "qemu/iov.h"
 #include "net/checksum.h"
+#include "net/eth.h"
+#include "standard-headers/linux/virtio_net.h"
 #include "exec/address-spaces.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "sysemu/sysemu.h"
 
 #define CADENCE_GEM_ERR_DEBUG 0
 #define DB_PRINT(...) do {\
@@ -57,6 +63,7 @@
 #define GEM_TXPAUSE       (0x0000003C/4) /* TX Pause Time reg */
 #define GEM_TXPARTIALSF   (0x00000040/4) /* TX Partial Store and Forward */
 #define GEM_RXPARTIALSF   (0x00000044/4) /* RX Partial Store and Forward */
+#define GEM_INTMOD        (0x0000005C/4) /* Interrupt Moderation reg */
 #define GEM_HASHLO        (0x00000080/4) /* Hash Low address reg */
 #define GEM_HASHHI        (0x00000084/4) /* Hash High address reg */
 #define GEM_SPADDR1LO     (0x00000088/4) /* Specific addr 1 low reg */
@@ -142,6 +149,7 @@
 #define GEM_DESCONF5      (0x00000290/4)
 #define GEM_DESCONF6      (0x00000294/4)
 #define GEM_DESCONF6_64B_MASK (1U << 23)
+#define GEM_DESCONF6_LSO_MASK (1U << 27)
 #define GEM_DESCONF7      (0x00000298/4)
 
 #define GEM_INT_Q1_STATUS               (0x00000400 / 4)
@@ -202,6 +210,7 @@
 #define GEM_NWCTRL_RXENA       0x00000004 /* Receive Enable */
 #define GEM_NWCTRL_LOCALLOOP   0x00000002 /* Local Loopback */
 
+#define GEM_NWCFG_RXCOEN       0x01000000 /* RX checksum offload */
 #define GEM_NWCFG_STRIP_FCS    0x00020000 /* Strip FCS field */
 #define GEM_NWCFG_LERR_DISC    0x00010000 /* Discard RX frames with len err */
 #define GEM_NWCFG_BUFF_OFST_M  0x0000C000 /* Receive buffer offset mask */
@@ -293,10 +302,22 @@
 
 #define DESC_1_TX_WRAP 0x40000000
 #define DESC_1_TX_LAST 0x00008000
+/* Large send offload, first descriptor of a frame */
+#define R_DESC_1_TX_LSO_SHIFT           17
+#define R_DESC_1_TX_LSO_LENGTH          2
+#define DESC_1_TX_LSO_UFO               1
+#define DESC_1_TX_LSO_TSO               2
+/* Segment size, on the other descriptors of an LSO frame */
+#define R_DESC_1_TX_MSS_SHIFT           16
+#define R_DESC_1_TX_MSS_LENGTH          14
 
 #define DESC_0_RX_WRAP 0x00000002
 #define DESC_0_RX_OWNERSHIP 0x00000001
 
+#define R_DESC_1_RX_CSUM_SHIFT          22
+#define R_DESC_1_RX_CSUM_LENGTH         2
+#define DESC_1_RX_CSUM_IP_TCP           2
+#define DESC_1_RX_CSUM_IP_UDP           3
 #define R_DESC_1_RX_SAR_SHIFT           25
 #define R_DESC_1_RX_SAR_LENGTH          2
 #define R_DESC_1_RX_SAR_MATCH           (1 << 27)
@@ -307,6 +328,30 @@
 #define DESC_1_RX_SOF 0x00004000
 #define DESC_1_RX_EOF 0x00008000
 
+/* Interrupt moderation counts in steps of 800ns.  */
+#define GEM_INTMOD_RX_SHIFT 0
+#define GEM_INTMOD_TX_SHIFT 16
+#define GEM_INTMOD_NS 800
+
+/* Largest frame, jumbo or not, that is gathered for transmission.  */
+#define GEM_TX_MAX_FRAME 0x10000
+/* Most pieces a TX frame is handed to QEMU in.  */
+#define GEM_TX_MAX_FRAGS 64
+/* Room for the L2 to L4 headers of a TX frame.  */
+#define GEM_TX_HDR_SIZE 128
+
+/* A TX frame gathered from its descriptors.  */
+typedef struct GemTxFrame {
+    struct iovec iov[GEM_TX_MAX_FRAGS];
+    bool mapped[GEM_TX_MAX_FRAGS];
+    int niov;
+    uint32_t bounced;
+    uint32_t size;
+    /* Large send offload requested by the descriptors, if any */
+    uint8_t lso;
+    uint16_t mss;
+} GemTxFrame;
+
 #define GEM_MODID_VALUE 0x00020118
 
 static inline uint64_t tx_desc_get_buffer(CadenceGEMState *s, uint32_t *desc)
@@ -431,6 +476,12 @@ static inline void rx_desc_set_multicast_hash(uint32_t *desc)
     desc[1] |= R_DESC_1_RX_MULTICAST_HASH;
 }
 
+static inline void rx_desc_set_csum(uint32_t *desc, unsigned csum)
+{
+    desc[1] = deposit32(desc[1], R_DESC_1_RX_CSUM_SHIFT,
+                        R_DESC_1_RX_CSUM_LENGTH, csum);
+}
+
 static inline void rx_desc_set_sar(uint32_t *desc, int sar_idx)
 {
     desc[1] = deposit32(desc[1], R_DESC_1_RX_SAR_SHIFT, R_DESC_1_RX_SAR_LENGTH,
@@ -458,6 +509,7 @@ static void gem_init_register_masks(CadenceGEMState *s)
     s->regs_ro[GEM_RXQBASE]  = 0x00000003;
     s->regs_ro[GEM_TXQBASE]  = 0x00000003;
     s->regs_ro[GEM_RXSTATUS] = 0xFFFFFFF0;
+    s->regs_ro[GEM_INTMOD]   = 0xFF00FF00;
     s->regs_ro[GEM_ISR]      = 0xFFFFFFFF;
     s->regs_ro[GEM_IMR]      = 0xFFFFFFFF;
     s->regs_ro[GEM_MODID]    = 0xFFFFFFFF;
@@ -871,16 +923,162 @@ static hwaddr gem_get_rx_desc_addr(CadenceGEMState *s, int q)
     return gem_get_desc_addr(s, false, q);
 }
 
-static void gem_get_rx_desc(CadenceGEMState *s, int q)
+/*
+ * gem_int_moderate:
+ * Delay in ns the moderation register asks for on completions of one
+ * direction, 0 when they're not moderated.
+ */
+static int64_t gem_int_moderate(CadenceGEMState *s, int shift)
 {
-    hwaddr desc_addr = gem_get_rx_desc_addr(s, q);
+    return extract32(s->regs[GEM_INTMOD], shift, 8) * GEM_INTMOD_NS;
+}
+
+static void gem_rx_raise(CadenceGEMState *s)
+{
+    int q;
+
+    for (q = 0; q < s->num_priority_queues; q++) {
+        if (!(s->rx_cmpl_pending & (1 << q))) {
+            continue;
+        }
+        if (q == 0) {
+            s->regs[GEM_ISR] |= GEM_INT_RXCMPL & ~(s->regs[GEM_IMR]);
+        } else {
+            s->regs[GEM_INT_Q1_STATUS + q - 1] |= GEM_INT_RXCMPL &
+                                          ~(s->regs[GEM_INT_Q1_MASK + q - 1]);
+        }
+    }
+    s->rx_cmpl_pending = 0;
+    /* Handle interrupt consequences */
+    gem_update_int_status(s);
+}
 
-    DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", desc_addr);
+static void gem_tx_raise(CadenceGEMState *s)
+{
+    int q;
 
-    /* read current descriptor */
-    address_space_read(&s->dma_as, desc_addr, *s->attr,
-                     (uint8_t *)s->rx_desc[q],
-                     sizeof(uint32_t) * gem_get_desc_len(s, true));
+    for (q = 0; q < s->num_priority_queues; q++) {
+        if (!(s->tx_cmpl_pending & (1 << q))) {
+            continue;
+        }
+        if (q == 0) {
+            s->regs[GEM_ISR] |= GEM_INT_TXCMPL & ~(s->regs[GEM_IMR]);
+        } else {
+            s->regs[GEM_INT_Q1_STATUS + q - 1] |=
+                    GEM_INT_TXCMPL & ~s->regs[GEM_INT_Q1_MASK + q - 1];
+        }
+    }
+    s->tx_cmpl_pending = 0;
+    /* Handle interrupt consequences */
+    gem_update_int_status(s);
+}
+
+static void gem_rx_mod_expire(void *opaque)
+{
+    gem_rx_raise(opaque);
+}
+
+static void gem_tx_mod_expire(void *opaque)
+{
+    gem_tx_raise(opaque);
+}
+
+/*
+ * gem_tx_complete:
+ * Signal a frame sent on queue q, subject to interrupt moderation.
+ */
+static void gem_tx_complete(CadenceGEMState *s, int q)
+{
+    int64_t delay = gem_int_moderate(s, GEM_INTMOD_TX_SHIFT);
+
+    s->regs[GEM_TXSTATUS] |= GEM_TXSTATUS_TXCMPL;
+    s->tx_cmpl_pending |= 1 << q;
+    if (!delay) {
+        gem_tx_raise(s);
+    } else if (!timer_pending(s->tx_mod_timer)) {
+        timer_mod(s->tx_mod_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay);
+    }
+}
+
+/*
+ * gem_rx_desc_writeback:
+ * Write the RX descriptors of queue q completed since the last call back
+ * to the ring in one go.
+ */
+static void gem_rx_desc_writeback(CadenceGEMState *s, int q)
+{
+    unsigned desc_len = gem_get_desc_len(s, true);
+    unsigned first = s->rx_wb_first[q];
+
+    if (!s->rx_wb_num[q]) {
+        return;
+    }
+
+    DB_PRINT("write back %d descriptors from 0x%" HWADDR_PRIx "\n",
+             s->rx_wb_num[q],
+             s->rx_cache_addr[q] + 4 * first * desc_len);
+    address_space_write(&s->dma_as,
+                        s->rx_cache_addr[q] + 4 * first * desc_len,
+                        *s->attr,
+                        (uint8_t *)&s->rx_desc_cache[q][first * desc_len],
+                        sizeof(uint32_t) * desc_len * s->rx_wb_num[q]);
+    s->rx_wb_num[q] = 0;
+}
+
+/* Drop the RX descriptors fetched ahead for queue q.  */
+static void gem_rx_desc_invalidate(CadenceGEMState *s, int q)
+{
+    gem_rx_desc_writeback(s, q);
+    s->rx_cache_num[q] = 0;
+    s->rx_cache_pos[q] = 0;
+}
+
+/*
+ * gem_rx_desc_fill:
+ * Fetch a window of RX descriptors for queue q, starting at the current
+ * one, and keep those owned by hardware up to the end of the ring.
+ */
+static void gem_rx_desc_fill(CadenceGEMState *s, int q)
+{
+    unsigned desc_len = gem_get_desc_len(s, true);
+    uint32_t *desc = s->rx_desc_cache[q];
+    int i;
+
+    gem_rx_desc_invalidate(s, q);
+
+    s->rx_cache_addr[q] = gem_get_rx_desc_addr(s, q);
+    DB_PRINT("read descriptors 0x%" HWADDR_PRIx "\n", s->rx_cache_addr[q]);
+    address_space_read(&s->dma_as, s->rx_cache_addr[q], *s->attr,
+                       (uint8_t *)desc,
+                       sizeof(uint32_t) * desc_len * GEM_RX_DESC_CACHE);
+
+    for (i = 0; i < GEM_RX_DESC_CACHE; i++, desc += desc_len) {
+        if (rx_desc_get_ownership(desc) == 1) {
+            break;
+        }
+        if (rx_desc_get_wrap(desc)) {
+            i++;
+            break;
+        }
+    }
+    s->rx_cache_num[q] = i;
+}
+
+static void gem_get_rx_desc(CadenceGEMState *s, int q)
+{
+    hwaddr desc_addr = gem_get_rx_desc_addr(s, q);
+    unsigned desc_len = gem_get_desc_len(s, true);
+    unsigned pos = s->rx_cache_pos[q];
+
+    /* read current descriptor, from the cache when it's there */
+    if (pos >= s->rx_cache_num[q] ||
+        desc_addr != s->rx_cache_addr[q] + 4 * pos * desc_len) {
+        gem_rx_desc_fill(s, q);
+        pos = 0;
+    }
+    memcpy(s->rx_desc[q], &s->rx_desc_cache[q][pos * desc_len],
+           sizeof(uint32_t) * desc_len);
 
     /* Descriptor owned by software ? */
     if (rx_desc_get_ownership(s->rx_desc[q]) == 1) {
@@ -899,10 +1097,97 @@ static void gem_get_rx_desc(CadenceGEMState *s, int q)
 }
 
 /*
- * gem_receive:
- * Fit a packet handed to us by QEMU into the receive descriptor ring.
+ * gem_put_rx_desc:
+ * Hand the current RX descriptor of queue q back. The write back is
+ * deferred to gem_rx_complete_bh() so that descriptors completed in a
+ * burst go out together.
  */
-static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
+static void gem_put_rx_desc(CadenceGEMState *s, int q)
+{
+    unsigned desc_len = gem_get_desc_len(s, true);
+    unsigned pos = s->rx_cache_pos[q];
+
+    if (pos >= s->rx_cache_num[q]) {
+        /* Not fetched through the cache (the ring moved under us).  */
+        address_space_write(&s->dma_as, gem_get_rx_desc_addr(s, q),
+                            *s->attr, (uint8_t *)s->rx_desc[q],
+                            sizeof(uint32_t) * desc_len);
+        return;
+    }
+
+    memcpy(&s->rx_desc_cache[q][pos * desc_len], s->rx_desc[q],
+           sizeof(uint32_t) * desc_len);
+    if (!s->rx_wb_num[q]) {
+        s->rx_wb_first[q] = pos;
+    }
+    s->rx_wb_num[q]++;
+    s->rx_cache_pos[q]++;
+    qemu_bh_schedule(s->rx_bh);
+}
+
+/*
+ * gem_rx_complete_bh:
+ * Write back RX descriptors, then raise or moderate the RX interrupts.
+ */
+static void gem_rx_complete_bh(void *opaque)
+{
+    CadenceGEMState *s = opaque;
+    int64_t delay = gem_int_moderate(s, GEM_INTMOD_RX_SHIFT);
+    int q;
+
+    for (q = 0; q < s->num_priority_queues; q++) {
+        gem_rx_desc_writeback(s, q);
+    }
+
+    if (!s->rx_cmpl_pending) {
+        return;
+    }
+    if (!delay) {
+        gem_rx_raise(s);
+    } else if (!timer_pending(s->rx_mod_timer)) {
+        timer_mod(s->rx_mod_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + delay);
+    }
+}
+
+static void gem_transmit(CadenceGEMState *s);
+
+/*
+ * gem_vm_state_change:
+ * Flush what is held back before the VM stops, so that neither guest
+ * memory nor the interrupt state is missing anything when it's saved.
+ */
+static void gem_vm_state_change(void *opaque, int running, RunState state)
+{
+    CadenceGEMState *s = opaque;
+    int q;
+
+    if (running) {
+        return;
+    }
+
+    qemu_bh_cancel(s->rx_bh);
+    timer_del(s->rx_mod_timer);
+    timer_del(s->tx_mod_timer);
+    /* Whatever the guest kicked off before the stop goes out now.  */
+    if (s->tx_kick) {
+        s->tx_kick = false;
+        gem_transmit(s);
+    }
+    for (q = 0; q < s->num_priority_queues; q++) {
+        gem_rx_desc_writeback(s, q);
+    }
+    gem_rx_raise(s);
+    gem_tx_raise(s);
+}
+
+/*
+ * gem_receive_frame:
+ * Fit a packet into the receive descriptor ring. csum is the checksum
+ * status to report in the descriptors.
+ */
+static ssize_t gem_receive_frame(NetClientState *nc, const uint8_t *buf,
+                                 size_t size, unsigned csum)
 {
     CadenceGEMState *s;
     unsigned   rxbufsize, bytes_to_copy;
@@ -994,8 +1279,6 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
     q = get_queue_from_screen(s, rxbuf_ptr, rxbufsize);
 
     while (bytes_to_copy) {
-        hwaddr desc_addr;
-
         /* Do nothing if receive is not enabled. */
         if (!gem_can_receive(nc)) {
             assert(!first_desc);
@@ -1042,12 +1325,12 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
         default: /* SAR */
             rx_desc_set_sar(s->rx_desc[q], maf);
         }
+        if (csum) {
+            rx_desc_set_csum(s->rx_desc[q], csum);
+        }
 
         /* Descriptor write-back.  */
-        desc_addr = gem_get_rx_desc_addr(s, q);
-        address_space_write(&s->dma_as, desc_addr, *s->attr,
-                         (uint8_t *)s->rx_desc[q],
-                         sizeof(uint32_t) * gem_get_desc_len(s, true));
+        gem_put_rx_desc(s, q);
 
         /* Next descriptor */
         if (rx_desc_get_wrap(s->rx_desc[q])) {
@@ -1065,18 +1348,98 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
     gem_receive_updatestats(s, buf, size);
 
     s->regs[GEM_RXSTATUS] |= GEM_RXSTATUS_FRMRCVD;
-    if (q == 0) {
-        s->regs[GEM_ISR] |= GEM_INT_RXCMPL & ~(s->regs[GEM_IMR]);
-    } else {
-        s->regs[GEM_INT_Q1_STATUS + q - 1] |= GEM_INT_RXCMPL &
-                                      ~(s->regs[GEM_INT_Q1_MASK + q - 1]);
-    }
-    /* Handle interrupt consequences */
-    gem_update_int_status(s);
+    /* Raised by gem_rx_complete_bh(), once the descriptors are back.  */
+    s->rx_cmpl_pending |= 1 << q;
+    qemu_bh_schedule(s->rx_bh);
 
     return size;
 }
 
+/*
+ * gem_rx_csum_status:
+ * The RX descriptor checksum status of a frame the host vouched for, if
+ * the guest asked for RX checksum offload.
+ */
+static unsigned gem_rx_csum_status(CadenceGEMState *s, const uint8_t *buf,
+                                   size_t size)
+{
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = size };
+    bool isip4, isip6, isudp, istcp;
+    size_t l3off, l4off, l5off;
+    eth_ip6_hdr_info ip6hdr_info;
+    eth_ip4_hdr_info ip4hdr_info;
+    eth_l4_hdr_info l4hdr_info;
+
+    if (!(s->regs[GEM_NWCFG] & GEM_NWCFG_RXCOEN)) {
+        return 0;
+    }
+
+    eth_get_protocols(&iov, 1, &isip4, &isip6, &isudp, &istcp,
+                      &l3off, &l4off, &l5off,
+                      &ip6hdr_info, &ip4hdr_info, &l4hdr_info);
+    if ((isip4 && ip4hdr_info.fragment) || (isip6 && ip6hdr_info.fragment)) {
+        return 0;
+    }
+    if (istcp) {
+        return DESC_1_RX_CSUM_IP_TCP;
+    } else if (isudp) {
+        return DESC_1_RX_CSUM_IP_UDP;
+    }
+    return 0;
+}
+
+/*
+ * gem_receive:
+ * Take a packet from QEMU. With a vnet header in front it may come with
+ * its checksum already checked, or still to be completed.
+ */
+static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
+{
+    CadenceGEMState *s = qemu_get_nic_opaque(nc);
+    struct virtio_net_hdr vhdr;
+    const uint8_t *frame = buf + sizeof(vhdr);
+    size_t frame_size = size - sizeof(vhdr);
+    uint8_t *copy = NULL;
+    unsigned csum = 0;
+    ssize_t ret;
+
+    /* Hold frames in the net queue while the wire is busy.  */
+    if (!net_shaper_ready(&s->rx_shaper)) {
+        return 0;
+    }
+    if (!s->vnet_hdr) {
+        net_shaper_account(&s->rx_shaper, size);
+        return gem_receive_frame(nc, buf, size, 0);
+    }
+    if (size < sizeof(vhdr)) {
+        return -1;
+    }
+    memcpy(&vhdr, buf, sizeof(vhdr));
+
+    if (vhdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+        size_t csum_off = vhdr.csum_start + vhdr.csum_offset;
+
+        /* The checksum field holds the pseudo header sum, finish it off.  */
+        if (vhdr.csum_start < frame_size &&
+            csum_off + sizeof(uint16_t) <= frame_size) {
+            copy = g_memdup(frame, frame_size);
+            stw_be_p(copy + csum_off,
+                     net_checksum_finish(
+                         net_checksum_add(frame_size - vhdr.csum_start,
+                                          copy + vhdr.csum_start)));
+            frame = copy;
+            csum = gem_rx_csum_status(s, frame, frame_size);
+        }
+    } else if (vhdr.flags & VIRTIO_NET_HDR_F_DATA_VALID) {
+        csum = gem_rx_csum_status(s, frame, frame_size);
+    }
+
+    net_shaper_account(&s->rx_shaper, frame_size);
+    ret = gem_receive_frame(nc, frame, frame_size, csum);
+    g_free(copy);
+    return ret < 0 ? ret : size;
+}
+
 /*
  * gem_transmit_updatestats:
  * Increment transmit statistics.
@@ -1124,161 +1487,398 @@ static void gem_transmit_updatestats(CadenceGEMState *s, const uint8_t *packet,
 }
 
 /*
- * gem_transmit:
- * Fish packets out of the descriptor ring and feed them to QEMU
+ * gem_tx_add_frag:
+ * Add len bytes at addr to the frame being gathered. Fragments are used
+ * straight from guest RAM where possible and copied to the bounce buffer
+ * otherwise; the last iovec is kept back for the bounce buffer so that a
+ * frame always fits.
  */
-static void gem_transmit(CadenceGEMState *s)
+static void gem_tx_add_frag(CadenceGEMState *s, GemTxFrame *f,
+                            hwaddr addr, unsigned len)
 {
-    uint32_t desc[DESC_MAX_NUM_WORDS];
-    hwaddr packet_desc_addr;
-    uint8_t     tx_packet[10240];
-    uint8_t     *p;
-    unsigned    total_bytes;
-    int q = 0;
+    while (len) {
+        hwaddr plen = len;
+        void *p = NULL;
 
-    /* Do nothing if transmit is not enabled. */
-    if (!(s->regs[GEM_NWCTRL] & GEM_NWCTRL_TXENA)) {
+        if (f->niov < GEM_TX_MAX_FRAGS - 1) {
+            p = address_space_map_ram(&s->dma_as, addr, &plen, false,
+                                      *s->attr);
+        }
+        if (p) {
+            f->iov[f->niov].iov_base = p;
+            f->iov[f->niov].iov_len = plen;
+            f->mapped[f->niov++] = true;
+        } else {
+            uint8_t *b = s->tx_bounce + f->bounced;
+
+            plen = len;
+            address_space_read(&s->dma_as, addr, *s->attr, b, plen);
+            /* Bounced data is appended, so it extends a bounced tail.  */
+            if (f->niov && !f->mapped[f->niov - 1]) {
+                f->iov[f->niov - 1].iov_len += plen;
+            } else {
+                f->iov[f->niov].iov_base = b;
+                f->iov[f->niov].iov_len = plen;
+                f->mapped[f->niov++] = false;
+            }
+            f->bounced += plen;
+        }
+        addr += plen;
+        len -= plen;
+        f->size += plen;
+    }
+}
+
+static void gem_tx_unmap(CadenceGEMState *s, GemTxFrame *f)
+{
+    int i;
+
+    for (i = 0; i < f->niov; i++) {
+        if (f->mapped[i]) {
+            address_space_unmap(&s->dma_as, f->iov[i].iov_base,
+                                f->iov[i].iov_len, false, f->iov[i].iov_len);
+        }
+    }
+    f->niov = 0;
+}
+
+/*
+ * gem_tx_checksum:
+ * Fill in the TCP/UDP checksum of the frame like net_checksum_calculate()
+ * but without writing to guest memory. The headers are patched in the
+ * copy held in hdr and sg is set up as hdr followed by the rest of the
+ * frame. With vhdr, the checksum and any segmentation are left to the
+ * peer: vhdr is filled in and only the pseudo header sum goes in.
+ * Returns the number of entries in sg, 0 if there is nothing to do.
+ */
+static int gem_tx_checksum(GemTxFrame *f, uint8_t *hdr, size_t hdr_len,
+                           struct iovec *sg, struct virtio_net_hdr *vhdr)
+{
+    bool isip4, isip6, isudp, istcp;
+    size_t l3off, l4off, l5off, csum_off, l4len;
+    eth_ip6_hdr_info ip6hdr_info;
+    eth_ip4_hdr_info ip4hdr_info;
+    eth_l4_hdr_info l4hdr_info;
+    uint32_t csum, cso;
+    int n;
+
+    eth_get_protocols(f->iov, f->niov, &isip4, &isip6, &isudp, &istcp,
+                      &l3off, &l4off, &l5off,
+                      &ip6hdr_info, &ip4hdr_info, &l4hdr_info);
+    if (!(istcp || isudp)) {
+        return 0;
+    }
+
+    if (isip4) {
+        if (ip4hdr_info.fragment) {
+            return 0;
+        }
+        /* As net_checksum_calculate(), only handle whole IP datagrams.  */
+        l4len = be16_to_cpu(ip4hdr_info.ip4_hdr.ip_len);
+        if (l3off + l4len > f->size) {
+            return 0;
+        }
+        l4len -= MIN(l4len, IP_HDR_GET_LEN(&ip4hdr_info.ip4_hdr));
+    } else if (isip6 && vhdr && !ip6hdr_info.fragment) {
+        /* IPv6 is only ever offloaded.  */
+        l4len = f->size - l4off;
+    } else {
+        return 0;
+    }
+
+    if (istcp) {
+        csum_off = l4off + offsetof(struct tcp_header, th_sum);
+        if (l4len < sizeof(struct tcp_header)) {
+            return 0;
+        }
+    } else {
+        csum_off = l4off + offsetof(struct udp_header, uh_sum);
+        if (l4len < sizeof(struct udp_header)) {
+            return 0;
+        }
+    }
+    if (csum_off + sizeof(uint16_t) > hdr_len) {
+        return 0;
+    }
+
+    sg[0].iov_base = hdr;
+    sg[0].iov_len = hdr_len;
+    n = 1 + iov_copy(sg + 1, GEM_TX_MAX_FRAGS, f->iov, f->niov,
+                     hdr_len, f->size - hdr_len);
+
+    stw_he_p(hdr + csum_off, 0);
+    if (isip4) {
+        csum = eth_calc_ip4_pseudo_hdr_csum(&ip4hdr_info.ip4_hdr, l4len, &cso);
+    } else {
+        csum = eth_calc_ip6_pseudo_hdr_csum(&ip6hdr_info.ip6_hdr, l4len,
+                                            ip6hdr_info.l4proto, &cso);
+    }
+
+    if (!vhdr) {
+        csum += net_checksum_add_iov(sg, n, l4off, l4len, cso);
+        stw_be_p(hdr + csum_off, net_checksum_finish(csum));
+        return n;
+    }
+
+    stw_be_p(hdr + csum_off, ~net_checksum_finish(csum));
+    vhdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    vhdr->csum_start = l4off;
+    vhdr->csum_offset = csum_off - l4off;
+    if (f->lso == DESC_1_TX_LSO_TSO && istcp && f->mss) {
+        vhdr->gso_type = isip4 ? VIRTIO_NET_HDR_GSO_TCPV4 :
+                                 VIRTIO_NET_HDR_GSO_TCPV6;
+        vhdr->hdr_len = l5off;
+        vhdr->gso_size = f->mss;
+    } else if (f->lso == DESC_1_TX_LSO_UFO && isudp && f->mss) {
+        vhdr->gso_type = VIRTIO_NET_HDR_GSO_UDP;
+        vhdr->hdr_len = l5off;
+        vhdr->gso_size = f->mss;
+    }
+    return n;
+}
+
+
+static void gem_tx_sent(NetClientState *nc, ssize_t len)
+{
+    CadenceGEMState *s = qemu_get_nic_opaque(nc);
+
+    s->tx_stalled = false;
+    gem_transmit(s);
+}
+
+/*
+ * gem_tx_send:
+ * Hand a gathered frame off to QEMU.
+ */
+static void gem_tx_send(CadenceGEMState *s, GemTxFrame *f)
+{
+    NetClientState *nc = qemu_get_queue(s->nic);
+    bool loop = s->phy_loop || (s->regs[GEM_NWCTRL] & GEM_NWCTRL_LOCALLOOP);
+    struct virtio_net_hdr vhdr = {
+        .flags = 0,
+        .gso_type = VIRTIO_NET_HDR_GSO_NONE,
+    };
+    bool offload = s->vnet_hdr && !loop;
+    struct iovec sg[GEM_TX_MAX_FRAGS + 2];
+    uint8_t hdr[GEM_TX_HDR_SIZE] = { 0 };
+    size_t hdr_len = iov_to_buf(f->iov, f->niov, 0, hdr, sizeof(hdr));
+    struct iovec *iov = sg + 1;
+    int niov = f->niov;
+
+    memcpy(iov, f->iov, sizeof(f->iov[0]) * f->niov);
+
+    /* Is checksum offload enabled? */
+    if (s->regs[GEM_DMACFG] & GEM_DMACFG_TXCSUM_OFFL) {
+        int n = gem_tx_checksum(f, hdr, hdr_len, sg + 1,
+                                offload ? &vhdr : NULL);
+
+        if (n) {
+            niov = n;
+        }
+    }
+
+    /* Update MAC statistics */
+    gem_transmit_updatestats(s, hdr, f->size);
+    net_shaper_account(&s->tx_shaper, f->size);
+
+    /* Send the packet somewhere */
+    if (loop) {
+        uint8_t *buf = g_malloc(f->size);
+
+        iov_to_buf(iov, niov, 0, buf, f->size);
+        gem_receive_frame(nc, buf, f->size, 0);
+        g_free(buf);
         return;
     }
 
-    DB_PRINT("\n");
+    if (s->vnet_hdr) {
+        /* The peer wants a vnet header on every frame.  */
+        sg[0].iov_base = &vhdr;
+        sg[0].iov_len = sizeof(vhdr);
+        iov = sg;
+        niov++;
+    }
+    if (!qemu_sendv_packet_async(nc, iov, niov, gem_tx_sent)) {
+        /* The peer queued its own copy of the frame, so the guest buffers
+         * can go, but don't pile up more until it drains.
+         */
+        s->tx_stalled = true;
+    }
+}
 
-    /* The packet we will hand off to QEMU.
-     * Packets scattered across multiple descriptors are gathered to this
-     * one contiguous buffer first.
-     */
-    p = tx_packet;
-    total_bytes = 0;
+static void gem_tx_set_used_status(CadenceGEMState *s, int q)
+{
+    s->regs[GEM_TXSTATUS] |= GEM_TXSTATUS_USED;
+    /* IRQ TXUSED is defined only for queue 0 */
+    if (q == 0) {
+        s->regs[GEM_ISR] |= GEM_INT_TXUSED & ~(s->regs[GEM_IMR]);
+    }
+    gem_update_int_status(s);
+}
 
-    for (q = s->num_priority_queues - 1; q >= 0; q--) {
+/*
+ * gem_transmit_frame:
+ * Send the frame at the head of TX queue q.
+ * Returns false when the queue has nothing (more) to send.
+ */
+static bool gem_transmit_frame(CadenceGEMState *s, int q)
+{
+    unsigned desc_len = gem_get_desc_len(s, false);
+    uint32_t desc[DESC_MAX_NUM_WORDS];
+    uint32_t desc_first[DESC_MAX_NUM_WORDS];
+    hwaddr desc_addr = gem_get_tx_desc_addr(s, q);
+    hwaddr packet_desc_addr = desc_addr;
+    GemTxFrame f;
+
+    f.niov = 0;
+    f.bounced = 0;
+    f.size = 0;
+    f.lso = 0;
+    f.mss = 0;
+
+    for (;;) {
         /* read current descriptor */
-        packet_desc_addr = gem_get_tx_desc_addr(s, q);
-
         DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
         address_space_read(&s->dma_as, packet_desc_addr, *s->attr,
-                         (uint8_t *)desc,
-                         sizeof(uint32_t) * gem_get_desc_len(s, false));
-        /* Handle all descriptors owned by hardware */
-        while (tx_desc_get_used(desc) == 0) {
+                           (uint8_t *)desc, sizeof(uint32_t) * desc_len);
+        if (tx_desc_get_used(desc)) {
+            gem_tx_set_used_status(s, q);
+            break;
+        }
+        print_gem_tx_desc(desc, q);
 
-            /* Do nothing if transmit is not enabled. */
-            if (!(s->regs[GEM_NWCTRL] & GEM_NWCTRL_TXENA)) {
-                return;
-            }
-            print_gem_tx_desc(desc, q);
+        /* The real hardware would eat this (and possibly crash).
+         * For QEMU let's lend a helping hand.
+         */
+        if ((tx_desc_get_buffer(s, desc) == 0) ||
+            (tx_desc_get_length(desc) == 0)) {
+            DB_PRINT("Invalid TX descriptor @ 0x%" HWADDR_PRIx "\n",
+                     packet_desc_addr);
+            break;
+        }
 
-            /* The real hardware would eat this (and possibly crash).
-             * For QEMU let's lend a helping hand.
-             */
-            if ((tx_desc_get_buffer(s, desc) == 0) ||
-                (tx_desc_get_length(desc) == 0)) {
-                DB_PRINT("Invalid TX descriptor @ 0x%" HWADDR_PRIx "\n",
-                         packet_desc_addr);
-                break;
-            }
+        if (tx_desc_get_length(desc) > GEM_TX_MAX_FRAME - f.size) {
+            DB_PRINT("TX descriptor @ 0x%" HWADDR_PRIx " \
+                     too large: size 0x%"PRIx32" space 0x%"PRIx32"\n",
+                     packet_desc_addr,
+                     tx_desc_get_length(desc),
+                     GEM_TX_MAX_FRAME - f.size);
+            break;
+        }
 
-            if (tx_desc_get_length(desc) > sizeof(tx_packet) -
-                                               (p - tx_packet)) {
-                DB_PRINT("TX descriptor @ 0x%" HWADDR_PRIx " \
-                         too large: size 0x%"PRIx32" space 0x%"PRIx64"\n",
-                         packet_desc_addr,
-                         tx_desc_get_length(desc),
-                         sizeof(tx_packet) - (p - tx_packet));
-                break;
-            }
+        if (packet_desc_addr == desc_addr) {
+            f.lso = extract32(desc[1], R_DESC_1_TX_LSO_SHIFT,
+                              R_DESC_1_TX_LSO_LENGTH);
+        } else if (f.lso && !f.mss) {
+            f.mss = extract32(desc[1], R_DESC_1_TX_MSS_SHIFT,
+                              R_DESC_1_TX_MSS_LENGTH);
+        }
 
-            /* Gather this fragment of the packet from "dma memory" to our
-             * contig buffer.
-             */
-            address_space_read(&s->dma_as, tx_desc_get_buffer(s, desc),
-                             *s->attr,
-                             p, tx_desc_get_length(desc));
-            p += tx_desc_get_length(desc);
-            total_bytes += tx_desc_get_length(desc);
-
-            /* Last descriptor for this packet; hand the whole thing off */
-            if (tx_desc_get_last(desc)) {
-                uint32_t desc_first[DESC_MAX_NUM_WORDS];
-                hwaddr desc_addr = gem_get_tx_desc_addr(s, q);
-
-                /* Modify the 1st descriptor of this packet to be owned by
-                 * the processor.
-                 */
-                address_space_read(&s->dma_as, desc_addr, *s->attr,
-                                (uint8_t *)desc_first, sizeof(desc_first));
-                tx_desc_set_used(desc_first);
-                address_space_write(&s->dma_as, desc_addr, *s->attr,
-                                 (uint8_t *)desc_first, sizeof(desc_first));
-                /* Advance the hardware current descriptor past this packet */
-                if (tx_desc_get_wrap(desc)) {
-                    s->tx_desc_addr[q] = gem_get_queue_base_addr(s,
-                                         true, q);
-                } else {
-                    s->tx_desc_addr[q] +=
-                                         4 * gem_get_desc_len(s, false);
-                }
-                DB_PRINT("TX descriptor next: 0x%08x\n", s->tx_desc_addr[q]);
-
-                s->regs[GEM_TXSTATUS] |= GEM_TXSTATUS_TXCMPL;
-                if (q == 0) {
-                    s->regs[GEM_ISR] |= GEM_INT_TXCMPL & ~(s->regs[GEM_IMR]);
-                } else {
-                /* Update queue interrupt status */
-                    s->regs[GEM_INT_Q1_STATUS + q - 1] |=
-                            GEM_INT_TXCMPL & ~s->regs[GEM_INT_Q1_MASK + q - 1];
-                }
-
-                /* Handle interrupt consequences */
-                gem_update_int_status(s);
-
-                /* Is checksum offload enabled? */
-                if (s->regs[GEM_DMACFG] & GEM_DMACFG_TXCSUM_OFFL) {
-                    net_checksum_calculate(tx_packet, total_bytes);
-                }
-
-                /* Update MAC statistics */
-                gem_transmit_updatestats(s, tx_packet, total_bytes);
-
-                /* Send the packet somewhere */
-                if (s->phy_loop || (s->regs[GEM_NWCTRL] &
-                                    GEM_NWCTRL_LOCALLOOP)) {
-                    gem_receive(qemu_get_queue(s->nic), tx_packet,
-                                total_bytes);
-                } else {
-                    qemu_send_packet(qemu_get_queue(s->nic), tx_packet,
-                                     total_bytes);
-                }
-
-                /* Prepare for next packet */
-                p = tx_packet;
-                total_bytes = 0;
-            }
+        gem_tx_add_frag(s, &f, tx_desc_get_buffer(s, desc),
+                        tx_desc_get_length(desc));
+
+        /* Last descriptor for this packet; hand the whole thing off */
+        if (tx_desc_get_last(desc)) {
+            gem_tx_send(s, &f);
+            /* Done with the guest buffers before giving them back.  */
+            gem_tx_unmap(s, &f);
 
-            /* read next descriptor */
+            /* Modify the 1st descriptor of this packet to be owned by
+             * the processor.
+             */
+            address_space_read(&s->dma_as, desc_addr, *s->attr,
+                               (uint8_t *)desc_first,
+                               sizeof(uint32_t) * desc_len);
+            tx_desc_set_used(desc_first);
+            address_space_write(&s->dma_as, desc_addr, *s->attr,
+                                (uint8_t *)desc_first,
+                                sizeof(uint32_t) * desc_len);
+            /* Advance the hardware current descriptor past this packet */
             if (tx_desc_get_wrap(desc)) {
-                tx_desc_set_last(desc);
                 s->tx_desc_addr[q] = gem_get_queue_base_addr(s, true, q);
-                packet_desc_addr = gem_get_tx_desc_addr(s, q);
             } else {
-                packet_desc_addr += 4 * gem_get_desc_len(s, false);
+                s->tx_desc_addr[q] = packet_desc_addr + 4 * desc_len;
             }
-            DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-            address_space_read(&s->dma_as, packet_desc_addr, *s->attr,
-                             (uint8_t *)desc,
-                             sizeof(uint32_t) * gem_get_desc_len(s, false));
+            DB_PRINT("TX descriptor next: 0x%08x\n", s->tx_desc_addr[q]);
+
+            gem_tx_complete(s, q);
+            return true;
         }
 
-        if (tx_desc_get_used(desc)) {
-            s->regs[GEM_TXSTATUS] |= GEM_TXSTATUS_USED;
-            /* IRQ TXUSED is defined only for queue 0 */
-            if (q == 0) {
-                s->regs[GEM_ISR] |= GEM_INT_TXUSED & ~(s->regs[GEM_IMR]);
+        /* next descriptor of this packet */
+        if (tx_desc_get_wrap(desc)) {
+            packet_desc_addr = deposit64(packet_desc_addr, 0, 32,
+                                         gem_get_queue_base_addr(s, true, q));
+        } else {
+            packet_desc_addr += 4 * desc_len;
+        }
+    }
+
+    /* Leave incomplete frames for the next go.  */
+    gem_tx_unmap(s, &f);
+    return false;
+}
+
+/*
+ * gem_transmit:
+ * Fish packets out of the descriptor rings and feed them to QEMU
+ */
+static void gem_transmit(CadenceGEMState *s)
+{
+    uint32_t pending = MAKE_64BIT_MASK(0, s->num_priority_queues);
+    int q;
+
+    DB_PRINT("\n");
+
+    /* Take a frame from each queue in turn, highest priority first, so a
+     * busy queue can't starve the others.
+     */
+    while (pending && !s->tx_stalled) {
+        for (q = s->num_priority_queues - 1; q >= 0 && !s->tx_stalled; q--) {
+            /* Do nothing if transmit is not enabled. */
+            if (!(s->regs[GEM_NWCTRL] & GEM_NWCTRL_TXENA)) {
+                return;
+            }
+            /* Picked up again by gem_tx_shaper_expire().  */
+            if (!net_shaper_ready(&s->tx_shaper)) {
+                return;
+            }
+            if ((pending & (1 << q)) && !gem_transmit_frame(s, q)) {
+                pending &= ~(1 << q);
             }
-            gem_update_int_status(s);
         }
     }
 }
 
+static void gem_rx_shaper_expire(void *opaque)
+{
+    CadenceGEMState *s = opaque;
+
+    qemu_flush_queued_packets(qemu_get_queue(s->nic));
+}
+
+static void gem_tx_shaper_expire(void *opaque)
+{
+    gem_transmit(opaque);
+}
+
+/*
+ * With an iothread set, TXSTART only kicks this bottom half in the
+ * iothread and the vCPU goes straight back to the guest. The BQL still
+ * guards all device and net layer state.
+ */
+static void gem_tx_bh(void *opaque)
+{
+    CadenceGEMState *s = opaque;
+
+    qemu_mutex_lock_iothread();
+    if (s->tx_kick) {
+        s->tx_kick = false;
+        gem_transmit(s);
+    }
+    qemu_mutex_unlock_iothread();
+}
+
 static void gem_phy_reset(CadenceGEMState *s)
 {
     memset(&s->phy_regs[0], 0, sizeof(s->phy_regs));
@@ -1327,6 +1927,10 @@ static void gem_reset(DeviceState *d)
     s->regs[GEM_DESCONF2] = 0x2ab12800;
     s->regs[GEM_DESCONF5] = 0x002f2045;
     s->regs[GEM_DESCONF6] = GEM_DESCONF6_64B_MASK;
+    if (s->vnet_hdr) {
+        /* Segmentation is only done by a peer that takes vnet headers.  */
+        s->regs[GEM_DESCONF6] |= GEM_DESCONF6_LSO_MASK;
+    }
     s->regs[GEM_INT_Q1_MASK] = 0x00000CE6;
 
     if (s->num_priority_queues > 1) {
@@ -1342,6 +1946,21 @@ static void gem_reset(DeviceState *d)
     for (i = 0; i < 4; i++) {
         s->sar_active[i] = false;
     }
+    s->tx_stalled = false;
+    s->tx_kick = false;
+    net_shaper_reset(&s->rx_shaper);
+    net_shaper_reset(&s->tx_shaper);
+
+    for (i = 0; i < s->num_priority_queues; i++) {
+        s->rx_cache_num[i] = 0;
+        s->rx_cache_pos[i] = 0;
+        s->rx_wb_num[i] = 0;
+    }
+    s->rx_cmpl_pending = 0;
+    s->tx_cmpl_pending = 0;
+    qemu_bh_cancel(s->rx_bh);
+    timer_del(s->rx_mod_timer);
+    timer_del(s->tx_mod_timer);
 
     if (s->mdio) {
         phy_update_link(s);
@@ -1493,11 +2112,17 @@ static void gem_write(void *opaque, hwaddr offset, uint64_t val,
     case GEM_NWCTRL:
         if (val & GEM_NWCTRL_RXENA) {
             for (i = 0; i < s->num_priority_queues; ++i) {
+                gem_rx_desc_invalidate(s, i);
                 gem_get_rx_desc(s, i);
             }
         }
         if (val & GEM_NWCTRL_TXSTART) {
-            gem_transmit(s);
+            if (s->tx_bh) {
+                s->tx_kick = true;
+                qemu_bh_schedule(s->tx_bh);
+            } else {
+                gem_transmit(s);
+            }
         }
         if (!(val & GEM_NWCTRL_TXENA)) {
             /* Reset to start of Q when transmit disabled. */
@@ -1514,9 +2139,11 @@ static void gem_write(void *opaque, hwaddr offset, uint64_t val,
         gem_update_int_status(s);
         break;
     case GEM_RXQBASE:
+        gem_rx_desc_invalidate(s, 0);
         s->rx_desc_addr[0] = val;
         break;
     case GEM_RECEIVE_Q1_PTR ... GEM_RECEIVE_Q7_PTR:
+        gem_rx_desc_invalidate(s, offset - GEM_RECEIVE_Q1_PTR + 1);
         s->rx_desc_addr[offset - GEM_RECEIVE_Q1_PTR + 1] = val;
         break;
     case GEM_TXQBASE:
@@ -1602,6 +2229,7 @@ static NetClientInfo net_gem_info = {
 static void gem_realize(DeviceState *dev, Error **errp)
 {
     CadenceGEMState *s = CADENCE_GEM(dev);
+    NetClientState *nc;
     int i;
 
     address_space_init(&s->dma_as,
@@ -1631,10 +2259,32 @@ static void gem_realize(DeviceState *dev, Error **errp)
                       object_new(TYPE_MEMORY_TRANSACTION_ATTR));
     }
 
+    s->tx_bounce = g_malloc(GEM_TX_MAX_FRAME);
+
+    s->rx_bh = qemu_bh_new(gem_rx_complete_bh, s);
+    s->rx_mod_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, gem_rx_mod_expire, s);
+    s->tx_mod_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, gem_tx_mod_expire, s);
+    if (s->iothread) {
+        s->tx_bh = aio_bh_new(iothread_get_aio_context(s->iothread),
+                              gem_tx_bh, s);
+    }
+    qemu_add_vm_change_state_handler(gem_vm_state_change, s);
+    net_shaper_init(&s->rx_shaper, s->link_speed, gem_rx_shaper_expire, s);
+    net_shaper_init(&s->tx_shaper, s->link_speed, gem_tx_shaper_expire, s);
+
     qemu_macaddr_default_if_unset(&s->conf.macaddr);
 
     s->nic = qemu_new_nic(&net_gem_info, &s->conf,
                           object_get_typename(OBJECT(dev)), dev->id, s);
+
+    nc = qemu_get_queue(s->nic);
+    if (qemu_has_vnet_hdr(nc->peer)) {
+        s->vnet_hdr = true;
+        qemu_set_vnet_hdr_len(nc->peer, sizeof(struct virtio_net_hdr));
+        qemu_using_vnet_hdr(nc->peer, true);
+        /* Frames with the checksum left to do are fine, we finish it.  */
+        qemu_set_offload(nc->peer, 1, 0, 0, 0, 0);
+    }
 }
 
 static void gem_init(Object *obj)
@@ -1666,10 +2316,26 @@ static void gem_init(Object *obj)
                              &error_abort);
 }
 
+static int gem_post_load(void *opaque, int version_id)
+{
+    CadenceGEMState *s = opaque;
+    int i;
+
+    /* The current RX descriptors aren't migrated, fetch them again.  */
+    if (s->regs[GEM_NWCTRL] & GEM_NWCTRL_RXENA) {
+        for (i = 0; i < s->num_priority_queues; i++) {
+            gem_rx_desc_invalidate(s, i);
+            gem_get_rx_desc(s, i);
+        }
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_cadence_gem = {
     .name = "cadence_gem",
     .version_id = 4,
     .minimum_version_id = 4,
+    .post_load = gem_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, CadenceGEMState, CADENCE_GEM_MAXREG),
         VMSTATE_UINT8(phy_loop, CadenceGEMState),
@@ -1692,6 +2358,9 @@ static Property gem_properties[] = {
                       num_type1_screeners, 4),
     DEFINE_PROP_UINT8("num-type2-screeners", CadenceGEMState,
                       num_type2_screeners, 4),
+    DEFINE_PROP_UINT32("link-speed", CadenceGEMState, link_speed, 0),
+    DEFINE_PROP_LINK("iothread", CadenceGEMState, iothread, TYPE_IOTHREAD,
+                     IOThread *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
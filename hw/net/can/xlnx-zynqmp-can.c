@@ -432,7 +432,8 @@ static bool tx_ready_check(XlnxZynqMPCAN *s)
 
 static void transfer_fifo(XlnxZynqMPCAN *s, Fifo *fifo)
 {
-    qemu_can_frame frame;
+    qemu_can_frame frames[MAILBOX_CAPACITY];
+    size_t nframes = 0;
     uint32_t data[CAN_FRAME_SIZE];
     int i;
     bool can_tx = tx_ready_check(s);
@@ -466,13 +467,15 @@ static void transfer_fifo(XlnxZynqMPCAN *s, Fifo *fifo)
                                       RXOK, 1);
                 }
             } else {
-                /* Normal mode Tx. */
-                generate_frame(&frame, data);
-
-                can_bus_client_send(&s->bus_client, &frame, 1);
+                /* Normal mode Tx, the whole FIFO goes out in one go. */
+                generate_frame(&frames[nframes++], data);
             }
         }
 
+        if (nframes) {
+            can_bus_client_send(&s->bus_client, frames, nframes);
+        }
+
         ARRAY_FIELD_DP32(s->regs, INTERRUPT_STATUS_REGISTER, TXOK, 1);
         ARRAY_FIELD_DP32(s->regs, STATUS_REGISTER, TXBFLL, 0);
 
@@ -600,57 +603,53 @@ static uint64_t can_tcr_pre_write(RegisterInfo  *reg, uint64_t val64)
     return 0;
 }
 
-static void update_rx_fifo(XlnxZynqMPCAN *s, const qemu_can_frame *frame)
+/*
+ * Precompute the enabled acceptance filters so that the receive path does
+ * not walk AFR, AFMR and AFIR for every frame. The mask and ID registers
+ * are only writable while their filter is disabled, so AFR writes are the
+ * only point where the set can change.
+ */
+static void can_update_rx_filters(XlnxZynqMPCAN *s)
 {
-    uint32_t filter_pass = 0;
-
-    /* If no filter is enabled. Message will be stored in FIFO. */
-    if (!((ARRAY_FIELD_EX32(s->regs, AFR, UAF1)) |
-       (ARRAY_FIELD_EX32(s->regs, AFR, UAF2)) |
-       (ARRAY_FIELD_EX32(s->regs, AFR, UAF3)) |
-       (ARRAY_FIELD_EX32(s->regs, AFR, UAF4)))) {
-        filter_pass = 1;
-    }
+    unsigned int i;
 
-    /*
-     * Messages that pass any of the acceptance filters will be stored in
-     * the RX FIFO.
-    */
-    if (ARRAY_FIELD_EX32(s->regs, AFR, UAF1)) {
-        uint32_t id_masked = s->regs[R_AFMR1] & frame->can_id;
-        uint32_t filter_id_masked = s->regs[R_AFMR1] & s->regs[R_AFIR1];
+    s->rx_filter_num = 0;
+    for (i = 0; i < ARRAY_SIZE(s->rx_filter_mask); i++) {
+        uint32_t mask = s->regs[R_AFMR1 + 2 * i];
 
-        if (filter_id_masked == id_masked) {
-            filter_pass = 1;
+        if (!(s->regs[R_AFR] & (1 << i))) {
+            continue;
         }
+        s->rx_filter_mask[s->rx_filter_num] = mask;
+        s->rx_filter_id[s->rx_filter_num] = mask & s->regs[R_AFIR1 + 2 * i];
+        s->rx_filter_num++;
     }
+}
 
-    if (ARRAY_FIELD_EX32(s->regs, AFR, UAF2)) {
-        uint32_t id_masked = s->regs[R_AFMR2] & frame->can_id;
-        uint32_t filter_id_masked = s->regs[R_AFMR2] & s->regs[R_AFIR2];
+static bool can_rx_filter_pass(XlnxZynqMPCAN *s, qemu_canid_t can_id)
+{
+    unsigned int i;
 
-        if (filter_id_masked == id_masked) {
-            filter_pass = 1;
-        }
+    /* If no filter is enabled, every message is stored in the FIFO. */
+    if (!s->rx_filter_num) {
+        return true;
     }
 
-    if (ARRAY_FIELD_EX32(s->regs, AFR, UAF3)) {
-        uint32_t id_masked = s->regs[R_AFMR3] & frame->can_id;
-        uint32_t filter_id_masked = s->regs[R_AFMR3] & s->regs[R_AFIR3];
-
-        if (filter_id_masked == id_masked) {
-            filter_pass = 1;
+    /*
+     * Messages that pass any of the acceptance filters will be stored in
+     * the RX FIFO.
+     */
+    for (i = 0; i < s->rx_filter_num; i++) {
+        if ((can_id & s->rx_filter_mask[i]) == s->rx_filter_id[i]) {
+            return true;
         }
     }
+    return false;
+}
 
-    if (ARRAY_FIELD_EX32(s->regs, AFR, UAF4)) {
-        uint32_t id_masked = s->regs[R_AFMR4] & frame->can_id;
-        uint32_t filter_id_masked = s->regs[R_AFMR4] & s->regs[R_AFIR4];
-
-        if (filter_id_masked == id_masked) {
-            filter_pass = 1;
-        }
-    }
+static void update_rx_fifo(XlnxZynqMPCAN *s, const qemu_can_frame *frame)
+{
+    bool filter_pass = can_rx_filter_pass(s, frame->can_id);
 
     /* Store the message in fifo if it passed through any of the filters. */
     if (filter_pass && frame->can_dlc <= MAX_DLC) {
@@ -700,9 +699,6 @@ static void update_rx_fifo(XlnxZynqMPCAN *s, const qemu_can_frame *frame)
 
             ARRAY_FIELD_DP32(s->regs, INTERRUPT_STATUS_REGISTER, RXOK, 1);
         }
-
-        can_update_irq(s);
-
     } else {
         DB_PRINT("Message didn't pass through any filter"
                   "or dlc is not in range\n");
@@ -740,6 +736,8 @@ static void can_filter_enable_post_write(RegisterInfo *reg, uint64_t val64)
     } else {
         ARRAY_FIELD_DP32(s->regs, STATUS_REGISTER, ACFBSY, 0);
     }
+
+    can_update_rx_filters(s);
 }
 
 static uint64_t can_filter_mask_pre_write(RegisterInfo *reg, uint64_t val64)
@@ -923,6 +921,7 @@ static void xlnx_zynqmp_can_reset(DeviceState *dev)
     for (i = 0; i < ARRAY_SIZE(s->reg_info); ++i) {
         register_reset(&s->reg_info[i]);
     }
+    can_update_rx_filters(s);
 }
 
 static int xlnx_zynqmp_can_can_receive(CanBusClientState *client)
@@ -944,7 +943,7 @@ static int xlnx_zynqmp_can_can_receive(CanBusClientState *client)
 static ssize_t xlnx_zynqmp_can_receive(CanBusClientState *client,
                                const qemu_can_frame *buf, size_t buf_size) {
     XlnxZynqMPCAN *s = container_of(client, XlnxZynqMPCAN, bus_client);
-    const qemu_can_frame *frame = buf;
+    size_t i;
 
     DB_PRINT("Incoming data for CAN%d\n", s->cfg.ctrl_idx);
 
@@ -962,16 +961,25 @@ static ssize_t xlnx_zynqmp_can_receive(CanBusClientState *client,
 
     } else if (ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SNOOP)) {
         /* Snoop Mode: Just keep the data. no response back. */
-        update_rx_fifo(s, frame);
+        for (i = 0; i < buf_size; i++) {
+            update_rx_fifo(s, &buf[i]);
+        }
+        can_update_irq(s);
     } else if ((ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SLEEP))) {
         /*
          * XlnxZynqMPCAN is in sleep mode. Any data on bus will bring it to wake
          * up state.
          */
         can_exit_sleep_mode(s);
-        update_rx_fifo(s, frame);
+        for (i = 0; i < buf_size; i++) {
+            update_rx_fifo(s, &buf[i]);
+        }
+        can_update_irq(s);
     } else if ((ARRAY_FIELD_EX32(s->regs, STATUS_REGISTER, SLEEP)) == 0) {
-        update_rx_fifo(s, frame);
+        for (i = 0; i < buf_size; i++) {
+            update_rx_fifo(s, &buf[i]);
+        }
+        can_update_irq(s);
     } else {
         DB_PRINT("Can't receive data as XlnxZynqMPCAN is not set correctly.\n");
     }
@@ -1052,10 +1060,19 @@ static void xlnx_zynqmp_can_init(Object *obj)
                              0, &error_abort);
 }
 
+static int xlnx_zynqmp_can_post_load(void *opaque, int version_id)
+{
+    XlnxZynqMPCAN *s = opaque;
+
+    can_update_rx_filters(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_can = {
     .name = TYPE_XLNX_ZYNQMP_CAN,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = xlnx_zynqmp_can_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_FIFO(rx_fifo, XlnxZynqMPCAN),
         VMSTATE_UINT32_ARRAY(regs, XlnxZynqMPCAN, XLNX_ZYNQMP_CAN_R_MAX),
@@ -28,6 +28,8 @@
 #include "qemu/log.h"
 #include "net/net.h"
 #include "net/checksum.h"
+#include "net/shaper.h"
+#include "qemu/iov.h"
 
 #include "hw/stream.h"
 
@@ -406,6 +408,10 @@ struct XilinxAXIEnet {
 
     /* Whether axienet_eth_rx_notify should flush incoming queue. */
     bool need_flush;
+
+    /* Wire speed in Mbit/s received frames are paced to, 0 for no limit */
+    uint32_t c_link_speed;
+    NetShaper rx_shaper;
 };
 
 static void axienet_rx_reset(XilinxAXIEnet *s)
@@ -444,6 +450,7 @@ static void xilinx_axienet_reset(DeviceState *d)
 
     axienet_rx_reset(s);
     axienet_tx_reset(s);
+    net_shaper_reset(&s->rx_shaper);
 
     s->regs[R_PPST] = PPST_LINKSTATUS | PPST_PHY_LINKSTATUS;
     s->regs[R_IS] = IS_AUTONEG | IS_RX_DCM_LOCK | IS_MGM_RDY | IS_PHY_RST_DONE;
@@ -720,7 +727,11 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     static const unsigned char sa_bcast[6] = {0xff, 0xff, 0xff,
                                               0xff, 0xff, 0xff};
     static const unsigned char sa_ipmcast[3] = {0x01, 0x00, 0x52};
+    static const uint8_t fcs[4];
     uint32_t app[CONTROL_PAYLOAD_WORDS] = {0};
+    struct iovec iov[2];
+    int iovcnt = 1;
+    size_t pushed = 0;
     int promisc = s->fmi & (1 << 31);
     int unicast, broadcast, multicast, ip_multicast = 0;
     uint32_t csum32;
@@ -733,6 +744,11 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
         s->need_flush = true;
         return 0;
     }
+    /* Hold frames in the net queue while the wire is busy.  */
+    if (!net_shaper_ready(&s->rx_shaper)) {
+        return 0;
+    }
+    net_shaper_account(&s->rx_shaper, size);
 
     unicast = ~buf[0] & 0x1;
     broadcast = memcmp(buf, sa_bcast, 6) == 0;
@@ -827,20 +843,25 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
         size = s->c_rxmem - 4;
     }
 
-    memcpy(s->rxmem, buf, size);
-    memset(s->rxmem + size, 0, 4); /* Clear the FCS.  */
-
-    if (s->rcw[1] & RCW1_FCS) {
-        size += 4; /* fcs is inband.  */
-    }
+    iov[0].iov_base = (void *)buf;
+    iov[0].iov_len = size;
 
     app[0] = 5 << 28;
-    csum32 = net_checksum_add(size - 14, (uint8_t *)s->rxmem + 14);
+    /* The cleared FCS doesn't add to the sum.  */
+    csum32 = net_checksum_add(size - 14, (uint8_t *)buf + 14);
     /* Fold it once.  */
     csum32 = (csum32 & 0xffff) + (csum32 >> 16);
     /* And twice to get rid of possible carries.  */
     csum16 = (csum32 & 0xffff) + (csum32 >> 16);
     app[3] = csum16;
+
+    if (s->rcw[1] & RCW1_FCS) {
+        /* fcs is inband, cleared.  */
+        iov[1].iov_base = (void *)fcs;
+        iov[1].iov_len = sizeof(fcs);
+        iovcnt++;
+        size += 4;
+    }
     app[4] = size & 0xffff;
 
     s->stats.rx_bytes += size;
@@ -856,8 +877,6 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     /* Good frame.  */
     app[2] |= 1 << 6;
 
-    s->rxsize = size;
-    s->rxpos = 0;
     for (i = 0; i < ARRAY_SIZE(app); ++i) {
         app[i] = cpu_to_le32(app[i]);
     }
@@ -865,6 +884,24 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     memcpy(s->rxapp, app, s->rxappsize);
     axienet_eth_rx_notify(s);
 
+    /* Hand the frame straight to the DMA, which writes it into the guest
+     * buffers of the S2MM descriptors it has fetched. Only what it can't
+     * take right now is kept in rxmem.
+     */
+    if (!s->rxappsize && stream_can_push(s->tx_data_dev,
+                                         axienet_eth_rx_notify, s)) {
+        pushed = stream_pushv(s->tx_data_dev, iov, iovcnt,
+                              STREAM_ATTR_EOP | STREAM_ATTR_READONLY);
+    }
+    if (pushed == size) {
+        s->regs[R_IS] |= IS_RX_COMPLETE;
+    } else {
+        iov_to_buf(iov, iovcnt, pushed, s->rxmem, size - pushed);
+        s->rxsize = size - pushed;
+        s->rxpos = 0;
+        axienet_eth_rx_notify(s);
+    }
+
     enet_update_irq(s);
     return size;
 }
@@ -890,13 +927,9 @@ xilinx_axienet_control_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
     return len;
 }
 
-static size_t
-xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
-                                uint32_t attr)
+/* Returns true if the frame must be silently dropped.  */
+static bool enet_tx_drop(XilinxAXIEnet *s, size_t size, uint32_t attr)
 {
-    XilinxAXIEnetStreamSlave *ds = XILINX_AXI_ENET_DATA_STREAM(obj);
-    XilinxAXIEnet *s = ds->enet;
-
     /* FIXME. buffer if not EOP. Or add a better scatter-gathering +
        zero copying flow to the stream if.  */
     if (!stream_attr_has_eop(attr)) {
@@ -905,50 +938,109 @@ xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
 
     /* TX enable ?  */
     if (!(s->tc & TC_TX)) {
-        return size;
+        return true;
     }
 
     /* Jumbo or vlan sizes ?  */
     if (!(s->tc & TC_JUM)) {
         if (size > 1518 && size <= 1522 && !(s->tc & TC_VLAN)) {
-            return size;
+            return true;
         }
     }
+    return false;
+}
+
+static void enet_tx_done(XilinxAXIEnet *s, size_t size)
+{
+    s->stats.tx_bytes += size;
+    s->regs[R_IS] |= IS_TX_COMPLETE;
+    enet_update_irq(s);
+}
+
+/* Frames made of several DMA buffers go out without being linearized.
+ * An inserted checksum is summed across the buffers and spliced in.
+ */
+static size_t
+xilinx_axienet_data_stream_pushv(StreamSlave *obj, const struct iovec *iov,
+                                 int iovcnt, uint32_t attr)
+{
+    XilinxAXIEnetStreamSlave *ds = XILINX_AXI_ENET_DATA_STREAM(obj);
+    XilinxAXIEnet *s = ds->enet;
+    size_t size = iov_size(iov, iovcnt);
+    struct iovec *sg = NULL;
+
+    if (enet_tx_drop(s, size, attr)) {
+        return size;
+    }
 
     if (s->hdr[0] & 1) {
         unsigned int start_off = s->hdr[1] >> 16;
         unsigned int write_off = s->hdr[1] & 0xffff;
         uint32_t tmp_csum;
         uint16_t csum;
+        uint8_t field[2];
+        int n;
+
+        if (start_off > size || write_off + sizeof(field) > size) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: checksum offsets %u/%u "
+                          "beyond the %zu byte frame\n", __func__,
+                          start_off, write_off, size);
+            goto send;
+        }
 
-        tmp_csum = net_checksum_add(size - start_off,
-                                    (uint8_t *)buf + start_off);
+        tmp_csum = net_checksum_add_iov(iov, iovcnt, start_off,
+                                        size - start_off, 0);
         /* Accumulate the seed.  */
         tmp_csum += s->hdr[2] & 0xffff;
 
         /* Fold the 32bit partial checksum.  */
         csum = net_checksum_finish(tmp_csum);
 
-        /* Writeback.  */
-        buf[write_off] = csum >> 8;
-        buf[write_off + 1] = csum & 0xff;
+        /* Writeback, into a frame put together around the field.  */
+        field[0] = csum >> 8;
+        field[1] = csum & 0xff;
+        sg = g_new(struct iovec, iovcnt + 2);
+        n = iov_copy(sg, iovcnt + 2, iov, iovcnt, 0, write_off);
+        sg[n].iov_base = field;
+        sg[n].iov_len = sizeof(field);
+        n++;
+        n += iov_copy(sg + n, iovcnt + 2 - n, iov, iovcnt,
+                      write_off + sizeof(field),
+                      size - write_off - sizeof(field));
+        iov = sg;
+        iovcnt = n;
     }
 
-    qemu_send_packet(qemu_get_queue(s->nic), buf, size);
-
-    s->stats.tx_bytes += size;
-    s->regs[R_IS] |= IS_TX_COMPLETE;
-    enet_update_irq(s);
+send:
+    qemu_sendv_packet(qemu_get_queue(s->nic), iov, iovcnt);
+    g_free(sg);
 
+    enet_tx_done(s, size);
     return size;
 }
 
+static size_t
+xilinx_axienet_data_stream_push(StreamSlave *obj, uint8_t *buf, size_t size,
+                                uint32_t attr)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+    return xilinx_axienet_data_stream_pushv(obj, &iov, 1, attr);
+}
+
 static NetClientInfo net_xilinx_enet_info = {
     .type = NET_CLIENT_DRIVER_NIC,
     .size = sizeof(NICState),
     .receive = eth_rx,
 };
 
+static void axienet_rx_shaper_expire(void *opaque)
+{
+    XilinxAXIEnet *s = XILINX_AXI_ENET(opaque);
+
+    qemu_flush_queued_packets(qemu_get_queue(s->nic));
+}
+
 static void xilinx_enet_realize(DeviceState *dev, Error **errp)
 {
     XilinxAXIEnet *s = XILINX_AXI_ENET(dev);
@@ -987,6 +1079,8 @@ static void xilinx_enet_realize(DeviceState *dev, Error **errp)
     s->TEMAC.parent = s;
 
     s->rxmem = g_malloc(s->c_rxmem);
+    net_shaper_init(&s->rx_shaper, s->c_link_speed, axienet_rx_shaper_expire,
+                    s);
     return;
 
 xilinx_enet_realize_fail:
@@ -1017,6 +1111,7 @@ static Property xilinx_enet_properties[] = {
     DEFINE_PROP_UINT32("phyaddr", XilinxAXIEnet, c_phyaddr, 7),
     DEFINE_PROP_UINT32("rxmem", XilinxAXIEnet, c_rxmem, 0x1000),
     DEFINE_PROP_UINT32("txmem", XilinxAXIEnet, c_txmem, 0x1000),
+    DEFINE_PROP_UINT32("link-speed", XilinxAXIEnet, c_link_speed, 0),
     DEFINE_NIC_PROPERTIES(XilinxAXIEnet, conf),
     DEFINE_PROP_LINK("axistream-connected", XilinxAXIEnet,
                      tx_data_dev, TYPE_STREAM_SLAVE, StreamSlave *),
@@ -1041,6 +1136,14 @@ static void xilinx_enet_stream_class_init(ObjectClass *klass, void *data)
     ssc->push = data;
 }
 
+static void xilinx_enet_data_stream_class_init(ObjectClass *klass, void *data)
+{
+    StreamSlaveClass *ssc = STREAM_SLAVE_CLASS(klass);
+
+    ssc->push = xilinx_axienet_data_stream_push;
+    ssc->pushv = xilinx_axienet_data_stream_pushv;
+}
+
 static const TypeInfo xilinx_enet_info = {
     .name          = TYPE_XILINX_AXI_ENET,
     .parent        = TYPE_SYS_BUS_DEVICE,
@@ -1053,8 +1156,7 @@ static const TypeInfo xilinx_enet_data_stream_info = {
     .name          = TYPE_XILINX_AXI_ENET_DATA_STREAM,
     .parent        = TYPE_OBJECT,
     .instance_size = sizeof(struct XilinxAXIEnetStreamSlave),
-    .class_init    = xilinx_enet_stream_class_init,
-    .class_data    = xilinx_axienet_data_stream_push,
+    .class_init    = xilinx_enet_data_stream_class_init,
     .interfaces = (InterfaceInfo[]) {
             { TYPE_STREAM_SLAVE },
             { }
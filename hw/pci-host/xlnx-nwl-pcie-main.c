@@ -728,13 +728,21 @@ static void axipcie_msi_write(void *opaque, hwaddr addr, uint64_t value,
 {
     AXIPCIE_MAIN *s = XILINX_AXIPCIE_MAIN(opaque);
     unsigned int irq = value & 63;
-
-    if (irq < 32) {
-        s->regs[R_MSGF_MSI_STATUS_LO] |= 1 << irq;
-    } else {
-        s->regs[R_MSGF_MSI_STATUS_HI] |= 1 << (irq - 32);
+    unsigned int hi = irq / 32;
+    uint32_t bit = 1U << (irq % 32);
+    uint32_t *status = &s->regs[hi ? R_MSGF_MSI_STATUS_HI
+                                   : R_MSGF_MSI_STATUS_LO];
+
+    /* Vectors latch until the guest clears them, nothing to do when the
+     * vector is already pending.  Otherwise only its half can change.
+     */
+    if (*status & bit) {
+        return;
+    }
+    *status |= bit;
+    if (s->regs[hi ? R_MSGF_MSI_MASK_HI : R_MSGF_MSI_MASK_LO] & bit) {
+        qemu_irq_raise(s->irq_msi[hi]);
     }
-    update_msi_irqs(s);
 }
 
 static const MemoryRegionOps axipcie_msi_ops = {
@@ -751,9 +759,12 @@ static IOMMUTLBEntry axipcie_translate(IOMMUMemoryRegion *mr, hwaddr addr,
                                        bool is_write, MemTxAttrs *attr)
 {
     AXIPCIE_MAIN *s = container_of(mr, AXIPCIE_MAIN, iommu_attr);
+    /* Ingress is untranslated, a single entry covers the whole space and
+     * stays valid for as long as the bridge exists.
+     */
     IOMMUTLBEntry ret = {
-        .iova = addr,
-        .translated_addr = addr,
+        .iova = 0,
+        .translated_addr = 0,
         .addr_mask = ~(hwaddr)0,
         .perm = IOMMU_RW,
         .target_as = s->dma_as,
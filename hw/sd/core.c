@@ -128,6 +128,40 @@ uint8_t sdbus_read_data(SDBus *sdbus)
     return value;
 }
 
+size_t sdbus_read_bulk(SDBus *sdbus, uint8_t *buf, size_t len)
+{
+    SDState *card = get_card(sdbus);
+    size_t ret = 0;
+
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->read_bulk) {
+            ret = sc->read_bulk(card, buf, len);
+        }
+    }
+    trace_sdbus_read_bulk(sdbus_name(sdbus), len, ret);
+
+    return ret;
+}
+
+size_t sdbus_write_bulk(SDBus *sdbus, const uint8_t *buf, size_t len)
+{
+    SDState *card = get_card(sdbus);
+    size_t ret = 0;
+
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->write_bulk) {
+            ret = sc->write_bulk(card, buf, len);
+        }
+    }
+    trace_sdbus_write_bulk(sdbus_name(sdbus), len, ret);
+
+    return ret;
+}
+
 bool sdbus_data_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
@@ -2177,6 +2177,186 @@ uint8_t sd_read_data(SDState *sd)
     return ret;
 }
 
+/* Whole blocks of CMD18 are read straight into buf, anything else goes
+ * through sd->data just like sd_read_data.
+ */
+size_t sd_read_bulk(SDState *sd, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+    int io_len;
+
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->state != sd_sendingdata_state ||
+        (sd->current_cmd != 17 && sd->current_cmd != 18)) {
+        return 0;
+    }
+
+    io_len = (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+    if (!io_len) {
+        return 0;
+    }
+
+    trace_sdcard_read_data(sd->proto_name,
+                           sd_acmd_name(sd->current_cmd),
+                           sd->current_cmd, len);
+    while (done < len && sd->state == sd_sendingdata_state &&
+           !(sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        size_t n;
+
+        if (sd->data_offset == 0) {
+            if (sd->current_cmd == 18) {
+                uint64_t nblk = (len - done) / io_len;
+
+                if (sd->data_start + io_len > sd->size) {
+                    sd->card_status |= ADDRESS_ERROR;
+                    break;
+                }
+                if (sd->multi_blk_cnt != 0) {
+                    nblk = MIN(nblk, sd->multi_blk_cnt);
+                }
+                nblk = MIN(nblk, (sd->size - sd->data_start) / io_len);
+                if (nblk) {
+                    n = nblk * io_len;
+                    trace_sdcard_read_block(sd->data_start, n);
+                    if (blk_pread(sd->blk, sd->data_start, buf + done,
+                                  n) < 0) {
+                        fprintf(stderr, "sd_blk_read: read error on host "
+                                "side\n");
+                    }
+                    sd->data_start += n;
+                    done += n;
+                    if (sd->multi_blk_cnt != 0) {
+                        sd->multi_blk_cnt -= nblk;
+                        if (sd->multi_blk_cnt == 0) {
+                            sd->state = sd_transfer_state;
+                        }
+                    }
+                    continue;
+                }
+            }
+            BLK_READ_BLOCK(sd->data_start, io_len);
+        }
+
+        n = MIN(len - done, io_len - sd->data_offset);
+        memcpy(buf + done, sd->data + sd->data_offset, n);
+        sd->data_offset += n;
+        done += n;
+
+        if (sd->data_offset >= io_len) {
+            if (sd->current_cmd == 17) {
+                sd->state = sd_transfer_state;
+                break;
+            }
+            sd->data_start += io_len;
+            sd->data_offset = 0;
+            if (sd->multi_blk_cnt != 0) {
+                if (--sd->multi_blk_cnt == 0) {
+                    /* Stop! */
+                    sd->state = sd_transfer_state;
+                }
+            }
+        }
+    }
+
+    /* sd_read_data returns zeroes once the data phase is over.  */
+    memset(buf + done, 0, len - done);
+    return len;
+}
+
+/* Whole blocks of CMD25 are written straight from buf, anything else
+ * goes through sd->data just like sd_write_data.
+ */
+size_t sd_write_bulk(SDState *sd, const uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->state != sd_receivingdata_state || !sd->blk_len ||
+        (sd->current_cmd != 24 && sd->current_cmd != 25)) {
+        return 0;
+    }
+
+    while (done < len && sd->state == sd_receivingdata_state &&
+           !(sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        size_t n;
+
+        if (sd->current_cmd == 25 && sd->data_offset == 0) {
+            uint64_t nblk = (len - done) / sd->blk_len;
+            uint64_t i;
+
+            /* Start of the block - let's check the address is valid */
+            if (sd->data_start + sd->blk_len > sd->size) {
+                sd->card_status |= ADDRESS_ERROR;
+                break;
+            }
+            if (sd_wp_addr(sd, sd->data_start)) {
+                sd->card_status |= WP_VIOLATION;
+                break;
+            }
+            if (sd->multi_blk_cnt != 0) {
+                nblk = MIN(nblk, sd->multi_blk_cnt);
+            }
+            nblk = MIN(nblk, (sd->size - sd->data_start) / sd->blk_len);
+            for (i = 1; i < nblk; i++) {
+                if (sd_wp_addr(sd, sd->data_start + i * sd->blk_len)) {
+                    break;
+                }
+            }
+            nblk = MIN(nblk, i);
+            if (nblk) {
+                n = nblk * sd->blk_len;
+                trace_sdcard_write_block(sd->data_start, n);
+                if (blk_pwrite(sd->blk, sd->data_start, buf + done,
+                               n, 0) < 0) {
+                    fprintf(stderr, "sd_blk_write: write error on host "
+                            "side\n");
+                }
+                sd->blk_written += nblk;
+                sd->data_start += n;
+                sd->csd[14] |= 0x40;
+                done += n;
+                if (sd->multi_blk_cnt != 0) {
+                    sd->multi_blk_cnt -= nblk;
+                    if (sd->multi_blk_cnt == 0) {
+                        sd->state = sd_transfer_state;
+                    }
+                }
+                continue;
+            }
+        }
+
+        n = MIN(len - done, sd->blk_len - sd->data_offset);
+        memcpy(sd->data + sd->data_offset, buf + done, n);
+        sd->data_offset += n;
+        done += n;
+
+        if (sd->data_offset >= sd->blk_len) {
+            /* TODO: Check CRC before committing */
+            sd->state = sd_programming_state;
+            BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
+            sd->blk_written++;
+            sd->csd[14] |= 0x40;
+            /* Bzzzzzzztt .... Operation complete.  */
+            if (sd->current_cmd == 24) {
+                sd->state = sd_transfer_state;
+                break;
+            }
+            sd->data_start += sd->blk_len;
+            sd->data_offset = 0;
+            sd->state = sd_receivingdata_state;
+            if (sd->multi_blk_cnt != 0) {
+                if (--sd->multi_blk_cnt == 0) {
+                    /* Stop! */
+                    sd->state = sd_transfer_state;
+                }
+            }
+        }
+    }
+
+    /* Like sd_write_data, drop whatever is left.  */
+    return len;
+}
+
 bool sd_data_ready(SDState *sd)
 {
     return sd->state == sd_sendingdata_state;
@@ -2264,6 +2444,8 @@ static void sd_class_init(ObjectClass *klass, void *data)
     sc->do_command = sd_do_command;
     sc->write_data = sd_write_data;
     sc->read_data = sd_read_data;
+    sc->read_bulk = sd_read_bulk;
+    sc->write_bulk = sd_write_bulk;
     sc->data_ready = sd_data_ready;
     sc->enable = sd_enable;
     sc->get_inserted = sd_get_inserted;
@@ -594,6 +594,55 @@ static void sdhci_write_dataport(SDHCIState *s, uint32_t value, unsigned size)
  * Single DMA data transfer
  */
 
+/* Move len bytes of whole blocks between the card and guest memory at
+ * addr, straight through a mapping of guest memory where possible.
+ * Returns false, with nothing transferred, if the card can't do bulk
+ * transfers for the current command.
+ */
+static bool sdhci_dma_bulk(SDHCIState *s, dma_addr_t addr, uint32_t len)
+{
+    bool read = s->trnmod & SDHC_TRNS_READ;
+    DMADirection dir = read ? DMA_DIRECTION_FROM_DEVICE
+                            : DMA_DIRECTION_TO_DEVICE;
+    bool first = true;
+
+    while (len) {
+        dma_addr_t l = len;
+        void *p = dma_memory_map(s->dma_as, addr, &l, dir);
+        uint8_t *buf = p;
+        size_t done;
+
+        if (!p) {
+            l = len;
+            buf = g_malloc(l);
+            if (!read) {
+                dma_memory_read(s->dma_as, addr, buf, l);
+            }
+        }
+
+        done = read ? sdbus_read_bulk(&s->sdbus, buf, l)
+                    : sdbus_write_bulk(&s->sdbus, buf, l);
+        if (p) {
+            dma_memory_unmap(s->dma_as, p, l, dir, done);
+        } else {
+            if (read && done) {
+                dma_memory_write(s->dma_as, addr, buf, done);
+            }
+            g_free(buf);
+        }
+
+        if (!done) {
+            /* The card only ever refuses a command as a whole.  */
+            assert(first);
+            return false;
+        }
+        first = false;
+        addr += done;
+        len -= done;
+    }
+    return true;
+}
+
 /* Multi block SDMA transfer */
 static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
 {
@@ -619,6 +668,23 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
         s->prnsts |= SDHC_DOING_READ | SDHC_DATA_INHIBIT |
                 SDHC_DAT_LINE_ACTIVE;
         while (s->blkcnt) {
+            if (s->data_count == 0 && block_size) {
+                unsigned int nblk = s->blkcnt;
+
+                if (page_aligned) {
+                    nblk = MIN(nblk, boundary_count / block_size);
+                }
+                if (nblk && sdhci_dma_bulk(s, s->sdmasysad,
+                                           nblk * block_size)) {
+                    s->sdmasysad += nblk * block_size;
+                    boundary_count -= nblk * block_size;
+                    s->blkcnt -= nblk;
+                    if (page_aligned && boundary_count == 0) {
+                        break;
+                    }
+                    continue;
+                }
+            }
             if (s->data_count == 0) {
                 for (n = 0; n < block_size; n++) {
                     s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
@@ -649,6 +715,23 @@ static void sdhci_sdma_transfer_multi_blocks(SDHCIState *s)
         s->prnsts |= SDHC_DOING_WRITE | SDHC_DATA_INHIBIT |
                 SDHC_DAT_LINE_ACTIVE;
         while (s->blkcnt) {
+            if (s->data_count == 0 && block_size) {
+                unsigned int nblk = s->blkcnt;
+
+                if (page_aligned) {
+                    nblk = MIN(nblk, boundary_count / block_size);
+                }
+                if (nblk && sdhci_dma_bulk(s, s->sdmasysad,
+                                           nblk * block_size)) {
+                    s->sdmasysad += nblk * block_size;
+                    boundary_count -= nblk * block_size;
+                    s->blkcnt -= nblk;
+                    if (page_aligned && boundary_count == 0) {
+                        break;
+                    }
+                    continue;
+                }
+            }
             begin = s->data_count;
             if (((boundary_count + begin) < block_size) && page_aligned) {
                 s->data_count = boundary_count + begin;
@@ -691,7 +774,9 @@ static void sdhci_sdma_transfer_single_block(SDHCIState *s)
     int n;
     uint32_t datacnt = s->blksize & BLOCK_SIZE_MASK;
 
-    if (s->trnmod & SDHC_TRNS_READ) {
+    if (sdhci_dma_bulk(s, s->sdmasysad, datacnt)) {
+        /* Done.  */
+    } else if (s->trnmod & SDHC_TRNS_READ) {
         for (n = 0; n < datacnt; n++) {
             s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
         }
@@ -760,6 +845,30 @@ static void get_adma_description(SDHCIState *s, ADMADescr *dscr)
     }
 }
 
+/* Transfer as many whole blocks of the descriptor as possible in bulk,
+ * advancing it and the block count. Returns false if nothing was done.
+ */
+static bool sdhci_adma_bulk(SDHCIState *s, ADMADescr *dscr,
+                            unsigned int *length)
+{
+    const uint16_t block_size = s->blksize & BLOCK_SIZE_MASK;
+    unsigned int nblk = block_size ? *length / block_size : 0;
+
+    if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
+        nblk = MIN(nblk, s->blkcnt);
+    }
+    if (!nblk || !sdhci_dma_bulk(s, dscr->addr, nblk * block_size)) {
+        return false;
+    }
+
+    dscr->addr += nblk * block_size;
+    *length -= nblk * block_size;
+    if (s->trnmod & SDHC_TRNS_BLK_CNT_EN) {
+        s->blkcnt -= nblk;
+    }
+    return true;
+}
+
 /* Advanced DMA data transfer */
 
 static void sdhci_do_adma(SDHCIState *s)
@@ -797,6 +906,14 @@ static void sdhci_do_adma(SDHCIState *s)
 
             if (s->trnmod & SDHC_TRNS_READ) {
                 while (length) {
+                    if (s->data_count == 0 &&
+                        sdhci_adma_bulk(s, &dscr, &length)) {
+                        if ((s->trnmod & SDHC_TRNS_BLK_CNT_EN) &&
+                            s->blkcnt == 0) {
+                            break;
+                        }
+                        continue;
+                    }
                     if (s->data_count == 0) {
                         for (n = 0; n < block_size; n++) {
                             s->fifo_buffer[n] = sdbus_read_data(&s->sdbus);
@@ -826,6 +943,14 @@ static void sdhci_do_adma(SDHCIState *s)
                 }
             } else {
                 while (length) {
+                    if (s->data_count == 0 &&
+                        sdhci_adma_bulk(s, &dscr, &length)) {
+                        if ((s->trnmod & SDHC_TRNS_BLK_CNT_EN) &&
+                            s->blkcnt == 0) {
+                            break;
+                        }
+                        continue;
+                    }
                     begin = s->data_count;
                     if ((length + begin) < block_size) {
                         s->data_count = length + begin;
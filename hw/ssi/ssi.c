@@ -44,14 +44,21 @@ static void ssi_cs_default(void *opaque, int n, int level)
     s->cs = cs;
 }
 
+static bool ssi_slave_selected(SSISlave *dev)
+{
+    SSISlaveClass *ssc = SSI_SLAVE_GET_CLASS(dev);
+
+    return (dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
+           (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
+           ssc->cs_polarity == SSI_CS_NONE;
+}
+
 static uint32_t ssi_transfer_raw_default(SSISlave *dev, uint32_t val,
                                          int num_bits)
 {
     SSISlaveClass *ssc = SSI_SLAVE_GET_CLASS(dev);
 
-    if ((dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
-            (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
-            ssc->cs_polarity == SSI_CS_NONE) {
+    if (ssi_slave_selected(dev)) {
         if (ssc->transfer_bits) {
            return ssc->transfer_bits(dev, val, num_bits);
         } else if (ssc->transfer) {
@@ -179,6 +186,57 @@ uint32_t ssi_transfer(SSIBus *bus, uint32_t val)
     return ssi_transfer_bits(bus, val, 0);
 }
 
+/* The one slave listening on the bus, if it is hooked up the usual way.  */
+static SSISlave *ssi_bus_single_slave(SSIBus *bus)
+{
+    BusState *b = BUS(bus);
+    BusChild *kid;
+    SSISlave *target = NULL;
+
+    QTAILQ_FOREACH(kid, &b->children, sibling) {
+        SSISlave *slave = SSI_SLAVE(kid->child);
+        SSISlaveClass *ssc = SSI_SLAVE_GET_CLASS(slave);
+
+        /* Devices with custom CS handling see every transfer.  */
+        if (ssc->transfer_raw != ssi_transfer_raw_default) {
+            return NULL;
+        }
+        if (!ssi_slave_selected(slave)) {
+            continue;
+        }
+        if (target) {
+            return NULL;
+        }
+        target = slave;
+    }
+    return target;
+}
+
+size_t ssi_transfer_read(SSIBus *bus, uint8_t *buf, size_t len)
+{
+    SSISlave *slave = ssi_bus_single_slave(bus);
+    SSISlaveClass *ssc;
+
+    if (!slave) {
+        return 0;
+    }
+    ssc = SSI_SLAVE_GET_CLASS(slave);
+    return ssc->transfer_read ? ssc->transfer_read(slave, buf, len) : 0;
+}
+
+const uint8_t *ssi_map_read(SSIBus *bus, uint64_t *len,
+                            void (*changed)(void *opaque), void *opaque)
+{
+    SSISlave *slave = ssi_bus_single_slave(bus);
+    SSISlaveClass *ssc;
+
+    if (!slave) {
+        return NULL;
+    }
+    ssc = SSI_SLAVE_GET_CLASS(slave);
+    return ssc->map_read ? ssc->map_read(slave, len, changed, opaque) : NULL;
+}
+
 void ssi_set_datalines(SSIBus *bus, uint8_t val)
 {
     BusState *b = BUS(bus);
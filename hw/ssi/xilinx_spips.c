@@ -28,6 +28,7 @@
 #include "hw/ptimer.h"
 #include "qemu/log.h"
 #include "qemu/bitops.h"
+#include "qemu/stripe.h"
 #include "hw/ssi/xilinx_spips.h"
 #include "qapi/error.h"
 #include "hw/register.h"
@@ -411,34 +412,51 @@ static void xlnx_zynqmp_qspips_reset(DeviceState *d)
     xlnx_zynqmp_qspips_update_ixr(s);
 }
 
-/* N way (num) in place bit striper. Lay out row wise bits (MSB to LSB)
- * column wise (from element 0 to N-1). num is the length of x, and dir
- * reverses the direction of the transform. Best illustrated by example:
- * Each digit in the below array is a single bit (num == 3):
- *
- * {{ 76543210, }  ----- stripe (dir == false) -----> {{ 741gdaFC, }
- *  { hgfedcba, }                                      { 630fcHEB, }
- *  { HGFEDCBA, }} <---- upstripe (dir == true) -----  { 52hebGDA, }}
- */
+static void xlnx_zynqmp_qspips_align_fifos_g(XlnxZynqMPQSPIPS *s)
+{
+    for (; s->tx_fifo_g_align % 4; s->tx_fifo_g_align++) {
+        fifo8_pop(&s->tx_fifo_g);
+    }
+    for (; s->rx_fifo_g_align % 4; s->rx_fifo_g_align++) {
+        fifo8_push(&s->rx_fifo_g, 0);
+    }
+}
 
-static inline void stripe8(uint8_t *x, int num, bool dir)
+/* Receive-only data stages on a single bus don't need to be clocked
+ * byte by byte, ask the flash for as much as the RX FIFO can take.
+ * Returns false if the stage has to take the slow path.
+ */
+static bool xlnx_zynqmp_qspips_bulk_rx_g(XlnxZynqMPQSPIPS *s)
 {
-    uint8_t r[num];
-    memset(r, 0, sizeof(uint8_t) * num);
-    int idx[2] = {0, 0};
-    int bit[2] = {0, 7};
-    int d = dir;
-
-    for (idx[0] = 0; idx[0] < num; ++idx[0]) {
-        for (bit[0] = 7; bit[0] >= 0; bit[0]--) {
-            r[idx[!d]] |= x[idx[d]] & 1 << bit[d] ? 1 << bit[!d] : 0;
-            idx[1] = (idx[1] + 1) % num;
-            if (!idx[1]) {
-                bit[1]--;
-            }
-        }
+    uint8_t buf[RXFF_A_Q];
+    uint8_t busses;
+    size_t n;
+
+    if (!ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, DATA_XFER) ||
+        !ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, RECIEVE) ||
+        ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, TRANSMIT) ||
+        ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, STRIPE)) {
+        return false;
+    }
+    busses = ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, DATA_BUS_SELECT);
+    if (busses != 1 && busses != 2) {
+        return false;
+    }
+
+    n = MIN(s->regs[R_GQSPI_DATA_STS], fifo8_num_free(&s->rx_fifo_g));
+    n = ssi_transfer_read(XILINX_SPIPS(s)->spi[busses >> 1], buf,
+                          MIN(n, sizeof(buf)));
+    if (!n) {
+        return false;
     }
-    memcpy(x, r, sizeof(uint8_t) * num);
+    DB_PRINT_L(1, "bus %d bulk rx %zu bytes\n", busses >> 1, n);
+    fifo8_push_all(&s->rx_fifo_g, buf, n);
+    s->rx_fifo_g_align += n;
+    s->regs[R_GQSPI_DATA_STS] -= n;
+    if (!s->regs[R_GQSPI_DATA_STS]) {
+        xlnx_zynqmp_qspips_align_fifos_g(s);
+    }
+    return true;
 }
 
 static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
@@ -489,6 +507,9 @@ static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
             /* No space in RX fifo for transfer - try again later */
             return;
         }
+        if (xlnx_zynqmp_qspips_bulk_rx_g(s)) {
+            continue;
+        }
         if (ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, STRIPE) &&
             (ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, TRANSMIT) ||
              ARRAY_FIELD_EX32(s->regs, GQSPI_GF_SNAPSHOT, RECIEVE))) {
@@ -533,12 +554,7 @@ static void xlnx_zynqmp_qspips_flush_fifo_g(XlnxZynqMPQSPIPS *s)
             }
         }
         if (!s->regs[R_GQSPI_DATA_STS]) {
-            for (; s->tx_fifo_g_align % 4; s->tx_fifo_g_align++) {
-                fifo8_pop(&s->tx_fifo_g);
-            }
-            for (; s->rx_fifo_g_align % 4; s->rx_fifo_g_align++) {
-                fifo8_push(&s->rx_fifo_g, 0);
-            }
+            xlnx_zynqmp_qspips_align_fifos_g(s);
         }
     }
 }
@@ -624,7 +640,7 @@ static void xilinx_spips_flush_txfifo(XilinxSPIPS *s)
             for (i = 0; i < num_effective_busses(s); ++i) {
                 tx_rx[i] = fifo8_pop(&s->tx_fifo);
             }
-            stripe8(tx_rx, num_effective_busses(s), false);
+            stripe8(tx_rx, num_effective_busses(s), false, true);
         } else if ( s->snoop_state == SNOOP_NONE ||
                     s->snoop_state >= SNOOP_ADDR) {
             tx = fifo8_pop(&s->tx_fifo);
@@ -662,7 +678,7 @@ static void xilinx_spips_flush_txfifo(XilinxSPIPS *s)
             s->regs[R_INTR_STATUS] |= IXR_RX_FIFO_OVERFLOW;
             DB_PRINT_L(0, "rx FIFO overflow");
         } else if (s->snoop_state == SNOOP_STRIPING) {
-            stripe8(tx_rx, num_effective_busses(s), true);
+            stripe8(tx_rx, num_effective_busses(s), true, true);
             for (i = 0; i < num_effective_busses(s); ++i) {
                 fifo8_push(&s->rx_fifo, (uint8_t)tx_rx[i]);
                 DB_PRINT_L(debug_level, "pushing striped rx byte\n");
@@ -740,6 +756,45 @@ static void xilinx_spips_flush_txfifo(XilinxSPIPS *s)
     }
 }
 
+/* The data phase of a read in one go, where there is nothing left to
+ * snoop. In dual parallel mode both flashes are read and the halves are
+ * striped together. Returns how many bytes went into buf.
+ */
+static size_t xilinx_spips_bulk_read(XilinxSPIPS *s, uint8_t *buf, size_t len)
+{
+    int busses = num_effective_busses(s);
+    size_t n, n0, n1;
+    uint8_t *x;
+
+    if (busses > 2 || s->link_state_next_when ||
+        s->rx_discard || (s->regs[R_CMND] & R_CMND_RXFIFO_DRAIN) ||
+        (s->snoop_state != SNOOP_NONE && s->snoop_state != SNOOP_STRIPING)) {
+        return 0;
+    }
+    if (busses == 1) {
+        return ssi_transfer_read(s->spi[0], buf, len);
+    }
+    if (s->snoop_state != SNOOP_STRIPING) {
+        return 0;
+    }
+
+    n = len / 2;
+    x = g_malloc(2 * n);
+    /* Same lane order as xilinx_spips_flush_txfifo. Both flashes see the
+     * same commands, so either both or neither can do bulk reads.
+     */
+    n1 = ssi_transfer_read(s->spi[1], x, n);
+    n0 = n1 ? ssi_transfer_read(s->spi[0], x + n, n1) : 0;
+    if (n0 != n1) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: dual parallel flashes out of "
+                      "sync\n", object_get_canonical_path(OBJECT(s)));
+    }
+    n = MIN(n0, n1);
+    stripe2(buf, x, x + n1, n, true, true);
+    g_free(x);
+    return 2 * n;
+}
+
 static inline void tx_data_bytes(Fifo8 *fifo, uint32_t value, int num, bool be)
 {
     int i;
@@ -1046,6 +1101,21 @@ static void xilinx_qspips_invalidate_mmio_ptr(XilinxQSPIPS *q)
     q->lqspi_cached_addr = ~0ULL;
 }
 
+static void xilinx_qspips_invalidate_direct(void *opaque)
+{
+    XilinxQSPIPS *q = XILINX_QSPIPS(opaque);
+    XilinxSPIPS *s = &q->parent_obj;
+
+    if (q->direct_mmio_mapped) {
+        memory_region_invalidate_mmio_ptr(&s->mmlqspi, q->direct_addr,
+                                          q->direct_size);
+        q->direct_mmio_mapped = false;
+    }
+    q->direct_ptr = NULL;
+    q->direct_size = 0;
+    q->direct_failed = false;
+}
+
 static void xilinx_qspips_write(void *opaque, hwaddr addr,
                                 uint64_t value, unsigned size)
 {
@@ -1060,6 +1130,7 @@ static void xilinx_qspips_write(void *opaque, hwaddr addr,
     if (addr == R_LQSPI_CFG &&
                ((lqspi_cfg_old ^ value) & ~LQSPI_CFG_U_PAGE)) {
         q->lqspi_cached_addr = ~0ULL;
+        xilinx_qspips_invalidate_direct(q);
         if (q->lqspi_size) {
             uint32_t src = q->lqspi_src;
             uint32_t dst = q->lqspi_dst;
@@ -1165,6 +1236,59 @@ static const MemoryRegionOps xlnx_zynqmp_qspips_ops = {
 
 #define LQSPI_CACHE_SIZE 1024
 
+/* Select the flash holding flash_addr and clock out the configured read
+ * command, up to the data phase.
+ */
+static void lqspi_start_read(XilinxSPIPS *s, int flash_addr)
+{
+    int slave = flash_addr >> LQSPI_ADDRESS_BITS;
+    int i;
+
+    s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
+    s->regs[R_LQSPI_STS] |= slave ? LQSPI_CFG_U_PAGE : 0;
+
+    DB_PRINT_L(0, "config reg status: %08x\n", s->regs[R_LQSPI_CFG]);
+
+    fifo8_reset(&s->tx_fifo);
+    fifo8_reset(&s->rx_fifo);
+
+    /* instruction */
+    DB_PRINT_L(0, "pushing read instruction: %02x\n",
+               (unsigned)(uint8_t)(s->regs[R_LQSPI_CFG] &
+                                   LQSPI_CFG_INST_CODE));
+    fifo8_push(&s->tx_fifo, s->regs[R_LQSPI_CFG] & LQSPI_CFG_INST_CODE);
+    /* read address */
+    DB_PRINT_L(0, "pushing read address %06x\n", flash_addr);
+    if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_ADDR4) {
+        fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 24));
+    }
+    fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 16));
+    fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 8));
+    fifo8_push(&s->tx_fifo, (uint8_t)flash_addr);
+    /* mode bits */
+    if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_MODE_EN) {
+        fifo8_push(&s->tx_fifo, extract32(s->regs[R_LQSPI_CFG],
+                                          LQSPI_CFG_MODE_SHIFT,
+                                          LQSPI_CFG_MODE_WIDTH));
+    }
+    /* dummy bytes */
+    for (i = 0; i < (extract32(s->regs[R_LQSPI_CFG], LQSPI_CFG_DUMMY_SHIFT,
+                               LQSPI_CFG_DUMMY_WIDTH)); ++i) {
+        DB_PRINT_L(0, "pushing dummy byte\n");
+        fifo8_push(&s->tx_fifo, 0);
+    }
+    xilinx_spips_update_cs_lines(s);
+    xilinx_spips_flush_txfifo(s);
+    fifo8_reset(&s->rx_fifo);
+}
+
+static void lqspi_end_read(XilinxSPIPS *s, uint32_t u_page_save)
+{
+    s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
+    s->regs[R_LQSPI_STS] |= u_page_save;
+    xilinx_spips_update_cs_lines(s);
+}
+
 static void lqspi_load_cache(void *opaque, hwaddr addr)
 {
     XilinxQSPIPS *q = opaque;
@@ -1172,70 +1296,102 @@ static void lqspi_load_cache(void *opaque, hwaddr addr)
     int i;
     int flash_addr = ((addr & ~(LQSPI_CACHE_SIZE - 1))
                    / num_effective_busses(s));
-    int slave = flash_addr >> LQSPI_ADDRESS_BITS;
     int cache_entry = 0;
     uint32_t u_page_save = s->regs[R_LQSPI_STS] & ~LQSPI_CFG_U_PAGE;
 
     if (addr < q->lqspi_cached_addr ||
             addr > q->lqspi_cached_addr + LQSPI_CACHE_SIZE - 4) {
         xilinx_qspips_invalidate_mmio_ptr(q);
-        s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
-        s->regs[R_LQSPI_STS] |= slave ? LQSPI_CFG_U_PAGE : 0;
-
-        DB_PRINT_L(0, "config reg status: %08x\n", s->regs[R_LQSPI_CFG]);
-
-        fifo8_reset(&s->tx_fifo);
-        fifo8_reset(&s->rx_fifo);
-
-        /* instruction */
-        DB_PRINT_L(0, "pushing read instruction: %02x\n",
-                   (unsigned)(uint8_t)(s->regs[R_LQSPI_CFG] &
-                                       LQSPI_CFG_INST_CODE));
-        fifo8_push(&s->tx_fifo, s->regs[R_LQSPI_CFG] & LQSPI_CFG_INST_CODE);
-        /* read address */
-        DB_PRINT_L(0, "pushing read address %06x\n", flash_addr);
-        if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_ADDR4) {
-            fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 24));
-        }
-        fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 16));
-        fifo8_push(&s->tx_fifo, (uint8_t)(flash_addr >> 8));
-        fifo8_push(&s->tx_fifo, (uint8_t)flash_addr);
-        /* mode bits */
-        if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_MODE_EN) {
-            fifo8_push(&s->tx_fifo, extract32(s->regs[R_LQSPI_CFG],
-                                              LQSPI_CFG_MODE_SHIFT,
-                                              LQSPI_CFG_MODE_WIDTH));
-        }
-        /* dummy bytes */
-        for (i = 0; i < (extract32(s->regs[R_LQSPI_CFG], LQSPI_CFG_DUMMY_SHIFT,
-                                   LQSPI_CFG_DUMMY_WIDTH)); ++i) {
-            DB_PRINT_L(0, "pushing dummy byte\n");
-            fifo8_push(&s->tx_fifo, 0);
-        }
-        xilinx_spips_update_cs_lines(s);
-        xilinx_spips_flush_txfifo(s);
-        fifo8_reset(&s->rx_fifo);
+        lqspi_start_read(s, flash_addr);
 
         DB_PRINT_L(0, "starting QSPI data read\n");
 
+        cache_entry = xilinx_spips_bulk_read(s, q->lqspi_buf,
+                                             LQSPI_CACHE_SIZE);
         while (cache_entry < LQSPI_CACHE_SIZE) {
-            for (i = 0; i < 64; ++i) {
+            int n = MIN(64, LQSPI_CACHE_SIZE - cache_entry);
+
+            for (i = 0; i < n; ++i) {
                 tx_data_bytes(&s->tx_fifo, 0, 1, false);
             }
             xilinx_spips_flush_txfifo(s);
-            for (i = 0; i < 64; ++i) {
+            for (i = 0; i < n; ++i) {
                 rx_data_bytes(&s->rx_fifo, &q->lqspi_buf[cache_entry++], 1);
             }
         }
 
-        s->regs[R_LQSPI_STS] &= ~LQSPI_CFG_U_PAGE;
-        s->regs[R_LQSPI_STS] |= u_page_save;
-        xilinx_spips_update_cs_lines(s);
+        lqspi_end_read(s, u_page_save);
 
         q->lqspi_cached_addr = flash_addr * num_effective_busses(s);
     }
 }
 
+static bool lqspi_direct_hit(XilinxQSPIPS *q, hwaddr addr, unsigned size)
+{
+    return q->direct_ptr && addr >= q->direct_addr &&
+           addr + size <= q->direct_addr + q->direct_size;
+}
+
+/* Back the whole window of the flash holding addr with host memory: the
+ * flash storage itself on a single bus, or a de-striped copy of both
+ * flashes in dual parallel mode. Only possible once the flashes sit in
+ * the data phase of the configured read command.
+ */
+static bool lqspi_map_direct(XilinxQSPIPS *q, hwaddr addr)
+{
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+    int busses = num_effective_busses(s);
+    int flash_addr = (addr / busses) & ~((1 << LQSPI_ADDRESS_BITS) - 1);
+    uint32_t u_page_save = s->regs[R_LQSPI_STS] & ~LQSPI_CFG_U_PAGE;
+    const uint8_t *p[2] = { NULL, NULL };
+    uint64_t len = 1 << LQSPI_ADDRESS_BITS;
+    int i;
+
+    if (!q->direct_enabled || q->direct_failed || busses > ARRAY_SIZE(p)) {
+        return false;
+    }
+
+    xilinx_qspips_invalidate_direct(q);
+    lqspi_start_read(s, flash_addr);
+    for (i = 0; i < busses; ++i) {
+        uint64_t bus_len;
+
+        if (s->snoop_state != SNOOP_STRIPING &&
+            s->snoop_state != SNOOP_NONE) {
+            break;
+        }
+        p[i] = ssi_map_read(s->spi[i], &bus_len,
+                            xilinx_qspips_invalidate_direct, q);
+        if (!p[i]) {
+            break;
+        }
+        len = MIN(len, bus_len);
+    }
+    lqspi_end_read(s, u_page_save);
+    if (i < busses) {
+        /* Don't retry until something changes.  */
+        q->direct_failed = true;
+        return false;
+    }
+
+    if (busses == 1) {
+        q->direct_ptr = p[0];
+    } else {
+        if (!q->direct_shadow) {
+            /* Never resized, a stale mapping may still point at it.  */
+            q->direct_shadow = g_malloc(2 << LQSPI_ADDRESS_BITS);
+        }
+        /* Same lane order as xilinx_spips_flush_txfifo.  */
+        stripe2(q->direct_shadow, p[1], p[0], len, true, true);
+        q->direct_ptr = q->direct_shadow;
+    }
+    q->direct_addr = (hwaddr)flash_addr * busses;
+    q->direct_size = len * busses;
+    DB_PRINT_L(0, "direct window %" HWADDR_PRIx " + %" PRIx64 "\n",
+               q->direct_addr, q->direct_size);
+    return lqspi_direct_hit(q, addr, 1);
+}
+
 static void *lqspi_request_mmio_ptr(void *opaque, hwaddr addr, unsigned *size,
                                     unsigned *offset)
 {
@@ -1246,6 +1402,13 @@ static void *lqspi_request_mmio_ptr(void *opaque, hwaddr addr, unsigned *size,
         return NULL;
     }
 
+    if (lqspi_direct_hit(q, addr, 1) || lqspi_map_direct(q, addr)) {
+        q->direct_mmio_mapped = true;
+        *size = q->direct_size;
+        *offset = q->direct_addr;
+        return (void *)q->direct_ptr;
+    }
+
     offset_within_the_region = addr & ~(LQSPI_CACHE_SIZE - 1);
     lqspi_load_cache(opaque, offset_within_the_region);
     *size = LQSPI_CACHE_SIZE;
@@ -1259,6 +1422,11 @@ lqspi_read(void *opaque, hwaddr addr, unsigned int size)
     XilinxQSPIPS *q = opaque;
     uint32_t ret;
 
+    if (lqspi_direct_hit(q, addr, 4) ||
+        (lqspi_map_direct(q, addr) && lqspi_direct_hit(q, addr, 4))) {
+        return ldl_le_p(q->direct_ptr + addr - q->direct_addr);
+    }
+
     if (addr >= q->lqspi_cached_addr &&
             addr <= q->lqspi_cached_addr + LQSPI_CACHE_SIZE - 4) {
         uint8_t *retp = &q->lqspi_buf[addr - q->lqspi_cached_addr];
@@ -1453,6 +1621,10 @@ static Property xilinx_qspips_properties[] = {
      */
     DEFINE_PROP_BOOL("x-mmio-exec", XilinxQSPIPS, mmio_execution_enabled,
                      false),
+    /* Serve the linear window straight from the flash contents when the
+     * flashes allow it, and hand that out for mmio execution.
+     */
+    DEFINE_PROP_BOOL("lqspi-direct", XilinxQSPIPS, direct_enabled, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
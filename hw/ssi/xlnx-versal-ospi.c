@@ -33,6 +33,8 @@
 #include "qemu/bitops.h"
 #include "qemu/log.h"
 #include "qemu/fifo.h"
+#include "qapi/error.h"
+#include "migration/blocker.h"
 #include "hw/dma-ctrl.h"
 
 #include "hw/ssi/ssi.h"
@@ -421,6 +423,17 @@ typedef struct OSPI {
 
     /* Maximum inferred membank size is 512 bytes */
     uint8_t stig_membank[512];
+
+    /* DAC window mapped straight onto the flash contents.  */
+    bool direct_enabled;
+    bool direct_mmio_mapped;
+    bool direct_failed;
+    const uint8_t *direct_ptr;
+    hwaddr direct_addr;
+    uint64_t direct_size;
+
+    bool mmio_execution_enabled;
+    Error *migration_blocker;
 } OSPI;
 
 /* Type to avoid cpu endian byte swaps */
@@ -838,7 +851,18 @@ static void ospi_ind_read(OSPI *s, uint32_t flash_addr, uint32_t len)
 
     fifo_reset(&s->rx_fifo);
 
-    /* transmit second part (data) */
+    /* transmit second part (data), in bulk if the flash lets us */
+    while (len) {
+        uint8_t buf[256];
+        size_t n = ssi_transfer_read(s->spi, buf, MIN(len, sizeof(buf)));
+
+        if (!n) {
+            break;
+        }
+        fifo_push_all(&s->rx_sram, buf, n);
+        len -= n;
+    }
+
     for (i = 0; i < len; ++i) {
         fifo_push8(&s->tx_fifo, 0);
     }
@@ -888,15 +912,20 @@ static void ospi_ind_rd_completed(OSPI *s)
     }
 }
 
+/* Hand the DMA as many whole bursts as the SRAM holds in one request,
+ * it only asks for more once they are all done.
+ */
 static uint32_t get_ind_rd_dma_len(OSPI *s, IndOp *op)
 {
+    uint32_t used = fifo_num_used(&s->rx_sram);
+    uint32_t burst = ospi_dma_burst_size(s);
     uint32_t len = 0;
+
     if (DEP_AF_EX32(s->regs, CONFIG_REG, ENB_DMA_IF_FLD)) {
-        if (fifo_num_used(&s->rx_sram) <
-            ospi_dma_burst_size(s)) {
+        if (used < burst) {
             len = ospi_dma_single_size(s);
         } else {
-            len = ospi_dma_burst_size(s);
+            len = used - used % burst;
         }
     }
     return len;
@@ -929,6 +958,19 @@ static void ospi_dma_read(OSPI *s, bool start_dma)
     }
 }
 
+/* Every refill is a new read command on the flash. Wait for the SRAM to
+ * drain to half before refilling, rather than topping it up a word at a
+ * time after each AHB or DMA read.
+ */
+static bool ospi_ind_rd_refill(OSPI *s, IndOp *op)
+{
+    uint32_t free = fifo_num_free(&s->rx_sram);
+
+    return !ospi_ind_op_completed(op) && free &&
+           (free >= RXFF_SZ / 2 ||
+            free >= ind_op_end_byte(op) - ind_op_next_byte(op));
+}
+
 static void ospi_do_ind_read(OSPI *s)
 {
     IndOp *op = s->rd_ind_op;
@@ -938,8 +980,7 @@ static void ospi_do_ind_read(OSPI *s)
     bool start_dma = IS_IND_DMA_START(op);
 
     /* Continue to read flash until we run out of space in sram */
-    while (!ospi_ind_op_completed(op) &&
-           !fifo_is_full(&s->rx_sram)) {
+    while (ospi_ind_rd_refill(s, op)) {
         /* Read reqested number of bytes, max bytes limited to size of sram */
         next_b = ind_op_next_byte(op);
         end_b = next_b + fifo_num_free(&s->rx_sram);
@@ -979,10 +1020,11 @@ static void ospi_notify(void *opaque)
     OSPI *s = XILINX_OSPI(opaque);
 
     s->src_dma_inprog = false;
-    ospi_dma_read(s, false);
+    /* Refill first, so that the next request can be a large one.  */
     if (!ospi_ind_op_completed(s->rd_ind_op)) {
         ospi_do_ind_read(s);
     }
+    ospi_dma_read(s, false);
 }
 
 /* Transmit write enable instruction */
@@ -1241,12 +1283,91 @@ static void ospi_tx_sram_write(OSPI *s, uint64_t value, unsigned int size)
     }
 }
 
+static void ospi_invalidate_direct(void *opaque)
+{
+    OSPI *s = XILINX_OSPI(opaque);
+
+    if (s->direct_mmio_mapped) {
+        memory_region_invalidate_mmio_ptr(&s->iomem_dac, s->direct_addr,
+                                          s->direct_size);
+        s->direct_mmio_mapped = false;
+    }
+    s->direct_ptr = NULL;
+    s->direct_size = 0;
+    s->direct_failed = false;
+}
+
+static bool ospi_direct_hit(OSPI *s, hwaddr addr, unsigned int size)
+{
+    return s->direct_ptr && addr >= s->direct_addr &&
+           addr + size <= s->direct_addr + s->direct_size;
+}
+
+/* Back the window of the flash holding addr with its storage. Only done
+ * when reads of the DAC window plainly go to the flash, and the flash
+ * sits in the data phase of the configured read command.
+ */
+static bool ospi_map_direct(OSPI *s, hwaddr addr)
+{
+    uint64_t base = 0;
+    uint64_t win = memory_region_size(&s->iomem_dac);
+    uint64_t len;
+    const uint8_t *p;
+
+    if (!s->direct_enabled || s->direct_failed ||
+        !DEP_AF_EX32(s->regs, CONFIG_REG, ENB_SPI_FLD) ||
+        !DEP_AF_EX32(s->regs, CONFIG_REG, ENB_DIR_ACC_CTLR_FLD) ||
+        DEP_AF_EX32(s->regs, CONFIG_REG, ENB_AHB_ADDR_REMAP_FLD) ||
+        !s->dac_enable || s->dac_with_indac) {
+        return false;
+    }
+
+    if (DEP_AF_EX32(s->regs, CONFIG_REG, ENABLE_AHB_DECODER_FLD)) {
+        int cs = ospi_ahb_decoder_cs(s, addr);
+        int i;
+
+        if (cs < 0) {
+            return false;
+        }
+        for (i = 0; i < cs; i++) {
+            base += flash_sz(s, i);
+        }
+        win = flash_sz(s, cs);
+    }
+
+    ospi_invalidate_direct(s);
+    ospi_tx_fifo_push_rd_op_addr(s, base);
+    ospi_dac_cs(s, base);
+    ospi_flush_txfifo(s);
+    p = ssi_map_read(s->spi, &len, ospi_invalidate_direct, s);
+    ospi_disable_cs(s);
+    fifo_reset(&s->rx_fifo);
+
+    if (!p) {
+        /* Don't retry until something changes.  */
+        s->direct_failed = true;
+        return false;
+    }
+    s->direct_ptr = p;
+    s->direct_addr = base;
+    s->direct_size = MIN(len, win);
+    DPRINTF("direct window %" HWADDR_PRIx " + %" PRIx64 "\n",
+            s->direct_addr, s->direct_size);
+    return ospi_direct_hit(s, addr, 1);
+}
+
 static uint64_t ospi_do_dac_read(void *opaque, hwaddr addr, unsigned int size)
 {
     OSPI *s = XILINX_OSPI(opaque);
     OSPIRdData ret = {};
     int i;
 
+    if (ospi_direct_hit(s, addr, size) ||
+        (ospi_map_direct(s, addr) && ospi_direct_hit(s, addr, size))) {
+        memcpy(ret.u8, s->direct_ptr + addr - s->direct_addr, size);
+        return ret.u64;
+    }
+
     /* Create first section of read cmd */
     ospi_tx_fifo_push_rd_op_addr(s, (uint32_t) addr);
 
@@ -1486,6 +1607,7 @@ static void ospi_reset(DeviceState *dev)
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         dep_register_reset(&s->regs_info[i]);
     }
+    ospi_invalidate_direct(s);
 
     fifo_create8(&s->rx_fifo, RXFF_SZ);
     fifo_create8(&s->tx_fifo, TXFF_SZ);
@@ -1665,11 +1787,27 @@ static uint64_t ospi_read(void *opaque, hwaddr addr, unsigned int size)
     return dep_register_read(r);
 }
 
+/* Registers that change where DAC reads end up.  */
+static bool ospi_dac_config_reg(hwaddr addr)
+{
+    switch (addr) {
+    case A_CONFIG_REG:
+    case A_DEV_INSTR_RD_CONFIG_REG:
+    case A_DEV_SIZE_CONFIG_REG:
+    case A_REMAP_ADDR_REG:
+    case A_MODE_BIT_CONFIG_REG:
+        return true;
+    default:
+        return false;
+    }
+}
+
 static void ospi_write(void *opaque, hwaddr addr, uint64_t value,
         unsigned int size)
 {
     OSPI *s = XILINX_OSPI(opaque);
     DepRegisterInfo *r = &s->regs_info[addr / 4];
+    uint32_t old;
 
     if (!r->data) {
         qemu_log("%s: Decode error: write to %" HWADDR_PRIx "=%" PRIx64 "\n",
@@ -1677,7 +1815,11 @@ static void ospi_write(void *opaque, hwaddr addr, uint64_t value,
                 addr, value);
         return;
     }
+    old = s->regs[addr / 4];
     dep_register_write(r, value, ~0);
+    if (ospi_dac_config_reg(addr) && old != s->regs[addr / 4]) {
+        ospi_invalidate_direct(s);
+    }
     ospi_update_irq_line(s);
 }
 
@@ -1804,9 +1946,26 @@ static void ospi_dac_write(void *opaque, hwaddr addr, uint64_t value,
     }
 }
 
+static void *ospi_dac_request_ptr(void *opaque, hwaddr addr, unsigned *size,
+                                  unsigned *offset)
+{
+    OSPI *s = XILINX_OSPI(opaque);
+
+    if (!s->mmio_execution_enabled ||
+        !(ospi_direct_hit(s, addr, 1) || ospi_map_direct(s, addr))) {
+        return NULL;
+    }
+
+    s->direct_mmio_mapped = true;
+    *size = s->direct_size;
+    *offset = s->direct_addr;
+    return (void *)s->direct_ptr;
+}
+
 static const MemoryRegionOps ospi_dac_ops = {
     .read = ospi_dac_read,
     .write = ospi_dac_write,
+    .request_ptr = ospi_dac_request_ptr,
     .endianness = DEVICE_LITTLE_ENDIAN,
     .valid = {
         .min_access_size = 4,
@@ -1818,6 +1977,9 @@ static void ospi_update_dac_status(void *opaque, int n, int level)
 {
     OSPI *s = XILINX_OSPI(opaque);
 
+    if (s->dac_enable != !!level) {
+        ospi_invalidate_direct(s);
+    }
     s->dac_enable = level;
 }
 
@@ -1848,6 +2010,13 @@ static void ospi_realize(DeviceState *dev, Error **errp)
     ssi_auto_connect_slaves(DEVICE(s), s->cs_lines, s->spi);
     qdev_init_gpio_out(dev, s->cs_lines, s->num_cs);
     qdev_init_gpio_in(dev, ospi_update_dac_status, 1);
+
+    /* Same as the QSPI, mmio execution is not migratable.  */
+    if (s->mmio_execution_enabled) {
+        error_setg(&s->migration_blocker,
+                   "enabling mmio_execution breaks migration");
+        migrate_add_blocker(s->migration_blocker, &error_fatal);
+    }
 }
 
 static void ospi_init(Object *obj)
@@ -1887,6 +2056,9 @@ static Property ospi_properties[] = {
     DEFINE_PROP_BOOL("dac-with-indac", OSPI, dac_with_indac, false),
     DEFINE_PROP_BOOL("indac-write-disabled", OSPI, ind_write_disabled, true),
     DEFINE_PROP_UINT8("num-cs", OSPI, num_cs, 4),
+    /* Serve DAC reads straight from the flash contents when it allows it.  */
+    DEFINE_PROP_BOOL("dac-direct", OSPI, direct_enabled, false),
+    DEFINE_PROP_BOOL("x-mmio-exec", OSPI, mmio_execution_enabled, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -148,36 +148,64 @@ static inline int64_t is_between(int64_t x, int64_t a, int64_t b)
     return x < a && x >= b;
 }
 
+/* Steps from the current counter value until it next hits @target,
+ * wrapping around at @interval.
+ */
+static int64_t cadence_timer_steps_to(CadenceTimerState *s, int64_t target,
+                                      int64_t interval)
+{
+    int64_t d = (s->reg_count & COUNTER_CTRL_DEC) ?
+                (int64_t)s->reg_value - target :
+                target - (int64_t)s->reg_value;
+
+    return d > 0 ? d : d + interval;
+}
+
+/* Arm the QEMU timer for the next event that would change the irq line.
+ * Everything else (the counter value, masked or already pending status
+ * bits) is worked out lazily by cadence_timer_sync when the guest looks,
+ * so idle or polled timers cost no host wakeups.
+ */
 static void cadence_timer_run(CadenceTimerState *s)
 {
     int i;
-    int64_t event_interval, next_value;
+    int64_t event_interval = INT64_MAX;
+    uint32_t wanted = s->reg_intr_en & ~s->reg_intr;
+    uint32_t wrap_intr = (s->reg_count & COUNTER_CTRL_INT) ?
+                         COUNTER_INTR_IV : COUNTER_INTR_OV;
+    int64_t interval = (s->reg_count & COUNTER_CTRL_INT) ?
+                       (int64_t)s->reg_interval + 1 :
+                       1ull << s->container->bit_width;
+    interval <<= 16;
 
     assert(s->cpu_time_valid); /* cadence_timer_sync must be called first */
 
     if (s->reg_count & COUNTER_CTRL_DIS) {
-        s->cpu_time_valid = 0;
+        timer_del(s->timer);
         return;
     }
 
-    { /* figure out what's going to happen next (rollover or match) */
-        int64_t interval = (s->reg_count & COUNTER_CTRL_INT) ?
-                           (int64_t)s->reg_interval + 1 :
-                           1ull << s->container->bit_width;
-        interval <<= 16;
-        next_value = (s->reg_count & COUNTER_CTRL_DEC) ? -1ULL : interval;
-        for (i = 0; i < 3; ++i) {
-            int64_t cand = (uint64_t)s->reg_match[i] << 16;
-            if (is_between(cand, (uint64_t)s->reg_value, next_value)) {
-                next_value = cand;
-            }
+    /* figure out what's going to happen next (rollover or match) */
+    if (wanted & wrap_intr) {
+        event_interval = (s->reg_count & COUNTER_CTRL_DEC) ?
+                         (int64_t)s->reg_value + 1 :
+                         interval - (int64_t)s->reg_value;
+    }
+    for (i = 0; i < 3; ++i) {
+        int64_t cand = (uint64_t)s->reg_match[i] << 16;
+        if (!(wanted & (2 << i)) || cand > interval) {
+            continue;
         }
+        event_interval = MIN(event_interval,
+                             cadence_timer_steps_to(s, cand, interval));
     }
-    DB_PRINT("next timer event value: %16llx\n",
-            (unsigned long long)next_value);
 
-    event_interval = next_value - (int64_t)s->reg_value;
-    event_interval = (event_interval < 0) ? -event_interval : event_interval;
+    if (event_interval == INT64_MAX) {
+        timer_del(s->timer);
+        return;
+    }
+    DB_PRINT("next timer event in: %16llx\n",
+            (unsigned long long)event_interval);
 
     timer_mod(s->timer, s->cpu_time +
                 cadence_timer_get_ns(s, event_interval));
@@ -196,7 +224,9 @@ static void cadence_timer_sync(CadenceTimerState *s)
     s->cpu_time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     DB_PRINT("cpu time: %lld ns\n", (long long)old_time);
 
-    if (!s->cpu_time_valid || old_time == s->cpu_time) {
+    /* A stopped counter does not advance, restart from now when enabled */
+    if (!s->cpu_time_valid || old_time == s->cpu_time ||
+        (s->reg_count & COUNTER_CTRL_DIS)) {
         s->cpu_time_valid = 1;
         return;
     }
@@ -210,8 +240,10 @@ static void cadence_timer_sync(CadenceTimerState *s)
             continue;
         }
         /* check to see if match event has occurred. check m +/- interval
-         * to account for match events in wrap around cases */
-        if (is_between(m, s->reg_value, x) ||
+         * to account for match events in wrap around cases, a whole
+         * interval or more (nobody looked for a while) hits every match */
+        if (r >= interval ||
+            is_between(m, s->reg_value, x) ||
             is_between(m + interval, s->reg_value, x) ||
             is_between(m - interval, s->reg_value, x)) {
             s->reg_intr |= (2 << i);
@@ -221,10 +253,11 @@ static void cadence_timer_sync(CadenceTimerState *s)
         s->reg_intr |= (s->reg_count & COUNTER_CTRL_INT) ?
             COUNTER_INTR_IV : COUNTER_INTR_OV;
     }
-    while (x < 0) {
+    x %= interval;
+    if (x < 0) {
         x += interval;
     }
-    s->reg_value = x % interval;
+    s->reg_value = x;
 
     cadence_timer_update(s);
 }
@@ -243,8 +276,8 @@ static uint32_t cadence_ttc_read_imp(void *opaque, hwaddr offset)
     CadenceTimerState *s = cadence_timer_from_addr(opaque, offset);
     uint32_t value;
 
+    /* The armed timer stays valid, only catch the registers up */
     cadence_timer_sync(s);
-    cadence_timer_run(s);
 
     switch (offset) {
     case 0x00: /* clock control */
@@ -288,6 +321,7 @@ static uint32_t cadence_ttc_read_imp(void *opaque, hwaddr offset)
         /* cleared after read */
         value = s->reg_intr;
         s->reg_intr = 0;
+        cadence_timer_run(s);
         cadence_timer_update(s);
         return value;
 
@@ -425,6 +459,7 @@ static void cadence_ttc_init(Object *obj)
         cadence_timer_init(133000000, &s->timer[i]);
         s->timer[i].container = s;
         sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->timer[i].irq);
+        qdev_pm_add_timer(DEVICE(obj), s->timer[i].timer);
     }
 
     memory_region_init_io(&s->iomem, obj, &cadence_ttc_ops, s,
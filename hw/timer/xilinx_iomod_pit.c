@@ -25,10 +25,10 @@
 
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
-#include "hw/ptimer.h"
 #include "hw/register.h"
 #include "qemu/log.h"
-#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "qemu/host-utils.h"
 #include "qapi/error.h"
 #include "hw/fdt_generic_util.h"
 
@@ -69,9 +69,20 @@ typedef struct XilinxPIT {
     qemu_irq hit_out;
     /* State var to remember hit_in level */
     bool ps_level;
-
-    QEMUBH *bh;
-    ptimer_state *ptimer;
+    /* The intc has our interrupt latched, so hits go unnoticed */
+    bool irq_latched;
+
+    /* The counter is only evaluated when read.  The timer is armed for
+     * the next hit only while someone would notice it.
+     */
+    QEMUTimer *timer;
+    bool running;
+    bool periodic;
+    uint32_t limit;
+    /* QEMU_CLOCK_VIRTUAL ns when the counter was loaded with limit */
+    int64_t start;
+    /* Value of the counter when stopped */
+    uint32_t counter;
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
     const char *prefix;
@@ -86,6 +97,66 @@ static Property xlx_iom_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static uint64_t pit_ticks(XilinxPIT *s, int64_t now)
+{
+    return muldiv64(now - s->start, s->frequency, NANOSECONDS_PER_SECOND);
+}
+
+static int64_t pit_ticks_to_ns(XilinxPIT *s, uint64_t ticks)
+{
+    return s->start + muldiv64(ticks, NANOSECONDS_PER_SECOND, s->frequency);
+}
+
+static uint32_t pit_count(XilinxPIT *s, int64_t now)
+{
+    uint64_t ticks;
+
+    if (!s->running) {
+        return s->counter;
+    }
+
+    ticks = pit_ticks(s, now);
+    if (s->periodic) {
+        return s->limit - ticks % s->limit;
+    }
+    return ticks >= s->limit ? 0 : s->limit - ticks;
+}
+
+static bool pit_hit_wanted(XilinxPIT *s)
+{
+    return s->hit_out || (s->irq && !s->irq_latched);
+}
+
+static void pit_update_timer(XilinxPIT *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t deadline;
+    uint64_t k;
+
+    if (!s->running || !pit_hit_wanted(s)) {
+        timer_del(s->timer);
+        return;
+    }
+
+    if (!s->periodic) {
+        deadline = pit_ticks_to_ns(s, s->limit);
+        if (deadline < now) {
+            /* Ran out while nobody was looking */
+            s->running = false;
+            s->counter = 0;
+            timer_del(s->timer);
+            return;
+        }
+    } else {
+        k = pit_ticks(s, now) / s->limit + 1;
+        deadline = pit_ticks_to_ns(s, k * s->limit);
+        if (deadline <= now) {
+            deadline = pit_ticks_to_ns(s, (k + 1) * s->limit);
+        }
+    }
+    timer_mod(s->timer, deadline);
+}
+
 static uint64_t pit_ctr_pr(RegisterInfo *reg, uint64_t val)
 {
     XilinxPIT *s = XILINX_IO_MODULE_PIT(reg->opaque);
@@ -99,7 +170,7 @@ static uint64_t pit_ctr_pr(RegisterInfo *reg, uint64_t val)
     if (s->ps_enable) {
         r = s->ps_counter;
     } else {
-        r = ptimer_get_count(s->ptimer);
+        r = pit_count(s, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
     }
     return r;
 }
@@ -107,6 +178,7 @@ static uint64_t pit_ctr_pr(RegisterInfo *reg, uint64_t val)
 static void pit_control_pw(RegisterInfo *reg, uint64_t value)
 {
     XilinxPIT *s = XILINX_IO_MODULE_PIT(reg->opaque);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     uint32_t v32 = value;
 
     if (!s->cfg.use) {
@@ -114,18 +186,22 @@ static void pit_control_pw(RegisterInfo *reg, uint64_t value)
         return;
     }
 
-    ptimer_stop(s->ptimer);
+    s->counter = pit_count(s, now);
+    s->running = false;
     if (v32 & R_IOM_PIT_CONTROL_EN_MASK) {
         if (s->ps_enable) {
             /* pre-scalar mode Do-Nothing here. Wait for the friend to hit_in
              * and decrement the counter(s->ps_counter)*/
             s->ps_counter = s->regs[R_IOM_PIT_PRELOAD];
         } else {
-            ptimer_set_limit(s->ptimer, s->regs[R_IOM_PIT_PRELOAD], 1);
-            ptimer_run(s->ptimer, !(v32 & R_IOM_PIT_CONTROL_PRELOAD_MASK));
-
+            s->limit = s->regs[R_IOM_PIT_PRELOAD];
+            /* A zero preload hits once and stops */
+            s->periodic = (v32 & R_IOM_PIT_CONTROL_PRELOAD_MASK) && s->limit;
+            s->start = now;
+            s->running = true;
         }
     }
+    pit_update_timer(s);
 }
 
 static void pit_timer_hit(void *opaque)
@@ -137,6 +213,27 @@ static void pit_timer_hit(void *opaque)
     qemu_irq_pulse(s->hit_out);
 }
 
+static void pit_timer_cb(void *opaque)
+{
+    XilinxPIT *s = XILINX_IO_MODULE_PIT(opaque);
+
+    if (!s->periodic) {
+        s->running = false;
+        s->counter = 0;
+    }
+    pit_timer_hit(s);
+    pit_update_timer(s);
+}
+
+/* Driven by the intc while it has our interrupt latched.  */
+static void iom_pit_irq_status(void *opaque, int n, int level)
+{
+    XilinxPIT *s = XILINX_IO_MODULE_PIT(opaque);
+
+    s->irq_latched = level;
+    pit_update_timer(s);
+}
+
 static void iom_pit_ps_hit_in(void *opaque, int n, int level)
 {
     XilinxPIT *s = XILINX_IO_MODULE_PIT(opaque);
@@ -203,6 +300,11 @@ static void iom_pit_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
     s->ps_level = false;
+    if (s->cfg.use) {
+        timer_del(s->timer);
+    }
+    s->running = false;
+    s->counter = 0;
 }
 
 static void xlx_iom_realize(DeviceState *dev, Error **errp)
@@ -212,15 +314,19 @@ static void xlx_iom_realize(DeviceState *dev, Error **errp)
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
     if (s->cfg.use) {
-        s->bh = qemu_bh_new(pit_timer_hit, s);
-        s->ptimer = ptimer_init(s->bh, PTIMER_POLICY_DEFAULT);
-        ptimer_set_freq(s->ptimer, s->frequency);
+        if (!s->frequency) {
+            error_setg(errp, "%s: frequency must not be zero", s->prefix);
+            return;
+        }
+        s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, pit_timer_cb, s);
         /* IRQ out to pulse when present timer expires/reloads */
         qdev_init_gpio_out(dev, &s->hit_out, 1);
         /* IRQ in to enable pre-scalar mode. Routed from gpo1 */
         qdev_init_gpio_in_named(dev, iom_pit_ps_config, "ps_config", 1);
         /* hit_out of neighbouring PIT is received as hit_in */
         qdev_init_gpio_in_named(dev, iom_pit_ps_hit_in, "ps_hit_in", 1);
+        /* IRQ_STATUS line of our interrupt from the intc, optional */
+        qdev_init_gpio_in_named(dev, iom_pit_irq_status, "irq_status", 1);
     }
 }
 
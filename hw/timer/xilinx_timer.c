@@ -24,9 +24,8 @@
 
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
-#include "hw/ptimer.h"
+#include "qemu/timer.h"
 #include "qemu/log.h"
-#include "qemu/main-loop.h"
 
 #define D(x)
 
@@ -47,14 +46,21 @@
 #define TCSR_PWMA       (1<<9)
 #define TCSR_ENALL      (1<<10)
 
+/* The counter is not stepped, its value and expiry are derived from the
+ * virtual clock when the guest looks.  The QEMU timer is only armed when
+ * the expiry would raise the irq line.
+ */
 struct xlx_timer
 {
-    QEMUBH *bh;
-    ptimer_state *ptimer;
+    QEMUTimer *timer;
     void *parent;
     int nr; /* for debug.  */
 
-    unsigned long timer_div;
+    bool running;
+    uint64_t limit;         /* ticks from load to expiry */
+    int64_t start_ns;       /* virtual time of the last (re)load */
+    int64_t period_ns;
+    uint64_t stopped_count; /* ticks left, while stopped */
 
     uint32_t regs[R_MAX];
 };
@@ -99,6 +105,74 @@ static void timer_update_irq(struct timerblock *t)
     qemu_set_irq(t->irq, !!irq);
 }
 
+static uint64_t xlx_timer_ns_to_ticks(struct xlx_timer *xt, int64_t ns)
+{
+    struct timerblock *t = xt->parent;
+
+    return muldiv64(ns, t->freq_hz, NANOSECONDS_PER_SECOND);
+}
+
+static void xlx_timer_load(struct xlx_timer *xt, int64_t now)
+{
+    struct timerblock *t = xt->parent;
+
+    if (xt->regs[R_TCSR] & TCSR_UDT) {
+        xt->limit = xt->regs[R_TLR];
+    } else {
+        xt->limit = (uint32_t)~0 - xt->regs[R_TLR];
+    }
+    xt->start_ns = now;
+    xt->period_ns = MAX(muldiv64(xt->limit, NANOSECONDS_PER_SECOND,
+                                 t->freq_hz), 1);
+}
+
+/* Catch the expiry status and auto-reload up with the virtual clock.  */
+static void xlx_timer_sync(struct xlx_timer *xt, int64_t now)
+{
+    int64_t expire;
+
+    if (!xt->running) {
+        return;
+    }
+
+    expire = xt->start_ns + xt->period_ns;
+    if (now < expire) {
+        return;
+    }
+
+    xt->regs[R_TCSR] |= TCSR_TINT;
+    if (xt->regs[R_TCSR] & TCSR_ARHT) {
+        xlx_timer_load(xt, expire);
+        /* Skip the periods that went by unobserved in one go.  */
+        xt->start_ns += (now - xt->start_ns) / xt->period_ns * xt->period_ns;
+    } else {
+        xt->running = false;
+        xt->stopped_count = 0;
+    }
+}
+
+static uint64_t xlx_timer_count(struct xlx_timer *xt, int64_t now)
+{
+    uint64_t elapsed;
+
+    if (!xt->running) {
+        return xt->stopped_count;
+    }
+    elapsed = xlx_timer_ns_to_ticks(xt, now - xt->start_ns);
+    return elapsed < xt->limit ? xt->limit - elapsed : 0;
+}
+
+static void xlx_timer_arm(struct xlx_timer *xt)
+{
+    uint32_t csr = xt->regs[R_TCSR];
+
+    if (xt->running && (csr & TCSR_ENIT) && !(csr & TCSR_TINT)) {
+        timer_mod(xt->timer, xt->start_ns + xt->period_ns);
+    } else {
+        timer_del(xt->timer);
+    }
+}
+
 static uint64_t
 timer_read(void *opaque, hwaddr addr, unsigned int size)
 {
@@ -106,16 +180,19 @@ timer_read(void *opaque, hwaddr addr, unsigned int size)
     struct xlx_timer *xt;
     uint32_t r = 0;
     unsigned int timer;
+    int64_t now;
 
     addr >>= 2;
     timer = timer_from_addr(addr);
     xt = &t->timers[timer];
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    xlx_timer_sync(xt, now);
     /* Further decoding to address a specific timers reg.  */
     addr &= 0x3;
     switch (addr)
     {
         case R_TCR:
-                r = ptimer_get_count(xt->ptimer);
+                r = xlx_timer_count(xt, now);
                 if (!(xt->regs[R_TCSR] & TCSR_UDT))
                     r = ~r;
                 D(qemu_log("xlx_timer t=%d read counter=%x udt=%d\n",
@@ -131,21 +208,21 @@ timer_read(void *opaque, hwaddr addr, unsigned int size)
     return r;
 }
 
-static void timer_enable(struct xlx_timer *xt)
+static void timer_enable(struct xlx_timer *xt, int64_t now)
 {
-    uint64_t count;
-
     D(fprintf(stderr, "%s timer=%d down=%d\n", __func__,
               xt->nr, xt->regs[R_TCSR] & TCSR_UDT));
 
-    ptimer_stop(xt->ptimer);
+    xlx_timer_load(xt, now);
+    xt->running = true;
+}
 
-    if (xt->regs[R_TCSR] & TCSR_UDT)
-        count = xt->regs[R_TLR];
-    else
-        count = ~0 - xt->regs[R_TLR];
-    ptimer_set_limit(xt->ptimer, count, 1);
-    ptimer_run(xt->ptimer, 1);
+static void timer_disable(struct xlx_timer *xt, int64_t now)
+{
+    if (xt->running) {
+        xt->stopped_count = xlx_timer_count(xt, now);
+        xt->running = false;
+    }
 }
 
 static void
@@ -156,10 +233,13 @@ timer_write(void *opaque, hwaddr addr,
     struct xlx_timer *xt;
     unsigned int timer;
     uint32_t value = val64;
+    int64_t now;
 
     addr >>= 2;
     timer = timer_from_addr(addr);
     xt = &t->timers[timer];
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    xlx_timer_sync(xt, now);
     D(fprintf(stderr, "%s addr=%x val=%x (timer=%d off=%d)\n",
              __func__, addr * 4, value, timer, addr & 3));
     /* Further decoding to address a specific timers reg.  */
@@ -172,7 +252,9 @@ timer_write(void *opaque, hwaddr addr,
 
             xt->regs[addr] = value & 0x7ff;
             if (value & TCSR_ENT)
-                timer_enable(xt);
+                timer_enable(xt, now);
+            else
+                timer_disable(xt, now);
             break;
  
         default:
@@ -180,6 +262,7 @@ timer_write(void *opaque, hwaddr addr,
                 xt->regs[addr] = value;
             break;
     }
+    xlx_timer_arm(xt);
     timer_update_irq(t);
 }
 
@@ -198,10 +281,9 @@ static void timer_hit(void *opaque)
     struct xlx_timer *xt = opaque;
     struct timerblock *t = xt->parent;
     D(fprintf(stderr, "%s %d\n", __func__, xt->nr));
-    xt->regs[R_TCSR] |= TCSR_TINT;
 
-    if (xt->regs[R_TCSR] & TCSR_ARHT)
-        timer_enable(xt);
+    xlx_timer_sync(xt, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    xlx_timer_arm(xt);
     timer_update_irq(t);
 }
 
@@ -210,16 +292,14 @@ static void xilinx_timer_realize(DeviceState *dev, Error **errp)
     struct timerblock *t = XILINX_TIMER(dev);
     unsigned int i;
 
-    /* Init all the ptimers.  */
+    /* Init all the timers.  */
     t->timers = g_malloc0(sizeof t->timers[0] * num_timers(t));
     for (i = 0; i < num_timers(t); i++) {
         struct xlx_timer *xt = &t->timers[i];
 
         xt->parent = t;
         xt->nr = i;
-        xt->bh = qemu_bh_new(timer_hit, xt);
-        xt->ptimer = ptimer_init(xt->bh, PTIMER_POLICY_DEFAULT);
-        ptimer_set_freq(xt->ptimer, t->freq_hz);
+        xt->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, timer_hit, xt);
     }
 
     memory_region_init_io(&t->mmio, OBJECT(t), &timer_ops, t, "xlnx.xps-timer",
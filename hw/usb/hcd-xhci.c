@@ -707,27 +707,64 @@ static void xhci_event(XHCIState *xhci, XHCIEvent *event, int v)
     xhci_intr_raise(xhci, v);
 }
 
+/*
+ * Ring fetches read the TRBs that follow in the same page along with the
+ * one asked for, a TD is then usually read with a single DMA access for
+ * both xhci_ring_chain_length() and xhci_ring_fetch().  The guest only
+ * hands TRBs over by flipping their cycle bit, and TRBs it handed over
+ * are not supposed to change until software stops the ring.  The
+ * read-ahead is dropped before a doorbell is processed, which is when
+ * such changes could have been made.
+ */
+static void xhci_ring_flush_cache(XHCIRing *ring)
+{
+    ring->cache_len = 0;
+}
+
+static void xhci_ring_read_trb(XHCIState *xhci, XHCIRing *ring,
+                               dma_addr_t addr, bool ccs, XHCITRB *trb)
+{
+    PCIDevice *pci_dev = PCI_DEVICE(xhci);
+    dma_addr_t off = addr - ring->cache_addr;
+    uint8_t *raw;
+
+    if (addr < ring->cache_addr || off >= ring->cache_len * TRB_SIZE ||
+        off % TRB_SIZE ||
+        (ldl_le_p(ring->cache + off + 12) & TRB_C) != ccs) {
+        /* Missed, or not handed over yet at the time of the read-ahead */
+        uint32_t nr = (0x1000 - (addr & 0xfff)) / TRB_SIZE;
+
+        nr = MAX(MIN(nr, XHCI_RING_PREFETCH), 1);
+        pci_dma_read(pci_dev, addr, ring->cache, nr * TRB_SIZE);
+        ring->cache_addr = addr;
+        ring->cache_len = nr;
+        off = 0;
+    }
+
+    raw = ring->cache + off;
+    trb->parameter = ldq_le_p(raw);
+    trb->status = ldl_le_p(raw + 8);
+    trb->control = ldl_le_p(raw + 12);
+}
+
 static void xhci_ring_init(XHCIState *xhci, XHCIRing *ring,
                            dma_addr_t base)
 {
     ring->dequeue = base;
     ring->ccs = 1;
+    xhci_ring_flush_cache(ring);
 }
 
 static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
                                dma_addr_t *addr)
 {
-    PCIDevice *pci_dev = PCI_DEVICE(xhci);
     uint32_t link_cnt = 0;
 
     while (1) {
         TRBType type;
-        pci_dma_read(pci_dev, ring->dequeue, trb, TRB_SIZE);
+        xhci_ring_read_trb(xhci, ring, ring->dequeue, ring->ccs, trb);
         trb->addr = ring->dequeue;
         trb->ccs = ring->ccs;
-        le64_to_cpus(&trb->parameter);
-        le32_to_cpus(&trb->status);
-        le32_to_cpus(&trb->control);
 
         trace_usb_xhci_fetch_trb(ring->dequeue, trb_name(trb),
                                  trb->parameter, trb->status, trb->control);
@@ -757,9 +794,8 @@ static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
     }
 }
 
-static int xhci_ring_chain_length(XHCIState *xhci, const XHCIRing *ring)
+static int xhci_ring_chain_length(XHCIState *xhci, XHCIRing *ring)
 {
-    PCIDevice *pci_dev = PCI_DEVICE(xhci);
     XHCITRB trb;
     int length = 0;
     dma_addr_t dequeue = ring->dequeue;
@@ -770,10 +806,7 @@ static int xhci_ring_chain_length(XHCIState *xhci, const XHCIRing *ring)
 
     while (1) {
         TRBType type;
-        pci_dma_read(pci_dev, dequeue, &trb, TRB_SIZE);
-        le64_to_cpus(&trb.parameter);
-        le32_to_cpus(&trb.status);
-        le32_to_cpus(&trb.control);
+        xhci_ring_read_trb(xhci, ring, dequeue, ccs, &trb);
 
         if ((trb.control & TRB_C) != ccs) {
             return -length;
@@ -1939,6 +1972,7 @@ static void xhci_kick_epctx(XHCIEPContext *epctx, unsigned int streamid)
         xhci_set_ep_state(xhci, epctx, NULL, EP_RUNNING);
     }
     assert(ring->dequeue != 0);
+    xhci_ring_flush_cache(ring);
 
     epctx->kick_active++;
     while (1) {
@@ -2437,6 +2471,7 @@ static void xhci_process_commands(XHCIState *xhci)
     }
 
     xhci->crcr_low |= CRCR_CRR;
+    xhci_ring_flush_cache(&xhci->cmd_ring);
 
     while ((type = xhci_ring_fetch(xhci, &xhci->cmd_ring, &trb, &addr))) {
         event.ptr = addr;
@@ -122,9 +122,17 @@ typedef enum TRBCCode {
     CC_SPLIT_TRANSACTION_ERROR
 } TRBCCode;
 
+/* TRBs read ahead at once from a transfer or command ring */
+#define XHCI_RING_PREFETCH 16
+
 typedef struct XHCIRing {
     dma_addr_t dequeue;
     bool ccs;
+
+    /* Raw TRBs read ahead from cache_addr, see xhci_ring_read_trb() */
+    dma_addr_t cache_addr;
+    uint32_t cache_len;
+    uint8_t cache[XHCI_RING_PREFETCH * 16];
 } XHCIRing;
 
 typedef struct XHCIPort {
@@ -127,9 +127,12 @@ struct vhost_user {
     int slave_fd;
 };
 
+/* Without KVM, virtio_queue_notify() signals the kick eventfds and the
+ * call eventfds are read by QEMU, so the backend can use both.
+ */
 static bool ioeventfd_enabled(void)
 {
-    return kvm_enabled() && kvm_eventfds_enabled();
+    return !kvm_enabled() || kvm_eventfds_enabled();
 }
 
 static int vhost_user_read(struct vhost_dev *dev, VhostUserMsg *msg)
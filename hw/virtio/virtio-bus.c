@@ -285,8 +285,13 @@ int virtio_bus_set_host_notifier(VirtioBusState *bus, int n, bool assign)
             error_report("%s: unable to assign ioeventfd: %d", __func__, r);
             goto cleanup_event_notifier;
         }
+        /* Guest kicks that the accelerator does not turn into eventfd
+         * writes still reach the notifier through virtio_queue_notify().
+         */
+        virtio_queue_set_host_notifier_enabled(vq, true);
         return 0;
     } else {
+        virtio_queue_set_host_notifier_enabled(vq, false);
         k->ioeventfd_assign(proxy, notifier, n, false);
     }
 
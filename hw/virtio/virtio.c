@@ -108,7 +108,17 @@ struct VirtQueue
     VirtIODevice *vdev;
     EventNotifier guest_notifier;
     EventNotifier host_notifier;
+    bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /* Elements handed out by virtqueue_pop_batch(), allocated on first use
+     * for elements of up to pool_elem_sz bytes.
+     */
+    void *pool;
+    size_t pool_elem_sz;
+    size_t pool_slot_size;
+    void **pool_free;
+    unsigned int pool_nfree;
 };
 
 static void virtio_free_region_cache(VRingMemoryRegionCaches *caches)
@@ -510,6 +520,28 @@ void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
     rcu_read_unlock();
 }
 
+/* virtqueue_push_batch:
+ * @vq: The #VirtQueue
+ * @elems: The #VirtQueueElements to push
+ * @lens: number of bytes written to each element, or NULL if none were
+ * @count: number of elements
+ *
+ * Like virtqueue_push() for several elements, with a single update of the
+ * used index.  The caller notifies the guest once afterwards.
+ */
+void virtqueue_push_batch(VirtQueue *vq, VirtQueueElement **elems,
+                          const unsigned int *lens, unsigned int count)
+{
+    unsigned int i;
+
+    rcu_read_lock();
+    for (i = 0; i < count; i++) {
+        virtqueue_fill(vq, elems[i], lens ? lens[i] : 0, i);
+    }
+    virtqueue_flush(vq, count);
+    rcu_read_unlock();
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -803,9 +835,12 @@ void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem)
     virtqueue_map_iovec(vdev, elem->out_sg, elem->out_addr, &elem->out_num, 0);
 }
 
-static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+/* Lay out an element of @sz bytes followed by its scatter-gather lists at
+ * @elem.  Returns the size this takes, @elem may be NULL to only get that.
+ */
+static size_t virtqueue_layout_element(VirtQueueElement *elem, size_t sz,
+                                       unsigned out_num, unsigned in_num)
 {
-    VirtQueueElement *elem;
     size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
     size_t out_addr_ofs = in_addr_ofs + in_num * sizeof(elem->in_addr[0]);
     size_t out_addr_end = out_addr_ofs + out_num * sizeof(elem->out_addr[0]);
@@ -813,19 +848,102 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
     size_t out_sg_end = out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
 
+    if (elem) {
+        elem->out_num = out_num;
+        elem->in_num = in_num;
+        elem->in_addr = (void *)elem + in_addr_ofs;
+        elem->out_addr = (void *)elem + out_addr_ofs;
+        elem->in_sg = (void *)elem + in_sg_ofs;
+        elem->out_sg = (void *)elem + out_sg_ofs;
+    }
+    return out_sg_end;
+}
+
+static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+{
+    VirtQueueElement *elem;
+
     assert(sz >= sizeof(VirtQueueElement));
-    elem = g_malloc(out_sg_end);
+    elem = g_malloc(virtqueue_layout_element(NULL, sz, out_num, in_num));
     trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
-    elem->out_num = out_num;
-    elem->in_num = in_num;
-    elem->in_addr = (void *)elem + in_addr_ofs;
-    elem->out_addr = (void *)elem + out_addr_ofs;
-    elem->in_sg = (void *)elem + in_sg_ofs;
-    elem->out_sg = (void *)elem + out_sg_ofs;
+    virtqueue_layout_element(elem, sz, out_num, in_num);
     return elem;
 }
 
-void *virtqueue_pop(VirtQueue *vq, size_t sz)
+/* Elements from the per-queue pool have room for this many scatter-gather
+ * entries, bigger ones come from the heap.
+ */
+#define VIRTQUEUE_POOL_SG   8
+#define VIRTQUEUE_POOL_SIZE 64
+
+static void virtqueue_pool_init(VirtQueue *vq, size_t sz)
+{
+    int i;
+
+    vq->pool_elem_sz = sz;
+    vq->pool_slot_size = QEMU_ALIGN_UP(
+        virtqueue_layout_element(NULL, sz, 0, VIRTQUEUE_POOL_SG), 16);
+    vq->pool = g_malloc(VIRTQUEUE_POOL_SIZE * vq->pool_slot_size);
+    vq->pool_free = g_new(void *, VIRTQUEUE_POOL_SIZE);
+    for (i = 0; i < VIRTQUEUE_POOL_SIZE; i++) {
+        vq->pool_free[i] = vq->pool +
+                           (VIRTQUEUE_POOL_SIZE - 1 - i) * vq->pool_slot_size;
+    }
+    vq->pool_nfree = VIRTQUEUE_POOL_SIZE;
+}
+
+static void *virtqueue_pool_alloc_element(VirtQueue *vq, size_t sz,
+                                          unsigned out_num, unsigned in_num)
+{
+    VirtQueueElement *elem;
+
+    if (!vq->pool) {
+        virtqueue_pool_init(vq, sz);
+    }
+    if (sz > vq->pool_elem_sz || out_num + in_num > VIRTQUEUE_POOL_SG ||
+        !vq->pool_nfree) {
+        return virtqueue_alloc_element(sz, out_num, in_num);
+    }
+
+    assert(sz >= sizeof(VirtQueueElement));
+    elem = vq->pool_free[--vq->pool_nfree];
+    trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
+    virtqueue_layout_element(elem, sz, out_num, in_num);
+    return elem;
+}
+
+static bool virtqueue_pool_contains(VirtQueue *vq, void *elem)
+{
+    return vq->pool && elem >= vq->pool &&
+           elem < vq->pool + VIRTQUEUE_POOL_SIZE * vq->pool_slot_size;
+}
+
+/* virtqueue_free_element:
+ * @vq: The #VirtQueue the element was popped from
+ * @elem: The element
+ *
+ * Free an element from virtqueue_pop_batch(), it must not outlive the
+ * device.  Elements from virtqueue_pop() may be passed too, or freed with
+ * g_free().
+ */
+void virtqueue_free_element(VirtQueue *vq, void *elem)
+{
+    if (virtqueue_pool_contains(vq, elem)) {
+        vq->pool_free[vq->pool_nfree++] = elem;
+    } else {
+        g_free(elem);
+    }
+}
+
+static void virtqueue_update_avail_event(VirtQueue *vq)
+{
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+}
+
+/* Called within rcu_read_lock(), with at least one element available.  */
+static void *virtqueue_pop_elem(VirtQueue *vq, size_t sz, bool pooled)
 {
     unsigned int i, head, max;
     VRingMemoryRegionCaches *caches;
@@ -840,17 +958,6 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     VRingDesc desc;
     int rc;
 
-    if (unlikely(vdev->broken)) {
-        return NULL;
-    }
-    rcu_read_lock();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
@@ -865,10 +972,6 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
     caches = vring_get_region_caches(vq);
@@ -935,7 +1038,11 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     }
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    if (pooled) {
+        elem = virtqueue_pool_alloc_element(vq, sz, out_num, in_num);
+    } else {
+        elem = virtqueue_alloc_element(sz, out_num, in_num);
+    }
     elem->index = head;
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
@@ -951,7 +1058,6 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     trace_virtqueue_pop(vq, elem, elem->in_num, elem->out_num);
 done:
     address_space_cache_destroy(&indirect_desc_cache);
-    rcu_read_unlock();
 
     return elem;
 
@@ -960,6 +1066,74 @@ err_undo_map:
     goto done;
 }
 
+void *virtqueue_pop(VirtQueue *vq, size_t sz)
+{
+    void *elem = NULL;
+
+    if (unlikely(vq->vdev->broken)) {
+        return NULL;
+    }
+    rcu_read_lock();
+    if (!virtio_queue_empty_rcu(vq)) {
+        /* Needed after virtio_queue_empty(), see comment in
+         * virtqueue_num_heads(). */
+        smp_rmb();
+        elem = virtqueue_pop_elem(vq, sz, false);
+        virtqueue_update_avail_event(vq);
+    }
+    rcu_read_unlock();
+
+    return elem;
+}
+
+/* virtqueue_pop_batch:
+ * @vq: The #VirtQueue
+ * @sz: size of the elements to return, as for virtqueue_pop()
+ * @elems: where to store the elements
+ * @max: maximum number of elements to pop
+ *
+ * Pop up to @max elements with a single read of the available index and a
+ * single update of the avail event.  The elements usually come from a
+ * small per-queue pool and must be released with virtqueue_free_element().
+ *
+ * Returns: the number of elements popped
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    unsigned int n = 0;
+    int avail;
+
+    if (unlikely(vq->vdev->broken)) {
+        return 0;
+    }
+    rcu_read_lock();
+    if (unlikely(!vq->vring.avail)) {
+        goto out;
+    }
+
+    avail = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (avail <= 0) {
+        goto out;
+    }
+    max = MIN(max, avail);
+
+    while (n < max) {
+        elems[n] = virtqueue_pop_elem(vq, sz, true);
+        if (!elems[n]) {
+            break;
+        }
+        n++;
+    }
+    if (n) {
+        virtqueue_update_avail_event(vq);
+    }
+
+out:
+    rcu_read_unlock();
+    return n;
+}
+
 /* virtqueue_drop_all:
  * @vq: The #VirtQueue
  * Drops all queued buffers and indicates them to the guest
@@ -1541,7 +1715,11 @@ void virtio_queue_notify(VirtIODevice *vdev, int n)
     }
 
     trace_virtio_queue_notify(vdev, vq - vdev->vq, vq);
-    if (vq->handle_aio_output) {
+    /* Whoever listens on the host notifier owns the queue: an IOThread, or
+     * a vhost backend when there is no ioeventfd to kick it directly, as
+     * with TCG.
+     */
+    if (vq->host_notifier_enabled) {
         event_notifier_set(&vq->host_notifier);
     } else if (vq->handle_output) {
         vq->handle_output(vdev, vq);
@@ -2454,6 +2632,11 @@ EventNotifier *virtio_queue_get_host_notifier(VirtQueue *vq)
     return &vq->host_notifier;
 }
 
+void virtio_queue_set_host_notifier_enabled(VirtQueue *vq, bool enabled)
+{
+    vq->host_notifier_enabled = enabled;
+}
+
 void virtio_device_set_child_bus_name(VirtIODevice *vdev, char *bus_name)
 {
     g_free(vdev->bus_name);
@@ -2550,6 +2733,10 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
         }
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
     }
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        g_free(vdev->vq[i].pool);
+        g_free(vdev->vq[i].pool_free);
+    }
     g_free(vdev->vq);
 }
 
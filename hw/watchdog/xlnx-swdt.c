@@ -27,6 +27,7 @@
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
 #include "hw/register.h"
+#include "hw/deadline.h"
 #include "qemu/timer.h"
 #include "qemu/bitops.h"
 #include "qapi/error.h"
@@ -68,8 +69,8 @@ typedef struct SWDTState {
     qemu_irq rst;
     QEMUTimer *timer;
     /* model the irq and rst line high time. */
-    QEMUTimer *irq_done_timer;
-    QEMUTimer *rst_done_timer;
+    Deadline irq_done;
+    Deadline rst_done;
 
     uint64_t pclk;
     uint32_t current_mode;
@@ -85,7 +86,7 @@ static void swdt_done_irq_update(SWDTState *s)
                               s->pclk);
 
     qemu_set_irq(s->irq, 1);
-    timer_mod(s->irq_done_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + irqln);
+    deadline_mod_delay_ns(&s->irq_done, irqln);
 }
 
 static void swdt_reset_irq_update(SWDTState *s)
@@ -95,7 +96,7 @@ static void swdt_reset_irq_update(SWDTState *s)
                               s->pclk);
 
     qemu_set_irq(s->rst, 1);
-    timer_mod(s->rst_done_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + rstln);
+    deadline_mod_delay_ns(&s->rst_done, rstln);
 }
 
 static void swdt_irq_done(void *opaque)
@@ -289,8 +290,9 @@ static void swdt_init(Object *obj)
     sysbus_init_irq(sbd, &s->irq);
 
     s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, swdt_time_elapsed, s);
-    s->irq_done_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, swdt_irq_done, s);
-    s->rst_done_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, swdt_reset_done, s);
+    qdev_pm_add_timer(DEVICE(obj), s->timer);
+    deadline_init(&s->irq_done, swdt_irq_done, s);
+    deadline_init(&s->rst_done, swdt_reset_done, s);
 }
 
 static Property swdt_properties[] = {
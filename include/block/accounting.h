@@ -38,6 +38,15 @@ enum BlockAcctType {
     BLOCK_MAX_IOTYPE,
 };
 
+/* One bin for latencies below 1 us, then one per power of two of
+ * microseconds.  The last one is open ended.
+ */
+#define BLOCK_ACCT_HISTOGRAM_BINS 24
+
+typedef struct BlockAcctHistogram {
+    uint64_t bins[BLOCK_ACCT_HISTOGRAM_BINS];
+} BlockAcctHistogram;
+
 struct BlockAcctTimedStats {
     BlockAcctStats *stats;
     TimedAverage latency[BLOCK_MAX_IOTYPE];
@@ -55,6 +64,10 @@ struct BlockAcctStats {
     uint64_t merged[BLOCK_MAX_IOTYPE];
     int64_t last_access_time_ns;
     QSLIST_HEAD(, BlockAcctTimedStats) intervals;
+    /* Latency of the requests as seen by the device model */
+    BlockAcctHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+    /* Time the requests spent below the BlockBackend */
+    BlockAcctHistogram backend_latency_histogram[BLOCK_MAX_IOTYPE];
     bool account_invalid;
     bool account_failed;
 };
@@ -76,10 +89,12 @@ void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
                       int64_t bytes, enum BlockAcctType type);
 void block_acct_done(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_failed(BlockAcctStats *stats, BlockAcctCookie *cookie);
+void block_acct_backend_done(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_invalid(BlockAcctStats *stats, enum BlockAcctType type);
 void block_acct_merge_done(BlockAcctStats *stats, enum BlockAcctType type,
                            int num_requests);
 int64_t block_acct_idle_time_ns(BlockAcctStats *stats);
+uint64_t block_acct_histogram_boundary(unsigned bin);
 double block_acct_queue_depth(BlockAcctTimedStats *stats,
                               enum BlockAcctType type);
 
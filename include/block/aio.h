@@ -124,6 +124,13 @@ struct AioContext {
     struct LinuxAioState *linux_aio;
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+    /* State for Linux io_uring.  Uses aio_context_acquire/release for
+     * locking.
+     */
+    struct LuringState *linux_io_uring;
+#endif
+
     /* TimerLists for calling timers - one per clock type.  Has its own
      * locking.
      */
@@ -131,7 +138,9 @@ struct AioContext {
 
     int external_disable_cnt;
 
-    /* Number of AioHandlers without .io_poll() */
+    /* Number of AioHandlers that cannot be polled, neither through
+     * .io_poll() nor for readiness.
+     */
     int poll_disable_cnt;
 
     /* Polling mode parameters */
@@ -143,6 +152,13 @@ struct AioContext {
     /* Are we in polling mode or monitoring file descriptors? */
     bool poll_started;
 
+    /* Busy polling rounds, and those that made progress before the
+     * polling time ran out.  Only updated by the thread running aio_poll(),
+     * read without synchronization.
+     */
+    uint64_t poll_attempts;
+    uint64_t poll_successes;
+
     /* epoll(7) state used when built with CONFIG_EPOLL */
     int epollfd;
     bool epoll_enabled;
@@ -351,6 +367,16 @@ void aio_set_fd_poll(AioContext *ctx, int fd,
                      IOHandler *io_poll_begin,
                      IOHandler *io_poll_end);
 
+/* Let a file descriptor that has already been registered with
+ * aio_set_fd_handler without .io_poll() be busy polled for readiness, with
+ * a non-blocking poll(2), instead of disabling polling for the whole
+ * AioContext.  Its handlers then run right from polling mode.  This costs
+ * a system call per polling round, but avoids the wakeup latency of
+ * blocking in ppoll(2).  Do nothing if the file descriptor is not
+ * registered.
+ */
+void aio_set_fd_poll_ready(AioContext *ctx, int fd, bool poll_ready);
+
 /* Register an event notifier and associated callbacks.  Behaves very similarly
  * to event_notifier_set_handler.  Unlike event_notifier_set_handler, these callbacks
  * will be invoked when using aio_poll().
@@ -373,6 +399,13 @@ void aio_set_event_notifier_poll(AioContext *ctx,
                                  EventNotifierHandler *io_poll_begin,
                                  EventNotifierHandler *io_poll_end);
 
+/* Like aio_set_fd_poll_ready, for doorbells that have no memory to poll
+ * and are only signalled through an event notifier.
+ */
+void aio_set_event_notifier_poll_ready(AioContext *ctx,
+                                       EventNotifier *notifier,
+                                       bool poll_ready);
+
 /* Return a GSource that lets the main loop poll the file descriptors attached
  * to this AioContext.
  */
@@ -384,6 +417,11 @@ struct ThreadPool *aio_get_thread_pool(AioContext *ctx);
 /* Return the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_get_linux_aio(AioContext *ctx);
 
+/* Return the LuringState bound to this AioContext, setting it up on first
+ * use.  Returns NULL if the host does not support io_uring.
+ */
+struct LuringState *aio_get_linux_io_uring(AioContext *ctx, Error **errp);
+
 /**
  * aio_timer_new:
  * @ctx: the aio context
@@ -19,6 +19,7 @@
 #define QEMU_THREAD_POOL_H
 
 #include "block/block.h"
+#include "qapi-types.h"
 
 typedef int ThreadPoolFunc(void *opaque);
 
@@ -27,11 +28,29 @@ typedef struct ThreadPool ThreadPool;
 ThreadPool *thread_pool_new(struct AioContext *ctx);
 void thread_pool_free(ThreadPool *pool);
 
+/*
+ * Workers take the oldest request of the highest priority.  Without an
+ * explicit priority, requests run at THREAD_POOL_PRIORITY_NORMAL, or at
+ * THREAD_POOL_PRIORITY_LOW when submitted from a background coroutine.
+ */
 BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
         ThreadPoolFunc *func, void *arg,
         BlockCompletionFunc *cb, void *opaque);
+BlockAIOCB *thread_pool_submit_aio_prio(ThreadPool *pool,
+        ThreadPoolPriority prio, ThreadPoolFunc *func, void *arg,
+        BlockCompletionFunc *cb, void *opaque);
 int coroutine_fn thread_pool_submit_co(ThreadPool *pool,
         ThreadPoolFunc *func, void *arg);
+int coroutine_fn thread_pool_submit_co_prio(ThreadPool *pool,
+        ThreadPoolPriority prio, ThreadPoolFunc *func, void *arg);
 void thread_pool_submit(ThreadPool *pool, ThreadPoolFunc *func, void *arg);
 
+/* Fill in the size and the statistics of @pool, except @iothread */
+void thread_pool_get_info(ThreadPool *pool, ThreadPoolInfo *info);
+
+/* Configuration of the pools created from now on */
+void thread_pool_set_max_threads(int max_threads);
+int thread_pool_set_cpus(unsigned long first, unsigned long last,
+                         Error **errp);
+
 #endif
@@ -25,6 +25,7 @@
 
 #include "qemu/host-utils.h"
 #include "qemu/queue.h"
+#include "qemu/thread.h"
 #ifdef CONFIG_TCG
 #include "tcg-target.h"
 #endif
@@ -88,6 +89,24 @@ typedef uint64_t target_ulong;
  * 0x18 (the offset of the addend field in each TLB entry) plus the offset
  * of tlb_table inside env (which is non-trivial but not huge).
  */
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* The TLB of each MMU mode is sized at run time, between these bounds,
+ * from how much of it was in use since the last resize.  The generated
+ * code loads the table base and index mask from env, so there is no
+ * displacement limit to honour.
+ */
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
+
+#if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+#else
+#define CPU_TLB_DYN_MAX_BITS MIN(22, TARGET_LONG_BITS - TARGET_PAGE_BITS)
+#endif
+
+#else /* !TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 #define CPU_TLB_BITS                                             \
     MIN(8,                                                       \
         TCG_TARGET_TLB_DISPLACEMENT_BITS - CPU_TLB_ENTRY_BITS -  \
@@ -98,6 +117,8 @@ typedef uint64_t target_ulong;
 
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
 
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
        bit TARGET_PAGE_BITS-1..4  : Nonzero for accesses that should not
@@ -129,20 +150,57 @@ QEMU_BUILD_BUG_ON(sizeof(CPUTLBEntry) != (1 << CPU_TLB_ENTRY_BITS));
 typedef struct CPUIOTLBEntry {
     hwaddr addr;
     MemTxAttrs attrs;
+    /* Accesses through this entry pass the etrace mem filter.  */
+    bool etrace;
 } CPUIOTLBEntry;
 
 #ifndef NB_MEM_ATTR
 #define NB_MEM_ATTR 2
 #endif
 
-#define CPU_COMMON_TLB \
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+typedef struct CPUTLBDesc {
+    /* Start of the current sizing window and the most entries that
+     * were in use at a flush within it.
+     */
+    int64_t window_begin_ns;
+    size_t window_max_entries;
+    /* Entries of tlb_table in use.  */
+    size_t n_used_entries;
+} CPUTLBDesc;
+
+#define CPU_COMMON_TLB_TABLES \
+    /* tlb_lock keeps tlb_reset_dirty off the tables while they are     \
+     * reallocated.                                                     \
+     */                                                                 \
+    QemuSpin tlb_lock;                                                  \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
+    /* (number of entries - 1) << CPU_TLB_ENTRY_BITS */                 \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    /* The meaning of the MMU modes is defined in the target code. */   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];                                 \
+    CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+
+#else
+
+#define CPU_COMMON_TLB_TABLES \
     /* The meaning of the MMU modes is defined in the target code. */   \
     CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
     CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+
+#endif
+
+#define CPU_COMMON_TLB \
+    CPU_COMMON_TLB_TABLES                                               \
     CPUIOTLBEntry memattr[NB_MEM_ATTR];                                 \
     size_t tlb_flush_count;                                             \
+    /* Bumped by every flush, full or not, to drop target state derived \
+       from the page tables, such as a page table walk cache.  */       \
+    uint32_t tlb_flush_gen;                                             \
     target_ulong tlb_flush_addr;                                        \
     target_ulong tlb_flush_mask;                                        \
     target_ulong vtlb_index;                                            \
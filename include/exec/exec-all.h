@@ -94,6 +94,18 @@ void cpu_address_space_init(CPUState *cpu, AddressSpace *as, int asidx);
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
 /* cputlb.c */
+/**
+ * tlb_init:
+ * @cpu: CPU whose TLB should be initialized
+ *
+ * Allocate the TLB of @cpu when it is sized at run time.
+ */
+void tlb_init(CPUState *cpu);
+/**
+ * tlb_destroy:
+ * @cpu: CPU whose TLB should be freed
+ */
+void tlb_destroy(CPUState *cpu);
 /**
  * tlb_flush_page:
  * @cpu: CPU whose TLB should be flushed
@@ -254,6 +266,12 @@ void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr);
 void probe_write(CPUArchState *env, target_ulong addr, int mmu_idx,
                  uintptr_t retaddr);
 #else
+static inline void tlb_init(CPUState *cpu)
+{
+}
+static inline void tlb_destroy(CPUState *cpu)
+{
+}
 static inline void tlb_flush_page(CPUState *cpu, target_ulong addr)
 {
 }
@@ -341,9 +359,15 @@ struct TranslationBlock {
 #define CF_USE_ICOUNT  0x00020000
 #define CF_INVALID     0x00040000 /* TB is stale. Setters need tb_lock */
 #define CF_PARALLEL    0x00080000 /* Generate code for a parallel context */
+#define CF_ETRACE      0x00100000 /* TB passes the etrace exec filter */
+#define CF_SUPERBLOCK  0x00200000 /* Translate across branches, see below */
+#define CF_QUANTUM     0x00400000 /* Count insns only, for quantum icount */
+#define CF_COVERAGE    0x00800000 /* Not accounted for coverage yet */
+#define CF_SINGLESTEP  0x01000000 /* Translated for a single-stepping CPU */
 /* cflags' mask for hashing/comparison */
 #define CF_HASH_MASK   \
-    (CF_COUNT_MASK | CF_LAST_IO | CF_USE_ICOUNT | CF_PARALLEL)
+    (CF_COUNT_MASK | CF_LAST_IO | CF_USE_ICOUNT | CF_PARALLEL | CF_QUANTUM | \
+     CF_SINGLESTEP)
 
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
@@ -382,10 +406,31 @@ struct TranslationBlock {
      */
     uintptr_t jmp_list_next[2];
     uintptr_t jmp_list_first;
+
+    /* Entries left before the TB is retranslated as a superblock */
+    int32_t hot_count;
+
+    /* Statistics, if tb_stats_enabled when the TB was translated */
+    struct TBStatistics *tb_stats;
 };
 
 extern bool parallel_cpus;
 
+/* When non-zero, TBs count their entries, and one entered that many times
+ * is retranslated with CF_SUPERBLOCK.  Such a TB carries on past the
+ * direct branches front ends are able to follow, leaving through side
+ * exits instead, so that its code is optimized as a unit.
+ */
+extern unsigned int tb_hot_threshold;
+
+/* How code_gen_buffer is backed; set from -accel tcg,tb-hugepages= */
+enum {
+    TB_HUGEPAGES_OFF,           /* host pages only */
+    TB_HUGEPAGES_THP,           /* madvise for transparent huge pages */
+    TB_HUGEPAGES_HUGETLB,       /* MAP_HUGETLB, falling back to THP */
+};
+extern int tb_hugepages;
+
 /* Hide the atomic_read to make code a little easier on the eyes */
 static inline uint32_t tb_cflags(const TranslationBlock *tb)
 {
@@ -396,7 +441,8 @@ static inline uint32_t tb_cflags(const TranslationBlock *tb)
 static inline uint32_t curr_cflags(void)
 {
     return (parallel_cpus ? CF_PARALLEL : 0)
-         | (use_icount ? CF_USE_ICOUNT : 0);
+         | (use_icount ? CF_USE_ICOUNT : 0)
+         | (use_icount_quantum ? CF_QUANTUM : 0);
 }
 
 void tb_remove(TranslationBlock *tb);
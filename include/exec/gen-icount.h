@@ -2,6 +2,7 @@
 #define GEN_ICOUNT_H
 
 #include "qemu/timer.h"
+#include "exec/tb-stats.h"
 
 /* Helpers for instruction counting code generation.  */
 
@@ -12,7 +13,26 @@ static inline void gen_tb_start(TranslationBlock *tb)
     TCGv_i32 count, imm;
 
     tcg_ctx->exitreq_label = gen_new_label();
-    if (tb_cflags(tb) & CF_USE_ICOUNT) {
+
+    if (tb->hot_count) {
+        /* Count down the entries, and once they run out leave before
+         * anything was executed so that the main loop retranslates
+         * the TB as a superblock.
+         */
+        TCGv_ptr phot = tcg_const_ptr(&tb->hot_count);
+        TCGLabel *cold = gen_new_label();
+
+        count = tcg_temp_new_i32();
+        tcg_gen_ld_i32(count, phot, 0);
+        tcg_gen_subi_i32(count, count, 1);
+        tcg_gen_st_i32(count, phot, 0);
+        tcg_gen_brcondi_i32(TCG_COND_GT, count, 0, cold);
+        tcg_gen_exit_tb((uintptr_t)tb + TB_EXIT_HOT);
+        gen_set_label(cold);
+        tcg_temp_free_i32(count);
+        tcg_temp_free_ptr(phot);
+    }
+    if (tb_cflags(tb) & (CF_USE_ICOUNT | CF_QUANTUM)) {
         count = tcg_temp_local_new_i32();
     } else {
         count = tcg_temp_new_i32();
@@ -21,7 +41,7 @@ static inline void gen_tb_start(TranslationBlock *tb)
     tcg_gen_ld_i32(count, cpu_env,
                    -ENV_OFFSET + offsetof(CPUState, icount_decr.u32));
 
-    if (tb_cflags(tb) & CF_USE_ICOUNT) {
+    if (tb_cflags(tb) & (CF_USE_ICOUNT | CF_QUANTUM)) {
         imm = tcg_temp_new_i32();
         /* We emit a movi with a dummy immediate argument. Keep the insn index
          * of the movi so that we later (when we know the actual insn count)
@@ -35,17 +55,37 @@ static inline void gen_tb_start(TranslationBlock *tb)
 
     tcg_gen_brcondi_i32(TCG_COND_LT, count, 0, tcg_ctx->exitreq_label);
 
-    if (tb_cflags(tb) & CF_USE_ICOUNT) {
+    if (tb_cflags(tb) & (CF_USE_ICOUNT | CF_QUANTUM)) {
         tcg_gen_st16_i32(count, cpu_env,
                          -ENV_OFFSET + offsetof(CPUState, icount_decr.u16.low));
     }
 
     tcg_temp_free_i32(count);
+
+    if (tb->tb_stats) {
+        /* Count executions inline, so that chaining stays on.  */
+        TCGv_ptr pexec = tcg_const_ptr(&tb->tb_stats->executions);
+        TCGv_i64 n = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(n, pexec, 0);
+        tcg_gen_addi_i64(n, n, 1);
+        tcg_gen_st_i64(n, pexec, 0);
+        tcg_temp_free_i64(n);
+        tcg_temp_free_ptr(pexec);
+    }
+
+    if (tb_cflags(tb) & CF_ETRACE) {
+        /* Record the execution from within the TB so chaining stays on.  */
+        TCGv_ptr ptb = tcg_const_ptr(tb);
+
+        gen_helper_etrace_exec_tb(cpu_env, ptb);
+        tcg_temp_free_ptr(ptb);
+    }
 }
 
 static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
 {
-    if (tb_cflags(tb) & CF_USE_ICOUNT) {
+    if (tb_cflags(tb) & (CF_USE_ICOUNT | CF_QUANTUM)) {
         /* Update the num_insn immediate parameter now that we know
          * the actual insn count.  */
         tcg_set_insn_param(icount_start_insn_idx, 1, num_insns);
@@ -76,6 +76,21 @@ typedef struct MemoryTransaction
     void *opaque;
 } MemoryTransaction;
 
+/*
+ * A burst of iov_size(iov, iovcnt) bytes starting at addr, see
+ * MemoryRegionOps.access_burst.
+ */
+typedef struct MemoryBurstTransaction
+{
+    const struct iovec *iov;
+    int iovcnt;
+    bool rw;
+    hwaddr addr;
+    uint64_t size;
+    MemTxAttrs attr;
+    void *opaque;
+} MemoryBurstTransaction;
+
 struct MemoryRegionMmio {
     CPUReadMemoryFunc *read[3];
     CPUWriteMemoryFunc *write[3];
@@ -146,6 +161,12 @@ struct MemoryRegionOps {
     /* FIXME: Remove */
     void (*access)(MemoryTransaction *tr);
 
+    /* Optional. Accesses wider than valid.max_access_size are handed over
+     * whole, as a single burst, instead of being split into accesses. The
+     * burst never crosses the end of the region.
+     */
+    MemTxResult (*access_burst)(MemoryBurstTransaction *tr);
+
     /* Read from the memory region. @addr is relative to @mr; @size is
      * in bytes. */
     uint64_t (*read)(void *opaque,
@@ -289,6 +310,7 @@ struct MemoryRegion {
     unsigned ioeventfd_nb;
     MemoryRegionIoeventfd *ioeventfds;
     char *filename;
+    char *memdev; /* memory backend aliased in place of RAM of its own */
 };
 
 struct IOMMUMemoryRegion {
@@ -296,6 +318,16 @@ struct IOMMUMemoryRegion {
 
     QLIST_HEAD(, IOMMUNotifier) iommu_notify;
     IOMMUNotifierFlag iommu_notify_flags;
+
+    /* CPU TLBs may hold translations made through this region.  */
+    bool cpu_tlb_cached;
+
+    /* Translations only depend on the address, the direction and the
+     * requester_id and secure attributes, and every change is announced
+     * through memory_region_notify_iommu() or
+     * memory_region_iommu_invalidate_cpu_tlbs().  Lets DMA reuse them.
+     */
+    bool dma_cacheable;
 };
 
 #define IOMMU_NOTIFIER_FOREACH(n, mr) \
@@ -655,6 +687,30 @@ void memory_region_init_rom_device_nomigrate(MemoryRegion *mr,
                                              uint64_t size,
                                              Error **errp);
 
+/**
+ * memory_region_init_rom_device_ptr:  Initialize a ROM memory region from a
+ *                                     user-provided pointer. Writes are
+ *                                     handled via callbacks.
+ *
+ * Note that this function does not do anything to cause the data in the
+ * RAM side of the memory region to be migrated; that is the responsibility
+ * of the caller.
+ *
+ * @mr: the #MemoryRegion to be initialized.
+ * @owner: the object that tracks the region's reference count
+ * @ops: callbacks for write access handling (must not be NULL).
+ * @name: the name of the region.
+ * @size: size of the region.
+ * @ptr: memory to be mapped; must contain at least @size bytes.
+ */
+void memory_region_init_rom_device_ptr(MemoryRegion *mr,
+                                       struct Object *owner,
+                                       const MemoryRegionOps *ops,
+                                       void *opaque,
+                                       const char *name,
+                                       uint64_t size,
+                                       void *ptr);
+
 /**
  * memory_region_init_reservation: Initialize a memory region that reserves
  *                                 I/O space.
@@ -902,6 +958,20 @@ uint64_t memory_region_iommu_get_min_page_size(IOMMUMemoryRegion *iommu_mr);
 void memory_region_notify_iommu(IOMMUMemoryRegion *iommu_mr,
                                 IOMMUTLBEntry entry);
 
+/**
+ * memory_region_iommu_invalidate_cpu_tlbs: drop the CPU TLB entries that
+ * cache translations made through an IOMMU
+ *
+ * When an IOMMU translates into RAM, the CPU TLBs install plain RAM
+ * entries so that later guest accesses bypass the IOMMU altogether.
+ * Protection units that change their translations must call this to
+ * have those entries dropped. It does nothing unless a CPU has filled
+ * its TLB through @iommu_mr since the last call.
+ *
+ * @iommu_mr: the memory region whose translations changed
+ */
+void memory_region_iommu_invalidate_cpu_tlbs(IOMMUMemoryRegion *iommu_mr);
+
 /**
  * memory_region_notify_one: notify a change in an IOMMU translation
  *                           entry to a single notifier
@@ -1607,6 +1677,24 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
                                          unsigned size,
                                          MemTxAttrs attrs);
 
+/**
+ * memory_region_dispatch_burst: perform a burst access directly to the
+ * specified MemoryRegion. The region must implement access_burst.
+ *
+ * @mr: #MemoryRegion to access
+ * @addr: address within that region
+ * @iov: the data to write or the buffers to read into
+ * @iovcnt: number of elements in @iov
+ * @is_write: indicates the transfer direction
+ * @attrs: memory transaction attributes to use for the access
+ */
+MemTxResult memory_region_dispatch_burst(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         const struct iovec *iov,
+                                         int iovcnt,
+                                         bool is_write,
+                                         MemTxAttrs attrs);
+
 /**
  * address_space_init: initializes an address space
  *
@@ -1916,6 +2004,21 @@ bool address_space_access_valid(AddressSpace *as, hwaddr addr, int len, bool is_
 void *address_space_map(AddressSpace *as, hwaddr addr,
                         hwaddr *plen, bool is_write);
 
+/* address_space_map_ram: map RAM for zero-copy DMA
+ *
+ * Same as address_space_map() but honours @attrs and returns %NULL rather
+ * than bouncing accesses that can't be done directly on host memory. Unmap
+ * with address_space_unmap().
+ *
+ * @as: #AddressSpace to be accessed
+ * @addr: address within that address space
+ * @plen: pointer to length of buffer; updated on return
+ * @is_write: indicates the transfer direction
+ * @attrs: memory transaction attributes of the master
+ */
+void *address_space_map_ram(AddressSpace *as, hwaddr addr, hwaddr *plen,
+                            bool is_write, MemTxAttrs attrs);
+
 /* address_space_unmap: Unmaps a memory region previously mapped by address_space_map()
  *
  * Will also mark the memory as dirty if @is_write == %true.  @access_len gives
@@ -0,0 +1,44 @@
+/*
+ * MMIO access profiling
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef MMIO_PROFILE_H
+#define MMIO_PROFILE_H
+
+#include "exec/memory.h"
+
+extern bool mmio_profile_enabled;
+extern __thread const char *mmio_profile_caller;
+
+/* Account an access of @size bytes to @mr, taking @ns in the device.  */
+void mmio_profile_account(MemoryRegion *mr, bool is_write, uint64_t size,
+                          int64_t ns);
+
+/* Keep the profile of @mr around after it is gone.  */
+void mmio_profile_region_finalize(MemoryRegion *mr);
+
+/* Attribute the accesses until mmio_profile_caller_pop to @caller,
+ * unless an outer caller already claimed them.  @caller must stay valid
+ * until then.
+ */
+static inline const char *mmio_profile_caller_push(const char *caller)
+{
+    const char *old = mmio_profile_caller;
+
+    if (!old) {
+        mmio_profile_caller = caller;
+    }
+    return old;
+}
+
+static inline void mmio_profile_caller_pop(const char *old)
+{
+    mmio_profile_caller = old;
+}
+
+#endif
@@ -39,6 +39,7 @@ struct TBContext {
     /* statistics */
     unsigned tb_flush_count;
     int tb_phys_invalidate_count;
+    unsigned tb_evict_count; /* code regions evicted */
 };
 
 extern TBContext tb_ctx;
@@ -0,0 +1,27 @@
+/*
+ * Guest code coverage
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef TB_COVERAGE_H
+#define TB_COVERAGE_H
+
+extern bool tb_coverage_enabled;
+
+/* Start collecting coverage and write it to @path when QEMU exits.  */
+void tb_coverage_init(const char *path);
+
+#ifdef NEED_CPU_H
+#include "exec/exec-all.h"
+
+/* Mark the guest code of @tb as executed and clear its CF_COVERAGE.
+ * @cpu must be about to run @tb, so that its MMU state maps @tb->pc.
+ */
+void tb_coverage_mark(CPUState *cpu, TranslationBlock *tb);
+#endif
+
+#endif
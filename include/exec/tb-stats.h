@@ -0,0 +1,59 @@
+/*
+ * Translation block statistics
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef TB_STATS_H
+#define TB_STATS_H
+
+#include "exec/exec-all.h"
+#include "tcg/tcg.h"
+
+/* Statistics of a guest code block, kept across its translations.  */
+typedef struct TBStatistics {
+    tb_page_addr_t phys_pc;
+    target_ulong pc;
+    target_ulong cs_base;
+    uint32_t flags;
+
+    /* Protected by the table lock.  */
+    unsigned int guest_insns;
+    size_t host_bytes;
+    uint64_t translations;
+    uint64_t translate_ns;
+
+    /* Updated by the generated code and the execution loop of any vCPU,
+     * without synchronization: concurrent updates may get lost.
+     */
+    uint64_t executions;
+    uint64_t unchained_exits;
+    uint64_t interrupted;
+    uint64_t faults;
+} TBStatistics;
+
+extern bool tb_stats_enabled;
+
+/* Statistics of the block about to be translated at @pc.  */
+TBStatistics *tb_stats_get(tb_page_addr_t phys_pc, target_ulong pc,
+                           target_ulong cs_base, uint32_t flags);
+
+/* Account a translation of @tb that took @ns.  */
+void tb_stats_translated(TranslationBlock *tb, int64_t ns);
+
+/* Account the return of the generated code with TB_EXIT_* @tb_exit.  */
+static inline void tb_stats_exit(TranslationBlock *tb, int tb_exit)
+{
+    TBStatistics *s = tb->tb_stats;
+
+    if (tb_exit <= TB_EXIT_IDX1) {
+        s->unchained_exits++;
+    } else {
+        s->interrupted++;
+    }
+}
+
+#endif
@@ -141,4 +141,21 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_follow_branch:
+ * @db: Disassembly context.
+ * @dest: Guest address translation would carry on at.
+ *
+ * Return true if the TB is a superblock (CF_SUPERBLOCK) and translation
+ * may go on at @dest rather than ending the TB at the current direct
+ * branch.  The caller either follows an unconditional branch to @dest,
+ * or keeps translating the fall through path at @dest and leaves the TB
+ * through a side exit when the branch is taken.
+ *
+ * Only forward targets within the first page of the TB are accepted, so
+ * [pc_first, pc_next) still covers all the guest code translated and
+ * page invalidation keeps working.
+ */
+bool translator_follow_branch(DisasContextBase *db, target_ulong dest);
+
 #endif  /* EXEC__TRANSLATOR_H */
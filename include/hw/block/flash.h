@@ -39,6 +39,9 @@ void nand_setpins(DeviceState *dev, uint8_t cle, uint8_t ale,
 void nand_getpins(DeviceState *dev, int *rb);
 void nand_setio(DeviceState *dev, uint32_t value);
 uint32_t nand_getio(DeviceState *dev);
+/* Same as @len 8-bit nand_getio()/nand_setio() data cycles */
+void nand_getio_buf(DeviceState *dev, uint8_t *buf, int len);
+void nand_setio_buf(DeviceState *dev, const uint8_t *buf, int len);
 uint32_t nand_getbuswidth(DeviceState *dev);
 
 #define NAND_MFR_TOSHIBA	0x98
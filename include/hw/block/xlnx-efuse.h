@@ -31,6 +31,7 @@
 #define TYPE_XLNX_EFUSE "xlnx.efuse"
 #include "hw/ptimer.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/sysemu.h"
 
 #define XLNX_EFUSE(obj) \
      OBJECT_CHECK(XLNXEFuse, (obj), TYPE_XLNX_EFUSE)
@@ -48,6 +49,12 @@ typedef struct XLNXEFuse {
     bool blk_ro;
     uint32_t *fuse32;
 
+    /* Programmed bytes [wb_start, wb_end) not yet written back to blk.  */
+    uint32_t wb_start;
+    uint32_t wb_end;
+    QEMUTimer *wb_timer;
+    VMChangeStateEntry *wb_vmstate;
+
     void (*pgm_done)(DeviceState *dev, bool failed);
     DeviceState *dev;
 
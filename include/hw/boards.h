@@ -226,6 +226,7 @@ struct MachineState {
     int kvm_shadow_mem;
     char *dtb;
     char *hw_dtb;
+    char *fdt_plan_cache;
     char *dumpdtb;
     bool is_linux;
     int phandle_start;
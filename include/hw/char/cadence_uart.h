@@ -47,6 +47,8 @@ typedef struct {
     CharBackend chr;
     qemu_irq irq;
     QEMUTimer *fifo_trigger_handle;
+    /* Sends what is left in tx_fifo once the guest stops writing.  */
+    QEMUTimer *tx_flush_timer;
 } CadenceUARTState;
 
 static inline DeviceState *cadence_uart_create(hwaddr addr,
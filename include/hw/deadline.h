@@ -0,0 +1,84 @@
+/*
+ * Shared deadline service for device timeouts
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef HW_DEADLINE_H
+#define HW_DEADLINE_H
+
+#include "qemu/queue.h"
+#include "migration/vmstate.h"
+
+/*
+ * Timeouts, pulse widths and other one-shot events that devices would
+ * otherwise arm a private QEMUTimer or ptimer/bottom-half pair for.
+ *
+ * A Deadline is embedded in the device state, nothing is allocated.  All
+ * pending deadlines share a single QEMU_CLOCK_VIRTUAL timer that only
+ * tracks the earliest one.  Callbacks run from the timer callback, with
+ * the iothread lock held.  Deadlines are meant to be few and rarely
+ * pending at the same time; periodic, high rate events should keep
+ * using their own QEMUTimer.
+ */
+
+typedef void DeadlineCB(void *opaque);
+
+typedef struct Deadline {
+    DeadlineCB *cb;
+    void *opaque;
+    int64_t expire_ns;
+    QLIST_ENTRY(Deadline) next;
+} Deadline;
+
+/**
+ * deadline_init:
+ * @d: the deadline
+ * @cb: the callback to run when it expires
+ * @opaque: the opaque pointer to pass to the callback
+ */
+void deadline_init(Deadline *d, DeadlineCB *cb, void *opaque);
+
+/**
+ * deadline_mod_ns:
+ * @d: the deadline
+ * @expire_ns: the QEMU_CLOCK_VIRTUAL time to expire at
+ *
+ * Arm @d, replacing any previous expiry time.
+ */
+void deadline_mod_ns(Deadline *d, int64_t expire_ns);
+
+/**
+ * deadline_mod_delay_ns:
+ * @d: the deadline
+ * @delay_ns: how long from now to expire
+ */
+void deadline_mod_delay_ns(Deadline *d, int64_t delay_ns);
+
+/**
+ * deadline_del:
+ * @d: the deadline
+ *
+ * Disarm @d, a no-op if it is not pending.
+ */
+void deadline_del(Deadline *d);
+
+/**
+ * deadline_pending:
+ * @d: the deadline
+ *
+ * Returns: true if @d is armed and has not expired yet
+ */
+static inline bool deadline_pending(Deadline *d)
+{
+    return d->expire_ns >= 0;
+}
+
+extern const VMStateDescription vmstate_deadline;
+
+#define VMSTATE_DEADLINE(_field, _state)                             \
+    VMSTATE_STRUCT(_field, _state, 0, vmstate_deadline, Deadline)
+
+#endif
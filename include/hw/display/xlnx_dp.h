@@ -38,7 +38,6 @@
 #define XLNX_DP_H
 
 #define AUD_CHBUF_MAX_DEPTH                 32768
-#define MAX_QEMU_BUFFER_SIZE                4096
 
 #define DP_CORE_REG_ARRAY_SIZE              (0x3AF >> 2)
 #define DP_AVBUF_REG_ARRAY_SIZE             (0x238 >> 2)
@@ -84,7 +83,6 @@ typedef struct XlnxDPState {
     int16_t audio_buffer_0[AUD_CHBUF_MAX_DEPTH];
     int16_t audio_buffer_1[AUD_CHBUF_MAX_DEPTH];
     size_t audio_data_available[2];
-    int64_t temp_buffer[AUD_CHBUF_MAX_DEPTH];
     int16_t out_buffer[AUD_CHBUF_MAX_DEPTH];
     size_t byte_left; /* byte available in out_buffer. */
     size_t data_ptr;  /* next byte to be sent to QEMU. */
@@ -106,6 +104,8 @@ typedef struct XlnxDPState {
 
     ptimer_state *vblank;
     QEMUBH *bh;
+    /* Redraw the whole frame, not only what the DPDMA fetched anew */
+    bool full_update;
 } XlnxDPState;
 
 #define TYPE_XLNX_DP "xlnx.v-dp"
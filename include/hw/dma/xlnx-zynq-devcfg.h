@@ -50,6 +50,12 @@ typedef struct XlnxZynqDevcfg {
 
     MemoryRegion iomem;
     qemu_irq irq;
+    QEMUTimer *dma_timer;
+
+    /* Bytes per second of QEMU_CLOCK_VIRTUAL that the PCAP moves, 0
+     * completes every command from the register write that queued it.
+     */
+    uint64_t bandwidth;
 
     XlnxZynqDevcfgDMACmd dma_cmd_fifo[XLNX_ZYNQ_DEVCFG_DMA_CMD_FIFO_LEN];
     uint8_t dma_cmd_fifo_num;
@@ -31,6 +31,16 @@
 
 #define XLNX_DPDMA_REG_ARRAY_SIZE (0x1000 >> 2)
 
+/* What the last contiguous frame fetch of a channel copied where.  */
+typedef struct XlnxDPDMAFrameCache {
+    MemoryRegion *mr;
+    hwaddr offset;
+    uint32_t line_size;
+    uint32_t line_stride;
+    uint32_t lines;
+    uint8_t *data;
+} XlnxDPDMAFrameCache;
+
 struct XlnxDPDMAState {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -42,6 +52,15 @@ struct XlnxDPDMAState {
     uint8_t *data[6];
     bool operation_finished[6];
     qemu_irq irq;
+
+    /* Fetch frames straight from RAM, skipping lines the guest didn't
+     * touch since the previous frame.
+     */
+    bool map_fb;
+    XlnxDPDMAFrameCache fb[6];
+    /* Bytes of data[] written since xlnx_dpdma_take_dirty(), end exclusive */
+    size_t dirty_start[6];
+    size_t dirty_end[6];
 };
 
 typedef struct XlnxDPDMAState XlnxDPDMAState;
@@ -77,6 +96,21 @@ size_t xlnx_dpdma_start_operation(XlnxDPDMAState *s, uint8_t channel,
 void xlnx_dpdma_set_host_data_location(XlnxDPDMAState *s, uint8_t channel,
                                        void *p);
 
+/*
+ * xlnx_dpdma_take_dirty: Get the bytes of the host buffer of a channel that
+ *                        changed since the last call, and forget them.
+ *
+ * Returns false if nothing changed.  Contiguous frame fetches of the mapped
+ * framebuffer only count the lines the guest wrote to.
+ *
+ * @s The DPDMA state.
+ * @channel The channel.
+ * @start Set to the first byte that changed.
+ * @end Set to the byte after the last one that changed.
+ */
+bool xlnx_dpdma_take_dirty(XlnxDPDMAState *s, uint8_t channel,
+                           size_t *start, size_t *end);
+
 /*
  * xlnx_dpdma_trigger_vsync_irq: Trigger a VSYNC IRQ when the display is
  *                               updated.
@@ -34,12 +34,22 @@ typedef struct FDTMachineInfo {
     void *fdt;
     /* irq descriptors for top level int controller */
     qemu_irq *irq_base;
-    /* per-device specific opaques */
-    FDTDevOpaque *dev_opaques;
+    /* per-device specific opaques, FDTDevOpaque keyed by node path */
+    GHashTable *dev_opaques;
+    /* node paths keyed by phandle */
+    GHashTable *phandles;
     /* recheck coroutine queue */
     CoQueue *cq;
+    /* per node wait queues, keyed by node path */
+    GHashTable *waiters;
+    /* bumped whenever a node makes progress */
+    unsigned int progress;
     /* list of all IRQ connections */
     FDTIRQConnection *irqs;
+    /* machine plan, see fdt_plan_load */
+    GHashTable *plan;
+    char *plan_hash;
+    bool plan_loaded;
 } FDTMachineInfo;
 
 /* create a new FDTMachineInfo. The client is responsible for setting irq_base.
@@ -79,12 +89,66 @@ void dump_inst_bind_table(void);
 
 void fdt_init_yield(FDTMachineInfo *);
 
+/* Targeted variants of the above. The caller only resumes once the named
+ * node changes state, rather than on every state change in the machine.
+ *
+ * fdt_init_wait_opaque waits until node_path has an opaque and returns it.
+ * fdt_init_wait_realized waits until dev, the device of node_path, is
+ * realized. fdt_init_node_notify wakes the waiters on node_path.
+ */
+
+void *fdt_init_wait_opaque(FDTMachineInfo *fdti, char *node_path);
+void fdt_init_wait_realized(FDTMachineInfo *fdti, char *node_path,
+                            DeviceState *dev);
+void fdt_init_node_notify(FDTMachineInfo *fdti, const char *node_path);
+
+/* Run suspended node inits until nothing makes progress anymore. Returns
+ * false if some node is still waiting for a dependency.
+ */
+
+bool fdt_init_run(FDTMachineInfo *fdti);
+
 /* set, check and get per device opaques. Keyed by fdt node_paths */
 
 void fdt_init_set_opaque(FDTMachineInfo *fdti, char *node_path, void *opaque);
 int fdt_init_has_opaque(FDTMachineInfo *fdti, char *node_path);
 void *fdt_init_get_opaque(FDTMachineInfo *fdti, char *node_path);
 
+/* same as qemu_devtree_get_node_by_phandle but served from an index built
+ * when fdti is created.
+ */
+
+int fdt_init_get_node_by_phandle(FDTMachineInfo *fdti, char *node_path,
+                                 uint32_t phandle);
+
+/* Machine plans cache how each node got bound to a device model, so later
+ * runs off the same DTB skip the matching. Plans live in a directory, one
+ * file per DTB hash.
+ */
+
+typedef enum FDTPlanKind {
+    FDT_PLAN_NONE = 0,      /* nothing matched, compatible invalidated */
+    FDT_PLAN_INST_BIND,     /* instance binding on the node name */
+    FDT_PLAN_COMPAT,        /* compat table entry, arg is the key */
+    FDT_PLAN_QDEV,          /* QOM type, arg is the type name */
+} FDTPlanKind;
+
+typedef struct FDTPlanEntry {
+    FDTPlanKind kind;
+    char *arg;
+} FDTPlanEntry;
+
+/* Load the plan matching fdti->fdt from dir, else prepare for recording
+ * one. Returns true if a plan was loaded.
+ */
+
+bool fdt_plan_load(FDTMachineInfo *fdti, const char *dir);
+void fdt_plan_save(FDTMachineInfo *fdti, const char *dir);
+const FDTPlanEntry *fdt_plan_lookup(FDTMachineInfo *fdti,
+                                    const char *node_path);
+void fdt_plan_record(FDTMachineInfo *fdti, const char *node_path,
+                     FDTPlanKind kind, const char *arg);
+
 /* statically register a FDTInitFn as being associate with a compatibility */
 
 #define fdt_register_compatibility_opaque(function, compat, n, opaque) \
@@ -198,6 +198,13 @@ static const FDTGenericGPIONameSet fdt_generic_gpio_name_set_interrupts = {
     .names_propname = "interrupt-names",
 };
 
+/* Connects GPIO vectors, see GPIO_VECTOR_IN_NAME.  */
+static const FDTGenericGPIONameSet fdt_generic_gpio_name_set_gpio_vector = {
+    .propname = "gpio-vectors",
+    .cells_propname = "#gpio-vector-cells",
+    .names_propname = "gpio-vector-names",
+};
+
 static const FDTGenericGPIOSet default_gpio_sets [] = {
     { .names = &fdt_generic_gpio_name_set_gpio },
     {
@@ -220,6 +227,13 @@ static const FDTGenericGPIOSet default_gpio_sets [] = {
     },
     { .names = &fdt_generic_gpio_name_set_clock },
     { .names = &fdt_generic_gpio_name_set_interrupts },
+    {
+      .names = &fdt_generic_gpio_name_set_gpio_vector,
+      .gpios = (FDTGenericGPIOConnection[]) {
+        { .name = GPIO_VECTOR_IN_NAME, .fdt_index = 0, .range = 32 },
+        { },
+      },
+    },
     { },
 };
 
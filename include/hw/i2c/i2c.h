@@ -42,6 +42,16 @@ typedef struct I2CSlaveClass
      */
     int (*recv)(I2CSlave *s);
 
+    /*
+     * Optional transaction level versions of send and recv, for slaves
+     * that can move a whole data phase at once.  send_buf returns the
+     * number of bytes acknowledged, stopping after the first NAK.
+     * recv_buf must fill all of @buf and returns @len.  The bus falls
+     * back to send and recv for slaves without them.
+     */
+    int (*send_buf)(I2CSlave *s, const uint8_t *buf, int len);
+    int (*recv_buf)(I2CSlave *s, uint8_t *buf, int len);
+
     /*
      * Notify the slave of a bus state change.  For start event,
      * returns non-zero to NAK an operation.  For other events the
@@ -80,6 +90,8 @@ void i2c_nack(I2CBus *bus);
 int i2c_send_recv(I2CBus *bus, uint8_t *data, bool send);
 int i2c_send(I2CBus *bus, uint8_t data);
 int i2c_recv(I2CBus *bus);
+int i2c_send_buf(I2CBus *bus, const uint8_t *buf, int len);
+int i2c_recv_buf(I2CBus *bus, uint8_t *buf, int len);
 
 DeviceState *i2c_create_slave(I2CBus *bus, const char *name, uint8_t addr);
 
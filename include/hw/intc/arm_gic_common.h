@@ -22,6 +22,7 @@
 #define HW_ARM_GIC_COMMON_H
 
 #include "hw/sysbus.h"
+#include "qemu/bitmap.h"
 
 /* Maximum number of possible interrupts, determined by the GIC architecture */
 #define GIC_MAXIRQ 1020
@@ -82,6 +83,12 @@ typedef struct GICState {
     uint32_t cpu_ctlr[GIC_NCPU];
 
     gic_irq_state irq_state[GIC_MAXIRQ];
+    /* Interrupts that may be both enabled and pending, for some CPU.  Bits
+     * are set when an interrupt gets enabled, pending or its level raised,
+     * and cleared again by gic_update() once it is neither, so that the
+     * scans for the best pending interrupt only visit these.
+     */
+    DECLARE_BITMAP(irq_maybe_pending, GIC_MAXIRQ);
     uint8_t irq_target[GIC_MAXIRQ];
     uint8_t priority1[GIC_INTERNAL][GIC_NCPU];
     uint8_t priority2[GIC_MAXIRQ - GIC_INTERNAL];
@@ -17,10 +17,19 @@ struct IRQState {
     qemu_irq_handler handler;
     void *opaque;
     int n;
+    /* Set while irq-stats counts the updates of this line.  */
+    struct IRQStats *stats;
 };
 
 void qemu_set_irq(qemu_irq irq, int level);
 
+/* See irq-stats.c.  irq_stats_account returns false for the updates the
+ * rate limit drops.
+ */
+extern bool irq_stats_enabled;
+bool irq_stats_account(qemu_irq irq, int level, void *caller);
+void irq_stats_release(qemu_irq irq);
+
 static inline void qemu_irq_raise(qemu_irq irq)
 {
     qemu_set_irq(irq, 1);
@@ -37,6 +46,16 @@ static inline void qemu_irq_pulse(qemu_irq irq)
     qemu_set_irq(irq, 0);
 }
 
+/* A GPIO vector carries up to 32 lines of a GPIO bank through one qemu_irq,
+ * its level holds line n in bit n.  A bank that changes many lines at once
+ * updates its vector once instead of once per line, sinks find the lines
+ * that changed by comparing with the previous level.  Devices provide them
+ * as the named GPIOs below, one per bank, next to their single lines.
+ * Vectors cannot be inverted or shared between several sources.
+ */
+#define GPIO_VECTOR_IN_NAME "gpio-vector-in"
+#define GPIO_VECTOR_OUT_NAME "gpio-vector-out"
+
 /* Returns an array of N IRQs. Each IRQ is assigned the argument handler and
  * opaque data.
  */
@@ -19,6 +19,17 @@
 typedef struct SSSBase SSSBase;
 typedef struct SSSStream SSSStream;
 
+/* Data a consumer of a fanned out stream has not taken yet.  */
+typedef struct SSSBacklog {
+    SSSBase *sss;
+    int rx;
+    int tx;
+    uint8_t *buf;
+    size_t len;
+    size_t pos;
+    uint32_t attr;
+} SSSBacklog;
+
 struct SSSStream {
     DeviceState parent_obj;
 
@@ -34,6 +45,7 @@ struct SSSBase {
     uint32_t (*get_sss_regfield)(SSSBase *, int);
     StreamCanPushNotifyFn *notifys;
     void **notify_opaques;
+    SSSBacklog *backlog;
 
     const uint32_t *sss_population;
     const int *r_sss_shifts;
@@ -42,5 +54,7 @@ struct SSSBase {
 };
 
 void sss_notify_all(SSSBase *s);
+/* Discards data still buffered for slow consumers, e.g on reset.  */
+void sss_drop_backlog(SSSBase *s);
 
 #endif
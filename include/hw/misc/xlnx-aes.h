@@ -32,9 +32,23 @@
 
 #define TYPE_XLNX_AES "xlnx-aes"
 
+#define XLNX_AES_KEY_CACHE_LEN 4
+
+/* Expanded key schedule and GHASH tables of a key, as gcm_init() leaves
+ * them before any message.
+ */
+typedef struct XlnxAESKeyCache {
+    bool valid;
+    uint16_t keylen;
+    uint32_t key[8];
+    gcm_context gcm_ctx;
+} XlnxAESKeyCache;
+
 typedef struct XlnxAES {
     DeviceState parent_obj;
     gcm_context gcm_ctx;
+    XlnxAESKeyCache key_cache[XLNX_AES_KEY_CACHE_LEN];
+    unsigned int key_cache_next;
     const char *prefix;
     qemu_irq s_done;
     qemu_irq s_busy;
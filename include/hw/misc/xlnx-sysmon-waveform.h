@@ -0,0 +1,43 @@
+/*
+ * Scripted sensor waveforms for the Xilinx system monitors
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef XLNX_SYSMON_WAVEFORM_H
+#define XLNX_SYSMON_WAVEFORM_H
+
+/*
+ * A waveform file has one sensor channel per line:
+ *
+ *   <channel> <step-ns> <sample> [<sample> ...]
+ *
+ * <channel> is the name of the channel's sample register (e.g TEMPERATURE).
+ * The samples are raw register codes, each held for <step-ns> nanoseconds
+ * of virtual time, and the sequence repeats.  Empty lines and lines
+ * starting with '#' are ignored.
+ *
+ * Samples are looked up from the virtual time when the guest reads the
+ * register, nothing runs in between.
+ */
+typedef struct XlnxSysmonWaveform {
+    char *name;
+    int64_t step_ns;
+    uint32_t nb_samples;
+    uint16_t *samples;
+} XlnxSysmonWaveform;
+
+typedef struct XlnxSysmonWaveforms {
+    unsigned int nb;
+    XlnxSysmonWaveform *w;
+} XlnxSysmonWaveforms;
+
+bool xlnx_sysmon_waveforms_load(XlnxSysmonWaveforms *ws, const char *path,
+                                Error **errp);
+const XlnxSysmonWaveform *xlnx_sysmon_waveform_find(XlnxSysmonWaveforms *ws,
+                                                    const char *name);
+uint16_t xlnx_sysmon_waveform_sample(const XlnxSysmonWaveform *w);
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * QEMU model of the Versal NoC NMU (NoC Master Unit)
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef XLNX_VERSAL_NOC_NMU_H
+#define XLNX_VERSAL_NOC_NMU_H
+
+#include "hw/sysbus.h"
+
+#define TYPE_XILINX_NOC_NMU "xlnx.noc-nmu"
+
+/* The address map registers hold address bits 47:16.  */
+#define NOC_NMU_ADDR_SHIFT 16
+
+/* Route the AXI address @addr through the address map of the NMU @nmu.
+ * Returns false if no enabled entry matches.  Otherwise *dst is set to the
+ * destination ID of the entry and *xaddr to the address, remapped if the
+ * entry asks for it.
+ */
+bool xlnx_noc_nmu_route(Object *nmu, uint64_t addr, uint64_t *xaddr,
+                        uint16_t *dst);
+
+#endif
@@ -28,8 +28,10 @@
 #define CADENCE_GEM(obj) OBJECT_CHECK(CadenceGEMState, (obj), TYPE_CADENCE_GEM)
 
 #include "net/net.h"
+#include "net/shaper.h"
 #include "hw/sysbus.h"
 #include "hw/mdio/mdio.h"
+#include "sysemu/iothread.h"
 
 #define CADENCE_GEM_MAXREG        (0x00000800 / 4) /* Last valid GEM address */
 
@@ -40,6 +42,9 @@
 #define MAX_TYPE1_SCREENERS             16
 #define MAX_TYPE2_SCREENERS             16
 
+/* RX descriptors fetched from the ring at a time.  */
+#define GEM_RX_DESC_CACHE               16
+
 typedef struct CadenceGEMState {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -79,10 +84,45 @@ typedef struct CadenceGEMState {
     uint32_t rx_desc_addr[MAX_PRIORITY_QUEUES];
     uint32_t tx_desc_addr[MAX_PRIORITY_QUEUES];
 
+    /* TX fragments that can't be used in place are copied here */
+    uint8_t *tx_bounce;
+    /* Waiting for the peer to drain before sending more */
+    bool tx_stalled;
+    /* The peer takes vnet headers, checksums and LSO are left to it */
+    bool vnet_hdr;
+
+    /* Wire speed in Mbit/s frames are paced to, 0 for as fast as possible */
+    uint32_t link_speed;
+    NetShaper rx_shaper;
+    NetShaper tx_shaper;
+
+    /* Transmit runs here when set, see gem_tx_bh() */
+    IOThread *iothread;
+    QEMUBH *tx_bh;
+    bool tx_kick;
+
     uint8_t can_rx_state; /* Debug only */
 
     uint32_t rx_desc[MAX_PRIORITY_QUEUES][DESC_MAX_NUM_WORDS];
 
+    /* RX descriptors fetched ahead, starting at rx_cache_addr. Those
+     * completed from rx_wb_first on are yet to be written back.
+     */
+    uint32_t rx_desc_cache[MAX_PRIORITY_QUEUES]
+                          [GEM_RX_DESC_CACHE * DESC_MAX_NUM_WORDS];
+    hwaddr rx_cache_addr[MAX_PRIORITY_QUEUES];
+    uint8_t rx_cache_num[MAX_PRIORITY_QUEUES];
+    uint8_t rx_cache_pos[MAX_PRIORITY_QUEUES];
+    uint8_t rx_wb_first[MAX_PRIORITY_QUEUES];
+    uint8_t rx_wb_num[MAX_PRIORITY_QUEUES];
+    QEMUBH *rx_bh;
+
+    /* Completion interrupts held back by moderation, one bit per queue */
+    uint8_t rx_cmpl_pending;
+    uint8_t tx_cmpl_pending;
+    QEMUTimer *rx_mod_timer;
+    QEMUTimer *tx_mod_timer;
+
     bool sar_active[4];
     MDIO *mdio;
 } CadenceGEMState;
@@ -68,6 +68,11 @@ typedef struct XlnxZynqMPCAN {
 
     uint16_t            rx_time_stamp;
 
+    /* Enabled acceptance filters, see can_update_rx_filters().  */
+    uint32_t            rx_filter_mask[4];
+    uint32_t            rx_filter_id[4];
+    uint8_t             rx_filter_num;
+
     Fifo                rx_fifo;
     Fifo                tx_fifo;
     Fifo                txhpb_fifo;
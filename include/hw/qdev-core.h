@@ -150,8 +150,12 @@ typedef struct PowerState {
     bool power;
     bool halt;
     bool active;
+    /* Timers of qdev_pm_add_timer() are stopped */
+    bool timers_gated;
 } PowerState;
 
+typedef struct PowerGatedTimer PowerGatedTimer;
+
 /**
  * DeviceState:
  * @realized: Indicates whether the device has been fully constructed.
@@ -177,6 +181,7 @@ struct DeviceState {
     int instance_id_alias;
     int alias_required_for_version;
     PowerState ps;
+    QLIST_HEAD(, PowerGatedTimer) pm_timers;
     uint64_t reset_level;
 };
 
@@ -327,6 +332,17 @@ BusState *qdev_get_child_bus(DeviceState *dev, const char *name);
 /* GPIO inputs also double as IRQ sinks.  */
 void qdev_init_gpio_in(DeviceState *dev, qemu_irq_handler handler, int n);
 void qdev_init_gpio_out(DeviceState *dev, qemu_irq *pins, int n);
+/**
+ * qdev_pm_add_timer: Suspend a timer while the device is powered off
+ * @dev: Device that owns @timer
+ * @timer: Timer of the device
+ *
+ * When the power state of @dev becomes inactive, @timer is stopped.  It is
+ * rearmed at its original expiry time, or right away if that has passed,
+ * once @dev is active again.  Gated devices so cost no host wakeups.
+ */
+void qdev_pm_add_timer(DeviceState *dev, QEMUTimer *timer);
+
 void qdev_init_gpio_in_named(DeviceState *dev, qemu_irq_handler handler,
                              const char *name, int n);
 void qdev_init_gpio_out_named(DeviceState *dev, qemu_irq *pins,
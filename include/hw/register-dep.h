@@ -211,6 +211,53 @@ void dep_register_trap_access(DepRegisterInfo *reg,
                               DepRegisterInfo *reg_debug,
                               DepRegisterAccessInfo *access);
 
+/**
+ * A block of registers behind a single MemoryRegion. Accesses are decoded
+ * through a dense index of 32 bit words, holes fail with a decode error.
+ *
+ * @mem: the MemoryRegion covering the whole block
+ * @index: registers indexed by offset / 4
+ * @nr_index: number of entries in @index
+ * @prefix: String prefix for log messages
+ */
+
+typedef struct DepRegisterBlock {
+    MemoryRegion mem;
+    DepRegisterInfo **index;
+    unsigned int nr_index;
+    const char *prefix;
+} DepRegisterBlock;
+
+/**
+ * Initialise a register block covering all of @container and map it there.
+ * @ops must use the dep_register_block_* accessors.
+ */
+
+void dep_register_block_init(DepRegisterBlock *b, Object *owner,
+                             const MemoryRegionOps *ops,
+                             MemoryRegion *container, const char *prefix);
+
+/**
+ * Add a register to a block at @offset, which must be aligned to the
+ * register size.
+ */
+
+void dep_register_block_add(DepRegisterBlock *b, DepRegisterInfo *reg,
+                            hwaddr offset);
+
+MemTxResult dep_register_block_read_be(void *opaque, hwaddr addr,
+                                       uint64_t *value, unsigned size,
+                                       MemTxAttrs attrs);
+MemTxResult dep_register_block_read_le(void *opaque, hwaddr addr,
+                                       uint64_t *value, unsigned size,
+                                       MemTxAttrs attrs);
+MemTxResult dep_register_block_write_be(void *opaque, hwaddr addr,
+                                        uint64_t value, unsigned size,
+                                        MemTxAttrs attrs);
+MemTxResult dep_register_block_write_le(void *opaque, hwaddr addr,
+                                        uint64_t value, unsigned size,
+                                        MemTxAttrs attrs);
+
 /* Define constants for a 32 bit register */
 
 #define DEP_REG32(reg, addr) \
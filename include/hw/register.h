@@ -14,10 +14,12 @@
 #include "hw/qdev-core.h"
 #include "exec/memory.h"
 #include "hw/registerfields.h"
+#include "migration/vmstate.h"
 
 typedef struct RegisterInfo RegisterInfo;
 typedef struct RegisterAccessInfo RegisterAccessInfo;
 typedef struct RegisterInfoArray RegisterInfoArray;
+typedef struct RegisterLookup RegisterLookup;
 
 /**
  * Access description for a register that is part of guest accessible device
@@ -98,8 +100,20 @@ struct RegisterInfo {
  * @num_elements is the number of elements in the array r
  *
  * @mem: optional Memory region for the register
+ *
+ * @lookup, @last: private, address sorted dispatch table built on first
+ * access and the most recently used entry of it
+ *
+ * @data, @reset_data, @reset_runs: private, the register data, a copy of
+ * it at reset and the runs of consecutive registers register_reset_block()
+ * copies back
  */
 
+typedef struct RegisterResetRun {
+    unsigned int start;
+    unsigned int len;
+} RegisterResetRun;
+
 struct RegisterInfoArray {
     MemoryRegion mem;
 
@@ -108,6 +122,14 @@ struct RegisterInfoArray {
 
     bool debug;
     const char *prefix;
+
+    RegisterLookup *lookup;
+    RegisterLookup *last;
+
+    uint32_t *data;
+    uint32_t *reset_data;
+    RegisterResetRun *reset_runs;
+    unsigned int num_reset_runs;
 };
 
 /**
@@ -141,6 +163,15 @@ uint64_t register_read(RegisterInfo *reg, uint64_t re, const char* prefix,
 
 void register_reset(RegisterInfo *reg);
 
+/**
+ * Reset all the registers of a block, as register_reset() does for each of
+ * them, by copying back a snapshot of their reset values. Registers the
+ * block doesn't describe are left alone.
+ * @r_array: Block of registers, as returned by register_init_block32()
+ */
+
+void register_reset_block(RegisterInfoArray *r_array);
+
 /**
  * Initialize a register.
  * @reg: Register to initialize
@@ -233,4 +264,25 @@ void register_trap_access(RegisterInfo *reg,
                           RegisterInfo *reg_d,
                           RegisterAccessInfo *access_d);
 
+extern const VMStateInfo vmstate_info_register_delta;
+
+/**
+ * VMSTATE_REGISTER_DELTA:
+ * Migrate the registers described by the RegisterInfo array @_field of
+ * @_num entries, as set up by register_init_block32().  Only registers
+ * that differ from their reset value are in the stream, the others are
+ * loaded back to it.  Values are loaded straight into the register
+ * storage, without running the pre_write or post_write hooks; devices
+ * that derive state from their registers recompute it in post_load, as
+ * with VMSTATE_UINT32_ARRAY.  Registers without a RegisterAccessInfo
+ * are not migrated.
+ */
+#define VMSTATE_REGISTER_DELTA(_field, _state, _num) {                     \
+    .name       = (stringify(_field)),                                   \
+    .size       = sizeof(RegisterInfo) * (_num),                         \
+    .info       = &vmstate_info_register_delta,                          \
+    .flags      = VMS_SINGLE,                                            \
+    .offset     = vmstate_offset_array(_state, _field, RegisterInfo, _num), \
+}
+
 #endif
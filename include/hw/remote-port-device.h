@@ -3,6 +3,7 @@
 
 #include "qemu-common.h"
 #include "qom/object.h"
+#include "qemu/notify.h"
 #include "hw/remote-port-proto.h"
 
 #define TYPE_REMOTE_PORT_DEVICE "remote-port-device"
@@ -48,6 +49,21 @@ void rp_restart_sync_timer(RemotePort *s);
 void rp_leave_iothread(RemotePort *s);
 
 ssize_t rp_write(RemotePort *s, const void *buf, size_t count);
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt);
+
+/*
+ * Responses that don't match an outstanding rp_dev_wait_resp slot are
+ * normally treated as replies to rp_wait_resp. With async responses
+ * enabled, they are instead dispatched to the device ops like requests,
+ * with RP_PKT_FLAGS_response set.
+ */
+void rp_dev_set_async_responses(RemotePort *s, uint32_t dev, bool async);
+
+/*
+ * Call @n from the main loop once the peer hello, and with it the peer
+ * caps, has been processed. Called right away if that already happened.
+ */
+void rp_add_hello_notifier(RemotePort *s, Notifier *n);
 
 RemotePortDynPkt rp_wait_resp(RemotePort *s);
 
@@ -8,11 +8,14 @@
 #ifndef REMOTE_PORT_GPIO_H
 #define REMOTE_PORT_GPIO_H
 
+#include "qemu/timer.h"
+
 #define TYPE_REMOTE_PORT_GPIO "remote-port-gpio"
 #define REMOTE_PORT_GPIO(obj) \
         OBJECT_CHECK(RemotePortGPIO, (obj), TYPE_REMOTE_PORT_GPIO)
 
 #define MAX_GPIOS 164
+#define RP_GPIO_BATCH_WORDS ((MAX_GPIOS + 31) / 32)
 
 typedef struct RemotePortGPIO {
     /* private */
@@ -22,9 +25,23 @@ typedef struct RemotePortGPIO {
     int8_t cache[MAX_GPIOS];
     uint32_t num_gpios;
     qemu_irq *gpio_out;
+    /* The same lines as GPIO vectors, and what they were last set to */
+    qemu_irq vector_out[RP_GPIO_BATCH_WORDS];
+    uint32_t vector_vals[RP_GPIO_BATCH_WORDS];
     uint16_t cell_offset_irq_num;
 
     bool posted_updates;
+
+    /*
+     * Coalescing window for batched updates. Changes within the window
+     * are sent as a single RP_CMD_interrupt_batch packet carrying the
+     * latest level of every changed line. 0 disables batching.
+     */
+    uint64_t batch_window_ns;
+    QEMUTimer *batch_timer;
+    uint32_t batch_changed[RP_GPIO_BATCH_WORDS];
+    uint32_t batch_vals[RP_GPIO_BATCH_WORDS];
+
     uint32_t rp_dev;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
@@ -22,9 +22,20 @@ typedef struct RemotePortMemorySlave {
     /* public */
     struct RemotePort *rp;
     struct rp_peer_state *peer;
+    uint32_t rp_dev;
     MemoryRegion *mr;
     AddressSpace *as;
     MemTxAttrs attr;
     RemotePortDynPkt rsp;
+
+    /*
+     * Announce shared file backed RAM in the address space to the peer
+     * so it can access it directly. See CAP_RAM_MAP.
+     */
+    bool share_ram;
+    bool ram_announce;
+    MemoryListener ram_listener;
+    Notifier hello_notifier;
+    QTAILQ_HEAD(, RemotePortRamExport) ram_exports;
 } RemotePortMemorySlave;
 #endif
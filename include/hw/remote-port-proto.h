@@ -69,7 +69,10 @@ enum rp_cmd {
     RP_CMD_write       = 4,
     RP_CMD_interrupt   = 5,
     RP_CMD_sync        = 6,
-    RP_CMD_max         = 6
+    RP_CMD_interrupt_batch = 7,
+    RP_CMD_ram_map     = 8,
+    RP_CMD_checkpoint  = 9,
+    RP_CMD_max         = 9
 };
 
 enum {
@@ -135,6 +138,32 @@ enum {
      * of the posted header-flag.
      */
     CAP_WIRE_POSTED_UPDATES = 3,
+
+    /*
+     * Busaccess payloads may be passed by reference into a shared data
+     * window instead of inline. See RP_BUS_ATTR_DATA_REF. Requires
+     * CAP_BUSACCESS_EXT_BASE.
+     */
+    CAP_BUSACCESS_DATA_REF = 4,
+
+    /*
+     * Peer understands RP_CMD_interrupt_batch, carrying updates for
+     * multiple wires in a single packet.
+     */
+    CAP_WIRE_BATCHED_UPDATES = 5,
+
+    /*
+     * Peer accepts RP_CMD_ram_map announcements and may access the
+     * announced RAM directly instead of going through busaccess packets.
+     */
+    CAP_RAM_MAP = 6,
+
+    /*
+     * Peer understands RP_CMD_checkpoint. Both sides send theirs after
+     * the hello so that a run resumed from a checkpoint on one side is
+     * not paired with a fresh or different one on the other.
+     */
+    CAP_CHECKPOINT_ID = 7,
 };
 
 struct rp_pkt_hello {
@@ -148,8 +177,21 @@ enum {
     RP_BUS_ATTR_EOP        =  (1 << 0),
     RP_BUS_ATTR_SECURE     =  (1 << 1),
     RP_BUS_ATTR_EXT_BASE   =  (1 << 2),
+    /*
+     * The payload at data_offset is a struct rp_busaccess_data_ref
+     * describing where in the shared data window the data lives.
+     * For reads, the request carries the reference telling the
+     * responder where to put the data and the response echoes it.
+     */
+    RP_BUS_ATTR_DATA_REF   =  (1 << 3),
 };
 
+struct rp_busaccess_data_ref {
+    /* Offset into the shared data window.  */
+    uint64_t offset;
+    uint64_t reserved0;
+} PACKED;
+
 struct rp_pkt_busaccess {
     struct rp_pkt_hdr hdr;
     uint64_t timestamp;
@@ -225,11 +267,68 @@ struct rp_pkt_interrupt {
     uint8_t val;
 } PACKED;
 
+/*
+ * Batched wire updates. The header is followed by two bitmaps of
+ * DIV_ROUND_UP(nr_lines, 32) 32bit words each. The first one flags the
+ * lines that changed, the second one holds their new values. Bit N of
+ * the bitmaps maps to line base_line + N. Responses carry no bitmaps.
+ */
+struct rp_pkt_interrupt_batch {
+    struct rp_pkt_hdr hdr;
+    uint64_t timestamp;
+    uint32_t base_line;
+    uint32_t nr_lines;
+} PACKED;
+
+#define RP_INTERRUPT_BATCH_WORDS(nr_lines) (((nr_lines) + 31) / 32)
+
+static inline uint32_t *
+rp_interrupt_batch_changed(struct rp_pkt_interrupt_batch *pkt)
+{
+    return (uint32_t *) (pkt + 1);
+}
+
+static inline uint32_t *
+rp_interrupt_batch_vals(struct rp_pkt_interrupt_batch *pkt)
+{
+    return rp_interrupt_batch_changed(pkt)
+           + RP_INTERRUPT_BATCH_WORDS(pkt->nr_lines);
+}
+
 struct rp_pkt_sync {
     struct rp_pkt_hdr hdr;
     uint64_t timestamp;
 } PACKED;
 
+enum {
+    RP_RAM_MAP_READONLY = (1 << 0),
+    /* The range is no longer RAM backed, fall back to busaccess.  */
+    RP_RAM_MAP_UNMAP    = (1 << 1),
+};
+
+/*
+ * Announces that [addr, addr + size) of the device's address space is
+ * backed by the file named by the path_len bytes following the header
+ * (not NUL terminated), starting at file offset. Always posted.
+ */
+struct rp_pkt_ram_map {
+    struct rp_pkt_hdr hdr;
+    uint64_t addr;
+    uint64_t size;
+    uint64_t offset;
+    uint32_t flags;
+    uint32_t path_len;
+} PACKED;
+
+/*
+ * The checkpoint the sender resumed from, 0 if it started from reset.
+ * Always posted.
+ */
+struct rp_pkt_checkpoint {
+    struct rp_pkt_hdr hdr;
+    uint64_t id;
+} PACKED;
+
 struct rp_pkt {
     union {
         struct rp_pkt_hdr hdr;
@@ -237,7 +336,10 @@ struct rp_pkt {
         struct rp_pkt_busaccess busaccess;
         struct rp_pkt_busaccess_ext_base busaccess_ext_base;
         struct rp_pkt_interrupt interrupt;
+        struct rp_pkt_interrupt_batch interrupt_batch;
         struct rp_pkt_sync sync;
+        struct rp_pkt_ram_map ram_map;
+        struct rp_pkt_checkpoint checkpoint;
     };
 };
 
@@ -253,6 +355,10 @@ struct rp_peer_state {
         bool busaccess_ext_base;
         bool busaccess_ext_byte_en;
         bool wire_posted_updates;
+        bool busaccess_data_ref;
+        bool wire_batched_updates;
+        bool ram_map;
+        bool checkpoint_id;
     } caps;
 
     /* Used to normalize our clk.  */
@@ -393,6 +499,8 @@ struct rp_encode_busaccess_in {
     uint32_t width;
     uint32_t stream_width;
     uint32_t byte_enable_len;
+    /* Only used when attr has RP_BUS_ATTR_DATA_REF.  */
+    uint64_t data_ref_offset;
 };
 
 /* Prepare encode_busaccess input parameters for a packet response.  */
@@ -411,6 +519,13 @@ rp_encode_busaccess_in_rsp_init(struct rp_encode_busaccess_in *in,
     in->width = pkt->busaccess.width;
     in->stream_width = pkt->busaccess.stream_width;
     in->byte_enable_len = 0;
+    if (pkt->busaccess.attributes & RP_BUS_ATTR_DATA_REF) {
+        struct rp_busaccess_data_ref *ref;
+
+        ref = (void *) ((char *) pkt + pkt->busaccess_ext_base.data_offset);
+        in->attr |= RP_BUS_ATTR_DATA_REF;
+        in->data_ref_offset = ref->offset;
+    }
 }
 size_t rp_encode_busaccess(struct rp_peer_state *peer,
                            struct rp_pkt_busaccess_ext_base *pkt,
@@ -427,6 +542,29 @@ size_t rp_encode_interrupt(uint32_t id, uint32_t dev,
                            int64_t clk,
                            uint32_t line, uint64_t vector, uint8_t val);
 
+/*
+ * Encodes the header in pkt and the changed/vals bitmaps of
+ * RP_INTERRUPT_BATCH_WORDS(nr_lines) words each right after it.
+ * pkt must have room for both. Returns the total size.
+ * For responses, pass nr_lines 0.
+ */
+size_t rp_encode_interrupt_batch(uint32_t id, uint32_t dev,
+                                 struct rp_pkt_interrupt_batch *pkt,
+                                 int64_t clk,
+                                 uint32_t base_line, uint32_t nr_lines,
+                                 const uint32_t *changed,
+                                 const uint32_t *vals,
+                                 uint32_t flags);
+
+size_t rp_encode_ram_map(uint32_t id, uint32_t dev,
+                         struct rp_pkt_ram_map *pkt,
+                         uint64_t addr, uint64_t size, uint64_t offset,
+                         uint32_t flags, uint32_t path_len);
+
+size_t rp_encode_checkpoint(uint32_t id, uint32_t dev,
+                            struct rp_pkt_checkpoint *pkt,
+                            uint64_t checkpoint_id);
+
 size_t rp_encode_sync(uint32_t id, uint32_t dev,
                       struct rp_pkt_sync *pkt,
                       int64_t clk);
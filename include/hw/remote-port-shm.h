@@ -0,0 +1,95 @@
+/*
+ * QEMU remote-port shared memory transport.
+ *
+ * Copyright (c) 2018 Xilinx Inc
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#ifndef REMOTE_PORT_SHM_H__
+#define REMOTE_PORT_SHM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * The shared memory transport carries the exact same byte stream as the
+ * chardev transport, it just replaces the socket with a pair of lock-free
+ * single producer, single consumer byte rings in a file mapped by both
+ * QEMU and the peer (typically under /dev/shm).
+ *
+ * Layout of the mapping:
+ *   RemotePortShmHdr
+ *   tx ring data (ring_size bytes), QEMU to peer.
+ *   rx ring data (ring_size bytes), peer to QEMU.
+ *
+ * QEMU creates and initializes the region and writes magic last. The peer
+ * must wait for magic to appear before using the rings.
+ *
+ * head and tail are free running byte counters, ring_size must be a power
+ * of 2. The producer only writes head/data_seq, the consumer only writes
+ * tail/space_seq. A side that runs out of data (or space) may sleep on
+ * the corresponding seq word with FUTEX_WAIT after raising its waiting
+ * flag. The other side bumps the seq word after every update and issues
+ * a FUTEX_WAKE if the waiting flag is set.
+ */
+
+#define RP_SHM_MAGIC   0x52505348 /* "RPSH" */
+#define RP_SHM_VERSION 1
+
+typedef struct RemotePortShmRing {
+    /* Producer owned.  */
+    uint32_t head;
+    uint32_t data_seq;
+    uint32_t producer_waiting;
+    uint8_t pad0[64 - 3 * 4];
+
+    /* Consumer owned.  */
+    uint32_t tail;
+    uint32_t space_seq;
+    uint32_t consumer_waiting;
+    uint8_t pad1[64 - 3 * 4];
+} RemotePortShmRing;
+
+typedef struct RemotePortShmHdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t reserved0;
+    uint8_t pad[64 - 4 * 4];
+
+    RemotePortShmRing tx;
+    RemotePortShmRing rx;
+} RemotePortShmHdr;
+
+typedef struct RemotePortShm {
+    RemotePortShmHdr *hdr;
+    uint8_t *tx_data;
+    uint8_t *rx_data;
+    size_t map_size;
+    uint32_t ring_size;
+    /* Number of polls before going to sleep on the doorbell.  */
+    uint32_t poll_spins;
+    int fd;
+} RemotePortShm;
+
+/**
+ * rp_shm_init:
+ * @shm: The transport state to initialize
+ * @path: File to create and map
+ * @ring_size: Size in bytes of each ring, must be a power of 2
+ * @poll_spins: Number of busy polls before sleeping on a doorbell
+ * @errp: returns an error if this function fails
+ *
+ * Returns true on success.
+ */
+bool rp_shm_init(RemotePortShm *shm, const char *path, uint32_t ring_size,
+                 uint32_t poll_spins, Error **errp);
+
+/*
+ * rp_shm_write and rp_shm_read block until all of @count bytes have been
+ * transfered. There may only be one writer and one reader at a time.
+ */
+void rp_shm_write(RemotePortShm *shm, const void *buf, size_t count);
+void rp_shm_read(RemotePortShm *shm, void *buf, size_t count);
+
+#endif
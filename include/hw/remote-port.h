@@ -12,6 +12,9 @@
 #include <stdbool.h>
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
+#ifndef _WIN32
+#include "hw/remote-port-shm.h"
+#endif
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
 #include "hw/ptimer.h"
@@ -19,6 +22,18 @@
 #define TYPE_REMOTE_PORT "remote-port"
 #define REMOTE_PORT(obj) OBJECT_CHECK(RemotePort, (obj), TYPE_REMOTE_PORT)
 
+#define RP_LATENCY_BUCKETS 16
+
+typedef struct RemotePortDevStats {
+    uint64_t rx_pkts;
+    uint64_t rx_bytes;
+    /* Round-trip times of transactions waited for in rp_dev_wait_resp.  */
+    uint64_t transactions;
+    uint64_t latency_total_ns;
+    uint64_t latency_max_ns;
+    uint64_t latency_hist[RP_LATENCY_BUCKETS];
+} RemotePortDevStats;
+
 typedef struct RemotePortRespSlot {
             RemotePortDynPkt rsp;
             uint32_t id;
@@ -26,6 +41,23 @@ typedef struct RemotePortRespSlot {
             bool valid;
 } RemotePortRespSlot;
 
+/*
+ * Per device virtual channel. Requests from the peer for a device are
+ * queued on its channel and dispatched by a dedicated thread, so that
+ * a busy device can't hold up the others.
+ */
+typedef struct RemotePortChannel {
+    RemotePort *rp;
+    QemuThread thread;
+    /* Signalled with rsp_mutex held when packets are queued.  */
+    QemuCond cond;
+    QemuSemaphore sem;
+    /* This array must be sized minimum 2 and always a power of 2.  */
+    RemotePortDynPkt pkt[16];
+    unsigned int wpos;
+    unsigned int rpos;
+} RemotePortChannel;
+
 struct RemotePort {
     DeviceState parent;
 
@@ -44,8 +76,46 @@ struct RemotePort {
 
     char *chardesc;
     char *chrdev_id;
+
+#ifndef _WIN32
+    /* Optional shared memory transport, replaces the chardev.  */
+    struct {
+        char *path;
+        uint32_t ring_size;
+        uint32_t poll_spins;
+        RemotePortShm t;
+    } shm;
+#endif
+    bool use_shm;
+
+    /*
+     * Shared data window for busaccess payloads passed by reference.
+     * See CAP_BUSACCESS_DATA_REF.
+     */
+    struct {
+        char *path;
+        uint64_t size;
+        uint8_t *ptr;
+    } data_window;
+    /* Packet trace record and replay, see rp_trace_init.  */
+    struct {
+        char *record_path;
+        char *replay_path;
+        FILE *f;
+        bool record;
+        bool replay;
+    } trace;
+
     struct rp_peer_state peer;
 
+    /* Run in the main loop once the peer hello has been processed.  */
+    QEMUBH *hello_bh;
+    NotifierList hello_notifiers;
+    bool hello_done;
+
+    /* The checkpoint both sides resume from, 0 when booting.  */
+    uint64_t checkpoint_id;
+
     struct {
         QEMUBH *bh;
         QEMUBH *bh_resp;
@@ -55,6 +125,30 @@ struct RemotePort {
         bool need_sync;
         struct rp_pkt rsp;
         uint64_t quantum;
+
+        /*
+         * Adaptive mode. The quantum doubles on every idle sync up to
+         * quantum_max and halves back towards the configured quantum
+         * when there was traffic since the last sync.
+         */
+        bool adaptive;
+        uint64_t quantum_max;
+        bool activity;
+
+        /*
+         * Tickless mode. An idle period runs up to the next local
+         * QEMU_CLOCK_VIRTUAL deadline (e.g the ARM generic timers), capped
+         * to quantum_max, instead of a fixed quantum.
+         */
+        bool tickless;
+
+        struct {
+            uint64_t count;
+            /* Host time spent waiting for sync responses.  */
+            uint64_t stall_ns;
+            /* Sum of remote minus local clock at every sync.  */
+            int64_t skew_ns;
+        } stats;
     } sync;
 
     QemuMutex rsp_mutex;
@@ -88,13 +182,34 @@ struct RemotePort {
 
     uint32_t current_id;
 
+    /* Max number of in-flight transactions per device.  */
+    uint32_t max_outstanding;
+
 #define REMOTE_PORT_MAX_DEVS 1024
 #define RP_MAX_OUTSTANDING_TRANSACTIONS 32
     struct {
         RemotePortRespSlot rsp_queue[RP_MAX_OUTSTANDING_TRANSACTIONS];
+        RemotePortDevStats stats;
+        /* Pass responses nobody waits for to the device.  */
+        bool async_rsp;
     } dev_state[REMOTE_PORT_MAX_DEVS];
 
+    struct {
+        /* Updated by the protocol thread only.  */
+        uint64_t rx_pkts[RP_CMD_max + 1];
+        uint64_t rx_bytes;
+        uint64_t tx_bytes;
+        uint64_t warp_count;
+        int64_t warp_ns;
+    } stats;
+
     RemotePortDevice *devs[REMOTE_PORT_MAX_DEVS];
+
+    /* Per device dispatch threads, created on first use.  */
+    bool dispatch_threads;
+    RemotePortChannel *chan[REMOTE_PORT_MAX_DEVS];
+    /* Total number of packets queued on channels.  */
+    unsigned int chan_pending;
 };
 
 /**
@@ -130,8 +245,21 @@ static inline void rp_resp_slot_done(RemotePort *s,
     rsp_slot->id = ~0;
     rsp_slot->used = false;
     rsp_slot->valid = false;
+    /* Wake up anyone waiting for a free slot.  */
+    qemu_cond_broadcast(&s->progress_cond);
 }
 
 RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id);
 
+/**
+ * rp_data_window_ptr
+ * @s: The remote-port adaptor
+ * @offset: Offset into the shared data window
+ * @len: Length of the access
+ *
+ * Returns a host pointer to the given range of the shared data window or
+ * NULL if the range is not within the window.
+ */
+void *rp_data_window_ptr(RemotePort *s, uint64_t offset, uint64_t len);
+
 #endif
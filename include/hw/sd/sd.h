@@ -106,6 +106,9 @@ typedef struct {
     int (*do_command)(SDState *sd, SDRequest *req, uint8_t *response);
     void (*write_data)(SDState *sd, uint8_t value);
     uint8_t (*read_data)(SDState *sd);
+    /* Optional bulk versions of the data phase, see sdbus_read_bulk.  */
+    size_t (*read_bulk)(SDState *sd, uint8_t *buf, size_t len);
+    size_t (*write_bulk)(SDState *sd, const uint8_t *buf, size_t len);
     bool (*data_ready)(SDState *sd);
     void (*set_voltage)(SDState *sd, uint16_t millivolts);
     uint8_t (*get_dat_lines)(SDState *sd);
@@ -142,6 +145,8 @@ int sd_do_command(SDState *sd, SDRequest *req,
                   uint8_t *response);
 void sd_write_data(SDState *sd, uint8_t value);
 uint8_t sd_read_data(SDState *sd);
+size_t sd_read_bulk(SDState *sd, uint8_t *buf, size_t len);
+size_t sd_write_bulk(SDState *sd, const uint8_t *buf, size_t len);
 void sd_set_cb(SDState *sd, qemu_irq readonly, qemu_irq insert);
 bool sd_data_ready(SDState *sd);
 /* sd_enable should not be used -- it is only used on the nseries boards,
@@ -162,6 +167,23 @@ bool sdbus_get_cmd_line(SDBus *sdbus);
 int sdbus_do_command(SDBus *sd, SDRequest *req, uint8_t *response);
 void sdbus_write_data(SDBus *sd, uint8_t value);
 uint8_t sdbus_read_data(SDBus *sd);
+/**
+ * sdbus_read_bulk: Read len bytes of the data phase in one go
+ * @sd: bus the card sits on
+ * @buf: where the data goes
+ * @len: number of bytes
+ *
+ * Same as len calls to sdbus_read_data, but whole blocks may go straight
+ * from the block backend into @buf. Returns 0, with nothing consumed, if
+ * the card can't do this for the current command.
+ */
+size_t sdbus_read_bulk(SDBus *sd, uint8_t *buf, size_t len);
+/**
+ * sdbus_write_bulk: Write len bytes of the data phase in one go
+ *
+ * The counterpart of sdbus_read_bulk for sdbus_write_data.
+ */
+size_t sdbus_write_bulk(SDBus *sd, const uint8_t *buf, size_t len);
 bool sdbus_data_ready(SDBus *sd);
 bool sdbus_get_inserted(SDBus *sd);
 bool sdbus_get_readonly(SDBus *sd);
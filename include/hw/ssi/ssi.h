@@ -60,6 +60,21 @@ struct SSISlaveClass {
     uint32_t (*transfer_raw)(SSISlave *dev, uint32_t val, int num_bits);
     /* Call this method to set the spi mode to single, dual or quad mode */
     void (*set_data_lines)(SSISlave *dev, uint8_t val);
+    /* Optional bulk read. Fills buf with what up to len transfers of 0
+     * would return and advances the device state accordingly. Devices
+     * return how many bytes they produced, which may be none when the
+     * current state has no shortcut; the master then falls back to
+     * transfer for the rest.
+     */
+    size_t (*transfer_read)(SSISlave *dev, uint8_t *buf, size_t len);
+    /* Optional direct access to what the next transfers would return.
+     * In a state where transfer_read would succeed, returns the host copy
+     * of that data and sets *len to how much of it is contiguous. Devices
+     * call changed(opaque) once when that data is modified afterwards, so
+     * the master can drop its mapping.
+     */
+    const uint8_t *(*map_read)(SSISlave *dev, uint64_t *len,
+                               void (*changed)(void *opaque), void *opaque);
 };
 
 struct SSISlave {
@@ -92,6 +107,18 @@ uint32_t ssi_transfer(SSIBus *bus, uint32_t val);
 
 void ssi_set_datalines(SSIBus *bus, uint8_t val);
 
+/* Read up to len bytes in one go from the single selected slave, see
+ * SSISlaveClass::transfer_read. Returns the number of bytes read, callers
+ * transfer the remainder one at a time.
+ */
+size_t ssi_transfer_read(SSIBus *bus, uint8_t *buf, size_t len);
+
+/* Map the data upcoming transfers would return from the single selected
+ * slave, see SSISlaveClass::map_read. Returns NULL if it can't be mapped.
+ */
+const uint8_t *ssi_map_read(SSIBus *bus, uint64_t *len,
+                            void (*changed)(void *opaque), void *opaque);
+
 /* Automatically connect all children nodes a spi controller as slaves */
 void ssi_auto_connect_slaves(DeviceState *parent, qemu_irq *cs_lines,
                              SSIBus *bus);
@@ -104,6 +104,15 @@ typedef struct {
     hwaddr lqspi_cached_addr;
     Error *migration_blocker;
     bool mmio_execution_enabled;
+
+    /* Linear window mapped straight onto the flash contents.  */
+    bool direct_enabled;
+    bool direct_mmio_mapped;
+    bool direct_failed;
+    const uint8_t *direct_ptr;
+    hwaddr direct_addr;
+    uint64_t direct_size;
+    uint8_t *direct_shadow;
 } XilinxQSPIPS;
 
 typedef struct {
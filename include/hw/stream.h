@@ -15,6 +15,10 @@
      INTERFACE_CHECK(StreamSlave, (obj), TYPE_STREAM_SLAVE)
 
 #define STREAM_ATTR_EOP      (1 << 0)   /* Signal End-Of-Packet.  */
+/* The data isn't owned by the master, e.g guest RAM mapped for zero-copy
+ * DMA. Slaves must not modify it in place.
+ */
+#define STREAM_ATTR_READONLY (1 << 1)
 
 typedef struct StreamSlave {
     Object Parent;
@@ -41,6 +45,8 @@ typedef struct StreamSlaveClass {
      * advance. The can_push() function can be used to trap the point in time
      * where the slave is ready to receive again, otherwise polling on a QEMU
      * timer will work.
+     * The data is only borrowed for the duration of the call. Slaves may
+     * modify it in place unless @attr has STREAM_ATTR_READONLY.
      * @obj: Stream slave to push to
      * @buf: Data to write
      * @len: Maximum number of bytes to write
@@ -48,11 +54,28 @@ typedef struct StreamSlaveClass {
      */
     size_t (*push)(StreamSlave *obj, unsigned char *buf, size_t len,
                    uint32_t attr);
+    /**
+     * pushv - Optional scatter-gather variant of push. Same semantics as
+     * push with the data described by an iovec array. If not implemented,
+     * stream_pushv falls back to push with a linearized copy. Slaves that
+     * forward data should forward the iovec as is, so that host RAM mapped
+     * by the master travels down the pipeline without copies.
+     * @obj: Stream slave to push to
+     * @iov: Data to write
+     * @iovcnt: Number of elements in @iov
+     * @attr: Attributes.
+     */
+    size_t (*pushv)(StreamSlave *obj, const struct iovec *iov, int iovcnt,
+                    uint32_t attr);
 } StreamSlaveClass;
 
 size_t
 stream_push(StreamSlave *sink, uint8_t *buf, size_t len, uint32_t attr);
 
+size_t
+stream_pushv(StreamSlave *sink, const struct iovec *iov, int iovcnt,
+             uint32_t attr);
+
 bool
 stream_can_push(StreamSlave *sink, StreamCanPushNotifyFn notify,
                 void *notify_opaque);
@@ -62,5 +85,32 @@ static inline bool stream_attr_has_eop(uint32_t attr)
     return (attr & STREAM_ATTR_EOP) != 0;
 }
 
+/* Gathers small pushes into large ones towards a sink. Data is pushed on
+ * once the buffer fills up, at EOP, or from a bottom half right after the
+ * current burst of pushes.
+ */
+typedef struct StreamCoalescer {
+    StreamSlave *sink;
+    uint8_t *buf;
+    size_t size;
+    size_t pos;
+    size_t len;
+    bool eop;
+    QEMUBH *bh;
+    StreamCanPushNotifyFn notify;
+    void *notify_opaque;
+} StreamCoalescer;
+
+void stream_coalescer_init(StreamCoalescer *c, StreamSlave *sink,
+                           size_t size);
+void stream_coalescer_reset(StreamCoalescer *c);
+/* Buffers up to len bytes, returns how many.  */
+size_t stream_coalescer_push(StreamCoalescer *c, const uint8_t *buf,
+                             size_t len, uint32_t attr);
+/* Same contract as StreamSlaveClass::can_push.  */
+bool stream_coalescer_can_push(StreamCoalescer *c,
+                               StreamCanPushNotifyFn notify,
+                               void *notify_opaque);
+
 
 #endif /* STREAM_H */
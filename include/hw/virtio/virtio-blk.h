@@ -39,6 +39,9 @@ struct VirtIOBlkConf
     uint32_t config_wce;
     uint32_t request_merging;
     uint16_t num_queues;
+    /* IOThreads serving the virtqueues round-robin, by id */
+    uint32_t num_vq_iothreads;
+    char **vq_iothreads;
 };
 
 struct VirtIOBlockDataPlane;
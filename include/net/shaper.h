@@ -0,0 +1,45 @@
+/*
+ * Wire speed pacing of network frames in virtual time.
+ *
+ * Copyright (c) 2019 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_NET_SHAPER_H
+#define QEMU_NET_SHAPER_H
+
+#include "qemu/timer.h"
+
+/* Preamble, FCS and inter frame gap, on top of what the NIC hands over.  */
+#define NET_SHAPER_OVERHEAD     (8 + 4 + 12)
+#define NET_SHAPER_MIN_FRAME    60
+
+/*
+ * Models a link of a given speed in QEMU_CLOCK_VIRTUAL, so that under
+ * icount a NIC moves frames no faster than the wire would let it.
+ *
+ * The owner asks net_shaper_ready() before moving a frame and holds it
+ * back when it says no, e.g. by returning 0 from its receive handler so
+ * that the net queue keeps the frame.  The callback then runs once the
+ * link is idle again, typically to flush that queue.  Each shaper only
+ * has its timer armed while its link is busy.
+ */
+typedef struct NetShaper {
+    uint32_t speed;      /* Mbit/s, 0 disables shaping */
+    int64_t free_at;     /* When the frame on the wire ends */
+    QEMUTimer *timer;
+} NetShaper;
+
+void net_shaper_init(NetShaper *sh, uint32_t speed,
+                     QEMUTimerCB *cb, void *opaque);
+void net_shaper_reset(NetShaper *sh);
+
+/* Is the link idle? If not, arms the callback for when it will be.  */
+bool net_shaper_ready(NetShaper *sh);
+
+/* Put a size byte frame on the wire.  */
+void net_shaper_account(NetShaper *sh, size_t size);
+
+#endif
@@ -65,6 +65,17 @@ typedef void coroutine_fn CoroutineEntry(void *opaque);
  */
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque);
 
+/**
+ * Create a new coroutine with a small stack
+ *
+ * Like qemu_coroutine_create(), for entry points that are known not to
+ * recurse deeply, e.g. one coroutine per device tree node.  The stack is a
+ * quarter of the default size and ends in a guard page, so an overflow
+ * crashes rather than corrupting memory.
+ */
+Coroutine *qemu_coroutine_create_small_stack(CoroutineEntry *entry,
+                                             void *opaque);
+
 /**
  * Transfer control to a coroutine
  */
@@ -117,6 +128,19 @@ bool qemu_in_coroutine(void);
  */
 bool qemu_coroutine_entered(Coroutine *co);
 
+/**
+ * Mark a coroutine as doing background work, like a block job
+ *
+ * Coroutines created by a background coroutine are background too, and the
+ * thread pool runs their requests after those of the guest.
+ */
+void qemu_coroutine_set_background(Coroutine *co, bool background);
+
+/**
+ * Return true if the coroutine does background work
+ */
+bool qemu_coroutine_is_background(Coroutine *co);
+
 /**
  * Provides a mutex that can be used to synchronise coroutines
  */
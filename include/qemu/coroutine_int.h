@@ -29,6 +29,14 @@
 #include "qemu/coroutine.h"
 
 #define COROUTINE_STACK_SIZE (1 << 20)
+#define COROUTINE_SMALL_STACK_SIZE (256 << 10)
+
+/* The stack sizes the pool keeps coroutines of */
+typedef enum {
+    COROUTINE_STACK_DEFAULT,
+    COROUTINE_STACK_SMALL,
+    COROUTINE_STACK__MAX,
+} CoroutineStackType;
 
 typedef enum {
     COROUTINE_YIELD = 1,
@@ -40,6 +48,8 @@ struct Coroutine {
     CoroutineEntry *entry;
     void *entry_arg;
     Coroutine *caller;
+    CoroutineStackType stack_type;
+    bool background;
 
     /* Only used when the coroutine has terminated.  */
     QSLIST_ENTRY(Coroutine) pool_next;
@@ -64,7 +74,7 @@ struct Coroutine {
     QSLIST_ENTRY(Coroutine) co_scheduled_next;
 };
 
-Coroutine *qemu_coroutine_new(void);
+Coroutine *qemu_coroutine_new(size_t stack_size);
 void qemu_coroutine_delete(Coroutine *co);
 CoroutineAction qemu_coroutine_switch(Coroutine *from, Coroutine *to,
                                       CoroutineAction action);
@@ -25,12 +25,21 @@
 #endif
 
 /* Leaf 1, %ecx */
+#ifndef bit_PCLMUL
+#define bit_PCLMUL      (1 << 1)
+#endif
+#ifndef bit_SSSE3
+#define bit_SSSE3       (1 << 9)
+#endif
 #ifndef bit_SSE4_1
 #define bit_SSE4_1      (1 << 19)
 #endif
 #ifndef bit_MOVBE
 #define bit_MOVBE       (1 << 22)
 #endif
+#ifndef bit_AES
+#define bit_AES         (1 << 25)
+#endif
 #ifndef bit_OSXSAVE
 #define bit_OSXSAVE     (1 << 27)
 #endif
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "qemu/thread.h"
 
 struct etrace_entry32 {
     uint32_t duration;
@@ -39,6 +40,11 @@ enum qemu_etrace_flag {
     ETRACE_F_MEM         = (1 << 2),
     ETRACE_F_CPU         = (1 << 3),
     ETRACE_F_GPIO         = (1 << 4),
+    ETRACE_F_COUNTERS    = (1 << 7),
+    ETRACE_F_TRACE       = (1 << 8),
+    /* Output format options, not trace points.  */
+    ETRACE_F_DELTA       = (1 << 5),
+    ETRACE_F_ZLIB        = (1 << 6),
 };
 
 enum qemu_etrace_event_u64_flag {
@@ -46,33 +52,67 @@ enum qemu_etrace_event_u64_flag {
     ETRACE_EVU64_F_PREV_VAL    = (1 << 0),
 };
 
+enum etrace_counter {
+    ETRACE_CNT_TB,
+    ETRACE_CNT_EXCP,
+    ETRACE_CNT_IRQ,
+    ETRACE_CNT_TLB_MISS,    /* per MMU index */
+    ETRACE_CNT_MAX,
+};
+
 enum etrace_mem_attr {
     MEM_READ    = (0 << 0),
     MEM_WRITE   = (1 << 0),
 };
 
+struct etrace_unit;
+struct etrace_ring;
+struct z_stream_s;
+
+struct etrace_range {
+    uint64_t start;
+    uint64_t end;   /* inclusive */
+};
+
 struct etracer {
     const char *filename;
     FILE *fp;
     unsigned int arch_bits;
     uint64_t flags;
 
-    /* FIXME: Removeme.  */
-    unsigned int current_unit_id;
-
-#define EXEC_CACHE_SIZE (16 * 1024)
-    uint64_t exec_start;
-    bool exec_start_valid;
-    int64_t exec_start_time;
+    /*
+     * Filters, set up from -etrace-flags. Empty range lists match
+     * everything, a sample rate of N keeps one in N events per unit.
+     */
     struct {
-        union {
-            struct etrace_entry64 t64[EXEC_CACHE_SIZE];
-            struct etrace_entry32 t32[2 * EXEC_CACHE_SIZE];
-        };
-        uint64_t start_time;
-        unsigned int pos;
-        unsigned int unit_id;
-    } exec_cache;
+        GArray *exec_ranges;
+        GArray *mem_ranges;
+        unsigned int exec_sample;
+        unsigned int mem_sample;
+    } filter;
+
+    /* Virtual time between counter samples, in ns.  */
+    uint64_t counter_period;
+
+    /* Streaming compressor, owned by the writer thread once it runs.  */
+    struct z_stream_s *zs;
+    bool zs_pending;
+
+    /*
+     * Per unit exec state, allocated on first use. Only the thread
+     * running a unit touches its state.
+     */
+#define ETRACE_MAX_UNITS 256
+    struct etrace_unit *units[ETRACE_MAX_UNITS];
+
+    /*
+     * Every producing thread owns a ring that the writer thread drains
+     * to fp. Rings are only ever added, at the list head.
+     */
+    struct etrace_ring *rings;
+    QemuThread writer;
+    QemuSemaphore wake;
+    bool running;
 };
 
 bool etrace_init(struct etracer *t, const char *filename,
@@ -92,6 +132,25 @@ void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end);
 
+bool etrace_exec_start_valid(struct etracer *t, unsigned int unit_id);
+
+/* TB instrumentation, called from translated code at the start of TBs
+   with CF_ETRACE. Closes the previous TB's range and opens a new one for
+   start - end. etrace_exec_tb_end closes the open range, if any.  */
+void etrace_exec_tb(struct etracer *t, unsigned int unit_id,
+                    uint64_t start, uint64_t end);
+void etrace_exec_tb_end(struct etracer *t, unsigned int unit_id);
+
+/*
+ * Filtering. The range filters are meant to be evaluated once, when a TB
+ * is translated or a TLB entry filled, and the result cached. The sample
+ * helpers are evaluated per event.
+ */
+bool etrace_exec_filter(struct etracer *t, uint64_t start, uint64_t end);
+bool etrace_mem_filter(struct etracer *t, uint64_t start, uint64_t end);
+bool etrace_exec_sample(struct etracer *t, unsigned int unit_id);
+bool etrace_mem_sample(struct etracer *t, unsigned int unit_id);
+
 void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val);
@@ -104,10 +163,23 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
 void etrace_note_write(struct etracer *t, unsigned int unit_id,
                        void *buf, size_t len);
 
-/* fp should point to an etracer object.  */
+/* fp should point to an etracer object. Notes are attributed to the
+   unit last set by the calling thread.  */
+void etrace_note_set_unit(struct etracer *t, unsigned int unit_id);
 int etrace_note_fprintf(FILE *fp,
                         const char *fmt, ...);
 
+/*
+ * Performance counters. Counts are kept per unit by the thread running it
+ * and sampled as TYPE_EVENT_U64 records from etrace_counters_poll, at most
+ * once per counter_period. idx is the MMU index for TLB misses.
+ */
+void etrace_count(struct etracer *t, unsigned int unit_id,
+                  enum etrace_counter c, unsigned int idx);
+void etrace_count_io(struct etracer *t, unsigned int unit_id,
+                     MemoryRegion *mr);
+void etrace_counters_poll(struct etracer *t, CPUState *cpu);
+
 void etrace_event_u64(struct etracer *t, uint16_t unit_id,
                       uint32_t flags,
                       const char *dev_name,
@@ -116,6 +116,21 @@ uint64_t fifo_pop64(Fifo *fifo);
 
 const void *fifo_pop_buf(Fifo *fifo, uint32_t max, uint32_t *num);
 
+/**
+ * fifo_peek_buf:
+ * @fifo: FIFO to peek into
+ * @max: maximum number of elements to peek
+ * @num: actual number of returned elements
+ *
+ * Same as fifo_pop_buf() but leaves the elements in the FIFO. Clients that
+ * hand the data on to consumers that may take only part of it can peek, and
+ * then fifo_pop_buf() the amount actually consumed.
+ *
+ * Returns: A pointer to the data at the head of the FIFO.
+ */
+
+const void *fifo_peek_buf(Fifo *fifo, uint32_t max, uint32_t *num);
+
 /**
  * fifo_reset:
  * @fifo: FIFO to reset
@@ -33,6 +33,7 @@
  * implementation borrowed from OpenSSL.
  */
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
@@ -96,6 +97,12 @@ typedef struct {
 
     uint64_t HL[16];            /*!< Precalculated HTable */
     uint64_t HH[16];            /*!< Precalculated HTable */
+
+    /* Host AES-NI/PCLMULQDQ state, used when accel is set.  */
+    bool accel;
+    unsigned int rounds;
+    uint8_t rk[15][16];         /*!< Expanded AES key */
+    uint8_t h[16];              /*!< GHASH key */
 }
 gcm_context;
 
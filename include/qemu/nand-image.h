@@ -0,0 +1,98 @@
+/*
+ * Layout of QEMU NAND flash backing images.
+ *
+ * Every page is stored as its in-band data followed by its OOB area.  The
+ * OOB is left erased (0xFF) apart from its last ecc_size bytes, which hold
+ * a digest of the page data split per 512 byte ECC codeword.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_NAND_IMAGE_H
+#define QEMU_NAND_IMAGE_H
+
+/* Only relies on the C library so that util/qemu-nand-creator.c can use
+ * it.
+ */
+
+#define NAND_ECC_CODEWORD_SIZE 512
+
+/* Where the digest of a page is at, a page may be digested in pieces.  */
+typedef struct NandEccState {
+    uint32_t pos;
+    uint32_t subpage_offset;
+} NandEccState;
+
+/* Fold the next len bytes of the data of a page_size page into its
+ * ecc_size bytes of ECC, which start out erased.  ecc_size must be a
+ * non-zero multiple of the number of codewords in a page.
+ *
+ * The data of each codeword is folded in runs of per_subpage bytes, so
+ * that the compiler can vectorize the inner loop.
+ */
+static inline void nand_ecc_digest(NandEccState *st, uint8_t *ecc,
+                                   uint32_t ecc_size, const uint8_t *data,
+                                   uint32_t len, uint32_t page_size)
+{
+    uint32_t per_subpage = ecc_size / (page_size / NAND_ECC_CODEWORD_SIZE);
+
+    while (len) {
+        uint32_t n = NAND_ECC_CODEWORD_SIZE - st->subpage_offset;
+        uint32_t base = st->pos - st->pos % per_subpage;
+        uint32_t idx = st->pos - base;
+        uint32_t done, i;
+
+        if (n > len) {
+            n = len;
+        }
+        for (done = 0; done < n; ) {
+            uint32_t run = per_subpage - idx;
+
+            if (run > n - done) {
+                run = n - done;
+            }
+            for (i = 0; i < run; i++) {
+                ecc[base + idx + i] ^= ~data[done + i];
+            }
+            done += run;
+            idx += run;
+            if (idx == per_subpage) {
+                idx = 0;
+            }
+        }
+
+        data += n;
+        len -= n;
+        st->subpage_offset += n;
+        if (st->subpage_offset == NAND_ECC_CODEWORD_SIZE) {
+            /* Next codeword, next ECC subpage */
+            st->subpage_offset = 0;
+            st->pos = base + per_subpage;
+        } else {
+            st->pos = base + idx;
+        }
+    }
+}
+
+/* Lay out the page_size bytes of data of one page into dst, which is
+ * page_size + oob_size long.
+ */
+static inline void nand_image_page(uint8_t *dst, const uint8_t *data,
+                                   uint32_t page_size, uint32_t oob_size,
+                                   uint32_t ecc_size)
+{
+    NandEccState st = { 0, 0 };
+    uint8_t *oob = dst + page_size;
+
+    memcpy(dst, data, page_size);
+    memset(oob, 0xFF, oob_size);
+    if (ecc_size) {
+        nand_ecc_digest(&st, oob + oob_size - ecc_size, ecc_size, data,
+                        page_size, page_size);
+    }
+}
+
+#endif
@@ -507,9 +507,44 @@ unsigned long qemu_getauxval(unsigned long type);
 
 void qemu_set_tty_echo(int fd, bool echo);
 
-void os_mem_prealloc(int fd, char *area, size_t sz, int smp_cpus,
+/**
+ * os_mem_prealloc:
+ * @fd: file descriptor backing @area, or -1
+ * @area: memory to preallocate
+ * @sz: size of @area
+ * @max_threads: how many threads may touch the pages at most
+ * @errp: returns an error if the host ran out of memory
+ *
+ * Touch every page of @area so that the host allocates it, in parallel.
+ */
+void os_mem_prealloc(int fd, char *area, size_t sz, int max_threads,
                      Error **errp);
 
+typedef struct MemPrealloc MemPrealloc;
+
+/**
+ * os_mem_prealloc_start:
+ *
+ * Like os_mem_prealloc(), but return as soon as the threads touching the
+ * pages are started.  Writes to @area are safe meanwhile.
+ * os_mem_prealloc_wait() must be called from the same thread before the
+ * guest uses @area.
+ *
+ * Returns: a handle to pass to os_mem_prealloc_wait(), or NULL with @errp
+ * set if the preallocation could not be started.
+ */
+MemPrealloc *os_mem_prealloc_start(int fd, char *area, size_t sz,
+                                   int max_threads, Error **errp);
+
+/**
+ * os_mem_prealloc_wait:
+ * @job: the handle returned by os_mem_prealloc_start()
+ * @errp: returns an error if the host ran out of memory
+ *
+ * Wait until all pages of the preallocation are touched and free @job.
+ */
+void os_mem_prealloc_wait(MemPrealloc *job, Error **errp);
+
 /**
  * qemu_get_pid_name:
  * @pid: pid of a process
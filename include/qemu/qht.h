@@ -13,7 +13,7 @@
 
 struct qht {
     struct qht_map *map;
-    QemuMutex lock; /* serializes setters of ht->map */
+    QemuMutex lock; /* serializes resizes, i.e. setters of ht->map */
     unsigned int mode;
 };
 
@@ -26,6 +26,8 @@ struct qht {
  *         chain, excluding empty chains.
  * @occupancy: frequency distribution representing chain occupancy rate.
  *             Valid range: from 0.0 (empty) to 1.0 (full occupancy).
+ * @resize_pending: number of head buckets a resize in progress still has to
+ *                  move. The other fields cover both maps of such a resize.
  *
  * An entry is a pointer-hash pair.
  * Each bucket can host several entries.
@@ -37,12 +39,17 @@ struct qht_stats {
     size_t entries;
     struct qdist chain;
     struct qdist occupancy;
+    size_t resize_pending;
 };
 
 typedef bool (*qht_lookup_func_t)(const void *obj, const void *userp);
 typedef void (*qht_iter_func_t)(struct qht *ht, void *p, uint32_t h, void *up);
 
-#define QHT_MODE_AUTO_RESIZE 0x1 /* auto-resize when heavily loaded */
+/*
+ * Auto-resize when heavily loaded. The entries are moved a few buckets at
+ * a time by the insertions and removals that follow.
+ */
+#define QHT_MODE_AUTO_RESIZE 0x1
 
 /**
  * qht_init - Initialize a QHT
@@ -146,6 +153,9 @@ bool qht_reset_size(struct qht *ht, size_t n_elems);
  * @ht: QHT to be resized
  * @n_elems: number of entries the resized hash table should be optimized for
  *
+ * Lookups, and writes other than those to the bucket being moved, carry on
+ * while the entries are moved to the resized table.
+ *
  * Returns true on success.
  * Returns false if the resize was not necessary and therefore not performed.
  * See also: qht_reset_size().
@@ -134,6 +134,27 @@ extern void call_rcu1(struct rcu_head *head, RCUCBFunc *func);
       }),                                                                \
       (RCUCBFunc *)(func))
 
+/*
+ * Batching of call_rcu.  The call_rcu thread waits for @min_size callbacks
+ * or @max_latency_ms milliseconds, whichever comes first, before it starts
+ * a grace period for all of them.
+ */
+extern void rcu_set_batching(unsigned int min_size,
+                             unsigned int max_latency_ms);
+extern void rcu_get_batching(unsigned int *min_size,
+                             unsigned int *max_latency_ms);
+
+typedef struct RCUStats {
+    uint64_t callbacks;
+    uint64_t callbacks_per_sec;
+    uint64_t batches;
+    uint64_t grace_periods;
+    uint64_t grace_period_ns;
+    uint64_t max_grace_period_ns;
+} RCUStats;
+
+extern void rcu_get_stats(RCUStats *stats);
+
 #define g_free_rcu(obj, field) \
     call_rcu1(({                                                         \
         char __attribute__((unused))                                     \
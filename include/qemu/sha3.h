@@ -0,0 +1,46 @@
+/*
+ * SHA-3 core, without padding.
+ *
+ * Copyright (c) 2013 Xilinx Inc
+ * Written by Edgar E. Iglesias <edgar.iglesias@xilinx.com>
+ *
+ * Uses borrowed LGPL code from nettle.
+ * This code is licensed under the GNU LGPL.
+ */
+#ifndef QEMU_SHA3_H
+#define QEMU_SHA3_H
+
+#define SHA3_384_DIGEST_SIZE 48
+#define SHA3_384_DATA_SIZE 104
+
+/* The sha3 state is a 5x5 matrix of 64-bit words. In the notation of
+   Keccak description, S[x,y] is element x + 5*y, so if x is
+   interpreted as the row index and y the column index, it is stored
+   in column-major order. */
+#define SHA3_STATE_LENGTH 25
+
+/* The "width" is 1600 bits or 200 octets */
+struct sha3_state {
+  uint64_t a[SHA3_STATE_LENGTH];
+};
+
+struct sha3_384_ctx {
+    struct sha3_state state;
+    uint32_t index;
+    uint8_t block[SHA3_384_DATA_SIZE];
+};
+
+/* Keccak-f[1600] */
+void sha3_permute(struct sha3_state *state);
+
+void sha3_384_init(struct sha3_384_ctx *ctx);
+void sha3_384_update(struct sha3_384_ctx *ctx, unsigned length,
+                     const uint8_t *data);
+
+/* Emit the current state as digest without padding, the way common
+ * hardware implementations do, and reset ctx.
+ */
+void sha3_384_digest_no_pad(struct sha3_384_ctx *ctx, unsigned length,
+                            uint8_t *digest);
+
+#endif
@@ -0,0 +1,193 @@
+/*
+ * Bit striping of data across dual parallel flashes.
+ *
+ * Copyright (c) 2013 Xilinx Inc
+ * Written by Peter Crosthwaite <peter.crosthwaite@xilinx.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef QEMU_STRIPE_H
+#define QEMU_STRIPE_H
+
+/* Only relies on the C library so that util/flash-stripe.c can use it.  */
+
+/* The two way case, the only one real hardware uses, works on eight groups
+ * at a time with every byte of a 64-bit word being one lane.
+ */
+#define STRIPE2_LANES 8
+
+/* Gather bits 0, 2, 4 and 6 of every byte into its low nibble.  */
+static inline uint64_t stripe_gather_even(uint64_t v)
+{
+    v &= 0x5555555555555555ULL;
+    v = (v | v >> 1) & 0x3333333333333333ULL;
+    v = (v | v >> 2) & 0x0f0f0f0f0f0f0f0fULL;
+    return v;
+}
+
+/* Inverse of stripe_gather_even().  */
+static inline uint64_t stripe_scatter_even(uint64_t v)
+{
+    v &= 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | v << 2) & 0x3333333333333333ULL;
+    v = (v | v << 1) & 0x5555555555555555ULL;
+    return v;
+}
+
+/* Stripe (or unstripe when dir) up to STRIPE2_LANES two byte groups
+ * {x0[i], x1[i]} into dst[2 * i] and dst[2 * i + 1]. dst may alias
+ * neither x0 nor x1.
+ */
+static inline void stripe2_lanes(uint8_t *dst, const uint8_t *x0,
+                                 const uint8_t *x1, size_t n,
+                                 bool dir, bool be)
+{
+    uint8_t l[2][STRIPE2_LANES] = { { 0 } };
+    uint64_t a, b, r0, r1;
+    size_t i;
+
+    memcpy(l[0], x0, n);
+    memcpy(l[1], x1, n);
+    memcpy(&a, l[0], sizeof a);
+    memcpy(&b, l[1], sizeof b);
+
+    if (!dir) {
+        uint64_t ae = stripe_gather_even(a), ao = stripe_gather_even(a >> 1);
+        uint64_t bev = stripe_gather_even(b), bo = stripe_gather_even(b >> 1);
+
+        if (be) {
+            r0 = ao << 4 | bo;
+            r1 = ae << 4 | bev;
+        } else {
+            r0 = ae | bev << 4;
+            r1 = ao | bo << 4;
+        }
+    } else if (be) {
+        /* a holds the odd bits of both groups, b the even ones.  */
+        r0 = stripe_scatter_even(b >> 4) | stripe_scatter_even(a >> 4) << 1;
+        r1 = stripe_scatter_even(b) | stripe_scatter_even(a) << 1;
+    } else {
+        /* a holds the even bits of both groups, b the odd ones.  */
+        r0 = stripe_scatter_even(a) | stripe_scatter_even(b) << 1;
+        r1 = stripe_scatter_even(a >> 4) | stripe_scatter_even(b >> 4) << 1;
+    }
+
+    memcpy(l[0], &r0, sizeof r0);
+    memcpy(l[1], &r1, sizeof r1);
+    for (i = 0; i < n; i++) {
+        dst[2 * i] = l[0][i];
+        dst[2 * i + 1] = l[1][i];
+    }
+}
+
+/* Stripe len two byte groups held in separate lanes x0 and x1 into dst,
+ * which is 2 * len long.
+ */
+static inline void stripe2(uint8_t *dst, const uint8_t *x0, const uint8_t *x1,
+                           size_t len, bool dir, bool be)
+{
+    size_t i;
+
+    for (i = 0; i < len; i += STRIPE2_LANES) {
+        size_t n = len - i < STRIPE2_LANES ? len - i : STRIPE2_LANES;
+
+        stripe2_lanes(dst + 2 * i, x0 + i, x1 + i, n, dir, be);
+    }
+}
+
+/* N way (num) in place bit striper. Lay out row wise bits column wise
+ * (from element 0 to N-1). num is the length of x, and dir reverses the
+ * direction of the transform. be determines the bit endianess scheme.
+ * false to lay out bits LSB to MSB (little endian) and true for big endian.
+ *
+ * Best illustrated by examples:
+ * Each digit in the below array is a single bit (num == 3, be == false):
+ *
+ * {{ 76543210, }  ----- stripe (dir == false) -----> {{ FCheb630, }
+ *  { hgfedcba, }                                      { GDAfc741, }
+ *  { HGFEDCBA, }} <---- upstripe (dir == true) -----  { HEBgda52, }}
+ *
+ * Same but with be == true:
+ *
+ * {{ 76543210, }  ----- stripe (dir == false) -----> {{ 741gdaFC, }
+ *  { hgfedcba, }                                      { 630fcHEB, }
+ *  { HGFEDCBA, }} <---- upstripe (dir == true) -----  { 52hebGDA, }}
+ */
+
+static inline void stripe8(uint8_t *x, int num, bool dir, bool be)
+{
+    uint8_t r[num];
+    int idx[2] = {0, 0};
+    int bit[2] = {0, be ? 7 : 0};
+    int d = dir;
+
+    if (num == 1) {
+        return;
+    }
+    if (num == 2) {
+        uint8_t x0 = x[0], x1 = x[1];
+
+        stripe2_lanes(x, &x0, &x1, 1, dir, be);
+        return;
+    }
+
+    memset(r, 0, sizeof(uint8_t) * num);
+    for (idx[0] = 0; idx[0] < num; ++idx[0]) {
+        for (bit[0] = be ? 7 : 0; bit[0] != (be ? -1 : 8);
+                 bit[0] += be ? -1 : 1) {
+            r[idx[!d]] |= x[idx[d]] & 1 << bit[d] ? 1 << bit[!d] : 0;
+            idx[1] = (idx[1] + 1) % num;
+            if (!idx[1]) {
+                bit[1] += be ? -1 : 1;
+            }
+        }
+    }
+    memcpy(x, r, sizeof(uint8_t) * num);
+}
+
+/* Stripe every num byte group of the len long buf in place. A trailing
+ * partial group is left alone.
+ */
+static inline void stripe_buf(uint8_t *buf, size_t len, int num,
+                              bool dir, bool be)
+{
+    size_t i, j;
+
+    if (num != 2) {
+        for (i = 0; i + num <= len; i += num) {
+            stripe8(buf + i, num, dir, be);
+        }
+        return;
+    }
+
+    for (i = 0; i + 2 <= len; i += 2 * STRIPE2_LANES) {
+        uint8_t x0[STRIPE2_LANES], x1[STRIPE2_LANES];
+        size_t n = (len - i) / 2;
+
+        n = n < STRIPE2_LANES ? n : STRIPE2_LANES;
+        for (j = 0; j < n; j++) {
+            x0[j] = buf[i + 2 * j];
+            x1[j] = buf[i + 2 * j + 1];
+        }
+        stripe2_lanes(buf + i, x0, x1, n, dir, be);
+    }
+}
+
+#endif
@@ -40,6 +40,8 @@ void qemu_cond_destroy(QemuCond *cond);
 void qemu_cond_signal(QemuCond *cond);
 void qemu_cond_broadcast(QemuCond *cond);
 void qemu_cond_wait(QemuCond *cond, QemuMutex *mutex);
+/* Returns false if @ms milliseconds elapsed without a wakeup.  */
+bool qemu_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms);
 
 void qemu_sem_init(QemuSemaphore *sem, int init);
 void qemu_sem_post(QemuSemaphore *sem);
@@ -61,6 +63,10 @@ void qemu_thread_get_self(QemuThread *thread);
 bool qemu_thread_is_self(QemuThread *thread);
 void qemu_thread_exit(void *retval);
 void qemu_thread_naming(bool enable);
+/* Run @thread on the first @nbits host CPUs set in @host_cpus only */
+int qemu_thread_set_affinity(QemuThread *thread,
+                             const unsigned long *host_cpus,
+                             unsigned long nbits);
 
 struct Notifier;
 void qemu_thread_atexit_add(struct Notifier *notifier);
@@ -66,7 +66,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t seq;               /* arming order, breaks expire_time ties */
+    int heap_index;             /* in the timer list, while pending */
     int scale;
 };
 
@@ -700,6 +701,22 @@ void timer_mod(QEMUTimer *ts, int64_t expire_timer);
  */
 void timer_mod_anticipate(QEMUTimer *ts, int64_t expire_time);
 
+/**
+ * timer_mod_coalesce_ns:
+ * @ts: the timer
+ * @expire_time: the expiry time in nanoseconds
+ * @slack: how late, in nanoseconds, the timer may fire
+ *
+ * Modify a timer to expire at @expire_time, or up to @slack later so
+ * that timers armed with the same @slack expire together, sharing a
+ * single wakeup.  Only for timers whose precision nobody observes, like
+ * timeouts and housekeeping.
+ *
+ * This function is thread-safe but the timer and its timer list must not be
+ * freed while this function is running.
+ */
+void timer_mod_coalesce_ns(QEMUTimer *ts, int64_t expire_time, int64_t slack);
+
 /**
  * timer_pending:
  * @ts: the timer
@@ -273,6 +273,8 @@ struct qemu_work_item;
 
 #define CPU_UNSET_NUMA_NODE_ID -1
 #define CPU_TRACE_DSTATE_MAX_EVENTS 32
+/* Bits in CPUState::host_cpus */
+#define CPU_HOST_CPUS_MAX 1024
 
 /**
  * CPUState:
@@ -283,6 +285,8 @@ struct qemu_work_item;
  * @has_waiter: #true if a CPU is currently waiting for the cpu_exec_end;
  * valid under cpu_list_lock.
  * @created: Indicates whether the CPU thread has been successfully created.
+ * @host_cpus: Host CPUs the thread of this CPU is pinned to, %NULL if it
+ * may run anywhere.
  * @interrupt_request: Indicates a pending interrupt request.
  * @halted: Nonzero if the CPU is in suspended state.
  * @stop: Indicates a pending stop request.
@@ -291,6 +295,8 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @qicount_clock: Virtual time reached by this CPU, in ns, only used in
+ * quantum icount mode.
  * @icount_decr: Low 16 bits: number of cycles left, only used in icount mode.
  * High 16 bits: Set to -1 to force TCG to stop executing linked TBs for this
  * CPU and return to its top level loop (even in non-icount mode).
@@ -312,6 +318,12 @@ struct qemu_work_item;
  * @opaque: User data.
  * @mem_io_pc: Host Program Counter at which the memory was accessed.
  * @mem_io_vaddr: Target virtual address at which the memory was accessed.
+ * @poll_addr: Physical address of the MMIO read being watched for polling.
+ * @poll_val: Value last returned by @poll_addr.
+ * @poll_pc: Host Program Counter of the polling load.
+ * @poll_icount: Instruction count at the last poll, only used in icount mode.
+ * @poll_count: Number of identical polls seen in a row.
+ * @poll_skip: Set once the vCPU is known to spin on @poll_addr.
  * @kvm_fd: vCPU file descriptor for KVM.
  * @work_mutex: Lock to prevent multiple access to queued_work_*.
  * @queued_work_first: First asynchronous work pending.
@@ -337,6 +349,7 @@ struct CPUState {
     HANDLE hThread;
 #endif
     int thread_id;
+    unsigned long *host_cpus;
     bool running, has_waiter;
     struct QemuCond *halt_cond;
     bool thread_kicked;
@@ -352,6 +365,7 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t qicount_clock;
     sigjmp_buf jmp_env;
 
     QemuMutex work_mutex;
@@ -386,6 +400,14 @@ struct CPUState {
     uintptr_t mem_io_pc;
     vaddr mem_io_vaddr;
 
+    /* Polling loop detection, see cpu_poll_mmio_read.  */
+    hwaddr poll_addr;
+    uint64_t poll_val;
+    uintptr_t poll_pc;
+    int64_t poll_icount;
+    unsigned int poll_count;
+    bool poll_skip;
+
     int kvm_fd;
     struct KVMState *kvm_state;
     struct kvm_run *kvm_run;
@@ -430,6 +452,7 @@ struct CPUState {
     bool reset_pin; /* state of reset pin */
     bool halt_pin; /* state of halt pin */
     bool arch_halt_pin;
+    bool power_gated; /* powered off by its power domain */
 
     char *gdb_id;
 };
@@ -690,6 +713,18 @@ const char *cpu_parse_cpu_model(const char *typename, const char *cpu_model);
  */
 CPUState *cpu_generic_init(const char *typename, const char *cpu_model);
 
+/**
+ * cpu_poll_reset:
+ * @cpu: The vCPU that did something other than polling.
+ *
+ * Restarts polling loop detection, see cpu_poll_mmio_read.
+ */
+static inline void cpu_poll_reset(CPUState *cpu)
+{
+    cpu->poll_count = 0;
+    cpu->poll_skip = false;
+}
+
 /**
  * cpu_has_work:
  * @cpu: The vCPU to check.
@@ -716,6 +751,16 @@ static inline bool cpu_has_work(CPUState *cpu)
  */
 bool qemu_cpu_is_self(CPUState *cpu);
 
+/**
+ * qemu_cpu_set_host_cpus:
+ * @cpu: The vCPU to pin.
+ * @host_cpus: Bitmap of %CPU_HOST_CPUS_MAX host CPUs.
+ *
+ * Pins @cpu's thread to @host_cpus. A thread shared by several vCPUs may
+ * run on the host CPUs of any of them.
+ */
+void qemu_cpu_set_host_cpus(CPUState *cpu, const unsigned long *host_cpus);
+
 /**
  * qemu_cpu_kick:
  * @cpu: The vCPU to kick.
@@ -724,6 +769,19 @@ bool qemu_cpu_is_self(CPUState *cpu);
  */
 void qemu_cpu_kick(CPUState *cpu);
 
+/**
+ * qemu_cpu_kick_wait:
+ * @cpu: The vCPU kicked by the caller.
+ * @ms: Timeout in milliseconds.
+ *
+ * Waits, with the iothread lock held, until @cpu's thread has left the
+ * execution loop after a kick, or has parked itself because it is idle.
+ *
+ * Returns: %true if @cpu acknowledged the kick, %false if it was idle or
+ * did not answer within @ms.
+ */
+bool qemu_cpu_kick_wait(CPUState *cpu, int ms);
+
 /**
  * cpu_is_stopped:
  * @cpu: The CPU to check.
@@ -0,0 +1,25 @@
+/*
+ * Boot milestone profiling
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_BOOT_PROFILE_H
+#define SYSEMU_BOOT_PROFILE_H
+
+#include "qapi-types.h"
+
+/* Note that @phase was hit at @detail, which may be NULL.  Only the first
+ * hit of each phase and detail since the last system reset is timed, the
+ * later ones are counted.  Cheap enough for register hooks, but lines that
+ * see a lot of traffic should check boot_profile_seen() first.
+ */
+void boot_profile_mark(BootPhase phase, const char *detail);
+
+/* Whether @phase was hit since the last system reset.  */
+bool boot_profile_seen(BootPhase phase);
+
+#endif
@@ -2,6 +2,7 @@
 #define QEMU_CPUS_H
 
 #include "qemu/timer.h"
+#include "exec/hwaddr.h"
 
 /* cpus.c */
 bool qemu_in_vcpu_thread(void);
@@ -14,6 +15,7 @@ void cpu_ticks_init(void);
 
 void configure_icount(QemuOpts *opts, Error **errp);
 extern int use_icount;
+extern bool use_icount_quantum;
 extern int icount_align_option;
 
 /* drift information for info jit command */
@@ -47,4 +49,10 @@ void list_cpus(FILE *f, fprintf_function cpu_fprintf, const char *optarg);
 
 void qemu_tcg_configure(QemuOpts *opts, Error **errp);
 
+/* Polling loop detection for -accel tcg,poll-skip=on. Called by the softmmu
+ * slow path on MMIO reads, see also cpu_poll_reset.
+ */
+void cpu_poll_mmio_read(CPUState *cpu, hwaddr addr, uint64_t val,
+                        uintptr_t pc);
+
 #endif
@@ -194,6 +194,11 @@ typedef struct DumpState {
                                   * finished. */
     uint8_t *guest_note;         /* ELF note content */
     size_t guest_note_size;
+
+    bool sparse;                 /* fd can seek over zero pages */
+    int threads;                 /* threads compressing kdump pages */
+    int64_t start_ms;            /* realtime at which the dump started */
+    int64_t end_ms;              /* and ended, 0 while it runs */
 } DumpState;
 
 uint16_t cpu_to_dump16(DumpState *s, uint16_t val);
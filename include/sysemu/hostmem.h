@@ -56,6 +56,10 @@ struct HostMemoryBackend {
     uint64_t size;
     bool merge, dump;
     bool prealloc, force_prealloc, is_mapped;
+    uint32_t prealloc_threads;
+    bool prealloc_async;
+    MemPrealloc *prealloc_job;
+    Notifier prealloc_done;
     DECLARE_BITMAP(host_nodes, MAX_NODES + 1);
     HostMemPolicy policy;
 
@@ -68,4 +72,12 @@ MemoryRegion *host_memory_backend_get_memory(HostMemoryBackend *backend,
 
 void host_memory_backend_set_mapped(HostMemoryBackend *backend, bool mapped);
 bool host_memory_backend_is_mapped(HostMemoryBackend *backend);
+
+/*
+ * Set in @host_cpus the host CPUs local to the host nodes @backend is bound
+ * to. Returns false when it isn't bound to any, or on error.
+ */
+bool host_memory_backend_get_host_cpus(HostMemoryBackend *backend,
+                                       unsigned long *host_cpus,
+                                       unsigned long nbits, Error **errp);
 #endif
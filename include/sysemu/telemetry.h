@@ -0,0 +1,38 @@
+/*
+ * Periodic counter snapshots
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_TELEMETRY_H
+#define SYSEMU_TELEMETRY_H
+
+#include "qapi-types.h"
+
+typedef struct TelemetrySet TelemetrySet;
+
+/* Read counter @idx of @opaque.  Called from the telemetry thread without
+ * the BQL, so it may only look at atomics or take locks of its own.
+ */
+typedef uint64_t TelemetryReadFunc(void *opaque, unsigned int idx);
+/* Drop what a source holds for a subscription, called with the BQL held. */
+typedef void TelemetryReleaseFunc(void *opaque);
+/* Add the counters of a source to @set, called with the BQL held.  */
+typedef void TelemetryBindFunc(TelemetrySet *set);
+
+void telemetry_register_source(TelemetrySource source,
+                               TelemetryBindFunc *bind);
+
+void telemetry_add_counter(TelemetrySet *set, const char *name,
+                           TelemetryReadFunc *read, void *opaque,
+                           unsigned int idx);
+/* Call @release on @opaque when the subscription ends.  Sources take a
+ * reference on what their counters read and drop it here.
+ */
+void telemetry_add_release(TelemetrySet *set, TelemetryReleaseFunc *release,
+                           void *opaque);
+
+#endif
@@ -22,11 +22,23 @@
 #include "qemu/queue.h"
 #include "sysemu/sysemu.h"
 #include "exec/exec-all.h"
+#include "qapi/clone-visitor.h"
+#include "qapi-visit.h"
+#include "qemu/error-report.h"
 
-typedef struct FaultEventEntry FaultEventEntry;
-static QLIST_HEAD(, FaultEventEntry) events = QLIST_HEAD_INITIALIZER(events);
+/* Pending actions, a binary min-heap ordered by time then submission.  */
+typedef struct FaultEventEntry {
+    uint64_t time_ns;
+    uint64_t seq;
+    ScheduledEvent *ev;
+} FaultEventEntry;
+
+static GArray *events;
+static uint64_t events_seq;
 static QEMUTimer *timer;
 
+static void do_fault(void *opaque);
+
 #ifndef DEBUG_FAULT_INJECTION
 #define DEBUG_FAULT_INJECTION 0
 #endif
@@ -118,47 +130,120 @@ ReadValue *qmp_read_mem(int64_t addr, int64_t size, bool has_cpu, int64_t cpu,
     }
 }
 
-struct FaultEventEntry {
-    uint64_t time_ns;
-    int64_t val;
-    QLIST_ENTRY(FaultEventEntry) node;
-};
+#define EVENT_AT(i) g_array_index(events, FaultEventEntry, (i))
 
-static void mod_next_event_timer(void)
+static bool event_before(FaultEventEntry *a, FaultEventEntry *b)
 {
-    uint64_t val;
-    FaultEventEntry *entry;
+    return a->time_ns < b->time_ns
+           || (a->time_ns == b->time_ns && a->seq < b->seq);
+}
 
-    if (QLIST_EMPTY(&events)) {
-        return;
-    } else {
-        val = QLIST_FIRST(&events)->time_ns;
+static void event_swap(unsigned int i, unsigned int j)
+{
+    FaultEventEntry tmp = EVENT_AT(i);
+
+    EVENT_AT(i) = EVENT_AT(j);
+    EVENT_AT(j) = tmp;
+}
+
+static void events_push(uint64_t time_ns, ScheduledEvent *ev)
+{
+    FaultEventEntry entry = {
+        .time_ns = time_ns,
+        .seq = events_seq++,
+        .ev = ev,
+    };
+    unsigned int i;
+
+    if (!events) {
+        events = g_array_new(false, false, sizeof(FaultEventEntry));
+        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
     }
 
-    QLIST_FOREACH(entry, &events, node) {
-        if (val > entry->time_ns) {
-            val = entry->time_ns;
+    g_array_append_val(events, entry);
+    for (i = events->len - 1; i; i = (i - 1) / 2) {
+        if (!event_before(&EVENT_AT(i), &EVENT_AT((i - 1) / 2))) {
+            break;
         }
+        event_swap(i, (i - 1) / 2);
     }
+}
 
-    timer_mod(timer, val);
+static FaultEventEntry events_pop(void)
+{
+    FaultEventEntry top = EVENT_AT(0);
+    unsigned int i = 0;
+
+    EVENT_AT(0) = EVENT_AT(events->len - 1);
+    g_array_set_size(events, events->len - 1);
+
+    for (;;) {
+        unsigned int l = 2 * i + 1, r = l + 1, min = i;
+
+        if (l < events->len && event_before(&EVENT_AT(l), &EVENT_AT(min))) {
+            min = l;
+        }
+        if (r < events->len && event_before(&EVENT_AT(r), &EVENT_AT(min))) {
+            min = r;
+        }
+        if (min == i) {
+            break;
+        }
+        event_swap(i, min);
+        i = min;
+    }
+    return top;
+}
+
+static void mod_next_event_timer(void)
+{
+    if (events && events->len) {
+        timer_mod(timer, EVENT_AT(0).time_ns);
+    }
+}
+
+static void fire_event(ScheduledEvent *ev, uint64_t now)
+{
+    ScheduledEventGpio *gpio;
+    ScheduledEventWriteMem *wm;
+    Error *err = NULL;
+
+    switch (ev->kind) {
+    case SCHEDULED_EVENT_ACTION_EVENT:
+        DPRINTF("fault %"PRId64" happened @%"PRId64"!\n",
+                ev->u.event.event_id, now);
+        qapi_event_send_fault_event(ev->u.event.event_id, now, &error_abort);
+        vm_stop_from_timer(RUN_STATE_DEBUG);
+        break;
+    case SCHEDULED_EVENT_ACTION_GPIO:
+        gpio = &ev->u.gpio;
+        qmp_inject_gpio(gpio->device_name, gpio->has_gpio, gpio->gpio,
+                        gpio->num, gpio->val, &err);
+        break;
+    case SCHEDULED_EVENT_ACTION_WRITE_MEM:
+        wm = &ev->u.write_mem;
+        qmp_write_mem(wm->addr, wm->val, wm->size, wm->has_cpu, wm->cpu,
+                      wm->has_qom, wm->qom, wm->has_debug && wm->debug,
+                      &err);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    if (err) {
+        error_report_err(err);
+    }
 }
 
 static void do_fault(void *opaque)
 {
-    FaultEventEntry *entry;
-    FaultEventEntry *next;
     uint64_t current_time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
-    QLIST_FOREACH_SAFE(entry, &events, node, next) {
-        if (entry->time_ns < current_time) {
-            DPRINTF("fault %"PRId64" happened @%"PRId64"!\n", entry->val,
-                    qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
-            qapi_event_send_fault_event(entry->val, current_time, &error_abort);
-            QLIST_REMOVE(entry, node);
-            g_free(entry);
-            vm_stop_from_timer(RUN_STATE_DEBUG);
-        }
+    while (events->len && EVENT_AT(0).time_ns <= current_time) {
+        FaultEventEntry entry = events_pop();
+
+        fire_event(entry.ev, current_time);
+        qapi_free_ScheduledEvent(entry.ev);
     }
 
     mod_next_event_timer();
@@ -166,18 +251,88 @@ static void do_fault(void *opaque)
 
 void qmp_trigger_event(int64_t time_ns, int64_t event_id, Error **errp)
 {
-    FaultEventEntry *entry;
+    ScheduledEvent *ev;
 
     DPRINTF("trigger_event(%"PRId64", %"PRId64")\n", time_ns, event_id);
 
-    entry = g_new0(FaultEventEntry, 1);
-    entry->time_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + time_ns;
-    entry->val = event_id;
-    QLIST_INSERT_HEAD(&events, entry, node);
+    ev = g_new0(ScheduledEvent, 1);
+    ev->kind = SCHEDULED_EVENT_ACTION_EVENT;
+    ev->u.event.event_id = event_id;
+    events_push(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + time_ns, ev);
 
-    if (!timer) {
-        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
+    mod_next_event_timer();
+}
+
+/* Catch what would only fail once the action fires.  */
+static bool check_event(ScheduledEvent *ev, Error **errp)
+{
+    ScheduledEventGpio *gpio;
+    ScheduledEventWriteMem *wm;
+    Object *obj;
+
+    switch (ev->kind) {
+    case SCHEDULED_EVENT_ACTION_GPIO:
+        gpio = &ev->u.gpio;
+        obj = object_resolve_path(gpio->device_name, NULL);
+        if (!object_dynamic_cast(obj, TYPE_DEVICE)) {
+            error_set(errp, ERROR_CLASS_DEVICE_NOT_FOUND,
+                      "Device '%s' is not a device", gpio->device_name);
+            return false;
+        }
+        if (!qdev_get_gpio_in_named(DEVICE(obj),
+                                    gpio->has_gpio ? gpio->gpio : NULL,
+                                    gpio->num)) {
+            error_set(errp, ERROR_CLASS_DEVICE_NOT_FOUND,
+                      "GPIO '%s' doesn't exists",
+                      gpio->has_gpio ? gpio->gpio : "unnammed");
+            return false;
+        }
+        break;
+    case SCHEDULED_EVENT_ACTION_WRITE_MEM:
+        wm = &ev->u.write_mem;
+        if (wm->has_qom) {
+            obj = object_resolve_path(wm->qom, NULL);
+            if (!object_dynamic_cast(obj, TYPE_CPU)) {
+                error_set(errp, ERROR_CLASS_DEVICE_NOT_FOUND,
+                          "'%s' is not a CPU or doesn't exists", wm->qom);
+                return false;
+            }
+        } else if (wm->has_cpu && !qemu_get_cpu(wm->cpu)) {
+            error_setg(errp, "CPU %" PRId64 " doesn't exist", wm->cpu);
+            return false;
+        }
+        if (wm->size <= 0 || wm->size > sizeof(wm->val)) {
+            error_setg(errp, "Invalid write size %" PRId64, wm->size);
+            return false;
+        }
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+void qmp_schedule_events(ScheduledEventList *list, Error **errp)
+{
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    ScheduledEventList *e;
+    unsigned int i = 0;
+
+    for (e = list; e; e = e->next, i++) {
+        Error *err = NULL;
+
+        if (!check_event(e->value, &err)) {
+            error_propagate(errp, err);
+            error_prepend(errp, "events[%u]: ", i);
+            return;
+        }
+    }
+
+    for (e = list; e; e = e->next) {
+        events_push(now + e->value->time_ns,
+                    QAPI_CLONE(ScheduledEvent, e->value));
     }
+    DPRINTF("scheduled %u events\n", i);
 
     mod_next_event_timer();
 }
@@ -731,6 +731,8 @@ static void qio_channel_socket_set_aio_fd_handler(QIOChannel *ioc,
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
     aio_set_fd_handler(ctx, sioc->fd, false, io_read, io_write, NULL, opaque);
+    /* Keep busy polling of the AioContext, e.g. for NBD in an IOThread */
+    aio_set_fd_poll_ready(ctx, sioc->fd, true);
 }
 
 static GSource *qio_channel_socket_create_watch(QIOChannel *ioc,
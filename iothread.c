@@ -17,6 +17,7 @@
 #include "qemu/module.h"
 #include "block/aio.h"
 #include "block/block.h"
+#include "block/thread-pool.h"
 #include "sysemu/iothread.h"
 #include "qmp-commands.h"
 #include "qemu/error-report.h"
@@ -302,6 +303,12 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    if (iothread->ctx) {
+        info->poll_ns = iothread->ctx->poll_ns;
+        info->poll_attempts = iothread->ctx->poll_attempts;
+        info->poll_successes = iothread->ctx->poll_successes;
+        info->poll_blockers = iothread->ctx->poll_disable_cnt;
+    }
 
     elem = g_new0(IOThreadInfoList, 1);
     elem->value = info;
@@ -322,6 +329,54 @@ IOThreadInfoList *qmp_query_iothreads(Error **errp)
     return head;
 }
 
+/* Pools are created on first use, contexts without one are skipped.  */
+static void query_one_thread_pool(AioContext *ctx, const char *id,
+                                  ThreadPoolInfoList ***prev)
+{
+    ThreadPool *pool = atomic_read(&ctx->thread_pool);
+    ThreadPoolInfoList *elem;
+
+    if (!pool) {
+        return;
+    }
+
+    elem = g_new0(ThreadPoolInfoList, 1);
+    elem->value = g_new0(ThreadPoolInfo, 1);
+    elem->value->has_iothread = id != NULL;
+    elem->value->iothread = g_strdup(id);
+    thread_pool_get_info(pool, elem->value);
+
+    **prev = elem;
+    *prev = &elem->next;
+}
+
+static int query_one_iothread_pool(Object *object, void *opaque)
+{
+    IOThread *iothread;
+    char *id;
+
+    iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
+    if (!iothread || !iothread->ctx) {
+        return 0;
+    }
+
+    id = iothread_get_id(iothread);
+    query_one_thread_pool(iothread->ctx, id, opaque);
+    g_free(id);
+    return 0;
+}
+
+ThreadPoolInfoList *qmp_query_thread_pools(Error **errp)
+{
+    ThreadPoolInfoList *head = NULL;
+    ThreadPoolInfoList **prev = &head;
+
+    query_one_thread_pool(qemu_get_aio_context(), NULL, &prev);
+    object_child_foreach(object_get_objects_root(), query_one_iothread_pool,
+                         &prev);
+    return head;
+}
+
 void iothread_stop_all(void)
 {
     Object *container = object_get_objects_root();
@@ -7716,6 +7716,80 @@ static TargetFdTrans target_inotify_trans = {
 };
 #endif
 
+/* The host can fill in guest timespec and timeval structures in place
+   when they have the same layout as its own.  */
+#if TARGET_ABI_BITS == HOST_LONG_BITS && \
+    defined(HOST_WORDS_BIGENDIAN) == defined(TARGET_WORDS_BIGENDIAN)
+#define TARGET_TIME_IS_HOST 1
+QEMU_BUILD_BUG_ON(sizeof(struct target_timespec) != sizeof(struct timespec));
+QEMU_BUILD_BUG_ON(sizeof(struct target_timeval) != sizeof(struct timeval));
+#endif
+
+/* Fast path for the syscalls that timer heavy and I/O heavy programs make
+   the most: the arguments are plain values or guest buffers that the host
+   uses in place, and the result needs no conversion, so they skip the
+   large switch of do_syscall() and its per-call structure copies.
+   Returns false to take the slow path, e.g. for descriptors that need
+   their data translated.  */
+static bool do_syscall_fast(int num, abi_long arg1, abi_long arg2,
+                            abi_long arg3, abi_long *ret)
+{
+    switch (num) {
+    case TARGET_NR_read:
+        if (arg3 == 0 || fd_trans_host_to_target_data(arg1)) {
+            return false;
+        }
+        if (!access_ok(VERIFY_WRITE, arg2, arg3)) {
+            *ret = -TARGET_EFAULT;
+            return true;
+        }
+        *ret = get_errno(safe_read(arg1, g2h(arg2), arg3));
+        return true;
+    case TARGET_NR_write:
+        if (fd_trans_target_to_host_data(arg1)) {
+            return false;
+        }
+        if (!access_ok(VERIFY_READ, arg2, arg3)) {
+            *ret = -TARGET_EFAULT;
+            return true;
+        }
+        *ret = get_errno(safe_write(arg1, g2h(arg2), arg3));
+        return true;
+#ifdef TARGET_NR_getpid
+    case TARGET_NR_getpid:
+        *ret = get_errno(getpid());
+        return true;
+#endif
+    case TARGET_NR_gettid:
+        *ret = get_errno(gettid());
+        return true;
+    case TARGET_NR_sched_yield:
+        *ret = get_errno(sched_yield());
+        return true;
+#ifdef TARGET_TIME_IS_HOST
+#ifdef TARGET_NR_clock_gettime
+    case TARGET_NR_clock_gettime:
+        if (!access_ok(VERIFY_WRITE, arg2, sizeof(struct timespec))) {
+            *ret = -TARGET_EFAULT;
+            return true;
+        }
+        *ret = get_errno(clock_gettime(arg1, g2h(arg2)));
+        return true;
+#endif
+    case TARGET_NR_gettimeofday:
+        /* Like the slow path, this never fills in the timezone */
+        if (!access_ok(VERIFY_WRITE, arg1, sizeof(struct timeval))) {
+            *ret = -TARGET_EFAULT;
+            return true;
+        }
+        *ret = get_errno(gettimeofday(g2h(arg1), NULL));
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
 /* do_syscall() should always have a single exit point at the end so
    that actions, such as logging of syscall results, can be performed.
    All errnos that do_syscall() returns must be -TARGET_<errcode>. */
@@ -7752,6 +7826,10 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
     if(do_strace)
         print_syscall(num, arg1, arg2, arg3, arg4, arg5, arg6);
 
+    if (do_syscall_fast(num, arg1, arg2, arg3, &ret)) {
+        goto fail;
+    }
+
     switch(num) {
     case TARGET_NR_exit:
         /* In old applications this may be used to implement _exit(2).
@@ -22,14 +22,18 @@
 #include "exec/ioport.h"
 #include "qapi/visitor.h"
 #include "qemu/bitops.h"
+#include "qemu/iov.h"
 #include "qemu/error-report.h"
 #include "qom/object.h"
 #include "trace-root.h"
 
 #include "exec/memory-internal.h"
+#include "exec/mmio-profile.h"
+#include "qemu/timer.h"
 #include "exec/ram_addr.h"
 #include "sysemu/kvm.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/hostmem.h"
 #include "hw/misc/mmio_interface.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
@@ -238,8 +242,24 @@ struct FlatView {
     unsigned nr_allocated;
     struct AddressSpaceDispatch *dispatch;
     MemoryRegion *root;
+    /* Regions rendered through an alias, see flatview_update_ranges() */
+    GHashTable *alias_targets;
 };
 
+/* A topology change since the last commit.  @range is in @mr's own
+ * address space, i.e. relative to its start.
+ */
+typedef struct FlatViewUpdate {
+    MemoryRegion *mr;
+    AddrRange range;
+} FlatViewUpdate;
+
+/* Past this many changes in one transaction, re-render everything.  */
+#define FLATVIEW_MAX_UPDATES 64
+
+static GArray *flatview_updates;
+static bool flatview_update_all;
+
 typedef struct AddressSpaceOps AddressSpaceOps;
 
 #define FOR_EACH_FLAT_RANGE(var, view)          \
@@ -309,6 +329,9 @@ static void flatview_destroy(FlatView *view)
         memory_region_unref(view->ranges[i].mr);
     }
     g_free(view->ranges);
+    if (view->alias_targets) {
+        g_hash_table_destroy(view->alias_targets);
+    }
     memory_region_unref(view->root);
     g_free(view);
 }
@@ -703,6 +726,14 @@ static AddressSpace *memory_region_to_address_space(MemoryRegion *mr)
     return NULL;
 }
 
+static void flatview_add_alias_target(FlatView *view, MemoryRegion *mr)
+{
+    if (!view->alias_targets) {
+        view->alias_targets = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(view->alias_targets, mr);
+}
+
 /* Render a memory region into the global view.  Ranges in @view obscure
  * ranges in @mr.
  */
@@ -736,6 +767,7 @@ static void render_memory_region(FlatView *view,
     clip = addrrange_intersection(tmp, clip);
 
     if (mr->alias) {
+        flatview_add_alias_target(view, mr->alias);
         int128_subfrom(&base, int128_make64(mr->alias->addr));
         int128_subfrom(&base, int128_make64(mr->alias_offset));
         render_memory_region(view, mr->alias, base, clip, readonly);
@@ -834,10 +866,25 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
+static void flatview_publish(FlatView *view)
+{
+    int i;
+
+    flatview_simplify(view);
+
+    view->dispatch = address_space_dispatch_new(view);
+    for (i = 0; i < view->nr; i++) {
+        MemoryRegionSection mrs =
+            section_from_flat_range(&view->ranges[i], view);
+        flatview_add_to_dispatch(view, &mrs);
+    }
+    address_space_dispatch_compact(view->dispatch);
+    g_hash_table_replace(flat_views, view->root, view);
+}
+
 /* Render a memory topology into a list of disjoint absolute ranges. */
 static FlatView *generate_memory_topology(MemoryRegion *mr)
 {
-    int i;
     FlatView *view;
 
     view = flatview_new(mr);
@@ -846,20 +893,196 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
         render_memory_region(view, mr, int128_zero(),
                              addrrange_make(int128_zero(), int128_2_64()), false);
     }
-    flatview_simplify(view);
+    flatview_publish(view);
 
-    view->dispatch = address_space_dispatch_new(view);
-    for (i = 0; i < view->nr; i++) {
-        MemoryRegionSection mrs =
-            section_from_flat_range(&view->ranges[i], view);
-        flatview_add_to_dispatch(view, &mrs);
+    return view;
+}
+
+/* Note that the rendering of @size bytes at @start in @mr changed.
+ * Commits only re-render the affected ranges of the FlatViews.
+ */
+static void memory_region_update_range(MemoryRegion *mr, Int128 start,
+                                       Int128 size)
+{
+    FlatViewUpdate u = { .mr = mr, .range = addrrange_make(start, size) };
+
+    memory_region_update_pending = true;
+    if (flatview_update_all || !int128_nz(size)) {
+        return;
     }
-    address_space_dispatch_compact(view->dispatch);
-    g_hash_table_replace(flat_views, mr, view);
+    if (!flatview_updates) {
+        flatview_updates = g_array_new(false, false, sizeof(FlatViewUpdate));
+    }
+    if (flatview_updates->len == FLATVIEW_MAX_UPDATES) {
+        flatview_update_all = true;
+        return;
+    }
+    g_array_append_val(flatview_updates, u);
+}
+
+static void memory_region_update(MemoryRegion *mr)
+{
+    memory_region_update_range(mr, int128_zero(), mr->size);
+}
+
+static void memory_region_update_all(void)
+{
+    memory_region_update_pending = true;
+    flatview_update_all = true;
+}
+
+static void flatview_updates_reset(void)
+{
+    if (flatview_updates) {
+        g_array_set_size(flatview_updates, 0);
+    }
+    flatview_update_all = false;
+}
+
+static gint addrrange_compare(gconstpointer a, gconstpointer b)
+{
+    const AddrRange *r1 = a, *r2 = b;
+
+    if (int128_lt(r1->start, r2->start)) {
+        return -1;
+    }
+    return int128_eq(r1->start, r2->start) ? 0 : 1;
+}
+
+/* Map the pending updates into the address space of @view.  Returns
+ * false if the whole view must be rendered again, e.g because a change
+ * is visible through an alias.  Otherwise fills @ranges with sorted
+ * disjoint ranges, possibly none.
+ */
+static bool flatview_update_ranges(FlatView *view, GArray *ranges)
+{
+    AddrRange all = addrrange_make(int128_zero(), int128_2_64());
+    unsigned i, j;
+
+    if (flatview_update_all) {
+        return false;
+    }
+
+    for (i = 0; flatview_updates && i < flatview_updates->len; i++) {
+        FlatViewUpdate *u = &g_array_index(flatview_updates,
+                                           FlatViewUpdate, i);
+        Int128 start = u->range.start;
+        MemoryRegion *mr;
+
+        for (mr = u->mr; mr; mr = mr->container) {
+            if (view->alias_targets
+                && g_hash_table_contains(view->alias_targets, mr)) {
+                return false;
+            }
+            if (mr == view->root) {
+                AddrRange r;
+
+                r = addrrange_make(int128_add(start, int128_make64(mr->addr)),
+                                   u->range.size);
+                if (addrrange_intersects(r, all)) {
+                    r = addrrange_intersection(r, all);
+                    g_array_append_val(ranges, r);
+                }
+                break;
+            }
+            int128_addto(&start, int128_make64(mr->addr));
+        }
+    }
+
+    /* Sort and merge overlapping or adjacent ranges.  */
+    g_array_sort(ranges, addrrange_compare);
+    for (i = 0, j = 1; j < ranges->len; j++) {
+        AddrRange *cur = &g_array_index(ranges, AddrRange, i);
+        AddrRange *next = &g_array_index(ranges, AddrRange, j);
+
+        if (int128_le(next->start, addrrange_end(*cur))) {
+            Int128 end = int128_max(addrrange_end(*cur), addrrange_end(*next));
+
+            cur->size = int128_sub(end, cur->start);
+        } else {
+            g_array_index(ranges, AddrRange, ++i) = *next;
+        }
+    }
+    g_array_set_size(ranges, MIN(ranges->len, i + 1));
+    return true;
+}
+
+/* Build a new FlatView from @old, rendering only @ranges again.  */
+static FlatView *flatview_rerender(FlatView *old, const AddrRange *ranges,
+                                   unsigned nr)
+{
+    FlatView *view = flatview_new(old->root);
+    unsigned i = 0;
+    FlatRange *fr;
+
+    if (old->alias_targets) {
+        GHashTableIter iter;
+        gpointer key;
+
+        g_hash_table_iter_init(&iter, old->alias_targets);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            flatview_add_alias_target(view, key);
+        }
+    }
+
+    /* Keep whatever lies outside of the updated ranges.  */
+    FOR_EACH_FLAT_RANGE(fr, old) {
+        FlatRange tmp = *fr;
+
+        while (int128_nz(tmp.addr.size)) {
+            Int128 end, skip;
+
+            while (i < nr && int128_le(addrrange_end(ranges[i]),
+                                       tmp.addr.start)) {
+                i++;
+            }
+            if (i == nr
+                || int128_ge(ranges[i].start, addrrange_end(tmp.addr))) {
+                flatview_insert(view, view->nr, &tmp);
+                break;
+            }
+            if (int128_lt(tmp.addr.start, ranges[i].start)) {
+                FlatRange head = tmp;
+
+                head.addr.size = int128_sub(ranges[i].start, tmp.addr.start);
+                flatview_insert(view, view->nr, &head);
+            }
+            end = addrrange_end(ranges[i]);
+            if (int128_ge(end, addrrange_end(tmp.addr))) {
+                break;
+            }
+            skip = int128_sub(end, tmp.addr.start);
+            tmp.offset_in_region += int128_get64(skip);
+            tmp.addr = addrrange_make(end, int128_sub(tmp.addr.size, skip));
+        }
+    }
+
+    /* The kept ranges never overlap @ranges, so they obscure nothing.  */
+    for (i = 0; i < nr; i++) {
+        render_memory_region(view, old->root, int128_zero(), ranges[i], false);
+    }
+    flatview_publish(view);
 
     return view;
 }
 
+/* Bring @old up to date with the pending updates, into flat_views.  */
+static void flatview_update(FlatView *old)
+{
+    GArray *ranges = g_array_new(false, false, sizeof(AddrRange));
+
+    if (!flatview_update_ranges(old, ranges)) {
+        generate_memory_topology(old->root);
+    } else if (!ranges->len) {
+        /* Untouched, keep using the same view and dispatch tree.  */
+        flatview_ref(old);
+        g_hash_table_replace(flat_views, old->root, old);
+    } else {
+        flatview_rerender(old, (AddrRange *)ranges->data, ranges->len);
+    }
+    g_array_free(ranges, true);
+}
+
 static void address_space_add_del_ioeventfds(AddressSpace *as,
                                              MemoryRegionIoeventfd *fds_new,
                                              unsigned fds_new_nb,
@@ -1047,24 +1270,33 @@ static void flatviews_init(void)
 
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /* Render unique FVs, starting from the previous ones when possible */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *old;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        old = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        if (old) {
+            flatview_update(old);
+        } else {
+            generate_memory_topology(physmr);
+        }
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
+    flatview_updates_reset();
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1140,6 +1372,7 @@ void memory_region_transaction_commit(void)
     if (!memory_region_transaction_depth) {
         if (memory_region_update_pending) {
             flatviews_reset();
+            iommu_xlat_cache_flush();
 
             MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
@@ -1398,7 +1631,7 @@ static void memory_region_do_set_ram(MemoryRegion *mr)
     if (mr->addr) {
         qemu_ram_free(mr->ram_block);
     }
-    if (int128_eq(mr->size, int128_make64(0))) {
+    if (int128_eq(mr->size, int128_make64(0)) || mr->memdev) {
         return;
     }
     switch (mr->ram) {
@@ -1452,7 +1685,7 @@ static void memory_region_set_ram(Object *obj, Visitor *v, const char *name,
     mr->dirty_log_mask |= tcg_enabled() ? (1 << DIRTY_MEMORY_CODE) : 0;
     /* FIXME: Sanitize error handling */
     /* FIXME: Probably need all that transactions stuff */
-    if (mr->ram == value) {
+    if (mr->ram == value || mr->memdev) {
         return;
     }
 
@@ -1509,6 +1742,78 @@ static void memory_region_set_filename(Object *obj, Visitor *v,
     mr->filename = filename;
 }
 
+static void memory_region_get_memdev(Object *obj, Visitor *v,
+                                     const char *name,
+                                     void *opaque, Error **errp)
+{
+    MemoryRegion *mr = MEMORY_REGION(obj);
+    char *memdev = mr->memdev ? mr->memdev : (char *)"";
+
+    visit_type_str(v, name, &memdev, errp);
+}
+
+/*
+ * Back the region with a memory backend, typically to place it on a host
+ * NUMA node or on huge pages. The region becomes an alias of the backend
+ * and drops any RAM it allocated itself.
+ */
+static void memory_region_set_memdev(Object *obj, Visitor *v,
+                                     const char *name,
+                                     void *opaque, Error **errp)
+{
+    MemoryRegion *mr = MEMORY_REGION(obj);
+    Error *local_err = NULL;
+    HostMemoryBackend *backend;
+    MemoryRegion *seg;
+    char *memdev;
+
+    visit_type_str(v, name, &memdev, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    if (mr->memdev || mr->alias) {
+        error_setg(errp, "Memory region %s is already an alias",
+                   memory_region_name(mr));
+        goto out;
+    }
+    backend = (HostMemoryBackend *)object_resolve_path_type(memdev,
+                                                    TYPE_MEMORY_BACKEND, NULL);
+    if (!backend) {
+        error_setg(errp, "No memory backend '%s'", memdev);
+        goto out;
+    }
+    seg = host_memory_backend_get_memory(backend, errp);
+    if (!seg) {
+        goto out;
+    }
+    if (host_memory_backend_is_mapped(backend)) {
+        error_setg(errp, "Memory backend '%s' is used multiple times",
+                   memdev);
+        goto out;
+    }
+
+    if (mr->ram_block) {
+        qemu_ram_free(mr->ram_block);
+        mr->ram_block = NULL;
+    }
+    mr->ram = 0;
+    mr->terminates = false;
+    object_property_set_link(obj, OBJECT(seg), "alias", &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        goto out;
+    }
+    host_memory_backend_set_mapped(backend, true);
+    vmstate_register_ram_global(seg);
+    mr->memdev = memdev;
+    return;
+
+out:
+    g_free(memdev);
+}
+
 static void memory_region_initfn(Object *obj)
 {
     MemoryRegion *mr = MEMORY_REGION(obj);
@@ -1554,6 +1859,10 @@ static void memory_region_initfn(Object *obj)
                         memory_region_get_filename,
                         memory_region_set_filename,
                         NULL, NULL, &error_abort);
+    object_property_add(OBJECT(mr), "memdev", "string",
+                        memory_region_get_memdev,
+                        memory_region_set_memdev,
+                        NULL, NULL, &error_abort);
     object_property_add_bool(OBJECT(mr), "may-overlap",
                         memory_region_get_may_overlap,
                         NULL, /* memory_region_set_may_overlap */
@@ -1740,11 +2049,11 @@ static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
     }
 }
 
-MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
-                                        hwaddr addr,
-                                        uint64_t *pval,
-                                        unsigned size,
-                                        MemTxAttrs attrs)
+static MemTxResult memory_region_do_dispatch_read(MemoryRegion *mr,
+                                                  hwaddr addr,
+                                                  uint64_t *pval,
+                                                  unsigned size,
+                                                  MemTxAttrs attrs)
 {
     MemTxResult r;
 
@@ -1758,6 +2067,58 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
     return r;
 }
 
+MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
+                                        hwaddr addr,
+                                        uint64_t *pval,
+                                        unsigned size,
+                                        MemTxAttrs attrs)
+{
+    MemTxResult r;
+    int64_t start;
+
+    if (likely(!atomic_read(&mmio_profile_enabled))) {
+        return memory_region_do_dispatch_read(mr, addr, pval, size, attrs);
+    }
+
+    start = get_clock();
+    r = memory_region_do_dispatch_read(mr, addr, pval, size, attrs);
+    mmio_profile_account(mr, false, size, get_clock() - start);
+    return r;
+}
+
+MemTxResult memory_region_dispatch_burst(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         const struct iovec *iov,
+                                         int iovcnt,
+                                         bool is_write,
+                                         MemTxAttrs attrs)
+{
+    MemTxResult r;
+    int64_t start;
+    MemoryBurstTransaction tr = {
+        .iov = iov,
+        .iovcnt = iovcnt,
+        .rw = is_write,
+        .addr = addr,
+        .size = iov_size(iov, iovcnt),
+        .attr = attrs,
+        .opaque = mr->opaque,
+    };
+
+    assert(mr->ops->access_burst);
+    if (mr->flush_coalesced_mmio) {
+        qemu_flush_coalesced_mmio_buffer();
+    }
+    if (likely(!atomic_read(&mmio_profile_enabled))) {
+        return mr->ops->access_burst(&tr);
+    }
+
+    start = get_clock();
+    r = mr->ops->access_burst(&tr);
+    mmio_profile_account(mr, is_write, tr.size, get_clock() - start);
+    return r;
+}
+
 /* Return true if an eventfd was signalled */
 static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
                                                     hwaddr addr,
@@ -1784,11 +2145,11 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
-MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
-                                         hwaddr addr,
-                                         uint64_t data,
-                                         unsigned size,
-                                         MemTxAttrs attrs)
+static MemTxResult memory_region_do_dispatch_write(MemoryRegion *mr,
+                                                   hwaddr addr,
+                                                   uint64_t data,
+                                                   unsigned size,
+                                                   MemTxAttrs attrs)
 {
     if (!memory_region_access_valid(mr, addr, size, true)) {
         unassigned_mem_write(mr, addr, data, size);
@@ -1828,6 +2189,25 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
     }
 }
 
+MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         uint64_t data,
+                                         unsigned size,
+                                         MemTxAttrs attrs)
+{
+    MemTxResult r;
+    int64_t start;
+
+    if (likely(!atomic_read(&mmio_profile_enabled))) {
+        return memory_region_do_dispatch_write(mr, addr, data, size, attrs);
+    }
+
+    start = get_clock();
+    r = memory_region_do_dispatch_write(mr, addr, data, size, attrs);
+    mmio_profile_account(mr, true, size, get_clock() - start);
+    return r;
+}
+
 void memory_region_init_io(MemoryRegion *mr,
                            Object *owner,
                            const MemoryRegionOps *ops,
@@ -1982,6 +2362,24 @@ void memory_region_init_rom_device_nomigrate(MemoryRegion *mr,
     mr->ram_block = qemu_ram_alloc(size, mr, errp);
 }
 
+void memory_region_init_rom_device_ptr(MemoryRegion *mr,
+                                       Object *owner,
+                                       const MemoryRegionOps *ops,
+                                       void *opaque,
+                                       const char *name,
+                                       uint64_t size,
+                                       void *ptr)
+{
+    assert(ops && ptr);
+    memory_region_init(mr, owner, name, size);
+    mr->ops = ops;
+    mr->opaque = opaque;
+    mr->terminates = true;
+    mr->rom_device = true;
+    mr->destructor = memory_region_destructor_ram;
+    mr->ram_block = qemu_ram_alloc_from_ptr(size, ptr, mr, &error_fatal);
+}
+
 void memory_region_init_iommu(void *_iommu_mr,
                               size_t instance_size,
                               const char *mrtypename,
@@ -2004,8 +2402,10 @@ void memory_region_init_iommu(void *_iommu_mr,
 static void memory_region_finalize(Object *obj)
 {
     MemoryRegion *mr = MEMORY_REGION(obj);
+    int i;
 
     assert(!mr->container);
+    mmio_profile_region_finalize(mr);
 
     /* We know the region is not visible in any address space (it
      * does not have a container and cannot be a root either because
@@ -2015,6 +2415,12 @@ static void memory_region_finalize(Object *obj)
      */
     mr->enabled = false;
     memory_region_transaction_begin();
+    /* Updates inside the region went away along with its container.  */
+    for (i = 0; flatview_updates && i < flatview_updates->len; i++) {
+        if (g_array_index(flatview_updates, FlatViewUpdate, i).mr == mr) {
+            g_array_remove_index_fast(flatview_updates, i--);
+        }
+    }
     while (!QTAILQ_EMPTY(&mr->subregions)) {
         MemoryRegion *subregion = QTAILQ_FIRST(&mr->subregions);
         memory_region_del_subregion(mr, subregion);
@@ -2224,6 +2630,7 @@ void memory_region_notify_iommu(IOMMUMemoryRegion *iommu_mr,
 
     assert(memory_region_is_iommu(MEMORY_REGION(iommu_mr)));
 
+    iommu_xlat_cache_flush();
     IOMMU_NOTIFIER_FOREACH(iommu_notifier, iommu_mr) {
         memory_region_notify_one(iommu_notifier, &entry);
     }
@@ -2243,7 +2650,9 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2323,7 +2732,9 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2333,7 +2744,9 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2603,7 +3016,10 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_range(mr, int128_make64(subregion->addr),
+                                   subregion->size);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2641,8 +3057,11 @@ void memory_region_del_subregion(MemoryRegion *mr,
     assert(subregion->container == mr);
     subregion->container = NULL;
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_range(mr, int128_make64(subregion->addr),
+                                   subregion->size);
+    }
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
     memory_region_transaction_commit();
 }
 
@@ -2653,7 +3072,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update(mr);
     memory_region_transaction_commit();
 }
 
@@ -2668,11 +3087,11 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
         return;
     }
     memory_region_transaction_begin();
+    memory_region_update_range(mr, int128_zero(), int128_max(s, mr->size));
     mr->size = s;
     if (mr->ram) {
         memory_region_do_set_ram(mr);
     }
-    memory_region_update_pending = true;
     memory_region_transaction_commit();
 }
 
@@ -2709,7 +3128,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2851,7 +3272,7 @@ void memory_global_dirty_log_start(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_all();
     memory_region_transaction_commit();
 }
 
@@ -2861,7 +3282,7 @@ static void memory_global_dirty_log_do_stop(void)
 
     /* Refresh DIRTY_LOG_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_all();
     memory_region_transaction_commit();
 
     MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
@@ -3130,6 +3551,7 @@ void address_space_destroy(AddressSpace *as)
     as->root = NULL;
     memory_region_transaction_commit();
     QTAILQ_REMOVE(&address_spaces, as, address_spaces_link);
+    iommu_xlat_cache_flush();
 
     /* At this point, as->dispatch and as->current_map are dummy
      * entries that the guest should never use.  Wait for the old
@@ -3440,6 +3862,12 @@ static bool memory_region_parse_reg(FDTGenericMMap *obj,
                    "spport discontiguous or overlapping memory regions");
     }
 
+    if (mr->memdev && total_size > memory_region_size(mr->alias)) {
+        error_setg(errp, "Memory backend '%s' is smaller than region %s",
+                   mr->memdev, memory_region_name(mr));
+        return false;
+    }
+
     /* FIXME: parent should not be optional but we need to implement
      * reg-extended in kernel before we can do things properly
      */
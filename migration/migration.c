@@ -1562,6 +1562,15 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_X_MULTIFD];
 }
 
+bool migrate_load_batch_memory(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_LOAD_BATCH_MEMORY];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -2441,6 +2450,8 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-block", MIGRATION_CAPABILITY_BLOCK),
     DEFINE_PROP_MIG_CAP("x-return-path", MIGRATION_CAPABILITY_RETURN_PATH),
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_X_MULTIFD),
+    DEFINE_PROP_MIG_CAP("x-load-batch-memory",
+                        MIGRATION_CAPABILITY_X_LOAD_BATCH_MEMORY),
 
     DEFINE_PROP_END_OF_LIST(),
 };
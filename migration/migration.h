@@ -185,6 +185,7 @@ bool migrate_zero_blocks(void);
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
 bool migrate_pause_before_switchover(void);
+bool migrate_load_batch_memory(void);
 int migrate_multifd_channels(void);
 int migrate_multifd_page_count(void);
 
@@ -49,6 +49,7 @@
 #include "qemu/rcu_queue.h"
 #include "migration/colo.h"
 #include "migration/block.h"
+#include "exec/exec-all.h"
 
 /***********************************************************/
 /* ram save/restore */
@@ -2992,6 +2993,605 @@ static SaveVMHandlers savevm_ram_handlers = {
     .load_cleanup = ram_load_cleanup,
 };
 
+/*
+ * Mapped RAM snapshots
+ *
+ * The RAM blocks are stored one after the other in a plain file, each
+ * aligned to RAM_MAPPED_ALIGN and at the same offsets as in the block, so
+ * that restoring is just mapping the file MAP_PRIVATE over the blocks.
+ * Pages then fault in on first access and are copied on write, the file
+ * is never modified.  Zero pages are left as holes.
+ *
+ * The file starts with a RAMMappedHeader followed by nb_blocks
+ * RAMMappedBlock entries, all big endian.
+ *
+ * Incremental snapshots only store the host pages written since their
+ * parent was saved or loaded, the rest reads through to the parent like
+ * qcow2 backing files.  The table is followed by the path of the parent
+ * (a big endian 32-bit length then the bytes) and a bitmap of the pages
+ * present for each block, bit n of byte n/8 for page n.
+ *
+ * The blocks are cut in RAM_MAPPED_ALIGN chunks that are independent
+ * of each other, with x-multifd they are scanned for zero pages and
+ * written, or read back, by multifd-channels threads in parallel.
+ */
+#define RAM_MAPPED_MAGIC    0x51454d5552414d31ULL /* "QEMURAM1" */
+#define RAM_MAPPED_ALIGN    (2 * 1024 * 1024)
+
+typedef struct QEMU_PACKED RAMMappedHeader {
+    uint64_t magic;
+    uint32_t nb_blocks;
+    uint32_t flags;
+} RAMMappedHeader;
+
+/* Only the pages written since the parent snapshot are present.  */
+#define RAM_MAPPED_INCREMENTAL  1
+
+typedef struct QEMU_PACKED RAMMappedBlock {
+    char idstr[256];
+    uint64_t length;
+    uint64_t offset;
+} RAMMappedBlock;
+
+#ifndef _WIN32
+static int ram_mapped_pwrite(int fd, const uint8_t *buf, size_t len,
+                             off_t offset)
+{
+    while (len) {
+        ssize_t r = pwrite(fd, buf, len, offset);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return r < 0 ? -errno : -EIO;
+        }
+        buf += r;
+        len -= r;
+        offset += r;
+    }
+    return 0;
+}
+
+static int ram_mapped_pread(int fd, uint8_t *buf, size_t len, off_t offset)
+{
+    while (len) {
+        ssize_t r = pread(fd, buf, len, offset);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r < 0) {
+            return -errno;
+        }
+        if (r == 0) {
+            /* The tail of the file is a hole.  */
+            memset(buf, 0, len);
+            return 0;
+        }
+        buf += r;
+        len -= r;
+        offset += r;
+    }
+    return 0;
+}
+
+/* Write the non-zero runs of pages of @host at @offset.  */
+static int ram_mapped_save_range(int fd, uint8_t *host, size_t size,
+                                 off_t offset)
+{
+    size_t psize = qemu_real_host_page_size;
+    size_t start = 0, pos;
+    int ret;
+
+    for (pos = 0; pos < size; pos += psize) {
+        size_t len = MIN(psize, size - pos);
+
+        if (!buffer_is_zero(host + pos, len)) {
+            continue;
+        }
+        if (pos > start) {
+            ret = ram_mapped_pwrite(fd, host + start, pos - start,
+                                    offset + start);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        start = pos + len;
+    }
+    if (size > start) {
+        return ram_mapped_pwrite(fd, host + start, size - start,
+                                 offset + start);
+    }
+    return 0;
+}
+
+typedef struct RAMMappedChunk {
+    uint8_t *host;
+    size_t len;
+    off_t offset;
+} RAMMappedChunk;
+
+typedef struct RAMMappedJob {
+    int fd;
+    bool save;
+    GArray *chunks;
+    /* Next chunk to take, and the first error.  */
+    unsigned int next;
+    int ret;
+} RAMMappedJob;
+
+static void ram_mapped_add_chunks(GArray *chunks, uint8_t *host,
+                                  size_t size, off_t offset)
+{
+    size_t pos;
+
+    for (pos = 0; pos < size; pos += RAM_MAPPED_ALIGN) {
+        RAMMappedChunk c = {
+            .host = host + pos,
+            .len = MIN(RAM_MAPPED_ALIGN, size - pos),
+            .offset = offset + pos,
+        };
+
+        g_array_append_val(chunks, c);
+    }
+}
+
+static void *ram_mapped_thread(void *opaque)
+{
+    RAMMappedJob *job = opaque;
+    unsigned int i;
+    int ret;
+
+    while (!atomic_read(&job->ret) &&
+           (i = atomic_fetch_inc(&job->next)) < job->chunks->len) {
+        RAMMappedChunk *c = &g_array_index(job->chunks, RAMMappedChunk, i);
+
+        if (job->save) {
+            ret = ram_mapped_save_range(job->fd, c->host, c->len, c->offset);
+        } else {
+            ret = ram_mapped_pread(job->fd, c->host, c->len, c->offset);
+        }
+        if (ret < 0) {
+            atomic_cmpxchg(&job->ret, 0, ret);
+        }
+    }
+    return NULL;
+}
+
+/* Run @job on the multifd channel count of threads, if enabled.  */
+static int ram_mapped_run(RAMMappedJob *job)
+{
+    int nb_threads = migrate_use_multifd() ? migrate_multifd_channels() : 1;
+    QemuThread *threads;
+    int i;
+
+    nb_threads = MIN(nb_threads, job->chunks->len);
+    if (nb_threads <= 1) {
+        ram_mapped_thread(job);
+        return job->ret;
+    }
+
+    threads = g_new(QemuThread, nb_threads);
+    for (i = 0; i < nb_threads; i++) {
+        qemu_thread_create(threads + i, "mapped-ram", ram_mapped_thread,
+                           job, QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < nb_threads; i++) {
+        qemu_thread_join(threads + i);
+    }
+    g_free(threads);
+    return job->ret;
+}
+
+/* The snapshot the dirty log is relative to, see ram_mapped_track().  */
+static char *ram_mapped_base;
+static uint64_t ram_mapped_sync_count;
+
+/*
+ * Make @path the parent of the next incremental snapshot: start logging
+ * the writes to RAM and forget those done so far.
+ */
+static void ram_mapped_track(const char *path)
+{
+    RAMBlock *block;
+
+    memory_global_dirty_log_start();
+    memory_global_dirty_log_sync();
+    rcu_read_lock();
+    RAMBLOCK_FOREACH(block) {
+        g_free(cpu_physical_memory_snapshot_and_clear_dirty(
+                   block->offset, block->used_length,
+                   DIRTY_MEMORY_MIGRATION));
+    }
+    rcu_read_unlock();
+
+    g_free(ram_mapped_base);
+    ram_mapped_base = g_strdup(path);
+    ram_mapped_sync_count = ram_counters.dirty_sync_count;
+}
+
+static size_t ram_mapped_bitmap_size(uint64_t length)
+{
+    return DIV_ROUND_UP(DIV_ROUND_UP(length, qemu_real_host_page_size),
+                        BITS_PER_BYTE);
+}
+
+static bool ram_mapped_bitmap_test(const uint8_t *bitmap, uint64_t page)
+{
+    return bitmap[page / BITS_PER_BYTE] & (1 << (page % BITS_PER_BYTE));
+}
+
+/*
+ * Fetch the host pages of @block written since ram_mapped_track() into
+ * @bitmap and queue them up in @chunks.
+ */
+static void ram_mapped_add_dirty(GArray *chunks, RAMBlock *block,
+                                 off_t offset, uint8_t *bitmap)
+{
+    size_t psize = qemu_real_host_page_size;
+    DirtyBitmapSnapshot *snap;
+    ram_addr_t start = 0, pos;
+    uint64_t page;
+
+    snap = cpu_physical_memory_snapshot_and_clear_dirty(block->offset,
+                                                        block->used_length,
+                                                        DIRTY_MEMORY_MIGRATION);
+    for (pos = 0, page = 0; pos < block->used_length; pos += psize, page++) {
+        size_t len = MIN(psize, block->used_length - pos);
+
+        if (cpu_physical_memory_snapshot_get_dirty(snap, block->offset + pos,
+                                                   len)) {
+            bitmap[page / BITS_PER_BYTE] |= 1 << (page % BITS_PER_BYTE);
+            continue;
+        }
+        if (pos > start) {
+            ram_mapped_add_chunks(chunks, block->host + start, pos - start,
+                                  offset + start);
+        }
+        start = pos + len;
+    }
+    if (block->used_length > start) {
+        ram_mapped_add_chunks(chunks, block->host + start,
+                              block->used_length - start, offset + start);
+    }
+    g_free(snap);
+}
+
+int ram_save_mapped(const char *path, const char *parent, Error **errp)
+{
+    RAMMappedHeader hdr = { .magic = cpu_to_be64(RAM_MAPPED_MAGIC) };
+    RAMMappedJob job = { .save = true };
+    RAMMappedBlock *table;
+    RAMBlock *block;
+    uint32_t nb_blocks = 0, i = 0;
+    uint8_t *meta, *bitmap;
+    size_t meta_size, parent_len = 0;
+    off_t offset;
+    int fd, ret;
+
+    if (parent) {
+        if (g_strcmp0(parent, ram_mapped_base)) {
+            error_setg(errp, "'%s' is not the last mapped RAM snapshot saved "
+                       "or loaded", parent);
+            return -EINVAL;
+        }
+        if (ram_counters.dirty_sync_count != ram_mapped_sync_count) {
+            error_setg(errp, "A migration ran since '%s' was saved, "
+                       "the RAM written since then is unknown", parent);
+            return -EINVAL;
+        }
+        parent_len = strlen(parent);
+    }
+
+    fd = qemu_open(path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0660);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "Cannot create %s", path);
+        return -errno;
+    }
+
+    memory_global_dirty_log_sync();
+    rcu_read_lock();
+    meta_size = sizeof(hdr);
+    RAMBLOCK_FOREACH(block) {
+        nb_blocks++;
+        meta_size += sizeof(*table);
+        if (parent) {
+            meta_size += ram_mapped_bitmap_size(block->used_length);
+        }
+    }
+    if (parent) {
+        meta_size += sizeof(uint32_t) + parent_len;
+    }
+    meta = g_malloc0(meta_size);
+    table = (RAMMappedBlock *)(meta + sizeof(hdr));
+    bitmap = (uint8_t *)(table + nb_blocks);
+    if (parent) {
+        stl_be_p(bitmap, parent_len);
+        memcpy(bitmap + sizeof(uint32_t), parent, parent_len);
+        bitmap += sizeof(uint32_t) + parent_len;
+    }
+    offset = ROUND_UP(meta_size, RAM_MAPPED_ALIGN);
+
+    job.fd = fd;
+    job.chunks = g_array_new(false, false, sizeof(RAMMappedChunk));
+    RAMBLOCK_FOREACH(block) {
+        pstrcpy(table[i].idstr, sizeof(table[i].idstr), block->idstr);
+        table[i].length = cpu_to_be64(block->used_length);
+        table[i].offset = cpu_to_be64(offset);
+        if (parent) {
+            ram_mapped_add_dirty(job.chunks, block, offset, bitmap);
+            bitmap += ram_mapped_bitmap_size(block->used_length);
+        } else {
+            ram_mapped_add_chunks(job.chunks, block->host,
+                                  block->used_length, offset);
+        }
+        offset += ROUND_UP(block->used_length, RAM_MAPPED_ALIGN);
+        i++;
+    }
+    ret = ram_mapped_run(&job);
+    rcu_read_unlock();
+    g_array_free(job.chunks, true);
+
+    hdr.nb_blocks = cpu_to_be32(nb_blocks);
+    hdr.flags = cpu_to_be32(parent ? RAM_MAPPED_INCREMENTAL : 0);
+    memcpy(meta, &hdr, sizeof(hdr));
+    if (!ret && ftruncate(fd, offset) < 0) {
+        ret = -errno;
+    }
+    if (!ret) {
+        ret = ram_mapped_pwrite(fd, meta, meta_size, 0);
+    }
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot write %s", path);
+    } else {
+        ram_mapped_track(path);
+    }
+
+    g_free(meta);
+    qemu_close(fd);
+    return ret;
+}
+
+/*
+ * Map @len bytes of @fd at @offset over @host, or queue them up to be
+ * read in @chunks if they cannot be mapped.
+ */
+static int ram_mapped_load_range(int fd, RAMBlock *block, uint8_t *host,
+                                 size_t len, off_t offset, GArray *chunks)
+{
+    void *p;
+
+    /* File backed blocks are shared with someone else, or may be
+     * hugetlbfs, and need their contents in place.
+     */
+    if (block->fd < 0 && !(block->used_length &
+                           (qemu_real_host_page_size - 1))) {
+        p = mmap(host, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_FIXED, fd, offset);
+        if (p == MAP_FAILED) {
+            return -errno;
+        }
+        return 0;
+    }
+    ram_mapped_add_chunks(chunks, host, len, offset);
+    return 0;
+}
+
+/*
+ * Restore the pages of @block present in an incremental snapshot.  Runs
+ * shorter than RAM_MAPPED_ALIGN are read rather than mapped, so that
+ * scattered writes do not cost a mapping each.
+ */
+static int ram_mapped_load_dirty(int fd, RAMBlock *block, off_t offset,
+                                 const uint8_t *bitmap, GArray *chunks,
+                                 GArray *reads)
+{
+    size_t psize = qemu_real_host_page_size;
+    uint64_t npages = DIV_ROUND_UP(block->used_length, psize);
+    uint64_t page = 0, first;
+    int ret;
+
+    while (page < npages) {
+        size_t start, len;
+
+        if (!ram_mapped_bitmap_test(bitmap, page)) {
+            page++;
+            continue;
+        }
+        for (first = page; page < npages &&
+                           ram_mapped_bitmap_test(bitmap, page); page++) {
+            /* nothing */
+        }
+        start = first * psize;
+        len = MIN(page * psize, block->used_length) - start;
+        if (len < RAM_MAPPED_ALIGN) {
+            ram_mapped_add_chunks(reads, block->host + start, len,
+                                  offset + start);
+            continue;
+        }
+        ret = ram_mapped_load_range(fd, block, block->host + start, len,
+                                    offset + start, chunks);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+#define RAM_MAPPED_MAX_DEPTH    64
+
+static int ram_mapped_load_file(const char *path, unsigned int depth,
+                                Error **errp)
+{
+    RAMMappedJob job = { .save = false };
+    RAMMappedHeader hdr;
+    RAMMappedBlock *table = NULL;
+    uint8_t *bitmaps = NULL, *bitmap;
+    char *parent = NULL;
+    size_t bitmaps_size = 0;
+    uint32_t nb_blocks, i, parent_len;
+    off_t pos;
+    GArray *reads = NULL;
+    int fd, ret;
+
+    if (depth > RAM_MAPPED_MAX_DEPTH) {
+        error_setg(errp, "Mapped RAM snapshot chain too deep at %s", path);
+        return -ELOOP;
+    }
+
+    fd = qemu_open(path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "Cannot open %s", path);
+        return -errno;
+    }
+
+    ret = ram_mapped_pread(fd, (uint8_t *)&hdr, sizeof(hdr), 0);
+    if (ret < 0 || be64_to_cpu(hdr.magic) != RAM_MAPPED_MAGIC) {
+        error_setg(errp, "%s is not a mapped RAM snapshot", path);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    nb_blocks = be32_to_cpu(hdr.nb_blocks);
+    table = g_new(RAMMappedBlock, nb_blocks);
+    pos = sizeof(hdr);
+    ret = ram_mapped_pread(fd, (uint8_t *)table, nb_blocks * sizeof(*table),
+                           pos);
+    pos += nb_blocks * sizeof(*table);
+
+    if (!ret && be32_to_cpu(hdr.flags) & RAM_MAPPED_INCREMENTAL) {
+        ret = ram_mapped_pread(fd, (uint8_t *)&parent_len,
+                               sizeof(parent_len), pos);
+        parent_len = be32_to_cpu(parent_len);
+        pos += sizeof(parent_len);
+        if (!ret && (!parent_len || parent_len > PATH_MAX)) {
+            ret = -EINVAL;
+        }
+        if (!ret) {
+            parent = g_malloc0(parent_len + 1);
+            ret = ram_mapped_pread(fd, (uint8_t *)parent, parent_len, pos);
+            pos += parent_len;
+        }
+        for (i = 0; i < nb_blocks; i++) {
+            bitmaps_size += ram_mapped_bitmap_size(
+                be64_to_cpu(table[i].length));
+        }
+        if (!ret) {
+            bitmaps = g_malloc(bitmaps_size);
+            ret = ram_mapped_pread(fd, bitmaps, bitmaps_size, pos);
+        }
+    }
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot read %s", path);
+        goto out;
+    }
+
+    /* Check everything before touching the first block.  */
+    for (i = 0; i < nb_blocks; i++) {
+        RAMBlock *block;
+
+        table[i].idstr[sizeof(table[i].idstr) - 1] = 0;
+        block = qemu_ram_block_by_name(table[i].idstr);
+        if (!block) {
+            error_setg(errp, "Unknown RAM block '%s'", table[i].idstr);
+            ret = -EINVAL;
+            goto out;
+        }
+        if (block->used_length != be64_to_cpu(table[i].length)) {
+            error_setg(errp, "Length mismatch for RAM block '%s': 0x"
+                       RAM_ADDR_FMT " in use, 0x%" PRIx64 " in the "
+                       "snapshot", table[i].idstr, block->used_length,
+                       be64_to_cpu(table[i].length));
+            ret = -EINVAL;
+            goto out;
+        }
+    }
+
+    /* Lay the parents down first, then what changed on top.  */
+    if (parent) {
+        ret = ram_mapped_load_file(parent, depth + 1, errp);
+        if (ret < 0) {
+            error_prepend(errp, "%s: ", path);
+            goto out;
+        }
+    }
+
+    job.fd = fd;
+    job.chunks = g_array_new(false, false, sizeof(RAMMappedChunk));
+    reads = g_array_new(false, false, sizeof(RAMMappedChunk));
+    bitmap = bitmaps;
+    for (i = 0; i < nb_blocks; i++) {
+        RAMBlock *block = qemu_ram_block_by_name(table[i].idstr);
+        off_t offset = be64_to_cpu(table[i].offset);
+
+        if (bitmap) {
+            ret = ram_mapped_load_dirty(fd, block, offset, bitmap,
+                                        job.chunks, reads);
+            bitmap += ram_mapped_bitmap_size(block->used_length);
+        } else {
+            ret = ram_mapped_load_range(fd, block, block->host,
+                                        block->used_length, offset,
+                                        job.chunks);
+        }
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Cannot restore RAM block '%s'",
+                             block->idstr);
+            goto out;
+        }
+    }
+    g_array_append_vals(job.chunks, reads->data, reads->len);
+    ret = ram_mapped_run(&job);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot read %s", path);
+        goto out;
+    }
+
+out:
+    if (job.chunks) {
+        g_array_free(job.chunks, true);
+    }
+    if (reads) {
+        g_array_free(reads, true);
+    }
+    g_free(bitmaps);
+    g_free(parent);
+    g_free(table);
+    /* The mappings hold their own reference to the file.  */
+    qemu_close(fd);
+    return ret;
+}
+
+int ram_load_mapped(const char *path, Error **errp)
+{
+    int ret;
+
+    ret = ram_mapped_load_file(path, 0, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* The guest code changed under the translated blocks.  */
+    if (tcg_enabled()) {
+        tb_flush(first_cpu);
+    }
+    ram_mapped_track(path);
+    return 0;
+}
+#else
+int ram_save_mapped(const char *path, const char *parent, Error **errp)
+{
+    error_setg(errp, "Mapped RAM snapshots are not supported on this host");
+    return -ENOTSUP;
+}
+
+int ram_load_mapped(const char *path, Error **errp)
+{
+    error_setg(errp, "Mapped RAM snapshots are not supported on this host");
+    return -ENOTSUP;
+}
+#endif
+
 void ram_mig_init(void)
 {
     qemu_mutex_init(&XBZRLE.lock);
@@ -58,6 +58,10 @@ int ram_postcopy_incoming_init(MigrationIncomingState *mis);
 
 void ram_handle_compressed(void *host, uint8_t ch, uint64_t size);
 
+/* Save all RAM blocks to @path / map them back from it, see ram.c.  */
+int ram_save_mapped(const char *path, const char *parent, Error **errp);
+int ram_load_mapped(const char *path, Error **errp);
+
 int ramblock_recv_bitmap_test(RAMBlock *rb, void *host_addr);
 void ramblock_recv_bitmap_set(RAMBlock *rb, void *host_addr);
 void ramblock_recv_bitmap_set_range(RAMBlock *rb, void *host_addr, size_t nr);
@@ -2047,6 +2047,7 @@ int qemu_loadvm_state(QEMUFile *f)
 {
     MigrationIncomingState *mis = migration_incoming_get_current();
     Error *local_err = NULL;
+    bool batch_memory;
     unsigned int v;
     int ret;
 
@@ -2089,7 +2090,17 @@ int qemu_loadvm_state(QEMUFile *f)
 
     cpu_synchronize_all_pre_loadvm();
 
+    /* Postcopy runs the guest, and loads from the listen thread, before
+     * this returns.
+     */
+    batch_memory = migrate_load_batch_memory() && !migrate_postcopy_ram();
+    if (batch_memory) {
+        memory_region_transaction_begin();
+    }
     ret = qemu_loadvm_state_main(f, mis);
+    if (batch_memory) {
+        memory_region_transaction_commit();
+    }
     qemu_event_set(&mis->main_thread_load_event);
 
     trace_qemu_loadvm_state_post_main(ret);
@@ -2339,6 +2350,162 @@ void qmp_xen_load_devices_state(const char *filename, Error **errp)
     migration_incoming_state_destroy();
 }
 
+void qmp_snapshot_save_mapped(const char *state, const char *ram,
+                              bool has_parent, const char *parent,
+                              Error **errp)
+{
+    QEMUFile *f;
+    QIOChannelFile *ioc;
+    int saved_vm_running;
+    int ret;
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_SAVE_VM);
+    global_state_store();
+
+    if (ram_save_mapped(ram, has_parent ? parent : NULL, errp) < 0) {
+        goto the_end;
+    }
+
+    ioc = qio_channel_file_new_path(state, O_WRONLY | O_CREAT | O_TRUNC,
+                                    0660, errp);
+    if (!ioc) {
+        goto the_end;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-mapped-save-state");
+    f = qemu_fopen_channel_output(QIO_CHANNEL(ioc));
+    object_unref(OBJECT(ioc));
+    ret = qemu_save_device_state(f);
+    qemu_fclose(f);
+    if (ret < 0) {
+        error_setg(errp, QERR_IO_ERROR);
+    }
+
+ the_end:
+    if (saved_vm_running) {
+        vm_start();
+    }
+}
+
+void qmp_snapshot_load_mapped(const char *state, const char *ram,
+                              Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    QEMUFile *f;
+    QIOChannelFile *ioc;
+    int saved_vm_running;
+    int ret;
+
+    ioc = qio_channel_file_new_path(state, O_RDONLY | O_BINARY, 0, errp);
+    if (!ioc) {
+        return;
+    }
+    qio_channel_set_name(QIO_CHANNEL(ioc), "migration-mapped-load-state");
+    f = qemu_fopen_channel_input(QIO_CHANNEL(ioc));
+    object_unref(OBJECT(ioc));
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_RESTORE_VM);
+
+    /* Reset first, it may load ROM images into RAM.  */
+    qemu_system_reset(SHUTDOWN_CAUSE_NONE);
+    if (ram_load_mapped(ram, errp) < 0) {
+        qemu_fclose(f);
+        return;
+    }
+
+    mis->from_src_file = f;
+    ret = qemu_loadvm_state(f);
+    migration_incoming_state_destroy();
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading VM state", ret);
+        return;
+    }
+
+    if (saved_vm_running) {
+        vm_start();
+    }
+}
+
+/* @argv with every "%d" replaced by @index.  */
+static char **snapshot_fanout_argv(strList *argv, int64_t index)
+{
+    char *idx = g_strdup_printf("%" PRId64, index);
+    GPtrArray *args = g_ptr_array_new();
+    strList *l;
+
+    for (l = argv; l; l = l->next) {
+        char **parts = g_strsplit(l->value, "%d", -1);
+
+        g_ptr_array_add(args, g_strjoinv(idx, parts));
+        g_strfreev(parts);
+    }
+    g_ptr_array_add(args, NULL);
+    g_free(idx);
+    return (char **)g_ptr_array_free(args, false);
+}
+
+SnapshotFanoutChildList *qmp_snapshot_fanout(const char *state,
+                                             const char *ram, int64_t count,
+                                             strList *argv, Error **errp)
+{
+    SnapshotFanoutChildList *head = NULL, **tail = &head;
+    Error *local_err = NULL;
+    int64_t i;
+
+    if (count <= 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "count",
+                   "a positive number");
+        return NULL;
+    }
+    if (!argv) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "argv",
+                   "a command line");
+        return NULL;
+    }
+
+    qmp_snapshot_save_mapped(state, ram, false, NULL, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++) {
+        char **args = snapshot_fanout_argv(argv, i);
+        SnapshotFanoutChildList *e;
+        GError *gerr = NULL;
+        GPid pid;
+        bool ok;
+
+        /* Without G_SPAWN_DO_NOT_REAP_CHILD the children are not ours to
+         * wait for.
+         */
+        ok = g_spawn_async(NULL, args, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL,
+                           &pid, &gerr);
+        g_strfreev(args);
+        if (!ok) {
+            error_setg(errp, "Cannot start child %" PRId64 ": %s", i,
+                       gerr->message);
+            g_error_free(gerr);
+            break;
+        }
+
+        e = g_new0(SnapshotFanoutChildList, 1);
+        e->value = g_new0(SnapshotFanoutChild, 1);
+        e->value->index = i;
+        e->value->pid = (intptr_t)pid;
+        *tail = e;
+        tail = &e->next;
+    }
+
+    if (i < count) {
+        /* The children that did start are on their own.  */
+        qapi_free_SnapshotFanoutChildList(head);
+        return NULL;
+    }
+    return head;
+}
+
 int load_snapshot(const char *name, Error **errp)
 {
     BlockDriverState *bs, *bs_vm_state;
@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,8 +25,8 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -126,6 +127,208 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX2_OPT) || defined(__aarch64__)
+typedef int XbzrleRunEnd(uint8_t *old_buf, uint8_t *new_buf, int i,
+                         int slen, bool same);
+
+/*
+ * The encoder of the vector versions, which only differ in how they find
+ * where a run stops: @run_end returns the first index from @i where the
+ * bytes stop being @same.  Produces the same output as
+ * xbzrle_encode_buffer_int().
+ */
+static inline int xbzrle_encode_runs(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen,
+                                     XbzrleRunEnd *run_end)
+{
+    int d = 0, i = 0, end;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        end = run_end(old_buf, new_buf, i, slen, true);
+        /* buffer unchanged */
+        if (!i && end == slen) {
+            return 0;
+        }
+        /* skip last zero run */
+        if (end == slen) {
+            return d;
+        }
+        d += uleb128_encode_small(dst + d, end - i);
+        i = end;
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+        end = run_end(old_buf, new_buf, i, slen, false);
+        d += uleb128_encode_small(dst + d, end - i);
+        /* overflow */
+        if (d + end - i > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, end - i);
+        d += end - i;
+        i = end;
+    }
+
+    return d;
+}
+
+static inline int xbzrle_run_end_tail(uint8_t *old_buf, uint8_t *new_buf,
+                                      int i, int slen, bool same)
+{
+    while (i < slen && (old_buf[i] == new_buf[i]) == same) {
+        i++;
+    }
+    return i;
+}
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static inline int xbzrle_run_end_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                      int i, int slen, bool same)
+{
+    for (; i + 32 <= slen; i += 32) {
+        __m256i a = _mm256_loadu_si256((__m256i *)(old_buf + i));
+        __m256i b = _mm256_loadu_si256((__m256i *)(new_buf + i));
+        /* One bit per byte, set where they are equal.  */
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+        uint32_t stop = same ? ~eq : eq;
+
+        if (stop) {
+            return i + ctz32(stop);
+        }
+    }
+    return xbzrle_run_end_tail(old_buf, new_buf, i, slen, same);
+}
+
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_run_end_avx2);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef __aarch64__
+#include <arm_neon.h>
+
+static inline int xbzrle_run_end_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                      int i, int slen, bool same)
+{
+    for (; i + 16 <= slen; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(old_buf + i), vld1q_u8(new_buf + i));
+        /* There is no movemask, narrow to one nibble per byte instead.  */
+        uint64_t nibbles = vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        uint64_t stop = same ? ~nibbles : nibbles;
+
+        if (stop) {
+            return i + ctz64(stop) / 4;
+        }
+    }
+    return xbzrle_run_end_tail(old_buf, new_buf, i, slen, same);
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_run_end_neon);
+}
+#endif /* __aarch64__ */
+
+/* As in util/bufferiszero.c, the most preferred ISA must have the least
+ * significant bit for test_xbzrle_encode_next_accel.
+ */
+#define CACHE_AVX2    1
+#define CACHE_NEON    2
+
+static unsigned xbzrle_cache;
+static int (*xbzrle_encode_accel)(uint8_t *, uint8_t *, int, uint8_t *,
+                                  int) = xbzrle_encode_buffer_int;
+
+static void xbzrle_init_accel(unsigned cache)
+{
+    int (*fn)(uint8_t *, uint8_t *, int, uint8_t *, int);
+
+    fn = xbzrle_encode_buffer_int;
+#ifdef __aarch64__
+    if (cache & CACHE_NEON) {
+        fn = xbzrle_encode_buffer_neon;
+    }
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = xbzrle_encode_buffer_avx2;
+    }
+#endif
+    xbzrle_encode_accel = fn;
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+#endif
+
+static void __attribute__((constructor)) xbzrle_init_cpuid_cache(void)
+{
+    unsigned cache = 0;
+
+#ifdef CONFIG_AVX2_OPT
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+
+    if (max >= 7) {
+        __cpuid(1, a, b, c, d);
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX)) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 6) == 6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+#endif
+#ifdef __aarch64__
+    /* Always there on AArch64.  */
+    cache |= CACHE_NEON;
+#endif
+    xbzrle_cache = cache;
+    xbzrle_init_accel(cache);
+}
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    /* If no bits set, we just tested xbzrle_encode_buffer_int, and there
+     * are no more acceleration options to test.
+     */
+    if (!xbzrle_cache) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    xbzrle_cache &= xbzrle_cache - 1;
+    xbzrle_init_accel(xbzrle_cache);
+    return true;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
@@ -0,0 +1,259 @@
+/*
+ * MMIO access profiling
+ *
+ * Counts the accesses dispatched to each MemoryRegion, split by caller,
+ * along with the host time spent in the device callbacks.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qmp-commands.h"
+#include "qemu/thread.h"
+#include "qemu/host-utils.h"
+#include "exec/mmio-profile.h"
+
+/* Bucket N counts accesses of [2^N, 2^(N+1)) bytes.  */
+#define MMIO_PROFILE_SIZES 16
+
+typedef struct MmioProfileCounters {
+    MemoryRegion *mr;
+    char *caller;
+    /* Set when mr goes away, mr is NULL from then on.  */
+    char *name;
+    /* QOM path of the owner, looked up when first reported.  */
+    char *owner;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t sizes[MMIO_PROFILE_SIZES];
+    uint64_t host_ns;
+    uint64_t max_host_ns;
+} MmioProfileCounters;
+
+bool mmio_profile_enabled;
+__thread const char *mmio_profile_caller;
+
+/* Accesses may come from any thread.  Protects the table and counters.  */
+static QemuSpin mmio_profile_lock;
+/* Counters of live regions, keyed by region and caller.  */
+static GHashTable *mmio_profile;
+/* Counters of regions that went away.  */
+static GSList *mmio_profile_dead;
+
+static guint mmio_profile_hash(gconstpointer key)
+{
+    const MmioProfileCounters *c = key;
+
+    return g_direct_hash(c->mr) ^ g_str_hash(c->caller);
+}
+
+static gboolean mmio_profile_equal(gconstpointer a, gconstpointer b)
+{
+    const MmioProfileCounters *ca = a, *cb = b;
+
+    return ca->mr == cb->mr && !strcmp(ca->caller, cb->caller);
+}
+
+static void mmio_profile_counters_free(gpointer data)
+{
+    MmioProfileCounters *c = data;
+
+    g_free(c->caller);
+    g_free(c->name);
+    g_free(c->owner);
+    g_free(c);
+}
+
+void mmio_profile_account(MemoryRegion *mr, bool is_write, uint64_t size,
+                          int64_t ns)
+{
+    MmioProfileCounters key = {
+        .mr = mr,
+        .caller = (char *)(mmio_profile_caller ? : "other"),
+    };
+    MmioProfileCounters *c;
+
+    qemu_spin_lock(&mmio_profile_lock);
+    if (!mmio_profile) {
+        /* Stopped meanwhile.  */
+        goto out;
+    }
+
+    c = g_hash_table_lookup(mmio_profile, &key);
+    if (!c) {
+        c = g_new0(MmioProfileCounters, 1);
+        c->mr = mr;
+        c->caller = g_strdup(key.caller);
+        g_hash_table_add(mmio_profile, c);
+    }
+
+    if (is_write) {
+        c->writes++;
+        c->write_bytes += size;
+    } else {
+        c->reads++;
+        c->read_bytes += size;
+    }
+    c->sizes[MIN(size ? 63 - clz64(size) : 0, MMIO_PROFILE_SIZES - 1)]++;
+    c->host_ns += ns;
+    c->max_host_ns = MAX(c->max_host_ns, ns);
+out:
+    qemu_spin_unlock(&mmio_profile_lock);
+}
+
+static const char *mmio_profile_region_name(MemoryRegion *mr)
+{
+    return memory_region_name(mr) ? : "(anonymous)";
+}
+
+static gboolean mmio_profile_region_gone(gpointer key, gpointer value,
+                                         gpointer opaque)
+{
+    MmioProfileCounters *c = key;
+
+    if (c->mr != opaque) {
+        return false;
+    }
+    /* The owner is usually unparented by now, keep whatever path we had.  */
+    c->name = g_strdup(mmio_profile_region_name(c->mr));
+    c->mr = NULL;
+    mmio_profile_dead = g_slist_prepend(mmio_profile_dead, c);
+    return true;
+}
+
+void mmio_profile_region_finalize(MemoryRegion *mr)
+{
+    qemu_spin_lock(&mmio_profile_lock);
+    if (mmio_profile) {
+        g_hash_table_foreach_steal(mmio_profile, mmio_profile_region_gone,
+                                   mr);
+    }
+    qemu_spin_unlock(&mmio_profile_lock);
+}
+
+static void mmio_profile_clear(void)
+{
+    g_slist_free_full(mmio_profile_dead, mmio_profile_counters_free);
+    mmio_profile_dead = NULL;
+    if (mmio_profile) {
+        g_hash_table_destroy(mmio_profile);
+        mmio_profile = NULL;
+    }
+}
+
+void qmp_mmio_profile_start(Error **errp)
+{
+    qemu_spin_lock(&mmio_profile_lock);
+    mmio_profile_clear();
+    mmio_profile = g_hash_table_new_full(mmio_profile_hash,
+                                         mmio_profile_equal,
+                                         mmio_profile_counters_free, NULL);
+    atomic_set(&mmio_profile_enabled, true);
+    qemu_spin_unlock(&mmio_profile_lock);
+}
+
+void qmp_mmio_profile_stop(Error **errp)
+{
+    atomic_set(&mmio_profile_enabled, false);
+}
+
+static MmioProfileEntry *mmio_profile_entry(MmioProfileCounters *c)
+{
+    MmioProfileEntry *e = g_new0(MmioProfileEntry, 1);
+    MmioProfileSizeList **tail = &e->sizes;
+    int i;
+
+    e->region = g_strdup(c->mr ? mmio_profile_region_name(c->mr) : c->name);
+    e->has_owner = c->owner != NULL;
+    e->owner = g_strdup(c->owner);
+    e->caller = g_strdup(c->caller);
+    e->reads = c->reads;
+    e->writes = c->writes;
+    e->read_bytes = c->read_bytes;
+    e->write_bytes = c->write_bytes;
+    e->host_ns = c->host_ns;
+    e->max_host_ns = c->max_host_ns;
+
+    for (i = 0; i < MMIO_PROFILE_SIZES; i++) {
+        MmioProfileSizeList *s;
+
+        if (!c->sizes[i]) {
+            continue;
+        }
+        s = g_new0(MmioProfileSizeList, 1);
+        s->value = g_new0(MmioProfileSize, 1);
+        s->value->size = 1ULL << i;
+        s->value->count = c->sizes[i];
+        *tail = s;
+        tail = &s->next;
+    }
+    return e;
+}
+
+static gint mmio_profile_compare(gconstpointer a, gconstpointer b)
+{
+    const MmioProfileCounters *ca = a, *cb = b;
+
+    if (ca->host_ns == cb->host_ns) {
+        return 0;
+    }
+    return ca->host_ns > cb->host_ns ? -1 : 1;
+}
+
+MmioProfileInfo *qmp_query_mmio_profile(Error **errp)
+{
+    MmioProfileInfo *info = g_new0(MmioProfileInfo, 1);
+    MmioProfileEntryList **tail = &info->entries;
+    GSList *all, *l;
+
+    info->enabled = atomic_read(&mmio_profile_enabled);
+
+    /* Counters are only freed and regions only finalized under the BQL,
+     * so they stay around while the lock is dropped for the QOM lookups.
+     */
+    qemu_spin_lock(&mmio_profile_lock);
+    all = g_slist_copy(mmio_profile_dead);
+    if (mmio_profile) {
+        GHashTableIter iter;
+        gpointer key;
+
+        g_hash_table_iter_init(&iter, mmio_profile);
+        while (g_hash_table_iter_next(&iter, &key, NULL)) {
+            all = g_slist_prepend(all, key);
+        }
+    }
+    qemu_spin_unlock(&mmio_profile_lock);
+
+    for (l = all; l; l = l->next) {
+        MmioProfileCounters *c = l->data;
+        Object *owner = c->mr ? memory_region_owner(c->mr) : NULL;
+
+        if (owner && !c->owner && owner->parent) {
+            c->owner = object_get_canonical_path(owner);
+        }
+    }
+
+    /* Snapshot the counters.  */
+    qemu_spin_lock(&mmio_profile_lock);
+    for (l = all; l; l = l->next) {
+        l->data = g_memdup(l->data, sizeof(MmioProfileCounters));
+    }
+    qemu_spin_unlock(&mmio_profile_lock);
+
+    all = g_slist_sort(all, mmio_profile_compare);
+    for (l = all; l; l = l->next) {
+        MmioProfileEntryList *e = g_new0(MmioProfileEntryList, 1);
+
+        e->value = mmio_profile_entry(l->data);
+        *tail = e;
+        tail = &e->next;
+    }
+    g_slist_free_full(all, g_free);
+    return info;
+}
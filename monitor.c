@@ -78,6 +78,8 @@
 #include "sysemu/cpus.h"
 #include "qemu/cutils.h"
 #include "qapi/qmp/dispatch.h"
+#include "qemu/main-loop.h"
+#include "sysemu/iothread.h"
 
 #if defined(TARGET_S390X)
 #include "hw/s390x/storage-keys.h"
@@ -166,8 +168,21 @@ typedef struct {
      * mode.
      */
     QmpCommandList *commands;
+    /*
+     * With oob=on, the requests the monitor thread hands over to the
+     * main loop, protected by qmp_queue_lock.
+     */
+    QemuMutex qmp_queue_lock;
+    GQueue *qmp_requests;
 } MonitorQMP;
 
+/* A request of an oob=on monitor waiting for the main loop */
+typedef struct QMPRequest {
+    Monitor *mon;
+    QObject *req;
+    QObject *id;
+} QMPRequest;
+
 /*
  * To prevent flooding clients, events can be throttled. The
  * throttling is calculated globally, rather than per-Monitor
@@ -218,6 +233,13 @@ static QLIST_HEAD(mon_list, Monitor) mon_list;
 static QLIST_HEAD(mon_fdsets, MonFdset) mon_fdsets;
 static int mon_refcount;
 
+/*
+ * The thread shared by all oob=on monitors, and the bottom half that
+ * runs their in-band requests in the main loop.
+ */
+static IOThread *mon_iothread;
+static QEMUBH *qmp_dispatcher_bh;
+
 static mon_cmd_t mon_cmds[];
 static mon_cmd_t info_cmds[];
 
@@ -572,11 +594,29 @@ static void monitor_data_init(Monitor *mon)
 {
     memset(mon, 0, sizeof(Monitor));
     qemu_mutex_init(&mon->out_lock);
+    qemu_mutex_init(&mon->qmp.qmp_queue_lock);
+    mon->qmp.qmp_requests = g_queue_new();
     mon->outbuf = qstring_new();
     /* Use *mon_cmds by default. */
     mon->cmd_table = mon_cmds;
 }
 
+static void qmp_request_free(QMPRequest *req)
+{
+    qobject_decref(req->id);
+    qobject_decref(req->req);
+    g_free(req);
+}
+
+static void monitor_qmp_cleanup_queue(Monitor *mon)
+{
+    qemu_mutex_lock(&mon->qmp.qmp_queue_lock);
+    while (!g_queue_is_empty(mon->qmp.qmp_requests)) {
+        qmp_request_free(g_queue_pop_head(mon->qmp.qmp_requests));
+    }
+    qemu_mutex_unlock(&mon->qmp.qmp_queue_lock);
+}
+
 static void monitor_data_destroy(Monitor *mon)
 {
     g_free(mon->mon_cpu_path);
@@ -587,6 +627,9 @@ static void monitor_data_destroy(Monitor *mon)
     g_free(mon->rs);
     QDECREF(mon->outbuf);
     qemu_mutex_destroy(&mon->out_lock);
+    monitor_qmp_cleanup_queue(mon);
+    g_queue_free(mon->qmp.qmp_requests);
+    qemu_mutex_destroy(&mon->qmp.qmp_queue_lock);
 }
 
 char *qmp_human_monitor_command(const char *command_line, bool has_cpu_index,
@@ -1128,6 +1171,56 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info((FILE *)mon, monitor_fprintf);
 }
+
+static void hmp_info_tb_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *sort_str = qdict_get_try_str(qdict, "sort");
+    bool disas = qdict_get_try_bool(qdict, "disas", false);
+    CPUState *cs = mon_get_cpu();
+    Error *err = NULL;
+    TbStatsInfo *info;
+    TbStatsEntryList *entry;
+    int sort = TB_STATS_SORT_EXECUTIONS;
+
+    if (sort_str) {
+        sort = qapi_enum_parse(&TbStatsSort_lookup, sort_str, -1, &err);
+        if (err) {
+            error_report_err(err);
+            return;
+        }
+    }
+    info = qmp_query_tb_stats(qdict_haskey(qdict, "count"),
+                              qdict_get_try_int(qdict, "count", 0),
+                              true, sort, &err);
+    if (err) {
+        error_report_err(err);
+        return;
+    }
+
+    monitor_printf(mon, "TB statistics %s\n",
+                   info->enabled ? "enabled" : "disabled");
+    for (entry = info->entries; entry; entry = entry->next) {
+        TbStatsEntry *e = entry->value;
+
+        monitor_printf(mon, "TB " TARGET_FMT_lx " (phys " TARGET_FMT_plx
+                       ") flags %08" PRIx32 ":\n", (target_ulong)e->pc,
+                       (hwaddr)e->phys_pc, e->flags);
+        monitor_printf(mon, "  insns=%" PRIu32 " host=%" PRIu64 " bytes"
+                       " translations=%" PRIu64 " translate=%" PRIu64 " ns\n",
+                       e->guest_insns, e->host_bytes, e->translations,
+                       e->translate_ns);
+        monitor_printf(mon, "  executions=%" PRIu64 " unchained-exits=%"
+                       PRIu64 " interrupted=%" PRIu64 " faults=%" PRIu64 "\n",
+                       e->executions, e->unchained_exits, e->interrupted,
+                       e->faults);
+        if (disas && cs && e->guest_insns) {
+            /* By physical address, the current MMU state may not map it */
+            monitor_disas(mon, cs, e->phys_pc, e->guest_insns, 1);
+        }
+    }
+
+    qapi_free_TbStatsInfo(info);
+}
 #endif
 
 static void hmp_info_history(Monitor *mon, const QDict *qdict)
@@ -3808,28 +3901,35 @@ static int monitor_can_read(void *opaque)
     return (mon->suspend_cnt == 0) ? 1 : 0;
 }
 
-static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
+static bool monitor_uses_oob(Monitor *mon)
 {
-    QObject *req, *rsp = NULL, *id = NULL;
-    QDict *qdict = NULL;
-    Monitor *mon = cur_mon;
-    Error *err = NULL;
+    return mon->flags & MONITOR_USE_OOB;
+}
 
-    req = json_parser_parse_err(tokens, NULL, &err);
-    if (!req && !err) {
-        /* json_parser_parse_err() sucks: can fail without setting @err */
-        error_setg(&err, QERR_JSON_PARSING);
-    }
-    if (err) {
-        goto err_out;
+/*
+ * Can @req run right away in the thread of an oob=on monitor?  Only
+ * commands flagged with allow-oob can, once capabilities are negotiated.
+ */
+static bool monitor_qmp_request_is_oob(Monitor *mon, QObject *req)
+{
+    QDict *qdict = qobject_to_qdict(req);
+    const char *name;
+    QmpCommand *cmd;
+
+    if (!monitor_uses_oob(mon) || !qdict
+        || mon->qmp.commands != &qmp_commands) {
+        return false;
     }
+    name = qdict_get_try_str(qdict, "execute");
+    cmd = name ? qmp_find_command(mon->qmp.commands, name) : NULL;
+    return cmd && qmp_command_is_enabled(cmd) && qmp_command_allows_oob(cmd);
+}
 
-    qdict = qobject_to_qdict(req);
-    if (qdict) {
-        id = qdict_get(qdict, "id");
-        qobject_incref(id);
-        qdict_del(qdict, "id");
-    } /* else will fail qmp_dispatch() */
+/* Run @req and send the response, takes the references to @req and @id. */
+static void monitor_qmp_dispatch(Monitor *mon, QObject *req, QObject *id)
+{
+    QObject *rsp;
+    QDict *qdict;
 
     if (trace_event_get_state_backends(TRACE_HANDLE_QMP_COMMAND)) {
         QString *req_json = qobject_to_json(req);
@@ -3837,7 +3937,7 @@ static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
         QDECREF(req_json);
     }
 
-    rsp = qmp_dispatch(cur_mon->qmp.commands, req);
+    rsp = qmp_dispatch(mon->qmp.commands, req);
 
     if (mon->qmp.commands == &qmp_cap_negotiation_commands) {
         qdict = qdict_get_qdict(qobject_to_qdict(rsp), "error");
@@ -3851,14 +3951,6 @@ static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
         }
     }
 
-err_out:
-    if (err) {
-        qdict = qdict_new();
-        qdict_put_obj(qdict, "error", qmp_build_error_object(err));
-        error_free(err);
-        rsp = QOBJECT(qdict);
-    }
-
     if (rsp) {
         if (id) {
             qdict_put_obj(qobject_to_qdict(rsp), "id", id);
@@ -3873,11 +3965,106 @@ err_out:
     qobject_decref(req);
 }
 
+/* Pop a request of any oob=on monitor, NULL if there is none.  */
+static QMPRequest *monitor_qmp_requests_pop_any(void)
+{
+    QMPRequest *req = NULL;
+    Monitor *mon;
+
+    qemu_mutex_lock(&monitor_lock);
+    QLIST_FOREACH(mon, &mon_list, entry) {
+        qemu_mutex_lock(&mon->qmp.qmp_queue_lock);
+        req = g_queue_pop_head(mon->qmp.qmp_requests);
+        qemu_mutex_unlock(&mon->qmp.qmp_queue_lock);
+        if (req) {
+            break;
+        }
+    }
+    qemu_mutex_unlock(&monitor_lock);
+
+    return req;
+}
+
+/*
+ * Run one in-band request of an oob=on monitor in the main loop, the
+ * bottom half is scheduled again for the next one.
+ */
+static void monitor_qmp_bh_dispatcher(void *opaque)
+{
+    QMPRequest *req = monitor_qmp_requests_pop_any();
+    Monitor *old_mon = cur_mon;
+
+    if (!req) {
+        return;
+    }
+
+    cur_mon = req->mon;
+    monitor_qmp_dispatch(req->mon, req->req, req->id);
+    cur_mon = old_mon;
+    g_free(req);
+
+    qemu_bh_schedule(qmp_dispatcher_bh);
+}
+
+static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
+{
+    QObject *req, *id = NULL;
+    QDict *qdict = NULL;
+    Monitor *mon = container_of(parser, Monitor, qmp.parser);
+    Error *err = NULL;
+
+    req = json_parser_parse_err(tokens, NULL, &err);
+    if (!req && !err) {
+        /* json_parser_parse_err() sucks: can fail without setting @err */
+        error_setg(&err, QERR_JSON_PARSING);
+    }
+    if (err) {
+        qdict = qdict_new();
+        qdict_put_obj(qdict, "error", qmp_build_error_object(err));
+        error_free(err);
+        monitor_json_emitter(mon, QOBJECT(qdict));
+        QDECREF(qdict);
+        return;
+    }
+
+    qdict = qobject_to_qdict(req);
+    if (qdict) {
+        id = qdict_get(qdict, "id");
+        qobject_incref(id);
+        qdict_del(qdict, "id");
+    } /* else will fail qmp_dispatch() */
+
+    if (!monitor_uses_oob(mon) || monitor_qmp_request_is_oob(mon, req)) {
+        /*
+         * Either in the main loop, or out of band in the monitor thread
+         * without the BQL and without looking at cur_mon.
+         */
+        monitor_qmp_dispatch(mon, req, id);
+    } else {
+        QMPRequest *req_obj = g_new0(QMPRequest, 1);
+
+        req_obj->mon = mon;
+        req_obj->req = req;
+        req_obj->id = id;
+        qemu_mutex_lock(&mon->qmp.qmp_queue_lock);
+        g_queue_push_tail(mon->qmp.qmp_requests, req_obj);
+        qemu_mutex_unlock(&mon->qmp.qmp_queue_lock);
+        qemu_bh_schedule(qmp_dispatcher_bh);
+    }
+}
+
 static void monitor_qmp_read(void *opaque, const uint8_t *buf, int size)
 {
+    Monitor *mon = opaque;
     Monitor *old_mon = cur_mon;
 
-    cur_mon = opaque;
+    if (monitor_uses_oob(mon)) {
+        /* In the monitor thread, cur_mon belongs to the main loop */
+        json_message_parser_feed(&mon->qmp.parser, (const char *) buf, size);
+        return;
+    }
+
+    cur_mon = mon;
 
     json_message_parser_feed(&cur_mon->qmp.parser, (const char *) buf, size);
 
@@ -3944,6 +4131,12 @@ static void monitor_qmp_event(void *opaque, int event)
 {
     QObject *data;
     Monitor *mon = opaque;
+    /* The monitor thread of an oob=on monitor doesn't hold the BQL */
+    bool need_bql = !qemu_mutex_iothread_locked();
+
+    if (need_bql) {
+        qemu_mutex_lock_iothread();
+    }
 
     switch (event) {
     case CHR_EVENT_OPENED:
@@ -3954,12 +4147,17 @@ static void monitor_qmp_event(void *opaque, int event)
         mon_refcount++;
         break;
     case CHR_EVENT_CLOSED:
+        monitor_qmp_cleanup_queue(mon);
         json_message_parser_destroy(&mon->qmp.parser);
         json_message_parser_init(&mon->qmp.parser, handle_qmp_command);
         mon_refcount--;
         monitor_fdsets_cleanup();
         break;
     }
+
+    if (need_bql) {
+        qemu_mutex_unlock_iothread();
+    }
 }
 
 static void monitor_event(void *opaque, int event)
@@ -4102,10 +4300,20 @@ void monitor_init(Chardev *chr, int flags)
     }
 
     if (monitor_is_qmp(mon)) {
-        qemu_chr_fe_set_handlers(&mon->chr, monitor_can_read, monitor_qmp_read,
-                                 monitor_qmp_event, NULL, mon, NULL, true);
-        qemu_chr_fe_set_echo(&mon->chr, true);
+        GMainContext *context = NULL;
+
+        if (monitor_uses_oob(mon)) {
+            if (!mon_iothread) {
+                mon_iothread = iothread_create("mon_iothread", &error_abort);
+                qmp_dispatcher_bh = qemu_bh_new(monitor_qmp_bh_dispatcher,
+                                                NULL);
+            }
+            context = iothread_get_g_main_context(mon_iothread);
+        }
         json_message_parser_init(&mon->qmp.parser, handle_qmp_command);
+        qemu_chr_fe_set_echo(&mon->chr, true);
+        qemu_chr_fe_set_handlers(&mon->chr, monitor_can_read, monitor_qmp_read,
+                                 monitor_qmp_event, NULL, mon, context, true);
     } else {
         qemu_chr_fe_set_handlers(&mon->chr, monitor_can_read, monitor_read,
                                  monitor_event, NULL, mon, NULL, true);
@@ -4120,6 +4328,15 @@ void monitor_cleanup(void)
 {
     Monitor *mon, *next;
 
+    if (mon_iothread) {
+        /* The monitor thread may be waiting for the BQL */
+        qemu_mutex_unlock_iothread();
+        iothread_stop(mon_iothread);
+        qemu_mutex_lock_iothread();
+        qemu_bh_delete(qmp_dispatcher_bh);
+        qmp_dispatcher_bh = NULL;
+    }
+
     qemu_mutex_lock(&monitor_lock);
     QLIST_FOREACH_SAFE(mon, &mon_list, entry, next) {
         QLIST_REMOVE(mon, entry);
@@ -4127,6 +4344,11 @@ void monitor_cleanup(void)
         g_free(mon);
     }
     qemu_mutex_unlock(&monitor_lock);
+
+    if (mon_iothread) {
+        iothread_destroy(mon_iothread);
+        mon_iothread = NULL;
+    }
 }
 
 QemuOptsList qemu_mon_opts = {
@@ -4146,6 +4368,9 @@ QemuOptsList qemu_mon_opts = {
         },{
             .name = "pretty",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "oob",
+            .type = QEMU_OPT_BOOL,
         },
         { /* end of list */ }
     },
@@ -46,7 +46,8 @@
 #define CAN_HOST_SOCKETCAN(obj) \
      OBJECT_CHECK(CanHostSocketCAN, (obj), TYPE_CAN_HOST_SOCKETCAN)
 
-#define CAN_READ_BUF_LEN  5
+/* Frames moved per recvmmsg()/sendmmsg() call.  */
+#define CAN_READ_BUF_LEN  32
 typedef struct CanHostSocketCAN {
     CanHostState       parent;
     char               *ifname;
@@ -56,6 +57,8 @@ typedef struct CanHostSocketCAN {
     can_err_mask_t     err_mask;
 
     qemu_can_frame     buf[CAN_READ_BUF_LEN];
+    struct mmsghdr     msgs[CAN_READ_BUF_LEN];
+    struct iovec       iov[CAN_READ_BUF_LEN];
     int                bufcnt;
     int                bufptr;
 
@@ -89,22 +92,59 @@ static void can_host_socketcan_display_msg(struct qemu_can_frame *msg)
     qemu_log_unlock();
 }
 
+/* Point msgs[0..n) at the frames, one frame per message.  */
+static void can_host_socketcan_setup_msgs(CanHostSocketCAN *c,
+                                          const qemu_can_frame *frames,
+                                          int n)
+{
+    int i;
+
+    memset(c->msgs, 0, sizeof(c->msgs[0]) * n);
+    for (i = 0; i < n; i++) {
+        c->iov[i].iov_base = (void *)&frames[i];
+        c->iov[i].iov_len = sizeof(qemu_can_frame);
+        c->msgs[i].msg_hdr.msg_iov = &c->iov[i];
+        c->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
 static void can_host_socketcan_read(void *opaque)
 {
     CanHostSocketCAN *c = opaque;
     CanHostState *ch = CAN_HOST(c);
+    int i, n = 0;
 
-    /* CAN_READ_BUF_LEN for multiple messages syscall is possible for future */
-    c->bufcnt = read(c->fd, c->buf, sizeof(qemu_can_frame));
+    /* Drain whatever the host has queued up, not just a single frame.  */
+    can_host_socketcan_setup_msgs(c, c->buf, CAN_READ_BUF_LEN);
+    c->bufcnt = recvmmsg(c->fd, c->msgs, CAN_READ_BUF_LEN, MSG_DONTWAIT,
+                         NULL);
     if (c->bufcnt < 0) {
-        warn_report("CAN bus host read failed (%s)", strerror(errno));
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            warn_report("CAN bus host read failed (%s)", strerror(errno));
+        }
         return;
     }
 
-    can_bus_client_send(&ch->bus_client, c->buf, 1);
+    /* Only classic frames are expected, drop anything else.  */
+    for (i = 0; i < c->bufcnt; i++) {
+        if (c->msgs[i].msg_len != sizeof(qemu_can_frame)) {
+            continue;
+        }
+        if (n != i) {
+            c->buf[n] = c->buf[i];
+        }
+        n++;
+    }
+    if (!n) {
+        return;
+    }
+
+    can_bus_client_send(&ch->bus_client, c->buf, n);
 
     if (DEBUG_CAN) {
-        can_host_socketcan_display_msg(c->buf);
+        for (i = 0; i < n; i++) {
+            can_host_socketcan_display_msg(&c->buf[i]);
+        }
     }
 }
 
@@ -119,28 +159,37 @@ static ssize_t can_host_socketcan_receive(CanBusClientState *client,
     CanHostState *ch = container_of(client, CanHostState, bus_client);
     CanHostSocketCAN *c = CAN_HOST_SOCKETCAN(ch);
 
-    size_t len = sizeof(qemu_can_frame);
-    int res;
+    size_t sent = 0;
+    int res, i;
 
     if (c->fd < 0) {
         return -1;
     }
 
-    res = write(c->fd, frames, len);
+    while (sent < frames_cnt) {
+        int n = MIN(frames_cnt - sent, CAN_READ_BUF_LEN);
 
-    if (!res) {
-        warn_report("[cansocketcan]: write message to host returns zero");
-        return -1;
-    }
+        can_host_socketcan_setup_msgs(c, frames + sent, n);
+        res = sendmmsg(c->fd, c->msgs, n, 0);
+
+        if (!res) {
+            warn_report("[cansocketcan]: write message to host returns zero");
+            return -1;
+        }
 
-    if (res != len) {
         if (res < 0) {
             warn_report("[cansocketcan]: write to host failed (%s)",
                         strerror(errno));
-        } else {
-            warn_report("[cansocketcan]: write to host truncated");
+            return -1;
         }
-        return -1;
+
+        for (i = 0; i < res; i++) {
+            if (c->msgs[i].msg_len != sizeof(qemu_can_frame)) {
+                warn_report("[cansocketcan]: write to host truncated");
+                return -1;
+            }
+        }
+        sent += res;
     }
 
     return 1;
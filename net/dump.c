@@ -30,13 +30,54 @@
 #include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/timer.h"
+#include "qemu/thread.h"
+#include "qemu/atomic.h"
+#include "qemu/host-utils.h"
 #include "qapi/visitor.h"
 #include "net/filter.h"
+#include "net/eth.h"
+
+/*
+ * Capture ring, filled by whoever sends the packets and drained into the
+ * file by a writer thread. It holds the pcap records back to back as they
+ * will end up in the file, wrapping at the end of the data area. head and
+ * tail count bytes and run free, only the producer moves head and only
+ * the writer moves tail.
+ *
+ * With a ring file the header and data area are a shared mapping of that
+ * file, so tools can follow the records from head as they come in.
+ */
+#define DUMP_RING_MAGIC     0x51445250 /* "QDRP" */
+#define DUMP_RING_DATA_OFF  64
+
+struct dump_ring_hdr {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+};
+
+typedef struct DumpRing {
+    struct dump_ring_hdr *hdr;
+    uint8_t *data;
+    uint32_t size;
+    size_t map_len;
+    bool mapped;
+    QemuThread thread;
+    QemuEvent event;
+    bool stop;
+    int fd;
+} DumpRing;
 
 typedef struct DumpState {
     int64_t start_ts;
     int fd;
     int pcap_caplen;
+    /* Only frames matching these are captured, 0 matches any.  */
+    uint16_t ethertype;
+    uint8_t ip_proto;
+    DumpRing *ring;
 } DumpState;
 
 #define PCAP_MAGIC 0xa1b2c3d4
@@ -60,6 +101,128 @@ struct pcap_sf_pkthdr {
     uint32_t len;
 };
 
+/* Does the frame pass the ethertype and IP protocol match?  */
+static bool dump_match(DumpState *s, const struct iovec *iov, int cnt)
+{
+    uint8_t l2[ETH_HLEN + 4 + sizeof(struct ip6_header)];
+    size_t len, l3off = ETH_HLEN;
+    uint16_t proto;
+
+    if (!s->ethertype && !s->ip_proto) {
+        return true;
+    }
+
+    len = iov_to_buf(iov, cnt, 0, l2, sizeof(l2));
+    if (len < ETH_HLEN) {
+        return false;
+    }
+    proto = lduw_be_p(l2 + 12);
+    if (proto == ETH_P_VLAN && len >= ETH_HLEN + 4) {
+        proto = lduw_be_p(l2 + 16);
+        l3off += 4;
+    }
+    if (s->ethertype && proto != s->ethertype) {
+        return false;
+    }
+    if (!s->ip_proto) {
+        return true;
+    }
+
+    if (proto == ETH_P_IP && len >= l3off + sizeof(struct ip_header)) {
+        return l2[l3off + offsetof(struct ip_header, ip_p)] == s->ip_proto;
+    }
+    if (proto == ETH_P_IPV6 && len >= l3off + sizeof(struct ip6_header)) {
+        return l2[l3off + offsetof(struct ip6_header, ip6_nxt)] == s->ip_proto;
+    }
+    return false;
+}
+
+/* Copy len bytes from buf to ring position pos, wrapping as needed.  */
+static void dump_ring_put(DumpRing *r, uint32_t pos, const void *buf,
+                          size_t len)
+{
+    uint32_t off = pos & (r->size - 1);
+    size_t n = MIN(len, r->size - off);
+
+    memcpy(r->data + off, buf, n);
+    memcpy(r->data, (const uint8_t *)buf + n, len - n);
+}
+
+static void dump_ring_push(DumpRing *r, const struct pcap_sf_pkthdr *hdr,
+                           const struct iovec *iov, int cnt)
+{
+    uint32_t head = r->hdr->head;
+    uint32_t tail = atomic_mb_read(&r->hdr->tail);
+    uint32_t pos;
+    size_t done;
+    int i;
+
+    if (r->size - (head - tail) < sizeof(*hdr) + hdr->caplen) {
+        /* Full, the writer can't keep up.  */
+        atomic_set(&r->hdr->dropped, r->hdr->dropped + 1);
+        return;
+    }
+
+    dump_ring_put(r, head, hdr, sizeof(*hdr));
+    pos = head + sizeof(*hdr);
+    for (i = 0, done = 0; i < cnt && done < hdr->caplen; i++) {
+        size_t n = MIN(iov[i].iov_len, hdr->caplen - done);
+
+        dump_ring_put(r, pos + done, iov[i].iov_base, n);
+        done += n;
+    }
+
+    /* Publish the record only once it is all in.  */
+    atomic_mb_set(&r->hdr->head, head + sizeof(*hdr) + hdr->caplen);
+    qemu_event_set(&r->event);
+}
+
+static void *dump_ring_writer(void *opaque)
+{
+    DumpRing *r = opaque;
+    bool failed = false;
+
+    for (;;) {
+        uint32_t head, tail, off, n;
+        ssize_t ret;
+
+        qemu_event_reset(&r->event);
+        head = atomic_mb_read(&r->hdr->head);
+        tail = r->hdr->tail;
+        if (head == tail) {
+            if (atomic_read(&r->stop)) {
+                break;
+            }
+            qemu_event_wait(&r->event);
+            continue;
+        }
+
+        /* Write out to the end of the ring at most, the rest next time.  */
+        off = tail & (r->size - 1);
+        n = MIN(head - tail, r->size - off);
+        while (!failed && n) {
+            ret = write(r->fd, r->data + off, n);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                error_report("network dump write error - stopping dump");
+                failed = true;
+                break;
+            }
+            off += ret;
+            tail += ret;
+            n -= ret;
+        }
+        if (failed) {
+            /* Keep the producer going, the records go nowhere.  */
+            tail = head;
+        }
+        atomic_mb_set(&r->hdr->tail, tail);
+    }
+    return NULL;
+}
+
 static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
 {
     struct pcap_sf_pkthdr hdr;
@@ -73,6 +236,11 @@ static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
         return size;
     }
 
+    /* Filter before anything gets copied.  */
+    if (!dump_match(s, iov, cnt)) {
+        return size;
+    }
+
     ts = qemu_clock_get_us(QEMU_CLOCK_VIRTUAL);
     caplen = size > s->pcap_caplen ? s->pcap_caplen : size;
 
@@ -81,6 +249,11 @@ static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
     hdr.caplen = caplen;
     hdr.len = size;
 
+    if (s->ring) {
+        dump_ring_push(s->ring, &hdr, iov, cnt);
+        return size;
+    }
+
     dumpiov[0].iov_base = &hdr;
     dumpiov[0].iov_len = sizeof(hdr);
     cnt = iov_copy(&dumpiov[1], cnt, iov, cnt, 0, caplen);
@@ -94,12 +267,102 @@ static ssize_t dump_receive_iov(DumpState *s, const struct iovec *iov, int cnt)
     return size;
 }
 
+static void dump_ring_stop(DumpState *s)
+{
+    DumpRing *r = s->ring;
+
+    if (!r) {
+        return;
+    }
+
+    /* The writer drains what is left before it goes.  */
+    atomic_mb_set(&r->stop, true);
+    qemu_event_set(&r->event);
+    qemu_thread_join(&r->thread);
+    qemu_event_destroy(&r->event);
+
+#ifndef _WIN32
+    if (r->mapped) {
+        munmap(r->hdr, r->map_len);
+    } else
+#endif
+    {
+        g_free(r->hdr);
+    }
+    g_free(r);
+    s->ring = NULL;
+}
+
 static void dump_cleanup(DumpState *s)
 {
+    dump_ring_stop(s);
     close(s->fd);
     s->fd = -1;
 }
 
+/*
+ * Hand the file writes to a thread with a size byte ring, shared through
+ * ring_file when that is set.
+ */
+static int dump_ring_start(DumpState *s, uint32_t size, const char *ring_file,
+                           Error **errp)
+{
+    DumpRing *r;
+    size_t map_len;
+    void *p;
+
+    if (size < 4096 || size > (1U << 30)) {
+        error_setg(errp, "ring size must be between 4KiB and 1GiB");
+        return -1;
+    }
+    size = pow2ceil(size);
+    map_len = DUMP_RING_DATA_OFF + size;
+
+    if (ring_file) {
+#ifndef _WIN32
+        int fd = open(ring_file, O_CREAT | O_TRUNC | O_RDWR, 0644);
+
+        if (fd < 0) {
+            error_setg_errno(errp, errno, "can't open %s", ring_file);
+            return -1;
+        }
+        if (ftruncate(fd, map_len) < 0) {
+            error_setg_errno(errp, errno, "can't size %s", ring_file);
+            close(fd);
+            return -1;
+        }
+        p = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+            error_setg_errno(errp, errno, "can't map %s", ring_file);
+            return -1;
+        }
+#else
+        error_setg(errp, "ring files are not supported on this host");
+        return -1;
+#endif
+    } else {
+        p = g_malloc0(map_len);
+    }
+
+    r = g_new0(DumpRing, 1);
+    r->hdr = p;
+    r->data = (uint8_t *)p + DUMP_RING_DATA_OFF;
+    r->map_len = map_len;
+    r->mapped = ring_file != NULL;
+    r->fd = s->fd;
+    r->size = size;
+    r->hdr->size = size;
+    r->hdr->head = r->hdr->tail = r->hdr->dropped = 0;
+    atomic_mb_set(&r->hdr->magic, DUMP_RING_MAGIC);
+
+    qemu_event_init(&r->event, false);
+    s->ring = r;
+    qemu_thread_create(&r->thread, "net-dump", dump_ring_writer, r,
+                       QEMU_THREAD_JOINABLE);
+    return 0;
+}
+
 static int net_dump_state_init(DumpState *s, const char *filename,
                                int len, Error **errp)
 {
@@ -244,6 +507,10 @@ struct NetFilterDumpState {
     DumpState ds;
     char *filename;
     uint32_t maxlen;
+    uint32_t ring_size;
+    char *ring_file;
+    uint32_t ethertype;
+    uint32_t ip_proto;
 };
 typedef struct NetFilterDumpState NetFilterDumpState;
 
@@ -273,7 +540,42 @@ static void filter_dump_setup(NetFilterState *nf, Error **errp)
         return;
     }
 
-    net_dump_state_init(&nfds->ds, nfds->filename, nfds->maxlen, errp);
+    if (nfds->ethertype > UINT16_MAX || nfds->ip_proto > UINT8_MAX) {
+        error_setg(errp, "dump filter 'ethertype' or 'ip-proto' out of range");
+        return;
+    }
+    if (nfds->ring_file && !nfds->ring_size) {
+        error_setg(errp, "dump filter 'ring-file' needs 'ring-size' set");
+        return;
+    }
+
+    if (net_dump_state_init(&nfds->ds, nfds->filename, nfds->maxlen, errp)) {
+        return;
+    }
+    nfds->ds.ethertype = nfds->ethertype;
+    nfds->ds.ip_proto = nfds->ip_proto;
+
+    if (nfds->ring_size &&
+        dump_ring_start(&nfds->ds, nfds->ring_size, nfds->ring_file, errp)) {
+        close(nfds->ds.fd);
+        nfds->ds.fd = -1;
+    }
+}
+
+static void filter_dump_get_uint32(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    uint32_t *ptr = opaque;
+
+    visit_type_uint32(v, name, ptr, errp);
+}
+
+static void filter_dump_set_uint32(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    uint32_t *ptr = opaque;
+
+    visit_type_uint32(v, name, ptr, errp);
 }
 
 static void filter_dump_get_maxlen(Object *obj, Visitor *v, const char *name,
@@ -322,6 +624,22 @@ static void file_dump_set_filename(Object *obj, const char *value, Error **errp)
     nfds->filename = g_strdup(value);
 }
 
+static char *file_dump_get_ring_file(Object *obj, Error **errp)
+{
+    NetFilterDumpState *nfds = FILTER_DUMP(obj);
+
+    return g_strdup(nfds->ring_file);
+}
+
+static void file_dump_set_ring_file(Object *obj, const char *value,
+                                    Error **errp)
+{
+    NetFilterDumpState *nfds = FILTER_DUMP(obj);
+
+    g_free(nfds->ring_file);
+    nfds->ring_file = g_strdup(value);
+}
+
 static void filter_dump_instance_init(Object *obj)
 {
     NetFilterDumpState *nfds = FILTER_DUMP(obj);
@@ -332,6 +650,14 @@ static void filter_dump_instance_init(Object *obj)
                         filter_dump_set_maxlen, NULL, NULL, NULL);
     object_property_add_str(obj, "file", file_dump_get_filename,
                             file_dump_set_filename, NULL);
+    object_property_add(obj, "ring-size", "uint32", filter_dump_get_uint32,
+                        filter_dump_set_uint32, NULL, &nfds->ring_size, NULL);
+    object_property_add_str(obj, "ring-file", file_dump_get_ring_file,
+                            file_dump_set_ring_file, NULL);
+    object_property_add(obj, "ethertype", "uint32", filter_dump_get_uint32,
+                        filter_dump_set_uint32, NULL, &nfds->ethertype, NULL);
+    object_property_add(obj, "ip-proto", "uint32", filter_dump_get_uint32,
+                        filter_dump_set_uint32, NULL, &nfds->ip_proto, NULL);
 }
 
 static void filter_dump_instance_finalize(Object *obj)
@@ -339,6 +665,7 @@ static void filter_dump_instance_finalize(Object *obj)
     NetFilterDumpState *nfds = FILTER_DUMP(obj);
 
     g_free(nfds->filename);
+    g_free(nfds->ring_file);
 }
 
 static void filter_dump_class_init(ObjectClass *oc, void *data)
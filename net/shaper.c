@@ -0,0 +1,57 @@
+/*
+ * Wire speed pacing of network frames in virtual time.
+ *
+ * Copyright (c) 2019 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "net/shaper.h"
+
+void net_shaper_init(NetShaper *sh, uint32_t speed,
+                     QEMUTimerCB *cb, void *opaque)
+{
+    sh->speed = speed;
+    sh->free_at = 0;
+    sh->timer = speed ? timer_new_ns(QEMU_CLOCK_VIRTUAL, cb, opaque) : NULL;
+}
+
+void net_shaper_reset(NetShaper *sh)
+{
+    if (sh->timer) {
+        timer_del(sh->timer);
+    }
+    sh->free_at = 0;
+}
+
+bool net_shaper_ready(NetShaper *sh)
+{
+    if (!sh->speed) {
+        return true;
+    }
+    if (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) >= sh->free_at) {
+        return true;
+    }
+    if (!timer_pending(sh->timer)) {
+        timer_mod(sh->timer, sh->free_at);
+    }
+    return false;
+}
+
+void net_shaper_account(NetShaper *sh, size_t size)
+{
+    int64_t now;
+    uint64_t bits;
+
+    if (!sh->speed) {
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    bits = (MAX(size, NET_SHAPER_MIN_FRAME) + NET_SHAPER_OVERHEAD) * 8;
+    /* 1 Mbit/s puts a bit on the wire every 1000ns.  */
+    sh->free_at = MAX(now, sh->free_at) + bits * 1000 / sh->speed;
+}
@@ -85,6 +85,11 @@ bool qmp_has_success_response(const QmpCommand *cmd)
     return !(cmd->options & QCO_NO_SUCCESS_RESP);
 }
 
+bool qmp_command_allows_oob(const QmpCommand *cmd)
+{
+    return cmd->options & QCO_ALLOW_OOB;
+}
+
 void qmp_for_each_command(QmpCommandList *cmds, qmp_cmd_callback_fn fn,
                           void *opaque)
 {
@@ -42,7 +42,10 @@
 #include "block/block_int.h"
 #include "block/blockjob.h"
 #include "block/qapi.h"
+#include "block/thread-pool.h"
 #include "crypto/init.h"
+#include "qemu/stripe.h"
+#include "qemu/nand-image.h"
 #include "trace/control.h"
 
 #define QEMU_IMG_VERSION "qemu-img version " QEMU_VERSION QEMU_PKGVERSION \
@@ -65,6 +68,7 @@ enum {
     OPTION_SIZE = 264,
     OPTION_PREALLOCATION = 265,
     OPTION_SHRINK = 266,
+    OPTION_TRANSFORM = 267,
 };
 
 typedef enum OutputFormat {
@@ -178,6 +182,10 @@ static void QEMU_NORETURN help(void)
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
            "       process (defaults to 8)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
+           "  '--transform' lays out the target for a flash device, as the image\n"
+           "       of one of 'lanes' parallel flashes ('stripe,lanes=N,lane=I\n"
+           "       [,be=on][,byte-wise=on]') or as pages followed by their OOB\n"
+           "       ('nand,page-size=P,oob-size=O[,ecc-size=E]')\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
            "  'snapshot' is the name of the snapshot to create, apply or delete\n"
@@ -1527,6 +1535,43 @@ enum ImgConvertBlockStatus {
 
 #define MAX_COROUTINES 16
 
+/*
+ * Output transforms lay out the target for a flash device as they copy,
+ * instead of a separate pass over the converted image.  Every in_unit
+ * bytes of input become out_unit bytes of output.
+ */
+typedef struct ImgConvertTransform {
+    /* A multiple or a divisor of BDRV_SECTOR_SIZE */
+    size_t in_unit;
+    size_t out_unit;
+    /* Fills the end of a partial last unit */
+    uint8_t pad;
+    /* Whether zeros stay zeros, so that zero areas can be skipped */
+    bool keeps_zero;
+    /* Runs in the thread pool, may clobber src */
+    void (*apply)(const struct ImgConvertTransform *t, uint8_t *dst,
+                  uint8_t *src, size_t units);
+    union {
+        struct {
+            int lanes;
+            int lane;
+            bool be;
+            bool byte_wise;
+        } stripe;
+        struct {
+            uint32_t page_size;
+            uint32_t oob_size;
+            uint32_t ecc_size;
+        } nand;
+    };
+} ImgConvertTransform;
+
+/* A part of a buffer that is all data, or that can be zeroed instead */
+typedef struct ImgConvertRun {
+    int n;
+    bool data;
+} ImgConvertRun;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
@@ -1546,6 +1591,8 @@ typedef struct ImgConvertState {
     int min_sparse;
     size_t cluster_sectors;
     size_t buf_sectors;
+    const ImgConvertTransform *transform;
+    size_t unit_sectors;
     long num_coroutines;
     int running_coroutines;
     Coroutine *co[MAX_COROUTINES];
@@ -1624,6 +1671,16 @@ static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
         }
     }
 
+    /* Same for transforms working on several sectors at a time */
+    if (s->unit_sectors > 1) {
+        if (n < s->unit_sectors) {
+            n = MIN(s->unit_sectors, s->total_sectors - sector_num);
+            s->status = BLK_DATA;
+        } else {
+            n = QEMU_ALIGN_DOWN(n, s->unit_sectors);
+        }
+    }
+
     return n;
 }
 
@@ -1668,8 +1725,136 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
 }
 
 
+static void convert_stripe_apply(const ImgConvertTransform *t, uint8_t *dst,
+                                 uint8_t *src, size_t units)
+{
+    size_t len = units * t->in_unit;
+    int lanes = t->stripe.lanes;
+    int lane = t->stripe.lane;
+    size_t i;
+
+    if (!t->stripe.byte_wise) {
+        stripe_buf(src, len, lanes, false, t->stripe.be);
+    } else if (t->stripe.be) {
+        lane = lanes - 1 - lane;
+    }
+    for (i = 0; i < len / lanes; i++) {
+        dst[i] = src[i * lanes + lane];
+    }
+}
+
+static void convert_nand_apply(const ImgConvertTransform *t, uint8_t *dst,
+                               uint8_t *src, size_t units)
+{
+    size_t i;
+
+    for (i = 0; i < units; i++) {
+        nand_image_page(dst + i * t->out_unit, src + i * t->in_unit,
+                        t->nand.page_size, t->nand.oob_size,
+                        t->nand.ecc_size);
+    }
+}
+
+static int64_t convert_transform_size(const ImgConvertTransform *t,
+                                      int64_t bytes)
+{
+    return DIV_ROUND_UP(bytes, t->in_unit) * t->out_unit;
+}
+
+/* The CPU bound part of copying a buffer, see convert_worker() */
+typedef struct ImgConvertWork {
+    ImgConvertState *s;
+    uint8_t *buf;
+    int nb_sectors;
+    /* Zero detection results */
+    ImgConvertRun *runs;
+    int nb_runs;
+    /* Output of the transform, if any */
+    uint8_t *out_buf;
+    size_t out_len;
+} ImgConvertWork;
+
+/* Runs in the thread pool, so that the copy coroutines scan and transform
+ * buffers in parallel while the others wait for I/O.
+ */
+static int convert_worker(void *opaque)
+{
+    ImgConvertWork *w = opaque;
+    ImgConvertState *s = w->s;
+    const ImgConvertTransform *t = s->transform;
+    uint8_t *buf = w->buf;
+    int left = w->nb_sectors;
+
+    w->nb_runs = 0;
+
+    if (t) {
+        size_t len = w->nb_sectors * BDRV_SECTOR_SIZE;
+        size_t units = DIV_ROUND_UP(len, t->in_unit);
+        bool data = !s->min_sparse || !buffer_is_zero(buf, len);
+
+        w->runs[w->nb_runs++] = (ImgConvertRun) { w->nb_sectors, data };
+        w->out_len = units * t->out_unit;
+        if (data) {
+            memset(buf + len, t->pad, units * t->in_unit - len);
+            t->apply(t, w->out_buf, buf, units);
+        }
+        return 0;
+    }
+
+    while (left > 0) {
+        int n = left;
+        bool data;
+
+        /* If we're told to keep the target fully allocated (-S 0) or there
+         * is real non-zero data, we must write it. Otherwise we can treat
+         * it as zero sectors.
+         * Compressed clusters need to be written as a whole, so in that
+         * case we can only save the write if the buffer is completely
+         * zeroed. */
+        if (!s->min_sparse) {
+            data = true;
+        } else if (s->compressed) {
+            data = !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE);
+        } else {
+            data = is_allocated_sectors_min(buf, n, &n, s->min_sparse);
+        }
+        w->runs[w->nb_runs++] = (ImgConvertRun) { n, data };
+
+        left -= n;
+        buf += n * BDRV_SECTOR_SIZE;
+    }
+    return 0;
+}
+
+static int coroutine_fn
+convert_co_write_transformed(ImgConvertState *s, int64_t sector_num,
+                             int nb_sectors, ImgConvertWork *w,
+                             enum ImgConvertBlockStatus status)
+{
+    const ImgConvertTransform *t = s->transform;
+    int64_t offset = sector_num * BDRV_SECTOR_SIZE / t->in_unit * t->out_unit;
+    QEMUIOVector qiov;
+    struct iovec iov;
+
+    if (status == BLK_DATA && w->runs[0].data) {
+        iov.iov_base = w->out_buf;
+        iov.iov_len = w->out_len;
+        qemu_iovec_init_external(&qiov, &iov, 1);
+        return blk_co_pwritev(s->target, offset, w->out_len, &qiov, 0);
+    }
+
+    assert(t->keeps_zero);
+    if (s->has_zero_init) {
+        return 0;
+    }
+    return blk_co_pwrite_zeroes(s->target, offset,
+                                convert_transform_size(t, nb_sectors *
+                                                       BDRV_SECTOR_SIZE), 0);
+}
+
 static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                          int nb_sectors, uint8_t *buf,
+                                         const ImgConvertRun *runs,
                                          enum ImgConvertBlockStatus status)
 {
     int ret;
@@ -1678,6 +1863,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
 
     while (nb_sectors > 0) {
         int n = nb_sectors;
+        bool data;
         BdrvRequestFlags flags = s->compressed ? BDRV_REQ_WRITE_COMPRESSED : 0;
 
         switch (status) {
@@ -1689,18 +1875,11 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
             break;
 
         case BLK_DATA:
-            /* If we're told to keep the target fully allocated (-S 0) or there
-             * is real non-zero data, we must write it. Otherwise we can treat
-             * it as zero sectors.
-             * Compressed clusters need to be written as a whole, so in that
-             * case we can only save the write if the buffer is completely
-             * zeroed. */
-            if (!s->min_sparse ||
-                (!s->compressed &&
-                 is_allocated_sectors_min(buf, n, &n, s->min_sparse)) ||
-                (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
-            {
+            /* convert_worker() told the data from what can be zeroed */
+            n = runs->n;
+            data = runs->data;
+            runs++;
+            if (data) {
                 iov.iov_base = buf;
                 iov.iov_len = n << BDRV_SECTOR_BITS;
                 qemu_iovec_init_external(&qiov, &iov, 1);
@@ -1739,6 +1918,8 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
 static void coroutine_fn convert_co_do_copy(void *opaque)
 {
     ImgConvertState *s = opaque;
+    ThreadPool *pool = aio_get_thread_pool(blk_get_aio_context(s->target));
+    ImgConvertWork work;
     uint8_t *buf = NULL;
     int ret, i;
     int index = -1;
@@ -1753,6 +1934,16 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
 
     s->running_coroutines++;
     buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
+    work = (ImgConvertWork) {
+        .s      = s,
+        .buf    = buf,
+        .runs   = g_new(ImgConvertRun, s->buf_sectors),
+    };
+    if (s->transform) {
+        work.out_buf = blk_blockalign(s->target,
+                                      convert_transform_size(s->transform,
+                                          s->buf_sectors * BDRV_SECTOR_SIZE));
+    }
 
     while (1) {
         int n;
@@ -1799,6 +1990,16 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
             memset(buf, 0x00, n * BDRV_SECTOR_SIZE);
         }
 
+        if (status == BLK_DATA && s->ret == -EINPROGRESS) {
+            work.nb_sectors = n;
+            if (s->min_sparse || s->transform) {
+                thread_pool_submit_co(pool, convert_worker, &work);
+            } else {
+                /* Nothing to scan */
+                convert_worker(&work);
+            }
+        }
+
         if (s->wr_in_order) {
             /* keep writes in order */
             while (s->wr_offs != sector_num && s->ret == -EINPROGRESS) {
@@ -1809,7 +2010,13 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
         }
 
         if (s->ret == -EINPROGRESS) {
-            ret = convert_co_write(s, sector_num, n, buf, status);
+            if (s->transform) {
+                ret = convert_co_write_transformed(s, sector_num, n, &work,
+                                                   status);
+            } else {
+                ret = convert_co_write(s, sector_num, n, buf, work.runs,
+                                       status);
+            }
             if (ret < 0) {
                 error_report("error while writing sector %" PRId64
                              ": %s", sector_num, strerror(-ret));
@@ -1836,6 +2043,8 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
     }
 
     qemu_vfree(buf);
+    qemu_vfree(work.out_buf);
+    g_free(work.runs);
     s->co[index] = NULL;
     s->running_coroutines--;
     if (!s->running_coroutines && s->ret == -EINPROGRESS) {
@@ -1872,6 +2081,9 @@ static int convert_do_copy(ImgConvertState *s)
         }
         s->buf_sectors = s->cluster_sectors;
     }
+    if (s->unit_sectors > 1) {
+        s->buf_sectors = QEMU_ALIGN_UP(s->buf_sectors, s->unit_sectors);
+    }
 
     while (sector_num < s->total_sectors) {
         n = convert_iteration_sectors(s, sector_num);
@@ -1911,6 +2123,141 @@ static int convert_do_copy(ImgConvertState *s)
     return s->ret;
 }
 
+static QemuOptsList convert_transform_opts = {
+    .name = "transform",
+    .implied_opt_name = "type",
+    .head = QTAILQ_HEAD_INITIALIZER(convert_transform_opts.head),
+    .desc = {
+        {
+            .name = "type",
+            .type = QEMU_OPT_STRING,
+            .help = "Transform to apply (stripe, nand)",
+        },
+        {
+            .name = "lanes",
+            .type = QEMU_OPT_NUMBER,
+            .help = "stripe: number of parallel flashes (default 2)",
+        },
+        {
+            .name = "lane",
+            .type = QEMU_OPT_NUMBER,
+            .help = "stripe: flash to output the image of, from 0",
+        },
+        {
+            .name = "be",
+            .type = QEMU_OPT_BOOL,
+            .help = "stripe: big endian bit (or lane) order",
+        },
+        {
+            .name = "byte-wise",
+            .type = QEMU_OPT_BOOL,
+            .help = "stripe: split bytes rather than bits",
+        },
+        {
+            .name = "page-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "nand: page size",
+        },
+        {
+            .name = "oob-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "nand: OOB size per page",
+        },
+        {
+            .name = "ecc-size",
+            .type = QEMU_OPT_SIZE,
+            .help = "nand: ECC bytes at the end of the OOB (default 0)",
+        },
+        { /* end of list */ }
+    },
+};
+
+/* Set up the output transform described by @optarg, returns -1 on error */
+static int convert_parse_transform(ImgConvertTransform *t, const char *optarg)
+{
+    QemuOpts *opts;
+    const char *type;
+    int ret = -1;
+
+    opts = qemu_opts_parse_noisily(&convert_transform_opts, optarg, true);
+    if (!opts) {
+        return -1;
+    }
+
+    type = qemu_opt_get(opts, "type");
+    if (!g_strcmp0(type, "stripe")) {
+        uint64_t lanes = qemu_opt_get_number(opts, "lanes", 2);
+        uint64_t lane = qemu_opt_get_number(opts, "lane", 0);
+
+        /* Groups must not straddle sectors, those are copied separately */
+        if (!lanes || lanes > BDRV_SECTOR_SIZE ||
+            BDRV_SECTOR_SIZE % lanes) {
+            error_report("Number of stripe lanes must divide %d",
+                         BDRV_SECTOR_SIZE);
+            goto out;
+        }
+        if (lane >= lanes) {
+            error_report("Stripe lane must be less than %" PRIu64, lanes);
+            goto out;
+        }
+        *t = (ImgConvertTransform) {
+            .in_unit    = lanes,
+            .out_unit   = 1,
+            .pad        = 0,
+            .keeps_zero = true,
+            .apply      = convert_stripe_apply,
+            .stripe = {
+                .lanes      = lanes,
+                .lane       = lane,
+                .be         = qemu_opt_get_bool(opts, "be", false),
+                .byte_wise  = qemu_opt_get_bool(opts, "byte-wise", false),
+            },
+        };
+    } else if (!g_strcmp0(type, "nand")) {
+        uint64_t page_size = qemu_opt_get_size(opts, "page-size", 0);
+        uint64_t oob_size = qemu_opt_get_size(opts, "oob-size", 0);
+        uint64_t ecc_size = qemu_opt_get_size(opts, "ecc-size", 0);
+
+        if (!page_size || page_size > UINT32_MAX / 2 ||
+            page_size % NAND_ECC_CODEWORD_SIZE) {
+            error_report("NAND page size must be a multiple of %d",
+                         NAND_ECC_CODEWORD_SIZE);
+            goto out;
+        }
+        if (oob_size > UINT32_MAX / 2 || ecc_size > oob_size) {
+            error_report("NAND ECC size must not exceed the OOB size");
+            goto out;
+        }
+        if (ecc_size % (page_size / NAND_ECC_CODEWORD_SIZE)) {
+            error_report("NAND ECC size must be a multiple of the number of "
+                         "%d byte codewords per page",
+                         NAND_ECC_CODEWORD_SIZE);
+            goto out;
+        }
+        /* Erased flash, as qemu-nand-creator pads the last page with */
+        *t = (ImgConvertTransform) {
+            .in_unit    = page_size,
+            .out_unit   = page_size + oob_size,
+            .pad        = 0xff,
+            .keeps_zero = false,
+            .apply      = convert_nand_apply,
+            .nand = {
+                .page_size  = page_size,
+                .oob_size   = oob_size,
+                .ecc_size   = ecc_size,
+            },
+        };
+    } else {
+        error_report("Unknown transform '%s'", type ? type : "");
+        goto out;
+    }
+    ret = 0;
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
 static int img_convert(int argc, char **argv)
 {
     int c, bs_i, flags, src_flags = 0;
@@ -1928,6 +2275,8 @@ static int img_convert(int argc, char **argv)
          skip_create = false, progress = false, tgt_image_opts = false;
     int64_t ret = -EINVAL;
     bool force_share = false;
+    ImgConvertTransform transform;
+    int64_t out_size;
 
     ImgConvertState s = (ImgConvertState) {
         /* Need at least 4k of zeros for sparse detection */
@@ -1944,6 +2293,7 @@ static int img_convert(int argc, char **argv)
             {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
             {"force-share", no_argument, 0, 'U'},
             {"target-image-opts", no_argument, 0, OPTION_TARGET_IMAGE_OPTS},
+            {"transform", required_argument, 0, OPTION_TRANSFORM},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:co:s:l:S:pt:T:qnm:WU",
@@ -2059,6 +2409,16 @@ static int img_convert(int argc, char **argv)
         case OPTION_TARGET_IMAGE_OPTS:
             tgt_image_opts = true;
             break;
+        case OPTION_TRANSFORM:
+            if (s.transform) {
+                error_report("Only one --transform can be given");
+                goto fail_getopt;
+            }
+            if (convert_parse_transform(&transform, optarg) < 0) {
+                goto fail_getopt;
+            }
+            s.transform = &transform;
+            break;
         }
     }
 
@@ -2077,6 +2437,20 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (s.transform) {
+        if (s.compressed) {
+            error_report("Output transforms and compression are mutually "
+                         "exclusive");
+            goto fail_getopt;
+        }
+        /* Zeros become erased pages, those must be written out */
+        if (!s.transform->keeps_zero) {
+            s.min_sparse = 0;
+        }
+        s.unit_sectors = DIV_ROUND_UP(s.transform->in_unit,
+                                      BDRV_SECTOR_SIZE);
+    }
+
     if (tgt_image_opts && !skip_create) {
         error_report("--target-image-opts requires use of -n flag");
         goto fail_getopt;
@@ -2136,6 +2510,11 @@ static int img_convert(int argc, char **argv)
         s.total_sectors += s.src_sectors[bs_i];
     }
 
+    out_size = s.total_sectors * BDRV_SECTOR_SIZE;
+    if (s.transform) {
+        out_size = convert_transform_size(s.transform, out_size);
+    }
+
     if (sn_opts) {
         bdrv_snapshot_load_tmp(blk_bs(s.src[0]),
                                qemu_opt_get(sn_opts, SNAPSHOT_OPT_ID),
@@ -2200,8 +2579,7 @@ static int img_convert(int argc, char **argv)
             }
         }
 
-        qemu_opt_set_number(opts, BLOCK_OPT_SIZE, s.total_sectors * 512,
-                            &error_abort);
+        qemu_opt_set_number(opts, BLOCK_OPT_SIZE, out_size, &error_abort);
         ret = add_old_style_options(out_fmt, opts, out_baseimg, NULL);
         if (ret < 0) {
             goto out;
@@ -2222,6 +2600,12 @@ static int img_convert(int argc, char **argv)
         goto out;
     }
 
+    if (s.transform && out_baseimg) {
+        error_report("A transformed target cannot have a backing file");
+        ret = -1;
+        goto out;
+    }
+
     /* Check if compression is supported */
     if (s.compressed) {
         bool encryption =
@@ -2311,7 +2695,7 @@ static int img_convert(int argc, char **argv)
                          strerror(-output_sectors));
             ret = -1;
             goto out;
-        } else if (output_sectors < s.total_sectors) {
+        } else if (output_sectors * BDRV_SECTOR_SIZE < out_size) {
             error_report("output file is smaller than input file");
             ret = -1;
             goto out;
@@ -2329,6 +2713,13 @@ static int img_convert(int argc, char **argv)
         s.cluster_sectors = bdi.cluster_size / BDRV_SECTOR_SIZE;
     }
 
+    if (s.transform && s.compressed) {
+        error_report("Output transforms are not supported for this file "
+                     "format");
+        ret = -1;
+        goto out;
+    }
+
     ret = convert_do_copy(&s);
 out:
     if (!ret) {
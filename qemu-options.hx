@@ -119,9 +119,14 @@ Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
 DEF("accel", HAS_ARG, QEMU_OPTION_accel,
-    "-accel [accel=]accelerator[,thread=single|multi]\n"
+    "-accel [accel=]accelerator[,thread=single|multi|cluster]\n"
+    "                [,poll-skip=on|off][,superblock-threshold=n]\n"
+    "                [,tb-hugepages=off|thp|hugetlb]\n"
     "                select accelerator (kvm, xen, hax or tcg; use 'help' for a list)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi|cluster (enable multi-threaded TCG)\n"
+    "                poll-skip=on|off (fast-forward MMIO polling loops)\n"
+    "                superblock-threshold=n (retranslate hot TBs as superblocks)\n"
+    "                tb-hugepages=off|thp|hugetlb (huge pages for translated code)\n", QEMU_ARCH_ALL)
 STEXI
 @item -accel @var{name}[,prop=@var{value}[,...]]
 @findex -accel
@@ -130,11 +135,38 @@ kvm, xen, hax or tcg can be available. By default, tcg is used. If there is
 more than one accelerator specified, the next one is used if the previous one
 fails to initialize.
 @table @option
-@item thread=single|multi
+@item thread=single|multi|cluster
 Controls number of TCG threads. When the TCG is multi-threaded there will be one
 thread per vCPU therefor taking advantage of additional host cores. The default
 is to enable multi-threading where both the back-end and front-ends support it and
 no incompatible TCG features have been enabled (e.g. icount/replay).
+With @option{cluster}, there is one thread per cluster of identical vCPUs, e.g.
+one for the Cortex-A53s and one for the Cortex-R5s, each scheduling its vCPUs
+in turn like the single threaded TCG does. With @option{-icount} the clusters
+only run in parallel in quantum mode, where they meet at every quantum
+boundary; otherwise they share a single thread to stay deterministic.
+@item poll-skip=on|off
+Detects single-threaded TCG vCPUs spinning on an MMIO status register, i.e.
+reading the same value from the same load over and over without writing
+MMIO or taking interrupts. With @option{-icount}, when all other vCPUs are
+idle or polling too, virtual time skips ahead to the next timer as if the
+loop had kept running, which keeps execution deterministic. Without icount
+the polling vCPU only yields to the other vCPUs. The default is off.
+@item superblock-threshold=@var{n}
+Once a translation block has been entered @var{n} times it is translated
+again as a superblock, which carries on past forward direct branches within
+the same guest page instead of ending at them. The taken paths of conditional
+branches leave the superblock. Only the ARM front ends build superblocks so
+far. The default of 0 disables this.
+@item tb-hugepages=off|thp|hugetlb
+Selects how the buffer holding translated code is backed. @option{thp}, the
+default, asks for transparent huge pages; @option{hugetlb} maps it from the
+hugetlbfs pool, which needs enough pages reserved in
+@file{/proc/sys/vm/nr_hugepages}, and falls back to @option{thp} with a warning
+otherwise. @option{off} uses host pages only. With huge pages, the regions
+handed to each multi-threaded TCG vCPU are aligned to the huge page size when
+the buffer is large enough, and on NUMA hosts each region's pages are
+allocated on the node of the vCPU thread that fills it.
 @end table
 ETEXI
 
@@ -383,8 +415,22 @@ STEXI
 Dump an execution trace to @var{path}.
 ETEXI
 
+DEF("coverage", HAS_ARG, QEMU_OPTION_coverage,
+    "-coverage FILE  write the executed guest code to FILE at exit\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -coverage @var{path}
+@findex -coverage
+Record which guest physical addresses are executed and write them to
+@var{path} when QEMU exits, one line per range with its start and end in
+hexadecimal, the end excluded.  Each translation block is accounted the
+first time it runs, so this costs next to nothing compared with an
+execution trace.  Coverage can also be restarted and written out with the
+QMP commands @code{coverage-start} and @code{coverage-dump}.
+ETEXI
+
 DEF("etrace-flags", HAS_ARG, QEMU_OPTION_etrace_flags,
-    "-etrace-flags FLAGS  Execution trace flags\n\texec,translation,mem,cpu\n", QEMU_ARCH_ALL)
+    "-etrace-flags FLAGS  Execution trace flags\n\texec,translation,mem,cpu,counters,trace,delta,zlib\n", QEMU_ARCH_ALL)
 STEXI
 @item -etrace-flags
 @findex -etrace-flags
@@ -395,6 +441,25 @@ exec          Trace instruction execution.
 translation   Trace TB translation with TB contents. (for off-line disassembly)
 mem           Trace memory accesses (Only MMIO at the moment).
 cpu           Trace CPU register state (slow, currently not binary).
+counters      Sample per CPU counters of TBs, TLB misses per MMU index,
+              IO accesses per MemoryRegion, exceptions and IRQs.
+trace         Mirror enabled trace events as u64 events, needs the
+              perthread trace backend.
+delta         Delta and varint encode exec and mem records (not part of all).
+zlib          Gzip compress the trace stream (not part of all).
+@end example
+
+Filters can be given alongside the flags as key=value pairs. They are
+evaluated when code is translated or a TLB entry is filled, so untraced
+code and accesses run at full speed. Memory ranges are matched at target
+page granularity.
+
+@example
+exec-range=START-END  Only trace TBs starting at guest PCs START to END.
+mem-range=START-END   Only trace accesses to guest physical START to END.
+exec-sample=N         Only trace one in N TB executions per CPU.
+mem-sample=N          Only trace one in N memory accesses per CPU.
+counter-period=NS     Sample counters every NS of virtual time (1ms).
 @end example
 ETEXI
 
@@ -843,7 +908,8 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "       [,cyls=c,heads=h,secs=s[,trans=t]][,snapshot=on|off]\n"
     "       [,cache=writethrough|writeback|none|directsync|unsafe][,format=f]\n"
     "       [,serial=s][,addr=A][,rerror=ignore|stop|report]\n"
-    "       [,werror=ignore|stop|report|enospc][,id=name][,aio=threads|native]\n"
+    "       [,werror=ignore|stop|report|enospc][,id=name]\n"
+    "       [,aio=threads|native|io_uring]\n"
     "       [,readonly=on|off][,copy-on-read=on|off]\n"
     "       [,discard=ignore|unmap][,detect-zeroes=on|off|unmap]\n"
     "       [[,bps=b]|[[,bps_rd=r][,bps_wr=w]]]\n"
@@ -915,7 +981,7 @@ unsafe       │ on                off            on
 The default mode is @option{cache=writeback}.
 
 @item aio=@var{aio}
-@var{aio} is "threads", or "native" and selects between pthread based disk I/O and native Linux AIO.
+@var{aio} is "threads", "native" or "io_uring" and selects between pthread based disk I/O, native Linux AIO and Linux io_uring.
 @item format=@var{format}
 Specify which disk @var{format} will be used rather than detecting
 the format.  Can be used to specify format=raw to avoid interpreting
@@ -2546,6 +2612,8 @@ DEF("chardev", HAS_ARG, QEMU_OPTION_chardev,
     "-chardev vc,id=id[[,width=width][,height=height]][[,cols=cols][,rows=rows]]\n"
     "         [,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
     "-chardev ringbuf,id=id[,size=size][,logfile=PATH][,logappend=on|off]\n"
+    "-chardev ringlog,id=id,path=path[,size=size][,timestamp=on|off]\n"
+    "         [,rotate-size=size][,append=on|off][,mux=on|off]\n"
     "-chardev file,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
     "-chardev pipe,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
 #ifdef _WIN32
@@ -2584,6 +2652,7 @@ Backend is one of:
 @option{msmouse},
 @option{vc},
 @option{ringbuf},
+@option{ringlog},
 @option{file},
 @option{pipe},
 @option{console},
@@ -2754,6 +2823,19 @@ console with the given dimensions.
 Create a ring buffer with fixed size @option{size}.
 @var{size} must be a power of two and defaults to @code{64K}.
 
+@item -chardev ringlog ,id=@var{id} ,path=@var{path} [,size=@var{size}] [,timestamp=on|off] [,rotate-size=@var{size}] [,append=on|off]
+
+Log all traffic received from the guest to a file, like @option{file}, but
+without ever making the guest wait for the file. Output goes into a ring of
+@option{size} bytes, a power of two defaulting to @code{1M}, and is written
+out by a separate thread. Output that does not fit into the ring is dropped
+and a note saying so is written to the log.
+
+@option{timestamp} prefixes each line with the time since the chardev was
+opened. Once the log reaches @option{rotate-size} bytes, it is renamed to
+@var{path}.1 and a new log is started. @option{append} appends to an
+existing log instead of truncating it.
+
 @item -chardev file ,id=@var{id} ,path=@var{path}
 
 Log all traffic received from the guest to a file.
@@ -3535,11 +3617,21 @@ Like -qmp but uses pretty JSON formatting.
 ETEXI
 
 DEF("mon", HAS_ARG, QEMU_OPTION_mon, \
-    "-mon [chardev=]name[,mode=readline|control]\n", QEMU_ARCH_ALL)
+    "-mon [chardev=]name[,mode=readline|control][,pretty=on|off][,oob=on|off]\n",
+    QEMU_ARCH_ALL)
 STEXI
-@item -mon [chardev=]name[,mode=readline|control]
+@item -mon [chardev=]name[,mode=readline|control][,pretty=on|off][,oob=on|off]
 @findex -mon
-Setup monitor on chardev @var{name}.
+Setup monitor on chardev @var{name}.  @option{pretty} turns on pretty JSON
+formatting for a control monitor.
+
+With @option{oob=on}, a control monitor reads its chardev in a thread of
+its own.  Commands that allow it, like @code{query-status},
+@code{query-cpus-fast}, @code{query-tb-stats} or @code{coverage-stop},
+then run out of band in that thread, without the big QEMU lock, and are
+answered even while the main loop or the vCPUs hold the lock for a long
+time.  Any other command is still run by the main loop, in order, so its
+response may come after the response of a later out-of-band command.
 ETEXI
 
 DEF("debugcon", HAS_ARG, QEMU_OPTION_debugcon, \
@@ -3811,11 +3903,13 @@ ETEXI
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
     "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>]\n" \
+    "        [,rrperiod=seconds][,quantum=ns]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
-    "                or disable real time cpu sleeping\n", QEMU_ARCH_ALL)
+    "                or disable real time cpu sleeping\n" \
+    "                quantum=ns keeps per-vCPU clocks synchronized every ns\n", QEMU_ARCH_ALL)
 STEXI
-@item -icount [shift=@var{N}|auto][,rr=record|replay,rrfile=@var{filename},rrsnapshot=@var{snapshot}]
+@item -icount [shift=@var{N}|auto][,rr=record|replay,rrfile=@var{filename},rrsnapshot=@var{snapshot},rrperiod=@var{seconds}]
 @findex -icount
 Enable virtual instruction counter.  The virtual cpu will execute one
 instruction every 2^@var{N} ns of virtual time.  If @code{auto} is specified
@@ -3852,6 +3946,19 @@ read from this file in replay mode.
 Option rrsnapshot is used to create new vm snapshot named @var{snapshot}
 at the start of execution recording. In replay mode this option is used
 to load the initial VM state.
+
+Option rrperiod takes a VM snapshot, a replay anchor, every @var{seconds}
+of host time while recording or replaying.  In replay mode the QMP command
+@code{replay-seek} loads the anchor nearest before a given instruction count.
+
+@option{quantum=@var{ns}} selects a cheaper mode where each vCPU keeps its
+own instruction based clock and they only meet every @var{ns} nanoseconds of
+virtual time, or earlier at the next timer deadline, e.g. a remote-port sync.
+Translated code does not have to end at I/O instructions and multi-threaded
+TCG stays available, so vCPUs run in parallel within a quantum. Devices see
+the time of the last boundary, a vCPU its own clock. Time spent halted is
+skipped, as with @option{sleep=off}. A numeric @option{shift} is required,
+@option{align} and @option{rr} are not supported.
 ETEXI
 
 DEF("watchdog", HAS_ARG, QEMU_OPTION_watchdog, \
@@ -4207,6 +4314,22 @@ STEXI
 prepend a timestamp to each log message.(default:on)
 ETEXI
 
+DEF("thread-pool", HAS_ARG, QEMU_OPTION_thread_pool,
+    "-thread-pool [max-threads=n][,cpus=first[-last]]\n"
+    "                configure the worker thread pools\n"
+    "                max-threads: maximum number of workers of each pool\n"
+    "                cpus: host CPUs the workers run on\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -thread-pool [max-threads=@var{n}][,cpus=@var{first}[-@var{last}]]
+@findex -thread-pool
+Configure the thread pools that the main loop and each iothread use for
+blocking work, like file I/O.  @option{max-threads} limits the number of
+workers of each pool (default: 64).  @option{cpus} pins the workers to the
+host CPUs @var{first} to @var{last}, so they stay off the CPUs of the vCPU
+threads.  CPU pinning is only supported on Linux hosts.
+ETEXI
+
 DEF("dump-vmstate", HAS_ARG, QEMU_OPTION_dump_vmstate,
     "-dump-vmstate <file>\n"
     "                Output vmstate information in JSON format to file.\n"
@@ -4248,7 +4371,7 @@ property must be set.  These objects are placed in the
 
 @table @option
 
-@item -object memory-backend-file,id=@var{id},size=@var{size},mem-path=@var{dir},share=@var{on|off},discard-data=@var{on|off}
+@item -object memory-backend-file,id=@var{id},size=@var{size},mem-path=@var{dir},share=@var{on|off},discard-data=@var{on|off},prealloc=@var{on|off},prealloc-threads=@var{n},prealloc-async=@var{on|off}
 
 Creates a memory file backend object, which can be used to back
 the guest RAM with huge pages. The @option{id} parameter is a
@@ -4266,6 +4389,13 @@ to avoid unnecessarily flushing data to the backing file.  Note
 that @option{discard-data} is only an optimization, and QEMU
 might not discard file contents if it aborts unexpectedly or is
 terminated using SIGKILL.
+Setting @option{prealloc} to @var{on} allocates all of the memory
+upfront, after it is bound to the @option{host-nodes}, by touching
+its pages from up to @option{prealloc-threads} threads (by default
+as many as there are vCPUs).  With @option{prealloc-async} set to
+@var{on} the pages are touched in the background while the rest of
+the machine is created, QEMU only waits for them before the guest
+starts.
 
 @item -object rng-random,id=@var{id},filename=@var{/dev/random}
 
@@ -4382,13 +4512,21 @@ colo secondary:
 -object filter-redirector,id=f2,netdev=hn0,queue=rx,outdev=red1
 -object filter-rewriter,id=rew0,netdev=hn0,queue=all
 
-@item -object filter-dump,id=@var{id},netdev=@var{dev}[,file=@var{filename}][,maxlen=@var{len}]
+@item -object filter-dump,id=@var{id},netdev=@var{dev}[,file=@var{filename}][,maxlen=@var{len}][,ring-size=@var{size}][,ring-file=@var{ringfile}][,ethertype=@var{type}][,ip-proto=@var{proto}]
 
 Dump the network traffic on netdev @var{dev} to the file specified by
 @var{filename}. At most @var{len} bytes (64k by default) per packet are stored.
 The file format is libpcap, so it can be analyzed with tools such as tcpdump
 or Wireshark.
 
+With @option{ring-size}, packets are copied into a ring of @var{size} bytes
+and written to the file by a separate thread; packets that find the ring
+full are dropped. @option{ring-file} backs the ring with a shared mapping of
+@var{ringfile}, so live analysis tools can follow the pcap records as they
+arrive. @option{ethertype} and @option{ip-proto} only capture frames of
+the given ethertype (the inner one for VLAN tagged frames) or IPv4/IPv6
+protocol.
+
 @item -object colo-compare,id=@var{id},primary_in=@var{chardevid},secondary_in=@var{chardevid},outdev=@var{chardevid}[,vnet_hdr_support]
 
 Colo-compare gets packet from primary_in@var{chardevid} and secondary_in@var{chardevid}, than compare primary packet with
@@ -37,6 +37,7 @@
 #include "qom/object_interfaces.h"
 #include "hw/mem/pc-dimm.h"
 #include "hw/acpi/acpi_dev_interface.h"
+#include "qemu/rcu.h"
 
 NameInfo *qmp_query_name(Error **errp)
 {
@@ -722,3 +723,42 @@ MemoryInfo *qmp_query_memory_size_summary(Error **errp)
 
     return mem_info;
 }
+
+RcuInfo *qmp_query_rcu(Error **errp)
+{
+    RcuInfo *info = g_new0(RcuInfo, 1);
+    unsigned int min_batch, max_latency;
+    RCUStats stats;
+
+    rcu_get_batching(&min_batch, &max_latency);
+    rcu_get_stats(&stats);
+    info->min_batch = min_batch;
+    info->max_latency = max_latency;
+    info->callbacks = stats.callbacks;
+    info->callbacks_per_sec = stats.callbacks_per_sec;
+    info->batches = stats.batches;
+    info->grace_periods = stats.grace_periods;
+    info->grace_period_ns = stats.grace_period_ns;
+    info->max_grace_period_ns = stats.max_grace_period_ns;
+    return info;
+}
+
+void qmp_rcu_set_batching(bool has_min_batch, uint32_t min_batch,
+                          bool has_max_latency, uint32_t max_latency,
+                          Error **errp)
+{
+    unsigned int cur_batch, cur_latency;
+
+    rcu_get_batching(&cur_batch, &cur_latency);
+    if (!has_min_batch) {
+        min_batch = cur_batch;
+    }
+    if (!has_max_latency) {
+        max_latency = cur_latency;
+    }
+    if (!min_batch) {
+        error_setg(errp, "min-batch must be at least 1");
+        return;
+    }
+    rcu_set_batching(min_batch, max_latency);
+}
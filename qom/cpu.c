@@ -442,6 +442,9 @@ static void cpu_common_initfn(Object *obj)
 
 static void cpu_common_finalize(Object *obj)
 {
+    CPUState *cpu = CPU(obj);
+
+    g_free(cpu->host_cpus);
 }
 
 static int64_t cpu_common_get_arch_id(CPUState *cpu)
@@ -40,6 +40,11 @@ static DeviceState *irq_intercept_dev;
 static FILE *qtest_log_fp;
 static CharBackend qtest_chr;
 static GString *inbuf;
+/* Replies are gathered while a chunk of input is processed */
+static GString *outbuf;
+static bool qtest_buffering;
+/* ID of the request being processed, tagged onto its reply */
+static const char *qtest_cmd_id;
 static int irq_levels[MAX_IRQ];
 static qemu_timeval start_time;
 static bool qtest_opened;
@@ -146,6 +151,40 @@ static bool qtest_opened;
  * B64_DATA is an arbitrarily long base64 encoded string.
  * If the sizes do not match, the data will be truncated.
  *
+ * Binary transfers:
+ *
+ *  > binread ADDR SIZE
+ *  < OK SIZE
+ *  < RAW_DATA
+ *
+ *  > binwrite ADDR SIZE
+ *  > RAW_DATA
+ *  < OK
+ *
+ * RAW_DATA is exactly SIZE bytes of memory, sent as is right after the
+ * newline that ends the command (resp. the reply).
+ *
+ * Requests and batches:
+ *
+ * Clients may send requests without waiting for the replies of the previous
+ * ones.  Requests are still processed in order.  A request may start with
+ * an ID word of the form "#ID", its reply is then sent as "#ID " followed by
+ * the usual reply:
+ *
+ *  > #42 readl ADDR
+ *  < #42 OK VALUE
+ *
+ *  > batch COUNT
+ *  > COMMAND
+ *  > ...
+ *  < REPLY
+ *  < ...
+ *  < OK
+ *
+ * Runs the COUNT commands that follow back to back, once all of them have
+ * been received, so that nothing else, e.g. timers, runs in between.  Each
+ * command sends its own reply, the batch ends with its own OK.
+ *
  * IRQ management:
  *
  *  > irq_intercept_in QOM-PATH
@@ -218,11 +257,34 @@ static void GCC_FMT_ATTR(1, 2) qtest_log_send(const char *fmt, ...)
     va_end(ap);
 }
 
+static void qtest_write(CharBackend *chr, const void *buf, size_t len)
+{
+    if (qtest_buffering) {
+        g_string_append_len(outbuf, buf, len);
+    } else {
+        qemu_chr_fe_write_all(chr, buf, len);
+    }
+}
+
+static void qtest_flush(CharBackend *chr)
+{
+    qtest_buffering = false;
+    if (outbuf->len) {
+        qemu_chr_fe_write_all(chr, (uint8_t *)outbuf->str, outbuf->len);
+        g_string_truncate(outbuf, 0);
+    }
+}
+
 static void do_qtest_send(CharBackend *chr, const char *str, size_t len)
 {
-    qemu_chr_fe_write_all(chr, (uint8_t *)str, len);
+    if (qtest_cmd_id) {
+        qtest_write(chr, qtest_cmd_id, strlen(qtest_cmd_id));
+        qtest_write(chr, " ", 1);
+    }
+    qtest_write(chr, str, len);
     if (qtest_log_fp && qtest_opened) {
-        fprintf(qtest_log_fp, "%s", str);
+        fprintf(qtest_log_fp, "%s%s%s", qtest_cmd_id ? qtest_cmd_id : "",
+                qtest_cmd_id ? " " : "", str);
     }
 }
 
@@ -251,10 +313,15 @@ static void qtest_irq_handler(void *opaque, int n, int level)
 
     if (irq_levels[n] != level) {
         CharBackend *chr = &qtest_chr;
+        const char *id = qtest_cmd_id;
+
+        /* Async messages belong to no request */
+        qtest_cmd_id = NULL;
         irq_levels[n] = level;
         qtest_send_prefix(chr);
         qtest_sendf(chr, "IRQ %s %d\n",
                     level ? "raise" : "lower", n);
+        qtest_cmd_id = id;
     }
 }
 
@@ -480,6 +547,23 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
 
         g_free(data);
         g_free(b64_data);
+    } else if (strcmp(words[0], "binread") == 0) {
+        uint64_t addr, len;
+        uint8_t *data;
+        int ret;
+
+        g_assert(words[1] && words[2]);
+        ret = qemu_strtou64(words[1], NULL, 0, &addr);
+        g_assert(ret == 0);
+        ret = qemu_strtou64(words[2], NULL, 0, &len);
+        g_assert(ret == 0);
+
+        data = g_malloc(len);
+        cpu_physical_memory_read(addr, data, len);
+        qtest_send_prefix(chr);
+        qtest_sendf(chr, "OK %" PRIu64 "\n", len);
+        qtest_write(chr, data, len);
+        g_free(data);
     } else if (strcmp(words[0], "write") == 0) {
         uint64_t addr, len, i;
         uint8_t *data;
@@ -622,26 +706,120 @@ static void qtest_process_command(CharBackend *chr, gchar **words)
     }
 }
 
-static void qtest_process_inbuf(CharBackend *chr, GString *inbuf)
+/* Split the line at @buf into words, *@line_len is set to its length
+ * including the newline.  Returns NULL if the line isn't complete yet.
+ */
+static gchar **qtest_split_line(const char *buf, size_t len, size_t *line_len)
 {
-    char *end;
+    const char *end = memchr(buf, '\n', len);
+    gchar *line;
+    gchar **words;
 
-    while ((end = strchr(inbuf->str, '\n')) != NULL) {
-        size_t offset;
-        GString *cmd;
-        gchar **words;
+    if (!end) {
+        return NULL;
+    }
+    *line_len = end - buf + 1;
+    line = g_strndup(buf, end - buf);
+    words = g_strsplit(line, " ", 0);
+    g_free(line);
+    return words;
+}
+
+/* Skip the request ID of @words, if any.  */
+static gchar **qtest_command_words(gchar **words)
+{
+    return words[0] && words[0][0] == '#' ? words + 1 : words;
+}
+
+/* Size of the command at @buf, with its payload or the commands it batches,
+ * 0 if it hasn't been received in full yet.
+ */
+static size_t qtest_command_size(const char *buf, size_t len)
+{
+    gchar **line, **words;
+    size_t size, n;
+    uint64_t count, i;
+
+    line = qtest_split_line(buf, len, &size);
+    if (!line) {
+        return 0;
+    }
+    words = qtest_command_words(line);
+
+    if (words[0] && words[1] && words[2] &&
+        strcmp(words[0], "binwrite") == 0) {
+        if (qemu_strtou64(words[2], NULL, 0, &count) == 0) {
+            size = len - size < count ? 0 : size + count;
+        }
+    } else if (words[0] && words[1] && strcmp(words[0], "batch") == 0) {
+        if (qemu_strtou64(words[1], NULL, 0, &count) == 0) {
+            for (i = 0; i < count && size; i++) {
+                n = qtest_command_size(buf + size, len - size);
+                size = n ? size + n : 0;
+            }
+        }
+    }
+    g_strfreev(line);
+    return size;
+}
+
+/* Run the command at @buf, which qtest_command_size() found complete.  */
+static void qtest_execute(CharBackend *chr, const char *buf, size_t len)
+{
+    gchar **line, **words;
+    size_t size;
+    uint64_t addr, count, i;
+    int ret;
+
+    line = qtest_split_line(buf, len, &size);
+    words = qtest_command_words(line);
+    qtest_cmd_id = words != line ? line[0] : NULL;
 
-        offset = end - inbuf->str;
+    if (words[0] && strcmp(words[0], "binwrite") == 0) {
+        g_assert(words[1] && words[2]);
+        ret = qemu_strtou64(words[1], NULL, 0, &addr);
+        g_assert(ret == 0);
+        ret = qemu_strtou64(words[2], NULL, 0, &count);
+        g_assert(ret == 0);
+
+        cpu_physical_memory_write(addr, buf + size, count);
+        qtest_send_prefix(chr);
+        qtest_send(chr, "OK\n");
+    } else if (words[0] && strcmp(words[0], "batch") == 0) {
+        const char *id = qtest_cmd_id;
+
+        g_assert(words[1]);
+        ret = qemu_strtou64(words[1], NULL, 0, &count);
+        g_assert(ret == 0);
 
-        cmd = g_string_new_len(inbuf->str, offset);
-        g_string_erase(inbuf, 0, offset + 1);
+        for (i = 0; i < count; i++) {
+            size_t n = qtest_command_size(buf + size, len - size);
 
-        words = g_strsplit(cmd->str, " ", 0);
+            qtest_execute(chr, buf + size, n);
+            size += n;
+        }
+        qtest_cmd_id = id;
+        qtest_send_prefix(chr);
+        qtest_send(chr, "OK\n");
+    } else {
         qtest_process_command(chr, words);
-        g_strfreev(words);
+    }
+    qtest_cmd_id = NULL;
+    g_strfreev(line);
+}
+
+static void qtest_process_inbuf(CharBackend *chr, GString *inbuf)
+{
+    size_t pos = 0, size;
 
-        g_string_free(cmd, TRUE);
+    /* One write for all the replies to what came in at once */
+    qtest_buffering = true;
+    while ((size = qtest_command_size(inbuf->str + pos, inbuf->len - pos))) {
+        qtest_execute(chr, inbuf->str + pos, size);
+        pos += size;
     }
+    g_string_erase(inbuf, 0, pos);
+    qtest_flush(chr);
 }
 
 static void qtest_read(void *opaque, const uint8_t *buf, int size)
@@ -654,7 +832,7 @@ static void qtest_read(void *opaque, const uint8_t *buf, int size)
 
 static int qtest_can_read(void *opaque)
 {
-    return 1024;
+    return 64 * 1024;
 }
 
 static void qtest_event(void *opaque, int event)
@@ -729,6 +907,7 @@ void qtest_init(const char *qtest_chrdev, const char *qtest_log, Error **errp)
     qemu_chr_fe_set_echo(&qtest_chr, true);
 
     inbuf = g_string_new("");
+    outbuf = g_string_new("");
 }
 
 bool qtest_driver(void)
@@ -14,6 +14,7 @@
 #include "sysemu/replay.h"
 #include "replay-internal.h"
 #include "qemu/error-report.h"
+#include "qemu/bswap.h"
 #include "sysemu/sysemu.h"
 
 /* Mutex to protect reading and writing events to the log.
@@ -40,22 +41,35 @@ void replay_put_event(uint8_t event)
 }
 
 
+static void replay_put_bytes(const void *buf, size_t size)
+{
+    if (replay_file) {
+        fwrite(buf, 1, size, replay_file);
+    }
+}
+
 void replay_put_word(uint16_t word)
 {
-    replay_put_byte(word >> 8);
-    replay_put_byte(word);
+    uint8_t buf[2];
+
+    stw_be_p(buf, word);
+    replay_put_bytes(buf, sizeof(buf));
 }
 
 void replay_put_dword(uint32_t dword)
 {
-    replay_put_word(dword >> 16);
-    replay_put_word(dword);
+    uint8_t buf[4];
+
+    stl_be_p(buf, dword);
+    replay_put_bytes(buf, sizeof(buf));
 }
 
 void replay_put_qword(int64_t qword)
 {
-    replay_put_dword(qword >> 32);
-    replay_put_dword(qword);
+    uint8_t buf[8];
+
+    stq_be_p(buf, qword);
+    replay_put_bytes(buf, sizeof(buf));
 }
 
 void replay_put_array(const uint8_t *buf, size_t size)
@@ -75,37 +89,39 @@ uint8_t replay_get_byte(void)
     return byte;
 }
 
-uint16_t replay_get_word(void)
+/* Short reads at the end of the log read as 0xff bytes, like getc() */
+static void replay_get_bytes(void *buf, size_t size)
 {
-    uint16_t word = 0;
+    size_t n = 0;
+
     if (replay_file) {
-        word = replay_get_byte();
-        word = (word << 8) + replay_get_byte();
+        n = fread(buf, 1, size, replay_file);
     }
+    memset((uint8_t *)buf + n, replay_file ? 0xff : 0, size - n);
+}
+
+uint16_t replay_get_word(void)
+{
+    uint8_t buf[2];
 
-    return word;
+    replay_get_bytes(buf, sizeof(buf));
+    return lduw_be_p(buf);
 }
 
 uint32_t replay_get_dword(void)
 {
-    uint32_t dword = 0;
-    if (replay_file) {
-        dword = replay_get_word();
-        dword = (dword << 16) + replay_get_word();
-    }
+    uint8_t buf[4];
 
-    return dword;
+    replay_get_bytes(buf, sizeof(buf));
+    return ldl_be_p(buf);
 }
 
 int64_t replay_get_qword(void)
 {
-    int64_t qword = 0;
-    if (replay_file) {
-        qword = replay_get_dword();
-        qword = (qword << 32) + replay_get_dword();
-    }
+    uint8_t buf[8];
 
-    return qword;
+    replay_get_bytes(buf, sizeof(buf));
+    return ldq_be_p(buf);
 }
 
 void replay_get_array(uint8_t *buf, size_t *size)
@@ -84,6 +84,9 @@ extern ReplayState replay_state;
 /* File for replay writing */
 extern FILE *replay_file;
 
+/* Seconds of host time between replay anchors, 0 for none */
+extern int64_t replay_anchor_period;
+
 void replay_put_byte(uint8_t byte);
 void replay_put_event(uint8_t event);
 void replay_put_word(uint16_t word);
@@ -182,5 +185,7 @@ void *replay_event_net_load(void);
    Should be called before virtual devices initialization
    to make cached timers available for post_load functions. */
 void replay_vmstate_register(void);
+/* Starts taking replay anchors if an anchor period is set. */
+void replay_anchors_start(void);
 
 #endif
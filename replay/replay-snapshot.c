@@ -20,10 +20,27 @@
 #include "qemu/error-report.h"
 #include "migration/vmstate.h"
 #include "migration/snapshot.h"
+#include "block/snapshot.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+#include "qmp-commands.h"
+
+/* Anchors are VM snapshots named after the replay step they were taken at */
+#define REPLAY_ANCHOR_PREFIX "replay-anchor-"
+
+/* Seconds of host time between anchors, 0 for none */
+int64_t replay_anchor_period;
+static QEMUTimer *replay_anchor_timer;
 
 static int replay_pre_save(void *opaque)
 {
     ReplayState *state = opaque;
+
+    /* The log must account for every instruction run before the snapshot,
+       replay resumes with the CPU state of that moment. */
+    if (replay_mode == REPLAY_MODE_RECORD) {
+        replay_save_instructions();
+    }
     state->file_offset = ftell(replay_file);
 
     return 0;
@@ -83,3 +100,112 @@ void replay_vmstate_init(void)
         }
     }
 }
+
+static void replay_anchor_save(void *opaque)
+{
+    Error *err = NULL;
+    char *name;
+
+    if (runstate_is_running()) {
+        name = g_strdup_printf(REPLAY_ANCHOR_PREFIX "%" PRIu64,
+                               replay_get_current_step());
+        if (save_snapshot(name, &err) != 0) {
+            error_report_err(err);
+            error_report("Could not create replay anchor, giving up on them");
+            g_free(name);
+            return;
+        }
+        g_free(name);
+    }
+    timer_mod(replay_anchor_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                                   replay_anchor_period * 1000);
+}
+
+void replay_anchors_start(void)
+{
+    if (!replay_anchor_period) {
+        return;
+    }
+    replay_anchor_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                       replay_anchor_save, NULL);
+    timer_mod(replay_anchor_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                                   replay_anchor_period * 1000);
+}
+
+/* Find the anchor taken last at or before @icount.  The initial snapshot,
+ * if any, is the anchor of step 0.
+ */
+static char *replay_find_anchor(int64_t icount, Error **errp)
+{
+    BlockDriverState *bs;
+    AioContext *aio_context;
+    QEMUSnapshotInfo *sn_tab;
+    char *name = NULL;
+    uint64_t best = 0, step;
+    const char *p;
+    int i, nb_sns;
+
+    bs = bdrv_all_find_vmstate_bs();
+    if (!bs) {
+        error_setg(errp, "No block device supports snapshots");
+        return NULL;
+    }
+    aio_context = bdrv_get_aio_context(bs);
+
+    aio_context_acquire(aio_context);
+    nb_sns = bdrv_snapshot_list(bs, &sn_tab);
+    aio_context_release(aio_context);
+    if (nb_sns < 0) {
+        error_setg_errno(errp, -nb_sns, "Could not list snapshots");
+        return NULL;
+    }
+
+    for (i = 0; i < nb_sns; i++) {
+        if (!strstart(sn_tab[i].name, REPLAY_ANCHOR_PREFIX, &p) ||
+            qemu_strtou64(p, NULL, 10, &step) < 0 || step > icount) {
+            continue;
+        }
+        if (!name || step > best) {
+            g_free(name);
+            name = g_strdup(sn_tab[i].name);
+            best = step;
+        }
+    }
+    g_free(sn_tab);
+
+    if (!name && replay_snapshot) {
+        name = g_strdup(replay_snapshot);
+    }
+    if (!name) {
+        error_setg(errp, "No replay anchor at or before icount %" PRId64,
+                   icount);
+    }
+    return name;
+}
+
+void qmp_replay_seek(int64_t icount, Error **errp)
+{
+    int saved_vm_running;
+    char *name;
+
+    if (replay_mode != REPLAY_MODE_PLAY) {
+        error_setg(errp, "replay-seek is only available while replaying");
+        return;
+    }
+    if (icount < 0) {
+        error_setg(errp, "icount must not be negative");
+        return;
+    }
+
+    name = replay_find_anchor(icount, errp);
+    if (!name) {
+        return;
+    }
+
+    saved_vm_running = runstate_is_running();
+    vm_stop(RUN_STATE_RESTORE_VM);
+    if (load_snapshot(name, errp) == 0 && saved_vm_running) {
+        vm_start();
+    }
+    g_free(name);
+}
@@ -25,6 +25,8 @@
 #define REPLAY_VERSION              0xe02006
 /* Size of replay log header */
 #define HEADER_SIZE                 (sizeof(uint32_t) + sizeof(uint64_t))
+/* Events are small, let them pile up before they hit the file */
+#define REPLAY_BUFFER_SIZE          (1 << 20)
 
 ReplayMode replay_mode = REPLAY_MODE_NONE;
 char *replay_snapshot;
@@ -240,6 +242,7 @@ static void replay_enable(const char *fname, int mode)
         fprintf(stderr, "Replay: open %s: %s\n", fname, strerror(errno));
         exit(1);
     }
+    setvbuf(replay_file, NULL, _IOFBF, REPLAY_BUFFER_SIZE);
 
     replay_filename = g_strdup(fname);
 
@@ -300,6 +303,7 @@ void replay_configure(QemuOpts *opts)
     }
 
     replay_snapshot = g_strdup(qemu_opt_get(opts, "rrsnapshot"));
+    replay_anchor_period = qemu_opt_get_number(opts, "rrperiod", 0);
     replay_vmstate_register();
     replay_enable(fname, mode);
 
@@ -322,7 +326,7 @@ void replay_start(void)
         exit(1);
     }
 
-    /* Timer for snapshotting will be set up here. */
+    replay_anchors_start();
 
     replay_enable_events();
 }
@@ -0,0 +1,165 @@
+#!/usr/bin/env python
+#
+# Merge and pretty-print perthread trace backend files
+#
+# Copyright (c) 2018 Xilinx Inc.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# For help see docs/devel/tracing.txt
+
+from __future__ import print_function
+import heapq
+import struct
+import sys
+from tracetool import read_events
+from tracetool.backend.simple import is_string
+
+header_magic = 0x5054545241434531
+header_version = 1
+
+chunk_type_mapping = 0
+chunk_type_events = 1
+
+file_header_fmt = '=QII'
+chunk_header_fmt = '=IIQQII'
+event_header_fmt = '=QII'
+
+def read_struct(fobj, fmt):
+    '''Read one struct, None at the end of the file'''
+    size = struct.calcsize(fmt)
+    buf = fobj.read(size)
+    if len(buf) != size:
+        return None
+    return struct.unpack(fmt, buf)
+
+def parse_args(event, buf):
+    '''Decode the arguments of one record'''
+    args = []
+    off = 0
+    for type_, name in event.args:
+        if is_string(type_):
+            (slen,) = struct.unpack_from('=I', buf, off)
+            args.append(buf[off + 4:off + 4 + slen])
+            off += 4 + slen
+        else:
+            (val,) = struct.unpack_from('=Q', buf, off)
+            args.append(val)
+            off += 8
+    return args
+
+def parse_events(chunk, tid):
+    '''Yield (ticks, tid, event id, raw arguments) from an events chunk'''
+    size = struct.calcsize(event_header_fmt)
+    off = 0
+    while off + size <= len(chunk):
+        ticks, event_id, arglen = struct.unpack_from(event_header_fmt,
+                                                     chunk, off)
+        off += size
+        yield (ticks, tid, event_id, chunk[off:off + arglen])
+        off += arglen
+
+def read_trace(fobj):
+    '''Read a trace file.
+
+    Returns the event names by ID, the records of every thread by thread
+    ID, in the order the thread recorded them, and the (ticks, ns) clock
+    samples of the file.  Dropped events are reported with an ID of None and
+    the count as argument.
+    '''
+    header = read_struct(fobj, file_header_fmt)
+    if header is None or header[0] != header_magic:
+        raise ValueError('Not a valid perthread trace file!')
+    if header[1] != header_version:
+        raise ValueError('Trace format %d not supported with this QEMU '
+                         'release!' % header[1])
+
+    idtoname = {}
+    threads = {}
+    clock = []
+    while True:
+        chunk = read_struct(fobj, chunk_header_fmt)
+        if chunk is None:
+            break
+        ctype, tid, ticks, ns, length, dropped = chunk
+        data = fobj.read(length)
+        clock.append((ticks, ns))
+        if ctype == chunk_type_mapping:
+            off = 0
+            while off < len(data):
+                event_id, nlen = struct.unpack_from('=II', data, off)
+                name = data[off + 8:off + 8 + nlen].decode('ascii')
+                idtoname[event_id] = name
+                off += 8 + nlen
+        elif ctype == chunk_type_events:
+            recs = threads.setdefault(tid, [])
+            recs.extend(parse_events(data, tid))
+            if dropped:
+                recs.append((ticks, tid, None, dropped))
+    return idtoname, threads, sorted(clock)
+
+def ticks_to_ns(clock):
+    '''Linear conversion from host ticks to host ns, None if unknown'''
+    if len(clock) < 2 or clock[-1][0] == clock[0][0]:
+        return None
+    t0, n0 = clock[0]
+    rate = float(clock[-1][1] - n0) / (clock[-1][0] - t0)
+    return lambda ticks: n0 + (ticks - t0) * rate
+
+def main():
+    if len(sys.argv) < 3:
+        sys.stderr.write('usage: %s <trace-events> <trace-file>...\n' %
+                         sys.argv[0])
+        sys.exit(1)
+
+    edict = {}
+    for event in read_events(open(sys.argv[1], 'r')):
+        edict[event.name] = event
+
+    # Files of several processes share the host cycle counter, so they
+    # merge just as the threads of one file do.
+    streams = []
+    clock = []
+    for path in sys.argv[2:]:
+        idtoname, threads, file_clock = read_trace(open(path, 'rb'))
+        clock.extend(file_clock)
+        for recs in threads.values():
+            # The index keeps records of equal ticks in recording order
+            streams.append([(r[0], r[1], i,
+                             idtoname.get(r[2], '#%d' % r[2])
+                             if r[2] is not None else None, r[3])
+                            for i, r in enumerate(recs)])
+    to_ns = ticks_to_ns(sorted(clock))
+
+    last = None
+    for ticks, tid, _, name, args in heapq.merge(*streams):
+        stamp = to_ns(ticks) if to_ns else ticks
+        delta = stamp - last if last is not None else 0
+        last = stamp
+        if to_ns:
+            fields = ['%0.3f' % (delta / 1000.0)]
+        else:
+            fields = ['+%d' % delta]
+        if name is None:
+            fields[:0] = ['dropped']
+            fields += ['tid=%d' % tid, 'num_events_dropped=%d' % args]
+        elif name not in edict:
+            sys.stderr.write('%s event is logged but is not declared in the '
+                             'trace events file, try using trace-events-all '
+                             'instead.\n' % name)
+            sys.exit(1)
+        else:
+            event = edict[name]
+            fields[:0] = [name]
+            fields.append('tid=%d' % tid)
+            for (type_, arg), val in zip(event.args, parse_args(event, args)):
+                if is_string(type_):
+                    fields.append('%s=%s' % (arg, val.decode('ascii',
+                                                             'replace')))
+                else:
+                    fields.append('%s=0x%x' % (arg, val))
+        print(' '.join(fields))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+"""
+Per-thread binary backend.
+"""
+
+__copyright__  = "Copyright (c) 2018 Xilinx Inc."
+__license__    = "GPL version 2 or (at your option) any later version"
+
+
+from tracetool import out
+from tracetool.backend.simple import is_string
+
+
+PUBLIC = True
+
+
+def generate_h_begin(events, group):
+    for event in events:
+        out('void _perthread_%(api)s(%(args)s);',
+            api=event.api(),
+            args=event.args)
+    out('')
+
+
+def generate_h(event, group):
+    out('    _perthread_%(api)s(%(args)s);',
+        api=event.api(),
+        args=", ".join(event.args.names()))
+
+
+def generate_h_backend_dstate(event, group):
+    out('    trace_event_get_state_dynamic_by_id(%(event_id)s) || \\',
+        event_id="TRACE_" + event.name.upper())
+
+
+def generate_c_begin(events, group):
+    out('#include "qemu/osdep.h"',
+        '#include "trace/control.h"',
+        '#include "trace/perthread.h"',
+        '')
+
+
+def generate_c(event, group):
+    out('void _perthread_%(api)s(%(args)s)',
+        '{',
+        '    PtRecord rec;',
+        api=event.api(),
+        args=event.args)
+    sizes = []
+    for type_, name in event.args:
+        if is_string(type_):
+            out('    size_t arg%(name)s_len = %(name)s ? MIN(strlen(%(name)s), PT_MAX_STRLEN) : 0;',
+                name=name)
+            sizes.append("4 + arg%s_len" % name)
+        else:
+            sizes.append("8")
+    sizestr = " + ".join(sizes)
+    if len(event.args) == 0:
+        sizestr = '0'
+
+    # The first scalar argument is what gets mirrored into etrace
+    hookval = '0'
+    for type_, name in event.args:
+        if not is_string(type_):
+            if type_.endswith('*'):
+                hookval = '(uintptr_t)%s' % name
+            else:
+                hookval = '(uint64_t)%s' % name
+            break
+
+    event_id = 'TRACE_' + event.name.upper()
+    if "vcpu" in event.properties:
+        # already checked on the generic format code
+        cond = "true"
+    else:
+        cond = "trace_event_get_state(%s)" % event_id
+
+    out('',
+        '    if (!%(cond)s) {',
+        '        return;',
+        '    }',
+        '',
+        '    pt_event_notify("%(name)s", %(hookval)s);',
+        '    if (pt_record_start(&rec, %(event_obj)s.id, %(size_str)s)) {',
+        '        return; /* Ring full, event dropped ! */',
+        '    }',
+        cond=cond,
+        name=event.name,
+        hookval=hookval,
+        event_obj=event.api(event.QEMU_EVENT),
+        size_str=sizestr)
+
+    for type_, name in event.args:
+        if is_string(type_):
+            out('    pt_record_write_str(&rec, %(name)s, arg%(name)s_len);',
+                name=name)
+        elif type_.endswith('*'):
+            out('    pt_record_write_u64(&rec, (uintptr_t)(uint64_t *)%(name)s);',
+                name=name)
+        else:
+            out('    pt_record_write_u64(&rec, (uint64_t)%(name)s);',
+                name=name)
+
+    out('    pt_record_finish(&rec);',
+        '}',
+        '')
@@ -60,8 +60,10 @@ BlockAIOCB *pr_manager_execute(PRManager *pr_mgr,
 
     /* The matching object_unref is in pr_manager_worker.  */
     object_ref(OBJECT(pr_mgr));
-    return thread_pool_submit_aio(pool, pr_manager_worker,
-                                  data, complete, opaque);
+    /* The guest waits on reservations, don't queue them behind I/O.  */
+    return thread_pool_submit_aio_prio(pool, THREAD_POOL_PRIORITY_HIGH,
+                                       pr_manager_worker, data,
+                                       complete, opaque);
 }
 
 static const TypeInfo pr_manager_info = {
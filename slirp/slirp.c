@@ -746,7 +746,14 @@ void slirp_pollfds_poll(GArray *pollfds, int select_error)
 
                 if (so->s != -1 &&
                     (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR))) {
-                    sorecvfrom(so);
+                    /* ICMP sockets are gone after their one reply */
+                    bool udp = so->so_type != IPPROTO_ICMP;
+                    int i = 0;
+
+                    do {
+                        sorecvfrom(so);
+                    } while (udp && ++i < SO_RECV_BATCH && so->s != -1 &&
+                             sodgrampending(so));
                 }
             }
 
@@ -653,6 +653,25 @@ sorecvfrom(struct socket *so)
 	} /* if ping packet */
 }
 
+/*
+ * Is another datagram queued up on so? Lets the poll loop drain a batch
+ * without blocking on the socket.
+ */
+int
+sodgrampending(struct socket *so)
+{
+#ifdef _WIN32
+	unsigned long n = 0;
+#else
+	int n = 0;
+#endif
+
+	if (ioctlsocket(so->s, FIONREAD, &n) < 0) {
+		return 0;
+	}
+	return n > 0;
+}
+
 /*
  * sendto() a socket
  */
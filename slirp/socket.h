@@ -11,6 +11,9 @@
 #define SO_EXPIRE 240000
 #define SO_EXPIREFAST 10000
 
+/* Datagrams taken from a UDP socket per poll at most */
+#define SO_RECV_BATCH 16
+
 /*
  * Our socket structure
  */
@@ -141,6 +144,7 @@ int sorecvoob(struct socket *);
 int sosendoob(struct socket *);
 int sowrite(struct socket *);
 void sorecvfrom(struct socket *);
+int sodgrampending(struct socket *);
 int sosendto(struct socket *, struct mbuf *);
 struct socket * tcp_listen(Slirp *, uint32_t, u_int, uint32_t, u_int,
                                int);
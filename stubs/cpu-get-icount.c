@@ -5,6 +5,7 @@
 #include "qemu/main-loop.h"
 
 int use_icount;
+bool use_icount_quantum;
 
 int64_t cpu_get_icount(void)
 {
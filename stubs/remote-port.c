@@ -0,0 +1,13 @@
+/*
+ * Remote-port stubs
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qmp-commands.h"
+
+RemotePortInfoList *qmp_query_remote_port(Error **errp)
+{
+    return NULL;
+}
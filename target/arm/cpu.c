@@ -332,6 +332,7 @@ static void arm_cpu_reset(CPUState *s)
         }
         env->pmsav7.rnr[M_REG_NS] = 0;
         env->pmsav7.rnr[M_REG_S] = 0;
+        env->pmsav7.map_dirty = true;
         env->pmsav8.mair0[M_REG_NS] = 0;
         env->pmsav8.mair0[M_REG_S] = 0;
         env->pmsav8.mair1[M_REG_NS] = 0;
@@ -929,6 +930,7 @@ static void arm_cpu_realizefn(DeviceState *dev, Error **errp)
     Error *local_err = NULL;
 #ifndef CONFIG_USER_ONLY
     AddressSpace *as;
+    int i;
 #endif
 
     cpu_exec_realizefn(cs, &local_err);
@@ -1111,6 +1113,7 @@ static void arm_cpu_realizefn(DeviceState *dev, Error **errp)
                 env->pmsav7.drbar = g_new0(uint32_t, nr);
                 env->pmsav7.drsr = g_new0(uint32_t, nr);
                 env->pmsav7.dracr = g_new0(uint32_t, nr);
+                env->pmsav7.map = g_new0(ARMPMSAv7Region, nr);
             }
         }
     }
@@ -1153,6 +1156,9 @@ static void arm_cpu_realizefn(DeviceState *dev, Error **errp)
                                                1, arm_gt_htimer_cb, cpu);
         cpu->gt_timer[GTIMER_SEC] = timer_new(QEMU_CLOCK_VIRTUAL,
                                                1, arm_gt_stimer_cb, cpu);
+        for (i = 0; i < NUM_GTIMERS; i++) {
+            qdev_pm_add_timer(dev, cpu->gt_timer[i]);
+        }
     }
 #endif
     register_cp_regs_for_features(cpu);
@@ -2022,9 +2028,24 @@ static void arm_cpu_pwr_cntrl(void *opaque, int n, int level)
 {
     DeviceClass *dc_parent = DEVICE_CLASS(ARM_CPU_PARENT_CLASS);
     ARMCPU *cpu = ARM_CPU(opaque);
+#ifndef CONFIG_USER_ONLY
+    CPUState *cs = CPU(opaque);
+    bool was_gated = cs->power_gated;
+#endif
 
     cpu->power_state = level ? PSCI_ON : PSCI_OFF;
     dc_parent->pwr_cntrl(opaque, n, level);
+
+#ifndef CONFIG_USER_ONLY
+    /* A gated core stays halted, and its generic timers are suspended by
+     * the device power state, until its domain is powered up again.
+     */
+    cs->power_gated = !level;
+    cpu_halt_update(cs);
+    if (was_gated && !cs->power_gated) {
+        cpu_interrupt(cs, CPU_INTERRUPT_EXITTB);
+    }
+#endif
 }
 
 #ifdef CONFIG_USER_ONLY
@@ -158,6 +158,33 @@ typedef struct {
     uint32_t base_mask;
 } TCR;
 
+/* A decoded, enabled PMSAv7 MPU region (see pmsav7.map).  */
+typedef struct ARMPMSAv7Region {
+    uint32_t base;
+    uint32_t rmask;
+    uint8_t rsize;
+    uint8_t n;
+} ARMPMSAv7Region;
+
+#define ARM_PTW_CACHE_SIZE 64
+
+/* One remembered step of an LPAE table walk: the base of the next level
+ * table for every VA sharing vaprefix, valid while the translation
+ * registers match and no TLB flush has happened since (see tlb_flush_gen).
+ */
+typedef struct ARMPTWCacheEntry {
+    uint64_t ttbr;
+    uint64_t tcr;
+    uint64_t vaprefix;
+    uint64_t descaddr;
+    uint32_t gen;
+    uint32_t tableattrs;
+    uint16_t mmu_idx;
+    uint8_t level;
+    uint8_t ttbr_select;
+    bool valid;
+} ARMPTWCacheEntry;
+
 typedef struct CPUARMState {
     /* Regs for current mode.  */
     uint32_t regs[16];
@@ -545,6 +572,11 @@ typedef struct CPUARMState {
     struct CPUBreakpoint *cpu_breakpoint[16];
     struct CPUWatchpoint *cpu_watchpoint[16];
 
+#if !defined(CONFIG_USER_ONLY)
+    /* Cache of LPAE table walks, indexed by VA.  */
+    ARMPTWCacheEntry ptw_cache[ARM_PTW_CACHE_SIZE];
+#endif
+
     /* Fields up to this point are cleared by a CPU reset */
     struct {} end_reset_fields;
 
@@ -565,6 +597,12 @@ typedef struct CPUARMState {
         uint32_t *drsr;
         uint32_t *dracr;
         uint32_t rnr[M_REG_NUM_BANKS];
+        /* The well formed, enabled regions in priority order, rebuilt
+         * from drbar/drsr on the next lookup once map_dirty is set.
+         */
+        ARMPMSAv7Region *map;
+        uint32_t map_len;
+        bool map_dirty;
     } pmsav7;
 
     MemTxAttrs *memattr_ns;
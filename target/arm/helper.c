@@ -9,6 +9,7 @@
 #include "sysemu/sysemu.h"
 #include "qemu/bitops.h"
 #include "qemu/crc32c.h"
+#include "qemu/range.h"
 #include "exec/exec-all.h"
 #include "exec/cpu_ldst.h"
 #include "arm_ldst.h"
@@ -1831,7 +1832,12 @@ static void gt_recalc_timer(ARMCPU *cpu, int timeridx)
         if (nexttick > INT64_MAX) {
             nexttick = INT64_MAX;
         }
-        timer_mod(cpu->gt_timer[timeridx], nexttick);
+        /* Re-arming for the same deadline would only notify the timer
+         * list (and kick the deadline consumers, like remote-port sync).
+         */
+        if (timer_expire_time_ns(cpu->gt_timer[timeridx]) != nexttick) {
+            timer_mod(cpu->gt_timer[timeridx], nexttick);
+        }
         trace_arm_gt_recalc(timeridx, irqstate, nexttick);
     } else {
         /* Timer disabled: ISTATUS and timer output always clear */
@@ -2601,6 +2607,7 @@ static void pmsav7_write(CPUARMState *env, const ARMCPRegInfo *ri,
     u32p += env->pmsav7.rnr[M_REG_NS];
     tlb_flush(CPU(cpu)); /* Mappings may have changed - purge! */
     *u32p = value;
+    env->pmsav7.map_dirty = true;
 }
 
 static void pmsav7_rgnr_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -8863,6 +8870,30 @@ static uint8_t convert_stage2_attrs(CPUARMState *env, uint8_t s2attrs)
     return (hiattr << 6) | (hihint << 4) | (loattr << 2) | lohint;
 }
 
+/* The walk cache is indexed by the VA bits consumed above a level 2 table,
+ * so a hit skips every level down to the last table.  Entries for shallower
+ * tables (e.g. ones that end in block mappings) share the same slots and
+ * compare their own, shorter, VA prefix.
+ */
+static ARMPTWCacheEntry *arm_ptw_cache_entry(CPUARMState *env,
+                                             target_ulong address,
+                                             int32_t stride)
+{
+    unsigned idx = (address >> (2 * stride + 3)) & (ARM_PTW_CACHE_SIZE - 1);
+
+    return &env->ptw_cache[idx];
+}
+
+static inline uint64_t arm_ptw_cache_prefix(target_ulong address,
+                                            int32_t stride, int inputsize,
+                                            uint32_t level)
+{
+    /* Bits of the VA that selected the table that is walked at 'level'.  */
+    int shift = stride * (5 - level) + 3;
+
+    return extract64(address, shift, inputsize - shift);
+}
+
 static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
                                MMUAccessType access_type, ARMMMUIdx mmu_idx,
                                hwaddr *phys_ptr, MemTxAttrs *txattrs, int *prot,
@@ -8893,6 +8924,7 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
     bool ttbr1_valid = true;
     uint64_t descaddrmask;
     bool aarch64 = arm_el_is_aa64(env, el);
+    ARMPTWCacheEntry *ptwc;
 
     /* TODO:
      * This code does not handle the different format TCR for VTCR_EL2.
@@ -9095,6 +9127,24 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
      * bits at each step.
      */
     tableattrs = regime_is_secure(env, mmu_idx) ? 0 : (1 << 4);
+
+    /* Skip the levels we have already walked for this part of the VA
+     * space, as long as nothing that could change the walk has happened.
+     * Only valid table descriptors are ever cached, so a guest creating
+     * new mappings without a TLB maintenance operation is still fine.
+     */
+    ptwc = arm_ptw_cache_entry(env, address, stride);
+    if (ptwc->valid && ptwc->gen == env->tlb_flush_gen &&
+        ptwc->mmu_idx == mmu_idx && ptwc->ttbr == ttbr &&
+        ptwc->tcr == tcr->raw_tcr && ptwc->ttbr_select == ttbr_select &&
+        ptwc->level > level && ptwc->vaprefix ==
+        arm_ptw_cache_prefix(address, stride, inputsize, ptwc->level)) {
+        level = ptwc->level;
+        descaddr = ptwc->descaddr;
+        tableattrs = ptwc->tableattrs;
+        indexmask = indexmask_grainsize;
+    }
+
     for (;;) {
         uint64_t descriptor;
         bool nstable;
@@ -9123,6 +9173,20 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
             tableattrs |= extract64(descriptor, 59, 5);
             level++;
             indexmask = indexmask_grainsize;
+
+            *ptwc = (ARMPTWCacheEntry) {
+                .ttbr = ttbr,
+                .tcr = tcr->raw_tcr,
+                .vaprefix = arm_ptw_cache_prefix(address, stride, inputsize,
+                                                 level),
+                .descaddr = descaddr,
+                .gen = env->tlb_flush_gen,
+                .tableattrs = tableattrs,
+                .mmu_idx = mmu_idx,
+                .level = level,
+                .ttbr_select = ttbr_select,
+                .valid = true,
+            };
             continue;
         }
         /* Block entry at level 1 or 2, or page entry at level 3.
@@ -9287,15 +9351,61 @@ static inline bool m_is_system_region(CPUARMState *env, uint32_t address)
     return arm_feature(env, ARM_FEATURE_M) && extract32(address, 29, 3) == 0x7;
 }
 
+/* Decode DRBAR/DRSR into the list of enabled regions, highest priority
+ * first, so that lookups only have to look at regions that can match.
+ */
+static void pmsav7_update_map(ARMCPU *cpu)
+{
+    CPUARMState *env = &cpu->env;
+    int n;
+
+    env->pmsav7.map_len = 0;
+    for (n = (int)cpu->pmsav7_dregion - 1; n >= 0; n--) {
+        uint32_t base = env->pmsav7.drbar[n];
+        uint32_t rsize = extract32(env->pmsav7.drsr[n], 1, 5);
+        uint32_t rmask;
+
+        if (!(env->pmsav7.drsr[n] & 0x1)) {
+            continue;
+        }
+
+        if (!rsize) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "DRSR[%d]: Rsize field cannot be 0\n", n);
+            continue;
+        }
+        rsize++;
+        rmask = (1ull << rsize) - 1;
+
+        if (base & rmask) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "DRBAR[%d]: 0x%" PRIx32 " misaligned "
+                          "to DRSR region size, mask = 0x%" PRIx32 "\n",
+                          n, base, rmask);
+            continue;
+        }
+
+        env->pmsav7.map[env->pmsav7.map_len++] = (ARMPMSAv7Region) {
+            .base = base,
+            .rmask = rmask,
+            .rsize = rsize,
+            .n = n,
+        };
+    }
+    env->pmsav7.map_dirty = false;
+}
+
 static bool get_phys_addr_pmsav7(CPUARMState *env, uint32_t address,
                                  MMUAccessType access_type, ARMMMUIdx mmu_idx,
-                                 hwaddr *phys_ptr, int *prot, uint32_t *fsr)
+                                 hwaddr *phys_ptr, int *prot,
+                                 target_ulong *page_size, uint32_t *fsr)
 {
     ARMCPU *cpu = arm_env_get_cpu(env);
     int n;
     bool is_user = regime_is_user(env, mmu_idx);
 
     *phys_ptr = address;
+    *page_size = TARGET_PAGE_SIZE;
     *prot = 0;
 
     if (regime_translation_disabled(env, mmu_idx) ||
@@ -9309,34 +9419,32 @@ static bool get_phys_addr_pmsav7(CPUARMState *env, uint32_t address,
          */
         get_phys_addr_pmsav7_default(env, mmu_idx, address, prot);
     } else { /* MPU enabled */
-        for (n = (int)cpu->pmsav7_dregion - 1; n >= 0; n--) {
-            /* region search */
-            uint32_t base = env->pmsav7.drbar[n];
-            uint32_t rsize = extract32(env->pmsav7.drsr[n], 1, 5);
-            uint32_t rmask;
-            bool srdis = false;
-
-            if (!(env->pmsav7.drsr[n] & 0x1)) {
-                continue;
-            }
+        uint32_t m;
 
-            if (!rsize) {
-                qemu_log_mask(LOG_GUEST_ERROR,
-                              "DRSR[%d]: Rsize field cannot be 0\n", n);
-                continue;
-            }
-            rsize++;
-            rmask = (1ull << rsize) - 1;
+        if (env->pmsav7.map_dirty) {
+            pmsav7_update_map(cpu);
+        }
 
-            if (base & rmask) {
-                qemu_log_mask(LOG_GUEST_ERROR,
-                              "DRBAR[%d]: 0x%" PRIx32 " misaligned "
-                              "to DRSR region size, mask = 0x%" PRIx32 "\n",
-                              n, base, rmask);
-                continue;
-            }
+        n = -1;
+        for (m = 0; m < env->pmsav7.map_len; m++) {
+            /* region search */
+            uint32_t base = env->pmsav7.map[m].base;
+            uint32_t rsize = env->pmsav7.map[m].rsize;
+            uint32_t rmask = env->pmsav7.map[m].rmask;
+            bool srdis = false;
 
+            n = env->pmsav7.map[m].n;
             if (address < base || address > base + rmask) {
+                /* A region sharing our page with us but not covering us
+                 * means whatever we hit below only holds for part of the
+                 * page, so it must not be cached for the whole page.
+                 */
+                if (ranges_overlap(base, (uint64_t)rmask + 1,
+                                   address & TARGET_PAGE_MASK,
+                                   TARGET_PAGE_SIZE)) {
+                    *page_size = 1;
+                }
+                n = -1;
                 continue;
             }
 
@@ -9369,13 +9477,13 @@ static bool get_phys_addr_pmsav7(CPUARMState *env, uint32_t address,
                 }
             }
             if (rsize < TARGET_PAGE_BITS) {
-                qemu_log_mask(LOG_UNIMP,
-                              "DRSR[%d]: No support for MPU (sub)region "
-                              "alignment of %" PRIu32 " bits. Minimum is %d\n",
-                              n, rsize, TARGET_PAGE_BITS);
-                continue;
+                /* (Sub)region smaller than a page: the TLB entry gets
+                 * TLB_RECHECK and every access comes back here.
+                 */
+                *page_size = MIN(*page_size, 1 << rsize);
             }
             if (srdis) {
+                n = -1;
                 continue;
             }
             break;
@@ -9953,7 +10061,7 @@ static bool get_phys_addr(CPUARMState *env, target_ulong address,
         } else if (arm_feature(env, ARM_FEATURE_V7)) {
             /* PMSAv7 */
             ret = get_phys_addr_pmsav7(env, address, access_type, mmu_idx,
-                                       phys_ptr, prot, fsr);
+                                       phys_ptr, prot, page_size, fsr);
         } else {
             /* Pre-v7 MPU */
             ret = get_phys_addr_pmsav5(env, address, access_type, mmu_idx,
@@ -10014,9 +10122,14 @@ bool arm_tlb_fill(CPUState *cs, vaddr address,
                         core_to_arm_mmu_idx(env, mmu_idx), &phys_addr,
                         &attrs, &prot, &page_size, fsr, fi, NULL);
     if (!ret) {
-        /* Map a single [sub]page.  */
-        phys_addr &= TARGET_PAGE_MASK;
-        address &= TARGET_PAGE_MASK;
+        /* Map a single [sub]page.  Regions smaller than a page are
+         * handled by the core TLB code (TLB_RECHECK), which wants the
+         * exact addresses.
+         */
+        if (page_size >= TARGET_PAGE_SIZE) {
+            phys_addr &= TARGET_PAGE_MASK;
+            address &= TARGET_PAGE_MASK;
+        }
         tlb_set_page_with_attrs(cs, address, phys_addr, attrs,
                                 prot, mmu_idx, page_size);
         return 0;
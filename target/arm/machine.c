@@ -481,6 +481,7 @@ static int cpu_post_load(void *opaque, int version_id)
 
     hw_breakpoint_update_all(cpu);
     hw_watchpoint_update_all(cpu);
+    cpu->env.pmsav7.map_dirty = true;
 
     return 0;
 }
@@ -21,6 +21,7 @@
 #include "cpu.h"
 #include "exec/exec-all.h"
 #include "tcg-op.h"
+#include "tcg-op-gvec.h"
 #include "qemu/log.h"
 #include "arm_ldst.h"
 #include "translate.h"
@@ -386,6 +387,36 @@ static inline void gen_goto_tb(DisasContext *s, int n, uint64_t dest)
     }
 }
 
+/* In a superblock, carry on translating at the target of an
+ * unconditional direct branch instead of ending the TB.
+ */
+static bool a64_follow_branch(DisasContext *s, uint64_t dest)
+{
+    if (s->ss_active || !translator_follow_branch(&s->base, dest)) {
+        return false;
+    }
+    s->pc = dest;
+    return true;
+}
+
+/* In a superblock, keep translating the fall through path of a
+ * conditional branch to dest.  Returns the label the taken path should
+ * branch to, which leaves the TB, or NULL if the TB must end here.
+ */
+static TCGLabel *a64_side_exit(DisasContext *s, uint64_t dest)
+{
+    int n = s->nb_side_exits;
+
+    if (n == A64_MAX_SIDE_EXITS || s->ss_active ||
+        !translator_follow_branch(&s->base, s->pc)) {
+        return NULL;
+    }
+    s->side_exit_label[n] = gen_new_label();
+    s->side_exit_dest[n] = dest;
+    s->nb_side_exits++;
+    return s->side_exit_label[n];
+}
+
 static void unallocated_encoding(DisasContext *s)
 {
     /* Unallocated and reserved encodings are uncategorized */
@@ -538,6 +569,28 @@ static inline int vec_reg_offset(DisasContext *s, int regno,
     return offs;
 }
 
+/* Return the offset into CPUARMState of the whole 128 bit vector
+ * register Qn, for the tcg_gen_gvec_* operations.
+ */
+static inline int vec_full_reg_offset(DisasContext *s, int regno)
+{
+    assert_fp_access_checked(s);
+    return offsetof(CPUARMState, vfp.regs[regno * 2]);
+}
+
+/* Expand a 3-operand operation on the vector registers, clearing the
+ * high half of Qd unless is_q.
+ */
+typedef void GVecGen3Fn(unsigned vece, uint32_t dofs, uint32_t aofs,
+                        uint32_t bofs, uint32_t oprsz, uint32_t maxsz);
+
+static void gen_gvec_fn3(DisasContext *s, bool is_q, int rd, int rn, int rm,
+                         GVecGen3Fn *gvec_fn, int vece)
+{
+    gvec_fn(vece, vec_full_reg_offset(s, rd), vec_full_reg_offset(s, rn),
+            vec_full_reg_offset(s, rm), is_q ? 16 : 8, 16);
+}
+
 /* Return the offset into CPUARMState of a slice (from
  * the least significant end) of FP register Qn (ie
  * Dn, Sn, Hn or Bn).
@@ -1227,7 +1280,9 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
     }
 
     /* B Branch / BL Branch with link */
-    gen_goto_tb(s, 0, addr);
+    if (!a64_follow_branch(s, addr)) {
+        gen_goto_tb(s, 0, addr);
+    }
 }
 
 /* Compare and branch (immediate)
@@ -1249,6 +1304,12 @@ static void disas_comp_b_imm(DisasContext *s, uint32_t insn)
     addr = s->pc + sextract32(insn, 5, 19) * 4 - 4;
 
     tcg_cmp = read_cpu_reg(s, rt, sf);
+    label_match = a64_side_exit(s, addr);
+    if (label_match) {
+        tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
+                            tcg_cmp, 0, label_match);
+        return;
+    }
     label_match = gen_new_label();
 
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
@@ -1279,6 +1340,13 @@ static void disas_test_b_imm(DisasContext *s, uint32_t insn)
 
     tcg_cmp = tcg_temp_new_i64();
     tcg_gen_andi_i64(tcg_cmp, cpu_reg(s, rt), (1ULL << bit_pos));
+    label_match = a64_side_exit(s, addr);
+    if (label_match) {
+        tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
+                            tcg_cmp, 0, label_match);
+        tcg_temp_free_i64(tcg_cmp);
+        return;
+    }
     label_match = gen_new_label();
     tcg_gen_brcondi_i64(op ? TCG_COND_NE : TCG_COND_EQ,
                         tcg_cmp, 0, label_match);
@@ -1308,12 +1376,18 @@ static void disas_cond_b_imm(DisasContext *s, uint32_t insn)
 
     if (cond < 0x0e) {
         /* genuinely conditional branches */
-        TCGLabel *label_match = gen_new_label();
+        TCGLabel *label_match = a64_side_exit(s, addr);
+
+        if (label_match) {
+            arm_gen_test_cc(cond, label_match);
+            return;
+        }
+        label_match = gen_new_label();
         arm_gen_test_cc(cond, label_match);
         gen_goto_tb(s, 0, s->pc);
         gen_set_label(label_match);
         gen_goto_tb(s, 1, addr);
-    } else {
+    } else if (!a64_follow_branch(s, addr)) {
         /* 0xe and 0xf are both "always" conditions */
         gen_goto_tb(s, 0, addr);
     }
@@ -1816,7 +1890,7 @@ static void disas_uncond_b_reg(DisasContext *s, uint32_t insn)
         return;
     }
 
-    s->base.is_jmp = DISAS_JUMP;
+    s->base.is_jmp = DISAS_JUMP_CACHED;
 }
 
 /* Branches, exception generating and system instructions */
@@ -9072,6 +9146,24 @@ static void disas_simd_3same_logic(DisasContext *s, uint32_t insn)
         return;
     }
 
+    switch (size + 4 * is_u) {
+    case 0: /* AND */
+        gen_gvec_fn3(s, is_q, rd, rn, rm, tcg_gen_gvec_and, 0);
+        return;
+    case 1: /* BIC */
+        gen_gvec_fn3(s, is_q, rd, rn, rm, tcg_gen_gvec_andc, 0);
+        return;
+    case 2: /* ORR */
+        gen_gvec_fn3(s, is_q, rd, rn, rm, tcg_gen_gvec_or, 0);
+        return;
+    case 3: /* ORN */
+        gen_gvec_fn3(s, is_q, rd, rn, rm, tcg_gen_gvec_orc, 0);
+        return;
+    case 4: /* EOR */
+        gen_gvec_fn3(s, is_q, rd, rn, rm, tcg_gen_gvec_xor, 0);
+        return;
+    }
+
     tcg_op1 = tcg_temp_new_i64();
     tcg_op2 = tcg_temp_new_i64();
     tcg_res[0] = tcg_temp_new_i64();
@@ -9434,6 +9526,12 @@ static void disas_simd_3same_int(DisasContext *s, uint32_t insn)
         return;
     }
 
+    if (opcode == 0x10) { /* ADD, SUB */
+        gen_gvec_fn3(s, is_q, rd, rn, rm,
+                     u ? tcg_gen_gvec_sub : tcg_gen_gvec_add, size);
+        return;
+    }
+
     if (size == 3) {
         assert(is_q);
         for (pass = 0; pass < 2; pass++) {
@@ -9606,16 +9704,6 @@ static void disas_simd_3same_int(DisasContext *s, uint32_t insn)
                 genfn = fns[size][u];
                 break;
             }
-            case 0x10: /* ADD, SUB */
-            {
-                static NeonGenTwoOpFn * const fns[3][2] = {
-                    { gen_helper_neon_add_u8, gen_helper_neon_sub_u8 },
-                    { gen_helper_neon_add_u16, gen_helper_neon_sub_u16 },
-                    { tcg_gen_add_i32, tcg_gen_sub_i32 },
-                };
-                genfn = fns[size][u];
-                break;
-            }
             case 0x11: /* CMTST, CMEQ */
             {
                 static NeonGenTwoOpFn * const fns[3][2] = {
@@ -11230,6 +11318,7 @@ static int aarch64_tr_init_disas_context(DisasContextBase *dcbase,
 
     dc->pc = dc->base.pc_first;
     dc->condjmp = 0;
+    dc->nb_side_exits = 0;
 
     dc->aarch64 = 1;
     /* If we are coming from secure EL0 in a system with a 32-bit EL3, then
@@ -11358,6 +11447,7 @@ static void aarch64_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
 static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *dc = container_of(dcbase, DisasContext, base);
+    int i;
 
     if (unlikely(dc->base.singlestep_enabled || dc->ss_active)) {
         /* Note that this means single stepping WFI doesn't halt the CPU.
@@ -11371,6 +11461,7 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             /* fall through */
         case DISAS_EXIT:
         case DISAS_JUMP:
+        case DISAS_JUMP_CACHED:
             if (dc->base.singlestep_enabled) {
                 gen_exception_internal(EXCP_DEBUG);
             } else {
@@ -11396,6 +11487,9 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
         case DISAS_JUMP:
             tcg_gen_lookup_and_goto_ptr();
             break;
+        case DISAS_JUMP_CACHED:
+            tcg_gen_lookup_and_goto_ptr_cached(cpu_pc, dc->base.tb);
+            break;
         case DISAS_NORETURN:
         case DISAS_SWI:
             break;
@@ -11427,6 +11521,12 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
         }
     }
 
+    for (i = 0; i < dc->nb_side_exits; i++) {
+        gen_set_label(dc->side_exit_label[i]);
+        gen_a64_set_pc_im(dc->side_exit_dest[i]);
+        tcg_gen_lookup_and_goto_ptr_cached(cpu_pc, dc->base.tb);
+    }
+
     /* Functions above can change dc->pc, so re-align db->pc_next */
     dc->base.pc_next = dc->pc;
 }
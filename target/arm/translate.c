@@ -25,6 +25,7 @@
 #include "disas/disas.h"
 #include "exec/exec-all.h"
 #include "tcg-op.h"
+#include "tcg-op-gvec.h"
 #include "qemu/log.h"
 #include "qemu/bitops.h"
 #include "qemu/error-report.h"
@@ -4218,6 +4219,31 @@ static void gen_goto_tb(DisasContext *s, int n, target_ulong dest)
     s->base.is_jmp = DISAS_NORETURN;
 }
 
+/* In a superblock, keep translating past a direct branch to dest
+ * instead of ending the TB.  A conditional branch leaves the TB through
+ * an inline exit on its taken path and carries on with the fall through
+ * path, an unconditional one carries on at dest.
+ */
+static bool arm_follow_branch(DisasContext *s, uint32_t dest)
+{
+    if (s->condexec_mask) {
+        return false;
+    }
+    if (s->condjmp) {
+        if (!translator_follow_branch(&s->base, s->pc)) {
+            return false;
+        }
+        gen_set_pc_im(s, dest);
+        gen_goto_ptr();
+        return true;
+    }
+    if (!translator_follow_branch(&s->base, dest)) {
+        return false;
+    }
+    s->pc = dest;
+    return true;
+}
+
 static inline void gen_jmp (DisasContext *s, uint32_t dest)
 {
     if (unlikely(is_singlestepping(s))) {
@@ -4225,7 +4251,7 @@ static inline void gen_jmp (DisasContext *s, uint32_t dest)
         if (s->thumb)
             dest |= 1;
         gen_bx_im(s, dest);
-    } else {
+    } else if (!arm_follow_branch(s, dest)) {
         gen_goto_tb(s, 0, dest);
     }
 }
@@ -5674,6 +5700,46 @@ static int disas_neon_data_insn(DisasContext *s, uint32_t insn)
             tcg_temp_free_i32(tmp3);
             return 0;
         }
+        if (op == NEON_3R_VADD_VSUB
+            || (op == NEON_3R_LOGIC && (u << 2 | size) <= 4)) {
+            /* Operations on the whole D or Q register.  */
+            int vec_size = q ? 16 : 8;
+            int rd_ofs = vfp_reg_offset(1, rd);
+            int rn_ofs = vfp_reg_offset(1, rn);
+            int rm_ofs = vfp_reg_offset(1, rm);
+
+            switch (op == NEON_3R_LOGIC ? u << 2 | size : 8 + u) {
+            case 0: /* VAND */
+                tcg_gen_gvec_and(0, rd_ofs, rn_ofs, rm_ofs,
+                                 vec_size, vec_size);
+                break;
+            case 1: /* VBIC */
+                tcg_gen_gvec_andc(0, rd_ofs, rn_ofs, rm_ofs,
+                                  vec_size, vec_size);
+                break;
+            case 2: /* VORR */
+                tcg_gen_gvec_or(0, rd_ofs, rn_ofs, rm_ofs,
+                                vec_size, vec_size);
+                break;
+            case 3: /* VORN */
+                tcg_gen_gvec_orc(0, rd_ofs, rn_ofs, rm_ofs,
+                                 vec_size, vec_size);
+                break;
+            case 4: /* VEOR */
+                tcg_gen_gvec_xor(0, rd_ofs, rn_ofs, rm_ofs,
+                                 vec_size, vec_size);
+                break;
+            case 8: /* VADD */
+                tcg_gen_gvec_add(size, rd_ofs, rn_ofs, rm_ofs,
+                                 vec_size, vec_size);
+                break;
+            case 9: /* VSUB */
+                tcg_gen_gvec_sub(size, rd_ofs, rn_ofs, rm_ofs,
+                                 vec_size, vec_size);
+                break;
+            }
+            return 0;
+        }
         if (size == 3 && op != NEON_3R_LOGIC) {
             /* 64-bit element instructions. */
             for (pass = 0; pass < (q ? 2 : 1); pass++) {
@@ -5730,13 +5796,6 @@ static int disas_neon_data_insn(DisasContext *s, uint32_t insn)
                                                   cpu_V1, cpu_V0);
                     }
                     break;
-                case NEON_3R_VADD_VSUB:
-                    if (u) {
-                        tcg_gen_sub_i64(CPU_V001);
-                    } else {
-                        tcg_gen_add_i64(CPU_V001);
-                    }
-                    break;
                 default:
                     abort();
                 }
@@ -5838,21 +5897,6 @@ static int disas_neon_data_insn(DisasContext *s, uint32_t insn)
             break;
         case NEON_3R_LOGIC: /* Logic ops.  */
             switch ((u << 2) | size) {
-            case 0: /* VAND */
-                tcg_gen_and_i32(tmp, tmp, tmp2);
-                break;
-            case 1: /* BIC */
-                tcg_gen_andc_i32(tmp, tmp, tmp2);
-                break;
-            case 2: /* VORR */
-                tcg_gen_or_i32(tmp, tmp, tmp2);
-                break;
-            case 3: /* VORN */
-                tcg_gen_orc_i32(tmp, tmp, tmp2);
-                break;
-            case 4: /* VEOR */
-                tcg_gen_xor_i32(tmp, tmp, tmp2);
-                break;
             case 5: /* VBSL */
                 tmp3 = neon_load_reg(rd, pass);
                 gen_neon_bsl(tmp, tmp, tmp2, tmp3);
@@ -5909,18 +5953,6 @@ static int disas_neon_data_insn(DisasContext *s, uint32_t insn)
             tmp2 = neon_load_reg(rd, pass);
             gen_neon_add(size, tmp, tmp2);
             break;
-        case NEON_3R_VADD_VSUB:
-            if (!u) { /* VADD */
-                gen_neon_add(size, tmp, tmp2);
-            } else { /* VSUB */
-                switch (size) {
-                case 0: gen_helper_neon_sub_u8(tmp, tmp, tmp2); break;
-                case 1: gen_helper_neon_sub_u16(tmp, tmp, tmp2); break;
-                case 2: tcg_gen_sub_i32(tmp, tmp, tmp2); break;
-                default: abort();
-                }
-            }
-            break;
         case NEON_3R_VTST_VCEQ:
             if (!u) { /* VTST */
                 switch (size) {
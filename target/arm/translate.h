@@ -71,6 +71,13 @@ typedef struct DisasContext {
 #define TMP_A64_MAX 16
     int tmp_a64_count;
     TCGv_i64 tmp_a64[TMP_A64_MAX];
+    /* Taken paths of the conditional branches an A64 superblock went
+     * past, emitted out of line at the end of the TB.
+     */
+#define A64_MAX_SIDE_EXITS 8
+    int nb_side_exits;
+    TCGLabel *side_exit_label[A64_MAX_SIDE_EXITS];
+    uint64_t side_exit_dest[A64_MAX_SIDE_EXITS];
 } DisasContext;
 
 typedef struct DisasCompare {
@@ -147,6 +154,11 @@ static void disas_set_insn_syndrome(DisasContext *s, uint32_t syn)
  * helper) has done so before we reach return from cpu_tb_exec.
  */
 #define DISAS_EXIT      DISAS_TARGET_9
+/* As DISAS_JUMP, for an indirect branch that leaves everything the TB
+ * flags are computed from alone, so that the next TB can be looked up
+ * inline (see tcg_gen_lookup_and_goto_ptr_cached).
+ */
+#define DISAS_JUMP_CACHED DISAS_TARGET_10
 
 #ifdef TARGET_AARCH64
 void a64_translate_init(void);
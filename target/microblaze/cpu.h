@@ -31,6 +31,8 @@
 #include "fpu/softfloat.h"
 struct CPUMBState;
 typedef struct CPUMBState CPUMBState;
+/* Number of PIDs whose translations the QEMU TLB holds at once.  */
+#define MB_PID_SLOTS 4
 #if !defined(CONFIG_USER_ONLY)
 #include "mmu.h"
 #endif
@@ -230,7 +232,8 @@ typedef struct CPUMBState CPUMBState;
 #define CC_NE  1
 #define CC_EQ  0
 
-#define NB_MMU_MODES    3
+/* nommu plus a kernel/user pair per PID slot.  */
+#define NB_MMU_MODES    (1 + 2 * MB_PID_SLOTS)
 #undef NB_MEM_ATTR
 #define NB_MEM_ATTR     1
 
@@ -249,6 +252,10 @@ struct CPUMBState {
     uint32_t imm;
     uint32_t regs[32];
     uint64_t sregs[14];
+    /* MSR carry (0 or 1), kept out of sregs[SR_MSR] so the translator can
+       keep it in a TCG global.  MSR_C and MSR_CC are always clear in
+       sregs[SR_MSR]; use mb_cpu_read_msr() for the architectural view.  */
+    uint32_t msr_c;
     float_status fp_status;
     /* Stack protectors. Yes, it's a hw feature.  */
     uint32_t slr, shr;
@@ -366,22 +373,51 @@ int cpu_mb_signal_handler(int host_signum, void *pinfo,
 #define MMU_NOMMU_IDX   0
 #define MMU_KERNEL_IDX  1
 #define MMU_USER_IDX    2
-/* See NB_MMU_MODES further up the file.  */
+/* See NB_MMU_MODES further up the file.  PID slot N uses the kernel and
+ * user indexes of slot 0 shifted up by 2 * N.
+ */
+#define MMU_SLOT_IDX(slot, idx) ((idx) + 2 * (slot))
+
+/* The PID slot of the current MMU index is part of the TB flags.  */
+#define MB_TB_PID_SLOT_SHIFT 20
+
+static inline bool mb_mmu_idx_is_user(int mmu_idx)
+{
+    return mmu_idx != MMU_NOMMU_IDX && !(mmu_idx & 1);
+}
 
 static inline int cpu_mmu_index (CPUMBState *env, bool ifetch)
 {
+        unsigned int slot = 0;
+
         /* Are we in nommu mode?.  */
         if (!(env->sregs[SR_MSR] & MSR_VM))
             return MMU_NOMMU_IDX;
 
+#if !defined(CONFIG_USER_ONLY)
+        slot = env->mmu.cur_slot;
+#endif
 	if (env->sregs[SR_MSR] & MSR_UM)
-            return MMU_USER_IDX;
-        return MMU_KERNEL_IDX;
+            return MMU_SLOT_IDX(slot, MMU_USER_IDX);
+        return MMU_SLOT_IDX(slot, MMU_KERNEL_IDX);
 }
 
 int mb_cpu_handle_mmu_fault(CPUState *cpu, vaddr address, int rw,
                             int mmu_idx);
 
+#define MSR_C_BITS ((uint32_t)(MSR_C | MSR_CC))
+
+static inline uint64_t mb_cpu_read_msr(const CPUMBState *env)
+{
+    return env->sregs[SR_MSR] | (env->msr_c ? MSR_C_BITS : 0);
+}
+
+static inline void mb_cpu_write_msr(CPUMBState *env, uint64_t val)
+{
+    env->msr_c = (val & MSR_C) != 0;
+    env->sregs[SR_MSR] = val & ~(uint64_t)MSR_C_BITS;
+}
+
 #include "exec/cpu-all.h"
 
 static inline void cpu_get_tb_cpu_state(CPUMBState *env, target_ulong *pc,
@@ -391,6 +427,11 @@ static inline void cpu_get_tb_cpu_state(CPUMBState *env, target_ulong *pc,
     *cs_base = 0;
     *flags = (env->iflags & IFLAGS_TB_MASK) |
                  (env->sregs[SR_MSR] & (MSR_UM | MSR_VM | MSR_EE));
+#if !defined(CONFIG_USER_ONLY)
+    if (env->sregs[SR_MSR] & MSR_VM) {
+        *flags |= env->mmu.cur_slot << MB_TB_PID_SLOT_SHIFT;
+    }
+#endif
 }
 
 #if !defined(CONFIG_USER_ONLY)
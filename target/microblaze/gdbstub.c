@@ -29,6 +29,8 @@ int mb_cpu_gdb_read_register(CPUState *cs, uint8_t *mem_buf, int n)
 
     if (n < 32) {
         return gdb_get_reg32(mem_buf, env->regs[n]);
+    } else if (n == 32 + SR_MSR) {
+        return gdb_get_reg32(mem_buf, mb_cpu_read_msr(env));
     } else {
         return gdb_get_reg32(mem_buf, env->sregs[n - 32]);
     }
@@ -50,6 +52,8 @@ int mb_cpu_gdb_write_register(CPUState *cs, uint8_t *mem_buf, int n)
 
     if (n < 32) {
         env->regs[n] = tmp;
+    } else if (n == 32 + SR_MSR) {
+        mb_cpu_write_msr(env, tmp);
     } else {
         env->sregs[n - 32] = tmp;
     }
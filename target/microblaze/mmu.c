@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "qemu/host-utils.h"
 
 #define D(x)
 
@@ -34,6 +35,58 @@ static unsigned int tlb_decode_size(unsigned int f)
     return sizes[f];
 }
 
+static unsigned int tlb_size_class(uint64_t t)
+{
+    return (t & TLB_PAGESZ_MASK) >> 7;
+}
+
+/* Page sizes go up by a factor of 4 from 1K, so all addresses within a
+ * page of size class SZ hash to the same bucket.
+ */
+static unsigned int mmu_hash(uint64_t vaddr, unsigned int sz)
+{
+    uint64_t vpn = vaddr >> (10 + 2 * sz);
+
+    return (vpn ^ (vpn >> 6) ^ (sz * 11)) & (TLB_HASH_SIZE - 1);
+}
+
+static void mmu_hash_insert(struct microblaze_mmu *mmu, unsigned int idx)
+{
+    uint64_t t = mmu->rams[RAM_TAG][idx];
+    unsigned int sz = tlb_size_class(t);
+    unsigned int h;
+
+    if (!(t & TLB_VALID)) {
+        return;
+    }
+
+    h = mmu_hash(t & TLB_EPN_MASK, sz);
+    mmu->hash_next[idx] = mmu->hash[h];
+    mmu->hash[h] = idx;
+    mmu->size_count[sz]++;
+}
+
+static void mmu_hash_remove(struct microblaze_mmu *mmu, unsigned int idx)
+{
+    uint64_t t = mmu->rams[RAM_TAG][idx];
+    unsigned int sz = tlb_size_class(t);
+    int8_t *p;
+
+    if (!(t & TLB_VALID)) {
+        return;
+    }
+
+    for (p = &mmu->hash[mmu_hash(t & TLB_EPN_MASK, sz)]; *p >= 0;
+         p = &mmu->hash_next[*p]) {
+        if (*p == idx) {
+            *p = mmu->hash_next[idx];
+            mmu->size_count[sz]--;
+            return;
+        }
+    }
+    g_assert_not_reached();
+}
+
 static void mmu_flush_idx(CPUMBState *env, unsigned int idx)
 {
     CPUState *cs = CPU(mb_env_get_cpu(env));
@@ -55,23 +108,34 @@ static void mmu_flush_idx(CPUMBState *env, unsigned int idx)
     }
 }
 
-static void mmu_change_pid(CPUMBState *env, unsigned int newpid) 
+/* Every PID slot caches the translations for one PID in its own MMU
+ * indexes, so switching to a PID that still has a slot costs nothing.
+ * Otherwise the oldest claimed slot is flushed and taken over.
+ */
+static void mmu_change_pid(CPUMBState *env, unsigned int newpid)
 {
+    CPUState *cs = CPU(mb_env_get_cpu(env));
     struct microblaze_mmu *mmu = &env->mmu;
-    unsigned int i;
-    uint32_t t;
+    unsigned int s;
 
     if (newpid & ~0xff)
         qemu_log_mask(LOG_GUEST_ERROR, "Illegal rpid=%x\n", newpid);
+    newpid &= 0xff;
 
-    for (i = 0; i < ARRAY_SIZE(mmu->rams[RAM_TAG]); i++) {
-        /* Lookup and decode.  */
-        t = mmu->rams[RAM_TAG][i];
-        if (t & TLB_VALID) {
-            if (mmu->tids[i] && ((mmu->regs[MMU_R_PID] & 0xff) == mmu->tids[i]))
-                mmu_flush_idx(env, i);
+    for (s = 0; s < MB_PID_SLOTS; s++) {
+        if ((mmu->slot_valid & (1 << s)) && mmu->slot_pid[s] == newpid) {
+            mmu->cur_slot = s;
+            return;
         }
     }
+
+    s = mmu->next_victim;
+    mmu->next_victim = (s + 1) % MB_PID_SLOTS;
+    tlb_flush_by_mmuidx(cs, (1 << MMU_SLOT_IDX(s, MMU_KERNEL_IDX)) |
+                            (1 << MMU_SLOT_IDX(s, MMU_USER_IDX)));
+    mmu->slot_pid[s] = newpid;
+    mmu->slot_valid |= 1 << s;
+    mmu->cur_slot = s;
 }
 
 /* rw - 0 = read, 1 = write, 2 = fetch.  */
@@ -79,99 +143,115 @@ unsigned int mmu_translate(struct microblaze_mmu *mmu,
                            struct microblaze_mmu_lookup *lu,
                            target_ulong vaddr, int rw, int mmu_idx)
 {
-    unsigned int i, hit = 0;
+    unsigned int i, sz, hit = 0;
     unsigned int tlb_ex = 0, tlb_wr = 0, tlb_zsel;
     uint64_t tlb_tag, tlb_rpn, mask;
+    uint64_t candidates = 0;
     uint32_t tlb_size, t0;
+    int j;
+
+    /* Gather the valid entries with a matching tag from the hash chains.
+     * They are then checked in index order, like the linear search the
+     * hardware semantics are defined by.
+     */
+    for (sz = 0; sz < ARRAY_SIZE(mmu->size_count); sz++) {
+        if (!mmu->size_count[sz]) {
+            continue;
+        }
+        mask = ~((uint64_t)tlb_decode_size(sz) - 1);
+        for (j = mmu->hash[mmu_hash(vaddr, sz)]; j >= 0;
+             j = mmu->hash_next[j]) {
+            uint64_t t = mmu->rams[RAM_TAG][j];
+
+            if (tlb_size_class(t) == sz
+                && (vaddr & mask) == (t & TLB_EPN_MASK & mask)) {
+                candidates |= 1ULL << j;
+            }
+        }
+    }
 
     lu->err = ERR_MISS;
-    for (i = 0; i < ARRAY_SIZE(mmu->rams[RAM_TAG]); i++) {
+    while (candidates) {
         uint64_t t, d;
 
+        i = ctz64(candidates);
+        candidates &= candidates - 1;
+
         /* Lookup and decode.  */
         t = mmu->rams[RAM_TAG][i];
-        D(qemu_log("TLB %" PRId64 " valid=%d\n", i, t & TLB_VALID));
-        if (t & TLB_VALID) {
-            tlb_size = tlb_decode_size((t & TLB_PAGESZ_MASK) >> 7);
-            if (tlb_size < TARGET_PAGE_SIZE) {
-                qemu_log("%d pages not supported\n", tlb_size);
-                abort();
-            }
+        tlb_size = tlb_decode_size(tlb_size_class(t));
+        if (tlb_size < TARGET_PAGE_SIZE) {
+            qemu_log("%d pages not supported\n", tlb_size);
+            abort();
+        }
 
-            mask = ~((uint64_t)tlb_size - 1);
-            tlb_tag = t & TLB_EPN_MASK;
-            if ((vaddr & mask) != (tlb_tag & mask)) {
-                D(qemu_log("TLB %d vaddr=%x != tag=%x\n",
-                           i, vaddr & mask, tlb_tag & mask));
-                continue;
-            }
-            if (mmu->tids[i]
-                && ((mmu->regs[MMU_R_PID] & 0xff) != mmu->tids[i])) {
-                D(qemu_log("TLB %d pid=%x != tid=%x\n",
-                           i, mmu->regs[MMU_R_PID], mmu->tids[i]));
-                continue;
-            }
+        tlb_tag = t & TLB_EPN_MASK;
+        if (mmu->tids[i]
+            && ((mmu->regs[MMU_R_PID] & 0xff) != mmu->tids[i])) {
+            D(qemu_log("TLB %d pid=%x != tid=%x\n",
+                       i, mmu->regs[MMU_R_PID], mmu->tids[i]));
+            continue;
+        }
 
-            /* Bring in the data part.  */
-            d = mmu->rams[RAM_DATA][i];
-            tlb_ex = d & TLB_EX;
-            tlb_wr = d & TLB_WR;
+        /* Bring in the data part.  */
+        d = mmu->rams[RAM_DATA][i];
+        tlb_ex = d & TLB_EX;
+        tlb_wr = d & TLB_WR;
 
-            /* Now let's see if there is a zone that overrides the protbits.  */
-            tlb_zsel = (d >> 4) & 0xf;
-            t0 = mmu->regs[MMU_R_ZPR] >> (30 - (tlb_zsel * 2));
-            t0 &= 0x3;
+        /* Now let's see if there is a zone that overrides the protbits.  */
+        tlb_zsel = (d >> 4) & 0xf;
+        t0 = mmu->regs[MMU_R_ZPR] >> (30 - (tlb_zsel * 2));
+        t0 &= 0x3;
 
-            if (tlb_zsel > mmu->c_mmu_zones) {
-                qemu_log_mask(LOG_GUEST_ERROR, "tlb zone select out of range! %d\n", tlb_zsel);
-                t0 = 1; /* Ignore.  */
-            }
+        if (tlb_zsel > mmu->c_mmu_zones) {
+            qemu_log_mask(LOG_GUEST_ERROR, "tlb zone select out of range! %d\n", tlb_zsel);
+            t0 = 1; /* Ignore.  */
+        }
 
-            if (mmu->c_mmu == 1) {
-                t0 = 1; /* Zones are disabled.  */
-            }
+        if (mmu->c_mmu == 1) {
+            t0 = 1; /* Zones are disabled.  */
+        }
 
-            switch (t0) {
-                case 0:
-                    if (mmu_idx == MMU_USER_IDX)
-                        continue;
-                    break;
-                case 2:
-                    if (mmu_idx != MMU_USER_IDX) {
-                        tlb_ex = 1;
-                        tlb_wr = 1;
-                    }
-                    break;
-                case 3:
+        switch (t0) {
+            case 0:
+                if (mb_mmu_idx_is_user(mmu_idx))
+                    continue;
+                break;
+            case 2:
+                if (!mb_mmu_idx_is_user(mmu_idx)) {
                     tlb_ex = 1;
                     tlb_wr = 1;
-                    break;
-                default: break;
-            }
-
-            lu->err = ERR_PROT;
-            lu->prot = PAGE_READ;
-            if (tlb_wr)
-                lu->prot |= PAGE_WRITE;
-            else if (rw == 1)
-                goto done;
-            if (tlb_ex)
-                lu->prot |=PAGE_EXEC;
-            else if (rw == 2) {
-                goto done;
-            }
-
-            tlb_rpn = d & TLB_RPN_MASK;
+                }
+                break;
+            case 3:
+                tlb_ex = 1;
+                tlb_wr = 1;
+                break;
+            default: break;
+        }
 
-            lu->vaddr = tlb_tag;
-            lu->paddr = tlb_rpn & mmu->c_addr_mask;
-            lu->paddr = tlb_rpn;
-            lu->size = tlb_size;
-            lu->err = ERR_HIT;
-            lu->idx = i;
-            hit = 1;
+        lu->err = ERR_PROT;
+        lu->prot = PAGE_READ;
+        if (tlb_wr)
+            lu->prot |= PAGE_WRITE;
+        else if (rw == 1)
+            goto done;
+        if (tlb_ex)
+            lu->prot |=PAGE_EXEC;
+        else if (rw == 2) {
             goto done;
         }
+
+        tlb_rpn = d & TLB_RPN_MASK;
+
+        lu->vaddr = tlb_tag;
+        lu->paddr = tlb_rpn & mmu->c_addr_mask;
+        lu->paddr = tlb_rpn;
+        lu->size = tlb_size;
+        lu->err = ERR_HIT;
+        lu->idx = i;
+        hit = 1;
+        goto done;
     }
 done:
     D(qemu_log("MMU vaddr=%x rw=%d tlb_wr=%d tlb_ex=%d hit=%d\n",
@@ -205,8 +285,10 @@ uint32_t mmu_read(CPUMBState *env, bool ext, uint32_t rn)
 
             i = env->mmu.regs[MMU_R_TLBX] & 0xff;
             r = extract64(env->mmu.rams[rn & 1][i], ext * 32, 32);
-            if (rn == MMU_R_TLBHI)
+            if (rn == MMU_R_TLBHI) {
+                mmu_change_pid(env, env->mmu.tids[i]);
                 env->mmu.regs[MMU_R_PID] = env->mmu.tids[i];
+            }
             break;
         case MMU_R_PID:
         case MMU_R_ZPR:
@@ -258,9 +340,13 @@ void mmu_write(CPUMBState *env, bool ext, uint32_t rn, uint32_t v)
                              i, env->sregs[SR_PC]);
                 env->mmu.tids[i] = env->mmu.regs[MMU_R_PID] & 0xff;
                 mmu_flush_idx(env, i);
+                mmu_hash_remove(&env->mmu, i);
             }
             tmp64 = env->mmu.rams[rn & 1][i];
             env->mmu.rams[rn & 1][i] = deposit64(tmp64, ext * 32, 32, v);
+            if (rn == MMU_R_TLBHI) {
+                mmu_hash_insert(&env->mmu, i);
+            }
 
             D(qemu_log("%s ram[%d][%d]=%x\n", __func__, rn & 1, i, v));
             break;
@@ -323,4 +409,16 @@ void mmu_init(struct microblaze_mmu *mmu)
     for (i = 0; i < ARRAY_SIZE(mmu->regs); i++) {
         mmu->regs[i] = 0;
     }
+
+    memset(mmu->hash, -1, sizeof(mmu->hash));
+    memset(mmu->size_count, 0, sizeof(mmu->size_count));
+    for (i = 0; i < ARRAY_SIZE(mmu->rams[RAM_TAG]); i++) {
+        mmu_hash_insert(mmu, i);
+    }
+
+    /* PID 0 starts out in slot 0.  */
+    memset(mmu->slot_pid, 0, sizeof(mmu->slot_pid));
+    mmu->slot_valid = 1;
+    mmu->cur_slot = 0;
+    mmu->next_victim = 1;
 }
@@ -59,6 +59,7 @@
 #define R_TBLX_MISS_MASK (1U << 31)
 
 #define TLB_ENTRIES    64
+#define TLB_HASH_SIZE  64
 
 struct microblaze_mmu
 {
@@ -69,6 +70,19 @@ struct microblaze_mmu
     /* Control flops.  */
     uint32_t regs[3];
 
+    /* Valid entries chained by page size and tag, so lookups only visit
+     * the entries that can match (see mmu_hash()).
+     */
+    int8_t hash[TLB_HASH_SIZE];
+    int8_t hash_next[TLB_ENTRIES];
+    uint8_t size_count[8];
+
+    /* The PID whose translations each QEMU TLB slot holds.  */
+    uint8_t slot_pid[MB_PID_SLOTS];
+    uint8_t slot_valid;
+    uint8_t cur_slot;
+    uint8_t next_victim;
+
     int c_mmu;
     int c_mmu_tlb_access;
     int c_mmu_zones;
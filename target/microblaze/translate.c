@@ -55,6 +55,7 @@
 static TCGv_i32 env_debug;
 static TCGv_i32 cpu_R[32];
 static TCGv_i64 cpu_SR[14];
+static TCGv_i32 cpu_msr_c;
 static TCGv_i32 env_imm;
 static TCGv_i32 env_btaken;
 static TCGv_i32 env_btarget;
@@ -80,8 +81,19 @@ typedef struct DisasContext {
     unsigned int delayed_branch;
     unsigned int tb_flags, synced_flags; /* tb dependent flags.  */
     unsigned int clear_imm;
+    /* The value of the imm prefix in effect.  It is only stored to env
+       when the TB ends between the prefix and its insn; ext_imm_known is
+       false when the prefix was executed by the previous TB.  */
+    uint32_t ext_imm;
+    bool ext_imm_known;
     int is_jmp;
 
+    /* Branch state an exception in the delay slot needs: bimm and, for
+       direct branches, btarget.  t_sync_flags stores it along with
+       D_FLAG, so delay slot insns that cannot fault never pay for it.  */
+    bool bimm;
+    bool dslot_synced;
+
 #define JMP_NOJMP     0
 #define JMP_DIRECT    1
 #define JMP_DIRECT_CC 2
@@ -111,6 +123,17 @@ static const char *special_regnames[] =
 
 static inline void t_sync_flags(DisasContext *dc)
 {
+    if ((dc->tb_flags & D_FLAG) && !dc->dslot_synced) {
+        TCGv_i32 t0 = tcg_const_i32(dc->bimm);
+
+        tcg_gen_st_i32(t0, cpu_env, offsetof(CPUMBState, bimm));
+        tcg_temp_free_i32(t0);
+        if (dc->jmp == JMP_DIRECT || dc->jmp == JMP_DIRECT_CC) {
+            tcg_gen_movi_i32(env_btarget, dc->jmp_pc);
+        }
+        dc->dslot_synced = true;
+    }
+
     /* Synch the tb dependent flags between translator and runtime.  */
     if (dc->tb_flags != dc->synced_flags) {
         tcg_gen_movi_i32(env_iflags, dc->tb_flags);
@@ -118,6 +141,14 @@ static inline void t_sync_flags(DisasContext *dc)
     }
 }
 
+/* Publish a pending imm prefix that execution will resume after.  */
+static inline void t_sync_imm(DisasContext *dc)
+{
+    if ((dc->tb_flags & IMM_FLAG) && dc->ext_imm_known) {
+        tcg_gen_movi_i32(env_imm, dc->ext_imm);
+    }
+}
+
 static inline void t_gen_raise_exception(DisasContext *dc, uint32_t index)
 {
     TCGv_i32 tmp = tcg_const_i32(index);
@@ -152,8 +183,7 @@ static void gen_goto_tb(DisasContext *dc, int n, target_ulong dest)
 
 static void read_carry(DisasContext *dc, TCGv_i32 d)
 {
-    tcg_gen_extrl_i64_i32(d, cpu_SR[SR_MSR]);
-    tcg_gen_shri_i32(d, d, 31);
+    tcg_gen_mov_i32(d, cpu_msr_c);
 }
 
 /*
@@ -162,20 +192,12 @@ static void read_carry(DisasContext *dc, TCGv_i32 d)
  */
 static void write_carry(DisasContext *dc, TCGv_i32 v)
 {
-    TCGv_i64 t0 = tcg_temp_new_i64();
-    tcg_gen_extu_i32_i64(t0, v);
-    /* Deposit bit 0 into MSR_C and the alias MSR_CC.  */
-    tcg_gen_deposit_i64(cpu_SR[SR_MSR], cpu_SR[SR_MSR], t0, 2, 1);
-    tcg_gen_deposit_i64(cpu_SR[SR_MSR], cpu_SR[SR_MSR], t0, 31, 1);
-    tcg_temp_free_i64(t0);
+    tcg_gen_andi_i32(cpu_msr_c, v, 1);
 }
 
 static void write_carryi(DisasContext *dc, bool carry)
 {
-    TCGv_i32 t0 = tcg_temp_new_i32();
-    tcg_gen_movi_i32(t0, carry);
-    write_carry(dc, t0);
-    tcg_temp_free_i32(t0);
+    tcg_gen_movi_i32(cpu_msr_c, carry);
 }
 
 /*
@@ -199,7 +221,7 @@ static bool trap_illegal(DisasContext *dc, bool cond)
 static bool trap_userspace(DisasContext *dc, bool cond)
 {
     int mem_index = cpu_mmu_index(&dc->cpu->env, false);
-    bool cond_user = cond && mem_index == MMU_USER_IDX;
+    bool cond_user = cond && mb_mmu_idx_is_user(mem_index);
 
     if (cond_user && (dc->tb_flags & MSR_EE_FLAG)) {
         tcg_gen_movi_i64(cpu_SR[SR_ESR], ESR_EC_PRIVINSN);
@@ -219,7 +241,9 @@ static inline int dec_alu_op_b_is_small_imm(DisasContext *dc)
 static inline TCGv_i32 *dec_alu_op_b(DisasContext *dc)
 {
     if (dc->type_b) {
-        if (dc->tb_flags & IMM_FLAG)
+        if ((dc->tb_flags & IMM_FLAG) && dc->ext_imm_known)
+            tcg_gen_movi_i32(env_imm, dc->ext_imm | dc->imm);
+        else if (dc->tb_flags & IMM_FLAG)
             tcg_gen_ori_i32(env_imm, env_imm, dc->imm);
         else
             tcg_gen_movi_i32(env_imm, (int32_t)((int16_t)dc->imm));
@@ -437,7 +461,13 @@ static void dec_xor(DisasContext *dc)
 
 static inline void msr_read(DisasContext *dc, TCGv_i32 d)
 {
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    /* Replicate the carry into MSR_C and MSR_CC.  */
     tcg_gen_extrl_i64_i32(d, cpu_SR[SR_MSR]);
+    tcg_gen_muli_i32(t, cpu_msr_c, MSR_C_BITS);
+    tcg_gen_or_i32(d, d, t);
+    tcg_temp_free_i32(t);
 }
 
 static inline void msr_write(DisasContext *dc, TCGv_i32 v)
@@ -446,9 +476,10 @@ static inline void msr_write(DisasContext *dc, TCGv_i32 v)
 
     t = tcg_temp_new_i64();
     dc->cpustate_changed = 1;
-    /* PVR bit is not writable.  */
+    /* PVR bit is not writable, the carry lives in cpu_msr_c.  */
+    tcg_gen_extract_i32(cpu_msr_c, v, 2, 1);
     tcg_gen_extu_i32_i64(t, v);
-    tcg_gen_andi_i64(t, t, ~MSR_PVR);
+    tcg_gen_andi_i64(t, t, ~(MSR_PVR | (uint64_t)MSR_C_BITS));
     tcg_gen_andi_i64(cpu_SR[SR_MSR], cpu_SR[SR_MSR], MSR_PVR);
     tcg_gen_or_i64(cpu_SR[SR_MSR], cpu_SR[SR_MSR], t);
     tcg_temp_free_i64(t);
@@ -529,6 +560,10 @@ static void dec_msr(DisasContext *dc)
         } else {
             gen_helper_mmu_read(cpu_R[dc->rd], cpu_env,
                                 tcg_const_i32(extended), tcg_const_i32(sr));
+            if (sr == MMU_R_TLBHI) {
+                /* Reading TLBHI loads PID, which may switch PID slot.  */
+                dc->cpustate_changed = 1;
+            }
         }
         return;
     }
@@ -750,8 +785,7 @@ static void dec_bit(DisasContext *dc)
             t0 = tcg_temp_new_i32();
 
             LOG_DIS("src r%d r%d\n", dc->rd, dc->ra);
-            tcg_gen_extrl_i64_i32(t0, cpu_SR[SR_MSR]);
-            tcg_gen_andi_i32(t0, t0, MSR_CC);
+            tcg_gen_shli_i32(t0, cpu_msr_c, 31);
             write_carry(dc, cpu_R[dc->ra]);
             if (dc->rd) {
                 tcg_gen_shri_i32(cpu_R[dc->rd], cpu_R[dc->ra], 1);
@@ -834,7 +868,9 @@ static inline void sync_jmpstate(DisasContext *dc)
 static void dec_imm(DisasContext *dc)
 {
     LOG_DIS("imm %x\n", dc->imm << 16);
-    tcg_gen_movi_i32(env_imm, (dc->imm << 16));
+    /* Folded into the next insn; see dec_alu_op_b.  */
+    dc->ext_imm = dc->imm << 16;
+    dc->ext_imm_known = true;
     dc->tb_flags |= IMM_FLAG;
     dc->clear_imm = 0;
 }
@@ -1192,14 +1228,13 @@ static void dec_bcc(DisasContext *dc)
     if (dslot) {
         dc->delayed_branch = 2;
         dc->tb_flags |= D_FLAG;
-        tcg_gen_st_i32(tcg_const_i32(dc->type_b && (dc->tb_flags & IMM_FLAG)),
-                      cpu_env, offsetof(CPUMBState, bimm));
+        dc->bimm = dc->type_b && (dc->tb_flags & IMM_FLAG);
+        dc->dslot_synced = false;
     }
 
     if (dec_alu_op_b_is_small_imm(dc)) {
         int32_t offset = (int32_t)((int16_t)dc->imm); /* sign-extend.  */
 
-        tcg_gen_movi_i32(env_btarget, dc->pc + offset);
         dc->jmp = JMP_DIRECT_CC;
         dc->jmp_pc = dc->pc + offset;
     } else {
@@ -1252,8 +1287,8 @@ static void dec_br(DisasContext *dc)
     if (dslot) {
         dc->delayed_branch = 2;
         dc->tb_flags |= D_FLAG;
-        tcg_gen_st_i32(tcg_const_i32(dc->type_b && (dc->tb_flags & IMM_FLAG)),
-                      cpu_env, offsetof(CPUMBState, bimm));
+        dc->bimm = dc->type_b && (dc->tb_flags & IMM_FLAG);
+        dc->dslot_synced = false;
     }
     if (link && dc->rd)
         tcg_gen_movi_i32(cpu_R[dc->rd], dc->pc);
@@ -1290,7 +1325,7 @@ static inline void do_rti(DisasContext *dc)
     TCGv_i32 t0, t1;
     t0 = tcg_temp_new_i32();
     t1 = tcg_temp_new_i32();
-    tcg_gen_extrl_i64_i32(t1, cpu_SR[SR_MSR]);
+    msr_read(dc, t1);
     tcg_gen_shri_i32(t0, t1, 1);
     tcg_gen_ori_i32(t1, t1, MSR_IE);
     tcg_gen_andi_i32(t0, t0, (MSR_VM | MSR_UM));
@@ -1308,7 +1343,7 @@ static inline void do_rtb(DisasContext *dc)
     TCGv_i32 t0, t1;
     t0 = tcg_temp_new_i32();
     t1 = tcg_temp_new_i32();
-    tcg_gen_extrl_i64_i32(t1, cpu_SR[SR_MSR]);
+    msr_read(dc, t1);
     tcg_gen_andi_i32(t1, t1, ~MSR_BIP);
     tcg_gen_shri_i32(t0, t1, 1);
     tcg_gen_andi_i32(t0, t0, (MSR_VM | MSR_UM));
@@ -1327,7 +1362,7 @@ static inline void do_rte(DisasContext *dc)
     t0 = tcg_temp_new_i32();
     t1 = tcg_temp_new_i32();
 
-    tcg_gen_extrl_i64_i32(t1, cpu_SR[SR_MSR]);
+    msr_read(dc, t1);
     tcg_gen_ori_i32(t1, t1, MSR_EE);
     tcg_gen_andi_i32(t1, t1, ~MSR_EIP);
     tcg_gen_shri_i32(t0, t1, 1);
@@ -1355,8 +1390,8 @@ static void dec_rts(DisasContext *dc)
 
     dc->delayed_branch = 2;
     dc->tb_flags |= D_FLAG;
-    tcg_gen_st_i32(tcg_const_i32(dc->type_b && (dc->tb_flags & IMM_FLAG)),
-                  cpu_env, offsetof(CPUMBState, bimm));
+    dc->bimm = dc->type_b && (dc->tb_flags & IMM_FLAG);
+    dc->dslot_synced = false;
 
     if (i_bit) {
         LOG_DIS("rtid ir=%x\n", dc->ir);
@@ -1620,6 +1655,8 @@ void gen_intermediate_code(CPUState *cs, struct TranslationBlock *tb)
     dc->cpustate_changed = 0;
     dc->abort_at_next_insn = 0;
     dc->nr_nops = 0;
+    dc->ext_imm_known = false;
+    dc->dslot_synced = true;
 
     if (pc_start & 3) {
         cpu_abort(cs, "Microblaze: unaligned PC=%x\n", pc_start);
@@ -1649,6 +1686,7 @@ void gen_intermediate_code(CPUState *cs, struct TranslationBlock *tb)
 #endif
 
         if (unlikely(cpu_breakpoint_test(cs, dc->pc, BP_ANY))) {
+            t_sync_imm(dc);
             t_gen_raise_exception(dc, EXCP_DEBUG);
             dc->is_jmp = DISAS_UPDATE;
             /* The address covered by the breakpoint must be included in
@@ -1732,6 +1770,7 @@ void gen_intermediate_code(CPUState *cs, struct TranslationBlock *tb)
         dc->is_jmp = DISAS_UPDATE;
         tcg_gen_movi_i64(cpu_SR[SR_PC], npc);
     }
+    t_sync_imm(dc);
     t_sync_flags(dc);
 
     if (unlikely(cs->singlestep_enabled)) {
@@ -1796,7 +1835,7 @@ void mb_cpu_dump_state(CPUState *cs, FILE *f, fprintf_function cpu_fprintf,
                 env->sregs[SR_PC], lookup_symbol(env->sregs[SR_PC]));
     cpu_fprintf(f, "rmsr=%" PRIx64 " resr=%" PRIx64 " rear=%" PRIx64 " "
                    "debug=%x imm=%x iflags=%x fsr=%" PRIx64 "\n",
-             env->sregs[SR_MSR], env->sregs[SR_ESR], env->sregs[SR_EAR],
+             mb_cpu_read_msr(env), env->sregs[SR_ESR], env->sregs[SR_EAR],
              env->debug, env->imm, env->iflags, env->sregs[SR_FSR]);
     cpu_fprintf(f, "btaken=%d btarget=%x mode=%s(saved=%s) eip=%d ie=%d\n",
              env->btaken, env->btarget,
@@ -1826,6 +1865,9 @@ void mb_tcg_init(void)
     env_imm = tcg_global_mem_new_i32(cpu_env,
                     offsetof(CPUMBState, imm),
                     "imm");
+    cpu_msr_c = tcg_global_mem_new_i32(cpu_env,
+                    offsetof(CPUMBState, msr_c),
+                    "msr_c");
     env_btarget = tcg_global_mem_new_i32(cpu_env,
                      offsetof(CPUMBState, btarget),
                      "btarget");
@@ -285,12 +285,15 @@ static inline int tcg_target_const_match(tcg_target_long val, TCGType type,
 #define OPC_ARITH_GvEv	(0x03)		/* ... plus (ARITH_FOO << 3) */
 #define OPC_ANDN        (0xf2 | P_EXT38)
 #define OPC_ADD_GvEv	(OPC_ARITH_GvEv | (ARITH_ADD << 3))
+#define OPC_AND_GvEv	(OPC_ARITH_GvEv | (ARITH_AND << 3))
 #define OPC_BSF         (0xbc | P_EXT)
 #define OPC_BSR         (0xbd | P_EXT)
 #define OPC_BSWAP	(0xc8 | P_EXT)
 #define OPC_CALL_Jz	(0xe8)
 #define OPC_CMOVCC      (0x40 | P_EXT)  /* ... plus condition code */
 #define OPC_CMP_GvEv	(OPC_ARITH_GvEv | (ARITH_CMP << 3))
+#define OPC_CMPXCHG_EbGb (0xb0 | P_EXT)
+#define OPC_CMPXCHG_EvGv (0xb1 | P_EXT)
 #define OPC_DEC_r32	(0x48)
 #define OPC_IMUL_GvEv	(0xaf | P_EXT)
 #define OPC_IMUL_GvEvIb	(0x6b)
@@ -1245,9 +1248,15 @@ static void * const qemu_st_helpers[16] = {
    WHICH is the offset into the CPUTLBEntry structure of the slot to read.
    This should be offsetof addr_read or addr_write.
 
+   RMW requests that addr_read match as well, for read-modify-write
+   accesses to pages that must be both readable and writable.  It is only
+   supported when TARGET_LONG_BITS <= TCG_TARGET_REG_BITS.
+
    Outputs:
-   LABEL_PTRS is filled with 1 (32-bit addresses) or 2 (64-bit addresses)
-   positions of the displacements of forward jumps to the TLB miss case.
+   LABEL_PTRS is filled with 1 (32-bit addresses) or 2 (64-bit addresses,
+   or RMW) positions of the displacements of forward jumps to the TLB miss
+   case.  The RMW jump is taken with the second argument register holding
+   the page-masked address instead of ADDRLO.
 
    Second argument register is loaded with the low part of the address.
    In the TLB hit case, it has been adjusted as indicated by the TLB
@@ -1258,7 +1267,8 @@ static void * const qemu_st_helpers[16] = {
 
 static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
                                     int mem_index, TCGMemOp opc,
-                                    tcg_insn_unit **label_ptr, int which)
+                                    tcg_insn_unit **label_ptr, int which,
+                                    bool rmw)
 {
     const TCGReg r0 = TCG_REG_L0;
     const TCGReg r1 = TCG_REG_L1;
@@ -1270,6 +1280,8 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
     unsigned a_mask = (1 << a_bits) - 1;
     unsigned s_mask = (1 << s_bits) - 1;
     target_ulong tlb_mask;
+    int mask_off = offsetof(CPUArchState, tlb_mask[mem_index]);
+    int table_off = offsetof(CPUArchState, tlb_table[mem_index]);
 
     if (TCG_TARGET_REG_BITS == 64) {
         if (TARGET_LONG_BITS == 64) {
@@ -1278,14 +1290,22 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
         }
         if (TCG_TYPE_PTR == TCG_TYPE_I64) {
             hrexw = P_REXW;
-            if (TARGET_PAGE_BITS + CPU_TLB_BITS > 32) {
+            if (TARGET_PAGE_BITS + CPU_TLB_DYN_MAX_BITS > 32) {
                 tlbtype = TCG_TYPE_I64;
                 tlbrexw = P_REXW;
             }
         }
     }
 
+    /* The TLB is sized at run time, so rather than an immediate mask
+       and a displacement off env, pick the mask and the table base up
+       from env.  */
     tcg_out_mov(s, tlbtype, r0, addrlo);
+    tcg_out_shifti(s, SHIFT_SHR + tlbrexw, r0,
+                   TARGET_PAGE_BITS - CPU_TLB_ENTRY_BITS);
+    tcg_out_modrm_offset(s, OPC_AND_GvEv + tlbrexw, r0, TCG_AREG0, mask_off);
+    tcg_out_modrm_offset(s, OPC_ADD_GvEv + hrexw, r0, TCG_AREG0, table_off);
+
     /* If the required alignment is at least as large as the access, simply
        copy the address and mask.  For lesser alignments, check that we don't
        cross pages for the complete access.  */
@@ -1295,20 +1315,23 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
         tcg_out_modrm_offset(s, OPC_LEA + trexw, r1, addrlo, s_mask - a_mask);
     }
     tlb_mask = (target_ulong)TARGET_PAGE_MASK | a_mask;
+    tgen_arithi(s, ARITH_AND + trexw, r1, tlb_mask, 0);
 
-    tcg_out_shifti(s, SHIFT_SHR + tlbrexw, r0,
-                   TARGET_PAGE_BITS - CPU_TLB_ENTRY_BITS);
+    /* cmp which(r0), r1 */
+    tcg_out_modrm_offset(s, OPC_CMP_GvEv + trexw, r1, r0, which);
 
-    tgen_arithi(s, ARITH_AND + trexw, r1, tlb_mask, 0);
-    tgen_arithi(s, ARITH_AND + tlbrexw, r0,
-                (CPU_TLB_SIZE - 1) << CPU_TLB_ENTRY_BITS, 0);
+    if (rmw) {
+        tcg_debug_assert(TARGET_LONG_BITS <= TCG_TARGET_REG_BITS);
 
-    tcg_out_modrm_sib_offset(s, OPC_LEA + hrexw, r0, TCG_AREG0, r0, 0,
-                             offsetof(CPUArchState, tlb_table[mem_index][0])
-                             + which);
+        /* jne slow_path */
+        tcg_out_opc(s, OPC_JCC_long + JCC_JNE, 0, 0, 0);
+        label_ptr[1] = s->code_ptr;
+        s->code_ptr += 4;
 
-    /* cmp 0(r0), r1 */
-    tcg_out_modrm_offset(s, OPC_CMP_GvEv + trexw, r1, r0, 0);
+        /* cmp addr_read(r0), r1 */
+        tcg_out_modrm_offset(s, OPC_CMP_GvEv + trexw, r1, r0,
+                             offsetof(CPUTLBEntry, addr_read));
+    }
 
     /* Prepare for both the fast path add of the tlb addend, and the slow
        path function argument setup.  There are two cases worth note:
@@ -1324,8 +1347,8 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
     s->code_ptr += 4;
 
     if (TARGET_LONG_BITS > TCG_TARGET_REG_BITS) {
-        /* cmp 4(r0), addrhi */
-        tcg_out_modrm_offset(s, OPC_CMP_GvEv, addrhi, r0, 4);
+        /* cmp which+4(r0), addrhi */
+        tcg_out_modrm_offset(s, OPC_CMP_GvEv, addrhi, r0, which + 4);
 
         /* jne slow_path */
         tcg_out_opc(s, OPC_JCC_long + JCC_JNE, 0, 0, 0);
@@ -1337,7 +1360,7 @@ static inline void tcg_out_tlb_load(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
 
     /* add addend(r0), r1 */
     tcg_out_modrm_offset(s, OPC_ADD_GvEv + hrexw, r1, r0,
-                         offsetof(CPUTLBEntry, addend) - which);
+                         offsetof(CPUTLBEntry, addend));
 }
 
 /*
@@ -1515,6 +1538,61 @@ static void tcg_out_qemu_st_slow_path(TCGContext *s, TCGLabelQemuLdst *l)
     tcg_out_push(s, retaddr);
     tcg_out_jmp(s, qemu_st_helpers[opc & (MO_BSWAP | MO_SIZE)]);
 }
+
+#if TCG_TARGET_HAS_qemu_cmpxchg
+/* helper signature: helper_atomic_cmpxchg_mmu(CPUState *env, target_ulong addr,
+ *                                             uintxx_t cmpv, uintxx_t newv,
+ *                                             TCGMemOpIdx oi, uintptr_t ra)
+ * Only host-endian accesses are inlined.
+ */
+static void * const qemu_cmpxchg_helpers[16] = {
+    [MO_UB]   = helper_atomic_cmpxchgb_mmu,
+    [MO_LEUW] = helper_atomic_cmpxchgw_le_mmu,
+    [MO_LEUL] = helper_atomic_cmpxchgl_le_mmu,
+    [MO_LEQ]  = helper_atomic_cmpxchgq_le_mmu,
+};
+
+/*
+ * Generate code for the slow path for a compare-and-swap at the end of block
+ */
+static void tcg_out_qemu_cmpxchg_slow_path(TCGContext *s, TCGLabelQemuLdst *l)
+{
+    TCGMemOpIdx oi = l->oi;
+    TCGMemOp opc = get_memop(oi);
+    TCGType dtype = (opc & MO_SIZE) == MO_64 ? TCG_TYPE_I64 : TCG_TYPE_I32;
+
+    tcg_patch32(l->label_ptr[0], s->code_ptr - l->label_ptr[0] - 4);
+    tcg_patch32(l->label_ptr[1], s->code_ptr - l->label_ptr[1] - 4);
+
+    /* The "L" constraint keeps addr and newv out of the first two argument
+       registers, and cmpv is in RAX, so filling the arguments in this
+       order reads every input before it can be overwritten.  */
+    tcg_out_mov(s, TCG_TYPE_TL, tcg_target_call_iarg_regs[1], l->addrlo_reg);
+    tcg_out_mov(s, dtype, tcg_target_call_iarg_regs[3], l->datahi_reg);
+    tcg_out_mov(s, dtype, tcg_target_call_iarg_regs[2], TCG_REG_RAX);
+    tcg_out_mov(s, TCG_TYPE_PTR, tcg_target_call_iarg_regs[0], TCG_AREG0);
+
+    if (ARRAY_SIZE(tcg_target_call_iarg_regs) > 5) {
+        tcg_out_movi(s, TCG_TYPE_I32, tcg_target_call_iarg_regs[4], oi);
+        tcg_out_movi(s, TCG_TYPE_PTR, tcg_target_call_iarg_regs[5],
+                     (uintptr_t)l->raddr);
+    } else {
+        tcg_out_sti(s, TCG_TYPE_I32, oi, TCG_REG_ESP,
+                    TCG_TARGET_CALL_STACK_OFFSET);
+        tcg_out_movi(s, TCG_TYPE_PTR, TCG_REG_RAX, (uintptr_t)l->raddr);
+        tcg_out_st(s, TCG_TYPE_PTR, TCG_REG_RAX, TCG_REG_ESP,
+                   TCG_TARGET_CALL_STACK_OFFSET + 8);
+    }
+
+    tcg_out_call(s, qemu_cmpxchg_helpers[opc & (MO_BSWAP | MO_SIZE)]);
+
+    /* The helpers return at most 32 valid bits for the smaller sizes.  */
+    if (l->type == TCG_TYPE_I64 && dtype == TCG_TYPE_I32) {
+        tcg_out_ext32u(s, TCG_REG_RAX, TCG_REG_RAX);
+    }
+    tcg_out_jmp(s, l->raddr);
+}
+#endif /* TCG_TARGET_HAS_qemu_cmpxchg */
 #elif defined(__x86_64__) && defined(__linux__)
 # include <asm/prctl.h>
 # include <sys/prctl.h>
@@ -1659,7 +1737,7 @@ static void tcg_out_qemu_ld(TCGContext *s, const TCGArg *args, bool is64)
     mem_index = get_mmuidx(oi);
 
     tcg_out_tlb_load(s, addrlo, addrhi, mem_index, opc,
-                     label_ptr, offsetof(CPUTLBEntry, addr_read));
+                     label_ptr, offsetof(CPUTLBEntry, addr_read), false);
 
     /* TLB Hit.  */
     tcg_out_qemu_ld_direct(s, datalo, datahi, TCG_REG_L1, -1, 0, 0, opc);
@@ -1799,7 +1877,7 @@ static void tcg_out_qemu_st(TCGContext *s, const TCGArg *args, bool is64)
     mem_index = get_mmuidx(oi);
 
     tcg_out_tlb_load(s, addrlo, addrhi, mem_index, opc,
-                     label_ptr, offsetof(CPUTLBEntry, addr_write));
+                     label_ptr, offsetof(CPUTLBEntry, addr_write), false);
 
     /* TLB Hit.  */
     tcg_out_qemu_st_direct(s, datalo, datahi, TCG_REG_L1, 0, 0, opc);
@@ -1843,6 +1921,82 @@ static void tcg_out_qemu_st(TCGContext *s, const TCGArg *args, bool is64)
 #endif
 }
 
+static void tcg_out_qemu_cmpxchg(TCGContext *s, const TCGArg *args, bool is64)
+{
+#if defined(CONFIG_SOFTMMU) && TCG_TARGET_HAS_qemu_cmpxchg
+    TCGReg datalo = args[0];
+    TCGReg addrlo = args[1];
+    TCGReg cmpv = args[2];
+    TCGReg newv = args[3];
+    TCGMemOpIdx oi = args[4];
+    TCGMemOp opc = get_memop(oi);
+    TCGLabelQemuLdst *label;
+    tcg_insn_unit *label_ptr[2];
+
+    /* Both the comparison value and the result live in RAX.  */
+    tcg_debug_assert(datalo == TCG_REG_RAX && cmpv == TCG_REG_RAX);
+
+    /* Require natural alignment for the fast path; anything else is left
+       to the helper, which also raises the guest alignment fault.  */
+    tcg_out_tlb_load(s, addrlo, 0, get_mmuidx(oi),
+                     (opc & ~MO_AMASK) | MO_ALIGN, label_ptr,
+                     offsetof(CPUTLBEntry, addr_write), true);
+
+    /* TLB Hit.  lock cmpxchg newv, (L1) */
+    tcg_out8(s, 0xf0);
+    switch (opc & MO_SIZE) {
+    case MO_8:
+        tcg_out_modrm_offset(s, OPC_CMPXCHG_EbGb + P_REXB_R, newv,
+                             TCG_REG_L1, 0);
+        break;
+    case MO_16:
+        tcg_out_modrm_offset(s, OPC_CMPXCHG_EvGv + P_DATA16, newv,
+                             TCG_REG_L1, 0);
+        break;
+    case MO_32:
+        tcg_out_modrm_offset(s, OPC_CMPXCHG_EvGv, newv, TCG_REG_L1, 0);
+        break;
+    case MO_64:
+        tcg_out_modrm_offset(s, OPC_CMPXCHG_EvGv + P_REXW, newv,
+                             TCG_REG_L1, 0);
+        break;
+    default:
+        tcg_abort();
+    }
+
+    /* On success the accumulator is left holding all of cmpv, so
+       zero-extend it to the size of the access either way.  */
+    switch (opc & MO_SIZE) {
+    case MO_8:
+        tcg_out_ext8u(s, TCG_REG_RAX, TCG_REG_RAX);
+        break;
+    case MO_16:
+        tcg_out_ext16u(s, TCG_REG_RAX, TCG_REG_RAX);
+        break;
+    case MO_32:
+        if (is64) {
+            tcg_out_ext32u(s, TCG_REG_RAX, TCG_REG_RAX);
+        }
+        break;
+    }
+
+    label = new_ldst_label(s);
+    label->is_ld = false;
+    label->is_cmpxchg = true;
+    label->oi = oi;
+    label->type = is64 ? TCG_TYPE_I64 : TCG_TYPE_I32;
+    label->datalo_reg = datalo;
+    label->datahi_reg = newv;
+    label->addrlo_reg = addrlo;
+    label->raddr = s->code_ptr;
+    label->label_ptr[0] = label_ptr[0];
+    label->label_ptr[1] = label_ptr[1];
+#else
+    /* Only emitted for the softmmu on 64-bit hosts.  */
+    tcg_abort();
+#endif
+}
+
 static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
                               const TCGArg *args, const int *const_args)
 {
@@ -2127,6 +2281,12 @@ static inline void tcg_out_op(TCGContext *s, TCGOpcode opc,
     case INDEX_op_qemu_st_i64:
         tcg_out_qemu_st(s, args, 1);
         break;
+    case INDEX_op_qemu_cmpxchg_i32:
+        tcg_out_qemu_cmpxchg(s, args, 0);
+        break;
+    case INDEX_op_qemu_cmpxchg_i64:
+        tcg_out_qemu_cmpxchg(s, args, 1);
+        break;
 
     OP_32_64(mulu2):
         tcg_out_modrm(s, OPC_GRP3_Ev + rexw, EXT3_MUL, args[3]);
@@ -2479,6 +2639,13 @@ static const TCGTargetOpDef *tcg_target_op_def(TCGOpcode op)
         return (TCG_TARGET_REG_BITS == 64 ? &L_L
                 : TARGET_LONG_BITS <= TCG_TARGET_REG_BITS ? &L_L_L
                 : &L_L_L_L);
+    case INDEX_op_qemu_cmpxchg_i32:
+    case INDEX_op_qemu_cmpxchg_i64:
+        {
+            static const TCGTargetOpDef cmpxchg
+                = { .args_ct_str = { "a", "L", "0", "L" } };
+            return &cmpxchg;
+        }
 
     case INDEX_op_brcond2_i32:
         {
@@ -108,6 +108,41 @@ static void init_arg_info(struct tcg_temp_info *infos,
     init_ts_info(infos, temps_used, arg_temp(arg));
 }
 
+/* The fall through path of a conditional branch can only be reached from
+ * the branch, so the constants held in globals and local temps are still
+ * known there; labels, where paths merge, reset everything.  Normal temps
+ * die at the branch, and so do copies, which may name one of them.
+ */
+static void reset_temps_past_cond_branch(TCGContext *s,
+                                         TCGTempSet *temps_used)
+{
+    int nb_temps = s->nb_temps;
+    int i;
+
+    for (i = find_first_bit(temps_used->l, nb_temps); i < nb_temps;
+         i = find_next_bit(temps_used->l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+        struct tcg_temp_info *ti = ts_info(ts);
+
+        if ((ts->temp_global || ts->temp_local) && ti->is_const) {
+            tcg_target_ulong val = ti->val, mask = ti->mask;
+
+            reset_ts(ts);
+            ti->is_const = true;
+            ti->val = val;
+            ti->mask = mask;
+        }
+    }
+    for (i = find_first_bit(temps_used->l, nb_temps); i < nb_temps;
+         i = find_next_bit(temps_used->l, nb_temps, i + 1)) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (!(ts->temp_global || ts->temp_local) || !ts_is_const(ts)) {
+            clear_bit(i, temps_used->l);
+        }
+    }
+}
+
 static int op_bits(TCGOpcode op)
 {
     const TCGOpDef *def = &tcg_op_defs[op];
@@ -1454,7 +1489,10 @@ void tcg_optimize(TCGContext *s)
                We trash everything if the operation is the end of a basic
                block, otherwise we only trash the output args.  "mask" is
                the non-zero bits mask for the first output arg.  */
-            if (def->flags & TCG_OPF_BB_END) {
+            if (opc == INDEX_op_brcond_i32 || opc == INDEX_op_brcond_i64 ||
+                opc == INDEX_op_brcond2_i32) {
+                reset_temps_past_cond_branch(s, &temps_used);
+            } else if (def->flags & TCG_OPF_BB_END) {
                 bitmap_zero(temps_used.l, nb_temps);
             } else {
         do_reset_output:
@@ -1499,6 +1537,8 @@ void tcg_optimize(TCGContext *s)
             case INDEX_op_qemu_ld_i64:
             case INDEX_op_qemu_st_i32:
             case INDEX_op_qemu_st_i64:
+            case INDEX_op_qemu_cmpxchg_i32:
+            case INDEX_op_qemu_cmpxchg_i64:
             case INDEX_op_call:
                 /* Opcodes that touch guest memory stop the optimization.  */
                 prev_mb = NULL;
@@ -22,6 +22,7 @@
 
 typedef struct TCGLabelQemuLdst {
     bool is_ld;             /* qemu_ld: true, qemu_st: false */
+    bool is_cmpxchg;        /* qemu_cmpxchg, datahi_reg holds newv */
     TCGMemOpIdx oi;
     TCGType type;           /* result type of a load */
     TCGReg addrlo_reg;      /* reg index for low word of guest virtual addr */
@@ -40,6 +41,10 @@ typedef struct TCGLabelQemuLdst {
 
 static void tcg_out_qemu_ld_slow_path(TCGContext *s, TCGLabelQemuLdst *l);
 static void tcg_out_qemu_st_slow_path(TCGContext *s, TCGLabelQemuLdst *l);
+#if TCG_TARGET_HAS_qemu_cmpxchg
+static void tcg_out_qemu_cmpxchg_slow_path(TCGContext *s,
+                                           TCGLabelQemuLdst *l);
+#endif
 
 static bool tcg_out_ldst_finalize(TCGContext *s)
 {
@@ -47,6 +52,11 @@ static bool tcg_out_ldst_finalize(TCGContext *s)
 
     /* qemu_ld/st slow paths */
     for (lb = s->ldst_labels; lb != NULL; lb = lb->next) {
+#if TCG_TARGET_HAS_qemu_cmpxchg
+        if (lb->is_cmpxchg) {
+            tcg_out_qemu_cmpxchg_slow_path(s, lb);
+        } else
+#endif
         if (lb->is_ld) {
             tcg_out_qemu_ld_slow_path(s, lb);
         } else {
@@ -72,6 +82,7 @@ static inline TCGLabelQemuLdst *new_ldst_label(TCGContext *s)
 {
     TCGLabelQemuLdst *l = tcg_malloc(sizeof(*l));
 
+    l->is_cmpxchg = false;
     l->next = s->ldst_labels;
     s->ldst_labels = l;
     return l;
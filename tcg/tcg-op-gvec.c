@@ -0,0 +1,272 @@
+/*
+ * Generic vector operation expansion
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "tcg.h"
+#include "tcg-op.h"
+#include "tcg-op-gvec.h"
+
+typedef void GVecGen2Fn(unsigned vece, TCGv_i64 d, TCGv_i64 a);
+typedef void GVecGen3Fn(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b);
+
+/* Verify vector size and alignment rules.  OFS should be the OR of all
+   of the operand offsets so that we can check them all at once.  */
+static void check_size_align(uint32_t oprsz, uint32_t maxsz, uint32_t ofs)
+{
+    uint32_t align = maxsz > 8 ? 15 : 7;
+
+    tcg_debug_assert(oprsz > 0);
+    tcg_debug_assert(oprsz <= maxsz);
+    tcg_debug_assert((oprsz & align) == 0 || oprsz == 8);
+    tcg_debug_assert((maxsz & align) == 0);
+    tcg_debug_assert((ofs & 7) == 0);
+}
+
+/* Replicate the low element of C, of size VECE, across 64 bits.  */
+static uint64_t gvec_dup_const(unsigned vece, uint64_t c)
+{
+    switch (vece) {
+    case MO_8:
+        return 0x0101010101010101ull * (uint8_t)c;
+    case MO_16:
+        return 0x0001000100010001ull * (uint16_t)c;
+    case MO_32:
+        return 0x0000000100000001ull * (uint32_t)c;
+    case MO_64:
+        return c;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* Clear MAXSZ bytes at DOFS.  */
+static void expand_clr(uint32_t dofs, uint32_t maxsz)
+{
+    TCGv_i64 zero = tcg_const_i64(0);
+    uint32_t i;
+
+    for (i = 0; i < maxsz; i += 8) {
+        tcg_gen_st_i64(zero, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(zero);
+}
+
+static void expand_2_i64(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t oprsz, uint32_t maxsz, GVecGen2Fn *fni)
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    uint32_t i;
+
+    check_size_align(oprsz, maxsz, dofs | aofs);
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + i);
+        fni(vece, t0, t0);
+        tcg_gen_st_i64(t0, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(t0);
+
+    if (oprsz < maxsz) {
+        expand_clr(dofs + oprsz, maxsz - oprsz);
+    }
+}
+
+static void expand_3_i64(unsigned vece, uint32_t dofs, uint32_t aofs,
+                         uint32_t bofs, uint32_t oprsz, uint32_t maxsz,
+                         GVecGen3Fn *fni)
+{
+    TCGv_i64 t0 = tcg_temp_new_i64();
+    TCGv_i64 t1 = tcg_temp_new_i64();
+    uint32_t i;
+
+    check_size_align(oprsz, maxsz, dofs | aofs | bofs);
+    for (i = 0; i < oprsz; i += 8) {
+        tcg_gen_ld_i64(t0, cpu_env, aofs + i);
+        tcg_gen_ld_i64(t1, cpu_env, bofs + i);
+        fni(vece, t0, t0, t1);
+        tcg_gen_st_i64(t0, cpu_env, dofs + i);
+    }
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t0);
+
+    if (oprsz < maxsz) {
+        expand_clr(dofs + oprsz, maxsz - oprsz);
+    }
+}
+
+/* Perform a vector addition using normal addition and a mask.  The mask
+   should be the sign bit of each lane.  This 6-operation form is more
+   efficient than separate additions when there are 4 or more lanes in
+   the 64-bit operation.  */
+void tcg_gen_vec_add_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 m, t1, t2, t3;
+
+    if (vece == MO_64) {
+        tcg_gen_add_i64(d, a, b);
+        return;
+    }
+
+    m = tcg_const_i64(gvec_dup_const(vece, 1ull << ((8 << vece) - 1)));
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+
+    tcg_gen_andc_i64(t1, a, m);
+    tcg_gen_andc_i64(t2, b, m);
+    tcg_gen_xor_i64(t3, a, b);
+    tcg_gen_add_i64(d, t1, t2);
+    tcg_gen_and_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(m);
+}
+
+/* As above, setting the sign bit of each lane of A so that no borrow
+   crosses into the next lane.  */
+void tcg_gen_vec_sub_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    TCGv_i64 m, t1, t2, t3;
+
+    if (vece == MO_64) {
+        tcg_gen_sub_i64(d, a, b);
+        return;
+    }
+
+    m = tcg_const_i64(gvec_dup_const(vece, 1ull << ((8 << vece) - 1)));
+    t1 = tcg_temp_new_i64();
+    t2 = tcg_temp_new_i64();
+    t3 = tcg_temp_new_i64();
+
+    tcg_gen_or_i64(t1, a, m);
+    tcg_gen_andc_i64(t2, b, m);
+    tcg_gen_eqv_i64(t3, a, b);
+    tcg_gen_sub_i64(d, t1, t2);
+    tcg_gen_and_i64(t3, t3, m);
+    tcg_gen_xor_i64(d, d, t3);
+
+    tcg_temp_free_i64(t1);
+    tcg_temp_free_i64(t2);
+    tcg_temp_free_i64(t3);
+    tcg_temp_free_i64(m);
+}
+
+void tcg_gen_vec_neg_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a)
+{
+    TCGv_i64 zero = tcg_const_i64(0);
+
+    tcg_gen_vec_sub_i64(vece, d, zero, a);
+    tcg_temp_free_i64(zero);
+}
+
+static void vec_mov_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a)
+{
+    tcg_gen_mov_i64(d, a);
+}
+
+static void vec_not_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a)
+{
+    tcg_gen_not_i64(d, a);
+}
+
+static void vec_and_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_and_i64(d, a, b);
+}
+
+static void vec_or_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_or_i64(d, a, b);
+}
+
+static void vec_xor_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_xor_i64(d, a, b);
+}
+
+static void vec_andc_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_andc_i64(d, a, b);
+}
+
+static void vec_orc_i64(unsigned vece, TCGv_i64 d, TCGv_i64 a, TCGv_i64 b)
+{
+    tcg_gen_orc_i64(d, a, b);
+}
+
+void tcg_gen_gvec_mov(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    if (dofs == aofs) {
+        check_size_align(oprsz, maxsz, dofs);
+        if (oprsz < maxsz) {
+            expand_clr(dofs + oprsz, maxsz - oprsz);
+        }
+        return;
+    }
+    expand_2_i64(vece, dofs, aofs, oprsz, maxsz, vec_mov_i64);
+}
+
+void tcg_gen_gvec_not(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    expand_2_i64(vece, dofs, aofs, oprsz, maxsz, vec_not_i64);
+}
+
+void tcg_gen_gvec_neg(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t oprsz, uint32_t maxsz)
+{
+    expand_2_i64(vece, dofs, aofs, oprsz, maxsz, tcg_gen_vec_neg_i64);
+}
+
+void tcg_gen_gvec_add(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, tcg_gen_vec_add_i64);
+}
+
+void tcg_gen_gvec_sub(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, tcg_gen_vec_sub_i64);
+}
+
+void tcg_gen_gvec_and(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, vec_and_i64);
+}
+
+void tcg_gen_gvec_or(unsigned vece, uint32_t dofs, uint32_t aofs,
+                     uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, vec_or_i64);
+}
+
+void tcg_gen_gvec_xor(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, vec_xor_i64);
+}
+
+void tcg_gen_gvec_andc(unsigned vece, uint32_t dofs, uint32_t aofs,
+                       uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, vec_andc_i64);
+}
+
+void tcg_gen_gvec_orc(unsigned vece, uint32_t dofs, uint32_t aofs,
+                      uint32_t bofs, uint32_t oprsz, uint32_t maxsz)
+{
+    expand_3_i64(vece, dofs, aofs, bofs, oprsz, maxsz, vec_orc_i64);
+}
@@ -26,6 +26,7 @@
 #include "qemu-common.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "exec/tb-hash.h"
 #include "tcg.h"
 #include "tcg-op.h"
 #include "tcg-mo.h"
@@ -2570,6 +2571,94 @@ void tcg_gen_lookup_and_goto_ptr(void)
     }
 }
 
+void tcg_gen_lookup_and_goto_ptr_cached(TCGv addr, const TranslationBlock *tb)
+{
+    uint32_t cflags = tb_cflags(tb);
+    TCGLabel *miss;
+    TCGv_ptr ptb;
+    TCGv hash, t;
+    TCGv_i32 t32;
+
+    /* TBs that must stop early, and the logging that wants every lookup,
+       take the helper.  */
+    if (!TCG_TARGET_HAS_goto_ptr || qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)
+        || (cflags & (CF_COUNT_MASK | CF_LAST_IO | CF_NOCACHE))) {
+        tcg_gen_lookup_and_goto_ptr();
+        return;
+    }
+
+    miss = gen_new_label();
+    ptb = tcg_temp_local_new_ptr();
+    hash = tcg_temp_new();
+    t = tcg_temp_new();
+
+    /* ptb = &cpu->tb_jmp_cache[tb_jmp_cache_hash_func(addr)] */
+#ifdef CONFIG_SOFTMMU
+    tcg_gen_shri_tl(hash, addr, TARGET_PAGE_BITS - TB_JMP_PAGE_BITS);
+    tcg_gen_xor_tl(hash, hash, addr);
+    tcg_gen_shri_tl(t, hash, TARGET_PAGE_BITS - TB_JMP_PAGE_BITS);
+    tcg_gen_andi_tl(t, t, TB_JMP_PAGE_MASK);
+    tcg_gen_andi_tl(hash, hash, TB_JMP_ADDR_MASK);
+    tcg_gen_or_tl(hash, hash, t);
+#else
+    tcg_gen_shri_tl(hash, addr, TB_JMP_CACHE_BITS);
+    tcg_gen_xor_tl(hash, hash, addr);
+    tcg_gen_andi_tl(hash, hash, TB_JMP_CACHE_SIZE - 1);
+#endif
+    tcg_gen_muli_tl(hash, hash, sizeof(void *));
+#if TARGET_LONG_BITS == 32
+    tcg_gen_ext_i32_ptr(ptb, hash);
+#elif UINTPTR_MAX == UINT32_MAX
+    tcg_gen_extrl_i64_i32(TCGV_PTR_TO_NAT(ptb), hash);
+#else
+    tcg_gen_mov_i64(TCGV_PTR_TO_NAT(ptb), hash);
+#endif
+    tcg_gen_add_ptr(ptb, ptb, cpu_env);
+    tcg_gen_ld_ptr(ptb, ptb, -ENV_OFFSET + offsetof(CPUState, tb_jmp_cache));
+    tcg_temp_free(hash);
+    tcg_temp_free(t);
+
+#if UINTPTR_MAX == UINT32_MAX
+    tcg_gen_brcondi_i32(TCG_COND_EQ, TCGV_PTR_TO_NAT(ptb), 0, miss);
+#else
+    tcg_gen_brcondi_i64(TCG_COND_EQ, TCGV_PTR_TO_NAT(ptb), 0, miss);
+#endif
+
+    /* The same checks as tb_lookup__cpu_state(), with the state of tb.  */
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, ptb, offsetof(TranslationBlock, pc));
+    tcg_gen_brcond_tl(TCG_COND_NE, t, addr, miss);
+    tcg_temp_free(t);
+
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, ptb, offsetof(TranslationBlock, cs_base));
+    tcg_gen_brcondi_tl(TCG_COND_NE, t, tb->cs_base, miss);
+    tcg_temp_free(t);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, ptb, offsetof(TranslationBlock, flags));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, tb->flags, miss);
+    tcg_temp_free_i32(t32);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, ptb, offsetof(TranslationBlock, trace_vcpu_dstate));
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, tb->trace_vcpu_dstate, miss);
+    tcg_temp_free_i32(t32);
+
+    t32 = tcg_temp_new_i32();
+    tcg_gen_ld_i32(t32, ptb, offsetof(TranslationBlock, cflags));
+    tcg_gen_andi_i32(t32, t32, CF_HASH_MASK | CF_INVALID);
+    tcg_gen_brcondi_i32(TCG_COND_NE, t32, cflags & CF_HASH_MASK, miss);
+    tcg_temp_free_i32(t32);
+
+    tcg_gen_ld_ptr(ptb, ptb, offsetof(TranslationBlock, tc.ptr));
+    tcg_gen_op1i(INDEX_op_goto_ptr, tcgv_ptr_arg(ptb));
+    tcg_temp_free_ptr(ptb);
+
+    gen_set_label(miss);
+    tcg_gen_lookup_and_goto_ptr();
+}
+
 static inline TCGMemOp tcg_canonicalize_memop(TCGMemOp op, bool is64, bool st)
 {
     /* Trigger the asserts within as early as possible.  */
@@ -2775,6 +2864,33 @@ static void * const table_cmpxchg[16] = {
     WITH_ATOMIC64([MO_64 | MO_BE] = gen_helper_atomic_cmpxchgq_be)
 };
 
+/* With the softmmu, a backend that implements qemu_cmpxchg performs the
+   compare-and-swap with a host atomic on a TLB hit for RAM, and calls the
+   cmpxchg helper from its slow path otherwise.  Only host-endian accesses
+   are handled inline.  */
+static inline bool use_qemu_cmpxchg(TCGMemOp memop)
+{
+#ifdef CONFIG_SOFTMMU
+    return TCG_TARGET_HAS_qemu_cmpxchg && !(memop & MO_BSWAP);
+#else
+    return false;
+#endif
+}
+
+static void gen_qemu_cmpxchg(TCGOpcode opc, TCGArg retv, TCGv addr,
+                             TCGArg cmpv, TCGArg newv,
+                             TCGMemOp memop, TCGArg idx)
+{
+    TCGMemOpIdx oi = make_memop_idx(memop, idx);
+
+    /* The opcodes only exist for 64-bit hosts.  */
+#if TARGET_LONG_BITS == 32
+    tcg_gen_op5(opc, retv, tcgv_i32_arg(addr), cmpv, newv, oi);
+#else
+    tcg_gen_op5(opc, retv, tcgv_i64_arg(addr), cmpv, newv, oi);
+#endif
+}
+
 void tcg_gen_atomic_cmpxchg_i32(TCGv_i32 retv, TCGv addr, TCGv_i32 cmpv,
                                 TCGv_i32 newv, TCGArg idx, TCGMemOp memop)
 {
@@ -2797,6 +2913,13 @@ void tcg_gen_atomic_cmpxchg_i32(TCGv_i32 retv, TCGv addr, TCGv_i32 cmpv,
             tcg_gen_mov_i32(retv, t1);
         }
         tcg_temp_free_i32(t1);
+    } else if (use_qemu_cmpxchg(memop)) {
+        gen_qemu_cmpxchg(INDEX_op_qemu_cmpxchg_i32, tcgv_i32_arg(retv), addr,
+                         tcgv_i32_arg(cmpv), tcgv_i32_arg(newv),
+                         memop & ~MO_SIGN, idx);
+        if (memop & MO_SIGN) {
+            tcg_gen_ext_i32(retv, retv, memop);
+        }
     } else {
         gen_atomic_cx_i32 gen;
 
@@ -2841,6 +2964,9 @@ void tcg_gen_atomic_cmpxchg_i64(TCGv_i64 retv, TCGv addr, TCGv_i64 cmpv,
             tcg_gen_mov_i64(retv, t1);
         }
         tcg_temp_free_i64(t1);
+    } else if ((memop & MO_SIZE) == MO_64 && use_qemu_cmpxchg(memop)) {
+        gen_qemu_cmpxchg(INDEX_op_qemu_cmpxchg_i64, tcgv_i64_arg(retv), addr,
+                         tcgv_i64_arg(cmpv), tcgv_i64_arg(newv), memop, idx);
     } else if ((memop & MO_SIZE) == MO_64) {
 #ifdef CONFIG_ATOMIC64
         gen_atomic_cx_i64 gen;
@@ -801,6 +801,24 @@ void tcg_gen_goto_tb(unsigned idx);
  */
 void tcg_gen_lookup_and_goto_ptr(void);
 
+/**
+ * tcg_gen_lookup_and_goto_ptr_cached() - tcg_gen_lookup_and_goto_ptr(),
+ * looking in tb_jmp_cache inline first
+ * @addr: Global holding the guest address of the target TB
+ * @tb: TB being translated
+ *
+ * Only for indirect branches that leave the cpu state used for the TB
+ * flags as it was at the start of @tb, as a hit is only checked against
+ * the flags, cs_base and cflags of @tb.  A hit jumps straight to the
+ * host code of the target, so that a function return does not need to
+ * leave the generated code.  Misses are handled by lookup_tb_ptr.
+ *
+ * The entries are whatever tb_jmp_cache holds, so they are dropped by the
+ * TLB flushes and TB invalidations that clear it.
+ */
+void tcg_gen_lookup_and_goto_ptr_cached(TCGv addr,
+                                        const TranslationBlock *tb);
+
 #if TARGET_LONG_BITS == 32
 #define tcg_temp_new() tcg_temp_new_i32()
 #define tcg_global_reg_new tcg_global_reg_new_i32
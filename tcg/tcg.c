@@ -60,6 +60,10 @@
 #include "exec/log.h"
 #include "sysemu/sysemu.h"
 
+#if defined(CONFIG_NUMA) && !defined(CONFIG_USER_ONLY)
+#include <numaif.h>
+#endif
+
 /* Forward declarations for functions declared in tcg-target.inc.c and
    used here. */
 static void tcg_target_init(TCGContext *s);
@@ -128,6 +132,12 @@ TCGv_env cpu_env = 0;
  * dynamically allocate from as demand dictates. Given appropriate region
  * sizing, this minimizes flushes even when some TCG threads generate a lot
  * more code than others.
+ *
+ * Once every region has been handed out, tcg_region_evict() frees the least
+ * recently used of the full ones, rather than having the whole buffer
+ * flushed. Lookups of the code in a region mark it used; eviction walks
+ * the full regions oldest first, and gives those marked used a second
+ * chance after clearing the mark.
  */
 struct tcg_region_state {
     QemuMutex lock;
@@ -143,6 +153,14 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    size_t *full; /* ring of full regions, oldest first */
+    size_t full_head;
+    size_t n_full;
+    size_t *free; /* evicted regions, to be handed out again */
+    size_t n_free;
+
+    /* set without the lock, see tcg_region_touch() */
+    bool *used;
 };
 
 static struct tcg_region_state region;
@@ -312,18 +330,61 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_ptr = start;
     s->code_gen_buffer_size = end - start;
     s->code_gen_highwater = end - TCG_HIGHWATER;
+
+#if defined(CONFIG_NUMA) && defined(MPOL_LOCAL) && !defined(CONFIG_USER_ONLY)
+    /*
+     * Nothing touches a region before the thread it is assigned to starts
+     * translating into it, so have its pages allocated on that thread's
+     * node even when the process runs under an interleave or bind policy.
+     * This is only a hint: it does not move pages already faulted in by the
+     * region's previous owner.
+     */
+    mbind(start, end - start, MPOL_LOCAL, NULL, 0, 0);
+#endif
+}
+
+static size_t tcg_region_index(const void *p)
+{
+    size_t i;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    i = (p - region.start_aligned) / region.stride;
+    return MIN(i, region.n - 1);
 }
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i;
+
+    if (region.n_free) {
+        i = region.free[--region.n_free];
+    } else if (region.current < region.n) {
+        i = region.current++;
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    atomic_set(&region.used[i], false);
     return false;
 }
 
+static void tcg_region_push_full__locked(size_t i)
+{
+    region.full[(region.full_head + region.n_full) % region.n] = i;
+    region.n_full++;
+}
+
+static size_t tcg_region_pop_full__locked(void)
+{
+    size_t i = region.full[region.full_head];
+
+    region.full_head = (region.full_head + 1) % region.n;
+    region.n_full--;
+    return i;
+}
+
 /*
  * Request a new region once the one in use has filled up.
  * Returns true on error.
@@ -331,13 +392,15 @@ static bool tcg_region_alloc__locked(TCGContext *s)
 static bool tcg_region_alloc(TCGContext *s)
 {
     bool err;
-    /* read the region size now; alloc__locked will overwrite it on success */
+    /* read the region now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t full = tcg_region_index(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        tcg_region_push_full__locked(full);
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -361,6 +424,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.full_head = 0;
+    region.n_full = 0;
+    region.n_free = 0;
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -371,6 +437,66 @@ void tcg_region_reset_all(void)
     qemu_mutex_unlock(&region.lock);
 }
 
+/*
+ * Mark the region holding @tc_ptr as used, so that the next eviction
+ * passes it over. Called on lookups, with or without tb_lock.
+ */
+void tcg_region_touch(const void *tc_ptr)
+{
+    bool *used = &region.used[tcg_region_index(tc_ptr)];
+
+    /* keep the cache line shared while the mark is already set */
+    if (!atomic_read(used)) {
+        atomic_set(used, true);
+    }
+}
+
+/*
+ * Evict a quarter of the full regions, least recently used first. @evict is
+ * called on the bounds of each region before it is handed out again, and
+ * has to drop all TBs in there.
+ *
+ * Returns false if there is no full region to evict, in which case only a
+ * flush can make room.
+ *
+ * Call from a safe-work context.
+ */
+bool tcg_region_evict(void (*evict)(void *start, void *end))
+{
+    size_t n_evict;
+
+    qemu_mutex_lock(&region.lock);
+    /* another vCPU may have asked for room as well */
+    if (region.n_free) {
+        qemu_mutex_unlock(&region.lock);
+        return true;
+    }
+    if (!region.n_full) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+
+    /* at most one lap clearing marks before everything is unmarked */
+    n_evict = DIV_ROUND_UP(region.n_full, 4);
+    while (n_evict) {
+        size_t i = tcg_region_pop_full__locked();
+        void *start, *end;
+
+        if (atomic_read(&region.used[i])) {
+            atomic_set(&region.used[i], false);
+            tcg_region_push_full__locked(i);
+            continue;
+        }
+        tcg_region_bounds(i, &start, &end);
+        evict(start, end);
+        region.agg_size_full -= end - start - TCG_HIGHWATER;
+        region.free[region.n_free++] = i;
+        n_evict--;
+    }
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
 #ifdef CONFIG_USER_ONLY
 static size_t tcg_n_regions(void)
 {
@@ -379,33 +505,31 @@ static size_t tcg_n_regions(void)
 #else
 /*
  * It is likely that some vCPUs will translate more code than others, so we
- * first try to set more regions than max_cpus, with those regions being of
- * reasonable size. If that's not possible we make do by evenly dividing
- * the code_gen_buffer among the vCPUs.
+ * first try to set more regions than TCG threads, with those regions being
+ * of reasonable size. The spare regions also let tcg_region_evict() drop
+ * part of the cache rather than all of it, which is why even a single TCG
+ * thread gets several. If that's not possible we make do by evenly
+ * dividing the code_gen_buffer among the threads.
  */
 static size_t tcg_n_regions(void)
 {
+    size_t n_threads = qemu_tcg_mttcg_enabled() ? max_cpus : 1;
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
-    }
-
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /* Try to have more regions than threads, with each region being >= 2 MB */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
-    /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    /* If we can't, then just allocate one region per TCG thread */
+    return n_threads;
 }
 #endif
 
@@ -420,7 +544,8 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG there is a single TCG thread,
+ * which goes through the regions in turn.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
@@ -442,13 +567,27 @@ void tcg_region_init(void)
     void *buf = tcg_init_ctx.code_gen_buffer;
     void *aligned;
     size_t size = tcg_init_ctx.code_gen_buffer_size;
-    size_t page_size = qemu_real_host_page_size;
+    size_t page_size = tcg_init_ctx.code_gen_page_size;
+    bool guard = true;
     size_t region_size;
     size_t n_regions;
     size_t i;
 
     n_regions = tcg_n_regions();
 
+    /*
+     * With a huge page backed buffer, lay the regions out on huge page
+     * boundaries so that no huge page is shared by two threads.  Fall back
+     * to host pages if the regions would be too small for that; a hugetlbfs
+     * mapping then cannot have its guard pages protected.
+     */
+    aligned = QEMU_ALIGN_PTR_UP(buf, page_size);
+    if (aligned - buf >= size ||
+        (size - (aligned - buf)) / n_regions < 2 * page_size) {
+        page_size = qemu_real_host_page_size;
+        guard = !tcg_init_ctx.code_gen_hugetlb;
+    }
+
     /* The first region will be 'aligned - buf' bytes larger than the others */
     aligned = QEMU_ALIGN_PTR_UP(buf, page_size);
     g_assert(aligned < tcg_init_ctx.code_gen_buffer + size);
@@ -475,8 +614,12 @@ void tcg_region_init(void)
     /* account for that last guard page */
     region.end -= page_size;
 
+    region.full = g_new(size_t, n_regions);
+    region.free = g_new(size_t, n_regions);
+    region.used = g_new0(bool, n_regions);
+
     /* set guard pages */
-    for (i = 0; i < region.n; i++) {
+    for (i = 0; guard && i < region.n; i++) {
         void *start, *end;
         int rc;
 
@@ -1130,6 +1273,10 @@ bool tcg_op_supported(TCGOpcode op)
     case INDEX_op_qemu_st_i64:
         return true;
 
+    case INDEX_op_qemu_cmpxchg_i32:
+    case INDEX_op_qemu_cmpxchg_i64:
+        return TCG_TARGET_HAS_qemu_cmpxchg;
+
     case INDEX_op_goto_ptr:
         return TCG_TARGET_HAS_goto_ptr;
 
@@ -1711,6 +1858,8 @@ void tcg_dump_ops(TCGContext *s)
             case INDEX_op_qemu_st_i32:
             case INDEX_op_qemu_ld_i64:
             case INDEX_op_qemu_st_i64:
+            case INDEX_op_qemu_cmpxchg_i32:
+            case INDEX_op_qemu_cmpxchg_i64:
                 {
                     TCGMemOpIdx oi = op->args[k++];
                     TCGMemOp op = get_memop(oi);
@@ -2000,6 +2149,62 @@ static void tcg_la_bb_end(TCGContext *s)
     }
 }
 
+/* liveness analysis: end of basic block that goes on at label l, and
+   also at the next op if fallthrough.  All temps are dead.  Globals and
+   local temps need to be in memory only if they are not dead at one of
+   the successors; label_mem says which at l, if it has been seen.  This
+   lets a flag computation that all paths overwrite be removed even when
+   a conditional branch stands between it and the overwrite. */
+static void tcg_la_bb_branch(TCGContext *s, TCGTempSet * const *label_mem,
+                             TCGLabel *l, bool fallthrough)
+{
+    TCGTempSet *mem = label_mem[l->id];
+    int ng = s->nb_globals;
+    int nt = s->nb_temps;
+    int i;
+
+    if (!mem) {
+        /* A backward branch.  */
+        tcg_la_bb_end(s);
+        return;
+    }
+    for (i = 0; i < nt; ++i) {
+        TCGTemp *ts = &s->temps[i];
+
+        if (i >= ng && !ts->temp_local) {
+            ts->state = TS_DEAD;
+        } else if (test_bit(i, mem->l)
+                   || (fallthrough && ts->state != TS_DEAD)) {
+            ts->state = TS_DEAD | TS_MEM;
+        } else {
+            ts->state = TS_DEAD;
+        }
+    }
+}
+
+/* liveness analysis: label l is set here.  Record which globals and
+   local temps the code after it does not treat as dead, for the
+   branches to l, then go on with the code falling through to l. */
+static void tcg_la_set_label(TCGContext *s, TCGTempSet **label_mem,
+                             TCGLabel *l)
+{
+    TCGTempSet *mem = tcg_malloc(sizeof(TCGTempSet));
+    int ng = s->nb_globals;
+    int nt = s->nb_temps;
+    int i;
+
+    bitmap_zero(mem->l, nt);
+    for (i = 0; i < nt; ++i) {
+        TCGTemp *ts = &s->temps[i];
+
+        if ((i < ng || ts->temp_local) && ts->state != TS_DEAD) {
+            set_bit(i, mem->l);
+        }
+    }
+    label_mem[l->id] = mem;
+    tcg_la_bb_branch(s, label_mem, l, false);
+}
+
 /* Liveness analysis : update the opc_arg_life array to tell if a
    given input arguments is dead. Instructions updating dead
    temporaries are removed. */
@@ -2007,6 +2212,10 @@ static void liveness_pass_1(TCGContext *s)
 {
     int nb_globals = s->nb_globals;
     int oi, oi_prev;
+    TCGTempSet **label_mem;
+
+    label_mem = tcg_malloc(sizeof(TCGTempSet *) * s->nb_labels);
+    memset(label_mem, 0, sizeof(TCGTempSet *) * s->nb_labels);
 
     tcg_la_func_end(s);
 
@@ -2202,7 +2411,19 @@ static void liveness_pass_1(TCGContext *s)
                 }
 
                 /* if end of basic block, update */
-                if (def->flags & TCG_OPF_BB_END) {
+                if (opc == INDEX_op_set_label) {
+                    tcg_la_set_label(s, label_mem, arg_label(op->args[0]));
+                } else if (opc == INDEX_op_br) {
+                    tcg_la_bb_branch(s, label_mem, arg_label(op->args[0]),
+                                     false);
+                } else if (opc == INDEX_op_brcond_i32
+                           || opc == INDEX_op_brcond_i64) {
+                    tcg_la_bb_branch(s, label_mem, arg_label(op->args[3]),
+                                     true);
+                } else if (opc == INDEX_op_brcond2_i32) {
+                    tcg_la_bb_branch(s, label_mem, arg_label(op->args[5]),
+                                     true);
+                } else if (def->flags & TCG_OPF_BB_END) {
                     tcg_la_bb_end(s);
                 } else if (def->flags & TCG_OPF_SIDE_EFFECTS) {
                     /* globals should be synced to memory */
@@ -0,0 +1,348 @@
+/*
+ * Periodic counter snapshots
+ *
+ * A subscription resolves its counters once, with the BQL held, into an
+ * array of read callbacks.  A thread of its own then reads them at the
+ * subscription period and pushes the values out as a TELEMETRY event or
+ * a line on a chardev.  The values are read without the BQL, so the
+ * sources only hand out counters that are atomics or have a lock of
+ * their own, and keep a reference on them for as long as the
+ * subscription lasts.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qapi/error.h"
+#include "qapi-event.h"
+#include "qmp-commands.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "chardev/char-fe.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/telemetry.h"
+
+typedef struct TelemetryCounter {
+    TelemetryReadFunc *read;
+    void *opaque;
+    unsigned int idx;
+} TelemetryCounter;
+
+typedef struct TelemetryRelease {
+    TelemetryReleaseFunc *release;
+    void *opaque;
+} TelemetryRelease;
+
+struct TelemetrySet {
+    GArray *counters;
+    GArray *releases;
+    /* Handed to the subscriber once bound */
+    strList *names;
+    strList **names_tail;
+};
+
+typedef struct TelemetrySub {
+    uint32_t id;
+    int64_t period_ns;
+    int64_t deadline;
+    TelemetrySet set;
+    bool has_chr;
+    CharBackend chr;
+    QTAILQ_ENTRY(TelemetrySub) next;
+} TelemetrySub;
+
+static TelemetryBindFunc *telemetry_sources[TELEMETRY_SOURCE__MAX];
+
+/* Protects the subscriptions, taken by the thread while it reads them.  */
+static QemuMutex telemetry_lock;
+static QemuCond telemetry_cond;
+static QTAILQ_HEAD(, TelemetrySub) telemetry_subs =
+    QTAILQ_HEAD_INITIALIZER(telemetry_subs);
+static uint32_t telemetry_next_id = 1;
+static bool telemetry_thread_started;
+static QemuThread telemetry_thread;
+
+static void __attribute__((constructor)) telemetry_init_lock(void)
+{
+    qemu_mutex_init(&telemetry_lock);
+    qemu_cond_init(&telemetry_cond);
+}
+
+void telemetry_register_source(TelemetrySource source,
+                               TelemetryBindFunc *bind)
+{
+    assert(source < TELEMETRY_SOURCE__MAX);
+    telemetry_sources[source] = bind;
+}
+
+void telemetry_add_counter(TelemetrySet *set, const char *name,
+                           TelemetryReadFunc *read, void *opaque,
+                           unsigned int idx)
+{
+    TelemetryCounter c = { .read = read, .opaque = opaque, .idx = idx };
+    strList *elem = g_new0(strList, 1);
+
+    g_array_append_val(set->counters, c);
+    elem->value = g_strdup(name);
+    *set->names_tail = elem;
+    set->names_tail = &elem->next;
+}
+
+void telemetry_add_release(TelemetrySet *set, TelemetryReleaseFunc *release,
+                           void *opaque)
+{
+    TelemetryRelease r = { .release = release, .opaque = opaque };
+
+    g_array_append_val(set->releases, r);
+}
+
+/* Called with telemetry_lock held.  */
+static void telemetry_snapshot(TelemetrySub *sub, int64_t now)
+{
+    GArray *counters = sub->set.counters;
+    guint i;
+
+    if (sub->has_chr) {
+        GString *line = g_string_new(NULL);
+
+        g_string_append_printf(line, "%" PRIu32 " %" PRId64, sub->id, now);
+        for (i = 0; i < counters->len; i++) {
+            TelemetryCounter *c = &g_array_index(counters, TelemetryCounter, i);
+
+            g_string_append_printf(line, " %" PRIu64,
+                                   c->read(c->opaque, c->idx));
+        }
+        g_string_append_c(line, '\n');
+        /* Whatever doesn't fit right away is dropped.  */
+        qemu_chr_fe_write(&sub->chr, (uint8_t *)line->str, line->len);
+        g_string_free(line, true);
+    } else {
+        uint64List *values = NULL;
+
+        for (i = counters->len; i-- > 0; ) {
+            TelemetryCounter *c = &g_array_index(counters, TelemetryCounter, i);
+            uint64List *elem = g_new0(uint64List, 1);
+
+            elem->value = c->read(c->opaque, c->idx);
+            elem->next = values;
+            values = elem;
+        }
+        qapi_event_send_telemetry(sub->id, now, values, &error_abort);
+        qapi_free_uint64List(values);
+    }
+}
+
+static void *telemetry_thread_fn(void *opaque)
+{
+    qemu_mutex_lock(&telemetry_lock);
+    for (;;) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        int64_t next = INT64_MAX;
+        TelemetrySub *sub;
+
+        QTAILQ_FOREACH(sub, &telemetry_subs, next) {
+            if (sub->deadline <= now) {
+                telemetry_snapshot(sub, now);
+                sub->deadline += sub->period_ns;
+                if (sub->deadline <= now) {
+                    /* Fell behind, skip the missed snapshots */
+                    sub->deadline = now + sub->period_ns;
+                }
+            }
+            next = MIN(next, sub->deadline);
+        }
+
+        if (next == INT64_MAX) {
+            qemu_cond_wait(&telemetry_cond, &telemetry_lock);
+        } else {
+            qemu_cond_timedwait(&telemetry_cond, &telemetry_lock,
+                                DIV_ROUND_UP(next - now, SCALE_MS));
+        }
+    }
+    qemu_mutex_unlock(&telemetry_lock);
+
+    return NULL;
+}
+
+static void telemetry_sub_free(TelemetrySub *sub)
+{
+    guint i;
+
+    for (i = 0; i < sub->set.releases->len; i++) {
+        TelemetryRelease *r = &g_array_index(sub->set.releases,
+                                             TelemetryRelease, i);
+
+        r->release(r->opaque);
+    }
+    g_array_free(sub->set.releases, true);
+    g_array_free(sub->set.counters, true);
+    if (sub->has_chr) {
+        qemu_chr_fe_deinit(&sub->chr, false);
+    }
+    g_free(sub);
+}
+
+TelemetrySubscription *qmp_telemetry_subscribe(TelemetrySourceList *sources,
+                                               uint32_t period,
+                                               bool has_chardev,
+                                               const char *chardev,
+                                               Error **errp)
+{
+    TelemetrySubscription *info;
+    TelemetrySourceList *s;
+    TelemetrySub *sub;
+
+    if (!period) {
+        error_setg(errp, "period must be at least 1 ms");
+        return NULL;
+    }
+
+    sub = g_new0(TelemetrySub, 1);
+    if (has_chardev) {
+        Chardev *chr = qemu_chr_find(chardev);
+
+        if (!chr) {
+            error_setg(errp, "Chardev '%s' not found", chardev);
+            g_free(sub);
+            return NULL;
+        }
+        if (!qemu_chr_fe_init(&sub->chr, chr, errp)) {
+            g_free(sub);
+            return NULL;
+        }
+        sub->has_chr = true;
+    }
+
+    sub->set.counters = g_array_new(false, false, sizeof(TelemetryCounter));
+    sub->set.releases = g_array_new(false, false, sizeof(TelemetryRelease));
+    sub->set.names_tail = &sub->set.names;
+    for (s = sources; s; s = s->next) {
+        /* Sources that aren't built in have no counters */
+        if (telemetry_sources[s->value]) {
+            telemetry_sources[s->value](&sub->set);
+        }
+    }
+
+    info = g_new0(TelemetrySubscription, 1);
+    info->counters = sub->set.names;
+    sub->set.names = NULL;
+
+    sub->period_ns = (int64_t)period * SCALE_MS;
+    sub->deadline = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sub->period_ns;
+    qemu_mutex_lock(&telemetry_lock);
+    info->id = sub->id = telemetry_next_id++;
+    QTAILQ_INSERT_TAIL(&telemetry_subs, sub, next);
+    if (!telemetry_thread_started) {
+        qemu_thread_create(&telemetry_thread, "telemetry",
+                           telemetry_thread_fn, NULL, QEMU_THREAD_DETACHED);
+        telemetry_thread_started = true;
+    }
+    qemu_cond_signal(&telemetry_cond);
+    qemu_mutex_unlock(&telemetry_lock);
+
+    return info;
+}
+
+void qmp_telemetry_unsubscribe(uint32_t id, Error **errp)
+{
+    TelemetrySub *sub;
+
+    qemu_mutex_lock(&telemetry_lock);
+    QTAILQ_FOREACH(sub, &telemetry_subs, next) {
+        if (sub->id == id) {
+            QTAILQ_REMOVE(&telemetry_subs, sub, next);
+            break;
+        }
+    }
+    qemu_mutex_unlock(&telemetry_lock);
+
+    if (!sub) {
+        error_setg(errp, "No telemetry subscription %" PRIu32, id);
+        return;
+    }
+    telemetry_sub_free(sub);
+}
+
+/* Block backends.  The stats have a lock of their own.  */
+
+enum {
+    TELEMETRY_BLK_BYTES,
+    TELEMETRY_BLK_OPS,
+    TELEMETRY_BLK_TIME,
+    TELEMETRY_BLK__MAX,
+};
+
+static const char *const telemetry_blk_types[BLOCK_MAX_IOTYPE] = {
+    [BLOCK_ACCT_READ] = "rd",
+    [BLOCK_ACCT_WRITE] = "wr",
+    [BLOCK_ACCT_FLUSH] = "flush",
+};
+
+static const char *const telemetry_blk_fields[TELEMETRY_BLK__MAX] = {
+    [TELEMETRY_BLK_BYTES] = "bytes",
+    [TELEMETRY_BLK_OPS] = "ops",
+    [TELEMETRY_BLK_TIME] = "total-time-ns",
+};
+
+static uint64_t telemetry_blk_read(void *opaque, unsigned int idx)
+{
+    BlockAcctStats *stats = blk_get_stats(opaque);
+    unsigned int type = idx % BLOCK_MAX_IOTYPE;
+    uint64_t val = 0;
+
+    qemu_mutex_lock(&stats->lock);
+    switch (idx / BLOCK_MAX_IOTYPE) {
+    case TELEMETRY_BLK_BYTES:
+        val = stats->nr_bytes[type];
+        break;
+    case TELEMETRY_BLK_OPS:
+        val = stats->nr_ops[type];
+        break;
+    case TELEMETRY_BLK_TIME:
+        val = stats->total_time_ns[type];
+        break;
+    }
+    qemu_mutex_unlock(&stats->lock);
+    return val;
+}
+
+static void telemetry_blk_release(void *opaque)
+{
+    blk_unref(opaque);
+}
+
+static void telemetry_blk_bind(TelemetrySet *set)
+{
+    BlockBackend *blk;
+    unsigned int field, type;
+
+    for (blk = blk_next(NULL); blk; blk = blk_next(blk)) {
+        blk_ref(blk);
+        telemetry_add_release(set, telemetry_blk_release, blk);
+        for (field = 0; field < TELEMETRY_BLK__MAX; field++) {
+            for (type = 0; type < BLOCK_MAX_IOTYPE; type++) {
+                char *name;
+
+                if (field == TELEMETRY_BLK_BYTES && type == BLOCK_ACCT_FLUSH) {
+                    continue;
+                }
+                name = g_strdup_printf("block.%s.%s-%s", blk_name(blk),
+                                       telemetry_blk_types[type],
+                                       telemetry_blk_fields[field]);
+                telemetry_add_counter(set, name, telemetry_blk_read, blk,
+                                      field * BLOCK_MAX_IOTYPE + type);
+                g_free(name);
+            }
+        }
+    }
+}
+
+static void __attribute__((constructor)) telemetry_init_sources(void)
+{
+    telemetry_register_source(TELEMETRY_SOURCE_BLOCK, telemetry_blk_bind);
+}
@@ -0,0 +1,77 @@
+/*
+ * XBZRLE encoder speed benchmark
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "../migration/xbzrle.h"
+
+#define PAGE_SIZE 4096
+
+/* Pages with @runs changed runs of @run_len bytes.  */
+static const struct {
+    int runs;
+    int run_len;
+} benches[] = {
+    { 1, 0 },       /* unchanged */
+    { 1, 8 },
+    { 16, 16 },
+    { 64, 8 },
+    { 4, 512 },
+};
+
+static void test_xbzrle_speed_one(int runs, int run_len)
+{
+    uint8_t *old_buf = g_malloc0(PAGE_SIZE);
+    uint8_t *new_buf = g_malloc0(PAGE_SIZE);
+    uint8_t *dst = g_malloc(PAGE_SIZE);
+    double total = 0.0;
+    int i;
+
+    for (i = 0; i < runs; i++) {
+        memset(new_buf + (PAGE_SIZE / runs) * i, 0x5a, run_len);
+    }
+
+    g_test_timer_start();
+    do {
+        for (i = 0; i < 1024; i++) {
+            xbzrle_encode_buffer(old_buf, new_buf, PAGE_SIZE, dst, PAGE_SIZE);
+        }
+        total += 1024 * PAGE_SIZE;
+    } while (g_test_timer_elapsed() < 1.0);
+
+    total /= 1024 * 1024; /* to MB */
+    g_print("%d runs of %d bytes ", runs, run_len);
+    g_print("done: %.2f MB in %.2f secs: ", total, g_test_timer_last());
+    g_print("%.2f MB/sec\n", total / g_test_timer_last());
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(dst);
+}
+
+/* From the fastest encoder the host has down to the plain C one.  */
+static void test_xbzrle_speed(void)
+{
+    int accel = 0;
+    size_t i;
+
+    do {
+        for (i = 0; i < ARRAY_SIZE(benches); i++) {
+            g_print("xbzrle encoder %d: ", accel);
+            test_xbzrle_speed_one(benches[i].runs, benches[i].run_len);
+        }
+        accel++;
+    } while (test_xbzrle_encode_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/xbzrle/speed", test_xbzrle_speed);
+    return g_test_run();
+}
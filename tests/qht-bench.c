@@ -9,8 +9,16 @@
 #include "qemu/atomic.h"
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "exec/tb-hash-xx.h"
 
+/* sampled lookup latencies, in ns */
+struct lat_stats {
+    size_t n;
+    uint64_t sum;
+    uint64_t max;
+};
+
 struct thread_stats {
     size_t rd;
     size_t not_rd;
@@ -20,6 +28,8 @@ struct thread_stats {
     size_t not_rm;
     size_t rz;
     size_t not_rz;
+    /* [1] is for lookups that overlapped an explicit resize */
+    struct lat_stats lat[2];
 };
 
 struct thread_info {
@@ -28,6 +38,7 @@ struct thread_info {
     uint64_t r;
     bool write_op; /* writes alternate between insertions and removals */
     bool resize_down;
+    unsigned int n_lookups;
 } QEMU_ALIGNED(64); /* avoid false sharing among threads */
 
 static struct qht ht;
@@ -53,6 +64,10 @@ static unsigned long resize_delay = 1000;
 static double resize_rate; /* 0.0 to 1.0 */
 static unsigned int n_rz_threads = 1;
 static QemuThread *rz_threads;
+static unsigned int n_resizing;
+
+/* time one lookup out of lat_period, 0 to disable */
+static unsigned int lat_period;
 
 static double update_rate; /* 0.0 to 1.0 */
 static uint64_t update_threshold;
@@ -84,7 +99,9 @@ static const char commands_string[] =
     " -R = enable auto-resize\n"
     " -S = resize rate (0.0 to 100.0)\n"
     " -D = delay (in us) between potential resizes\n"
-    " -N = number of resize threads";
+    " -N = number of resize threads\n"
+    "\n"
+    " -L = time one out of every N lookups";
 
 static void usage_complete(int argc, char *argv[])
 {
@@ -127,7 +144,9 @@ static void do_rz(struct thread_info *info)
         size_t size = info->resize_down ? resize_min : resize_max;
         bool resized;
 
+        atomic_inc(&n_resizing);
         resized = qht_resize(&ht, size);
+        atomic_dec(&n_resizing);
         info->resize_down = !info->resize_down;
 
         if (resized) {
@@ -139,6 +158,31 @@ static void do_rz(struct thread_info *info)
     g_usleep(resize_delay);
 }
 
+static bool do_lookup(struct thread_info *info, long *p, uint32_t hash)
+{
+    struct lat_stats *lat;
+    int64_t t0, ns;
+    bool resizing;
+    bool read;
+
+    if (!lat_period || ++info->n_lookups < lat_period) {
+        return qht_lookup(&ht, is_equal, p, hash);
+    }
+    info->n_lookups = 0;
+
+    resizing = atomic_read(&n_resizing);
+    t0 = get_clock();
+    read = qht_lookup(&ht, is_equal, p, hash);
+    ns = get_clock() - t0;
+    resizing = resizing || atomic_read(&n_resizing);
+
+    lat = &info->stats.lat[resizing];
+    lat->n++;
+    lat->sum += ns;
+    lat->max = MAX(lat->max, ns);
+    return read;
+}
+
 static void do_rw(struct thread_info *info)
 {
     struct thread_stats *stats = &info->stats;
@@ -150,7 +194,7 @@ static void do_rw(struct thread_info *info)
 
         p = &keys[info->r & (lookup_range - 1)];
         hash = h(*p);
-        read = qht_lookup(&ht, is_equal, p, hash);
+        read = do_lookup(info, p, hash);
         if (read) {
             stats->rd++;
         } else {
@@ -264,6 +308,9 @@ static void pr_params(void)
         printf(" # resize threads   %u\n", n_rz_threads);
     }
     printf(" update rate:       %f%%\n", update_rate * 100.0);
+    if (lat_period) {
+        printf(" latency sampling:  1/%u lookups\n", lat_period);
+    }
     printf(" offset:            %ld\n", populate_offset);
     printf(" initial key range: %zu\n", init_range);
     printf(" lookup range:      %lu\n", lookup_range);
@@ -333,7 +380,7 @@ static void htable_init(void)
 
 static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
 {
-    int i;
+    int i, j;
 
     for (i = 0; i < n; i++) {
         struct thread_stats *stats = &info[i].stats;
@@ -349,7 +396,23 @@ static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
 
         s->rz += stats->rz;
         s->not_rz += stats->not_rz;
+
+        for (j = 0; j < ARRAY_SIZE(s->lat); j++) {
+            s->lat[j].n += stats->lat[j].n;
+            s->lat[j].sum += stats->lat[j].sum;
+            s->lat[j].max = MAX(s->lat[j].max, stats->lat[j].max);
+        }
+    }
+}
+
+static void pr_lat(const char *name, struct lat_stats *lat)
+{
+    if (!lat->n) {
+        printf(" %-19s no samples\n", name);
+        return;
     }
+    printf(" %-19s avg %.1f ns, max %" PRIu64 " ns (%zu samples)\n",
+           name, (double)lat->sum / lat->n, lat->max, lat->n);
 }
 
 static void pr_stats(void)
@@ -383,6 +446,13 @@ static void pr_stats(void)
     tx = (s.rd + s.not_rd + s.in + s.not_in + s.rm + s.not_rm) / 1e6 / duration;
     printf(" Throughput:        %.2f MT/s\n", tx);
     printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_rw_threads);
+
+    if (lat_period) {
+        pr_lat("Lookup latency:", &s.lat[0]);
+        if (resize_rate) {
+            pr_lat("  while resizing:", &s.lat[1]);
+        }
+    }
 }
 
 static void run_test(void)
@@ -412,7 +482,7 @@ static void parse_args(int argc, char *argv[])
     int c;
 
     for (;;) {
-        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:r:Rs:S:u:");
+        c = getopt(argc, argv, "d:D:g:k:K:l:L:hn:N:o:r:Rs:S:u:");
         if (c < 0) {
             break;
         }
@@ -442,6 +512,9 @@ static void parse_args(int argc, char *argv[])
         case 'l':
             lookup_range = pow2ceil(atol(optarg));
             break;
+        case 'L':
+            lat_period = atoi(optarg);
+            break;
         case 'n':
             n_rw_threads = atoi(optarg);
             break;
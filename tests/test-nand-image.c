@@ -0,0 +1,67 @@
+/*
+ * Test the NAND flash image layout
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/nand-image.h"
+
+#define PAGE_SIZE_TEST 2048
+#define OOB_SIZE_TEST 64
+#define ECC_SIZE_TEST 16
+
+/* An erased page has an erased OOB, ECC included.  */
+static void test_nand_erased(void)
+{
+    uint8_t data[PAGE_SIZE_TEST];
+    uint8_t page[PAGE_SIZE_TEST + OOB_SIZE_TEST];
+    int i;
+
+    memset(data, 0xff, sizeof(data));
+    nand_image_page(page, data, PAGE_SIZE_TEST, OOB_SIZE_TEST, ECC_SIZE_TEST);
+    for (i = 0; i < sizeof(page); i++) {
+        g_assert_cmpint(page[i], ==, 0xff);
+    }
+}
+
+/* qemu-nand-creator digests pages as read() returns them.  */
+static void test_nand_pieces(void)
+{
+    uint8_t data[PAGE_SIZE_TEST];
+    uint8_t page[PAGE_SIZE_TEST + OOB_SIZE_TEST];
+    uint8_t ecc[ECC_SIZE_TEST];
+    NandEccState st = { 0, 0 };
+    uint32_t done, len;
+    int i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = g_test_rand_int();
+    }
+    nand_image_page(page, data, PAGE_SIZE_TEST, OOB_SIZE_TEST, ECC_SIZE_TEST);
+
+    memset(ecc, 0xff, sizeof(ecc));
+    for (done = 0; done < PAGE_SIZE_TEST; done += len) {
+        len = MIN(g_test_rand_int_range(1, 700), PAGE_SIZE_TEST - done);
+        nand_ecc_digest(&st, ecc, ECC_SIZE_TEST, data + done, len,
+                        PAGE_SIZE_TEST);
+    }
+
+    g_assert(!memcmp(page, data, PAGE_SIZE_TEST));
+    for (i = 0; i < OOB_SIZE_TEST - ECC_SIZE_TEST; i++) {
+        g_assert_cmpint(page[PAGE_SIZE_TEST + i], ==, 0xff);
+    }
+    g_assert(!memcmp(page + PAGE_SIZE_TEST + OOB_SIZE_TEST - ECC_SIZE_TEST,
+                     ecc, ECC_SIZE_TEST));
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/nand-image/erased", test_nand_erased);
+    g_test_add_func("/nand-image/pieces", test_nand_pieces);
+    return g_test_run();
+}
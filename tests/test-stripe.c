@@ -0,0 +1,93 @@
+/*
+ * Test the dual parallel flash bit striper
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/stripe.h"
+
+/* The original bit at a time striper, for reference.  */
+static void stripe8_ref(uint8_t *x, int num, bool dir, bool be)
+{
+    uint8_t r[num];
+    int idx[2] = {0, 0};
+    int bit[2] = {0, be ? 7 : 0};
+    int d = dir;
+
+    memset(r, 0, num);
+    for (idx[0] = 0; idx[0] < num; ++idx[0]) {
+        for (bit[0] = be ? 7 : 0; bit[0] != (be ? -1 : 8);
+                 bit[0] += be ? -1 : 1) {
+            r[idx[!d]] |= x[idx[d]] & 1 << bit[d] ? 1 << bit[!d] : 0;
+            idx[1] = (idx[1] + 1) % num;
+            if (!idx[1]) {
+                bit[1] += be ? -1 : 1;
+            }
+        }
+    }
+    memcpy(x, r, num);
+}
+
+static void test_stripe_pair(void)
+{
+    int dir, be, v;
+
+    for (dir = 0; dir < 2; dir++) {
+        for (be = 0; be < 2; be++) {
+            for (v = 0; v < 0x10000; v++) {
+                uint8_t a[2] = { v, v >> 8 };
+                uint8_t b[2] = { v, v >> 8 };
+
+                stripe8_ref(a, 2, dir, be);
+                stripe8(b, 2, dir, be);
+                g_assert_cmpint(a[0], ==, b[0]);
+                g_assert_cmpint(a[1], ==, b[1]);
+            }
+        }
+    }
+}
+
+static void test_stripe_buf(void)
+{
+    uint8_t src[67], ref[67], buf[67], x0[33], x1[33], out[66];
+    int dir, be, num;
+    size_t i;
+
+    for (i = 0; i < sizeof src; i++) {
+        src[i] = g_test_rand_int();
+    }
+    for (i = 0; i < sizeof x0; i++) {
+        x0[i] = src[2 * i];
+        x1[i] = src[2 * i + 1];
+    }
+
+    for (dir = 0; dir < 2; dir++) {
+        for (be = 0; be < 2; be++) {
+            for (num = 1; num <= 4; num++) {
+                memcpy(ref, src, sizeof ref);
+                for (i = 0; i + num <= sizeof ref; i += num) {
+                    stripe8_ref(ref + i, num, dir, be);
+                }
+                memcpy(buf, src, sizeof buf);
+                stripe_buf(buf, sizeof buf, num, dir, be);
+                g_assert(!memcmp(buf, ref, sizeof buf));
+
+                if (num == 2) {
+                    stripe2(out, x0, x1, sizeof x0, dir, be);
+                    g_assert(!memcmp(out, ref, sizeof out));
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/stripe/pair", test_stripe_pair);
+    g_test_add_func("/stripe/buf", test_stripe_buf);
+    return g_test_run();
+}
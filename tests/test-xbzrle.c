@@ -174,6 +174,16 @@ static void test_encode_decode(void)
     }
 }
 
+/* The accelerated encoders must not change the encoding.  */
+static void test_encode_accel(void)
+{
+    do {
+        test_encode_decode_1_byte();
+        test_encode_decode_overflow();
+        test_encode_decode();
+    } while (test_xbzrle_encode_next_accel());
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +196,8 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    /* Last, it leaves the slowest encoder selected.  */
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
 
     return g_test_run();
 }
@@ -0,0 +1,430 @@
+/*
+ * Throughput benchmark for the Xilinx ZynqMP and Versal boot flow models
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Drives the models through qtest, so the CPUs never run. Runs with
+ * QTEST_QEMU_BINARY pointing at qemu-system-aarch64. The benchmarks using
+ * the ZynqMP CSU, ZDMA or the Versal PMC need the matching hardware DTB.
+ * Every result is printed on stdout as one JSON object per line.
+ */
+#include "qemu/osdep.h"
+#include "libqtest.h"
+
+/* Scratch DDR, present on every machine used here.  */
+#define SRC_ADDR            0x01000000
+#define DST_ADDR            0x04000000
+#define DESC_ADDR           0x00800000
+#define MAX_SIZE            (1024 * 1024)
+
+/* ZynqMP, at the addresses of the ZCU102 and the Xilinx DTBs.  */
+#define ZYNQMP_QSPI         0xff0f0000
+#define ZYNQMP_LQSPI        0xc0000000
+#define ZYNQMP_GEM0         0xff0b0000
+#define ZYNQMP_GDMA         0xfd500000
+#define ZYNQMP_CSU_SSS      0xffca0008
+#define ZYNQMP_CSU_SHA3     0xffca2000
+#define ZYNQMP_CSU_AES      0xffca5000
+#define ZYNQMP_CSU_DMA      0xffc80000
+
+/* Versal PMC and LPD.  */
+#define VERSAL_OSPI         0xf1010000
+#define VERSAL_OSPI_DAC     0xc0000000
+#define VERSAL_ADMA         0xffa80000
+#define VERSAL_PMC_SSS      0xf1110500
+#define VERSAL_PMC_SHA3     0xf1210000
+#define VERSAL_PMC_DMA0     0xf11c0000
+
+/* Legacy QSPI.  */
+#define R_QSPI_EN           0x14
+#define R_LQSPI_CFG         0xa0
+#define   LQSPI_CFG_LQ_MODE   (1U << 31)
+#define R_GQSPI_SELECT      0x144
+
+/* Versal OSPI.  */
+#define R_OSPI_CONFIG       0x0
+#define   OSPI_CONFIG_ENB_DIR_ACC   (1 << 7)
+#define   OSPI_CONFIG_ENB_SPI       (1 << 0)
+#define R_OSPI_DEV_INSTR_RD 0x4
+
+/* GEM.  */
+#define R_GEM_NWCTRL        0x0
+#define   GEM_NWCTRL_TXSTART  (1 << 9)
+#define   GEM_NWCTRL_TXENA    (1 << 3)
+#define R_GEM_TXSTATUS      0x14
+#define R_GEM_TXQBASE       0x1c
+#define R_GEM_TXQ1BASE      0x440
+#define GEM_NUM_QUEUES      8
+#define GEM_DESC_USED       (1U << 31)
+#define GEM_DESC_WRAP       (1 << 30)
+#define GEM_DESC_LAST       (1 << 15)
+#define GEM_RING            64
+
+/* ZDMA channel.  */
+#define R_ZDMA_ISR          0x100
+#define   ZDMA_ISR_DMA_DONE   (1 << 10)
+#define R_ZDMA_CTRL0        0x110
+#define R_ZDMA_SRC_DSCR     0x128
+#define R_ZDMA_DST_DSCR     0x138
+#define R_ZDMA_CTRL2        0x200
+
+/* CSU/PMC stream DMA, the destination channel is 0x800 up.  */
+#define CSU_DMA_DST         0x800
+#define R_CSU_DMA_ADDR      0x0
+#define R_CSU_DMA_SIZE      0x4
+#define   CSU_DMA_SIZE_LAST   (1 << 0)
+#define R_CSU_DMA_ISR       0x14
+#define   CSU_DMA_ISR_DONE    (1 << 1)
+#define R_CSU_DMA_ADDR_MSB  0x28
+
+/* SHA3 and ZynqMP AES.  */
+#define R_SHA3_START        0x0
+#define R_AES_KEY_SRC       0x04
+#define R_AES_KEY_LOAD      0x08
+#define R_AES_START_MSG     0x0c
+#define R_AES_CFG           0x18
+#define R_AES_KUP_0         0x20
+
+/* SSS routes, the field of each sink holds the encoding of its source.  */
+#define ZYNQMP_SSS_DMA_FROM_DMA     (0x5 << 4)
+#define ZYNQMP_SSS_DMA_FROM_AES     (0xa << 4)
+#define ZYNQMP_SSS_AES_FROM_DMA     (0x5 << 8)
+#define ZYNQMP_SSS_SHA_FROM_DMA     (0x5 << 12)
+#define VERSAL_SSS_DMA0_FROM_DMA0   (0xd << 0)
+#define VERSAL_SSS_SHA_FROM_DMA0    (0xc << 16)
+
+enum {
+    PLAT_ZCU102,
+    PLAT_ZYNQMP_FDT,
+    PLAT_VERSAL_FDT,
+};
+
+typedef struct Bench Bench;
+
+struct Bench {
+    const char *name;
+    int platform;
+    const char *unit;
+    /* Sizes to run with, zero terminated.  */
+    size_t sizes[4];
+    /* Does one iteration and returns how much of unit it got through.  */
+    double (*run)(const Bench *b, size_t size);
+    uint64_t base;
+    uint32_t route;
+};
+
+static double duration = 1.0;
+static const char *zynqmp_dtb;
+static const char *versal_dtb;
+static const char *filter;
+
+/* Nothing here needs the guest to run, a bit of virtual time is all the
+ * paced models need to move on.
+ */
+static void wait_bits(uint64_t addr, uint32_t mask)
+{
+    int i;
+
+    for (i = 0; !(readl(addr) & mask); i++) {
+        g_assert_cmpint(i, <, 100000);
+        clock_step(1000);
+    }
+    writel(addr, mask);
+}
+
+static double bench_lqspi_read(const Bench *b, size_t size)
+{
+    static uint8_t buf[MAX_SIZE];
+
+    bufread(b->base, buf, size);
+    return size;
+}
+
+static double bench_gem_tx(const Bench *b, size_t size)
+{
+    int i;
+
+    for (i = 0; i < GEM_RING; i++) {
+        uint32_t ctl = size | GEM_DESC_LAST;
+
+        if (i == GEM_RING - 1) {
+            ctl |= GEM_DESC_WRAP;
+        }
+        writel(DESC_ADDR + i * 8 + 4, ctl);
+    }
+    writel(b->base + R_GEM_TXQBASE, DESC_ADDR);
+    writel(b->base + R_GEM_NWCTRL, GEM_NWCTRL_TXENA | GEM_NWCTRL_TXSTART);
+    g_assert(readl(DESC_ADDR + (GEM_RING - 1) * 8 + 4) & GEM_DESC_USED);
+    writel(b->base + R_GEM_TXSTATUS, ~0);
+    return GEM_RING;
+}
+
+static double bench_zdma_copy(const Bench *b, size_t size)
+{
+    writel(b->base + R_ZDMA_SRC_DSCR, SRC_ADDR);
+    writel(b->base + R_ZDMA_SRC_DSCR + 4, 0);
+    writel(b->base + R_ZDMA_SRC_DSCR + 8, size);
+    writel(b->base + R_ZDMA_DST_DSCR, DST_ADDR);
+    writel(b->base + R_ZDMA_DST_DSCR + 4, 0);
+    writel(b->base + R_ZDMA_DST_DSCR + 8, size);
+    /* Simple mode, descriptors in registers.  */
+    writel(b->base + R_ZDMA_CTRL0, 0);
+    writel(b->base + R_ZDMA_CTRL2, 1);
+    wait_bits(b->base + R_ZDMA_ISR, ZDMA_ISR_DMA_DONE);
+    return size;
+}
+
+static void csu_dma_start(uint64_t ch, uint64_t addr, size_t size, bool last)
+{
+    writel(ch + R_CSU_DMA_ADDR_MSB, addr >> 32);
+    writel(ch + R_CSU_DMA_ADDR, addr);
+    writel(ch + R_CSU_DMA_SIZE, size | (last ? CSU_DMA_SIZE_LAST : 0));
+}
+
+static double bench_csu_dma_copy(const Bench *b, size_t size)
+{
+    csu_dma_start(b->base + CSU_DMA_DST, DST_ADDR, size, false);
+    csu_dma_start(b->base, SRC_ADDR, size, true);
+    wait_bits(b->base + CSU_DMA_DST + R_CSU_DMA_ISR, CSU_DMA_ISR_DONE);
+    wait_bits(b->base + R_CSU_DMA_ISR, CSU_DMA_ISR_DONE);
+    return size;
+}
+
+static double bench_sha3(const Bench *b, size_t size)
+{
+    uint64_t sha3 = b->platform == PLAT_VERSAL_FDT ? VERSAL_PMC_SHA3
+                                                   : ZYNQMP_CSU_SHA3;
+
+    writel(sha3 + R_SHA3_START, 1);
+    csu_dma_start(b->base, SRC_ADDR, size, true);
+    wait_bits(b->base + R_CSU_DMA_ISR, CSU_DMA_ISR_DONE);
+    return size;
+}
+
+static double bench_csu_aes_gcm(const Bench *b, size_t size)
+{
+    int i;
+
+    /* Encrypt with a user key, the source holds the IV and then the
+     * payload. The payload and the tag come back out.
+     */
+    writel(ZYNQMP_CSU_AES + R_AES_KEY_SRC, 0);
+    for (i = 0; i < 8; i++) {
+        writel(ZYNQMP_CSU_AES + R_AES_KUP_0 + i * 4, 0x01020304 * i);
+    }
+    writel(ZYNQMP_CSU_AES + R_AES_KEY_LOAD, 1);
+    writel(ZYNQMP_CSU_AES + R_AES_CFG, 1);
+    writel(ZYNQMP_CSU_AES + R_AES_START_MSG, 1);
+
+    csu_dma_start(b->base + CSU_DMA_DST, DST_ADDR, size + 16, false);
+    csu_dma_start(b->base, SRC_ADDR, size + 16, true);
+    wait_bits(b->base + CSU_DMA_DST + R_CSU_DMA_ISR, CSU_DMA_ISR_DONE);
+    wait_bits(b->base + R_CSU_DMA_ISR, CSU_DMA_ISR_DONE);
+    return size;
+}
+
+static const Bench benches[] = {
+    {
+        .name = "zynqmp/qspi-linear-read", .platform = PLAT_ZCU102,
+        .unit = "MB/s", .sizes = { 4096, 65536 },
+        .run = bench_lqspi_read, .base = ZYNQMP_LQSPI,
+    }, {
+        .name = "zynqmp/gem-tx", .platform = PLAT_ZCU102,
+        .unit = "packets/s", .sizes = { 64, 1514 },
+        .run = bench_gem_tx, .base = ZYNQMP_GEM0,
+    }, {
+        .name = "zynqmp/zdma-copy", .platform = PLAT_ZYNQMP_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE },
+        .run = bench_zdma_copy, .base = ZYNQMP_GDMA,
+    }, {
+        .name = "zynqmp/csu-dma-copy", .platform = PLAT_ZYNQMP_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE },
+        .run = bench_csu_dma_copy, .base = ZYNQMP_CSU_DMA,
+        .route = ZYNQMP_SSS_DMA_FROM_DMA,
+    }, {
+        .name = "zynqmp/csu-sha3", .platform = PLAT_ZYNQMP_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE },
+        .run = bench_sha3, .base = ZYNQMP_CSU_DMA,
+        .route = ZYNQMP_SSS_SHA_FROM_DMA,
+    }, {
+        .name = "zynqmp/csu-aes-gcm", .platform = PLAT_ZYNQMP_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE - 16 },
+        .run = bench_csu_aes_gcm, .base = ZYNQMP_CSU_DMA,
+        .route = ZYNQMP_SSS_AES_FROM_DMA | ZYNQMP_SSS_DMA_FROM_AES,
+    }, {
+        .name = "versal/ospi-dac-read", .platform = PLAT_VERSAL_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536 },
+        .run = bench_lqspi_read, .base = VERSAL_OSPI_DAC,
+    }, {
+        .name = "versal/adma-copy", .platform = PLAT_VERSAL_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE },
+        .run = bench_zdma_copy, .base = VERSAL_ADMA,
+    }, {
+        .name = "versal/pmc-dma-copy", .platform = PLAT_VERSAL_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE },
+        .run = bench_csu_dma_copy, .base = VERSAL_PMC_DMA0,
+        .route = VERSAL_SSS_DMA0_FROM_DMA0,
+    }, {
+        .name = "versal/pmc-sha3", .platform = PLAT_VERSAL_FDT,
+        .unit = "MB/s", .sizes = { 4096, 65536, MAX_SIZE },
+        .run = bench_sha3, .base = VERSAL_PMC_DMA0,
+        .route = VERSAL_SSS_SHA_FROM_DMA0,
+    },
+};
+
+static bool bench_start(const Bench *b)
+{
+    static uint8_t pattern[MAX_SIZE];
+    size_t i;
+
+    switch (b->platform) {
+    case PLAT_ZCU102:
+        qtest_start("-machine xlnx-zcu102 -m 256M -net none");
+        break;
+    case PLAT_ZYNQMP_FDT:
+    case PLAT_VERSAL_FDT:
+        if (b->platform == PLAT_ZYNQMP_FDT ? !zynqmp_dtb : !versal_dtb) {
+            return false;
+        }
+        global_qtest = qtest_startf("-machine arm-generic-fdt -hw-dtb %s "
+                                    "-net none",
+                                    b->platform == PLAT_ZYNQMP_FDT ?
+                                    zynqmp_dtb : versal_dtb);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    for (i = 0; i < sizeof pattern; i++) {
+        pattern[i] = i * 7;
+    }
+    bufwrite(SRC_ADDR, pattern, sizeof pattern);
+
+    if (b->platform == PLAT_ZYNQMP_FDT && b->route) {
+        writel(ZYNQMP_CSU_SSS, b->route);
+    } else if (b->platform == PLAT_VERSAL_FDT && b->route) {
+        writel(VERSAL_PMC_SSS, b->route);
+    }
+
+    if (b->run == bench_lqspi_read && b->platform == PLAT_ZCU102) {
+        /* Legacy controller, linear mode, plain READ.  */
+        writel(ZYNQMP_QSPI + R_GQSPI_SELECT, 0);
+        writel(ZYNQMP_QSPI + R_LQSPI_CFG, LQSPI_CFG_LQ_MODE | 0x03);
+        writel(ZYNQMP_QSPI + R_QSPI_EN, 1);
+    } else if (b->run == bench_lqspi_read) {
+        writel(VERSAL_OSPI + R_OSPI_DEV_INSTR_RD, 0x03);
+        writel(VERSAL_OSPI + R_OSPI_CONFIG,
+               OSPI_CONFIG_ENB_DIR_ACC | OSPI_CONFIG_ENB_SPI);
+    } else if (b->run == bench_gem_tx) {
+        for (i = 0; i < GEM_RING; i++) {
+            writel(DESC_ADDR + i * 8, SRC_ADDR);
+        }
+        /* Park the other priority queues on a descriptor we own.  */
+        writel(DESC_ADDR + GEM_RING * 8 + 4, GEM_DESC_USED | GEM_DESC_WRAP);
+        for (i = 1; i < GEM_NUM_QUEUES; i++) {
+            writel(b->base + R_GEM_TXQ1BASE + (i - 1) * 4,
+                   DESC_ADDR + GEM_RING * 8);
+        }
+    }
+    return true;
+}
+
+static void bench_report(const Bench *b, size_t size, unsigned long iters,
+                         double units, double secs)
+{
+    double rate = units / secs;
+
+    if (!strcmp(b->unit, "MB/s")) {
+        rate /= 1024 * 1024;
+    }
+    printf("{\"bench\": \"%s\", \"size\": %zu, \"iterations\": %lu, "
+           "\"seconds\": %.3f, \"rate\": %.2f, \"unit\": \"%s\"}\n",
+           b->name, size, iters, secs, rate, b->unit);
+    fflush(stdout);
+}
+
+static void bench_run(const Bench *b)
+{
+    GTimer *timer;
+    int i;
+
+    if (filter && !strstr(b->name, filter)) {
+        return;
+    }
+    if (!bench_start(b)) {
+        fprintf(stderr, "%s: skipped, no hardware DTB given\n", b->name);
+        return;
+    }
+
+    timer = g_timer_new();
+    for (i = 0; i < ARRAY_SIZE(b->sizes) && b->sizes[i]; i++) {
+        size_t size = b->sizes[i];
+        unsigned long iters = 0;
+        double units = 0;
+
+        /* Warm up, maps and caches get set up on first use.  */
+        b->run(b, size);
+
+        g_timer_start(timer);
+        do {
+            units += b->run(b, size);
+            iters++;
+        } while (g_timer_elapsed(timer, NULL) < duration);
+        bench_report(b, size, iters, units, g_timer_elapsed(timer, NULL));
+    }
+    g_timer_destroy(timer);
+    qtest_end();
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("Runs with QTEST_QEMU_BINARY set to qemu-system-aarch64.\n\n");
+    printf(" -d = duration of each run, in seconds. Default: %g\n", duration);
+    printf(" -f = only run the benchmarks whose name contains this\n");
+    printf(" -z = ZynqMP hardware DTB, for the CSU and ZDMA runs\n");
+    printf(" -v = Versal hardware DTB, for the PMC, OSPI and ADMA runs\n");
+    printf(" -l = list the benchmarks\n");
+    printf(" -h = show this help message\n");
+}
+
+int main(int argc, char **argv)
+{
+    int i, c;
+
+    while ((c = getopt(argc, argv, "d:f:z:v:lh")) != -1) {
+        switch (c) {
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'f':
+            filter = optarg;
+            break;
+        case 'z':
+            zynqmp_dtb = optarg;
+            break;
+        case 'v':
+            versal_dtb = optarg;
+            break;
+        case 'l':
+            for (i = 0; i < ARRAY_SIZE(benches); i++) {
+                printf("%s\n", benches[i].name);
+            }
+            return 0;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(benches); i++) {
+        bench_run(&benches[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * Boot time regression check for Versal
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Boots a reference image with TCG, QTEST_QEMU_BINARY pointing at
+ * qemu-system-aarch64, until a boot milestone is hit.  Prints the boot
+ * profile on stdout as one JSON object per milestone and, given a
+ * baseline, fails if a milestone was not hit or took longer in host time
+ * than the baseline allows.
+ *
+ * A baseline has one milestone per line, the phase, optionally followed
+ * by ':' and the detail, and the host time in milliseconds it is expected
+ * within, e.g. "apu-release:acpu0 950.0".  -w writes one from a run.
+ */
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+static const char *qemu_args;
+static const char *baseline;
+static const char *write_baseline;
+static const char *until = "console-output";
+static double tolerance = 20.0;
+static unsigned int timeout = 600;
+
+/* libqtest kills QEMU on abort.  */
+static void perf_timeout(int sig)
+{
+    abort();
+}
+
+/* Events may come in before the reply.  */
+static QList *perf_query(void)
+{
+    QDict *resp, *ret;
+    QList *entries;
+
+    qmp_async("{ 'execute': 'query-boot-profile' }");
+    for (;;) {
+        resp = qmp_receive();
+        if (qdict_haskey(resp, "return")) {
+            break;
+        }
+        g_assert(!qdict_haskey(resp, "error"));
+        QDECREF(resp);
+    }
+    ret = qdict_get_qdict(resp, "return");
+    entries = qdict_get_qlist(ret, "entries");
+    QINCREF(entries);
+    QDECREF(resp);
+    return entries;
+}
+
+static char *perf_entry_name(QDict *e)
+{
+    if (qdict_haskey(e, "detail")) {
+        return g_strdup_printf("%s:%s", qdict_get_str(e, "phase"),
+                               qdict_get_str(e, "detail"));
+    }
+    return g_strdup(qdict_get_str(e, "phase"));
+}
+
+static double perf_ms(QDict *e, const char *key)
+{
+    return qdict_get_int(e, key) / 1e6;
+}
+
+static void perf_wait(void)
+{
+    QDict *resp;
+
+    for (;;) {
+        resp = qmp_receive();
+        if (qdict_haskey(resp, "event") &&
+            !strcmp(qdict_get_str(resp, "event"), "BOOT_PHASE")) {
+            QDict *data = qdict_get_qdict(resp, "data");
+
+            if (!strcmp(qdict_get_str(data, "phase"), until)) {
+                QDECREF(resp);
+                return;
+            }
+        }
+        QDECREF(resp);
+    }
+}
+
+/* Returns the number of milestones that regressed.  */
+static int perf_check(GHashTable *profile)
+{
+    char line[256];
+    int failed = 0;
+    FILE *f;
+
+    f = fopen(baseline, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", baseline, strerror(errno));
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        double limit, *ms;
+
+        if (line[0] == '#' || sscanf(line, "%127s %lf", name, &limit) != 2) {
+            continue;
+        }
+        limit *= 1 + tolerance / 100;
+        ms = g_hash_table_lookup(profile, name);
+        if (!ms) {
+            printf("{\"milestone\": \"%s\", \"result\": \"missing\"}\n", name);
+            failed++;
+        } else if (*ms > limit) {
+            printf("{\"milestone\": \"%s\", \"result\": \"regressed\", "
+                   "\"host-ms\": %.3f, \"limit-ms\": %.3f}\n",
+                   name, *ms, limit);
+            failed++;
+        }
+    }
+    fclose(f);
+    return failed;
+}
+
+static int perf_run(void)
+{
+    GHashTable *profile;
+    const QListEntry *entry;
+    QList *entries;
+    FILE *out = NULL;
+    int failed = 0;
+
+    signal(SIGALRM, perf_timeout);
+    alarm(timeout);
+    global_qtest = qtest_startf("-machine accel=tcg %s", qemu_args);
+    perf_wait();
+    alarm(0);
+    entries = perf_query();
+    qtest_end();
+
+    if (write_baseline) {
+        out = fopen(write_baseline, "w");
+        if (!out) {
+            fprintf(stderr, "%s: %s\n", write_baseline, strerror(errno));
+            return 1;
+        }
+    }
+
+    profile = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    QLIST_FOREACH_ENTRY(entries, entry) {
+        QDict *e = qobject_to_qdict(qlist_entry_obj(entry));
+        char *name = perf_entry_name(e);
+        double *ms = g_new(double, 1);
+
+        *ms = perf_ms(e, "host-ns");
+        printf("{\"milestone\": \"%s\", \"vm-ms\": %.3f, \"host-ms\": %.3f, "
+               "\"count\": %" PRId64 "}\n", name, perf_ms(e, "vm-ns"), *ms,
+               qdict_get_int(e, "count"));
+        if (out) {
+            fprintf(out, "%s %.3f\n", name, *ms);
+        }
+        g_hash_table_insert(profile, name, ms);
+    }
+    QDECREF(entries);
+    if (out) {
+        fclose(out);
+    }
+
+    if (baseline) {
+        failed = perf_check(profile);
+    }
+    g_hash_table_destroy(profile);
+    fflush(stdout);
+    return failed ? 1 : 0;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] -a <QEMU options>\n", name);
+    printf("Runs with QTEST_QEMU_BINARY set to qemu-system-aarch64.\n\n");
+    printf(" -a = QEMU options that boot the reference image\n");
+    printf(" -u = milestone to boot until. Default: %s\n", until);
+    printf(" -b = baseline to check the milestones against\n");
+    printf(" -t = slowdown allowed over the baseline, in percent. "
+           "Default: %g\n", tolerance);
+    printf(" -w = write the milestones of this run as a baseline\n");
+    printf(" -T = give up after this many seconds. Default: %u\n", timeout);
+    printf(" -h = show this help message\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+
+    while ((c = getopt(argc, argv, "a:u:b:t:w:T:h")) != -1) {
+        switch (c) {
+        case 'a':
+            qemu_args = optarg;
+            break;
+        case 'u':
+            until = optarg;
+            break;
+        case 'b':
+            baseline = optarg;
+            break;
+        case 't':
+            tolerance = atof(optarg);
+            break;
+        case 'w':
+            write_baseline = optarg;
+            break;
+        case 'T':
+            timeout = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!qemu_args) {
+        fprintf(stderr, "%s: no reference image, see -h\n", argv[0]);
+        return 1;
+    }
+    return perf_run();
+}
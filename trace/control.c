@@ -13,6 +13,9 @@
 #ifdef CONFIG_TRACE_SIMPLE
 #include "trace/simple.h"
 #endif
+#ifdef CONFIG_TRACE_PERTHREAD
+#include "trace/perthread.h"
+#endif
 #ifdef CONFIG_TRACE_FTRACE
 #include "trace/ftrace.h"
 #endif
@@ -251,6 +254,12 @@ void trace_init_file(const char *file)
 {
 #ifdef CONFIG_TRACE_SIMPLE
     st_set_trace_file(file);
+#ifdef CONFIG_TRACE_PERTHREAD
+    /* "-trace file" only applies to the simple backend */
+    pt_set_trace_file(NULL);
+#endif
+#elif defined CONFIG_TRACE_PERTHREAD
+    pt_set_trace_file(file);
 #elif defined CONFIG_TRACE_LOG
     /* If both the simple and the log backends are enabled, "-trace file"
      * only applies to the simple backend; use "-D" for the log backend.
@@ -294,6 +303,13 @@ bool trace_init_backends(void)
     }
 #endif
 
+#ifdef CONFIG_TRACE_PERTHREAD
+    if (!pt_init()) {
+        fprintf(stderr, "failed to initialize perthread tracing backend.\n");
+        return false;
+    }
+#endif
+
 #ifdef CONFIG_TRACE_FTRACE
     if (!ftrace_init()) {
         fprintf(stderr, "failed to initialize ftrace backend.\n");
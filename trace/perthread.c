@@ -0,0 +1,436 @@
+/*
+ * Per-thread binary trace backend
+ *
+ * Every thread records its events into a ring of its own.  Only the owner
+ * writes to a ring and only the writer thread drains it, so recording an
+ * event takes neither a lock nor an atomic read-modify-write.  When a ring
+ * is full, events are dropped and counted rather than waited for.
+ *
+ * Events are stamped with the host cycle counter.  The trace file is a
+ * sequence of chunks, each holding the records drained from one thread in
+ * one go, so a reader has to merge the threads by timestamp; see
+ * docs/devel/tracing.txt for the format and scripts/perthreadtrace.py.
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/error-report.h"
+#include "trace/control.h"
+#include "trace/perthread.h"
+
+/* Bytes of ring per thread, a power of two */
+#define PT_BUF_SIZE (256 * 1024)
+
+/* How long the writer lets records pile up before draining the rings */
+#define PT_WRITER_PERIOD_MS 50
+
+/** Trace file magic number, "PTTRACE1" */
+#define PT_HEADER_MAGIC 0x5054545241434531ULL
+
+/** Trace file version number, bump if format changes */
+#define PT_HEADER_VERSION 1
+
+enum {
+    PT_CHUNK_MAPPING = 0,
+    PT_CHUNK_EVENTS = 1,
+};
+
+typedef struct {
+    uint64_t magic;      /* PT_HEADER_MAGIC */
+    uint32_t version;    /* PT_HEADER_VERSION */
+    uint32_t pid;
+} PtFileHeader;
+
+/*
+ * Precedes the records of one thread.  ticks and ns sample the host cycle
+ * counter and the host clock back to back, so that readers can convert
+ * between the two.
+ */
+typedef struct {
+    uint32_t type;
+    uint32_t tid;
+    uint64_t ticks;
+    uint64_t ns;
+    uint32_t len;        /* bytes following the chunk header */
+    uint32_t dropped;    /* events the thread dropped since its last chunk */
+} PtChunkHeader;
+
+/* An event record, followed by its arguments */
+typedef struct {
+    uint64_t ticks;
+    uint32_t event;
+    uint32_t len;        /* bytes of arguments */
+} PtEventHeader;
+
+struct PtBuffer {
+    PtBuffer *next;
+    uint32_t tid;
+    bool exited;
+    Notifier exit;
+
+    /* [tail, head) is waiting for the writer, [head, wpos) is being built */
+    size_t head;
+    size_t tail;
+    size_t wpos;
+    unsigned int dropped;
+    uint8_t *data;
+};
+
+PtEventHook *pt_event_hook;
+
+/* Rings are only added, at the list head, except by the writer thread.  */
+static PtBuffer *pt_buffers;
+static __thread PtBuffer *pt_thread_buffer;
+static __thread bool pt_thread_exited;
+
+/*
+ * QEMU's own locks can't be used, they are traced.  pt_lock protects the
+ * wakeup and flush state, pt_io_lock the trace file.
+ */
+static CompatGMutex pt_lock;
+static CompatGCond pt_cond;
+static CompatGCond pt_flushed_cond;
+static bool pt_kicked;
+static unsigned int pt_flush_req;
+static unsigned int pt_flush_done;
+
+static CompatGMutex pt_io_lock;
+static FILE *pt_fp;
+static char *pt_file_name;
+
+static void pt_thread_exit(Notifier *n, void *data)
+{
+    PtBuffer *b = container_of(n, PtBuffer, exit);
+
+    pt_thread_buffer = NULL;
+    pt_thread_exited = true;
+    /* Pairs with the writer, everything recorded is published by now.  */
+    atomic_store_release(&b->exited, true);
+}
+
+static PtBuffer *pt_buffer_get(void)
+{
+    PtBuffer *b = pt_thread_buffer;
+
+    if (likely(b)) {
+        return b;
+    }
+    if (pt_thread_exited) {
+        return NULL;
+    }
+
+    /* don't use g_malloc, can deadlock when traced */
+    b = calloc(1, sizeof(*b));
+    if (!b) {
+        return NULL;
+    }
+    b->data = malloc(PT_BUF_SIZE);
+    if (!b->data) {
+        free(b);
+        return NULL;
+    }
+    b->tid = qemu_get_thread_id();
+    b->exit.notify = pt_thread_exit;
+    qemu_thread_atexit_add(&b->exit);
+    do {
+        b->next = atomic_read(&pt_buffers);
+    } while (atomic_cmpxchg(&pt_buffers, b->next, b) != b->next);
+
+    pt_thread_buffer = b;
+    return b;
+}
+
+static void pt_buffer_write(PtBuffer *b, const void *data, size_t len)
+{
+    size_t off = b->wpos & (PT_BUF_SIZE - 1);
+    size_t first = MIN(len, PT_BUF_SIZE - off);
+
+    memcpy(b->data + off, data, first);
+    memcpy(b->data, (const uint8_t *)data + first, len - first);
+    b->wpos += len;
+}
+
+static void pt_kick(void)
+{
+    g_mutex_lock(&pt_lock);
+    pt_kicked = true;
+    g_cond_signal(&pt_cond);
+    g_mutex_unlock(&pt_lock);
+}
+
+int pt_record_start(PtRecord *rec, uint32_t event, size_t arglen)
+{
+    PtBuffer *b = pt_buffer_get();
+    PtEventHeader hdr;
+    size_t len = sizeof(hdr) + arglen;
+
+    if (!b) {
+        return -ENOSPC;
+    }
+    if (b->wpos + len - atomic_load_acquire(&b->tail) > PT_BUF_SIZE) {
+        /* Ring full, event dropped ! */
+        atomic_inc(&b->dropped);
+        return -ENOSPC;
+    }
+
+    hdr.ticks = cpu_get_host_ticks();
+    hdr.event = event;
+    hdr.len = arglen;
+    pt_buffer_write(b, &hdr, sizeof(hdr));
+    rec->buf = b;
+    return 0;
+}
+
+void pt_record_write_u64(PtRecord *rec, uint64_t val)
+{
+    pt_buffer_write(rec->buf, &val, sizeof(val));
+}
+
+void pt_record_write_str(PtRecord *rec, const char *s, uint32_t slen)
+{
+    pt_buffer_write(rec->buf, &slen, sizeof(slen));
+    pt_buffer_write(rec->buf, s, slen);
+}
+
+void pt_record_finish(PtRecord *rec)
+{
+    PtBuffer *b = rec->buf;
+    size_t tail = atomic_read(&b->tail);
+    size_t prev_used = b->head - tail;
+    size_t used = b->wpos - tail;
+
+    atomic_store_release(&b->head, b->wpos);
+
+    /* Kick the writer early once the ring gets half full.  */
+    if (prev_used < PT_BUF_SIZE / 2 && used >= PT_BUF_SIZE / 2) {
+        pt_kick();
+    }
+}
+
+/* Called with pt_io_lock held and pt_fp open.  */
+static void pt_buffer_drain(PtBuffer *b)
+{
+    size_t head = atomic_load_acquire(&b->head);
+    size_t tail = b->tail;
+    size_t off = tail & (PT_BUF_SIZE - 1);
+    size_t first = MIN(head - tail, PT_BUF_SIZE - off);
+    size_t unused __attribute__ ((unused));
+    PtChunkHeader hdr;
+
+    hdr.dropped = atomic_xchg(&b->dropped, 0);
+    if (head == tail && !hdr.dropped) {
+        return;
+    }
+
+    hdr.type = PT_CHUNK_EVENTS;
+    hdr.tid = b->tid;
+    hdr.ticks = cpu_get_host_ticks();
+    hdr.ns = get_clock();
+    hdr.len = head - tail;
+    unused = fwrite(&hdr, sizeof(hdr), 1, pt_fp);
+    unused = fwrite(b->data + off, 1, first, pt_fp);
+    unused = fwrite(b->data, 1, hdr.len - first, pt_fp);
+
+    atomic_store_release(&b->tail, head);
+}
+
+/* Only the writer thread unlinks, producers only ever touch the head.  */
+static void pt_buffer_unlink(PtBuffer *b)
+{
+    PtBuffer **pb;
+
+    if (atomic_cmpxchg(&pt_buffers, b, b->next) == b) {
+        return;
+    }
+    for (pb = &pt_buffers; *pb != b; pb = &(*pb)->next) {
+        /* nothing */
+    }
+    *pb = b->next;
+}
+
+static void pt_write_pass(void)
+{
+    PtBuffer *b, *next;
+
+    g_mutex_lock(&pt_io_lock);
+    for (b = atomic_read(&pt_buffers); b; b = next) {
+        bool exited = atomic_load_acquire(&b->exited);
+
+        next = b->next;
+        if (pt_fp) {
+            pt_buffer_drain(b);
+        }
+        if (exited) {
+            pt_buffer_unlink(b);
+            free(b->data); /* don't use g_free, can deadlock when traced */
+            free(b);
+        }
+    }
+    if (pt_fp) {
+        fflush(pt_fp);
+    }
+    g_mutex_unlock(&pt_io_lock);
+}
+
+static gpointer pt_writer_thread(gpointer opaque)
+{
+    unsigned int req;
+
+    for (;;) {
+        g_mutex_lock(&pt_lock);
+        if (!pt_kicked && pt_flush_req == pt_flush_done) {
+            g_cond_wait_until(&pt_cond, &pt_lock,
+                              g_get_monotonic_time() +
+                              PT_WRITER_PERIOD_MS * 1000);
+        }
+        pt_kicked = false;
+        req = pt_flush_req;
+        g_mutex_unlock(&pt_lock);
+
+        pt_write_pass();
+
+        g_mutex_lock(&pt_lock);
+        pt_flush_done = req;
+        g_cond_broadcast(&pt_flushed_cond);
+        g_mutex_unlock(&pt_lock);
+    }
+    return NULL;
+}
+
+void pt_flush_trace_buffer(void)
+{
+    unsigned int req;
+
+    g_mutex_lock(&pt_lock);
+    req = ++pt_flush_req;
+    g_cond_signal(&pt_cond);
+    while ((int)(pt_flush_done - req) < 0) {
+        g_cond_wait(&pt_flushed_cond, &pt_lock);
+    }
+    g_mutex_unlock(&pt_lock);
+}
+
+static int pt_write_event_mapping(FILE *fp)
+{
+    PtChunkHeader hdr = {
+        .type = PT_CHUNK_MAPPING,
+        .ticks = cpu_get_host_ticks(),
+        .ns = get_clock(),
+    };
+    TraceEventIter iter;
+    TraceEvent *ev;
+
+    trace_event_iter_init(&iter, NULL);
+    while ((ev = trace_event_iter_next(&iter)) != NULL) {
+        hdr.len += 2 * sizeof(uint32_t) + strlen(trace_event_get_name(ev));
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        return -1;
+    }
+
+    trace_event_iter_init(&iter, NULL);
+    while ((ev = trace_event_iter_next(&iter)) != NULL) {
+        uint32_t id = trace_event_get_id(ev);
+        const char *name = trace_event_get_name(ev);
+        uint32_t len = strlen(name);
+
+        if (fwrite(&id, sizeof(id), 1, fp) != 1 ||
+            fwrite(&len, sizeof(len), 1, fp) != 1 ||
+            fwrite(name, len, 1, fp) != 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Set the name of the trace file and start writing to it
+ *
+ * @file        The trace file name or NULL for the default name-<pid>.pt set
+ *              at config time
+ */
+void pt_set_trace_file(const char *file)
+{
+    PtFileHeader header = {
+        .magic = PT_HEADER_MAGIC,
+        .version = PT_HEADER_VERSION,
+        .pid = getpid(),
+    };
+    FILE *fp;
+
+    /* Whatever was recorded so far belongs to the old file.  */
+    pt_flush_trace_buffer();
+
+    g_mutex_lock(&pt_io_lock);
+    if (pt_fp) {
+        fclose(pt_fp);
+        pt_fp = NULL;
+    }
+    g_free(pt_file_name);
+    if (!file) {
+        /* Type cast needed for Windows where getpid() returns an int. */
+        pt_file_name = g_strdup_printf(CONFIG_TRACE_FILE ".pt",
+                                       (pid_t)getpid());
+    } else {
+        pt_file_name = g_strdup(file);
+    }
+
+    fp = fopen(pt_file_name, "wb");
+    if (!fp) {
+        warn_report("cannot open trace file %s: %s", pt_file_name,
+                    strerror(errno));
+    } else if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+               pt_write_event_mapping(fp) < 0) {
+        warn_report("cannot write trace file %s", pt_file_name);
+        fclose(fp);
+    } else {
+        pt_fp = fp;
+    }
+    g_mutex_unlock(&pt_io_lock);
+}
+
+/* Helper function to create a thread with signals blocked, see
+ * trace/simple.c for why.
+ */
+static GThread *pt_thread_create(GThreadFunc fn)
+{
+    GThread *thread;
+#ifndef _WIN32
+    sigset_t set, oldset;
+
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oldset);
+#endif
+
+    thread = g_thread_new("trace-perthread", fn, NULL);
+
+#ifndef _WIN32
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+#endif
+
+    return thread;
+}
+
+bool pt_init(void)
+{
+    GThread *thread;
+
+    thread = pt_thread_create(pt_writer_thread);
+    if (!thread) {
+        warn_report("unable to initialize perthread trace backend");
+        return false;
+    }
+
+    atexit(pt_flush_trace_buffer);
+    return true;
+}
@@ -0,0 +1,72 @@
+/*
+ * Per-thread binary trace backend
+ *
+ * Copyright (c) 2018 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef TRACE_PERTHREAD_H
+#define TRACE_PERTHREAD_H
+
+#include "qemu/atomic.h"
+
+bool pt_init(void);
+/* Write the trace to @file, or to the default name-<pid>.pt if NULL.  */
+void pt_set_trace_file(const char *file);
+/* Wait until everything recorded so far is in the trace file.  */
+void pt_flush_trace_buffer(void);
+
+typedef struct PtBuffer PtBuffer;
+
+typedef struct {
+    PtBuffer *buf;
+} PtRecord;
+
+#define PT_MAX_STRLEN 512
+
+/**
+ * Start a record in the ring of the calling thread
+ *
+ * @arglen  number of bytes required for arguments
+ *
+ * Returns -ENOSPC if the ring is full, the record is then counted as dropped.
+ */
+int pt_record_start(PtRecord *rec, uint32_t id, size_t arglen);
+
+/**
+ * Append a 64-bit argument to a record
+ */
+void pt_record_write_u64(PtRecord *rec, uint64_t val);
+
+/**
+ * Append a string argument to a record
+ */
+void pt_record_write_str(PtRecord *rec, const char *s, uint32_t slen);
+
+/**
+ * Publish a record to the writer thread
+ *
+ * Don't append any more arguments to the record after calling this.
+ */
+void pt_record_finish(PtRecord *rec);
+
+/*
+ * Called for every enabled event with its name and its first argument,
+ * or 0 if it has none.  The etrace code sets it to mirror trace events
+ * into the etrace stream.
+ */
+typedef void PtEventHook(const char *name, uint64_t val);
+extern PtEventHook *pt_event_hook;
+
+static inline void pt_event_notify(const char *name, uint64_t val)
+{
+    PtEventHook *hook = atomic_read(&pt_event_hook);
+
+    if (unlikely(hook)) {
+        hook(name, val);
+    }
+}
+
+#endif /* TRACE_PERTHREAD_H */
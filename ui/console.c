@@ -30,6 +30,8 @@
 #include "chardev/char-fe.h"
 #include "trace.h"
 #include "exec/memory.h"
+#include "qemu/crc32c.h"
+#include "qemu/bitmap.h"
 
 #define DEFAULT_BACKSCROLL 512
 #define CONSOLE_CURSOR_PERIOD 500
@@ -134,6 +136,11 @@ struct QemuConsole {
     const GraphicHwOps *hw_ops;
     void *hw;
 
+    /* Checksum of each line of the surface, once one was asked for */
+    uint32_t *line_crc;
+    unsigned long *line_crc_dirty;
+    int line_crc_lines;
+
     /* Text console state */
     int width;
     int height;
@@ -357,6 +364,62 @@ void qmp_screendump(const char *filename, Error **errp)
     ppm_save(filename, surface, errp);
 }
 
+static void qemu_console_free_checksums(QemuConsole *con)
+{
+    g_free(con->line_crc);
+    g_free(con->line_crc_dirty);
+    con->line_crc = NULL;
+    con->line_crc_dirty = NULL;
+    con->line_crc_lines = 0;
+}
+
+DisplayChecksum *qmp_query_display_checksum(bool has_console, int64_t console,
+                                            Error **errp)
+{
+    QemuConsole *con = qemu_console_lookup_by_index(has_console ? console : 0);
+    DisplayChecksum *info;
+    DisplaySurface *surface;
+    int height, line_bytes, y;
+
+    if (con == NULL) {
+        error_setg(errp, "There is no console %" PRId64,
+                   has_console ? console : 0);
+        return NULL;
+    }
+
+    /* Devices that compose lazily do it now */
+    graphic_hw_update(con);
+    surface = qemu_console_surface(con);
+    info = g_new0(DisplayChecksum, 1);
+    if (!surface) {
+        return info;
+    }
+
+    height = surface_height(surface);
+    line_bytes = surface_width(surface) * surface_bytes_per_pixel(surface);
+    if (con->line_crc_lines != height) {
+        qemu_console_free_checksums(con);
+        con->line_crc = g_new0(uint32_t, height);
+        con->line_crc_dirty = bitmap_new(height);
+        bitmap_set(con->line_crc_dirty, 0, height);
+        con->line_crc_lines = height;
+    }
+
+    /* Only the lines reported by dpy_gfx_update are hashed again */
+    for (y = find_first_bit(con->line_crc_dirty, height); y < height;
+         y = find_next_bit(con->line_crc_dirty, height, y + 1)) {
+        con->line_crc[y] = crc32c(0xffffffff, (uint8_t *)surface_data(surface)
+                                  + y * surface_stride(surface), line_bytes);
+    }
+    bitmap_zero(con->line_crc_dirty, height);
+
+    info->width = surface_width(surface);
+    info->height = height;
+    info->checksum = crc32c(0xffffffff, (uint8_t *)con->line_crc,
+                            height * sizeof(uint32_t));
+    return info;
+}
+
 void graphic_hw_text_update(QemuConsole *con, console_ch_t *chardata)
 {
     if (!con) {
@@ -1527,6 +1590,10 @@ void dpy_gfx_update(QemuConsole *con, int x, int y, int w, int h)
     w = MIN(w, width - x);
     h = MIN(h, height - y);
 
+    if (con->line_crc && y < con->line_crc_lines && h > 0) {
+        bitmap_set(con->line_crc_dirty, y, MIN(h, con->line_crc_lines - y));
+    }
+
     if (!qemu_console_is_visible(con)) {
         return;
     }
@@ -1550,6 +1617,7 @@ void dpy_gfx_replace_surface(QemuConsole *con,
     assert(old_surface != surface || surface == NULL);
 
     con->surface = surface;
+    qemu_console_free_checksums(con);
     QLIST_FOREACH(dcl, &s->listeners, next) {
         if (con != (dcl->con ? dcl->con : active_console)) {
             continue;
@@ -35,9 +35,18 @@ struct AioHandler
     int deleted;
     void *opaque;
     bool is_external;
+    /* Without .io_poll(), poll the fd for readiness, see
+     * aio_set_fd_poll_ready()
+     */
+    bool poll_ready;
     QLIST_ENTRY(AioHandler) node;
 };
 
+static bool aio_node_can_poll(AioHandler *node)
+{
+    return node->io_poll || node->poll_ready;
+}
+
 #ifdef CONFIG_EPOLL_CREATE1
 
 /* The fd number threashold to switch to epoll */
@@ -245,7 +254,7 @@ void aio_set_fd_handler(AioContext *ctx,
             deleted = true;
         }
 
-        if (!node->io_poll) {
+        if (!aio_node_can_poll(node)) {
             ctx->poll_disable_cnt--;
         }
     } else {
@@ -257,10 +266,8 @@ void aio_set_fd_handler(AioContext *ctx,
 
             g_source_add_poll(&ctx->source, &node->pfd);
             is_new = true;
-
-            ctx->poll_disable_cnt += !io_poll;
         } else {
-            ctx->poll_disable_cnt += !io_poll - !node->io_poll;
+            ctx->poll_disable_cnt -= !aio_node_can_poll(node);
         }
 
         /* Update handler with latest information */
@@ -272,6 +279,8 @@ void aio_set_fd_handler(AioContext *ctx,
 
         node->pfd.events = (io_read ? G_IO_IN | G_IO_HUP | G_IO_ERR : 0);
         node->pfd.events |= (io_write ? G_IO_OUT | G_IO_ERR : 0);
+
+        ctx->poll_disable_cnt += !aio_node_can_poll(node);
     }
 
     aio_epoll_update(ctx, node, is_new);
@@ -297,6 +306,21 @@ void aio_set_fd_poll(AioContext *ctx, int fd,
     node->io_poll_end = io_poll_end;
 }
 
+void aio_set_fd_poll_ready(AioContext *ctx, int fd, bool poll_ready)
+{
+    AioHandler *node;
+
+    qemu_lockcnt_lock(&ctx->list_lock);
+    node = find_aio_handler(ctx, fd);
+    if (node) {
+        ctx->poll_disable_cnt -= !aio_node_can_poll(node);
+        node->poll_ready = poll_ready;
+        ctx->poll_disable_cnt += !aio_node_can_poll(node);
+    }
+    qemu_lockcnt_unlock(&ctx->list_lock);
+    aio_notify(ctx);
+}
+
 void aio_set_event_notifier(AioContext *ctx,
                             EventNotifier *notifier,
                             bool is_external,
@@ -317,6 +341,13 @@ void aio_set_event_notifier_poll(AioContext *ctx,
                     (IOHandler *)io_poll_end);
 }
 
+void aio_set_event_notifier_poll_ready(AioContext *ctx,
+                                       EventNotifier *notifier,
+                                       bool poll_ready)
+{
+    aio_set_fd_poll_ready(ctx, event_notifier_get_fd(notifier), poll_ready);
+}
+
 static void poll_set_started(AioContext *ctx, bool started)
 {
     AioHandler *node;
@@ -486,6 +517,33 @@ static void add_pollfd(AioHandler *node)
     npfd++;
 }
 
+/* Dispatch a handler without .io_poll() if its fd is ready, the way
+ * aio_dispatch_handlers() does after ppoll(2).
+ */
+static bool run_poll_ready_handler(AioHandler *node)
+{
+    GPollFD pfd = {
+        .fd = node->pfd.fd,
+        .events = node->pfd.events,
+    };
+    bool progress = false;
+
+    if (qemu_poll_ns(&pfd, 1, 0) <= 0) {
+        return false;
+    }
+
+    if ((pfd.revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) && node->io_read) {
+        node->io_read(node->opaque);
+        progress = true;
+    }
+    if (!node->deleted &&
+        (pfd.revents & (G_IO_OUT | G_IO_ERR)) && node->io_write) {
+        node->io_write(node->opaque);
+        progress = true;
+    }
+    return progress;
+}
+
 static bool run_poll_handlers_once(AioContext *ctx)
 {
     bool progress = false;
@@ -496,6 +554,10 @@ static bool run_poll_handlers_once(AioContext *ctx)
             aio_node_check(ctx, node->is_external) &&
             node->io_poll(node->opaque)) {
             progress = true;
+        } else if (!node->deleted && !node->io_poll && node->poll_ready &&
+                   aio_node_check(ctx, node->is_external) &&
+                   run_poll_ready_handler(node)) {
+            progress = true;
         }
 
         /* Caller handles freeing deleted nodes.  Don't do it here. */
@@ -559,7 +621,9 @@ static bool try_poll_mode(AioContext *ctx, bool blocking)
         if (max_ns) {
             poll_set_started(ctx, true);
 
+            ctx->poll_attempts++;
             if (run_poll_handlers(ctx, max_ns)) {
+                ctx->poll_successes++;
                 return true;
             }
         }
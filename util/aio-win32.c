@@ -119,6 +119,11 @@ void aio_set_fd_poll(AioContext *ctx, int fd,
     /* Not implemented */
 }
 
+void aio_set_fd_poll_ready(AioContext *ctx, int fd, bool poll_ready)
+{
+    /* Not implemented */
+}
+
 void aio_set_event_notifier(AioContext *ctx,
                             EventNotifier *e,
                             bool is_external,
@@ -180,6 +185,13 @@ void aio_set_event_notifier_poll(AioContext *ctx,
     /* Not implemented */
 }
 
+void aio_set_event_notifier_poll_ready(AioContext *ctx,
+                                       EventNotifier *notifier,
+                                       bool poll_ready)
+{
+    /* Not implemented */
+}
+
 bool aio_prepare(AioContext *ctx)
 {
     static struct timeval tv0;
@@ -64,6 +64,25 @@ buffer_zero_int(const void *buf, size_t len)
     }
 }
 
+/* Offset of the first 8 bytes that differ between @a and @b, rounded down
+ * to a multiple of 8, or @len if the buffers are equal.
+ */
+static size_t
+buffer_diff_int(const void *a, const void *b, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        if (ldq_he_p(a + i) != ldq_he_p(b + i)) {
+            return i;
+        }
+    }
+    if (i < len && memcmp(a + i, b + i, len - i)) {
+        return i;
+    }
+    return len;
+}
+
 #if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
 /* Do not use push_options pragmas unnecessarily, because clang
  * does not support them.
@@ -105,6 +124,34 @@ buffer_zero_sse2(const void *buf, size_t len)
 
     return _mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) == 0xFFFF;
 }
+
+static size_t
+buffer_diff_sse2(const void *a, const void *b, size_t len)
+{
+    size_t i;
+
+    /* Loop over unaligned blocks of 64, then redo the last one.  */
+    for (i = 0; ; i += 64) {
+        __m128i t;
+
+        if (i + 64 > len) {
+            i = len - 64;
+        }
+        t = _mm_cmpeq_epi8(_mm_loadu_si128(a + i), _mm_loadu_si128(b + i));
+        t &= _mm_cmpeq_epi8(_mm_loadu_si128(a + i + 16),
+                            _mm_loadu_si128(b + i + 16));
+        t &= _mm_cmpeq_epi8(_mm_loadu_si128(a + i + 32),
+                            _mm_loadu_si128(b + i + 32));
+        t &= _mm_cmpeq_epi8(_mm_loadu_si128(a + i + 48),
+                            _mm_loadu_si128(b + i + 48));
+        if (unlikely(_mm_movemask_epi8(t) != 0xFFFF)) {
+            return i;
+        }
+        if (i + 64 == len) {
+            return len;
+        }
+    }
+}
 #ifdef CONFIG_AVX2_OPT
 #pragma GCC pop_options
 #endif
@@ -185,6 +232,30 @@ buffer_zero_avx2(const void *buf, size_t len)
 
     return _mm256_testz_si256(t, t);
 }
+
+static size_t
+buffer_diff_avx2(const void *a, const void *b, size_t len)
+{
+    size_t i;
+
+    for (i = 0; ; i += 64) {
+        __m256i t;
+
+        if (i + 64 > len) {
+            i = len - 64;
+        }
+        t = _mm256_cmpeq_epi8(_mm256_loadu_si256(a + i),
+                              _mm256_loadu_si256(b + i));
+        t &= _mm256_cmpeq_epi8(_mm256_loadu_si256(a + i + 32),
+                               _mm256_loadu_si256(b + i + 32));
+        if (unlikely(_mm256_movemask_epi8(t) != -1)) {
+            return i;
+        }
+        if (i + 64 == len) {
+            return len;
+        }
+    }
+}
 #pragma GCC pop_options
 #endif /* CONFIG_AVX2_OPT */
 
@@ -202,22 +273,28 @@ buffer_zero_avx2(const void *buf, size_t len)
 #ifdef CONFIG_AVX2_OPT
 # define INIT_CACHE 0
 # define INIT_ACCEL buffer_zero_int
+# define INIT_DIFF_ACCEL buffer_diff_int
 #else
 # ifndef __SSE2__
 #  error "ISA selection confusion"
 # endif
 # define INIT_CACHE CACHE_SSE2
 # define INIT_ACCEL buffer_zero_sse2
+# define INIT_DIFF_ACCEL buffer_diff_sse2
 #endif
 
 static unsigned cpuid_cache = INIT_CACHE;
 static bool (*buffer_accel)(const void *, size_t) = INIT_ACCEL;
+static size_t (*buffer_diff_accel)(const void *, const void *, size_t) =
+    INIT_DIFF_ACCEL;
 
 static void init_accel(unsigned cache)
 {
     bool (*fn)(const void *, size_t) = buffer_zero_int;
+    size_t (*diff_fn)(const void *, const void *, size_t) = buffer_diff_int;
     if (cache & CACHE_SSE2) {
         fn = buffer_zero_sse2;
+        diff_fn = buffer_diff_sse2;
     }
 #ifdef CONFIG_AVX2_OPT
     if (cache & CACHE_SSE4) {
@@ -225,9 +302,11 @@ static void init_accel(unsigned cache)
     }
     if (cache & CACHE_AVX2) {
         fn = buffer_zero_avx2;
+        diff_fn = buffer_diff_avx2;
     }
 #endif
     buffer_accel = fn;
+    buffer_diff_accel = diff_fn;
 }
 
 #ifdef CONFIG_AVX2_OPT
@@ -284,8 +363,17 @@ static bool select_accel_fn(const void *buf, size_t len)
     return buffer_zero_int(buf, len);
 }
 
+static size_t select_diff_fn(const void *a, const void *b, size_t len)
+{
+    if (likely(len >= 64)) {
+        return buffer_diff_accel(a, b, len);
+    }
+    return buffer_diff_int(a, b, len);
+}
+
 #else
 #define select_accel_fn  buffer_zero_int
+#define select_diff_fn   buffer_diff_int
 bool test_buffer_is_zero_next_accel(void)
 {
     return false;
@@ -308,3 +396,18 @@ bool buffer_is_zero(const void *buf, size_t len)
        includes a check for an unrolled loop over 64-bit integers.  */
     return select_accel_fn(buf, len);
 }
+
+/*
+ * Copies @src to @dst if they differ, and returns whether they did.  The
+ * equal head of the buffers is not written again.
+ */
+bool buffer_update(void *dst, const void *src, size_t len)
+{
+    size_t off = select_diff_fn(dst, src, len);
+
+    if (off >= len) {
+        return false;
+    }
+    memcpy(dst + off, src + off, len - off);
+    return true;
+}
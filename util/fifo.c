@@ -126,6 +126,15 @@ const void *fifo_pop_buf(Fifo *fifo, uint32_t max, uint32_t *num)
     return ret;
 }
 
+const void *fifo_peek_buf(Fifo *fifo, uint32_t max, uint32_t *num)
+{
+    if (max == 0 || max > fifo->num) {
+        abort();
+    }
+    *num = MIN(fifo->capacity - fifo->head, max);
+    return &fifo->data[fifo->head * fifo->width];
+}
+
 void fifo_reset(Fifo *fifo)
 {
     fifo->num = 0;
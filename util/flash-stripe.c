@@ -23,6 +23,12 @@
  * THE SOFTWARE.
  */
 
+/*
+ * Standalone tool, build with something like:
+ * cc -Iinclude -o flash-stripe util/flash-stripe.c
+ * Define UNSTRIPE, FLASH_STRIPE_BE and FLASH_STRIPE_BW for the variants.
+ */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -32,45 +38,48 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
 
-/* N way (num) in place bit striper. Lay out row wise bits column wise
- * (from element 0 to N-1). num is the length of x, and dir reverses the
- * direction of the transform. be determines the bit endianess scheme.
- * false to lay out bits LSB to MSB (little endian) and true for big endian.
- *
- * Best illustrated by examples:
- * Each digit in the below array is a single bit (num == 3, be == false):
- *
- * {{ 76543210, }  ----- stripe (dir == false) -----> {{ FCheb630, }
- *  { hgfedcba, }                                      { GDAfc741, }
- *  { HGFEDCBA, }} <---- upstripe (dir == true) -----  { HEBgda52, }}
- *
- * Same but with be == true:
- *
- * {{ 76543210, }  ----- stripe (dir == false) -----> {{ 741gdaFC, }
- *  { hgfedcba, }                                      { 630fcHEB, }
- *  { HGFEDCBA, }} <---- upstripe (dir == true) -----  { 52hebGDA, }}
- */
+#include "qemu/stripe.h"
+
+/* Number of groups (one byte per file) handled per read and write.  */
+#define CHUNK_GROUPS (64 * 1024)
+
+static ssize_t read_full(int fd, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+
+    while (done < len) {
+        ssize_t ret = read(fd, buf + done, len - done);
+
+        if (ret == 0) {
+            break;
+        } else if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        done += ret;
+    }
+    return done;
+}
 
-static inline void stripe8(uint8_t *x, int num, bool dir, bool be)
+static int write_full(int fd, const uint8_t *buf, size_t len)
 {
-    uint8_t r[num];
-    memset(r, 0, sizeof(uint8_t) * num);
-    int idx[2] = {0, 0};
-    int bit[2] = {0, be ? 7 : 0};
-    int d = dir;
-
-    for (idx[0] = 0; idx[0] < num; ++idx[0]) {
-        for (bit[0] = be ? 7 : 0; bit[0] != (be ? -1 : 8);
-                 bit[0] += be ? -1 : 1) {
-            r[idx[!d]] |= x[idx[d]] & 1 << bit[d] ? 1 << bit[!d] : 0;
-            idx[1] = (idx[1] + 1) % num;
-            if (!idx[1]) {
-                bit[1] += be ? -1 : 1;
+    while (len) {
+        ssize_t ret = write(fd, buf, len);
+
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            return -1;
         }
+        buf += ret;
+        len -= ret;
     }
-    memcpy(x, r, sizeof(uint8_t) * num);
+    return 0;
 }
 
 int main(int argc, char *argv[])
@@ -88,6 +97,7 @@ int main(int argc, char *argv[])
 #endif
 
     int i;
+    size_t j;
 
     const char *exe_name = argv[0];
     argc--;
@@ -128,52 +138,107 @@ int main(int argc, char *argv[])
         }
     }
 
+    /* buf holds the image as it appears in the single file, lane i the
+     * bytes of the i-th group position.
+     */
+    uint8_t *buf = malloc((size_t)argc * CHUNK_GROUPS);
+    uint8_t *lane = malloc((size_t)argc * CHUNK_GROUPS);
+
+    if (!buf || !lane) {
+        fprintf(stderr, "ERROR: out of memory\n");
+        return 1;
+    }
+
     while (true) {
-        uint8_t buf[argc];
-        for (i = 0; i < argc; ++i) {
-            switch (read(!unstripe ? single : multiple[
-#if defined(FLASH_STRIPE_BW) && defined(FLASH_STRIPE_BE)
-                                                       argc - 1 -
+        size_t groups;
+        ssize_t n;
+
+        if (!unstripe) {
+            n = read_full(single, buf, (size_t)argc * CHUNK_GROUPS);
+            if (n == -1) {
+                perror(single_f);
+                return 1;
+            }
+            if (n == 0) {
+                break;
+            }
+            groups = (n + argc - 1) / argc;
+            if (n % argc) {
+                fprintf(stderr, "WARNING:input file %s is not multiple of "
+                        "%d bytes, padding with zero bytes\n", single_f,
+                        argc);
+                memset(buf + n, 0, groups * argc - n);
+            }
+#ifndef FLASH_STRIPE_BW
+            stripe_buf(buf, groups * argc, argc, false, be);
 #endif
-                                                       i], &buf[i], 1)) {
-            case 0:
+        } else {
+            size_t got = 0;
+
+            for (i = 0; i < argc; ++i) {
+                uint8_t *l = lane + (size_t)i * CHUNK_GROUPS;
+
+                /* The first file decides how much there is.  */
+                n = read_full(multiple[i], l, i ? got : CHUNK_GROUPS);
+                if (n == -1) {
+                    perror(argv[i]);
+                    return 1;
+                }
                 if (i == 0) {
-                    goto done;
-                } else if (!unstripe) {
-                    fprintf(stderr, "WARNING:input file %s is not multiple of "
-                            "%d bytes, padding with garbage byte\n", single_f,
-                            argc);
+                    got = n;
                 }
+                if ((size_t)n < got) {
+                    memset(l + n, 0, got - n);
+                }
+            }
+            groups = got;
+            if (!groups) {
                 break;
-            case -1:
-                perror(unstripe ? argv[i] : single_f);
-                return 1;
             }
-        }
-
+            for (j = 0; j < groups; ++j) {
+                for (i = 0; i < argc; ++i) {
+                    buf[j * argc + i] = lane[(size_t)
+#if defined(FLASH_STRIPE_BW) && defined(FLASH_STRIPE_BE)
+                                             (argc - 1 - i)
+#else
+                                             i
+#endif
+                                             * CHUNK_GROUPS + j];
+                }
+            }
 #ifndef FLASH_STRIPE_BW
-        stripe8(buf, argc, unstripe, be);
+            stripe_buf(buf, groups * argc, argc, true, be);
 #endif
+            if (write_full(single, buf, groups * argc)) {
+                perror(single_f);
+                return 1;
+            }
+            continue;
+        }
 
         for (i = 0; i < argc; ++i) {
-            switch (write(unstripe ? single : multiple[
 #if defined(FLASH_STRIPE_BW) && defined(FLASH_STRIPE_BE)
-                                                       argc - 1 -
+            int f = argc - 1 - i;
+#else
+            int f = i;
 #endif
-                                                       i], &buf[i], 1)) {
-            case -1:
-                perror(unstripe ? single_f : argv[i]);
+            uint8_t *l = lane + (size_t)i * CHUNK_GROUPS;
+
+            for (j = 0; j < groups; ++j) {
+                l[j] = buf[j * argc + i];
+            }
+            if (write_full(multiple[f], l, groups)) {
+                perror(argv[f]);
                 return 1;
-            case 0:
-                i--; /* try again */
             }
         }
     }
 
-done:
+    free(buf);
+    free(lane);
     close(single);
     for (i = 0; i < argc; ++i) {
-        close(multiple[argc]);
+        close(multiple[i]);
     }
     return 0;
 }
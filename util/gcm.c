@@ -38,6 +38,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/gcm.h"
+#include "qemu/bswap.h"
 #include "qemu/log.h"
 
 /*
@@ -63,6 +64,224 @@
 }
 #endif
 
+#ifdef CONFIG_AES_OPT
+#include "qemu/cpuid.h"
+
+static bool gcm_have_accel;
+
+static void __attribute__((constructor)) gcm_init_accel(void)
+{
+    unsigned int a, b, c, d;
+    unsigned int need = bit_AES | bit_PCLMUL | bit_SSSE3;
+
+    if (__get_cpuid_max(0, NULL) >= 1) {
+        __cpuid(1, a, b, c, d);
+        gcm_have_accel = (c & need) == need;
+    }
+}
+
+#pragma GCC push_options
+#pragma GCC target("aes,pclmul,ssse3")
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+#define GCM_BSWAP_MASK \
+    _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15)
+
+static __m128i gcm_accel_expand(__m128i k, __m128i t)
+{
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+    return _mm_xor_si128(k, t);
+}
+
+#define GCM_EXPAND128(k, rcon) \
+    gcm_accel_expand(k, _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k, rcon), \
+                                          0xff))
+
+/* The odd round keys of AES-256 use SubWord without RotWord and rcon.  */
+#define GCM_EXPAND256(k, k2, rcon) \
+    gcm_accel_expand(k, _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k2, \
+                                                                    rcon), \
+                                          0xff))
+#define GCM_EXPAND256_ODD(k, k2) \
+    gcm_accel_expand(k, _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k2, 0), \
+                                          0xaa))
+
+static bool gcm_accel_setkey(gcm_context *ctx, const unsigned char *key,
+                             unsigned int keysize)
+{
+    __m128i rk[15];
+    int i;
+
+    switch (keysize) {
+    case 128:
+        rk[0] = _mm_loadu_si128((const __m128i *)key);
+        rk[1] = GCM_EXPAND128(rk[0], 0x01);
+        rk[2] = GCM_EXPAND128(rk[1], 0x02);
+        rk[3] = GCM_EXPAND128(rk[2], 0x04);
+        rk[4] = GCM_EXPAND128(rk[3], 0x08);
+        rk[5] = GCM_EXPAND128(rk[4], 0x10);
+        rk[6] = GCM_EXPAND128(rk[5], 0x20);
+        rk[7] = GCM_EXPAND128(rk[6], 0x40);
+        rk[8] = GCM_EXPAND128(rk[7], 0x80);
+        rk[9] = GCM_EXPAND128(rk[8], 0x1b);
+        rk[10] = GCM_EXPAND128(rk[9], 0x36);
+        ctx->rounds = 10;
+        break;
+    case 256:
+        rk[0] = _mm_loadu_si128((const __m128i *)key);
+        rk[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+        rk[2] = GCM_EXPAND256(rk[0], rk[1], 0x01);
+        rk[3] = GCM_EXPAND256_ODD(rk[1], rk[2]);
+        rk[4] = GCM_EXPAND256(rk[2], rk[3], 0x02);
+        rk[5] = GCM_EXPAND256_ODD(rk[3], rk[4]);
+        rk[6] = GCM_EXPAND256(rk[4], rk[5], 0x04);
+        rk[7] = GCM_EXPAND256_ODD(rk[5], rk[6]);
+        rk[8] = GCM_EXPAND256(rk[6], rk[7], 0x08);
+        rk[9] = GCM_EXPAND256_ODD(rk[7], rk[8]);
+        rk[10] = GCM_EXPAND256(rk[8], rk[9], 0x10);
+        rk[11] = GCM_EXPAND256_ODD(rk[9], rk[10]);
+        rk[12] = GCM_EXPAND256(rk[10], rk[11], 0x20);
+        rk[13] = GCM_EXPAND256_ODD(rk[11], rk[12]);
+        rk[14] = GCM_EXPAND256(rk[12], rk[13], 0x40);
+        ctx->rounds = 14;
+        break;
+    default:
+        /* 192 bit keys are rare, leave them to the table code.  */
+        return false;
+    }
+
+    for (i = 0; i <= ctx->rounds; i++) {
+        _mm_storeu_si128((__m128i *)ctx->rk[i], rk[i]);
+    }
+    return true;
+}
+
+static __m128i gcm_accel_encrypt_block(gcm_context *ctx, __m128i x)
+{
+    unsigned int i;
+
+    x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)ctx->rk[0]));
+    for (i = 1; i < ctx->rounds; i++) {
+        x = _mm_aesenc_si128(x, _mm_loadu_si128((const __m128i *)ctx->rk[i]));
+    }
+    return _mm_aesenclast_si128(x,
+                                _mm_loadu_si128((const __m128i *)ctx->rk[i]));
+}
+
+static void gcm_accel_encrypt(gcm_context *ctx, const unsigned char in[16],
+                              unsigned char out[16])
+{
+    __m128i x = _mm_loadu_si128((const __m128i *)in);
+
+    _mm_storeu_si128((__m128i *)out, gcm_accel_encrypt_block(ctx, x));
+}
+
+/* Multiply in GF(2^128) on byte reflected operands, see the Intel
+ * Carry-Less Multiplication and its Usage for Computing the GCM Mode
+ * white paper.
+ */
+static __m128i gcm_accel_gfmul(__m128i a, __m128i b)
+{
+    __m128i lo, mid, hi, t1, t2, t3;
+
+    lo = _mm_clmulepi64_si128(a, b, 0x00);
+    mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                        _mm_clmulepi64_si128(a, b, 0x01));
+    hi = _mm_clmulepi64_si128(a, b, 0x11);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    /* Shift the 256 bit product left by one.  */
+    t1 = _mm_srli_epi32(lo, 31);
+    t2 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t3 = _mm_srli_si128(t1, 12);
+    t2 = _mm_slli_si128(t2, 4);
+    t1 = _mm_slli_si128(t1, 4);
+    lo = _mm_or_si128(lo, t1);
+    hi = _mm_or_si128(hi, t2);
+    hi = _mm_or_si128(hi, t3);
+
+    /* Reduce modulo x^128 + x^7 + x^2 + x + 1.  */
+    t1 = _mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30));
+    t1 = _mm_xor_si128(t1, _mm_slli_epi32(lo, 25));
+    t2 = _mm_srli_si128(t1, 4);
+    t1 = _mm_slli_si128(t1, 12);
+    lo = _mm_xor_si128(lo, t1);
+    t1 = _mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2));
+    t1 = _mm_xor_si128(t1, _mm_srli_epi32(lo, 7));
+    t1 = _mm_xor_si128(t1, t2);
+    lo = _mm_xor_si128(lo, t1);
+    return _mm_xor_si128(hi, lo);
+}
+
+static void gcm_accel_mult(gcm_context *ctx, const unsigned char x[16],
+                           unsigned char output[16])
+{
+    const __m128i bswap = GCM_BSWAP_MASK;
+    __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)x), bswap);
+    __m128i h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)ctx->h),
+                                 bswap);
+
+    _mm_storeu_si128((__m128i *)output,
+                     _mm_shuffle_epi8(gcm_accel_gfmul(a, h), bswap));
+}
+
+/* Process whole blocks while the keystream and GHASH are block aligned.
+ * Returns the number of bytes consumed.
+ */
+static size_t gcm_accel_push_blocks(gcm_context *ctx, int mode,
+                                    unsigned char *output,
+                                    const unsigned char *input,
+                                    size_t length)
+{
+    const __m128i bswap = GCM_BSWAP_MASK;
+    __m128i h = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)ctx->h),
+                                 bswap);
+    __m128i mul = _mm_shuffle_epi8(_mm_loadu_si128((__m128i *)ctx->mul),
+                                   bswap);
+    uint32_t ctr = ldl_be_p(ctx->iv + 12);
+    size_t done;
+
+    for (done = 0; length - done >= 16; done += 16) {
+        __m128i in, out, ks;
+
+        stl_be_p(ctx->iv + 12, ++ctr);
+        ks = gcm_accel_encrypt_block(ctx,
+                                     _mm_loadu_si128((__m128i *)ctx->iv));
+        in = _mm_loadu_si128((const __m128i *)(input + done));
+        out = _mm_xor_si128(in, ks);
+        _mm_storeu_si128((__m128i *)(output + done), out);
+
+        out = mode == GCM_ENCRYPT ? out : in;
+        mul = _mm_xor_si128(mul, _mm_shuffle_epi8(out, bswap));
+        mul = gcm_accel_gfmul(mul, h);
+    }
+
+    _mm_storeu_si128((__m128i *)ctx->mul, _mm_shuffle_epi8(mul, bswap));
+    ctx->data_len += done;
+    return done;
+}
+
+#pragma GCC pop_options
+#endif /* CONFIG_AES_OPT */
+
+static void gcm_aes_encrypt(gcm_context *ctx, const unsigned char in[16],
+                            unsigned char out[16])
+{
+#ifdef CONFIG_AES_OPT
+    if (ctx->accel) {
+        gcm_accel_encrypt(ctx, in, out);
+        return;
+    }
+#endif
+    aes_crypt_ecb(&ctx->aes_ctx, AES_ENCRYPT, in, out);
+}
+
 static void gcm_gen_table( gcm_context *ctx )
 {
     int i, j;
@@ -71,7 +290,8 @@ static void gcm_gen_table( gcm_context *ctx )
     unsigned char h[16];
 
     memset( h, 0, 16 );
-    aes_crypt_ecb( &ctx->aes_ctx, AES_ENCRYPT, h, h );
+    gcm_aes_encrypt( ctx, h, h );
+    memcpy(ctx->h, h, 16);
 
     ctx->HH[0] = 0;
     ctx->HL[0] = 0;
@@ -120,6 +340,10 @@ int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize )
     if( ( ret = aes_setkey_enc( &ctx->aes_ctx, key, keysize ) ) != 0 )
         return( ret );
 
+#ifdef CONFIG_AES_OPT
+    ctx->accel = gcm_have_accel && gcm_accel_setkey(ctx, key, keysize);
+#endif
+
     gcm_gen_table( ctx );
 
     return( 0 );
@@ -141,6 +365,13 @@ static void gcm_mult( gcm_context *ctx, const unsigned char x[16], unsigned char
     unsigned char lo, hi, rem;
     uint64_t zh, zl;
 
+#ifdef CONFIG_AES_OPT
+    if (ctx->accel) {
+        gcm_accel_mult(ctx, x, output);
+        return;
+    }
+#endif
+
     memset( z, 0x00, 16 );
     memcpy( v, x, 16 );
 
@@ -188,7 +419,7 @@ void gcm_push_iv(gcm_context *ctx,
     memcpy(ctx->iv, iv, iv_len );
     ctx->iv[15] = 1;
 
-    aes_crypt_ecb(&ctx->aes_ctx, AES_ENCRYPT, ctx->iv, ctx->ectr);
+    gcm_aes_encrypt(ctx, ctx->iv, ctx->ectr);
     memcpy(ctx->tag, ctx->ectr, tag_len);
 }
 
@@ -236,6 +467,17 @@ void gcm_push_data(gcm_context *ctx,
     p = input;
     while( length > 0 )
     {
+#ifdef CONFIG_AES_OPT
+        if (ctx->accel && ctx->ectr_len == 0 && ctx->mul_idx == 0
+            && length >= 16) {
+            size_t done = gcm_accel_push_blocks(ctx, mode, out_p, p, length);
+
+            length -= done;
+            p += done;
+            out_p += done;
+            continue;
+        }
+#endif
         use_len = ( length < 16 ) ? length : 16;
         if (ctx->ectr_len && use_len > ctx->ectr_len) {
             use_len = ctx->ectr_len;
@@ -249,7 +491,7 @@ void gcm_push_data(gcm_context *ctx,
                 if( ++ctx->iv[i - 1] != 0 )
                     break;
 
-            aes_crypt_ecb(&ctx->aes_ctx, AES_ENCRYPT, ctx->iv, ctx->ectr);
+            gcm_aes_encrypt(ctx, ctx->iv, ctx->ectr);
             ctx->ectr_len = 16;
         }
 
@@ -370,7 +612,7 @@ int gcm_crypt_and_tag( gcm_context *ctx,
         gcm_mult( ctx, y, y );
     }
 
-    aes_crypt_ecb( &ctx->aes_ctx, AES_ENCRYPT, y, ectr );
+    gcm_aes_encrypt( ctx, y, ectr );
     memcpy( tag, ectr, tag_len );
 
     p = add;
@@ -396,7 +638,7 @@ int gcm_crypt_and_tag( gcm_context *ctx,
             if( ++y[i - 1] != 0 )
                 break;
 
-        aes_crypt_ecb( &ctx->aes_ctx, AES_ENCRYPT, y, ectr );
+        gcm_aes_encrypt( ctx, y, ectr );
 
         for( i = 0; i < use_len; i++ )
         {
@@ -67,12 +67,24 @@ struct MemsetThread {
     size_t hpagesize;
     QemuThread pgthread;
     sigjmp_buf env;
+    bool *failed;
 };
 typedef struct MemsetThread MemsetThread;
 
-static MemsetThread *memset_thread;
-static int memset_num_threads;
-static bool memset_thread_failed;
+struct MemPrealloc {
+    MemsetThread *threads;
+    int num_threads;
+    bool failed;
+};
+
+/* Preallocations still touching pages, they share the SIGBUS handler.
+ * Only modified by the main thread.
+ */
+static int memset_num_jobs;
+static struct sigaction memset_oldact;
+
+/* SIGBUS is delivered to the thread that faulted */
+static __thread MemsetThread *memset_self;
 
 int qemu_get_thread_id(void)
 {
@@ -297,13 +309,8 @@ char *qemu_get_exec_dir(void)
 
 static void sigbus_handler(int signal)
 {
-    int i;
-    if (memset_thread) {
-        for (i = 0; i < memset_num_threads; i++) {
-            if (qemu_thread_is_self(&memset_thread[i].pgthread)) {
-                siglongjmp(memset_thread[i].env, 1);
-            }
-        }
+    if (memset_self) {
+        siglongjmp(memset_self->env, 1);
     }
 }
 
@@ -317,8 +324,9 @@ static void *do_touch_pages(void *arg)
     sigaddset(&set, SIGBUS);
     pthread_sigmask(SIG_UNBLOCK, &set, &oldset);
 
+    memset_self = memset_args;
     if (sigsetjmp(memset_args->env, 1)) {
-        memset_thread_failed = true;
+        *memset_args->failed = true;
     } else {
         char *addr = memset_args->addr;
         size_t numpages = memset_args->numpages;
@@ -326,103 +334,123 @@ static void *do_touch_pages(void *arg)
         size_t i;
         for (i = 0; i < numpages; i++) {
             /*
-             * Read & write back the same value, so we don't
-             * corrupt existing user/app data that might be
-             * stored.
-             *
-             * 'volatile' to stop compiler optimizing this away
-             * to a no-op
+             * Atomically add zero, so we don't corrupt existing
+             * user/app data that might be stored, nor data written
+             * meanwhile by QEMU while the pages are touched in the
+             * background.
              *
              * TODO: get a better solution from kernel so we
              * don't need to write at all so we don't cause
              * wear on the storage backing the region...
              */
-            *(volatile char *)addr = *addr;
+            atomic_fetch_add(addr, 0);
             addr += hpagesize;
         }
     }
+    memset_self = NULL;
     pthread_sigmask(SIG_SETMASK, &oldset, NULL);
     return NULL;
 }
 
-static inline int get_memset_num_threads(int smp_cpus)
+static inline int get_memset_num_threads(int max_threads)
 {
     long host_procs = sysconf(_SC_NPROCESSORS_ONLN);
     int ret = 1;
 
     if (host_procs > 0) {
-        ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT), smp_cpus);
+        ret = MIN(MIN(host_procs, MAX_MEM_PREALLOC_THREAD_COUNT),
+                  MAX(max_threads, 1));
     }
     /* In case sysconf() fails, we fall back to single threaded */
     return ret;
 }
 
-static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                            int smp_cpus)
+static void touch_all_pages(MemPrealloc *job, char *area, size_t hpagesize,
+                            size_t numpages, int max_threads)
 {
     size_t numpages_per_thread;
     size_t size_per_thread;
     char *addr = area;
     int i = 0;
 
-    memset_thread_failed = false;
-    memset_num_threads = get_memset_num_threads(smp_cpus);
-    memset_thread = g_new0(MemsetThread, memset_num_threads);
-    numpages_per_thread = (numpages / memset_num_threads);
+    job->failed = false;
+    job->num_threads = get_memset_num_threads(max_threads);
+    job->threads = g_new0(MemsetThread, job->num_threads);
+    numpages_per_thread = (numpages / job->num_threads);
     size_per_thread = (hpagesize * numpages_per_thread);
-    for (i = 0; i < memset_num_threads; i++) {
-        memset_thread[i].addr = addr;
-        memset_thread[i].numpages = (i == (memset_num_threads - 1)) ?
-                                    numpages : numpages_per_thread;
-        memset_thread[i].hpagesize = hpagesize;
-        qemu_thread_create(&memset_thread[i].pgthread, "touch_pages",
-                           do_touch_pages, &memset_thread[i],
+    for (i = 0; i < job->num_threads; i++) {
+        job->threads[i].addr = addr;
+        job->threads[i].numpages = (i == (job->num_threads - 1)) ?
+                                   numpages : numpages_per_thread;
+        job->threads[i].hpagesize = hpagesize;
+        job->threads[i].failed = &job->failed;
+        qemu_thread_create(&job->threads[i].pgthread, "touch_pages",
+                           do_touch_pages, &job->threads[i],
                            QEMU_THREAD_JOINABLE);
         addr += size_per_thread;
         numpages -= numpages_per_thread;
     }
-    for (i = 0; i < memset_num_threads; i++) {
-        qemu_thread_join(&memset_thread[i].pgthread);
-    }
-    g_free(memset_thread);
-    memset_thread = NULL;
-
-    return memset_thread_failed;
 }
 
-void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
-                     Error **errp)
+MemPrealloc *os_mem_prealloc_start(int fd, char *area, size_t memory,
+                                   int max_threads, Error **errp)
 {
-    int ret;
-    struct sigaction act, oldact;
+    MemPrealloc *job;
     size_t hpagesize = qemu_fd_getpagesize(fd);
     size_t numpages = DIV_ROUND_UP(memory, hpagesize);
 
-    memset(&act, 0, sizeof(act));
-    act.sa_handler = &sigbus_handler;
-    act.sa_flags = 0;
+    if (!memset_num_jobs) {
+        struct sigaction act;
 
-    ret = sigaction(SIGBUS, &act, &oldact);
-    if (ret) {
-        error_setg_errno(errp, errno,
-            "os_mem_prealloc: failed to install signal handler");
-        return;
+        memset(&act, 0, sizeof(act));
+        act.sa_handler = &sigbus_handler;
+        act.sa_flags = 0;
+
+        if (sigaction(SIGBUS, &act, &memset_oldact)) {
+            error_setg_errno(errp, errno,
+                "os_mem_prealloc: failed to install signal handler");
+            return NULL;
+        }
     }
+    memset_num_jobs++;
 
     /* touch pages simultaneously */
-    if (touch_all_pages(area, hpagesize, numpages, smp_cpus)) {
+    job = g_new0(MemPrealloc, 1);
+    touch_all_pages(job, area, hpagesize, numpages, max_threads);
+    return job;
+}
+
+void os_mem_prealloc_wait(MemPrealloc *job, Error **errp)
+{
+    int i;
+
+    for (i = 0; i < job->num_threads; i++) {
+        qemu_thread_join(&job->threads[i].pgthread);
+    }
+    if (job->failed) {
         error_setg(errp, "os_mem_prealloc: Insufficient free host memory "
             "pages available to allocate guest RAM");
     }
+    g_free(job->threads);
+    g_free(job);
 
-    ret = sigaction(SIGBUS, &oldact, NULL);
-    if (ret) {
+    if (!--memset_num_jobs && sigaction(SIGBUS, &memset_oldact, NULL)) {
         /* Terminate QEMU since it can't recover from error */
         perror("os_mem_prealloc: failed to reinstall signal handler");
         exit(1);
     }
 }
 
+void os_mem_prealloc(int fd, char *area, size_t memory, int max_threads,
+                     Error **errp)
+{
+    MemPrealloc *job;
+
+    job = os_mem_prealloc_start(fd, area, memory, max_threads, errp);
+    if (job) {
+        os_mem_prealloc_wait(job, errp);
+    }
+}
 
 char *qemu_get_pid_name(pid_t pid)
 {
@@ -550,7 +550,7 @@ int getpagesize(void)
     return system_info.dwPageSize;
 }
 
-void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
+void os_mem_prealloc(int fd, char *area, size_t memory, int max_threads,
                      Error **errp)
 {
     int i;
@@ -562,6 +562,23 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
     }
 }
 
+/* Pages are touched right away, there is no background preallocation */
+struct MemPrealloc {
+    int dummy;
+};
+
+MemPrealloc *os_mem_prealloc_start(int fd, char *area, size_t memory,
+                                   int max_threads, Error **errp)
+{
+    os_mem_prealloc(fd, area, memory, max_threads, errp);
+    return g_new0(MemPrealloc, 1);
+}
+
+void os_mem_prealloc_wait(MemPrealloc *job, Error **errp)
+{
+    g_free(job);
+}
+
 
 char *qemu_get_pid_name(pid_t pid)
 {
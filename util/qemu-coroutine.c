@@ -22,79 +22,139 @@
 #include "block/aio.h"
 
 enum {
-    POOL_BATCH_SIZE = 64,
+    POOL_MIN_BATCH_SIZE = 64,
+    POOL_MAX_BATCH_SIZE = 1024,
 };
 
-/** Free list to speed up creation */
-static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
-static unsigned int release_pool_size;
-static __thread QSLIST_HEAD(, Coroutine) alloc_pool = QSLIST_HEAD_INITIALIZER(pool);
-static __thread unsigned int alloc_pool_size;
+/* Follows the most coroutines a thread had alive at once, so that bursts
+ * like FDT machine creation or deep block queues are served from the pool.
+ * Coroutines that terminate in another thread than they were created in
+ * skew the per-thread counts, which only ever makes the pools larger.
+ */
+static unsigned int pool_batch_size = POOL_MIN_BATCH_SIZE;
+
+static const size_t coroutine_stack_size[COROUTINE_STACK__MAX] = {
+    [COROUTINE_STACK_DEFAULT] = COROUTINE_STACK_SIZE,
+    [COROUTINE_STACK_SMALL] = COROUTINE_SMALL_STACK_SIZE,
+};
+
+/** Free lists to speed up creation, one per stack size */
+static QSLIST_HEAD(, Coroutine) release_pool[COROUTINE_STACK__MAX];
+static unsigned int release_pool_size[COROUTINE_STACK__MAX];
+static __thread QSLIST_HEAD(, Coroutine) alloc_pool[COROUTINE_STACK__MAX];
+static __thread unsigned int alloc_pool_size[COROUTINE_STACK__MAX];
+static __thread int coroutines_in_use;
 static __thread Notifier coroutine_pool_cleanup_notifier;
 
 static void coroutine_pool_cleanup(Notifier *n, void *value)
 {
+    unsigned int max = atomic_read(&pool_batch_size) * 2;
     Coroutine *co;
     Coroutine *tmp;
+    int i;
 
-    QSLIST_FOREACH_SAFE(co, &alloc_pool, pool_next, tmp) {
-        QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
-        qemu_coroutine_delete(co);
+    /* Hand the stacks over to the threads that are left */
+    for (i = 0; i < COROUTINE_STACK__MAX; i++) {
+        QSLIST_FOREACH_SAFE(co, &alloc_pool[i], pool_next, tmp) {
+            QSLIST_REMOVE_HEAD(&alloc_pool[i], pool_next);
+            if (atomic_read(&release_pool_size[i]) < max) {
+                QSLIST_INSERT_HEAD_ATOMIC(&release_pool[i], co, pool_next);
+                atomic_inc(&release_pool_size[i]);
+            } else {
+                qemu_coroutine_delete(co);
+            }
+        }
+        alloc_pool_size[i] = 0;
     }
 }
 
-Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
+static void coroutine_pool_register_cleanup(void)
+{
+    if (!coroutine_pool_cleanup_notifier.notify) {
+        coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
+        qemu_thread_atexit_add(&coroutine_pool_cleanup_notifier);
+    }
+}
+
+static Coroutine *coroutine_create(CoroutineEntry *entry, void *opaque,
+                                   CoroutineStackType type)
 {
     Coroutine *co = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        co = QSLIST_FIRST(&alloc_pool);
+        unsigned int batch = atomic_read(&pool_batch_size);
+
+        if (++coroutines_in_use > (int)batch && batch < POOL_MAX_BATCH_SIZE) {
+            /* Losing a race here only delays the growth */
+            atomic_cmpxchg(&pool_batch_size, batch,
+                           MIN(coroutines_in_use, POOL_MAX_BATCH_SIZE));
+        }
+
+        co = QSLIST_FIRST(&alloc_pool[type]);
         if (!co) {
-            if (release_pool_size > POOL_BATCH_SIZE) {
+            if (atomic_read(&release_pool_size[type]) > batch) {
                 /* Slow path; a good place to register the destructor, too.  */
-                if (!coroutine_pool_cleanup_notifier.notify) {
-                    coroutine_pool_cleanup_notifier.notify = coroutine_pool_cleanup;
-                    qemu_thread_atexit_add(&coroutine_pool_cleanup_notifier);
-                }
+                coroutine_pool_register_cleanup();
 
                 /* This is not exact; there could be a little skew between
                  * release_pool_size and the actual size of release_pool.  But
                  * it is just a heuristic, it does not need to be perfect.
                  */
-                alloc_pool_size = atomic_xchg(&release_pool_size, 0);
-                QSLIST_MOVE_ATOMIC(&alloc_pool, &release_pool);
-                co = QSLIST_FIRST(&alloc_pool);
+                alloc_pool_size[type] = atomic_xchg(&release_pool_size[type],
+                                                    0);
+                QSLIST_MOVE_ATOMIC(&alloc_pool[type], &release_pool[type]);
+                co = QSLIST_FIRST(&alloc_pool[type]);
             }
         }
         if (co) {
-            QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
-            alloc_pool_size--;
+            QSLIST_REMOVE_HEAD(&alloc_pool[type], pool_next);
+            alloc_pool_size[type]--;
         }
     }
 
     if (!co) {
-        co = qemu_coroutine_new();
+        co = qemu_coroutine_new(coroutine_stack_size[type]);
+        co->stack_type = type;
     }
 
     co->entry = entry;
     co->entry_arg = opaque;
+    /* Work done on behalf of a background coroutine is background too */
+    co->background = qemu_in_coroutine() && qemu_coroutine_self()->background;
     QSIMPLEQ_INIT(&co->co_queue_wakeup);
     return co;
 }
 
+Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
+{
+    return coroutine_create(entry, opaque, COROUTINE_STACK_DEFAULT);
+}
+
+Coroutine *qemu_coroutine_create_small_stack(CoroutineEntry *entry,
+                                             void *opaque)
+{
+    return coroutine_create(entry, opaque, COROUTINE_STACK_SMALL);
+}
+
 static void coroutine_delete(Coroutine *co)
 {
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
-            QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
-            atomic_inc(&release_pool_size);
+        unsigned int batch = atomic_read(&pool_batch_size);
+        CoroutineStackType type = co->stack_type;
+
+        coroutines_in_use--;
+        /* Other threads take from the release pool without a lock */
+        if (atomic_read(&release_pool_size[type]) < batch * 2) {
+            QSLIST_INSERT_HEAD_ATOMIC(&release_pool[type], co, pool_next);
+            atomic_inc(&release_pool_size[type]);
             return;
         }
-        if (alloc_pool_size < POOL_BATCH_SIZE) {
-            QSLIST_INSERT_HEAD(&alloc_pool, co, pool_next);
-            alloc_pool_size++;
+        if (alloc_pool_size[type] < batch) {
+            coroutine_pool_register_cleanup();
+            QSLIST_INSERT_HEAD(&alloc_pool[type], co, pool_next);
+            alloc_pool_size[type]++;
             return;
         }
     }
@@ -190,3 +250,13 @@ bool qemu_coroutine_entered(Coroutine *co)
 {
     return co->caller;
 }
+
+void qemu_coroutine_set_background(Coroutine *co, bool background)
+{
+    co->background = background;
+}
+
+bool qemu_coroutine_is_background(Coroutine *co)
+{
+    return co->background;
+}
@@ -27,6 +27,12 @@
  * THE SOFTWARE.
  */
 
+/*
+ * Standalone tool, build with something like:
+ * cc -Iinclude -o qemu-nand-creator util/qemu-nand-creator.c
+ * qemu-img convert --transform nand lays out images the same way.
+ */
+
 #define _FILE_OFFSET_BITS 64
 
 #include <stdio.h>
@@ -41,7 +47,7 @@
 #include <assert.h>
 #include <errno.h>
 
-#define ECC_CODEWORD_SIZE 512
+#include "qemu/nand-image.h"
 
 #ifdef DEBUG
     #define DPRINT(...) do { fprintf(stdout, __VA_ARGS__); } while (0)
@@ -50,11 +56,7 @@
 #endif
 
 uint32_t ecc_size;
-uint32_t ecc_pos;
-uint32_t ecc_subpage_offset;
-
-static void ecc_digest(uint8_t *data , uint8_t * oob, uint32_t bytes_read,
-                       uint32_t page_size);
+NandEccState ecc_st;
 
 /* Command line positional inputs
  * 1. page size
@@ -149,8 +151,8 @@ int main(int argc, char *argv[])
             /* Clear oob & ecc area */
             memset(oob_buf, 0xFF, oob_size);
             memset(ecc_data, 0xFF, ecc_size);
-            ecc_pos = 0;
-            ecc_subpage_offset = 0;
+            ecc_st.pos = 0;
+            ecc_st.subpage_offset = 0;
 
             for (i = 0; i < page_size; ++i) {
                 /* Read Input file, 1 page at a time */
@@ -160,11 +162,12 @@ int main(int argc, char *argv[])
 
                 /* Calcualte Ecc digest based on read bytes */
                 if (ecc_size && bytes_read) {
-                    ecc_digest(&buf[i], ecc_data, bytes_read, page_size);
+                    nand_ecc_digest(&ecc_st, ecc_data, ecc_size, &buf[i],
+                                    bytes_read, page_size);
                     /* Copy ecc_data to OOB */
                     memcpy(&oob_buf[oob_size - ecc_size], ecc_data, ecc_size);
                     /* ECC debug Logging */
-                    DPRINT("\tECC pos %d\nECC Digest:\n", ecc_pos);
+                    DPRINT("\tECC pos %d\nECC Digest:\n", ecc_st.pos);
                     for (j = oob_size - ecc_size; j < oob_size; j++) {
                         DPRINT("%d:%x ", j, oob_buf[j]);
                         if (!(j % 5)) {
@@ -187,8 +190,9 @@ int main(int argc, char *argv[])
                         Image_done = true;
                         /* Clear Rest of the page and update ECC */
                         memset(&buf[bytes_read], 0xFF, page_size - bytes_read);
-                        ecc_digest(&buf[bytes_read], ecc_data,
-                                   page_size - bytes_read, page_size);
+                        nand_ecc_digest(&ecc_st, ecc_data, ecc_size,
+                                        &buf[bytes_read],
+                                        page_size - bytes_read, page_size);
                         /* Refresh ECC data */
                         memcpy(&oob_buf[oob_size - ecc_size], ecc_data,
                                ecc_size);
@@ -263,26 +267,3 @@ done:
     close(nand_flash);
     return 0;
 }
-
-static void ecc_digest(uint8_t *data , uint8_t * oob,
-                       uint32_t bytes_read, uint32_t page_size)
-{
-    int ecc_bytes_per_subpage =  ecc_size /
-                                    (page_size / ECC_CODEWORD_SIZE);
-    uint32_t head = 0;
-    while (head < bytes_read) {
-        oob[ecc_pos++] ^= ~data[head];
-        if (!(ecc_pos % ecc_bytes_per_subpage)) {
-            ecc_pos -= ecc_bytes_per_subpage;
-        }
-
-        ecc_subpage_offset++;
-        if (ecc_subpage_offset == ECC_CODEWORD_SIZE) {
-            ecc_subpage_offset = 0;
-            do {
-                ecc_pos++;
-            } while (ecc_pos % ecc_bytes_per_subpage);
-        }
-        head++;
-    }
-}
@@ -14,6 +14,7 @@
 #include "qemu/thread.h"
 #include "qemu/atomic.h"
 #include "qemu/notify.h"
+#include "qemu/bitops.h"
 #include "trace.h"
 
 static bool name_threads;
@@ -164,6 +165,34 @@ void qemu_cond_wait(QemuCond *cond, QemuMutex *mutex)
         error_exit(err, __func__);
 }
 
+static void compute_abs_deadline(struct timespec *ts, int ms)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    ts->tv_nsec = tv.tv_usec * 1000 + (ms % 1000) * 1000000;
+    ts->tv_sec = tv.tv_sec + ms / 1000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+bool qemu_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms)
+{
+    struct timespec ts;
+    int err;
+
+    assert(cond->initialized);
+    compute_abs_deadline(&ts, ms);
+    trace_qemu_mutex_unlocked(mutex);
+    err = pthread_cond_timedwait(&cond->cond, &mutex->lock, &ts);
+    trace_qemu_mutex_locked(mutex);
+    if (err && err != ETIMEDOUT) {
+        error_exit(err, __func__);
+    }
+    return err != ETIMEDOUT;
+}
+
 void qemu_sem_init(QemuSemaphore *sem, int init)
 {
     int rc;
@@ -238,18 +267,6 @@ void qemu_sem_post(QemuSemaphore *sem)
 #endif
 }
 
-static void compute_abs_deadline(struct timespec *ts, int ms)
-{
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    ts->tv_nsec = tv.tv_usec * 1000 + (ms % 1000) * 1000000;
-    ts->tv_sec = tv.tv_sec + ms / 1000;
-    if (ts->tv_nsec >= 1000000000) {
-        ts->tv_sec++;
-        ts->tv_nsec -= 1000000000;
-    }
-}
-
 int qemu_sem_timedwait(QemuSemaphore *sem, int ms)
 {
     int rc;
@@ -539,6 +556,28 @@ void qemu_thread_exit(void *retval)
     pthread_exit(retval);
 }
 
+int qemu_thread_set_affinity(QemuThread *thread,
+                             const unsigned long *host_cpus,
+                             unsigned long nbits)
+{
+#ifdef CONFIG_LINUX
+    cpu_set_t set;
+    unsigned long cpu;
+
+    CPU_ZERO(&set);
+    for (cpu = find_first_bit(host_cpus, nbits); cpu < nbits;
+         cpu = find_next_bit(host_cpus, nbits, cpu + 1)) {
+        if (cpu >= CPU_SETSIZE) {
+            return -EINVAL;
+        }
+        CPU_SET(cpu, &set);
+    }
+    return -pthread_setaffinity_np(thread->thread, sizeof(set), &set);
+#else
+    return -ENOSYS;
+#endif
+}
+
 void *qemu_thread_join(QemuThread *thread)
 {
     int err;
@@ -148,6 +148,20 @@ void qemu_cond_wait(QemuCond *cond, QemuMutex *mutex)
     trace_qemu_mutex_locked(mutex);
 }
 
+bool qemu_cond_timedwait(QemuCond *cond, QemuMutex *mutex, int ms)
+{
+    BOOL rc;
+
+    assert(cond->initialized);
+    trace_qemu_mutex_unlocked(mutex);
+    rc = SleepConditionVariableSRW(&cond->var, &mutex->lock, ms, 0);
+    trace_qemu_mutex_locked(mutex);
+    if (!rc && GetLastError() != ERROR_TIMEOUT) {
+        error_exit(GetLastError(), __func__);
+    }
+    return rc;
+}
+
 void qemu_sem_init(QemuSemaphore *sem, int init)
 {
     /* Manual reset.  */
@@ -445,3 +459,10 @@ bool qemu_thread_is_self(QemuThread *thread)
 {
     return GetCurrentThreadId() == thread->tid;
 }
+
+int qemu_thread_set_affinity(QemuThread *thread,
+                             const unsigned long *host_cpus,
+                             unsigned long nbits)
+{
+    return -ENOSYS;
+}
@@ -68,7 +68,14 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+    /* Binary min-heap of the pending timers, ordered by expire_time and
+     * then arming order, so that timers due at the same time still run
+     * first come first served.  Re-arming is O(log n) this way.
+     */
+    QEMUTimer **active_timers;
+    int nb_active_timers;
+    int max_active_timers;
+    uint64_t next_seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -95,6 +102,12 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+/* The timer due first, if any.  Called with active_timers_lock held.  */
+static QEMUTimer *timerlist_first(QEMUTimerList *timer_list)
+{
+    return timer_list->nb_active_timers ? timer_list->active_timers[0] : NULL;
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -119,6 +132,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -175,7 +189,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!atomic_read(&timer_list->active_timers);
+    return !!atomic_read(&timer_list->nb_active_timers);
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -188,16 +202,16 @@ bool timerlist_expired(QEMUTimerList *timer_list)
 {
     int64_t expire_time;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!atomic_read(&timer_list->nb_active_timers)) {
         return false;
     }
 
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    if (!timer_list->active_timers) {
+    if (!timer_list->nb_active_timers) {
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return false;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    expire_time = timer_list->active_timers[0]->expire_time;
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -219,7 +233,7 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
     int64_t delta;
     int64_t expire_time;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!atomic_read(&timer_list->nb_active_timers)) {
         return -1;
     }
 
@@ -232,11 +246,11 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    if (!timer_list->active_timers) {
+    if (!timer_list->nb_active_timers) {
         qemu_mutex_unlock(&timer_list->active_timers_lock);
         return -1;
     }
-    expire_time = timer_list->active_timers->expire_time;
+    expire_time = timer_list->active_timers[0]->expire_time;
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -356,43 +370,104 @@ void timer_deinit(QEMUTimer *ts)
     ts->timer_list = NULL;
 }
 
-static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+static void timerlist_heap_set(QEMUTimerList *timer_list, int i,
+                               QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
+    timer_list->active_timers[i] = ts;
+    ts->heap_index = i;
+}
 
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            atomic_set(pt, t->next);
+static void timerlist_sift_up(QEMUTimerList *timer_list, int i)
+{
+    QEMUTimer *ts = timer_list->active_timers[i];
+
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (!timer_before(ts, timer_list->active_timers[parent])) {
             break;
         }
-        pt = &t->next;
+        timerlist_heap_set(timer_list, i, timer_list->active_timers[parent]);
+        i = parent;
     }
+    timerlist_heap_set(timer_list, i, ts);
 }
 
-static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
-                                QEMUTimer *ts, int64_t expire_time)
+static void timerlist_sift_down(QEMUTimerList *timer_list, int i)
 {
-    QEMUTimer **pt, *t;
+    QEMUTimer *ts = timer_list->active_timers[i];
+    int n = timer_list->nb_active_timers;
 
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
     for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
+        int child = 2 * i + 1;
+
+        if (child >= n) {
             break;
         }
-        pt = &t->next;
+        if (child + 1 < n &&
+            timer_before(timer_list->active_timers[child + 1],
+                         timer_list->active_timers[child])) {
+            child++;
+        }
+        if (!timer_before(timer_list->active_timers[child], ts)) {
+            break;
+        }
+        timerlist_heap_set(timer_list, i, timer_list->active_timers[child]);
+        i = child;
     }
+    timerlist_heap_set(timer_list, i, ts);
+}
+
+static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    int i = ts->heap_index;
+    int last;
+
+    if (ts->expire_time == -1) {
+        return;
+    }
+    ts->expire_time = -1;
+
+    last = timer_list->nb_active_timers - 1;
+    atomic_set(&timer_list->nb_active_timers, last);
+    if (i == last) {
+        return;
+    }
+    timerlist_heap_set(timer_list, i, timer_list->active_timers[last]);
+    if (i > 0 && timer_before(timer_list->active_timers[i],
+                              timer_list->active_timers[(i - 1) / 2])) {
+        timerlist_sift_up(timer_list, i);
+    } else {
+        timerlist_sift_down(timer_list, i);
+    }
+}
+
+static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
+                                QEMUTimer *ts, int64_t expire_time)
+{
+    int i = timer_list->nb_active_timers;
+
+    if (i == timer_list->max_active_timers) {
+        timer_list->max_active_timers = MAX(16, 2 * i);
+        timer_list->active_timers = g_renew(QEMUTimer *,
+                                            timer_list->active_timers,
+                                            timer_list->max_active_timers);
+    }
+
+    /* add the timer to the heap */
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    atomic_set(pt, ts);
+    ts->seq = timer_list->next_seq++;
+    timerlist_heap_set(timer_list, i, ts);
+    atomic_set(&timer_list->nb_active_timers, i + 1);
+    timerlist_sift_up(timer_list, i);
 
-    return pt == &timer_list->active_timers;
+    return ts->heap_index == 0;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -457,6 +532,14 @@ void timer_mod_anticipate_ns(QEMUTimer *ts, int64_t expire_time)
     }
 }
 
+void timer_mod_coalesce_ns(QEMUTimer *ts, int64_t expire_time, int64_t slack)
+{
+    if (slack > 0) {
+        expire_time = QEMU_ALIGN_UP(expire_time, slack);
+    }
+    timer_mod_ns(ts, expire_time);
+}
+
 void timer_mod(QEMUTimer *ts, int64_t expire_time)
 {
     timer_mod_ns(ts, expire_time * ts->scale);
@@ -485,7 +568,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     QEMUTimerCB *cb;
     void *opaque;
 
-    if (!atomic_read(&timer_list->active_timers)) {
+    if (!atomic_read(&timer_list->nb_active_timers)) {
         return false;
     }
 
@@ -518,16 +601,14 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     for(;;) {
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
+        ts = timerlist_first(timer_list);
         if (!timer_expired_ns(ts, current_time)) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
             break;
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
         qemu_mutex_unlock(&timer_list->active_timers_lock);
@@ -604,7 +685,7 @@ int64_t qemu_clock_get_ns(QEMUClockType type)
         return get_clock();
     default:
     case QEMU_CLOCK_VIRTUAL:
-        if (use_icount) {
+        if (use_icount || use_icount_quantum) {
             return cpu_get_icount();
         } else {
             return cpu_get_clock();
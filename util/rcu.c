@@ -32,6 +32,7 @@
 #include "qemu/atomic.h"
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 
 /*
  * Global grace period counter.  Bit 0 is always one in rcu_gp_ctr.
@@ -46,6 +47,14 @@ QemuEvent rcu_gp_event;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/* Protects rcu_stats and the fields below, which the rest of the file
+ * writes with rcu_sync_lock held or from the call_rcu thread.
+ */
+static QemuMutex rcu_stats_lock;
+static RCUStats rcu_stats;
+static int64_t rcu_window_start;
+static uint64_t rcu_window_callbacks;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -138,7 +147,10 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    int64_t start, gp_ns;
+
     qemu_mutex_lock(&rcu_sync_lock);
+    start = get_clock();
     qemu_mutex_lock(&rcu_registry_lock);
 
     if (!QLIST_EMPTY(&registry)) {
@@ -163,11 +175,25 @@ void synchronize_rcu(void)
     }
 
     qemu_mutex_unlock(&rcu_registry_lock);
+
+    gp_ns = get_clock() - start;
+    qemu_mutex_lock(&rcu_stats_lock);
+    rcu_stats.grace_periods++;
+    rcu_stats.grace_period_ns += gp_ns;
+    rcu_stats.max_grace_period_ns = MAX(rcu_stats.max_grace_period_ns, gp_ns);
+    qemu_mutex_unlock(&rcu_stats_lock);
+
     qemu_mutex_unlock(&rcu_sync_lock);
 }
 
 
+/* Defaults of the call_rcu batching, see rcu_set_batching().  */
 #define RCU_CALL_MIN_SIZE        30
+#define RCU_CALL_MAX_LATENCY_MS  50
+#define RCU_CALL_POLL_MS         10
+
+static unsigned int rcu_call_min_size = RCU_CALL_MIN_SIZE;
+static unsigned int rcu_call_max_latency_ms = RCU_CALL_MAX_LATENCY_MS;
 
 /* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
@@ -233,25 +259,38 @@ static void *call_rcu_thread(void *opaque)
     rcu_register_thread();
 
     for (;;) {
-        int tries = 0;
+        int64_t waited = 0;
         int n = atomic_read(&rcu_call_count);
+        int batch;
+        int64_t now;
 
-        /* Heuristically wait for a decent number of callbacks to pile up.
-         * Fetch rcu_call_count now, we only must process elements that were
+        /* Wait for a decent number of callbacks to pile up, but not for
+         * longer than the configured latency since the first one, so that
+         * bursts of call_rcu share a single grace period.  Fetch
+         * rcu_call_count now, we only must process elements that were
          * added before synchronize_rcu() starts.
          */
-        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
-            g_usleep(10000);
+        while (n == 0 || ((unsigned)n < atomic_read(&rcu_call_min_size) &&
+                          waited < atomic_read(&rcu_call_max_latency_ms))) {
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
                 n = atomic_read(&rcu_call_count);
                 if (n == 0) {
                     qemu_event_wait(&rcu_call_ready_event);
+                    waited = 0;
                 }
+            } else {
+                int64_t poll = MIN(RCU_CALL_POLL_MS,
+                                   atomic_read(&rcu_call_max_latency_ms) -
+                                   waited);
+
+                g_usleep(poll * 1000);
+                waited += poll;
             }
             n = atomic_read(&rcu_call_count);
         }
 
+        batch = n;
         atomic_sub(&rcu_call_count, n);
         synchronize_rcu();
         qemu_mutex_lock_iothread();
@@ -272,10 +311,49 @@ static void *call_rcu_thread(void *opaque)
             node->func(node);
         }
         qemu_mutex_unlock_iothread();
+
+        now = get_clock();
+        qemu_mutex_lock(&rcu_stats_lock);
+        rcu_stats.callbacks += batch;
+        rcu_stats.batches++;
+        rcu_window_callbacks += batch;
+        if (now - rcu_window_start >= NANOSECONDS_PER_SECOND) {
+            rcu_stats.callbacks_per_sec = rcu_window_callbacks *
+                NANOSECONDS_PER_SECOND / (now - rcu_window_start);
+            rcu_window_start = now;
+            rcu_window_callbacks = 0;
+        }
+        qemu_mutex_unlock(&rcu_stats_lock);
     }
     abort();
 }
 
+void rcu_set_batching(unsigned int min_size, unsigned int max_latency_ms)
+{
+    atomic_set(&rcu_call_min_size, min_size);
+    atomic_set(&rcu_call_max_latency_ms, max_latency_ms);
+}
+
+void rcu_get_batching(unsigned int *min_size, unsigned int *max_latency_ms)
+{
+    *min_size = atomic_read(&rcu_call_min_size);
+    *max_latency_ms = atomic_read(&rcu_call_max_latency_ms);
+}
+
+void rcu_get_stats(RCUStats *stats)
+{
+    int64_t now = get_clock();
+
+    qemu_mutex_lock(&rcu_stats_lock);
+    *stats = rcu_stats;
+    /* The last rate is stale once the thread has been idle for a while */
+    if (now - rcu_window_start >= 2 * NANOSECONDS_PER_SECOND) {
+        stats->callbacks_per_sec = rcu_window_callbacks *
+            NANOSECONDS_PER_SECOND / (now - rcu_window_start);
+    }
+    qemu_mutex_unlock(&rcu_stats_lock);
+}
+
 void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
     node->func = func;
@@ -305,6 +383,8 @@ static void rcu_init_complete(void)
 
     qemu_mutex_init(&rcu_registry_lock);
     qemu_mutex_init(&rcu_sync_lock);
+    qemu_mutex_init(&rcu_stats_lock);
+    rcu_window_start = get_clock();
     qemu_event_init(&rcu_gp_event, true);
 
     qemu_event_init(&rcu_call_ready_event, false);
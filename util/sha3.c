@@ -0,0 +1,221 @@
+/*
+ * SHA-3 core, without padding.
+ *
+ * Copyright (c) 2013 Xilinx Inc
+ * Written by Edgar E. Iglesias <edgar.iglesias@xilinx.com>
+ *
+ * Uses borrowed LGPL code from nettle.
+ * This code is licensed under the GNU LGPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/sha3.h"
+
+/* Borrowed from nettle. Once distros get an OpenSSL version
+ * that has SHA-3 support, this should be removed.
+ *
+ * Implements the core SHA-3 parts but excludes padding to
+ * match common hardware implementations.
+ */
+
+#define SHA3_ROUNDS 24
+
+static const uint64_t sha3_rc[SHA3_ROUNDS] = {
+    0x0000000000000001ULL, 0X0000000000008082ULL,
+    0X800000000000808AULL, 0X8000000080008000ULL,
+    0X000000000000808BULL, 0X0000000080000001ULL,
+    0X8000000080008081ULL, 0X8000000000008009ULL,
+    0X000000000000008AULL, 0X0000000000000088ULL,
+    0X0000000080008009ULL, 0X000000008000000AULL,
+    0X000000008000808BULL, 0X800000000000008BULL,
+    0X8000000000008089ULL, 0X8000000000008003ULL,
+    0X8000000000008002ULL, 0X8000000000000080ULL,
+    0X000000000000800AULL, 0X800000008000000AULL,
+    0X8000000080008081ULL, 0X8000000000008080ULL,
+    0X0000000080000001ULL, 0X8000000080008008ULL,
+};
+
+/*
+ * The lanes live in locals, named after their x (a, e, i, o, u) and
+ * y (b, g, k, m, s) coordinates, so the compiler can keep the state in
+ * registers. Each round reads one set and writes the other, which saves
+ * the in-place shuffling of the pi step.
+ */
+
+/* Theta for one lane, then rho and pi into B.  */
+#define SHA3_RHO_PI(A, l, D, r, B) do {                                 \
+        A##l ^= D;                                                      \
+        B = rol64(A##l, r);                                             \
+    } while (0)
+
+#define SHA3_CHI(E, y) do {                                             \
+        E##y##a = Ba ^ (~Be & Bi);                                      \
+        E##y##e = Be ^ (~Bi & Bo);                                      \
+        E##y##i = Bi ^ (~Bo & Bu);                                      \
+        E##y##o = Bo ^ (~Bu & Ba);                                      \
+        E##y##u = Bu ^ (~Ba & Be);                                      \
+    } while (0)
+
+#define SHA3_COLUMN(A, x) \
+    (A##b##x ^ A##g##x ^ A##k##x ^ A##m##x ^ A##s##x)
+
+#define SHA3_ROUND(A, E, i) do {                                        \
+        uint64_t Ca = SHA3_COLUMN(A, a), Ce = SHA3_COLUMN(A, e);        \
+        uint64_t Ci = SHA3_COLUMN(A, i), Co = SHA3_COLUMN(A, o);        \
+        uint64_t Cu = SHA3_COLUMN(A, u);                                \
+        uint64_t Da = Cu ^ rol64(Ce, 1), De = Ca ^ rol64(Ci, 1);        \
+        uint64_t Di = Ce ^ rol64(Co, 1), Do = Ci ^ rol64(Cu, 1);        \
+        uint64_t Du = Co ^ rol64(Ca, 1);                                \
+        uint64_t Ba, Be, Bi, Bo, Bu;                                    \
+                                                                        \
+        SHA3_RHO_PI(A, ba, Da, 0, Ba);                                  \
+        SHA3_RHO_PI(A, ge, De, 44, Be);                                 \
+        SHA3_RHO_PI(A, ki, Di, 43, Bi);                                 \
+        SHA3_RHO_PI(A, mo, Do, 21, Bo);                                 \
+        SHA3_RHO_PI(A, su, Du, 14, Bu);                                 \
+        SHA3_CHI(E, b);                                                 \
+        E##ba ^= sha3_rc[i];                                            \
+                                                                        \
+        SHA3_RHO_PI(A, bo, Do, 28, Ba);                                 \
+        SHA3_RHO_PI(A, gu, Du, 20, Be);                                 \
+        SHA3_RHO_PI(A, ka, Da, 3, Bi);                                  \
+        SHA3_RHO_PI(A, me, De, 45, Bo);                                 \
+        SHA3_RHO_PI(A, si, Di, 61, Bu);                                 \
+        SHA3_CHI(E, g);                                                 \
+                                                                        \
+        SHA3_RHO_PI(A, be, De, 1, Ba);                                  \
+        SHA3_RHO_PI(A, gi, Di, 6, Be);                                  \
+        SHA3_RHO_PI(A, ko, Do, 25, Bi);                                 \
+        SHA3_RHO_PI(A, mu, Du, 8, Bo);                                  \
+        SHA3_RHO_PI(A, sa, Da, 18, Bu);                                 \
+        SHA3_CHI(E, k);                                                 \
+                                                                        \
+        SHA3_RHO_PI(A, bu, Du, 27, Ba);                                 \
+        SHA3_RHO_PI(A, ga, Da, 36, Be);                                 \
+        SHA3_RHO_PI(A, ke, De, 10, Bi);                                 \
+        SHA3_RHO_PI(A, mi, Di, 15, Bo);                                 \
+        SHA3_RHO_PI(A, so, Do, 56, Bu);                                 \
+        SHA3_CHI(E, m);                                                 \
+                                                                        \
+        SHA3_RHO_PI(A, bi, Di, 62, Ba);                                 \
+        SHA3_RHO_PI(A, go, Do, 55, Be);                                 \
+        SHA3_RHO_PI(A, ku, Du, 39, Bi);                                 \
+        SHA3_RHO_PI(A, ma, Da, 41, Bo);                                 \
+        SHA3_RHO_PI(A, se, De, 2, Bu);                                  \
+        SHA3_CHI(E, s);                                                 \
+    } while (0)
+
+#define SHA3_LANES(A, op)                                               \
+    op(A, ba, 0) op(A, be, 1) op(A, bi, 2) op(A, bo, 3) op(A, bu, 4)    \
+    op(A, ga, 5) op(A, ge, 6) op(A, gi, 7) op(A, go, 8) op(A, gu, 9)    \
+    op(A, ka, 10) op(A, ke, 11) op(A, ki, 12) op(A, ko, 13)             \
+    op(A, ku, 14) op(A, ma, 15) op(A, me, 16) op(A, mi, 17)             \
+    op(A, mo, 18) op(A, mu, 19) op(A, sa, 20) op(A, se, 21)             \
+    op(A, si, 22) op(A, so, 23) op(A, su, 24)
+
+#define SHA3_DECLARE(A, l, n) uint64_t A##l;
+#define SHA3_LOAD(A, l, n) A##l = state->a[n];
+#define SHA3_STORE(A, l, n) state->a[n] = A##l;
+
+void sha3_permute(struct sha3_state *state)
+{
+    SHA3_LANES(A, SHA3_DECLARE)
+    SHA3_LANES(E, SHA3_DECLARE)
+    unsigned i;
+
+    SHA3_LANES(A, SHA3_LOAD)
+
+    for (i = 0; i < SHA3_ROUNDS; i += 2) {
+        SHA3_ROUND(A, E, i);
+        SHA3_ROUND(E, A, i + 1);
+    }
+
+    SHA3_LANES(A, SHA3_STORE)
+}
+
+static void
+sha3_absorb(struct sha3_state *state, unsigned length, const uint8_t *data)
+{
+    unsigned i;
+
+    assert((length & 7) == 0);
+    for (i = 0; i < length / 8; i++) {
+        state->a[i] ^= ldq_le_p(data + i * 8);
+    }
+
+    sha3_permute(state);
+}
+
+static unsigned sha3_update(struct sha3_state *state,
+                            unsigned block_size, uint8_t *block,
+                            unsigned pos,
+                            unsigned length, const uint8_t *data)
+{
+    if (pos > 0) {
+        unsigned left = block_size - pos;
+        if (length < left) {
+            memcpy(block + pos, data, length);
+            return pos + length;
+        } else {
+            memcpy(block + pos, data, left);
+            data += left;
+            length -= left;
+            sha3_absorb(state, block_size, block);
+        }
+    }
+    for (; length >= block_size; length -= block_size, data += block_size) {
+        sha3_absorb(state, block_size, data);
+    }
+
+    memcpy(block, data, length);
+    return length;
+}
+
+void sha3_384_init(struct sha3_384_ctx *ctx)
+{
+    memset(&ctx->state, 0, offsetof(struct sha3_384_ctx, block));
+}
+
+void sha3_384_update(struct sha3_384_ctx *ctx,
+                     unsigned length,
+                     const uint8_t *data)
+{
+    ctx->index = sha3_update(&ctx->state, SHA3_384_DATA_SIZE, ctx->block,
+                             ctx->index, length, data);
+}
+
+static void write_le64(unsigned length, uint8_t *dst,
+                       uint64_t *src)
+{
+    unsigned i;
+    unsigned words;
+    unsigned leftover;
+
+    words = length / 8;
+    leftover = length % 8;
+
+    for (i = 0; i < words; i++, dst += 8) {
+        uint64_t v64 = cpu_to_le64(src[i]);
+        memcpy(dst, &v64, sizeof v64);
+    }
+
+    if (leftover) {
+        uint64_t word;
+        word = src[i];
+
+        do {
+            *dst++ = word & 0xff;
+            word >>= 8;
+        } while (--leftover);
+    }
+}
+
+void sha3_384_digest_no_pad(struct sha3_384_ctx *ctx,
+                            unsigned length,
+                            uint8_t *digest)
+{
+    write_le64(length, digest, ctx->state.a);
+    sha3_384_init(ctx);
+}
@@ -19,12 +19,24 @@
 #include "qemu/queue.h"
 #include "qemu/thread.h"
 #include "qemu/coroutine.h"
+#include "qemu/timer.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
+#include "qapi/error.h"
+#ifdef CONFIG_LINUX
+#include <sched.h>
+#endif
 
 static void do_spawn_thread(ThreadPool *pool);
 
+/* Defaults for the pools created from now on, set with -thread-pool */
+static int thread_pool_max_threads = 64;
+#ifdef CONFIG_LINUX
+static bool thread_pool_has_cpus;
+static cpu_set_t thread_pool_cpus;
+#endif
+
 typedef struct ThreadPoolElement ThreadPoolElement;
 
 enum ThreadState {
@@ -38,6 +50,8 @@ struct ThreadPoolElement {
     ThreadPool *pool;
     ThreadPoolFunc *func;
     void *arg;
+    ThreadPoolPriority prio;
+    int64_t submit_ns;
 
     /* Moving state out of THREAD_QUEUED is protected by lock.  After
      * that, only the worker thread can write to it.  Reads and writes
@@ -53,6 +67,17 @@ struct ThreadPoolElement {
     QLIST_ENTRY(ThreadPoolElement) all;
 };
 
+/* A priority class, protected by the lock of its pool */
+typedef struct ThreadPoolClass {
+    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+    uint64_t submitted;
+    uint64_t completed;
+    uint64_t queued;
+    uint64_t queue_ns;
+    uint64_t max_queue_ns;
+    uint64_t run_ns;
+} ThreadPoolClass;
+
 struct ThreadPool {
     AioContext *ctx;
     QEMUBH *completion_bh;
@@ -66,7 +91,7 @@ struct ThreadPool {
     QLIST_HEAD(, ThreadPoolElement) head;
 
     /* The following variables are protected by lock.  */
-    QTAILQ_HEAD(, ThreadPoolElement) request_list;
+    ThreadPoolClass classes[THREAD_POOL_PRIORITY__MAX];
     int cur_threads;
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
@@ -74,16 +99,39 @@ struct ThreadPool {
     bool stopping;
 };
 
+/* The oldest request of the highest priority, called with lock taken.  */
+static ThreadPoolElement *thread_pool_first_request(ThreadPool *pool)
+{
+    int i;
+
+    for (i = 0; i < THREAD_POOL_PRIORITY__MAX; i++) {
+        ThreadPoolElement *req = QTAILQ_FIRST(&pool->classes[i].request_list);
+
+        if (req) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
 
+#ifdef CONFIG_LINUX
+    if (thread_pool_has_cpus) {
+        sched_setaffinity(0, sizeof(thread_pool_cpus), &thread_pool_cpus);
+    }
+#endif
+
     qemu_mutex_lock(&pool->lock);
     pool->pending_threads--;
     do_spawn_thread(pool);
 
     while (!pool->stopping) {
         ThreadPoolElement *req;
+        ThreadPoolClass *c;
+        int64_t start, queue_ns;
         int ret;
 
         do {
@@ -92,14 +140,20 @@ static void *worker_thread(void *opaque)
             ret = qemu_sem_timedwait(&pool->sem, 10000);
             qemu_mutex_lock(&pool->lock);
             pool->idle_threads--;
-        } while (ret == -1 && !QTAILQ_EMPTY(&pool->request_list));
+        } while (ret == -1 && !thread_pool_first_request(pool));
         if (ret == -1 || pool->stopping) {
             break;
         }
 
-        req = QTAILQ_FIRST(&pool->request_list);
-        QTAILQ_REMOVE(&pool->request_list, req, reqs);
+        req = thread_pool_first_request(pool);
+        c = &pool->classes[req->prio];
+        QTAILQ_REMOVE(&c->request_list, req, reqs);
         req->state = THREAD_ACTIVE;
+        start = get_clock();
+        queue_ns = start - req->submit_ns;
+        c->queued--;
+        c->queue_ns += queue_ns;
+        c->max_queue_ns = MAX(c->max_queue_ns, queue_ns);
         qemu_mutex_unlock(&pool->lock);
 
         ret = req->func(req->arg);
@@ -110,6 +164,8 @@ static void *worker_thread(void *opaque)
         req->state = THREAD_DONE;
 
         qemu_mutex_lock(&pool->lock);
+        c->completed++;
+        c->run_ns += get_clock() - start;
 
         qemu_bh_schedule(pool->completion_bh);
     }
@@ -219,7 +275,8 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          * the lock taken and ensure that elem will remain THREAD_QUEUED.
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
-        QTAILQ_REMOVE(&pool->request_list, elem, reqs);
+        QTAILQ_REMOVE(&pool->classes[elem->prio].request_list, elem, reqs);
+        pool->classes[elem->prio].queued--;
         qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
@@ -242,15 +299,27 @@ static const AIOCBInfo thread_pool_aiocb_info = {
     .get_aio_context    = thread_pool_get_aio_context,
 };
 
-BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
-        ThreadPoolFunc *func, void *arg,
+/* Work submitted by background coroutines, like block jobs, runs last.  */
+static ThreadPoolPriority thread_pool_default_priority(void)
+{
+    if (qemu_in_coroutine() &&
+        qemu_coroutine_is_background(qemu_coroutine_self())) {
+        return THREAD_POOL_PRIORITY_LOW;
+    }
+    return THREAD_POOL_PRIORITY_NORMAL;
+}
+
+BlockAIOCB *thread_pool_submit_aio_prio(ThreadPool *pool,
+        ThreadPoolPriority prio, ThreadPoolFunc *func, void *arg,
         BlockCompletionFunc *cb, void *opaque)
 {
     ThreadPoolElement *req;
+    ThreadPoolClass *c = &pool->classes[prio];
 
     req = qemu_aio_get(&thread_pool_aiocb_info, NULL, cb, opaque);
     req->func = func;
     req->arg = arg;
+    req->prio = prio;
     req->state = THREAD_QUEUED;
     req->pool = pool;
 
@@ -258,16 +327,27 @@ BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
 
     trace_thread_pool_submit(pool, req, arg);
 
+    req->submit_ns = get_clock();
     qemu_mutex_lock(&pool->lock);
     if (pool->idle_threads == 0 && pool->cur_threads < pool->max_threads) {
         spawn_thread(pool);
     }
-    QTAILQ_INSERT_TAIL(&pool->request_list, req, reqs);
+    QTAILQ_INSERT_TAIL(&c->request_list, req, reqs);
+    c->submitted++;
+    c->queued++;
     qemu_mutex_unlock(&pool->lock);
     qemu_sem_post(&pool->sem);
     return &req->common;
 }
 
+BlockAIOCB *thread_pool_submit_aio(ThreadPool *pool,
+        ThreadPoolFunc *func, void *arg,
+        BlockCompletionFunc *cb, void *opaque)
+{
+    return thread_pool_submit_aio_prio(pool, thread_pool_default_priority(),
+                                       func, arg, cb, opaque);
+}
+
 typedef struct ThreadPoolCo {
     Coroutine *co;
     int ret;
@@ -281,16 +361,24 @@ static void thread_pool_co_cb(void *opaque, int ret)
     aio_co_wake(co->co);
 }
 
-int coroutine_fn thread_pool_submit_co(ThreadPool *pool, ThreadPoolFunc *func,
-                                       void *arg)
+int coroutine_fn thread_pool_submit_co_prio(ThreadPool *pool,
+                                            ThreadPoolPriority prio,
+                                            ThreadPoolFunc *func, void *arg)
 {
     ThreadPoolCo tpc = { .co = qemu_coroutine_self(), .ret = -EINPROGRESS };
     assert(qemu_in_coroutine());
-    thread_pool_submit_aio(pool, func, arg, thread_pool_co_cb, &tpc);
+    thread_pool_submit_aio_prio(pool, prio, func, arg, thread_pool_co_cb, &tpc);
     qemu_coroutine_yield();
     return tpc.ret;
 }
 
+int coroutine_fn thread_pool_submit_co(ThreadPool *pool, ThreadPoolFunc *func,
+                                       void *arg)
+{
+    return thread_pool_submit_co_prio(pool, thread_pool_default_priority(),
+                                      func, arg);
+}
+
 void thread_pool_submit(ThreadPool *pool, ThreadPoolFunc *func, void *arg)
 {
     thread_pool_submit_aio(pool, func, arg, NULL, NULL);
@@ -298,6 +386,8 @@ void thread_pool_submit(ThreadPool *pool, ThreadPoolFunc *func, void *arg)
 
 static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
 {
+    int i;
+
     if (!ctx) {
         ctx = qemu_get_aio_context();
     }
@@ -308,11 +398,13 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     qemu_mutex_init(&pool->lock);
     qemu_cond_init(&pool->worker_stopped);
     qemu_sem_init(&pool->sem, 0);
-    pool->max_threads = 64;
+    pool->max_threads = atomic_read(&thread_pool_max_threads);
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
-    QTAILQ_INIT(&pool->request_list);
+    for (i = 0; i < THREAD_POOL_PRIORITY__MAX; i++) {
+        QTAILQ_INIT(&pool->classes[i].request_list);
+    }
 }
 
 ThreadPool *thread_pool_new(AioContext *ctx)
@@ -352,3 +444,58 @@ void thread_pool_free(ThreadPool *pool)
     qemu_mutex_destroy(&pool->lock);
     g_free(pool);
 }
+
+void thread_pool_get_info(ThreadPool *pool, ThreadPoolInfo *info)
+{
+    ThreadPoolClassInfoList **tail = &info->classes;
+    int i;
+
+    qemu_mutex_lock(&pool->lock);
+    info->max_threads = pool->max_threads;
+    info->threads = pool->cur_threads;
+    info->idle_threads = pool->idle_threads;
+    for (i = 0; i < THREAD_POOL_PRIORITY__MAX; i++) {
+        ThreadPoolClass *c = &pool->classes[i];
+        ThreadPoolClassInfoList *elem = g_new0(ThreadPoolClassInfoList, 1);
+
+        elem->value = g_new0(ThreadPoolClassInfo, 1);
+        elem->value->priority = i;
+        elem->value->submitted = c->submitted;
+        elem->value->completed = c->completed;
+        elem->value->queued = c->queued;
+        elem->value->queue_time_ns = c->queue_ns;
+        elem->value->max_queue_time_ns = c->max_queue_ns;
+        elem->value->run_time_ns = c->run_ns;
+        *tail = elem;
+        tail = &elem->next;
+    }
+    qemu_mutex_unlock(&pool->lock);
+}
+
+void thread_pool_set_max_threads(int max_threads)
+{
+    assert(max_threads > 0);
+    atomic_set(&thread_pool_max_threads, max_threads);
+}
+
+int thread_pool_set_cpus(unsigned long first, unsigned long last,
+                         Error **errp)
+{
+#ifdef CONFIG_LINUX
+    unsigned long cpu;
+
+    if (first > last || last >= CPU_SETSIZE) {
+        error_setg(errp, "CPU range %lu-%lu is not valid", first, last);
+        return -EINVAL;
+    }
+    CPU_ZERO(&thread_pool_cpus);
+    for (cpu = first; cpu <= last; cpu++) {
+        CPU_SET(cpu, &thread_pool_cpus);
+    }
+    thread_pool_has_cpus = true;
+    return 0;
+#else
+    error_setg(errp, "Thread pool CPU affinity is not supported on this host");
+    return -ENOTSUP;
+#endif
+}
@@ -82,6 +82,7 @@ int main(int argc, char **argv)
 #include "qemu/bitmap.h"
 #include "qemu/log.h"
 #include "sysemu/blockdev.h"
+#include "block/thread-pool.h"
 #include "hw/block/block.h"
 #include "migration/misc.h"
 #include "migration/snapshot.h"
@@ -119,6 +120,7 @@ int main(int argc, char **argv)
 #include "sysemu/arch_init.h"
 
 #include "qemu/etrace.h"
+#include "exec/tb-coverage.h"
 
 #include "ui/qemu-spice.h"
 #include "qapi/string-input-visitor.h"
@@ -136,6 +138,7 @@ int main(int argc, char **argv)
 
 static const char *data_dir[16];
 static int data_dir_idx;
+static const char *qemu_arg_coverage;
 const char *bios_name = NULL;
 enum vga_retrace_method vga_retrace_method = VGA_RETRACE_DUMB;
 int request_opengl = -1;
@@ -339,6 +342,22 @@ static QemuOptsList qemu_accel_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Enable/disable multi-threaded TCG",
         },
+        {
+            .name = "poll-skip",
+            .type = QEMU_OPT_BOOL,
+            .help = "Fast-forward vCPUs polling MMIO status registers",
+        },
+        {
+            .name = "superblock-threshold",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Retranslate TBs entered this often as superblocks",
+        },
+        {
+            .name = "tb-hugepages",
+            .type = QEMU_OPT_STRING,
+            .help = "Back the translation buffer with huge pages "
+                    "(off, thp or hugetlb)",
+        },
         { /* end of list */ }
     },
 };
@@ -442,6 +461,21 @@ static QemuOptsList qemu_msg_opts = {
     },
 };
 
+static QemuOptsList qemu_thread_pool_opts = {
+    .name = "thread-pool",
+    .head = QTAILQ_HEAD_INITIALIZER(qemu_thread_pool_opts.head),
+    .desc = {
+        {
+            .name = "max-threads",
+            .type = QEMU_OPT_NUMBER,
+        }, {
+            .name = "cpus",
+            .type = QEMU_OPT_STRING,
+        },
+        { /* end of list */ }
+    },
+};
+
 static QemuOptsList qemu_name_opts = {
     .name = "name",
     .implied_opt_name = "guest",
@@ -515,6 +549,12 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rrperiod",
+            .type = QEMU_OPT_NUMBER,
+        }, {
+            .name = "quantum",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -1371,6 +1411,41 @@ static void configure_msg(QemuOpts *opts)
     enable_timestamp_msg = qemu_opt_get_bool(opts, "timestamp", true);
 }
 
+static void configure_thread_pool(QemuOpts *opts)
+{
+    const char *cpus = qemu_opt_get(opts, "cpus");
+    uint64_t max_threads = qemu_opt_get_number(opts, "max-threads", 0);
+
+    if (qemu_opt_find(opts, "max-threads")) {
+        if (max_threads < 1 || max_threads > INT_MAX) {
+            error_report("thread-pool: max-threads must be at least 1");
+            exit(1);
+        }
+        thread_pool_set_max_threads(max_threads);
+    }
+
+    if (cpus) {
+        unsigned long first, last;
+        const char *end;
+
+        if (qemu_strtoul(cpus, &end, 10, &first) < 0 ||
+            (*end == '-' && qemu_strtoul(end + 1, &end, 10, &last) < 0)) {
+            error_report("thread-pool: invalid CPU range '%s'", cpus);
+            exit(1);
+        }
+        if (*end) {
+            error_report("thread-pool: invalid CPU range '%s'", cpus);
+            exit(1);
+        }
+        if (!strchr(cpus, '-')) {
+            last = first;
+        }
+        if (thread_pool_set_cpus(first, last, &error_fatal) < 0) {
+            exit(1);
+        }
+    }
+}
+
 /***********************************************************/
 /* Semihosting */
 
@@ -2489,6 +2564,14 @@ static int mon_init_func(void *opaque, QemuOpts *opts, Error **errp)
     if (qemu_opt_get_bool(opts, "pretty", 0))
         flags |= MONITOR_USE_PRETTY;
 
+    if (qemu_opt_get_bool(opts, "oob", false)) {
+        if (!(flags & MONITOR_USE_CONTROL)) {
+            error_report("option 'oob' requires mode=control");
+            exit(1);
+        }
+        flags |= MONITOR_USE_OOB;
+    }
+
     if (qemu_opt_get_bool(opts, "default", 0)) {
         error_report("option 'default' does nothing and is deprecated");
     }
@@ -3178,6 +3261,7 @@ int main(int argc, char **argv, char **envp)
     qemu_add_opts(&qemu_tpmdev_opts);
     qemu_add_opts(&qemu_realtime_opts);
     qemu_add_opts(&qemu_msg_opts);
+    qemu_add_opts(&qemu_thread_pool_opts);
     qemu_add_opts(&qemu_name_opts);
     qemu_add_opts(&qemu_numa_opts);
     qemu_add_opts(&qemu_icount_opts);
@@ -3536,6 +3620,9 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_etrace_flags:
                 qemu_arg_etrace_flags = optarg;
                 break;
+            case QEMU_OPTION_coverage:
+                qemu_arg_coverage = optarg;
+                break;
             case QEMU_OPTION_mempath:
                 mem_path = optarg;
                 break;
@@ -4215,6 +4302,14 @@ int main(int argc, char **argv, char **envp)
                 }
                 configure_msg(opts);
                 break;
+            case QEMU_OPTION_thread_pool:
+                opts = qemu_opts_parse_noisily(qemu_find_opts("thread-pool"),
+                                               optarg, false);
+                if (!opts) {
+                    exit(1);
+                }
+                configure_thread_pool(opts);
+                break;
             case QEMU_OPTION_dump_vmstate:
                 if (vmstate_dump_file) {
                     error_report("only one '-dump-vmstate' "
@@ -4258,6 +4353,10 @@ int main(int argc, char **argv, char **envp)
         atexit(qemu_etrace_cleanup);
     }
 
+    if (qemu_arg_coverage) {
+        tb_coverage_init(qemu_arg_coverage);
+    }
+
     if (pid_file && qemu_create_pidfile(pid_file) != 0) {
         error_report("could not acquire pid file: %s", strerror(errno));
         exit(1);